@@ -27,6 +27,7 @@ typedef struct CypherExecutor CypherExecutor;
 typedef struct CypherIterator CypherIterator;
 typedef struct ExecutionContext ExecutionContext;
 typedef struct CypherResult CypherResult;
+typedef struct CypherBatch CypherBatch;
 typedef struct CypherValue CypherValue;
 
 /*
@@ -68,6 +69,11 @@ struct CypherValue {
       CypherValue *apValues;
       int nPairs;
     } map;
+    struct {                    /* Path value */
+      sqlite3_int64 *aNodeIds;  /* nLength+1 nodes, start first */
+      sqlite3_int64 *aRelIds;   /* nLength relationships */
+      int nLength;
+    } path;
   } u;
 };
 
@@ -82,6 +88,48 @@ struct CypherResult {
   int nColumnsAlloc;            /* Allocated column space */
 };
 
+/*
+** Most rows moved by one xNextBatch call.
+*/
+#define CYPHER_BATCH_SIZE 1024
+
+/*
+** One column of a batch. A column whose values are all nodes, all
+** relationships or all integers keeps them unboxed in aInt and type says
+** which; any other column holds full values in aValue and its type is
+** CYPHER_VALUE_NULL. Both vectors have CYPHER_BATCH_SIZE entries.
+*/
+typedef struct CypherVector {
+  char *zName;                  /* Column name */
+  CypherValueType type;         /* Type of the aInt entries, or NULL */
+  sqlite3_int64 *aInt;          /* Ids or integers */
+  CypherValue *aValue;          /* Values, when aInt is not used */
+  int iSlot;                    /* Execution context slot, -1 if unknown */
+} CypherVector;
+
+/*
+** Batch of result rows stored column by column (vectorized execution).
+** Columns and their vectors survive cypherBatchReset(), so an operator
+** refilling the same batch allocates nothing per row.
+*/
+struct CypherBatch {
+  CypherVector *aCol;           /* Column vectors */
+  int nCol;                     /* Number of columns */
+  int nRow;                     /* Rows held by every vector */
+};
+
+/*
+** Reads the properties of nodes and relationships by id with their JSON
+** type, so that booleans, lists and maps keep it. Lookups are prepared on
+** first use and the JSON path of each property is built once.
+*/
+typedef struct CypherPropertyReader {
+  GraphVtab *pGraph;            /* Graph the ids belong to */
+  sqlite3_stmt *apStmt[2];      /* Node and relationship lookups */
+  char **azPath;                /* Property name, JSON path pairs */
+  int nPath;                    /* Number of pairs */
+} CypherPropertyReader;
+
 /*
 ** Execution context structure.
 ** Manages state during query execution including variable bindings.
@@ -90,10 +138,11 @@ struct ExecutionContext {
   sqlite3 *pDb;                 /* Database connection */
   GraphVtab *pGraph;            /* Graph virtual table */
   
-  /* Variable bindings */
-  char **azVariables;           /* Variable names */
-  CypherValue *aBindings;       /* Variable values */
-  int nVariables;               /* Number of variables */
+  /* Variable bindings: a row frame with one slot per variable, the
+  ** variable's index in azVariables, resolved before execution */
+  char **azVariables;           /* Variable names, by slot */
+  CypherValue *aBindings;       /* Variable values, by slot */
+  int nVariables;               /* Number of slots */
   int nVariablesAlloc;          /* Allocated variable space */
   
   /* Execution state */
@@ -102,6 +151,9 @@ struct ExecutionContext {
   char *zErrorMsg;              /* Error message */
   int iErrorCode;               /* Error code */
   
+  /* Property reads of nodes and relationships for expressions */
+  CypherPropertyReader props;
+  
   /* Memory management */
   void **apAllocated;           /* Allocated memory blocks */
   int nAllocated;               /* Number of allocated blocks */
@@ -110,12 +162,15 @@ struct ExecutionContext {
 
 /*
 ** Base iterator interface (Volcano model).
-** All physical operators implement this interface.
+** All physical operators implement this interface. Operators that can
+** produce rows in bulk also implement xNextBatch; callers go through
+** cypherIteratorNextBatch(), which falls back to xNext for the rest.
 */
 struct CypherIterator {
   /* Virtual function table */
   int (*xOpen)(CypherIterator*);                    /* Initialize iterator */
   int (*xNext)(CypherIterator*, CypherResult*);     /* Get next result row */
+  int (*xNextBatch)(CypherIterator*, CypherBatch*); /* Get next rows, or NULL */
   int (*xClose)(CypherIterator*);                   /* Clean up iterator */
   void (*xDestroy)(CypherIterator*);                /* Destroy iterator */
   
@@ -199,6 +254,19 @@ ExecutionContext *executionContextCreate(sqlite3 *pDb, GraphVtab *pGraph);
 */
 void executionContextDestroy(ExecutionContext *pContext);
 
+/*
+** Set pValue, which must not hold a value, to property zProp of pObject:
+** read from the graph for a node or relationship, from the entries of a
+** map. A missing property, or any other object, gives NULL.
+*/
+int cypherPropertyRead(CypherPropertyReader *p, const CypherValue *pObject,
+                       const char *zProp, CypherValue *pValue);
+
+/*
+** Finalize the statements of a property reader and free its paths.
+*/
+void cypherPropertyReaderClose(CypherPropertyReader *p);
+
 /*
 ** Bind a variable to a value in the execution context.
 ** Returns SQLITE_OK on success, error code on failure.
@@ -211,6 +279,19 @@ int executionContextBind(ExecutionContext *pContext, const char *zVar, CypherVal
 */
 CypherValue *executionContextGet(ExecutionContext *pContext, const char *zVar);
 
+/*
+** Return the slot of a variable, adding an unbound slot for a new name.
+** Slots are resolved once, before execution, so that binding and reading
+** a variable per row is an array access. Returns -1 on allocation failure.
+*/
+int executionContextSlot(ExecutionContext *pContext, const char *zVar);
+
+/*
+** Bind the variable in slot iSlot to a copy of pValue.
+** Returns SQLITE_OK on success, error code on failure.
+*/
+int executionContextBindSlot(ExecutionContext *pContext, int iSlot, const CypherValue *pValue);
+
 /*
 ** Iterator creation functions.
 */
@@ -227,6 +308,13 @@ CypherIterator *cypherIteratorCreate(PhysicalPlanNode *pPlan, ExecutionContext *
 */
 void cypherIteratorDestroy(CypherIterator *pIterator);
 
+/*
+** Fill pBatch with the next rows of an iterator, through its xNextBatch
+** when it has one and otherwise up to CYPHER_BATCH_SIZE calls of xNext.
+** Returns SQLITE_DONE, with an empty batch, once the input is exhausted.
+*/
+int cypherIteratorNextBatch(CypherIterator *pIterator, CypherBatch *pBatch);
+
 /*
 ** Specific iterator implementations.
 */
@@ -243,12 +331,99 @@ CypherIterator *cypherAllNodesScanCreate(PhysicalPlanNode *pPlan, ExecutionConte
 */
 CypherIterator *cypherLabelIndexScanCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext);
 
+/*
+** Create a TypeIndexScan iterator.
+** Scans relationships of one type using the type_id index.
+*/
+CypherIterator *cypherTypeIndexScanCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext);
+
 /*
 ** Create a PropertyIndexScan iterator.
 ** Scans nodes/relationships with specific property values using property indexes.
 */
 CypherIterator *cypherPropertyIndexScanCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext);
 
+/*
+** Create a BitmapScan iterator.
+** Returns the nodes in the intersection of label and property bitmaps.
+*/
+CypherIterator *cypherBitmapScanCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext);
+
+/*
+** Create a RangeIndexScan iterator.
+** Scans nodes through a range index, in key order if the plan is ordered.
+*/
+CypherIterator *cypherRangeIndexScanCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext);
+
+/*
+** Create a FulltextScan iterator.
+** Returns the nodes a full-text index finds for CONTAINS, STARTS WITH and
+** ENDS WITH comparisons; the comparisons themselves are checked above it.
+*/
+CypherIterator *cypherFulltextScanCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext);
+
+/*
+** Create an Expand iterator (ExpandAll or ExpandInto).
+** Extends each input row along the edges of its bound start node.
+*/
+CypherIterator *cypherExpandCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext);
+
+/*
+** Create a VarLengthExpand iterator.
+** Extends each input row along every path of min..max relationships.
+*/
+CypherIterator *cypherVarLengthExpandCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext);
+
+/*
+** Create a ShortestPath iterator.
+** Binds the shortest paths between each pair of start and end nodes.
+*/
+CypherIterator *cypherShortestPathCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext);
+
+/*
+** Set the bytes a HashJoin, Distinct or Sort may hold before spilling to
+** temporary tables, for operators opened from now on. A limit of 0
+** restores their compile-time defaults and a negative one changes
+** nothing. Returns the limit set before the call.
+*/
+sqlite3_int64 cypherSpillLimit(sqlite3_int64 nLimit);
+
+/*
+** Create a HashJoin iterator.
+** Hashes the rows of its second child on the join variables and probes the
+** table with the rows of its first, spilling partitions to temporary tables
+** when the build side outgrows CYPHER_HASH_JOIN_MEMORY bytes.
+*/
+CypherIterator *cypherHashJoinCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext);
+
+/*
+** Create a NestedLoopJoin iterator.
+** Pairs every row of its first child with every row of its second, which
+** it holds in memory: the cross product of patterns sharing no variable.
+*/
+CypherIterator *cypherNestedLoopJoinCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext);
+
+/*
+** Create an Aggregation iterator.
+** Groups input rows on the plan's key columns and computes count, sum,
+** avg, min and max per group, or their mergeable partial state.
+*/
+CypherIterator *cypherAggregationCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext);
+
+/*
+** Create a Distinct iterator.
+** Produces each input row whose key columns, or whole row if the plan has
+** none, have not been seen before, moving the keys seen to a temporary
+** table when they outgrow CYPHER_DISTINCT_MEMORY bytes.
+*/
+CypherIterator *cypherDistinctCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext);
+
+/*
+** Create a Union iterator.
+** Produces the rows of each of its children in turn.
+*/
+CypherIterator *cypherUnionCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext);
+
 /*
 ** Create a Filter iterator.
 ** Filters input rows based on predicate expressions.
@@ -263,13 +438,16 @@ CypherIterator *cypherProjectionCreate(PhysicalPlanNode *pPlan, ExecutionContext
 
 /*
 ** Create a Sort iterator.
-** Sorts input rows based on specified criteria.
+** Orders input rows on the plan's sort keys, keeping only the first
+** nLimit rows if it is set, and spilling sorted runs to disk when the
+** rows do not fit in memory.
 */
 CypherIterator *cypherSortCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext);
 
 /*
 ** Create a Limit iterator.
-** Limits the number of output rows.
+** Skips the first nSkip input rows and produces at most nLimit of the
+** rest, closing its input as soon as it has them.
 */
 CypherIterator *cypherLimitCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext);
 
@@ -295,6 +473,13 @@ void cypherValueDestroy(CypherValue *pValue);
 */
 CypherValue *cypherValueCopy(CypherValue *pValue);
 
+/*
+** Copy pSrc into *pDest, which is overwritten without being freed. Only
+** strings, lists, maps and paths allocate.
+** Returns SQLITE_OK on success, SQLITE_NOMEM on allocation failure.
+*/
+int cypherValueCopyInto(CypherValue *pDest, const CypherValue *pSrc);
+
 /*
 ** Initialize a CypherValue to NULL.
 */
@@ -393,18 +578,37 @@ void cypherValueSetNode(CypherValue *pValue, sqlite3_int64 iNodeId);
 */
 void cypherValueSetRelationship(CypherValue *pValue, sqlite3_int64 iRelId);
 
+/*
+** Set a CypherValue to a path of nLength relationships.
+** Takes ownership of both arrays.
+*/
+void cypherValueSetPath(CypherValue *pValue, sqlite3_int64 *aNodeIds,
+                        sqlite3_int64 *aRelIds, int nLength);
+
 /*
 ** Parse JSON properties string and populate a CypherValue map.
 ** Returns SQLITE_OK on success, error code on failure.
 */
 int cypherParseJsonProperties(const char *zJson, CypherValue *pResult);
 
+/*
+** Parse any JSON value into a CypherValue: objects become maps, arrays
+** lists. Returns SQLITE_FORMAT if zJson is not well-formed.
+*/
+int cypherParseJsonValue(const char *zJson, CypherValue *pResult);
+
 /*
 ** Convert a CypherValue to JSON string representation.
 ** Caller must sqlite3_free() the returned string.
 */
 char *cypherValueToJson(const CypherValue *pValue);
 
+/*
+** Quote a string as a JSON string literal, escaping as needed.
+** Caller must sqlite3_free() the returned string.
+*/
+char *cypherJsonQuote(const char *z);
+
 /*
 ** Result management functions.
 */
@@ -421,6 +625,12 @@ CypherResult *cypherResultCreate(void);
 */
 void cypherResultDestroy(CypherResult *pResult);
 
+/*
+** Drop the columns of a result row after the first nKeep, keeping its
+** arrays so that the row can be refilled without allocating.
+*/
+void cypherResultTruncate(CypherResult *pResult, int nKeep);
+
 /*
 ** Add a column to a result row.
 ** Returns SQLITE_OK on success, error code on failure.
@@ -433,6 +643,75 @@ int cypherResultAddColumn(CypherResult *pResult, const char *zName, CypherValue
 */
 char *cypherResultToJson(CypherResult *pResult);
 
+/*
+** Encode a result row as a blob, for operators that spill rows to disk.
+** On success *paBlob must be freed with sqlite3_free().
+*/
+int cypherResultEncode(const CypherResult *pResult, unsigned char **paBlob,
+                       int *pnBlob);
+
+/*
+** Decode a blob written by cypherResultEncode(), appending its columns
+** to pResult. Returns SQLITE_CORRUPT if the blob is malformed.
+*/
+int cypherResultDecode(const unsigned char *aBlob, int nBlob, CypherResult *pResult);
+
+/*
+** Batch management functions.
+*/
+
+/*
+** Create an empty batch.
+** Returns NULL on allocation failure.
+*/
+CypherBatch *cypherBatchCreate(void);
+
+/*
+** Destroy a batch and free all associated memory.
+** Safe to call with NULL pointer.
+*/
+void cypherBatchDestroy(CypherBatch *pBatch);
+
+/*
+** Drop the rows of a batch, keeping its columns.
+*/
+void cypherBatchReset(CypherBatch *pBatch);
+
+/*
+** Return the index of the column zName, adding it if the batch has none.
+** eType is the type its values are expected to have: a node, relationship
+** or integer column is stored unboxed. Returns -1 on allocation failure.
+*/
+int cypherBatchAddColumn(CypherBatch *pBatch, const char *zName, CypherValueType eType);
+
+/*
+** Store a copy of pValue in column iCol of row iRow. An unboxed column
+** given another type of value is converted to hold full values, keeping
+** the entries of the rows before iRow.
+*/
+int cypherBatchSetValue(CypherBatch *pBatch, int iCol, int iRow, const CypherValue *pValue);
+
+/*
+** Read column iCol of row iRow into *pValue. The value still belongs to
+** the batch and must not be destroyed.
+*/
+void cypherBatchValue(CypherBatch *pBatch, int iCol, int iRow, CypherValue *pValue);
+
+/*
+** Append a result row to a batch, matching its columns by name.
+*/
+int cypherBatchAppendRow(CypherBatch *pBatch, CypherResult *pRow);
+
+/*
+** Add the columns of row iRow of a batch to pResult.
+*/
+int cypherBatchGetRow(CypherBatch *pBatch, int iRow, CypherResult *pResult);
+
+/*
+** Keep only the nSel rows of a batch listed, ascending, in aSel.
+*/
+void cypherBatchSelect(CypherBatch *pBatch, const int *aSel, int nSel);
+
 /*
 ** Get formatted JSON representation of a result row with indentation.
 ** Caller must sqlite3_free() the returned string.
@@ -76,6 +76,7 @@ typedef struct CypherExpression {
         /* Variable reference */
         struct {
             char *zName;
+            int iSlot;          /* Context slot, -1 until resolved */
         } variable;
         
         /* Property access */
@@ -126,6 +127,22 @@ int cypherExpressionEvaluate(const CypherExpression *pExpr,
                             ExecutionContext *pContext, 
                             CypherValue *pResult);
 
+/* Resolve the variables of an expression to context slots, once, before
+** it is evaluated per row */
+int cypherExpressionResolve(CypherExpression *pExpr, ExecutionContext *pContext);
+
+/* Compiled expression programs: an expression lowered to flat register
+** operations, with constants folded and functions resolved */
+typedef struct CypherProgram CypherProgram;
+
+int cypherExpressionCompile(const CypherExpression *pExpr, ExecutionContext *pContext,
+                            CypherProgram **ppProgram);
+int cypherProgramExecute(CypherProgram *pProgram, ExecutionContext *pContext,
+                         const CypherValue **ppResult);
+int cypherProgramEvaluate(CypherProgram *pProgram, ExecutionContext *pContext,
+                          CypherValue *pResult);
+void cypherProgramDestroy(CypherProgram *pProgram);
+
 /* Literal expression creation */
 int cypherExpressionCreateLiteral(CypherExpression **ppExpr, const CypherValue *pValue);
 int cypherExpressionCreateVariable(CypherExpression **ppExpr, const char *zName);
@@ -220,6 +237,9 @@ int cypherFunctionToString(CypherValue *apArgs, int nArgs, CypherValue *pResult)
 int cypherFunctionToInteger(CypherValue *apArgs, int nArgs, CypherValue *pResult);
 int cypherFunctionToFloat(CypherValue *apArgs, int nArgs, CypherValue *pResult);
 
+/* Graph functions */
+int cypherFunctionId(CypherValue *apArgs, int nArgs, CypherValue *pResult);
+
 /* Aggregate functions */
 int cypherFunctionCount(CypherValue *apArgs, int nArgs, CypherValue *pResult);
 int cypherFunctionSum(CypherValue *apArgs, int nArgs, CypherValue *pResult);
@@ -9,6 +9,7 @@
 #define CYPHER_PATHS_H
 
 #include "cypher.h"
+#include "graph.h"
 
 /* Path length bounds for variable-length patterns */
 typedef struct PathBounds {
@@ -43,6 +44,40 @@ typedef struct PathResult {
     struct PathResult *pNext;        /* Next path in result set */
 } PathResult;
 
+/* Directions a path may follow relationships in */
+#define CYPHER_PATH_OUTGOING  0   /* (a)-[*]->(b) */
+#define CYPHER_PATH_INCOMING  1   /* (a)<-[*]-(b) */
+#define CYPHER_PATH_BOTH      2   /* (a)-[*]-(b) */
+
+/*
+** Streaming path enumeration from one start node. In the default mode
+** every path within the bounds is returned once, depth first, with no
+** relationship used twice on a path. In pruning mode (CYPHER_PATH_PRUNE,
+** minimum length 0 or 1 only) each reachable end node is returned once,
+** found breadth first, and the path itself is not kept. In shortest-path
+** mode (CYPHER_PATH_SHORTEST) cypherPathWalkerStartPair() searches from
+** both ends at once and the walker returns one shortest path of at most
+** maxLength relationships, or all of them with CYPHER_PATH_ALL_SHORTEST.
+*/
+typedef struct PathWalker PathWalker;
+
+#define CYPHER_PATH_PRUNE         0x01
+#define CYPHER_PATH_SHORTEST      0x02
+#define CYPHER_PATH_ALL_SHORTEST  0x04
+
+int cypherPathWalkerCreate(GraphVtab *pGraph, const char *relType,
+                           int direction, PathBounds bounds, int flags,
+                           PathWalker **ppWalker);
+int cypherPathWalkerStart(PathWalker *pWalker, sqlite3_int64 startNode);
+int cypherPathWalkerStartPair(PathWalker *pWalker, sqlite3_int64 startNode,
+                              sqlite3_int64 endNode);
+int cypherPathWalkerNext(PathWalker *pWalker);     /* SQLITE_ROW or SQLITE_DONE */
+sqlite3_int64 cypherPathWalkerEnd(PathWalker *pWalker);
+int cypherPathWalkerLength(PathWalker *pWalker);
+const sqlite3_int64 *cypherPathWalkerEdges(PathWalker *pWalker); /* NULL if pruning */
+const sqlite3_int64 *cypherPathWalkerNodes(PathWalker *pWalker); /* NULL if pruning */
+void cypherPathWalkerDestroy(PathWalker *pWalker);
+
 /* Function declarations */
 
 /* Parse path bounds from pattern (e.g., "*1..3", "*", "*..5") */
@@ -33,11 +33,15 @@ typedef enum {
   LOGICAL_INDEX_SCAN,           /* Scan using property index */
   LOGICAL_RELATIONSHIP_SCAN,    /* Scan all relationships */
   LOGICAL_TYPE_SCAN,           /* Scan relationships by type */
+  LOGICAL_BITMAP_SCAN,         /* Intersect bitmap indexes */
+  LOGICAL_RANGE_SCAN,          /* Scan a range index in key order */
+  LOGICAL_FULLTEXT_SCAN,       /* Search a full-text index */
   
   /* Pattern Operations */
   LOGICAL_EXPAND,              /* Expand from node along relationships */
   LOGICAL_VAR_LENGTH_EXPAND,   /* Variable-length path expansion */
   LOGICAL_OPTIONAL_EXPAND,     /* Optional pattern matching */
+  LOGICAL_SHORTEST_PATH,       /* shortestPath() / allShortestPaths() */
   
   /* Filter Operations */
   LOGICAL_FILTER,              /* WHERE clause filtering */
@@ -52,6 +56,7 @@ typedef enum {
   /* Projection Operations */
   LOGICAL_PROJECTION,          /* SELECT/RETURN columns */
   LOGICAL_DISTINCT,            /* DISTINCT modifier */
+  LOGICAL_UNION,               /* UNION ALL of query results */
   LOGICAL_AGGREGATION,         /* GROUP BY and aggregates */
   
   /* Ordering Operations */
@@ -78,6 +83,15 @@ typedef enum {
   PHYSICAL_PROPERTY_INDEX_SCAN, /* Use property index for scanning */
   PHYSICAL_ALL_RELS_SCAN,      /* Sequential scan of all relationships */
   PHYSICAL_TYPE_INDEX_SCAN,    /* Use type index for relationships */
+  PHYSICAL_BITMAP_SCAN,        /* Intersect bitmap indexes, then fetch */
+  PHYSICAL_RANGE_INDEX_SCAN,   /* Use range index, in key order */
+  PHYSICAL_FULLTEXT_SCAN,      /* Search a full-text index */
+  
+  /* Pattern Operators */
+  PHYSICAL_EXPAND_ALL,         /* Walk adjacency, binding the far node */
+  PHYSICAL_EXPAND_INTO,        /* Walk adjacency to an already bound node */
+  PHYSICAL_VAR_LENGTH_EXPAND,  /* Walk paths of min..max relationships */
+  PHYSICAL_SHORTEST_PATH,      /* Bidirectional BFS between two nodes */
   
   /* Join Operators */
   PHYSICAL_HASH_JOIN,          /* In-memory hash join */
@@ -89,9 +103,56 @@ typedef enum {
   PHYSICAL_PROJECTION,         /* Column projection */
   PHYSICAL_SORT,               /* External sorting */
   PHYSICAL_LIMIT,              /* Result limiting */
-  PHYSICAL_AGGREGATION         /* Grouping and aggregation */
+  PHYSICAL_AGGREGATION,        /* Grouping and aggregation */
+  PHYSICAL_DISTINCT,           /* Hashed duplicate elimination */
+  PHYSICAL_UNION               /* Concatenation of query results */
 } PhysicalOperatorType;
 
+/*
+** Comparison of one property against a literal. An index scan carries the
+** comparisons it answers from its index, in index column order, and any
+** scan the filters pushed into its SQL.
+*/
+typedef struct PlanPredicate {
+  char *zProperty;              /* Property name, NULL to compare the id */
+  char *zOperator;              /* "=", "<", "<=", ">", ">=" or a string
+                                ** operator such as "CONTAINS" */
+  char *zValue;                 /* Literal value */
+} PlanPredicate;
+
+/*
+** Output column of an aggregation: a grouping key when zFunction is NULL,
+** otherwise an aggregate ("count", "sum", "avg", "min" or "max") of a
+** variable or of one of its properties. count(*) has no variable. Sorts
+** and DISTINCT use the same structure for their keys, without functions.
+*/
+typedef struct PlanColumn {
+  char *zFunction;              /* Aggregate function, NULL for a key */
+  char *zVariable;              /* Variable, NULL for count(*) */
+  char *zProperty;              /* Property of zVariable, or NULL */
+  char *zName;                  /* Output column name */
+  int bDistinct;                /* Aggregate distinct values only */
+  int bDesc;                    /* Sort key is descending */
+} PlanColumn;
+
+/*
+** Bits of LogicalPlanNode.iFlags, copied to PhysicalPlanNode.iFlags.
+*/
+#define PLAN_FLAG_DESC      0x01  /* Sort or ordered scan is descending */
+#define PLAN_FLAG_ORDERED   0x02  /* Scan returns its key order; a sort
+                                  ** marked so is satisfied by such a scan */
+#define PLAN_FLAG_DATE_KEY  0x04  /* Range scan key is an ISO-8601 date */
+#define PLAN_FLAG_INCOMING  0x08  /* Expand follows edges into the start node */
+#define PLAN_FLAG_UNDIRECTED 0x10 /* Expand follows edges either way */
+#define PLAN_FLAG_EXPAND_INTO 0x20 /* Expand target is bound before the expand */
+#define PLAN_FLAG_PRUNE_PATHS 0x40 /* Variable-length expand needs each end
+                                   ** node once, not every path to it */
+#define PLAN_FLAG_ALL_PATHS   0x80 /* allShortestPaths(): every shortest path */
+#define PLAN_FLAG_AGG_PARTIAL 0x100 /* Aggregation emits mergeable per-group
+                                    ** state instead of final values */
+#define PLAN_FLAG_AGG_FINAL   0x200 /* Aggregation merges the rows of partial
+                                    ** aggregations */
+
 /*
 ** Logical plan node structure.
 ** Forms a tree representing the logical query structure.
@@ -102,6 +163,31 @@ typedef struct LogicalPlanNode {
   char *zLabel;                 /* Node label (for scans) */
   char *zProperty;              /* Property name (for filters/indexes) */
   char *zValue;                 /* Literal value (for filters) */
+  char *zOperator;              /* Comparison operator (NULL means "=") */
+  char *zIndexName;             /* Property index chosen by the planner */
+  PlanPredicate *aIndexKey;     /* Comparisons answered by zIndexName */
+  int nIndexKey;
+  PlanPredicate *aScanFilter;   /* Comparisons evaluated by the scan SQL */
+  int nScanFilter;
+  
+  /* Relationship step (expand); zAlias and zLabel describe the far node */
+  char *zFromAlias;             /* Bound node the step starts from */
+  char *zRelAlias;              /* Relationship variable, or NULL */
+  char *zRelType;               /* Relationship type, or NULL for any */
+  int nMinHops;                 /* Variable-length step: path length bounds, */
+  int nMaxHops;                 /* nMaxHops -1 if unbounded */
+  char *zPathAlias;             /* Path variable (p = shortestPath(...)) */
+  char *zJoinKeys;              /* Hash join: comma-separated variables bound
+                                ** by both sides, NULL for a cross product */
+  char *zDistinctRels;          /* Join of comma patterns: their relationship
+                                ** variables, no two bound to one edge */
+  PlanColumn *aColumn;          /* Aggregation: keys and aggregates; */
+  int nColumn;                  /* Sort: sort keys, outermost first;
+                                ** Distinct: the columns produced;
+                                ** Projection: the names of the items */
+  struct CypherExpression **apExpr; /* Filter: the condition; projection:
+                                ** one expression per RETURN item */
+  int nExpr;
   
   /* Child operations */
   struct LogicalPlanNode **apChildren;
@@ -133,6 +219,23 @@ typedef struct PhysicalPlanNode {
   char *zLabel;                 /* Label for scans */
   char *zProperty;              /* Property for filters/indexes */
   char *zValue;                 /* Filter value */
+  PlanPredicate *aIndexKey;     /* Index search key (index scans) */
+  int nIndexKey;
+  PlanPredicate *aScanFilter;   /* Node scans: comparisons in the scan SQL */
+  int nScanFilter;
+  char *zFromAlias;             /* Expand: bound start node */
+  char *zRelAlias;              /* Expand: relationship variable */
+  char *zRelType;               /* Expand: relationship type, NULL for any */
+  int nMinHops;                 /* VarLengthExpand: path length bounds, */
+  int nMaxHops;                 /* nMaxHops -1 if unbounded */
+  char *zPathAlias;             /* ShortestPath: path variable, or NULL */
+  char *zJoinKeys;              /* HashJoin: comma-separated join variables */
+  char *zDistinctRels;          /* Joins: relationship variables that must
+                                ** bind different edges */
+  PlanColumn *aColumn;          /* Aggregation: keys and aggregates; */
+  int nColumn;                  /* Sort: sort keys, outermost first;
+                                ** Distinct: the columns produced;
+                                ** Projection: the names of the items */
   
   /* Child operators */
   struct PhysicalPlanNode **apChildren;
@@ -140,7 +243,7 @@ typedef struct PhysicalPlanNode {
   int nChildren;
   int nChildrenAlloc;
   
-  /* Filter and projection expressions */
+  /* Filter and projection expressions, owned by the logical plan */
   struct CypherExpression *pFilterExpr;      /* Filter expression */
   struct CypherExpression **apProjections;   /* Projection expressions */
   int nProjections;                          /* Number of projections */
@@ -148,7 +251,11 @@ typedef struct PhysicalPlanNode {
   /* Sort and limit parameters */
   struct CypherExpression **apSortKeys;      /* Sort key expressions */
   int nSortKeys;                             /* Number of sort keys */
-  int nLimit;                                /* LIMIT value */
+  int nLimit;                                /* LIMIT value, -1 for none; for
+                                             ** a sort or scan, the rows kept
+                                             ** (0 for all) */
+  int nSkip;                                 /* SKIP value: rows dropped
+                                             ** before nLimit counts */
   
   /* Cost and statistics */
   double rCost;                 /* Actual estimated cost */
@@ -177,13 +284,28 @@ typedef struct PlanContext {
   
   /* Available indexes */
   char **azLabelIndexes;        /* Available label indexes */
-  char **azPropertyIndexes;     /* Available property indexes */
+  char **azPropertyIndexes;     /* Available property indexes, by name */
+  char **azIndexLabels;         /* Label of each property index ("" = all) */
+  char **azIndexColumns;        /* Comma-separated properties of each index */
+  char **azBitmapIndexes;       /* Properties with a bitmap index */
+  char **azRangeIndexes;        /* Available range indexes, by name */
+  char **azRangeLabels;         /* Label of each range index ("" = all) */
+  char **azRangeProps;          /* Property of each range index */
+  char **azRangeTypes;          /* Key type of each range index */
+  char **azFulltextIndexes;     /* Available full-text indexes, by name */
+  char **azFulltextLabels;      /* Label of each full-text index ("" = all) */
+  char **azFulltextProps;       /* Property of each full-text index */
+  char **azFulltextTokenizers;  /* FTS5 tokenizer of each full-text index */
   int nLabelIndexes;
   int nPropertyIndexes;
+  int nBitmapIndexes;
+  int nRangeIndexes;
+  int nFulltextIndexes;
   
   /* Optimization settings */
   int bUseIndexes;              /* Enable index usage */
   int bReorderJoins;            /* Enable join reordering */
+  int bPushdown;                /* Push filters into the scan SQL */
   double rIndexCostFactor;      /* Index vs scan cost factor */
   
   /* Error tracking */
@@ -273,6 +395,50 @@ int logicalPlanNodeSetAlias(LogicalPlanNode *pNode, const char *zAlias);
 int logicalPlanNodeSetLabel(LogicalPlanNode *pNode, const char *zLabel);
 int logicalPlanNodeSetProperty(LogicalPlanNode *pNode, const char *zProperty);
 int logicalPlanNodeSetValue(LogicalPlanNode *pNode, const char *zValue);
+int logicalPlanNodeSetOperator(LogicalPlanNode *pNode, const char *zOperator);
+
+/*
+** Append a comparison to the index key of a logical plan node.
+** Returns SQLITE_OK on success, SQLITE_NOMEM on allocation failure.
+*/
+int logicalPlanNodeAddIndexKey(LogicalPlanNode *pNode, const char *zProperty,
+                               const char *zOperator, const char *zValue);
+
+/*
+** Append a comparison to the filters a scan evaluates in its SQL. A NULL
+** zProperty compares the node id. Returns SQLITE_OK on success,
+** SQLITE_NOMEM on allocation failure.
+*/
+int logicalPlanNodeAddScanFilter(LogicalPlanNode *pNode, const char *zProperty,
+                                 const char *zOperator, const char *zValue);
+
+/*
+** Copy or free an array of plan predicates.
+*/
+PlanPredicate *planPredicatesCopy(const PlanPredicate *aPred, int nPred);
+void planPredicatesFree(PlanPredicate *aPred, int nPred);
+
+/*
+** Return the text of a quoted literal from a plan, such as the value of
+** a predicate, without its quotes and escapes. Returns NULL if zValue is
+** not quoted or on OOM. Caller must sqlite3_free() the result.
+*/
+char *planLiteralText(const char *zValue);
+
+/*
+** Append an output column to an aggregation node, or a key to a sort
+** node. zFunction is NULL for a grouping or sort key. Returns SQLITE_OK
+** or SQLITE_NOMEM.
+*/
+int logicalPlanNodeAddColumn(LogicalPlanNode *pNode, const char *zFunction,
+                             const char *zVariable, const char *zProperty,
+                             const char *zName, int bDistinct);
+
+/*
+** Copy or free an array of plan columns.
+*/
+PlanColumn *planColumnsCopy(const PlanColumn *aCol, int nCol);
+void planColumnsFree(PlanColumn *aCol, int nCol);
 
 /*
 ** Physical plan construction functions.
@@ -190,6 +190,10 @@ struct CypherAst {
     int iFlags; // General purpose flags (e.g., DISTINCT for RETURN clause)
 };
 
+// Bits of CypherAst.iFlags
+#define CYPHER_AST_FLAG_DISTINCT 0x01 // RETURN DISTINCT / WITH DISTINCT
+#define CYPHER_AST_FLAG_ALL      0x02 // UNION ALL
+
 // AST Node creation functions
 CypherAst *cypherAstCreate(CypherAstNodeType type, int iLine, int iColumn);
 CypherAst *cypherAstCreateIdentifier(const char *zName, int iLine, int iColumn);
@@ -27,8 +27,10 @@ typedef struct GraphPropertySchema GraphPropertySchema;
 */
 struct CypherSchema {
   char **azNodeLabels;    /* Array of known node labels */
+  sqlite3_int64 *aiNodeLabelIds; /* Interned id of each label, 0 if unknown */
   int nNodeLabels;        /* Number of node labels */
   char **azRelTypes;      /* Array of known relationship types */
+  sqlite3_int64 *aiRelTypeIds;   /* Interned id of each type, 0 if unknown */
   int nRelTypes;          /* Number of relationship types */
   GraphPropertySchema *pPropSchema; /* Property schemas by label/type */
 };
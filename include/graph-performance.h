@@ -44,21 +44,26 @@ typedef struct PatternOptimizer {
 ** Index Utilization Improvements
 */
 
-/* Composite index structure */
+/* Composite index structure, describing a SQLite index over the
+** properties in order (see graphCreatePropertyIndex()) */
 typedef struct CompositeIndex {
     char *indexName;             /* Index name */
+    char *label;                 /* Label the index is scoped to, or NULL */
     char **properties;           /* Array of property names */
     int nProperties;             /* Number of properties */
-    void *btree;                 /* B-tree implementation */
     sqlite3_int64 nEntries;      /* Number of entries */
 } CompositeIndex;
 
-/* Bitmap index for set operations */
+/* Compressed set of node ids (see graph-bitmap.c) */
+typedef struct GraphBitmap GraphBitmap;
+
+/* Bitmap index for set operations: one bitmap per distinct value */
 typedef struct BitmapIndex {
-    char *property;              /* Indexed property */
-    unsigned char *bitmap;       /* Bitmap data */
-    sqlite3_int64 nBits;         /* Number of bits */
-    sqlite3_int64 nNodes;        /* Number of nodes */
+    char *property;              /* Indexed property, NULL for labels */
+    char **values;               /* Distinct values, as graphBitmapKey()s */
+    GraphBitmap **bitmaps;       /* Nodes having each value */
+    int nValues;                 /* Number of distinct values */
+    sqlite3_int64 nNodes;        /* Number of indexed nodes */
 } BitmapIndex;
 
 /* Index statistics for query planning */
@@ -163,12 +168,33 @@ int graphEliminateCartesianProduct(PhysicalPlanNode *plan);
 
 /* Index operations */
 CompositeIndex* graphCreateCompositeIndex(GraphVtab *pGraph,
+                                         const char *label,
                                          const char **properties,
                                          int nProperties);
+void graphDestroyCompositeIndex(CompositeIndex *index);
 BitmapIndex* graphCreateBitmapIndex(GraphVtab *pGraph,
                                    const char *property);
-int graphIntersectBitmaps(BitmapIndex *idx1, BitmapIndex *idx2,
-                         unsigned char *result);
+void graphDestroyBitmapIndex(BitmapIndex *index);
+char *graphBitmapKey(const char *zType, const char *zText);
+const GraphBitmap *graphBitmapIndexLookup(const BitmapIndex *index,
+                                          const char *zValue);
+int graphGetBitmapIndex(GraphVtab *pGraph, const char *property,
+                        const BitmapIndex **ppIndex);
+int graphBitmapIntersect(GraphVtab *pGraph, const char *zLabel,
+                         const char **azProp, const char **azValue, int nProp,
+                         GraphBitmap **ppResult);
+
+/* Compressed bitmaps */
+GraphBitmap *graphBitmapCreate(void);
+void graphBitmapDestroy(GraphBitmap *p);
+int graphBitmapAdd(GraphBitmap *p, sqlite3_int64 iNode);
+int graphBitmapContains(const GraphBitmap *p, sqlite3_int64 iNode);
+sqlite3_int64 graphBitmapCount(const GraphBitmap *p);
+GraphBitmap *graphBitmapAnd(const GraphBitmap *pA, const GraphBitmap *pB);
+GraphBitmap *graphBitmapOr(const GraphBitmap *pA, const GraphBitmap *pB);
+GraphBitmap *graphBitmapAndNot(const GraphBitmap *pA, const GraphBitmap *pB);
+int graphBitmapToArray(const GraphBitmap *p, sqlite3_int64 **paNodes,
+                       int *pnNodes);
 
 /* Memory management */
 QueryMemoryPool* graphCreateMemoryPool(size_t initialSize);
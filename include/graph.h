@@ -59,6 +59,7 @@ struct GraphEdge {
 ** Forward declarations for schema structures
 */
 typedef struct CypherSchema CypherSchema;
+typedef struct GraphBitmapCache GraphBitmapCache;
 
 /*
 ** Enhanced graph virtual table structure with schema and indexing support.
@@ -77,11 +78,15 @@ struct GraphVtab {
   void *pLabelIndex;  /* Label-based node index */
   void *pPropertyIndex; /* Property-based index */
   CypherSchema *pSchema;  /* Schema information for labels/types */
+  GraphBitmapCache *pBitmapCache; /* Bitmap indexes built so far */
+  int bTypeIndex;         /* <graph>_rel_types maintains edge type_id */
 };
 
 /* A global pointer to the graph virtual table. Not ideal, but simple. */
 extern GraphVtab *pGraph;
 
+#define GRAPH_VTAB_NCOL 9    /* Columns declared by the graph vtab */
+
 /*
 ** Graph cursor structure for virtual table iteration.
 ** Subclass of sqlite3_vtab_cursor following SQLite patterns.
@@ -94,6 +99,11 @@ struct GraphCursor {
   sqlite3_stmt *pNodeStmt;  /* Statement for node iteration */
   sqlite3_stmt *pEdgeStmt;  /* Statement for edge iteration */
   int iIterMode;            /* 0=nodes, 1=edges */
+  int aNodeCol[GRAPH_VTAB_NCOL]; /* pNodeStmt column per vtab column, or -1 */
+  int aEdgeCol[GRAPH_VTAB_NCOL]; /* pEdgeStmt column per vtab column, or -1 */
+  int bLazyProps;           /* Fetch properties only when xColumn asks */
+  sqlite3_stmt *pNodePropStmt; /* Deferred node properties lookup */
+  sqlite3_stmt *pEdgePropStmt; /* Deferred edge properties lookup */
 };
 
 /*
@@ -338,6 +348,146 @@ int graphAddEdgeWithType(GraphVtab *pVtab, sqlite3_int64 iFromId,
                          sqlite3_int64 iToId, const char *zType,
                          double rWeight, const char *zProperties);
 
+/*
+** Free the schema cache hanging off GraphVtab.pSchema.
+*/
+void graphDestroySchema(CypherSchema *pSchema);
+
+/*
+** Create the <graph>_labels / <graph>_label_index tables and the node
+** table triggers that keep them current. Called when the vtab is created
+** or connected.
+*/
+int graphInitLabelIndex(GraphVtab *pVtab);
+
+/*
+** Rebuild the label index from the node table.
+** zLabel, if not NULL, is interned even if no node carries it yet.
+*/
+int graphCreateLabelIndex(GraphVtab *pVtab, const char *zLabel);
+
+/*
+** Map a label to its interned integer id, or 0 if it is unknown.
+*/
+int graphLookupLabelId(GraphVtab *pVtab, const char *zLabel,
+                       sqlite3_int64 *piLabelId);
+
+/*
+** Create the <graph>_rel_types table and the edge table triggers that
+** keep the integer type_id column in step with rel_type.
+*/
+int graphInitTypeIndex(GraphVtab *pVtab);
+
+/*
+** Map a relationship type to its interned integer id, or 0 if unknown.
+*/
+int graphLookupRelTypeId(GraphVtab *pVtab, const char *zType,
+                         sqlite3_int64 *piTypeId);
+
+/*
+** Prepare "SELECT id, <neighbor>" over the outgoing (bIncoming==0) or
+** incoming edges of node ?1, optionally restricted to one relationship
+** type through the (from_id, type_id) / (to_id, type_id) indexes.
+*/
+int graphPrepareAdjacency(GraphVtab *pVtab, int bIncoming, const char *zType,
+                          sqlite3_stmt **ppStmt);
+
+/*
+** Node property expression used by property indexes, and the label test
+** that scopes a property index to one label. Both are sqlite3_mprintf()
+** formats; index DDL and lookups must spell them identically for SQLite
+** to match the query to the index.
+*/
+#define GRAPH_PROPERTY_EXPR "json_extract(properties, '$.%q')"
+#define GRAPH_LABEL_HINT    "instr(labels, '%q') > 0"
+
+/*
+** SQL expression that turns the labels column of row R into a value
+** json_each() can iterate. Labels are normally a JSON array, but some
+** callers store a bare label string, which counts as a single label.
+*/
+#define GRAPH_LABELS_JSON(R) \
+  "CASE WHEN json_valid(" R ".labels) THEN " R ".labels " \
+  "ELSE json_array(" R ".labels) END"
+
+/*
+** Key of a date range index: the Julian day number of an ISO-8601
+** property value, NULL for any other value. The GLOB keeps values like
+** 'now' away from julianday(), which may not be non-deterministic inside
+** an index. The format takes the property name twice.
+*/
+#define GRAPH_DATE_EXPR "julianday(CASE WHEN " GRAPH_PROPERTY_EXPR \
+  " GLOB '[0-9][0-9][0-9][0-9]-*' THEN " GRAPH_PROPERTY_EXPR " END)"
+
+/*
+** Return true if z can name an indexed label or property.
+*/
+int graphIsIdentifier(const char *z);
+
+/*
+** Property indexes (graph-schema.c). zLabel NULL or "" means all nodes.
+** zProperty is a property name or a comma-separated list of them.
+*/
+int graphCreatePropertyIndex(GraphVtab *pVtab, const char *zLabel,
+                             const char *zProperty);
+int graphDropPropertyIndex(GraphVtab *pVtab, const char *zLabel,
+                           const char *zProperty);
+char *graphPropertyIndexName(GraphVtab *pVtab, const char *zLabel,
+                             const char *zProperty);
+int graphLoadPropertyIndexes(GraphVtab *pVtab, char ***pazNames,
+                             char ***pazLabels, char ***pazColumns,
+                             int *pnNames);
+
+/*
+** Range indexes (graph-schema.c) keep the nodes ordered by one numeric
+** ("number") or ISO-8601 date ("date") property, so that they answer
+** ORDER BY as well as inequalities. zLabel NULL or "" means all nodes.
+*/
+int graphCreateRangeIndex(GraphVtab *pVtab, const char *zLabel,
+                          const char *zProperty, const char *zType);
+int graphDropRangeIndex(GraphVtab *pVtab, const char *zLabel,
+                        const char *zProperty);
+char *graphRangeIndexName(GraphVtab *pVtab, const char *zLabel,
+                          const char *zProperty);
+char *graphRangeKeyExpr(const char *zType, const char *zProperty);
+int graphLoadRangeIndexes(GraphVtab *pVtab, char ***pazNames,
+                          char ***pazLabels, char ***pazProps,
+                          char ***pazTypes, int *pnNames);
+
+/*
+** Full-text indexes (graph-schema.c) keep the text values of one property
+** in a contentless FTS5 table keyed by node id. zLabel NULL or "" means
+** all nodes; zTokenizer NULL means "trigram".
+*/
+int graphIsFulltextTokenizer(const char *zTokenizer);
+int graphCreateFulltextIndex(GraphVtab *pVtab, const char *zLabel,
+                             const char *zProperty, const char *zTokenizer);
+int graphDropFulltextIndex(GraphVtab *pVtab, const char *zLabel,
+                           const char *zProperty);
+char *graphFulltextIndexName(GraphVtab *pVtab, const char *zLabel,
+                             const char *zProperty);
+int graphLoadFulltextIndexes(GraphVtab *pVtab, char ***pazNames,
+                             char ***pazLabels, char ***pazProps,
+                             char ***pazTokenizers, int *pnNames);
+
+/*
+** Vector indexes (graph-vector.c) keep an HNSW graph over a property
+** holding fixed-dimension float vectors, searched by graph_knn().
+*/
+int graphCreateVectorIndex(GraphVtab *pVtab, const char *zLabel,
+                           const char *zProperty, int nDim, const char *zMetric,
+                           int nM, int nEfConstruction);
+int graphDropVectorIndex(GraphVtab *pVtab, const char *zLabel,
+                         const char *zProperty);
+char *graphVectorIndexName(GraphVtab *pVtab, const char *zLabel,
+                           const char *zProperty);
+
+/*
+** Bitmap indexes (graph-bitmap.c).
+*/
+int graphLoadBitmapIndexes(GraphVtab *pVtab, char ***pazProps, int *pnProps);
+void graphBitmapCacheDestroy(GraphBitmapCache *pCache);
+
 /*
 ** Find nodes by label using index.
 ** Returns linked list of nodes with specified label.
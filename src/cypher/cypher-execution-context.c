@@ -38,6 +38,7 @@ ExecutionContext *executionContextCreate(sqlite3 *pDb, GraphVtab *pGraph) {
   memset(pContext, 0, sizeof(ExecutionContext));
   pContext->pDb = pDb;
   pContext->pGraph = pGraph;
+  pContext->props.pGraph = pGraph;
   
   return pContext;
 }
@@ -65,29 +66,123 @@ void executionContextDestroy(ExecutionContext *pContext) {
   }
   sqlite3_free(pContext->apAllocated);
   
+  cypherPropertyReaderClose(&pContext->props);
   sqlite3_free(pContext->zErrorMsg);
   sqlite3_free(pContext);
 }
 
 /*
-** Bind a variable to a value in the execution context.
-** Returns SQLITE_OK on success, error code on failure.
+** Return the JSON path of property zProp, building it on first use.
 */
-int executionContextBind(ExecutionContext *pContext, const char *zVar, CypherValue *pValue) {
+static const char *propertyReaderPath(CypherPropertyReader *p, const char *zProp) {
   char **azNew;
-  CypherValue *aNew;
   int i;
   
-  if( !pContext || !zVar || !pValue ) return SQLITE_MISUSE;
+  for( i = 0; i < p->nPath; i++ ) {
+    if( strcmp(p->azPath[i*2], zProp) == 0 ) return p->azPath[i*2+1];
+  }
+  azNew = sqlite3_realloc(p->azPath, (p->nPath + 1) * 2 * sizeof(char*));
+  if( !azNew ) return NULL;
+  p->azPath = azNew;
+  azNew[i*2] = sqlite3_mprintf("%s", zProp);
+  azNew[i*2+1] = sqlite3_mprintf("$.\"%w\"", zProp);
+  if( !azNew[i*2] || !azNew[i*2+1] ) {
+    sqlite3_free(azNew[i*2]);
+    sqlite3_free(azNew[i*2+1]);
+    return NULL;
+  }
+  p->nPath++;
+  return azNew[i*2+1];
+}
+
+int cypherPropertyRead(CypherPropertyReader *p, const CypherValue *pObject,
+                       const char *zProp, CypherValue *pValue) {
+  const char *zPath;
+  const char *zType;
+  sqlite3_stmt *pStmt;
+  int bRel, rc, i;
   
-  /* Check if variable already exists */
-  for( i = 0; i < pContext->nVariables; i++ ) {
-    if( strcmp(pContext->azVariables[i], zVar) == 0 ) {
-      /* Update existing binding */
-      cypherValueDestroy(&pContext->aBindings[i]);
-      pContext->aBindings[i] = *cypherValueCopy(pValue);
-      return SQLITE_OK;
+  cypherValueInit(pValue);
+  if( pObject->type == CYPHER_VALUE_MAP ) {
+    for( i = 0; i < pObject->u.map.nPairs; i++ ) {
+      if( strcmp(pObject->u.map.azKeys[i], zProp) == 0 ) {
+        return cypherValueCopyInto(pValue, &pObject->u.map.apValues[i]);
+      }
     }
+    return SQLITE_OK;
+  }
+  if( pObject->type != CYPHER_VALUE_NODE && pObject->type != CYPHER_VALUE_RELATIONSHIP ) {
+    return SQLITE_OK;
+  }
+  if( !p->pGraph ) return SQLITE_ERROR;
+  
+  bRel = pObject->type == CYPHER_VALUE_RELATIONSHIP;
+  if( !p->apStmt[bRel] ) {
+    char *zSql = sqlite3_mprintf(
+        "SELECT json_type(properties, ?2), json_extract(properties, ?2) "
+        "FROM %s_%s WHERE id = ?1",
+        p->pGraph->zTableName, bRel ? "edges" : "nodes");
+    if( !zSql ) return SQLITE_NOMEM;
+    rc = sqlite3_prepare_v2(p->pGraph->pDb, zSql, -1, &p->apStmt[bRel], 0);
+    sqlite3_free(zSql);
+    if( rc != SQLITE_OK ) return rc;
+  }
+  zPath = propertyReaderPath(p, zProp);
+  if( !zPath ) return SQLITE_NOMEM;
+  
+  pStmt = p->apStmt[bRel];
+  sqlite3_bind_int64(pStmt, 1, bRel ? pObject->u.iRelId : pObject->u.iNodeId);
+  sqlite3_bind_text(pStmt, 2, zPath, -1, SQLITE_STATIC);
+  rc = sqlite3_step(pStmt);
+  if( rc == SQLITE_ROW ) {
+    rc = SQLITE_OK;
+    zType = (const char*)sqlite3_column_text(pStmt, 0);
+    if( !zType || strcmp(zType, "null") == 0 ) {
+      /* Missing or null */
+    } else if( strcmp(zType, "true") == 0 || strcmp(zType, "false") == 0 ) {
+      cypherValueSetBoolean(pValue, zType[0] == 't');
+    } else if( strcmp(zType, "integer") == 0 ) {
+      cypherValueSetInteger(pValue, sqlite3_column_int64(pStmt, 1));
+    } else if( strcmp(zType, "real") == 0 ) {
+      cypherValueSetFloat(pValue, sqlite3_column_double(pStmt, 1));
+    } else if( strcmp(zType, "text") == 0 ) {
+      rc = cypherValueSetString(pValue, (const char*)sqlite3_column_text(pStmt, 1));
+    } else {
+      /* Arrays and objects come back as JSON text */
+      rc = cypherParseJsonValue((const char*)sqlite3_column_text(pStmt, 1), pValue);
+    }
+  } else if( rc == SQLITE_DONE ) {
+    rc = SQLITE_OK;
+  }
+  sqlite3_reset(pStmt);
+  return rc;
+}
+
+void cypherPropertyReaderClose(CypherPropertyReader *p) {
+  int i;
+  
+  sqlite3_finalize(p->apStmt[0]);
+  sqlite3_finalize(p->apStmt[1]);
+  p->apStmt[0] = p->apStmt[1] = NULL;
+  for( i = 0; i < p->nPath * 2; i++ ) {
+    sqlite3_free(p->azPath[i]);
+  }
+  sqlite3_free(p->azPath);
+  p->azPath = NULL;
+  p->nPath = 0;
+}
+
+/*
+** Return the slot of a variable, adding an unbound slot for a new name.
+** Returns -1 on allocation failure.
+*/
+int executionContextSlot(ExecutionContext *pContext, const char *zVar) {
+  char **azNew;
+  CypherValue *aNew;
+  int i;
+  
+  for( i = 0; i < pContext->nVariables; i++ ) {
+    if( strcmp(pContext->azVariables[i], zVar) == 0 ) return i;
   }
   
   /* Resize arrays if needed */
@@ -95,24 +190,55 @@ int executionContextBind(ExecutionContext *pContext, const char *zVar, CypherVal
     int nNew = pContext->nVariablesAlloc ? pContext->nVariablesAlloc * 2 : 8;
     
     azNew = sqlite3_realloc(pContext->azVariables, nNew * sizeof(char*));
-    if( !azNew ) return SQLITE_NOMEM;
+    if( !azNew ) return -1;
     pContext->azVariables = azNew;
     
     aNew = sqlite3_realloc(pContext->aBindings, nNew * sizeof(CypherValue));
-    if( !aNew ) return SQLITE_NOMEM;
+    if( !aNew ) return -1;
     pContext->aBindings = aNew;
     
     pContext->nVariablesAlloc = nNew;
   }
   
-  /* Add new binding */
+  /* Add new slot, bound to NULL */
   pContext->azVariables[pContext->nVariables] = sqlite3_mprintf("%s", zVar);
-  if( !pContext->azVariables[pContext->nVariables] ) return SQLITE_NOMEM;
+  if( !pContext->azVariables[pContext->nVariables] ) return -1;
+  memset(&pContext->aBindings[pContext->nVariables], 0, sizeof(CypherValue));
   
-  pContext->aBindings[pContext->nVariables] = *cypherValueCopy(pValue);
-  pContext->nVariables++;
+  return pContext->nVariables++;
+}
+
+/*
+** Bind the variable in slot iSlot to a copy of pValue.
+** Returns SQLITE_OK on success, error code on failure.
+*/
+int executionContextBindSlot(ExecutionContext *pContext, int iSlot, const CypherValue *pValue) {
+  CypherValue *pSlot;
+  int rc;
   
-  return SQLITE_OK;
+  if( !pContext || !pValue || iSlot < 0 || iSlot >= pContext->nVariables ) {
+    return SQLITE_MISUSE;
+  }
+  
+  pSlot = &pContext->aBindings[iSlot];
+  cypherValueDestroy(pSlot);
+  rc = cypherValueCopyInto(pSlot, pValue);
+  if( rc != SQLITE_OK ) memset(pSlot, 0, sizeof(CypherValue));
+  return rc;
+}
+
+/*
+** Bind a variable to a value in the execution context.
+** Returns SQLITE_OK on success, error code on failure.
+*/
+int executionContextBind(ExecutionContext *pContext, const char *zVar, CypherValue *pValue) {
+  int iSlot;
+  
+  if( !pContext || !zVar || !pValue ) return SQLITE_MISUSE;
+  
+  iSlot = executionContextSlot(pContext, zVar);
+  if( iSlot < 0 ) return SQLITE_NOMEM;
+  return executionContextBindSlot(pContext, iSlot, pValue);
 }
 
 /*
@@ -179,6 +305,11 @@ void cypherValueDestroy(CypherValue *pValue) {
       sqlite3_free(pValue->u.map.apValues);
       break;
       
+    case CYPHER_VALUE_PATH:
+      sqlite3_free(pValue->u.path.aNodeIds);
+      sqlite3_free(pValue->u.path.aRelIds);
+      break;
+      
     default:
       /* No additional cleanup needed for other types */
       break;
@@ -236,6 +367,23 @@ CypherValue *cypherValueCopy(CypherValue *pValue) {
       pCopy->u.iRelId = pValue->u.iRelId;
       break;
       
+    case CYPHER_VALUE_PATH: {
+      int nLen = pValue->u.path.nLength;
+      pCopy->u.path.aNodeIds = sqlite3_malloc((nLen + 1) * sizeof(sqlite3_int64));
+      pCopy->u.path.aRelIds = sqlite3_malloc((nLen + 1) * sizeof(sqlite3_int64));
+      if( !pCopy->u.path.aNodeIds || !pCopy->u.path.aRelIds ) {
+        cypherValueDestroy(pCopy);
+        sqlite3_free(pCopy);
+        return NULL;
+      }
+      memcpy(pCopy->u.path.aNodeIds, pValue->u.path.aNodeIds, (nLen + 1) * sizeof(sqlite3_int64));
+      if( nLen > 0 ) {
+        memcpy(pCopy->u.path.aRelIds, pValue->u.path.aRelIds, nLen * sizeof(sqlite3_int64));
+      }
+      pCopy->u.path.nLength = nLen;
+      break;
+    }
+      
     case CYPHER_VALUE_LIST:
       if( pValue->u.list.nValues > 0 ) {
         pCopy->u.list.apValues = sqlite3_malloc(pValue->u.list.nValues * sizeof(CypherValue));
@@ -245,7 +393,6 @@ CypherValue *cypherValueCopy(CypherValue *pValue) {
           return NULL;
         }
         
-        pCopy->u.list.nValues = pValue->u.list.nValues;
         for( i = 0; i < pValue->u.list.nValues; i++ ) {
           CypherValue *pElementCopy = cypherValueCopy(&pValue->u.list.apValues[i]);
           if( !pElementCopy ) {
@@ -254,11 +401,37 @@ CypherValue *cypherValueCopy(CypherValue *pValue) {
             return NULL;
           }
           pCopy->u.list.apValues[i] = *pElementCopy;
+          pCopy->u.list.nValues = i + 1;
           sqlite3_free(pElementCopy);
         }
       }
       break;
       
+    case CYPHER_VALUE_MAP:
+      if( pValue->u.map.nPairs > 0 ) {
+        int nPairs = pValue->u.map.nPairs;
+        pCopy->u.map.azKeys = sqlite3_malloc(nPairs * sizeof(char*));
+        pCopy->u.map.apValues = sqlite3_malloc(nPairs * sizeof(CypherValue));
+        if( !pCopy->u.map.azKeys || !pCopy->u.map.apValues ) {
+          cypherValueDestroy(pCopy);
+          sqlite3_free(pCopy);
+          return NULL;
+        }
+        for( i = 0; i < nPairs; i++ ) {
+          char *zKey = sqlite3_mprintf("%s", pValue->u.map.azKeys[i]);
+          if( !zKey || cypherValueCopyInto(&pCopy->u.map.apValues[i],
+                                           &pValue->u.map.apValues[i]) != SQLITE_OK ) {
+            sqlite3_free(zKey);
+            cypherValueDestroy(pCopy);
+            sqlite3_free(pCopy);
+            return NULL;
+          }
+          pCopy->u.map.azKeys[i] = zKey;
+          pCopy->u.map.nPairs = i + 1;
+        }
+      }
+      break;
+      
     default:
       /* Unsupported type for copying */
       cypherValueDestroy(pCopy);
@@ -269,6 +442,32 @@ CypherValue *cypherValueCopy(CypherValue *pValue) {
   return pCopy;
 }
 
+/*
+** Copy pSrc into *pDest, which is overwritten without being freed.
+** Returns SQLITE_OK on success, SQLITE_NOMEM on allocation failure.
+*/
+int cypherValueCopyInto(CypherValue *pDest, const CypherValue *pSrc) {
+  CypherValue *pCopy;
+  
+  switch( pSrc->type ) {
+    case CYPHER_VALUE_STRING:
+    case CYPHER_VALUE_LIST:
+    case CYPHER_VALUE_MAP:
+    case CYPHER_VALUE_PATH:
+      pCopy = cypherValueCopy((CypherValue*)pSrc);
+      if( !pCopy ) return SQLITE_NOMEM;
+      *pDest = *pCopy;
+      sqlite3_free(pCopy);
+      break;
+      
+    default:
+      /* Scalars and ids own no memory */
+      *pDest = *pSrc;
+      break;
+  }
+  return SQLITE_OK;
+}
+
 /*
 ** Set string value.
 ** Makes a copy of the string using sqlite3_malloc().
@@ -322,6 +521,17 @@ char *cypherValueToString(CypherValue *pValue) {
     case CYPHER_VALUE_RELATIONSHIP:
       return sqlite3_mprintf("Relationship(%lld)", pValue->u.iRelId);
       
+    case CYPHER_VALUE_PATH: {
+      /* (1)-[10]-(2)-[12]-(4); the path keeps no edge directions */
+      char *z = sqlite3_mprintf("(%lld)", pValue->u.path.aNodeIds[0]);
+      int i;
+      for( i = 0; z && i < pValue->u.path.nLength; i++ ) {
+        z = sqlite3_mprintf("%z-[%lld]-(%lld)", z, pValue->u.path.aRelIds[i],
+                            pValue->u.path.aNodeIds[i + 1]);
+      }
+      return z;
+    }
+      
     case CYPHER_VALUE_LIST:
       /* Simplified list representation */
       return sqlite3_mprintf("[List with %d elements]", pValue->u.list.nValues);
@@ -431,6 +641,18 @@ void cypherResultDestroy(CypherResult *pResult) {
   sqlite3_free(pResult);
 }
 
+/*
+** Drop the columns of a result row after the first nKeep, keeping its
+** arrays so that the row can be refilled without allocating.
+*/
+void cypherResultTruncate(CypherResult *pResult, int nKeep) {
+  while( pResult->nColumns > nKeep ) {
+    pResult->nColumns--;
+    sqlite3_free(pResult->azColumnNames[pResult->nColumns]);
+    cypherValueDestroy(&pResult->aValues[pResult->nColumns]);
+  }
+}
+
 /*
 ** Add a column to a result row.
 ** Returns SQLITE_OK on success, error code on failure.
@@ -460,12 +682,241 @@ int cypherResultAddColumn(CypherResult *pResult, const char *zName, CypherValue
   pResult->azColumnNames[pResult->nColumns] = sqlite3_mprintf("%s", zName);
   if( !pResult->azColumnNames[pResult->nColumns] ) return SQLITE_NOMEM;
   
-  pResult->aValues[pResult->nColumns] = *cypherValueCopy(pValue);
+  if( cypherValueCopyInto(&pResult->aValues[pResult->nColumns], pValue) != SQLITE_OK ) {
+    sqlite3_free(pResult->azColumnNames[pResult->nColumns]);
+    return SQLITE_NOMEM;
+  }
   pResult->nColumns++;
   
   return SQLITE_OK;
 }
 
+/*
+** Create an empty batch.
+** Returns NULL on allocation failure.
+*/
+CypherBatch *cypherBatchCreate(void) {
+  CypherBatch *pBatch;
+  
+  pBatch = sqlite3_malloc(sizeof(CypherBatch));
+  if( !pBatch ) return NULL;
+  
+  memset(pBatch, 0, sizeof(CypherBatch));
+  return pBatch;
+}
+
+/*
+** Drop the rows of a batch, keeping its columns.
+*/
+void cypherBatchReset(CypherBatch *pBatch) {
+  int i, j;
+  
+  if( !pBatch ) return;
+  
+  for( i = 0; i < pBatch->nCol; i++ ) {
+    CypherVector *pVec = &pBatch->aCol[i];
+    if( !pVec->aValue ) continue;
+    for( j = 0; j < pBatch->nRow; j++ ) {
+      cypherValueDestroy(&pVec->aValue[j]);
+    }
+    memset(pVec->aValue, 0, pBatch->nRow * sizeof(CypherValue));
+  }
+  pBatch->nRow = 0;
+}
+
+/*
+** Destroy a batch and free all associated memory.
+** Safe to call with NULL pointer.
+*/
+void cypherBatchDestroy(CypherBatch *pBatch) {
+  int i;
+  
+  if( !pBatch ) return;
+  
+  cypherBatchReset(pBatch);
+  for( i = 0; i < pBatch->nCol; i++ ) {
+    sqlite3_free(pBatch->aCol[i].zName);
+    sqlite3_free(pBatch->aCol[i].aInt);
+    sqlite3_free(pBatch->aCol[i].aValue);
+  }
+  sqlite3_free(pBatch->aCol);
+  sqlite3_free(pBatch);
+}
+
+/*
+** Return true if values of type eType can be stored unboxed.
+*/
+static int batchTypeIsInt(CypherValueType eType) {
+  return eType == CYPHER_VALUE_NODE || eType == CYPHER_VALUE_RELATIONSHIP ||
+         eType == CYPHER_VALUE_INTEGER;
+}
+
+/*
+** Switch an unboxed column to full values, boxing its first nRow entries.
+*/
+static int batchColumnBox(CypherVector *pVec, int nRow) {
+  int i;
+  
+  pVec->aValue = sqlite3_malloc(CYPHER_BATCH_SIZE * sizeof(CypherValue));
+  if( !pVec->aValue ) return SQLITE_NOMEM;
+  memset(pVec->aValue, 0, CYPHER_BATCH_SIZE * sizeof(CypherValue));
+  for( i = 0; i < nRow; i++ ) {
+    pVec->aValue[i].type = pVec->type;
+    pVec->aValue[i].u.iInteger = pVec->aInt[i];
+  }
+  sqlite3_free(pVec->aInt);
+  pVec->aInt = NULL;
+  pVec->type = CYPHER_VALUE_NULL;
+  return SQLITE_OK;
+}
+
+/*
+** Return the index of the column zName, adding it if the batch has none.
+** Returns -1 on allocation failure.
+*/
+int cypherBatchAddColumn(CypherBatch *pBatch, const char *zName, CypherValueType eType) {
+  CypherVector *aNew;
+  CypherVector *pVec;
+  int i;
+  
+  for( i = 0; i < pBatch->nCol; i++ ) {
+    if( strcmp(pBatch->aCol[i].zName, zName) == 0 ) return i;
+  }
+  
+  aNew = sqlite3_realloc(pBatch->aCol, (pBatch->nCol + 1) * sizeof(CypherVector));
+  if( !aNew ) return -1;
+  pBatch->aCol = aNew;
+  pVec = &aNew[pBatch->nCol];
+  memset(pVec, 0, sizeof(CypherVector));
+  pVec->iSlot = -1;
+  
+  /* Rows already in the batch are NULL in the new column */
+  pVec->zName = sqlite3_mprintf("%s", zName);
+  if( batchTypeIsInt(eType) && pBatch->nRow == 0 ) {
+    pVec->type = eType;
+    pVec->aInt = sqlite3_malloc(CYPHER_BATCH_SIZE * sizeof(sqlite3_int64));
+  } else {
+    pVec->aValue = sqlite3_malloc(CYPHER_BATCH_SIZE * sizeof(CypherValue));
+    if( pVec->aValue ) memset(pVec->aValue, 0, CYPHER_BATCH_SIZE * sizeof(CypherValue));
+  }
+  if( !pVec->zName || (!pVec->aInt && !pVec->aValue) ) {
+    sqlite3_free(pVec->zName);
+    sqlite3_free(pVec->aInt);
+    sqlite3_free(pVec->aValue);
+    return -1;
+  }
+  return pBatch->nCol++;
+}
+
+/*
+** Store a copy of pValue in column iCol of row iRow.
+*/
+int cypherBatchSetValue(CypherBatch *pBatch, int iCol, int iRow, const CypherValue *pValue) {
+  CypherVector *pVec = &pBatch->aCol[iCol];
+  
+  if( pVec->aInt ) {
+    if( pValue->type == pVec->type ) {
+      pVec->aInt[iRow] = pValue->u.iInteger;
+      return SQLITE_OK;
+    }
+    if( batchColumnBox(pVec, iRow) != SQLITE_OK ) return SQLITE_NOMEM;
+  }
+  
+  cypherValueDestroy(&pVec->aValue[iRow]);
+  if( cypherValueCopyInto(&pVec->aValue[iRow], pValue) != SQLITE_OK ) {
+    memset(&pVec->aValue[iRow], 0, sizeof(CypherValue));
+    return SQLITE_NOMEM;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Read column iCol of row iRow. The value still belongs to the batch.
+*/
+void cypherBatchValue(CypherBatch *pBatch, int iCol, int iRow, CypherValue *pValue) {
+  CypherVector *pVec = &pBatch->aCol[iCol];
+  
+  if( pVec->aInt ) {
+    memset(pValue, 0, sizeof(CypherValue));
+    pValue->type = pVec->type;
+    pValue->u.iInteger = pVec->aInt[iRow];
+  } else {
+    *pValue = pVec->aValue[iRow];
+  }
+}
+
+/*
+** Append a result row to a batch, matching its columns by name. Batch
+** columns the row lacks are NULL.
+*/
+int cypherBatchAppendRow(CypherBatch *pBatch, CypherResult *pRow) {
+  CypherValue nullValue;
+  int iRow = pBatch->nRow;
+  int i, j;
+  int rc = SQLITE_OK;
+  
+  for( i = 0; i < pRow->nColumns; i++ ) {
+    if( cypherBatchAddColumn(pBatch, pRow->azColumnNames[i], pRow->aValues[i].type) < 0 ) {
+      return SQLITE_NOMEM;
+    }
+  }
+  
+  memset(&nullValue, 0, sizeof(nullValue));
+  for( i = 0; rc == SQLITE_OK && i < pBatch->nCol; i++ ) {
+    const CypherValue *pValue = &nullValue;
+    for( j = 0; j < pRow->nColumns; j++ ) {
+      if( strcmp(pRow->azColumnNames[j], pBatch->aCol[i].zName) == 0 ) {
+        pValue = &pRow->aValues[j];
+        break;
+      }
+    }
+    rc = cypherBatchSetValue(pBatch, i, iRow, pValue);
+  }
+  if( rc == SQLITE_OK ) pBatch->nRow++;
+  return rc;
+}
+
+/*
+** Add the columns of row iRow of a batch to pResult.
+*/
+int cypherBatchGetRow(CypherBatch *pBatch, int iRow, CypherResult *pResult) {
+  CypherValue value;
+  int i;
+  int rc = SQLITE_OK;
+  
+  for( i = 0; rc == SQLITE_OK && i < pBatch->nCol; i++ ) {
+    cypherBatchValue(pBatch, i, iRow, &value);
+    rc = cypherResultAddColumn(pResult, pBatch->aCol[i].zName, &value);
+  }
+  return rc;
+}
+
+/*
+** Keep only the nSel rows of a batch listed, ascending, in aSel.
+*/
+void cypherBatchSelect(CypherBatch *pBatch, const int *aSel, int nSel) {
+  int i, j, k;
+  
+  for( i = 0; i < pBatch->nCol; i++ ) {
+    CypherVector *pVec = &pBatch->aCol[i];
+    if( pVec->aInt ) {
+      for( j = 0; j < nSel; j++ ) {
+        pVec->aInt[j] = pVec->aInt[aSel[j]];
+      }
+      continue;
+    }
+    for( j = 0, k = 0; j < pBatch->nRow; j++ ) {
+      if( k < nSel && aSel[k] == j ) {
+        pVec->aValue[k++] = pVec->aValue[j];
+      } else {
+        cypherValueDestroy(&pVec->aValue[j]);
+      }
+    }
+    memset(&pVec->aValue[nSel], 0, (pBatch->nRow - nSel) * sizeof(CypherValue));
+  }
+  pBatch->nRow = nSel;
+}
+
 /*
 ** Set a CypherValue to a boolean.
 */
@@ -641,63 +1092,45 @@ void cypherValueSetRelationship(CypherValue *pValue, sqlite3_int64 iRelId) {
   }
 }
 
+/*
+** Set a CypherValue to a path, taking ownership of the id arrays.
+*/
+void cypherValueSetPath(CypherValue *pValue, sqlite3_int64 *aNodeIds,
+                        sqlite3_int64 *aRelIds, int nLength) {
+  if( pValue ) {
+    cypherValueDestroy(pValue);
+    pValue->type = CYPHER_VALUE_PATH;
+    pValue->u.path.aNodeIds = aNodeIds;
+    pValue->u.path.aRelIds = aRelIds;
+    pValue->u.path.nLength = nLength;
+  }
+}
+
 /*
 ** Get JSON representation of a result row.
 ** Caller must sqlite3_free() the returned string.
 */
 char *cypherResultToJson(CypherResult *pResult) {
-  char *zResult, *zValue;
-  int i, nResult = 0, nAlloc = 256;
+  char *zResult;
+  int i;
   
   if( !pResult ) return sqlite3_mprintf("null");
   
-  zResult = sqlite3_malloc(nAlloc);
-  if( !zResult ) return NULL;
-  
-  /* Start JSON object */
-  nResult = snprintf(zResult, nAlloc, "{");
-  
-  for( i = 0; i < pResult->nColumns; i++ ) {
-    zValue = cypherValueToString(&pResult->aValues[i]);
-    if( !zValue ) {
+  zResult = sqlite3_mprintf("{");
+  for( i = 0; zResult && i < pResult->nColumns; i++ ) {
+    char *zKey = cypherJsonQuote(pResult->azColumnNames[i]);
+    char *zValue = cypherValueToJson(&pResult->aValues[i]);
+    if( zKey && zValue ) {
+      zResult = sqlite3_mprintf("%z%s%s:%s", zResult, i > 0 ? "," : "",
+                                zKey, zValue);
+    } else {
       sqlite3_free(zResult);
-      return NULL;
+      zResult = NULL;
     }
-    
-    /* Calculate space needed */
-    int nNeeded = snprintf(NULL, 0, "%s\"%s\":%s", 
-                          i > 0 ? "," : "", 
-                          pResult->azColumnNames[i], 
-                          zValue);
-    
-    /* Resize if needed */
-    if( nResult + nNeeded + 2 >= nAlloc ) {
-      nAlloc = (nResult + nNeeded + 256) * 2;
-      char *zNew = sqlite3_realloc(zResult, nAlloc);
-      if( !zNew ) {
-        sqlite3_free(zResult);
-        sqlite3_free(zValue);
-        return NULL;
-      }
-      zResult = zNew;
-    }
-    
-    /* Add column to JSON */
-    nResult += snprintf(zResult + nResult, nAlloc - nResult,
-                       "%s\"%s\":%s", 
-                       i > 0 ? "," : "", 
-                       pResult->azColumnNames[i], 
-                       zValue);
-    
+    sqlite3_free(zKey);
     sqlite3_free(zValue);
   }
-  
-  /* Close JSON object */
-  if( nResult + 2 < nAlloc ) {
-    zResult[nResult++] = '}';
-    zResult[nResult] = '\0';
-  }
-  
+  if( zResult ) zResult = sqlite3_mprintf("%z}", zResult);
   return zResult;
 }
 
@@ -837,4 +1270,325 @@ char *cypherValueToFormattedJson(const CypherValue *pValue, int nIndent) {
       /* Cast away const since cypherValueToString doesn't modify the value */
       return cypherValueToString((CypherValue*)pValue);
   }
-}
\ No newline at end of file
+}
+/*
+** Row encoding. Operators that spill rows to temporary tables store each
+** row as a blob: the column count, then per column its name and value. A
+** value is a type byte followed by its payload; integers are stored in
+** native byte order, since a blob never outlives the connection that
+** wrote it.
+*/
+typedef struct RowBuffer {
+  unsigned char *a;             /* Encoded bytes */
+  int n;                        /* Bytes used */
+  int nAlloc;                   /* Bytes allocated */
+  int rc;                       /* SQLITE_NOMEM after a failed allocation */
+} RowBuffer;
+
+static void rowBufferAppend(RowBuffer *p, const void *pData, int nData) {
+  if( p->rc != SQLITE_OK ) return;
+  if( p->n + nData > p->nAlloc ) {
+    int nNew = p->nAlloc ? p->nAlloc * 2 : 128;
+    unsigned char *aNew;
+    while( nNew < p->n + nData ) nNew *= 2;
+    aNew = sqlite3_realloc(p->a, nNew);
+    if( !aNew ) {
+      p->rc = SQLITE_NOMEM;
+      return;
+    }
+    p->a = aNew;
+    p->nAlloc = nNew;
+  }
+  memcpy(&p->a[p->n], pData, nData);
+  p->n += nData;
+}
+
+static void rowBufferPutInt(RowBuffer *p, sqlite3_int64 iValue) {
+  rowBufferAppend(p, &iValue, sizeof(iValue));
+}
+
+static void rowBufferPutString(RowBuffer *p, const char *z) {
+  int n = z ? (int)strlen(z) : -1;
+  rowBufferAppend(p, &n, sizeof(n));
+  if( n > 0 ) rowBufferAppend(p, z, n);
+}
+
+static void rowEncodeValue(RowBuffer *p, const CypherValue *pValue) {
+  unsigned char type = (unsigned char)pValue->type;
+  int i;
+  
+  rowBufferAppend(p, &type, 1);
+  switch( pValue->type ) {
+    case CYPHER_VALUE_BOOLEAN:
+      rowBufferPutInt(p, pValue->u.bBoolean);
+      break;
+    case CYPHER_VALUE_INTEGER:
+      rowBufferPutInt(p, pValue->u.iInteger);
+      break;
+    case CYPHER_VALUE_FLOAT:
+      rowBufferAppend(p, &pValue->u.rFloat, sizeof(double));
+      break;
+    case CYPHER_VALUE_STRING:
+      rowBufferPutString(p, pValue->u.zString);
+      break;
+    case CYPHER_VALUE_NODE:
+      rowBufferPutInt(p, pValue->u.iNodeId);
+      break;
+    case CYPHER_VALUE_RELATIONSHIP:
+      rowBufferPutInt(p, pValue->u.iRelId);
+      break;
+    case CYPHER_VALUE_PATH:
+      rowBufferPutInt(p, pValue->u.path.nLength);
+      for( i = 0; i <= pValue->u.path.nLength; i++ ) {
+        rowBufferPutInt(p, pValue->u.path.aNodeIds[i]);
+      }
+      for( i = 0; i < pValue->u.path.nLength; i++ ) {
+        rowBufferPutInt(p, pValue->u.path.aRelIds[i]);
+      }
+      break;
+    case CYPHER_VALUE_LIST:
+      rowBufferPutInt(p, pValue->u.list.nValues);
+      for( i = 0; i < pValue->u.list.nValues; i++ ) {
+        rowEncodeValue(p, &pValue->u.list.apValues[i]);
+      }
+      break;
+    case CYPHER_VALUE_MAP:
+      rowBufferPutInt(p, pValue->u.map.nPairs);
+      for( i = 0; i < pValue->u.map.nPairs; i++ ) {
+        rowBufferPutString(p, pValue->u.map.azKeys[i]);
+        rowEncodeValue(p, &pValue->u.map.apValues[i]);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+/*
+** Encode a result row into a blob for cypherResultDecode().
+** On success *paBlob is set to a buffer the caller must sqlite3_free().
+*/
+int cypherResultEncode(const CypherResult *pResult, unsigned char **paBlob,
+                       int *pnBlob) {
+  RowBuffer buf;
+  int i;
+  
+  if( !pResult || !paBlob || !pnBlob ) return SQLITE_MISUSE;
+  memset(&buf, 0, sizeof(buf));
+  rowBufferPutInt(&buf, pResult->nColumns);
+  for( i = 0; i < pResult->nColumns; i++ ) {
+    rowBufferPutString(&buf, pResult->azColumnNames[i]);
+    rowEncodeValue(&buf, &pResult->aValues[i]);
+  }
+  if( buf.rc != SQLITE_OK ) {
+    sqlite3_free(buf.a);
+    return buf.rc;
+  }
+  *paBlob = buf.a;
+  *pnBlob = buf.n;
+  return SQLITE_OK;
+}
+
+/*
+** Cursor over an encoded row. Reads past the end set rc to SQLITE_CORRUPT.
+*/
+typedef struct RowReader {
+  const unsigned char *a;
+  int n;
+  int i;
+  int rc;
+} RowReader;
+
+static void rowReaderGet(RowReader *p, void *pData, int nData) {
+  if( p->rc != SQLITE_OK || nData < 0 || p->i + nData > p->n ) {
+    if( p->rc == SQLITE_OK ) p->rc = SQLITE_CORRUPT;
+    memset(pData, 0, nData > 0 ? nData : 0);
+    return;
+  }
+  memcpy(pData, &p->a[p->i], nData);
+  p->i += nData;
+}
+
+static sqlite3_int64 rowReaderGetInt(RowReader *p) {
+  sqlite3_int64 iValue;
+  rowReaderGet(p, &iValue, sizeof(iValue));
+  return iValue;
+}
+
+static char *rowReaderGetString(RowReader *p) {
+  char *z;
+  int n;
+  
+  rowReaderGet(p, &n, sizeof(n));
+  if( p->rc != SQLITE_OK || n < 0 ) return NULL;
+  if( p->i + n > p->n ) {
+    p->rc = SQLITE_CORRUPT;
+    return NULL;
+  }
+  z = sqlite3_malloc(n + 1);
+  if( !z ) {
+    p->rc = SQLITE_NOMEM;
+    return NULL;
+  }
+  memcpy(z, &p->a[p->i], n);
+  z[n] = 0;
+  p->i += n;
+  return z;
+}
+
+/*
+** Decode one value into pValue, which must be initialized. On error
+** pValue holds whatever was decoded so far and must still be destroyed.
+*/
+static void rowDecodeValue(RowReader *p, CypherValue *pValue) {
+  unsigned char type = 0;
+  sqlite3_int64 n;
+  int i;
+  
+  rowReaderGet(p, &type, 1);
+  if( p->rc != SQLITE_OK ) return;
+  switch( type ) {
+    case CYPHER_VALUE_NULL:
+      break;
+    case CYPHER_VALUE_BOOLEAN:
+      cypherValueSetBoolean(pValue, rowReaderGetInt(p) != 0);
+      break;
+    case CYPHER_VALUE_INTEGER:
+      cypherValueSetInteger(pValue, rowReaderGetInt(p));
+      break;
+    case CYPHER_VALUE_FLOAT: {
+      double rValue;
+      rowReaderGet(p, &rValue, sizeof(rValue));
+      cypherValueSetFloat(pValue, rValue);
+      break;
+    }
+    case CYPHER_VALUE_STRING:
+      pValue->type = CYPHER_VALUE_STRING;
+      pValue->u.zString = rowReaderGetString(p);
+      break;
+    case CYPHER_VALUE_NODE:
+      cypherValueSetNode(pValue, rowReaderGetInt(p));
+      break;
+    case CYPHER_VALUE_RELATIONSHIP:
+      cypherValueSetRelationship(pValue, rowReaderGetInt(p));
+      break;
+    case CYPHER_VALUE_PATH: {
+      sqlite3_int64 *aNodeIds, *aRelIds;
+      n = rowReaderGetInt(p);
+      if( n < 0 || n > p->n ) {
+        p->rc = SQLITE_CORRUPT;
+        return;
+      }
+      aNodeIds = sqlite3_malloc((int)(n + 1) * sizeof(sqlite3_int64));
+      aRelIds = sqlite3_malloc((int)(n + 1) * sizeof(sqlite3_int64));
+      if( !aNodeIds || !aRelIds ) {
+        sqlite3_free(aNodeIds);
+        sqlite3_free(aRelIds);
+        p->rc = SQLITE_NOMEM;
+        return;
+      }
+      for( i = 0; i <= n; i++ ) aNodeIds[i] = rowReaderGetInt(p);
+      for( i = 0; i < n; i++ ) aRelIds[i] = rowReaderGetInt(p);
+      cypherValueSetPath(pValue, aNodeIds, aRelIds, (int)n);
+      break;
+    }
+    case CYPHER_VALUE_LIST: {
+      CypherValue *aValues = NULL;
+      n = rowReaderGetInt(p);
+      if( n < 0 || n > p->n ) {
+        p->rc = SQLITE_CORRUPT;
+        return;
+      }
+      if( n > 0 ) {
+        aValues = sqlite3_malloc((int)n * sizeof(CypherValue));
+        if( !aValues ) {
+          p->rc = SQLITE_NOMEM;
+          return;
+        }
+        for( i = 0; i < n; i++ ) cypherValueInit(&aValues[i]);
+      }
+      cypherValueSetList(pValue, aValues, (int)n);
+      for( i = 0; i < n && p->rc == SQLITE_OK; i++ ) {
+        rowDecodeValue(p, &aValues[i]);
+      }
+      break;
+    }
+    case CYPHER_VALUE_MAP: {
+      char **azKeys = NULL;
+      CypherValue *aValues = NULL;
+      n = rowReaderGetInt(p);
+      if( n < 0 || n > p->n ) {
+        p->rc = SQLITE_CORRUPT;
+        return;
+      }
+      if( n > 0 ) {
+        azKeys = sqlite3_malloc((int)n * sizeof(char*));
+        aValues = sqlite3_malloc((int)n * sizeof(CypherValue));
+        if( !azKeys || !aValues ) {
+          sqlite3_free(azKeys);
+          sqlite3_free(aValues);
+          p->rc = SQLITE_NOMEM;
+          return;
+        }
+        for( i = 0; i < n; i++ ) {
+          azKeys[i] = NULL;
+          cypherValueInit(&aValues[i]);
+        }
+      }
+      cypherValueSetMap(pValue, azKeys, aValues, (int)n);
+      for( i = 0; i < n && p->rc == SQLITE_OK; i++ ) {
+        azKeys[i] = rowReaderGetString(p);
+        rowDecodeValue(p, &aValues[i]);
+      }
+      break;
+    }
+    default:
+      p->rc = SQLITE_CORRUPT;
+      break;
+  }
+}
+
+/*
+** Decode a row written by cypherResultEncode(), appending its columns to
+** pResult. Returns SQLITE_CORRUPT if the blob is not a complete row.
+*/
+int cypherResultDecode(const unsigned char *aBlob, int nBlob, CypherResult *pResult) {
+  RowReader reader;
+  sqlite3_int64 nColumns;
+  int i;
+  
+  if( !pResult || (!aBlob && nBlob > 0) ) return SQLITE_MISUSE;
+  memset(&reader, 0, sizeof(reader));
+  reader.a = aBlob;
+  reader.n = nBlob;
+  
+  nColumns = rowReaderGetInt(&reader);
+  if( reader.rc == SQLITE_OK && (nColumns < 0 || nColumns > nBlob) ) {
+    reader.rc = SQLITE_CORRUPT;
+  }
+  for( i = 0; reader.rc == SQLITE_OK && i < nColumns; i++ ) {
+    if( pResult->nColumns >= pResult->nColumnsAlloc ) {
+      int nNew = pResult->nColumnsAlloc ? pResult->nColumnsAlloc * 2 : 4;
+      char **azNew;
+      CypherValue *aNew;
+      
+      azNew = sqlite3_realloc(pResult->azColumnNames, nNew * sizeof(char*));
+      if( !azNew ) return SQLITE_NOMEM;
+      pResult->azColumnNames = azNew;
+      aNew = sqlite3_realloc(pResult->aValues, nNew * sizeof(CypherValue));
+      if( !aNew ) return SQLITE_NOMEM;
+      pResult->aValues = aNew;
+      pResult->nColumnsAlloc = nNew;
+    }
+    pResult->azColumnNames[pResult->nColumns] = rowReaderGetString(&reader);
+    if( !pResult->azColumnNames[pResult->nColumns] ) {
+      if( reader.rc == SQLITE_OK ) reader.rc = SQLITE_CORRUPT;
+      break;
+    }
+    cypherValueInit(&pResult->aValues[pResult->nColumns]);
+    pResult->nColumns++;
+    rowDecodeValue(&reader, &pResult->aValues[pResult->nColumns - 1]);
+  }
+  
+  return reader.rc;
+}
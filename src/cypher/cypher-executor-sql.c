@@ -9,6 +9,7 @@
 ** - cypher_execute(query_text) - Execute Cypher query and return results
 ** - cypher_execute_explain(query_text) - Execute with detailed execution stats
 ** - cypher_test_execute() - Execute test queries for demonstration
+** - cypher(query_text) - Table-valued function streaming the result rows
 **
 ** Memory allocation: All functions use sqlite3_malloc()/sqlite3_free()
 ** Error handling: Functions return SQLite error codes or NULL on error
@@ -20,6 +21,8 @@ extern const sqlite3_api_routines *sqlite3_api;
 #endif
 /* SQLITE_EXTENSION_INIT1 - removed to prevent multiple definition */
 #include "cypher-executor.h"
+#include "cypher-expressions.h"
+#include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 
@@ -70,7 +73,7 @@ static void cypherExecuteSqlFunc(
   pAst = cypherParse(pParser, zQuery, &zErrMsg);
   if( !pAst ) {
     sqlite3_result_error(context, zErrMsg ? zErrMsg : "Parse error", -1);
-    if (zErrMsg) sqlite3_free(zErrMsg);
+    if (zErrMsg) free(zErrMsg);
     cypherParserDestroy(pParser);
     return;
   }
@@ -81,7 +84,7 @@ static void cypherExecuteSqlFunc(
   }
   
   /* Plan the query */
-  pPlanner = cypherPlannerCreate(sqlite3_context_db_handle(context), NULL);
+  pPlanner = cypherPlannerCreate(sqlite3_context_db_handle(context), getGlobalGraph());
   if( !pPlanner ) {
     sqlite3_result_error_nomem(context);
     cypherParserDestroy(pParser);
@@ -115,7 +118,7 @@ static void cypherExecuteSqlFunc(
   }
   
   /* Execute the query */
-  pExecutor = cypherExecutorCreate(sqlite3_context_db_handle(context), NULL);
+  pExecutor = cypherExecutorCreate(sqlite3_context_db_handle(context), getGlobalGraph());
   if( !pExecutor ) {
     sqlite3_result_error_nomem(context);
     cypherPlannerDestroy(pPlanner);
@@ -148,6 +151,34 @@ static void cypherExecuteSqlFunc(
   cypherParserDestroy(pParser);
 }
 
+/*
+** SQL function: cypher_spill_limit([bytes])
+**
+** Sets the memory a sort, DISTINCT or hash join may use before it spills
+** to temporary tables, 0 for the built-in defaults. Without an argument
+** the limit is left alone.
+**
+** Usage: SELECT cypher_spill_limit(1048576);
+**
+** Returns: the limit in force before the call
+*/
+static void cypherSpillLimitSqlFunc(
+  sqlite3_context *context,
+  int argc,
+  sqlite3_value **argv
+) {
+  sqlite3_int64 nLimit = -1;
+  
+  if( argc > 0 ) {
+    nLimit = sqlite3_value_int64(argv[0]);
+    if( argc > 1 || sqlite3_value_type(argv[0]) != SQLITE_INTEGER || nLimit < 0 ) {
+      sqlite3_result_error(context, "cypher_spill_limit() takes a byte count", -1);
+      return;
+    }
+  }
+  sqlite3_result_int64(context, cypherSpillLimit(nLimit));
+}
+
 /*
 ** SQL function: cypher_execute_explain(query_text)
 **
@@ -197,7 +228,7 @@ static void cypherExecuteExplainSqlFunc(
   pAst = cypherParse(pParser, zQuery, &zErrMsg);
   if( !pAst ) {
     sqlite3_result_error(context, zErrMsg ? zErrMsg : "Parse error", -1);
-    if (zErrMsg) sqlite3_free(zErrMsg);
+    if (zErrMsg) free(zErrMsg);
     cypherParserDestroy(pParser);
     return;
   }
@@ -207,7 +238,7 @@ static void cypherExecuteExplainSqlFunc(
     return;
   }
   
-  pPlanner = cypherPlannerCreate(sqlite3_context_db_handle(context), NULL);
+  pPlanner = cypherPlannerCreate(sqlite3_context_db_handle(context), getGlobalGraph());
   if( !pPlanner ) {
     sqlite3_result_error_nomem(context);
     cypherParserDestroy(pParser);
@@ -233,7 +264,7 @@ static void cypherExecuteExplainSqlFunc(
   }
   
   /* Execute the query */
-  pExecutor = cypherExecutorCreate(sqlite3_context_db_handle(context), NULL);
+  pExecutor = cypherExecutorCreate(sqlite3_context_db_handle(context), getGlobalGraph());
   if( pExecutor ) {
     rc = cypherExecutorPrepare(pExecutor, pPlan);
     if( rc == SQLITE_OK ) {
@@ -325,6 +356,530 @@ static void cypherTestExecuteSqlFunc(
   }
 }
 
+/*
+** cypher(query) table-valued function.
+**
+** Streams the rows of a Cypher query to SQL. Rows are pulled from the
+** root iterator a batch at a time into a single reused batch, so memory
+** use does not grow with the size of the result and there is no row
+** limit.
+**
+** Used eponymously, SELECT value FROM cypher('MATCH ...'), each row comes
+** back as a JSON object in the value column. A table created with
+**
+**   CREATE VIRTUAL TABLE people USING cypher('MATCH (a:Person) RETURN a.name');
+**
+** instead has one column per RETURN item, named as the planner names it:
+** the alias, else the expression text such as a.name or count(*). Nodes
+** and relationships are returned as their ids, lists, maps and paths as
+** JSON.
+*/
+typedef struct CypherVtab CypherVtab;
+struct CypherVtab {
+  sqlite3_vtab base;         /* Base class - must be first */
+  sqlite3 *pDb;              /* Database connection */
+  char *zQuery;              /* Fixed query, NULL for the eponymous table */
+  char **azColumn;           /* RETURN item names when zQuery is set */
+  int nColumn;               /* Number of entries in azColumn */
+};
+
+typedef struct CypherVtabCursor CypherVtabCursor;
+struct CypherVtabCursor {
+  sqlite3_vtab_cursor base;  /* Base class - must be first */
+  CypherParser *pParser;     /* Owns the AST of the running query */
+  CypherPlanner *pPlanner;   /* Owns the physical plan */
+  CypherExecutor *pExecutor; /* Owns the open iterator tree */
+  CypherBatch *pBatch;       /* Rows read from the root iterator */
+  int iBatchRow;             /* Current row of pBatch */
+  int bEof;                  /* True once the result is exhausted */
+  sqlite3_int64 iRow;        /* Position in the result */
+};
+
+#define CYPHER_VTAB_VALUE 0
+#define CYPHER_VTAB_QUERY 1
+
+/*
+** Return the first RETURN clause of a query. Every side of a UNION has the
+** same columns, so the first one names them.
+*/
+static CypherAst *cypherVtabFindReturn(CypherAst *pAst) {
+  int i;
+  
+  if( !pAst ) return NULL;
+  if( cypherAstIsType(pAst, CYPHER_AST_RETURN) ) return pAst;
+  for( i = 0; i < pAst->nChildren; i++ ) {
+    CypherAst *pReturn = cypherVtabFindReturn(pAst->apChildren[i]);
+    if( pReturn ) return pReturn;
+  }
+  return NULL;
+}
+
+/*
+** Name of the column for a RETURN item, following the planner: the alias,
+** else var, var.prop or fn([DISTINCT ]arg). Other expressions are named
+** by position. Caller must sqlite3_free() the result.
+*/
+static char *cypherVtabItemName(CypherAst *pItem, int iItem) {
+  CypherAst *pExpr = pItem->nChildren > 0 ? pItem->apChildren[0] : NULL;
+  CypherAst *pArg = pExpr;
+  const char *zFunc = NULL;
+  int bDistinct = 0;
+  char *zArg = NULL;
+  char *zName;
+  
+  if( pItem->nChildren > 1 && cypherAstIsType(pItem->apChildren[1], CYPHER_AST_IDENTIFIER) ) {
+    return sqlite3_mprintf("%s", cypherAstGetValue(pItem->apChildren[1]));
+  }
+  if( cypherAstIsType(pExpr, CYPHER_AST_FUNCTION_CALL) ) {
+    int iArg = 0;
+    zFunc = cypherAstGetValue(pExpr);
+    if( !zFunc && pExpr->nChildren > 0 &&
+        cypherAstIsType(pExpr->apChildren[0], CYPHER_AST_IDENTIFIER) ) {
+      zFunc = cypherAstGetValue(pExpr->apChildren[0]);
+      iArg = 1;
+    }
+    pArg = iArg < pExpr->nChildren ? pExpr->apChildren[iArg] : NULL;
+    bDistinct = (pExpr->iFlags & CYPHER_AST_FLAG_DISTINCT) != 0;
+  }
+  
+  if( cypherAstIsType(pArg, CYPHER_AST_IDENTIFIER) ) {
+    zArg = sqlite3_mprintf("%s", cypherAstGetValue(pArg));
+  } else if( cypherAstIsType(pArg, CYPHER_AST_PROPERTY) && pArg->nChildren >= 2 ) {
+    zArg = sqlite3_mprintf("%s.%s", cypherAstGetValue(pArg->apChildren[0]),
+                           cypherAstGetValue(pArg->apChildren[1]));
+  } else if( zFunc && !pArg ) {
+    zArg = sqlite3_mprintf("*");
+  } else {
+    return sqlite3_mprintf("column%d", iItem + 1);
+  }
+  if( !zArg ) return NULL;
+  
+  if( zFunc ) {
+    zName = sqlite3_mprintf("%s(%s%s)", zFunc, bDistinct ? "DISTINCT " : "", zArg);
+    sqlite3_free(zArg);
+  } else {
+    zName = zArg;
+  }
+  return zName;
+}
+
+/*
+** Parse zQuery and collect the names of its RETURN items into pVtab.
+*/
+static int cypherVtabReadColumns(CypherVtab *pVtab, const char *zQuery, char **pzErr) {
+  CypherParser *pParser;
+  CypherAst *pAst;
+  CypherAst *pReturn;
+  CypherAst *pList;
+  char *zErrMsg = NULL;
+  int rc = SQLITE_OK;
+  int i;
+  
+  pParser = cypherParserCreate();
+  if( !pParser ) return SQLITE_NOMEM;
+  pAst = cypherParse(pParser, zQuery, &zErrMsg);
+  pReturn = cypherVtabFindReturn(pAst);
+  if( !pReturn || pReturn->nChildren == 0 ) {
+    *pzErr = sqlite3_mprintf("cypher(): %s", !pAst && zErrMsg ? zErrMsg :
+                             !pAst ? "Parse error" : "query has no RETURN clause");
+    free(zErrMsg);
+    cypherParserDestroy(pParser);
+    return SQLITE_ERROR;
+  }
+  free(zErrMsg);
+  
+  pList = pReturn->apChildren[0];
+  pVtab->azColumn = sqlite3_malloc(sizeof(char*) * (pList->nChildren + 1));
+  if( !pVtab->azColumn ) rc = SQLITE_NOMEM;
+  for( i = 0; rc == SQLITE_OK && i < pList->nChildren; i++ ) {
+    pVtab->azColumn[i] = cypherVtabItemName(pList->apChildren[i], i);
+    if( !pVtab->azColumn[i] ) rc = SQLITE_NOMEM;
+    else pVtab->nColumn++;
+  }
+  cypherParserDestroy(pParser);
+  return rc;
+}
+
+/*
+** Remove the SQL quotes around a module argument in place, undoubling
+** any embedded quote characters.
+*/
+static void cypherVtabDequote(char *z) {
+  char q = z[0];
+  int i, j;
+  
+  if( q != '\'' && q != '"' && q != '`' && q != '[' ) return;
+  if( q == '[' ) q = ']';
+  for( i = 1, j = 0; z[i]; i++ ) {
+    if( z[i] == q ) {
+      if( z[i+1] != q ) break;
+      i++;
+    }
+    z[j++] = z[i];
+  }
+  z[j] = '\0';
+}
+
+static int cypherVtabDisconnect(sqlite3_vtab *pBase) {
+  CypherVtab *pVtab = (CypherVtab*)pBase;
+  int i;
+  
+  for( i = 0; i < pVtab->nColumn; i++ ) {
+    sqlite3_free(pVtab->azColumn[i]);
+  }
+  sqlite3_free(pVtab->azColumn);
+  sqlite3_free(pVtab->zQuery);
+  sqlite3_free(pVtab);
+  return SQLITE_OK;
+}
+
+/*
+** Without arguments the table is the eponymous cypher(query). With one,
+** the dequoted query, it has a column per RETURN item.
+*/
+static int cypherVtabConnect(sqlite3 *pDb, void *pAux, int argc,
+                             const char *const *argv, sqlite3_vtab **ppVtab,
+                             char **pzErr) {
+  CypherVtab *pVtab;
+  char *zSql;
+  int rc = SQLITE_OK;
+  int i;
+  
+  (void)pAux;
+  
+  if( argc > 4 ) {
+    *pzErr = sqlite3_mprintf("cypher(): expected a single query argument");
+    return SQLITE_ERROR;
+  }
+  pVtab = sqlite3_malloc(sizeof(*pVtab));
+  if( !pVtab ) return SQLITE_NOMEM;
+  memset(pVtab, 0, sizeof(*pVtab));
+  pVtab->pDb = pDb;
+  
+  if( argc == 4 ) {
+    pVtab->zQuery = sqlite3_mprintf("%s", argv[3]);
+    if( !pVtab->zQuery ) {
+      cypherVtabDisconnect(&pVtab->base);
+      return SQLITE_NOMEM;
+    }
+    cypherVtabDequote(pVtab->zQuery);
+    rc = cypherVtabReadColumns(pVtab, pVtab->zQuery, pzErr);
+    zSql = rc == SQLITE_OK ? sqlite3_mprintf("CREATE TABLE x(") : NULL;
+    for( i = 0; zSql && i < pVtab->nColumn; i++ ) {
+      zSql = sqlite3_mprintf("%z%s\"%w\"", zSql, i ? "," : "", pVtab->azColumn[i]);
+    }
+    zSql = zSql ? sqlite3_mprintf("%z)", zSql) : NULL;
+    if( rc == SQLITE_OK && !zSql ) rc = SQLITE_NOMEM;
+  } else {
+    zSql = sqlite3_mprintf("CREATE TABLE x(value, query HIDDEN)");
+    if( !zSql ) rc = SQLITE_NOMEM;
+  }
+  
+  if( rc == SQLITE_OK ) {
+    rc = sqlite3_declare_vtab(pDb, zSql);
+  }
+  sqlite3_free(zSql);
+  if( rc != SQLITE_OK ) {
+    cypherVtabDisconnect(&pVtab->base);
+    return rc;
+  }
+  *ppVtab = &pVtab->base;
+  return SQLITE_OK;
+}
+
+/*
+** The eponymous table needs the query as an equality on its hidden column.
+*/
+static int cypherVtabBestIndex(sqlite3_vtab *pBase, sqlite3_index_info *pInfo) {
+  CypherVtab *pVtab = (CypherVtab*)pBase;
+  int i;
+  
+  if( !pVtab->zQuery ) {
+    int iQuery = -1;
+    for( i = 0; i < pInfo->nConstraint; i++ ) {
+      if( pInfo->aConstraint[i].iColumn != CYPHER_VTAB_QUERY ) continue;
+      if( !pInfo->aConstraint[i].usable ||
+          pInfo->aConstraint[i].op != SQLITE_INDEX_CONSTRAINT_EQ ) {
+        return SQLITE_CONSTRAINT;
+      }
+      iQuery = i;
+    }
+    if( iQuery < 0 ) return SQLITE_CONSTRAINT;
+    pInfo->aConstraintUsage[iQuery].argvIndex = 1;
+    pInfo->aConstraintUsage[iQuery].omit = 1;
+  }
+  pInfo->estimatedCost = 1000.0;
+  pInfo->estimatedRows = 1000;
+  return SQLITE_OK;
+}
+
+static int cypherVtabOpen(sqlite3_vtab *pBase, sqlite3_vtab_cursor **ppCursor) {
+  CypherVtabCursor *pCur;
+  
+  (void)pBase;
+  
+  pCur = sqlite3_malloc(sizeof(*pCur));
+  if( !pCur ) return SQLITE_NOMEM;
+  memset(pCur, 0, sizeof(*pCur));
+  pCur->bEof = 1;
+  *ppCursor = &pCur->base;
+  return SQLITE_OK;
+}
+
+/*
+** Release the running query, if any. Destroying the executor closes the
+** iterator tree.
+*/
+static void cypherVtabReset(CypherVtabCursor *pCur) {
+  cypherBatchDestroy(pCur->pBatch);
+  cypherExecutorDestroy(pCur->pExecutor);
+  if( pCur->pPlanner ) cypherPlannerDestroy(pCur->pPlanner);
+  if( pCur->pParser ) cypherParserDestroy(pCur->pParser);
+  pCur->pBatch = NULL;
+  pCur->iBatchRow = 0;
+  pCur->bEof = 1;
+  pCur->pExecutor = NULL;
+  pCur->pPlanner = NULL;
+  pCur->pParser = NULL;
+  pCur->iRow = 0;
+}
+
+static int cypherVtabClose(sqlite3_vtab_cursor *pCursor) {
+  CypherVtabCursor *pCur = (CypherVtabCursor*)pCursor;
+  cypherVtabReset(pCur);
+  sqlite3_free(pCur);
+  return SQLITE_OK;
+}
+
+/*
+** Move to the next row, refilling the batch from the root iterator once
+** its rows are used up.
+*/
+static int cypherVtabNext(sqlite3_vtab_cursor *pCursor) {
+  CypherVtabCursor *pCur = (CypherVtabCursor*)pCursor;
+  int rc;
+  
+  pCur->iRow++;
+  if( ++pCur->iBatchRow < pCur->pBatch->nRow ) return SQLITE_OK;
+  
+  pCur->iBatchRow = 0;
+  rc = cypherIteratorNextBatch(pCur->pExecutor->pRootIterator, pCur->pBatch);
+  if( rc == SQLITE_OK ) return SQLITE_OK;
+  cypherBatchReset(pCur->pBatch);
+  pCur->bEof = 1;
+  if( rc == SQLITE_DONE ) return SQLITE_OK;
+  sqlite3_free(pCursor->pVtab->zErrMsg);
+  pCursor->pVtab->zErrMsg = sqlite3_mprintf("cypher(): iterator error: %d", rc);
+  return rc;
+}
+
+/*
+** Parse, plan and prepare the query, then open the root iterator and read
+** the first row.
+*/
+static int cypherVtabFilter(sqlite3_vtab_cursor *pCursor, int idxNum,
+                            const char *idxStr, int argc, sqlite3_value **argv) {
+  CypherVtabCursor *pCur = (CypherVtabCursor*)pCursor;
+  CypherVtab *pVtab = (CypherVtab*)pCursor->pVtab;
+  const char *zQuery = pVtab->zQuery;
+  CypherAst *pAst;
+  PhysicalPlanNode *pPlan;
+  CypherIterator *pRoot;
+  char *zParseErr = NULL;
+  char *zErrMsg = NULL;
+  int rc;
+  
+  (void)idxNum;
+  (void)idxStr;
+  
+  cypherVtabReset(pCur);
+  if( !zQuery && argc > 0 ) {
+    zQuery = (const char*)sqlite3_value_text(argv[0]);
+  }
+  if( !zQuery ) return SQLITE_OK;
+  
+  pCur->pParser = cypherParserCreate();
+  if( !pCur->pParser ) return SQLITE_NOMEM;
+  /* The parser reports errors in malloc() memory */
+  pAst = cypherParse(pCur->pParser, zQuery, &zParseErr);
+  if( !pAst ) {
+    zErrMsg = sqlite3_mprintf("%s", zParseErr ? zParseErr : "Parse error");
+    free(zParseErr);
+    rc = SQLITE_ERROR;
+    goto filter_error;
+  }
+  free(zParseErr);
+  
+  pCur->pPlanner = cypherPlannerCreate(pVtab->pDb, getGlobalGraph());
+  if( !pCur->pPlanner ) return SQLITE_NOMEM;
+  rc = cypherPlannerCompile(pCur->pPlanner, pAst);
+  if( rc == SQLITE_OK ) rc = cypherPlannerOptimize(pCur->pPlanner);
+  pPlan = rc == SQLITE_OK ? cypherPlannerGetPlan(pCur->pPlanner) : NULL;
+  if( !pPlan ) {
+    const char *zError = cypherPlannerGetError(pCur->pPlanner);
+    zErrMsg = sqlite3_mprintf("%s", zError ? zError : "Planning error");
+    if( rc == SQLITE_OK ) rc = SQLITE_ERROR;
+    goto filter_error;
+  }
+  
+  pCur->pExecutor = cypherExecutorCreate(pVtab->pDb, getGlobalGraph());
+  if( !pCur->pExecutor ) return SQLITE_NOMEM;
+  rc = cypherExecutorPrepare(pCur->pExecutor, pPlan);
+  if( rc != SQLITE_OK ) {
+    const char *zError = cypherExecutorGetError(pCur->pExecutor);
+    zErrMsg = sqlite3_mprintf("%s", zError ? zError : "Executor prepare error");
+    goto filter_error;
+  }
+  
+  pRoot = pCur->pExecutor->pRootIterator;
+  rc = pRoot->xOpen(pRoot);
+  if( rc != SQLITE_OK ) {
+    zErrMsg = sqlite3_mprintf("Failed to open root iterator");
+    goto filter_error;
+  }
+  pCur->pBatch = cypherBatchCreate();
+  if( !pCur->pBatch ) return SQLITE_NOMEM;
+  pCur->bEof = 0;
+  pCur->iRow = 0;
+  pCur->iBatchRow = -1;
+  return cypherVtabNext(pCursor);
+  
+filter_error:
+  sqlite3_free(pCursor->pVtab->zErrMsg);
+  pCursor->pVtab->zErrMsg = sqlite3_mprintf("cypher(): %z", zErrMsg);
+  cypherVtabReset(pCur);
+  return rc;
+}
+
+static int cypherVtabEof(sqlite3_vtab_cursor *pCursor) {
+  CypherVtabCursor *pCur = (CypherVtabCursor*)pCursor;
+  return pCur->bEof;
+}
+
+/*
+** Return a value as the nearest SQL type. Graph entities become their ids,
+** compound values JSON.
+*/
+static void cypherVtabResultValue(sqlite3_context *pCtx, const CypherValue *pValue) {
+  char *zJson;
+  
+  switch( pValue->type ) {
+    case CYPHER_VALUE_NULL:
+      sqlite3_result_null(pCtx);
+      break;
+    case CYPHER_VALUE_BOOLEAN:
+      sqlite3_result_int(pCtx, pValue->u.bBoolean != 0);
+      break;
+    case CYPHER_VALUE_INTEGER:
+      sqlite3_result_int64(pCtx, pValue->u.iInteger);
+      break;
+    case CYPHER_VALUE_FLOAT:
+      sqlite3_result_double(pCtx, pValue->u.rFloat);
+      break;
+    case CYPHER_VALUE_STRING:
+      sqlite3_result_text(pCtx, pValue->u.zString, -1, SQLITE_TRANSIENT);
+      break;
+    case CYPHER_VALUE_NODE:
+      sqlite3_result_int64(pCtx, pValue->u.iNodeId);
+      break;
+    case CYPHER_VALUE_RELATIONSHIP:
+      sqlite3_result_int64(pCtx, pValue->u.iRelId);
+      break;
+    default:
+      zJson = cypherValueToJson(pValue);
+      if( zJson ) sqlite3_result_text(pCtx, zJson, -1, sqlite3_free);
+      else sqlite3_result_error_nomem(pCtx);
+      break;
+  }
+}
+
+static int cypherVtabColumn(sqlite3_vtab_cursor *pCursor, sqlite3_context *pCtx, int iCol) {
+  CypherVtabCursor *pCur = (CypherVtabCursor*)pCursor;
+  CypherVtab *pVtab = (CypherVtab*)pCursor->pVtab;
+  CypherBatch *pBatch = pCur->pBatch;
+  CypherValue value;
+  int i;
+  
+  if( !pVtab->zQuery ) {
+    if( iCol == CYPHER_VTAB_VALUE ) {
+      /* Build the row object straight from the batch columns */
+      char *zJson = sqlite3_mprintf("{");
+      for( i = 0; zJson && i < pBatch->nCol; i++ ) {
+        char *zKey = cypherJsonQuote(pBatch->aCol[i].zName);
+        char *zValue;
+        cypherBatchValue(pBatch, i, pCur->iBatchRow, &value);
+        zValue = cypherValueToJson(&value);
+        if( zKey && zValue ) {
+          zJson = sqlite3_mprintf("%z%s%s:%s", zJson, i > 0 ? "," : "",
+                                  zKey, zValue);
+        } else {
+          sqlite3_free(zJson);
+          zJson = NULL;
+        }
+        sqlite3_free(zKey);
+        sqlite3_free(zValue);
+      }
+      if( zJson ) zJson = sqlite3_mprintf("%z}", zJson);
+      if( !zJson ) return SQLITE_NOMEM;
+      sqlite3_result_text(pCtx, zJson, -1, sqlite3_free);
+    } else {
+      sqlite3_result_null(pCtx);  /* The query is consumed by xBestIndex */
+    }
+    return SQLITE_OK;
+  }
+  
+  /* Match the RETURN item by name, falling back to its position */
+  for( i = 0; i < pBatch->nCol; i++ ) {
+    if( strcmp(pBatch->aCol[i].zName, pVtab->azColumn[iCol]) == 0 ) break;
+  }
+  if( i == pBatch->nCol ) i = iCol;
+  if( i < pBatch->nCol ) {
+    cypherBatchValue(pBatch, i, pCur->iBatchRow, &value);
+    cypherVtabResultValue(pCtx, &value);
+  } else {
+    sqlite3_result_null(pCtx);
+  }
+  return SQLITE_OK;
+}
+
+static int cypherVtabRowid(sqlite3_vtab_cursor *pCursor, sqlite3_int64 *pRowid) {
+  CypherVtabCursor *pCur = (CypherVtabCursor*)pCursor;
+  *pRowid = pCur->iRow;
+  return SQLITE_OK;
+}
+
+/*
+** Virtual table module for cypher(). xCreate is xConnect so that a table
+** bound to a fixed query can be created; there is no backing storage.
+*/
+static sqlite3_module cypherVtabModule = {
+  0,                        /* iVersion */
+  cypherVtabConnect,        /* xCreate */
+  cypherVtabConnect,        /* xConnect */
+  cypherVtabBestIndex,      /* xBestIndex */
+  cypherVtabDisconnect,     /* xDisconnect */
+  cypherVtabDisconnect,     /* xDestroy */
+  cypherVtabOpen,           /* xOpen */
+  cypherVtabClose,          /* xClose */
+  cypherVtabFilter,         /* xFilter */
+  cypherVtabNext,           /* xNext */
+  cypherVtabEof,            /* xEof */
+  cypherVtabColumn,         /* xColumn */
+  cypherVtabRowid,          /* xRowid */
+  0,                        /* xUpdate */
+  0,                        /* xBegin */
+  0,                        /* xSync */
+  0,                        /* xCommit */
+  0,                        /* xRollback */
+  0,                        /* xFindFunction */
+  0,                        /* xRename */
+  0,                        /* xSavepoint */
+  0,                        /* xRelease */
+  0,                        /* xRollbackTo */
+  0,                        /* xShadowName */
+  0                         /* xIntegrity */
+};
+
 /*
 ** Register all Cypher executor SQL functions with the database.
 ** This should be called during extension initialization.
@@ -332,6 +887,10 @@ static void cypherTestExecuteSqlFunc(
 int cypherRegisterExecutorSqlFunctions(sqlite3 *db) {
   int rc = SQLITE_OK;
   
+  /* Functions callable from Cypher expressions */
+  rc = cypherRegisterBuiltinFunctions();
+  if( rc != SQLITE_OK ) return rc;
+  
   /* Register cypher_execute function */
   rc = sqlite3_create_function(db, "cypher_execute", 1, 
                               SQLITE_UTF8,
@@ -344,11 +903,21 @@ int cypherRegisterExecutorSqlFunctions(sqlite3 *db) {
                               0, cypherExecuteExplainSqlFunc, 0, 0);
   if( rc != SQLITE_OK ) return rc;
   
+  /* Register cypher_spill_limit function */
+  rc = sqlite3_create_function(db, "cypher_spill_limit", -1,
+                              SQLITE_UTF8,
+                              0, cypherSpillLimitSqlFunc, 0, 0);
+  if( rc != SQLITE_OK ) return rc;
+  
   /* Register cypher_test_execute function */
   rc = sqlite3_create_function(db, "cypher_test_execute", 0,
                               SQLITE_UTF8,
                               0, cypherTestExecuteSqlFunc, 0, 0);
   if( rc != SQLITE_OK ) return rc;
   
+  /* Register the cypher() table-valued function */
+  rc = sqlite3_create_module(db, "cypher", &cypherVtabModule, 0);
+  if( rc != SQLITE_OK ) return rc;
+  
   return SQLITE_OK;
 }
\ No newline at end of file
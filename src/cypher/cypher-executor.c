@@ -64,43 +64,14 @@ void cypherExecutorDestroy(CypherExecutor *pExecutor) {
 }
 
 /*
-** Recursively create iterators from a physical plan tree.
+** Create the iterator tree for a physical plan. Every operator creates
+** and owns the iterators of its own inputs, so only the root is built
+** here.
 ** Returns the root iterator, or NULL on error.
 */
 static CypherIterator *createIteratorTree(PhysicalPlanNode *pPlan, ExecutionContext *pContext) {
-  CypherIterator *pIterator;
-  CypherIterator *pChild;
-  
   if( !pPlan ) return NULL;
-  
-  /* Create iterator for this plan node */
-  pIterator = cypherIteratorCreate(pPlan, pContext);
-  if( !pIterator ) return NULL;
-  
-  /* Create child iterators */
-  if( pPlan->nChildren > 0 ) {
-    pIterator->apChildren = sqlite3_malloc(pPlan->nChildren * sizeof(CypherIterator*));
-    if( !pIterator->apChildren ) {
-      cypherIteratorDestroy(pIterator);
-      return NULL;
-    }
-    
-    for( int i = 0; i < pPlan->nChildren; i++ ) {
-      pChild = createIteratorTree(pPlan->apChildren[i], pContext);
-      if( !pChild ) {
-        /* Clean up partial iterator tree */
-        for( int j = 0; j < i; j++ ) {
-          cypherIteratorDestroy(pIterator->apChildren[j]);
-        }
-        cypherIteratorDestroy(pIterator);
-        return NULL;
-      }
-      pIterator->apChildren[i] = pChild;
-      pIterator->nChildren++;
-    }
-  }
-  
-  return pIterator;
+  return cypherIteratorCreate(pPlan, pContext);
 }
 
 /*
@@ -215,7 +186,6 @@ int cypherExecutorExecute(CypherExecutor *pExecutor, char **pzResults) {
     nUsed += nRowLen;
     
     sqlite3_free(zRowJson);
-        sqlite3_free(zResultArray);
     nResults++;
     
     /* Sanity check to prevent infinite loops */
@@ -297,7 +267,7 @@ char *cypherExecuteTestQuery(sqlite3 *pDb, const char *zQuery) {
   if( !pAst ) goto cleanup;
   
   /* Plan query */
-  pPlanner = cypherPlannerCreate(pDb, NULL);
+  pPlanner = cypherPlannerCreate(pDb, getGlobalGraph());
   if( !pPlanner ) goto cleanup;
   
   rc = cypherPlannerCompile(pPlanner, pAst);
@@ -0,0 +1,409 @@
+/*
+ * Cypher Expression Programs
+ * Lowers expression trees to flat register programs for per-row evaluation
+ */
+
+#include "sqlite3ext.h"
+#ifndef SQLITE_CORE
+extern const sqlite3_api_routines *sqlite3_api;
+#endif
+/* SQLITE_EXTENSION_INIT1 - removed to prevent multiple definition */
+#include <string.h>
+#include <sqlite3.h>
+#include "cypher-expressions.h"
+
+int cypherEvaluateArithmetic(const CypherValue *pLeft, const CypherValue *pRight,
+                           CypherArithmeticOp op, CypherValue *pResult);
+int cypherEvaluateComparison(const CypherValue *pLeft, const CypherValue *pRight,
+                           CypherComparisonOp op, CypherValue *pResult);
+
+/* Program opcodes */
+typedef enum {
+    CYPHER_PROG_SLOT,        /* r[p1] = binding in context slot p2 */
+    CYPHER_PROG_ARITHMETIC,  /* r[p1] = r[p2] <p4> r[p3] */
+    CYPHER_PROG_COMPARE,     /* r[p1] = r[p2] <p4> r[p3] */
+    CYPHER_PROG_FUNCTION,    /* r[p1] = pFunc(r[aiArg[p2]] .. r[aiArg[p2+p3-1]]) */
+    CYPHER_PROG_EVAL         /* r[p1] = tree evaluation of pExpr */
+} CypherProgramOpcode;
+
+typedef struct CypherProgramOp {
+    CypherProgramOpcode opcode;
+    int p1, p2, p3, p4;
+    const CypherBuiltinFunction *pFunc;  /* Pre-resolved for FUNCTION */
+    const CypherExpression *pExpr;       /* Subtree for EVAL */
+} CypherProgramOp;
+
+/*
+** A compiled expression. Registers are a pair of arrays: aReg owns the
+** values the program computes or folded at compile time, and apReg
+** points at each register's current value, which for variables is the
+** binding itself so that reading a variable copies nothing.
+*/
+struct CypherProgram {
+    CypherProgramOp *aOp;        /* Operations, in execution order */
+    int nOp;
+    CypherValue *aReg;           /* Owned register values */
+    const CypherValue **apReg;   /* Current value of each register */
+    int nReg;
+    int *aiArg;                  /* Argument registers of FUNCTION ops */
+    int nArg;
+    CypherValue *aArgValue;      /* Scratch argument vector for calls */
+    int nArgValueMax;
+    int iResult;                 /* Register holding the result */
+};
+
+/* Number of nodes in an expression tree, an upper bound on registers */
+static int programCountNodes(const CypherExpression *pExpr) {
+    int n = 1;
+    int i;
+
+    if (!pExpr) return 0;
+    switch (pExpr->type) {
+        case CYPHER_EXPR_ARITHMETIC:
+        case CYPHER_EXPR_COMPARISON:
+            n += programCountNodes(pExpr->u.binary.pLeft);
+            n += programCountNodes(pExpr->u.binary.pRight);
+            break;
+        case CYPHER_EXPR_FUNCTION:
+            for (i = 0; i < pExpr->u.function.nArgs; i++) {
+                n += programCountNodes(pExpr->u.function.apArgs[i]);
+            }
+            break;
+        default:
+            break;
+    }
+    return n;
+}
+
+/* Resolve a function call, or NULL if it must be left to the tree */
+static const CypherBuiltinFunction *programFunction(const CypherExpression *pExpr) {
+    const CypherBuiltinFunction *pFunc = cypherGetBuiltinFunction(pExpr->u.function.zName);
+    int nArgs = pExpr->u.function.nArgs;
+
+    if (!pFunc) return NULL;
+    if (nArgs < pFunc->nMinArgs || (pFunc->nMaxArgs >= 0 && nArgs > pFunc->nMaxArgs)) {
+        return NULL;
+    }
+    return pFunc;
+}
+
+/*
+** True if an expression depends on nothing but literals, so that its
+** value can be computed once at compile time.
+*/
+static int programIsConstant(const CypherExpression *pExpr) {
+    int i;
+
+    if (!pExpr) return 0;
+    switch (pExpr->type) {
+        case CYPHER_EXPR_LITERAL:
+            return 1;
+        case CYPHER_EXPR_ARITHMETIC:
+        case CYPHER_EXPR_COMPARISON:
+            return programIsConstant(pExpr->u.binary.pLeft) &&
+                   programIsConstant(pExpr->u.binary.pRight);
+        case CYPHER_EXPR_FUNCTION:
+            if (!programFunction(pExpr)) return 0;
+            for (i = 0; i < pExpr->u.function.nArgs; i++) {
+                if (!programIsConstant(pExpr->u.function.apArgs[i])) return 0;
+            }
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static CypherProgramOp *programAddOp(CypherProgram *p, CypherProgramOpcode opcode, int iReg) {
+    CypherProgramOp *pOp = &p->aOp[p->nOp++];
+    memset(pOp, 0, sizeof(*pOp));
+    pOp->opcode = opcode;
+    pOp->p1 = iReg;
+    return pOp;
+}
+
+/* Compile pExpr, leaving the number of its result register in *piReg */
+static int programCompileExpr(CypherProgram *p, const CypherExpression *pExpr,
+                              ExecutionContext *pContext, int *piReg) {
+    CypherProgramOp *pOp;
+    int iReg = p->nReg++;
+    int iLeft, iRight;
+    int rc;
+    int i;
+
+    *piReg = iReg;
+
+    /* Fold constant subtrees; an evaluation error is left to surface at
+    ** run time, as it would have without compilation */
+    if (programIsConstant(pExpr)) {
+        if (cypherExpressionEvaluate(pExpr, NULL, &p->aReg[iReg]) == SQLITE_OK) {
+            return SQLITE_OK;
+        }
+        cypherValueDestroy(&p->aReg[iReg]);
+        cypherValueInit(&p->aReg[iReg]);
+    }
+
+    switch (pExpr->type) {
+        case CYPHER_EXPR_VARIABLE:
+            if (!pContext || !pExpr->u.variable.zName) break;
+            pOp = programAddOp(p, CYPHER_PROG_SLOT, iReg);
+            pOp->p2 = executionContextSlot(pContext, pExpr->u.variable.zName);
+            return pOp->p2 < 0 ? SQLITE_NOMEM : SQLITE_OK;
+
+        case CYPHER_EXPR_ARITHMETIC:
+        case CYPHER_EXPR_COMPARISON:
+            if (!pExpr->u.binary.pLeft || !pExpr->u.binary.pRight) break;
+            rc = programCompileExpr(p, pExpr->u.binary.pLeft, pContext, &iLeft);
+            if (rc == SQLITE_OK) {
+                rc = programCompileExpr(p, pExpr->u.binary.pRight, pContext, &iRight);
+            }
+            if (rc != SQLITE_OK) return rc;
+            pOp = programAddOp(p, pExpr->type == CYPHER_EXPR_ARITHMETIC ?
+                               CYPHER_PROG_ARITHMETIC : CYPHER_PROG_COMPARE, iReg);
+            pOp->p2 = iLeft;
+            pOp->p3 = iRight;
+            pOp->p4 = pExpr->u.binary.op;
+            return SQLITE_OK;
+
+        case CYPHER_EXPR_FUNCTION: {
+            const CypherBuiltinFunction *pFunc = programFunction(pExpr);
+            int nArgs = pExpr->u.function.nArgs;
+            int iArg = p->nArg;
+
+            if (!pFunc) break;
+            p->nArg += nArgs;
+            for (i = 0; i < nArgs; i++) {
+                rc = programCompileExpr(p, pExpr->u.function.apArgs[i], pContext, &p->aiArg[iArg + i]);
+                if (rc != SQLITE_OK) return rc;
+            }
+            pOp = programAddOp(p, CYPHER_PROG_FUNCTION, iReg);
+            pOp->p2 = iArg;
+            pOp->p3 = nArgs;
+            pOp->pFunc = pFunc;
+            if (nArgs > p->nArgValueMax) p->nArgValueMax = nArgs;
+            return SQLITE_OK;
+        }
+
+        default:
+            break;
+    }
+
+    /* Anything else is evaluated by walking the subtree */
+    pOp = programAddOp(p, CYPHER_PROG_EVAL, iReg);
+    pOp->pExpr = pExpr;
+    return SQLITE_OK;
+}
+
+/*
+** Compile an expression into a program. Variables are bound to slots of
+** pContext, which the program must later be executed against. The
+** expression must outlive the program.
+*/
+int cypherExpressionCompile(const CypherExpression *pExpr, ExecutionContext *pContext,
+                            CypherProgram **ppProgram) {
+    CypherProgram *p;
+    int nNode;
+    int rc;
+    int i;
+
+    if (!pExpr || !ppProgram) return SQLITE_MISUSE;
+    *ppProgram = NULL;
+
+    nNode = programCountNodes(pExpr);
+    p = sqlite3_malloc(sizeof(CypherProgram));
+    if (!p) return SQLITE_NOMEM;
+    memset(p, 0, sizeof(CypherProgram));
+
+    p->aOp = sqlite3_malloc(nNode * sizeof(CypherProgramOp));
+    p->aReg = sqlite3_malloc(nNode * sizeof(CypherValue));
+    p->apReg = sqlite3_malloc(nNode * sizeof(CypherValue*));
+    p->aiArg = sqlite3_malloc(nNode * sizeof(int));
+    if (!p->aOp || !p->aReg || !p->apReg || !p->aiArg) {
+        cypherProgramDestroy(p);
+        return SQLITE_NOMEM;
+    }
+    for (i = 0; i < nNode; i++) {
+        cypherValueInit(&p->aReg[i]);
+        p->apReg[i] = &p->aReg[i];
+    }
+
+    rc = programCompileExpr(p, pExpr, pContext, &p->iResult);
+    if (rc == SQLITE_OK && p->nArgValueMax > 0) {
+        p->aArgValue = sqlite3_malloc(p->nArgValueMax * sizeof(CypherValue));
+        if (!p->aArgValue) rc = SQLITE_NOMEM;
+    }
+    if (rc != SQLITE_OK) {
+        cypherProgramDestroy(p);
+        return rc;
+    }
+
+    *ppProgram = p;
+    return SQLITE_OK;
+}
+
+void cypherProgramDestroy(CypherProgram *pProgram) {
+    int i;
+
+    if (!pProgram) return;
+    if (pProgram->aReg) {
+        for (i = 0; i < pProgram->nReg; i++) {
+            cypherValueDestroy(&pProgram->aReg[i]);
+        }
+    }
+    sqlite3_free(pProgram->aOp);
+    sqlite3_free(pProgram->aReg);
+    sqlite3_free(pProgram->apReg);
+    sqlite3_free(pProgram->aiArg);
+    sqlite3_free(pProgram->aArgValue);
+    sqlite3_free(pProgram);
+}
+
+/*
+** Integer and float fast paths for arithmetic. Returns 1 if the result
+** was computed, 0 to fall back to cypherEvaluateArithmetic().
+*/
+static int programArithmeticFast(const CypherValue *pL, const CypherValue *pR,
+                                 int op, CypherValue *pOut) {
+    if (pL->type == CYPHER_VALUE_INTEGER && pR->type == CYPHER_VALUE_INTEGER) {
+        sqlite3_int64 x = pL->u.iInteger, y = pR->u.iInteger, r;
+        switch (op) {
+            case CYPHER_OP_ADD:
+                if (__builtin_add_overflow(x, y, &r)) return 0;
+                break;
+            case CYPHER_OP_SUBTRACT:
+                if (__builtin_sub_overflow(x, y, &r)) return 0;
+                break;
+            case CYPHER_OP_MULTIPLY:
+                if (__builtin_mul_overflow(x, y, &r)) return 0;
+                break;
+            case CYPHER_OP_MODULO:
+                if (y == 0) return 0;
+                r = (y == -1) ? 0 : x % y;
+                break;
+            default:
+                return 0;
+        }
+        cypherValueSetInteger(pOut, r);
+        return 1;
+    }
+    if (pL->type == CYPHER_VALUE_FLOAT && pR->type == CYPHER_VALUE_FLOAT) {
+        double x = pL->u.rFloat, y = pR->u.rFloat;
+        switch (op) {
+            case CYPHER_OP_ADD:      cypherValueSetFloat(pOut, x + y); return 1;
+            case CYPHER_OP_SUBTRACT: cypherValueSetFloat(pOut, x - y); return 1;
+            case CYPHER_OP_MULTIPLY: cypherValueSetFloat(pOut, x * y); return 1;
+            default:                 return 0;
+        }
+    }
+    return 0;
+}
+
+/*
+** Same-type integer and float fast paths for the ordering comparisons.
+** Returns 1 if the result was computed, 0 to fall back to
+** cypherEvaluateComparison().
+*/
+static int programCompareFast(const CypherValue *pL, const CypherValue *pR,
+                              int op, CypherValue *pOut) {
+    int c;
+
+    if (pL->type == CYPHER_VALUE_INTEGER && pR->type == CYPHER_VALUE_INTEGER) {
+        c = (pL->u.iInteger > pR->u.iInteger) - (pL->u.iInteger < pR->u.iInteger);
+    } else if (pL->type == CYPHER_VALUE_FLOAT && pR->type == CYPHER_VALUE_FLOAT) {
+        c = (pL->u.rFloat > pR->u.rFloat) - (pL->u.rFloat < pR->u.rFloat);
+    } else {
+        return 0;
+    }
+    switch (op) {
+        case CYPHER_CMP_EQUAL:         cypherValueSetBoolean(pOut, c == 0); return 1;
+        case CYPHER_CMP_NOT_EQUAL:     cypherValueSetBoolean(pOut, c != 0); return 1;
+        case CYPHER_CMP_LESS:          cypherValueSetBoolean(pOut, c < 0);  return 1;
+        case CYPHER_CMP_LESS_EQUAL:    cypherValueSetBoolean(pOut, c <= 0); return 1;
+        case CYPHER_CMP_GREATER:       cypherValueSetBoolean(pOut, c > 0);  return 1;
+        case CYPHER_CMP_GREATER_EQUAL: cypherValueSetBoolean(pOut, c >= 0); return 1;
+        default:                       return 0;
+    }
+}
+
+/*
+** Run a program against the current bindings of pContext. On success
+** *ppResult points at the result, which stays valid until the program is
+** run again or the bindings change.
+*/
+int cypherProgramExecute(CypherProgram *pProgram, ExecutionContext *pContext,
+                         const CypherValue **ppResult) {
+    int i, j;
+    int rc = SQLITE_OK;
+
+    if (!pProgram || !ppResult) return SQLITE_MISUSE;
+
+    for (i = 0; rc == SQLITE_OK && i < pProgram->nOp; i++) {
+        const CypherProgramOp *pOp = &pProgram->aOp[i];
+        CypherValue *pOut = &pProgram->aReg[pOp->p1];
+
+        if (pOp->opcode == CYPHER_PROG_SLOT) {
+            pProgram->apReg[pOp->p1] = (pContext && pOp->p2 < pContext->nVariables) ?
+                                       &pContext->aBindings[pOp->p2] : pOut;
+            continue;
+        }
+
+        cypherValueDestroy(pOut);
+        cypherValueInit(pOut);
+        pProgram->apReg[pOp->p1] = pOut;
+
+        switch (pOp->opcode) {
+            case CYPHER_PROG_ARITHMETIC: {
+                const CypherValue *pL = pProgram->apReg[pOp->p2];
+                const CypherValue *pR = pProgram->apReg[pOp->p3];
+                if (!programArithmeticFast(pL, pR, pOp->p4, pOut)) {
+                    rc = cypherEvaluateArithmetic(pL, pR, (CypherArithmeticOp)pOp->p4, pOut);
+                }
+                break;
+            }
+
+            case CYPHER_PROG_COMPARE: {
+                const CypherValue *pL = pProgram->apReg[pOp->p2];
+                const CypherValue *pR = pProgram->apReg[pOp->p3];
+                if (!programCompareFast(pL, pR, pOp->p4, pOut)) {
+                    rc = cypherEvaluateComparison(pL, pR, (CypherComparisonOp)pOp->p4, pOut);
+                }
+                break;
+            }
+
+            case CYPHER_PROG_FUNCTION:
+                /* Builtins only read their arguments, so a shallow copy of
+                ** each register is enough */
+                for (j = 0; j < pOp->p3; j++) {
+                    pProgram->aArgValue[j] = *pProgram->apReg[pProgram->aiArg[pOp->p2 + j]];
+                }
+                rc = pOp->pFunc->xFunction(pProgram->aArgValue, pOp->p3, pOut);
+                break;
+
+            case CYPHER_PROG_EVAL:
+                rc = cypherExpressionEvaluate(pOp->pExpr, pContext, pOut);
+                break;
+
+            default:
+                rc = SQLITE_INTERNAL;
+                break;
+        }
+    }
+
+    if (rc == SQLITE_OK) {
+        *ppResult = pProgram->apReg[pProgram->iResult];
+    }
+    return rc;
+}
+
+/* Run a program and copy its result into pResult */
+int cypherProgramEvaluate(CypherProgram *pProgram, ExecutionContext *pContext,
+                          CypherValue *pResult) {
+    const CypherValue *pValue;
+    int rc;
+
+    if (!pResult) return SQLITE_MISUSE;
+    cypherValueInit(pResult);
+
+    rc = cypherProgramExecute(pProgram, pContext, &pValue);
+    if (rc != SQLITE_OK) return rc;
+    return cypherValueCopyInto(pResult, pValue);
+}
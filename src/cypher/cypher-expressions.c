@@ -23,6 +23,8 @@ int cypherEvaluateComparison(const CypherValue *pLeft, const CypherValue *pRight
                            CypherComparisonOp op, CypherValue *pResult);
 int cypherEvaluateFunction(const char *zName, CypherExpression **apArgs, int nArgs,
                          ExecutionContext *pContext, CypherValue *pResult);
+int cypherEvaluateLogical(const CypherValue *pLeft, const CypherValue *pRight,
+                         CypherLogicalOp op, CypherValue *pResult);
 
 /* Global function registry */
 static CypherBuiltinFunction *g_functions = NULL;
@@ -39,6 +41,9 @@ int cypherExpressionCreate(CypherExpression **ppExpr, CypherExpressionType type)
     
     memset(pExpr, 0, sizeof(CypherExpression));
     pExpr->type = type;
+    if (type == CYPHER_EXPR_VARIABLE) {
+        pExpr->u.variable.iSlot = -1;
+    }
     
     *ppExpr = pExpr;
     return SQLITE_OK;
@@ -103,6 +108,104 @@ int cypherExpressionDestroy(CypherExpression *pExpr) {
     return SQLITE_OK;
 }
 
+/*
+** Resolve every variable reference in an expression to its slot in the
+** execution context, so that evaluation reads the row frame directly
+** instead of looking names up.
+*/
+int cypherExpressionResolve(CypherExpression *pExpr, ExecutionContext *pContext) {
+    int rc = SQLITE_OK;
+    int i;
+    
+    if (!pExpr || !pContext) return SQLITE_OK;
+    
+    switch (pExpr->type) {
+        case CYPHER_EXPR_VARIABLE:
+            if (pExpr->u.variable.zName) {
+                pExpr->u.variable.iSlot = executionContextSlot(pContext, pExpr->u.variable.zName);
+                if (pExpr->u.variable.iSlot < 0) rc = SQLITE_NOMEM;
+            }
+            break;
+            
+        case CYPHER_EXPR_PROPERTY:
+            rc = cypherExpressionResolve(pExpr->u.property.pObject, pContext);
+            break;
+            
+        case CYPHER_EXPR_ARITHMETIC:
+        case CYPHER_EXPR_COMPARISON:
+        case CYPHER_EXPR_LOGICAL:
+        case CYPHER_EXPR_STRING:
+            rc = cypherExpressionResolve(pExpr->u.binary.pLeft, pContext);
+            if (rc == SQLITE_OK) {
+                rc = cypherExpressionResolve(pExpr->u.binary.pRight, pContext);
+            }
+            break;
+            
+        case CYPHER_EXPR_FUNCTION:
+            for (i = 0; rc == SQLITE_OK && i < pExpr->u.function.nArgs; i++) {
+                rc = cypherExpressionResolve(pExpr->u.function.apArgs[i], pContext);
+            }
+            break;
+            
+        case CYPHER_EXPR_LIST:
+            for (i = 0; rc == SQLITE_OK && i < pExpr->u.list.nElements; i++) {
+                rc = cypherExpressionResolve(pExpr->u.list.apElements[i], pContext);
+            }
+            break;
+            
+        case CYPHER_EXPR_MAP:
+            for (i = 0; rc == SQLITE_OK && i < pExpr->u.map.nPairs; i++) {
+                rc = cypherExpressionResolve(pExpr->u.map.apValues[i], pContext);
+            }
+            break;
+            
+        default:
+            break;
+    }
+    return rc;
+}
+
+/*
+** Set pResult to property zProp of pObject through the context's property
+** reader. Without a context only maps have properties.
+*/
+static int expressionReadProperty(ExecutionContext *pContext, const CypherValue *pObject,
+                                  const char *zProp, CypherValue *pResult) {
+    CypherPropertyReader noGraph;
+    
+    cypherValueSetNull(pResult);
+    if (pContext) return cypherPropertyRead(&pContext->props, pObject, zProp, pResult);
+    memset(&noGraph, 0, sizeof(noGraph));
+    return cypherPropertyRead(&noGraph, pObject, zProp, pResult);
+}
+
+/* Evaluate a list expression into a list of its element values */
+static int expressionEvaluateList(const CypherExpression *pExpr, ExecutionContext *pContext,
+                                  CypherValue *pResult) {
+    int nElements = pExpr->u.list.nElements;
+    CypherValue *aValues = NULL;
+    int rc = SQLITE_OK;
+    int i;
+    
+    if (nElements > 0) {
+        aValues = sqlite3_malloc(sizeof(CypherValue) * nElements);
+        if (!aValues) return SQLITE_NOMEM;
+    }
+    for (i = 0; i < nElements; i++) {
+        rc = cypherExpressionEvaluate(pExpr->u.list.apElements[i], pContext, &aValues[i]);
+        if (rc != SQLITE_OK) break;
+    }
+    if (rc != SQLITE_OK) {
+        while (i-- > 0) cypherValueDestroy(&aValues[i]);
+        sqlite3_free(aValues);
+        return rc;
+    }
+    pResult->type = CYPHER_VALUE_LIST;
+    pResult->u.list.apValues = aValues;
+    pResult->u.list.nValues = nElements;
+    return SQLITE_OK;
+}
+
 /* Expression evaluation */
 int cypherExpressionEvaluate(const CypherExpression *pExpr, 
                             ExecutionContext *pContext, 
@@ -129,20 +232,19 @@ int cypherExpressionEvaluate(const CypherExpression *pExpr,
             }
             
         case CYPHER_EXPR_VARIABLE:
-            /* Look up variable in execution context */
+            /* Read the slot resolved for the variable, falling back to
+            ** a lookup by name for unresolved expressions */
+            if (pContext && pExpr->u.variable.iSlot >= 0 &&
+                pExpr->u.variable.iSlot < pContext->nVariables) {
+                return cypherValueCopyInto(pResult, &pContext->aBindings[pExpr->u.variable.iSlot]);
+            }
             if (pContext && pExpr->u.variable.zName) {
                 CypherValue *pValue = executionContextGet(pContext, pExpr->u.variable.zName);
                 if (pValue) {
-                    *pResult = *cypherValueCopy(pValue);
-                    if (pResult->type == CYPHER_VALUE_NULL) {
-                        return SQLITE_NOMEM; /* Copy failed */
-                    }
-                } else {
-                    cypherValueSetNull(pResult);
+                    return cypherValueCopyInto(pResult, pValue);
                 }
-            } else {
-                cypherValueSetNull(pResult);
             }
+            cypherValueSetNull(pResult);
             return SQLITE_OK;
             
         case CYPHER_EXPR_ARITHMETIC:
@@ -190,6 +292,37 @@ int cypherExpressionEvaluate(const CypherExpression *pExpr,
                                         pContext,
                                         pResult);
             
+        case CYPHER_EXPR_PROPERTY:
+            cypherValueInit(&left);
+            rc = cypherExpressionEvaluate(pExpr->u.property.pObject, pContext, &left);
+            if (rc == SQLITE_OK) {
+                rc = expressionReadProperty(pContext, &left, pExpr->u.property.zProperty, pResult);
+            }
+            cypherValueDestroy(&left);
+            return rc;
+            
+        case CYPHER_EXPR_LOGICAL:
+            /* NOT has only a right operand */
+            cypherValueInit(&left);
+            cypherValueInit(&right);
+            
+            if (pExpr->u.binary.pLeft) {
+                rc = cypherExpressionEvaluate(pExpr->u.binary.pLeft, pContext, &left);
+            }
+            if (rc == SQLITE_OK) {
+                rc = cypherExpressionEvaluate(pExpr->u.binary.pRight, pContext, &right);
+            }
+            if (rc == SQLITE_OK) {
+                rc = cypherEvaluateLogical(pExpr->u.binary.pLeft ? &left : NULL, &right,
+                                         (CypherLogicalOp)pExpr->u.binary.op, pResult);
+            }
+            cypherValueDestroy(&left);
+            cypherValueDestroy(&right);
+            return rc;
+            
+        case CYPHER_EXPR_LIST:
+            return expressionEvaluateList(pExpr, pContext, pResult);
+            
         default:
             cypherValueSetNull(pResult);
             return SQLITE_OK;
@@ -292,8 +425,27 @@ int cypherEvaluateComparison(const CypherValue *pLeft, const CypherValue *pRight
         return SQLITE_OK;
     }
     
-    /* Compare values */
-    cmp = cypherValueCompare(pLeft, pRight);
+    /* Compare values. Integers and floats compare by value; values of
+    ** other differing types are never equal and have no order. */
+    if (op <= CYPHER_CMP_GREATER_EQUAL && pLeft->type != pRight->type) {
+        int bNumeric = (pLeft->type == CYPHER_VALUE_INTEGER || pLeft->type == CYPHER_VALUE_FLOAT) &&
+                       (pRight->type == CYPHER_VALUE_INTEGER || pRight->type == CYPHER_VALUE_FLOAT);
+        if (bNumeric) {
+            double rLeft = pLeft->type == CYPHER_VALUE_INTEGER ?
+                           (double)pLeft->u.iInteger : pLeft->u.rFloat;
+            double rRight = pRight->type == CYPHER_VALUE_INTEGER ?
+                            (double)pRight->u.iInteger : pRight->u.rFloat;
+            cmp = (rLeft > rRight) - (rLeft < rRight);
+        } else if (op == CYPHER_CMP_EQUAL || op == CYPHER_CMP_NOT_EQUAL) {
+            cypherValueSetBoolean(pResult, op == CYPHER_CMP_NOT_EQUAL);
+            return SQLITE_OK;
+        } else {
+            cypherValueSetNull(pResult);
+            return SQLITE_OK;
+        }
+    } else {
+        cmp = cypherValueCompare(pLeft, pRight);
+    }
     
     switch (op) {
         case CYPHER_CMP_EQUAL:
@@ -449,6 +601,26 @@ int cypherExpressionCreateLiteral(CypherExpression **ppExpr, const CypherValue *
     return SQLITE_OK;
 }
 
+/* Variable expression creation */
+int cypherExpressionCreateVariable(CypherExpression **ppExpr, const char *zName) {
+    CypherExpression *pExpr;
+    int rc;
+    
+    if (!ppExpr || !zName) return SQLITE_MISUSE;
+    
+    rc = cypherExpressionCreate(&pExpr, CYPHER_EXPR_VARIABLE);
+    if (rc != SQLITE_OK) return rc;
+    
+    pExpr->u.variable.zName = sqlite3_mprintf("%s", zName);
+    if (!pExpr->u.variable.zName) {
+        cypherExpressionDestroy(pExpr);
+        return SQLITE_NOMEM;
+    }
+    
+    *ppExpr = pExpr;
+    return SQLITE_OK;
+}
+
 /* Arithmetic expression creation */
 int cypherExpressionCreateArithmetic(CypherExpression **ppExpr,
                                     CypherExpression *pLeft,
@@ -506,6 +678,107 @@ int cypherExpressionCreateComparison(CypherExpression **ppExpr,
     return SQLITE_OK;
 }
 
+/* Property access expression creation, taking ownership of pObject */
+int cypherExpressionCreateProperty(CypherExpression **ppExpr,
+                                  CypherExpression *pObject,
+                                  const char *zProperty) {
+    CypherExpression *pExpr;
+    int rc;
+    
+    if (!ppExpr || !pObject || !zProperty) return SQLITE_MISUSE;
+    
+    rc = cypherExpressionCreate(&pExpr, CYPHER_EXPR_PROPERTY);
+    if (rc != SQLITE_OK) return rc;
+    
+    pExpr->u.property.zProperty = sqlite3_mprintf("%s", zProperty);
+    if (!pExpr->u.property.zProperty) {
+        cypherExpressionDestroy(pExpr);
+        return SQLITE_NOMEM;
+    }
+    pExpr->u.property.pObject = pObject;
+    
+    *ppExpr = pExpr;
+    return SQLITE_OK;
+}
+
+/* Logical expression creation; NOT takes a NULL pLeft */
+int cypherExpressionCreateLogical(CypherExpression **ppExpr,
+                                CypherExpression *pLeft,
+                                CypherExpression *pRight,
+                                CypherLogicalOp op) {
+    CypherExpression *pExpr;
+    int rc;
+    
+    if (!ppExpr || !pRight || (!pLeft && op != CYPHER_LOGIC_NOT)) return SQLITE_MISUSE;
+    
+    rc = cypherExpressionCreate(&pExpr, CYPHER_EXPR_LOGICAL);
+    if (rc != SQLITE_OK) return rc;
+    
+    pExpr->u.binary.pLeft = pLeft;
+    pExpr->u.binary.pRight = pRight;
+    pExpr->u.binary.op = op;
+    
+    *ppExpr = pExpr;
+    return SQLITE_OK;
+}
+
+/* Function call expression creation. The argument array is copied; the
+** arguments themselves are owned by the new expression. */
+int cypherExpressionCreateFunction(CypherExpression **ppExpr,
+                                 const char *zName,
+                                 CypherExpression **apArgs,
+                                 int nArgs) {
+    CypherExpression *pExpr;
+    int rc;
+    
+    if (!ppExpr || !zName || (nArgs > 0 && !apArgs)) return SQLITE_MISUSE;
+    
+    rc = cypherExpressionCreate(&pExpr, CYPHER_EXPR_FUNCTION);
+    if (rc != SQLITE_OK) return rc;
+    
+    pExpr->u.function.zName = sqlite3_mprintf("%s", zName);
+    if (nArgs > 0) {
+        pExpr->u.function.apArgs = sqlite3_malloc(sizeof(CypherExpression*) * nArgs);
+    }
+    if (!pExpr->u.function.zName || (nArgs > 0 && !pExpr->u.function.apArgs)) {
+        cypherExpressionDestroy(pExpr);
+        return SQLITE_NOMEM;
+    }
+    if (nArgs > 0) {
+        memcpy(pExpr->u.function.apArgs, apArgs, sizeof(CypherExpression*) * nArgs);
+    }
+    pExpr->u.function.nArgs = nArgs;
+    
+    *ppExpr = pExpr;
+    return SQLITE_OK;
+}
+
+/* List expression creation, copying the array as for function calls */
+int cypherExpressionCreateList(CypherExpression **ppExpr,
+                             CypherExpression **apElements,
+                             int nElements) {
+    CypherExpression *pExpr;
+    int rc;
+    
+    if (!ppExpr || (nElements > 0 && !apElements)) return SQLITE_MISUSE;
+    
+    rc = cypherExpressionCreate(&pExpr, CYPHER_EXPR_LIST);
+    if (rc != SQLITE_OK) return rc;
+    
+    if (nElements > 0) {
+        pExpr->u.list.apElements = sqlite3_malloc(sizeof(CypherExpression*) * nElements);
+        if (!pExpr->u.list.apElements) {
+            cypherExpressionDestroy(pExpr);
+            return SQLITE_NOMEM;
+        }
+        memcpy(pExpr->u.list.apElements, apElements, sizeof(CypherExpression*) * nElements);
+    }
+    pExpr->u.list.nElements = nElements;
+    
+    *ppExpr = pExpr;
+    return SQLITE_OK;
+}
+
 /* Built-in function registration */
 static CypherBuiltinFunction g_builtinFunctions[] = {
     {"toUpper", 1, 1, cypherFunctionToUpper},
@@ -518,6 +791,7 @@ static CypherBuiltinFunction g_builtinFunctions[] = {
     {"round", 1, 1, cypherFunctionRound},
     {"sqrt", 1, 1, cypherFunctionSqrt},
     {"toString", 1, 1, cypherFunctionToString},
+    {"id", 1, 1, cypherFunctionId},
     {"count", 1, 1, cypherFunctionCount},
     {"sum", 1, 1, cypherFunctionSum},
     {"avg", 1, 1, cypherFunctionAvg},
@@ -623,6 +897,11 @@ int cypherFunctionLength(CypherValue *apArgs, int nArgs, CypherValue *pResult) {
     
     if (apArgs[0].type == CYPHER_VALUE_STRING) {
         cypherValueSetInteger(pResult, strlen(apArgs[0].u.zString));
+    } else if (apArgs[0].type == CYPHER_VALUE_PATH) {
+        /* The number of relationships in the path */
+        cypherValueSetInteger(pResult, apArgs[0].u.path.nLength);
+    } else if (apArgs[0].type == CYPHER_VALUE_LIST) {
+        cypherValueSetInteger(pResult, apArgs[0].u.list.nValues);
     } else {
         return SQLITE_MISMATCH;
     }
@@ -780,8 +1059,30 @@ int cypherFunctionToString(CypherValue *apArgs, int nArgs, CypherValue *pResult)
     return SQLITE_OK;
 }
 
+/* id(n): the id of a node or relationship */
+int cypherFunctionId(CypherValue *apArgs, int nArgs, CypherValue *pResult) {
+    if (nArgs != 1 || !pResult) return SQLITE_MISUSE;
+    
+    switch (apArgs[0].type) {
+        case CYPHER_VALUE_NODE:
+            cypherValueSetInteger(pResult, apArgs[0].u.iNodeId);
+            return SQLITE_OK;
+            
+        case CYPHER_VALUE_RELATIONSHIP:
+            cypherValueSetInteger(pResult, apArgs[0].u.iRelId);
+            return SQLITE_OK;
+            
+        case CYPHER_VALUE_NULL:
+            cypherValueSetNull(pResult);
+            return SQLITE_OK;
+            
+        default:
+            return SQLITE_MISMATCH;
+    }
+}
+
 /*
-** Evaluate logical operations (AND, OR, NOT).
+** Evaluate logical operations (AND, OR, XOR, NOT).
 **
 ** Parameters:
 **   pLeft - Left operand (NULL for unary NOT)
@@ -838,6 +1139,19 @@ int cypherEvaluateLogical(const CypherValue *pLeft, const CypherValue *pRight,
             }
             return SQLITE_OK;
             
+        case CYPHER_LOGIC_XOR:
+            if (!pLeft || !pRight) return SQLITE_MISUSE;
+            
+            if (cypherValueIsNull(pLeft) || cypherValueIsNull(pRight)) {
+                cypherValueSetNull(pResult);
+                return SQLITE_OK;
+            }
+            
+            bLeft = cypherValueGetBoolean(pLeft);
+            bRight = cypherValueGetBoolean(pRight);
+            cypherValueSetBoolean(pResult, bLeft != bRight);
+            return SQLITE_OK;
+            
         case CYPHER_LOGIC_NOT:
             if (!pRight) return SQLITE_MISUSE;
             
@@ -9,9 +9,23 @@
 ** - AllNodesScan iterator for full table scans
 ** - LabelIndexScan iterator for label-based filtering
 ** - PropertyIndexScan iterator for property-based filtering
+** - BitmapScan iterator for conjunctions of low-cardinality equalities
+** - RangeIndexScan iterator for inequalities and index-ordered scans
+** - Expand iterator for relationship pattern steps
+** - VarLengthExpand iterator for variable-length relationship patterns
+** - ShortestPath iterator for shortestPath() and allShortestPaths()
+** - HashJoin iterator for patterns sharing variables, spilling to disk
+** - NestedLoopJoin iterator for the cross product of unrelated patterns
+** - Aggregation iterator for grouped count/sum/avg/min/max
+** - Distinct iterator for hashed duplicate elimination, spilling to disk
+** - Union iterator for concatenating query results
+** - Sort iterator with top-k selection and on-disk run merging
 ** - Filter iterator for predicate evaluation
 ** - Projection iterator for column selection
 **
+** Scans, Filter and Projection also fill column vectors a batch at a
+** time through xNextBatch, without building a CypherResult per row.
+**
 ** Memory allocation: All functions use sqlite3_malloc()/sqlite3_free()
 ** Error handling: Functions return SQLite error codes
 */
@@ -23,8 +37,11 @@ extern const sqlite3_api_routines *sqlite3_api;
 /* SQLITE_EXTENSION_INIT1 - removed to prevent multiple definition */
 #include "cypher-executor.h"
 #include "cypher-expressions.h"
+#include "cypher-paths.h"
 #include <string.h>
+#include <stdlib.h>
 #include <assert.h>
+#include "graph-performance.h"
 
 
 
@@ -46,9 +63,46 @@ CypherIterator *cypherIteratorCreate(PhysicalPlanNode *pPlan, ExecutionContext *
     case PHYSICAL_LABEL_INDEX_SCAN:
       return cypherLabelIndexScanCreate(pPlan, pContext);
       
+    case PHYSICAL_TYPE_INDEX_SCAN:
+      return cypherTypeIndexScanCreate(pPlan, pContext);
+      
     case PHYSICAL_PROPERTY_INDEX_SCAN:
       return cypherPropertyIndexScanCreate(pPlan, pContext);
       
+    case PHYSICAL_BITMAP_SCAN:
+      return cypherBitmapScanCreate(pPlan, pContext);
+      
+    case PHYSICAL_RANGE_INDEX_SCAN:
+      return cypherRangeIndexScanCreate(pPlan, pContext);
+      
+    case PHYSICAL_FULLTEXT_SCAN:
+      return cypherFulltextScanCreate(pPlan, pContext);
+      
+    case PHYSICAL_EXPAND_ALL:
+    case PHYSICAL_EXPAND_INTO:
+      return cypherExpandCreate(pPlan, pContext);
+      
+    case PHYSICAL_VAR_LENGTH_EXPAND:
+      return cypherVarLengthExpandCreate(pPlan, pContext);
+      
+    case PHYSICAL_SHORTEST_PATH:
+      return cypherShortestPathCreate(pPlan, pContext);
+      
+    case PHYSICAL_HASH_JOIN:
+      return cypherHashJoinCreate(pPlan, pContext);
+      
+    case PHYSICAL_NESTED_LOOP_JOIN:
+      return cypherNestedLoopJoinCreate(pPlan, pContext);
+      
+    case PHYSICAL_AGGREGATION:
+      return cypherAggregationCreate(pPlan, pContext);
+      
+    case PHYSICAL_DISTINCT:
+      return cypherDistinctCreate(pPlan, pContext);
+      
+    case PHYSICAL_UNION:
+      return cypherUnionCreate(pPlan, pContext);
+      
     case PHYSICAL_FILTER:
       return cypherFilterCreate(pPlan, pContext);
       
@@ -95,6 +149,191 @@ void cypherIteratorDestroy(CypherIterator *pIterator) {
   sqlite3_free(pIterator);
 }
 
+/*
+** Fill pBatch with the next rows of an iterator. Iterators without a batch
+** implementation are read a row at a time.
+*/
+int cypherIteratorNextBatch(CypherIterator *pIterator, CypherBatch *pBatch) {
+  int rc = SQLITE_OK;
+  
+  if( pIterator->xNextBatch ) {
+    return pIterator->xNextBatch(pIterator, pBatch);
+  }
+  
+  cypherBatchReset(pBatch);
+  while( rc == SQLITE_OK && pBatch->nRow < CYPHER_BATCH_SIZE ) {
+    CypherResult *pRow = cypherResultCreate();
+    if( !pRow ) return SQLITE_NOMEM;
+    rc = pIterator->xNext(pIterator, pRow);
+    if( rc == SQLITE_OK ) rc = cypherBatchAppendRow(pBatch, pRow);
+    cypherResultDestroy(pRow);
+  }
+  if( rc == SQLITE_DONE && pBatch->nRow > 0 ) rc = SQLITE_OK;
+  return rc;
+}
+
+/*
+** Batch form of the scans: step pStmt up to CYPHER_BATCH_SIZE times into
+** the id vector of the scan's column, without building any row.
+*/
+static int scanNextBatch(CypherIterator *pIterator, sqlite3_stmt *pStmt,
+                         CypherValueType eType, CypherBatch *pBatch) {
+  PhysicalPlanNode *pPlan = pIterator->pPlan;
+  const char *zName = pPlan->zAlias ? pPlan->zAlias :
+                      eType == CYPHER_VALUE_NODE ? "node" : "rel";
+  sqlite3_int64 *aId;
+  int iCol;
+  int rc;
+  
+  cypherBatchReset(pBatch);
+  if( pIterator->bEof ) return SQLITE_DONE;
+  
+  iCol = cypherBatchAddColumn(pBatch, zName, eType);
+  if( iCol < 0 ) return SQLITE_NOMEM;
+  aId = pBatch->aCol[iCol].aInt;
+  if( !aId ) return SQLITE_MISMATCH;
+  
+  while( pBatch->nRow < CYPHER_BATCH_SIZE ) {
+    rc = sqlite3_step(pStmt);
+    if( rc != SQLITE_ROW ) {
+      pIterator->bEof = 1;
+      break;
+    }
+    aId[pBatch->nRow++] = sqlite3_column_int64(pStmt, 0);
+  }
+  
+  pIterator->nRowsProduced += pBatch->nRow;
+  return pBatch->nRow > 0 ? SQLITE_OK : SQLITE_DONE;
+}
+
+/*
+** Append the SKIP and LIMIT pushed into a scan to its SQL, as parameters
+** bound by scanBindLimit(). Frees zSql and returns NULL on OOM.
+*/
+static char *scanLimitSql(char *zSql, PhysicalPlanNode *pPlan) {
+  if( !zSql || (pPlan->nLimit <= 0 && pPlan->nSkip <= 0) ) return zSql;
+  return sqlite3_mprintf("%z LIMIT :limit OFFSET :skip", zSql);
+}
+
+static void scanBindLimit(sqlite3_stmt *pStmt, PhysicalPlanNode *pPlan) {
+  int iLimit = sqlite3_bind_parameter_index(pStmt, ":limit");
+  if( iLimit > 0 ) {
+    sqlite3_bind_int(pStmt, iLimit, pPlan->nLimit > 0 ? pPlan->nLimit : -1);
+    sqlite3_bind_int(pStmt, sqlite3_bind_parameter_index(pStmt, ":skip"), pPlan->nSkip);
+  }
+}
+
+/*
+** Return the type of a literal from the plan, named as json_type() names
+** it: "text" for a quoted string, "integer", "real", "true" or "false".
+** Returns NULL for null and anything else.
+*/
+static const char *planValueType(const char *zValue) {
+  int n = (int)strlen(zValue);
+  char *zEnd;
+  
+  if( n >= 2 && (zValue[0] == '\'' || zValue[0] == '"') && zValue[n-1] == zValue[0] ) {
+    return "text";
+  }
+  if( strcmp(zValue, "true") == 0 || strcmp(zValue, "false") == 0 ) return zValue;
+  if( n == 0 ) return NULL;
+  strtoll(zValue, &zEnd, 10);
+  if( *zEnd == 0 ) return "integer";
+  strtod(zValue, &zEnd);
+  if( *zEnd == 0 ) return "real";
+  return NULL;
+}
+
+/*
+** Bind a literal from the plan. Quoted literals bind as their unescaped
+** text and numeric ones as numbers, so that they compare equal to
+** json_extract() results.
+*/
+static int bindPlanValue(sqlite3_stmt *pStmt, int iParam, const char *zValue) {
+  int n = (int)strlen(zValue);
+  sqlite3_int64 iVal;
+  double rVal;
+  char *zEnd;
+  
+  if( n >= 2 && (zValue[0] == '\'' || zValue[0] == '"') && zValue[n-1] == zValue[0] ) {
+    char *zText = planLiteralText(zValue);
+    if( !zText ) return SQLITE_NOMEM;
+    return sqlite3_bind_text(pStmt, iParam, zText, -1, sqlite3_free);
+  }
+  if( n > 0 ) {
+    iVal = strtoll(zValue, &zEnd, 10);
+    if( *zEnd == 0 ) return sqlite3_bind_int64(pStmt, iParam, iVal);
+    rVal = strtod(zValue, &zEnd);
+    if( *zEnd == 0 ) return sqlite3_bind_double(pStmt, iParam, rVal);
+  }
+  return sqlite3_bind_text(pStmt, iParam, zValue, n, SQLITE_STATIC);
+}
+
+/*
+** Append the comparison of a property with parameter ?iParam to zSql
+** after zAnd. SQL orders numbers before text, and json_extract() reads
+** JSON true and false as 1 and 0, where Cypher only compares values of
+** the same type. So the comparison also tests the JSON type of the
+** property: a value of another type never equals the literal and is
+** never ordered against it. Frees zSql and returns NULL on OOM.
+*/
+static char *propertyCompareSql(char *zSql, const char *zAnd,
+                                const PlanPredicate *pPred, int iParam) {
+  const char *zType = planValueType(pPred->zValue);
+  const char *zTypes = NULL;
+  
+  if( zType && strcmp(zType, "text") == 0 ) {
+    zTypes = "('text')";
+  } else if( zType && (strcmp(zType, "integer") == 0 || strcmp(zType, "real") == 0) ) {
+    zTypes = "('integer', 'real')";
+  }
+  if( !zTypes ) {
+    return sqlite3_mprintf("%z%s" GRAPH_PROPERTY_EXPR " %s ?%d", zSql, zAnd,
+                           pPred->zProperty, pPred->zOperator, iParam);
+  }
+  if( strcmp(pPred->zOperator, "<>") == 0 ) {
+    return sqlite3_mprintf("%z%s(json_type(properties, '$.%q') NOT IN %s OR "
+                           GRAPH_PROPERTY_EXPR " <> ?%d)", zSql, zAnd,
+                           pPred->zProperty, zTypes, pPred->zProperty, iParam);
+  }
+  return sqlite3_mprintf("%z%sjson_type(properties, '$.%q') IN %s AND "
+                         GRAPH_PROPERTY_EXPR " %s ?%d", zSql, zAnd,
+                         pPred->zProperty, zTypes, pPred->zProperty,
+                         pPred->zOperator, iParam);
+}
+
+/*
+** Append the filters pushed into a node scan to zSql, as further terms of
+** its WHERE clause, or of a new one unless bWhere is set. Their values
+** are parameters ?iParam, ?iParam+1, ... bound by scanBindFilter().
+** Frees zSql and returns NULL on OOM.
+*/
+static char *scanFilterSql(char *zSql, PhysicalPlanNode *pPlan, int bWhere, int iParam) {
+  int i;
+  
+  for( i = 0; zSql && i < pPlan->nScanFilter; i++ ) {
+    PlanPredicate *pFilter = &pPlan->aScanFilter[i];
+    const char *zAnd = (i == 0 && !bWhere) ? " WHERE " : " AND ";
+    
+    if( !pFilter->zProperty ) {
+      zSql = sqlite3_mprintf("%z%sid %s ?%d", zSql, zAnd, pFilter->zOperator, iParam + i);
+      continue;
+    }
+    zSql = propertyCompareSql(zSql, zAnd, pFilter, iParam + i);
+  }
+  return zSql;
+}
+
+static int scanBindFilter(sqlite3_stmt *pStmt, PhysicalPlanNode *pPlan, int iParam) {
+  int rc = SQLITE_OK;
+  int i;
+  
+  for( i = 0; i < pPlan->nScanFilter && rc == SQLITE_OK; i++ ) {
+    rc = bindPlanValue(pStmt, iParam + i, pPlan->aScanFilter[i].zValue);
+  }
+  return rc;
+}
+
 /*
 ** AllNodesScan iterator implementation.
 ** Scans all nodes in the graph sequentially.
@@ -106,6 +345,7 @@ typedef struct AllNodesScanData {
 
 static int allNodesScanOpen(CypherIterator *pIterator) {
   AllNodesScanData *pData = (AllNodesScanData*)pIterator->pIterData;
+  PhysicalPlanNode *pPlan = pIterator->pPlan;
   GraphVtab *pGraph = pIterator->pContext->pGraph;
   char *zSql;
   int rc;
@@ -113,9 +353,14 @@ static int allNodesScanOpen(CypherIterator *pIterator) {
   if( !pGraph ) return SQLITE_ERROR;
   
   zSql = sqlite3_mprintf("SELECT id FROM %s_nodes", pGraph->zTableName);
+  zSql = scanLimitSql(scanFilterSql(zSql, pPlan, 0, 1), pPlan);
+  if( !zSql ) return SQLITE_NOMEM;
   rc = sqlite3_prepare_v2(pGraph->pDb, zSql, -1, &pData->pStmt, 0);
   sqlite3_free(zSql);
   if( rc!=SQLITE_OK ) return rc;
+  rc = scanBindFilter(pData->pStmt, pPlan, 1);
+  if( rc!=SQLITE_OK ) return rc;
+  scanBindLimit(pData->pStmt, pPlan);
 
   pIterator->bOpened = 1;
   pIterator->bEof = 0;
@@ -149,6 +394,11 @@ static int allNodesScanNext(CypherIterator *pIterator, CypherResult *pResult) {
   return SQLITE_OK;
 }
 
+static int allNodesScanNextBatch(CypherIterator *pIterator, CypherBatch *pBatch) {
+  AllNodesScanData *pData = (AllNodesScanData*)pIterator->pIterData;
+  return scanNextBatch(pIterator, pData->pStmt, CYPHER_VALUE_NODE, pBatch);
+}
+
 static int allNodesScanClose(CypherIterator *pIterator) {
   AllNodesScanData *pData = (AllNodesScanData*)pIterator->pIterData;
   sqlite3_finalize(pData->pStmt);
@@ -179,6 +429,7 @@ CypherIterator *cypherAllNodesScanCreate(PhysicalPlanNode *pPlan, ExecutionConte
   /* Set up iterator */
   pIterator->xOpen = allNodesScanOpen;
   pIterator->xNext = allNodesScanNext;
+  pIterator->xNextBatch = allNodesScanNextBatch;
   pIterator->xClose = allNodesScanClose;
   pIterator->xDestroy = allNodesScanDestroy;
   pIterator->pContext = pContext;
@@ -202,6 +453,7 @@ static int labelIndexScanOpen(CypherIterator *pIterator) {
   LabelIndexScanData *pData = (LabelIndexScanData*)pIterator->pIterData;
   PhysicalPlanNode *pPlan = pIterator->pPlan;
   GraphVtab *pGraph = pIterator->pContext->pGraph;
+  sqlite3_int64 iLabelId = 0;
   char *zSql;
   int rc;
   
@@ -209,10 +461,30 @@ static int labelIndexScanOpen(CypherIterator *pIterator) {
   
   pData->zLabel = pPlan->zLabel;
   
-  zSql = sqlite3_mprintf("SELECT id FROM %s_nodes WHERE labels LIKE '%%%%\"%s\"%%%%'", pGraph->zTableName, pData->zLabel);
+  /* A label no node has ever carried has no id; the scan is then empty,
+  ** which label_id 0 (never assigned) gives for free. */
+  rc = graphLookupLabelId(pGraph, pData->zLabel, &iLabelId);
+  if( rc!=SQLITE_OK ) return rc;
+  
+  /* Range scan on the (label_id, node_id) primary key. Pushed filters
+  ** read the properties of each node found. */
+  if( pPlan->nScanFilter > 0 ) {
+    zSql = sqlite3_mprintf("SELECT node_id FROM %s_label_index JOIN %s_nodes "
+                           "ON id = node_id WHERE label_id = ?1",
+                           pGraph->zTableName, pGraph->zTableName);
+  } else {
+    zSql = sqlite3_mprintf("SELECT node_id FROM %s_label_index WHERE label_id = ?1",
+                           pGraph->zTableName);
+  }
+  zSql = scanLimitSql(scanFilterSql(zSql, pPlan, 1, 2), pPlan);
+  if( !zSql ) return SQLITE_NOMEM;
   rc = sqlite3_prepare_v2(pGraph->pDb, zSql, -1, &pData->pStmt, 0);
   sqlite3_free(zSql);
   if( rc!=SQLITE_OK ) return rc;
+  sqlite3_bind_int64(pData->pStmt, 1, iLabelId);
+  rc = scanBindFilter(pData->pStmt, pPlan, 2);
+  if( rc!=SQLITE_OK ) return rc;
+  scanBindLimit(pData->pStmt, pPlan);
 
   pIterator->bOpened = 1;
   pIterator->bEof = 0;
@@ -246,6 +518,11 @@ static int labelIndexScanNext(CypherIterator *pIterator, CypherResult *pResult)
   return SQLITE_OK;
 }
 
+static int labelIndexScanNextBatch(CypherIterator *pIterator, CypherBatch *pBatch) {
+  LabelIndexScanData *pData = (LabelIndexScanData*)pIterator->pIterData;
+  return scanNextBatch(pIterator, pData->pStmt, CYPHER_VALUE_NODE, pBatch);
+}
+
 static int labelIndexScanClose(CypherIterator *pIterator) {
   LabelIndexScanData *pData = (LabelIndexScanData*)pIterator->pIterData;
   sqlite3_finalize(pData->pStmt);
@@ -276,6 +553,7 @@ CypherIterator *cypherLabelIndexScanCreate(PhysicalPlanNode *pPlan, ExecutionCon
   /* Set up iterator */
   pIterator->xOpen = labelIndexScanOpen;
   pIterator->xNext = labelIndexScanNext;
+  pIterator->xNextBatch = labelIndexScanNextBatch;
   pIterator->xClose = labelIndexScanClose;
   pIterator->xDestroy = labelIndexScanDestroy;
   pIterator->pContext = pContext;
@@ -285,6 +563,118 @@ CypherIterator *cypherLabelIndexScanCreate(PhysicalPlanNode *pPlan, ExecutionCon
   return pIterator;
 }
 
+/*
+** TypeIndexScan iterator implementation.
+** Scans relationships of a specific type using the type_id index.
+*/
+
+typedef struct TypeIndexScanData {
+  sqlite3_stmt *pStmt;          /* SQL statement for edge iteration */
+  const char *zType;            /* Relationship type to filter by */
+} TypeIndexScanData;
+
+static int typeIndexScanOpen(CypherIterator *pIterator) {
+  TypeIndexScanData *pData = (TypeIndexScanData*)pIterator->pIterData;
+  PhysicalPlanNode *pPlan = pIterator->pPlan;
+  GraphVtab *pGraph = pIterator->pContext->pGraph;
+  sqlite3_int64 iTypeId = 0;
+  char *zSql;
+  int rc;
+  
+  if( !pGraph || !pPlan->zLabel ) return SQLITE_ERROR;
+  
+  pData->zType = pPlan->zLabel;
+  
+  /* As for labels, an unknown type has id 0 and the scan is empty */
+  rc = graphLookupRelTypeId(pGraph, pData->zType, &iTypeId);
+  if( rc!=SQLITE_OK ) return rc;
+  
+  zSql = scanLimitSql(sqlite3_mprintf("SELECT id FROM %s_edges WHERE type_id = ?",
+                                     pGraph->zTableName), pPlan);
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_prepare_v2(pGraph->pDb, zSql, -1, &pData->pStmt, 0);
+  sqlite3_free(zSql);
+  if( rc!=SQLITE_OK ) return rc;
+  sqlite3_bind_int64(pData->pStmt, 1, iTypeId);
+  scanBindLimit(pData->pStmt, pPlan);
+
+  pIterator->bOpened = 1;
+  pIterator->bEof = 0;
+  
+  return SQLITE_OK;
+}
+
+static int typeIndexScanNext(CypherIterator *pIterator, CypherResult *pResult) {
+  TypeIndexScanData *pData = (TypeIndexScanData*)pIterator->pIterData;
+  PhysicalPlanNode *pPlan = pIterator->pPlan;
+  CypherValue relValue;
+  int rc;
+  
+  if( pIterator->bEof ) return SQLITE_DONE;
+  
+  rc = sqlite3_step(pData->pStmt);
+  if( rc!=SQLITE_ROW ){
+    pIterator->bEof = 1;
+    return SQLITE_DONE;
+  }
+  
+  memset(&relValue, 0, sizeof(relValue));
+  relValue.type = CYPHER_VALUE_RELATIONSHIP;
+  relValue.u.iRelId = sqlite3_column_int64(pData->pStmt, 0);
+  
+  rc = cypherResultAddColumn(pResult, pPlan->zAlias ? pPlan->zAlias : "rel", &relValue);
+  if( rc != SQLITE_OK ) return rc;
+  
+  pIterator->nRowsProduced++;
+  
+  return SQLITE_OK;
+}
+
+static int typeIndexScanNextBatch(CypherIterator *pIterator, CypherBatch *pBatch) {
+  TypeIndexScanData *pData = (TypeIndexScanData*)pIterator->pIterData;
+  return scanNextBatch(pIterator, pData->pStmt, CYPHER_VALUE_RELATIONSHIP, pBatch);
+}
+
+static int typeIndexScanClose(CypherIterator *pIterator) {
+  TypeIndexScanData *pData = (TypeIndexScanData*)pIterator->pIterData;
+  sqlite3_finalize(pData->pStmt);
+  pData->pStmt = 0;
+  pIterator->bOpened = 0;
+  return SQLITE_OK;
+}
+
+static void typeIndexScanDestroy(CypherIterator *pIterator) {
+  sqlite3_free(pIterator->pIterData);
+}
+
+CypherIterator *cypherTypeIndexScanCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext) {
+  CypherIterator *pIterator;
+  TypeIndexScanData *pData;
+  
+  pIterator = sqlite3_malloc(sizeof(CypherIterator));
+  if( !pIterator ) return NULL;
+  
+  pData = sqlite3_malloc(sizeof(TypeIndexScanData));
+  if( !pData ) {
+    sqlite3_free(pIterator);
+    return NULL;
+  }
+  
+  memset(pIterator, 0, sizeof(CypherIterator));
+  memset(pData, 0, sizeof(TypeIndexScanData));
+  
+  pIterator->xOpen = typeIndexScanOpen;
+  pIterator->xNext = typeIndexScanNext;
+  pIterator->xNextBatch = typeIndexScanNextBatch;
+  pIterator->xClose = typeIndexScanClose;
+  pIterator->xDestroy = typeIndexScanDestroy;
+  pIterator->pContext = pContext;
+  pIterator->pPlan = pPlan;
+  pIterator->pIterData = pData;
+  
+  return pIterator;
+}
+
 /*
 ** PropertyIndexScan iterator implementation.
 ** Scans nodes/relationships with specific property values using property indexes.
@@ -300,27 +690,73 @@ static int propertyIndexScanOpen(CypherIterator *pIterator) {
   PropertyIndexScanData *pData = (PropertyIndexScanData*)pIterator->pIterData;
   PhysicalPlanNode *pPlan = pIterator->pPlan;
   GraphVtab *pGraph = pIterator->pContext->pGraph;
+  PlanPredicate single;
+  PlanPredicate *aKey = pPlan->aIndexKey;
+  int nKey = pPlan->nIndexKey;
+  sqlite3_int64 iLabelId = 0;
+  char *zWhere = NULL;
+  char *zSql;
+  int rc, i;
   
   if( !pGraph || !pPlan->zProperty ) return SQLITE_ERROR;
   
   pData->zProperty = pPlan->zProperty;
   pData->zValue = pPlan->zValue;
   
-  char *zSql = sqlite3_mprintf(
-    "SELECT id FROM %s_nodes WHERE "
-    "json_extract(properties, '$.%s') = %Q",
-    pGraph->zTableName, pData->zProperty, pData->zValue);
+  /* Plans without an index key look up a single property */
+  if( nKey == 0 ) {
+    single.zProperty = pPlan->zProperty;
+    single.zOperator = "=";
+    single.zValue = pPlan->zValue ? pPlan->zValue : "";
+    aKey = &single;
+    nKey = 1;
+  }
+  
+  /* The property expressions are spelled exactly as in the index DDL so
+  ** that SQLite picks up the index created by graph_create_index(). Key
+  ** values are parameters ?2, ?3, ..., followed by those of the pushed
+  ** filters */
+  for( i = 0; i < nKey; i++ ) {
+    zWhere = propertyCompareSql(zWhere, i ? " AND " : "", &aKey[i], i + 2);
+    if( !zWhere ) return SQLITE_NOMEM;
+  }
   
+  if( pPlan->zLabel ) {
+    rc = graphLookupLabelId(pGraph, pPlan->zLabel, &iLabelId);
+    if( rc!=SQLITE_OK ) {
+      sqlite3_free(zWhere);
+      return rc;
+    }
+    /* The label hint matches a label-scoped partial index; the label
+    ** index then filters the candidates exactly. CROSS JOIN keeps the
+    ** property lookup as the outer loop. */
+    zSql = sqlite3_mprintf(
+      "SELECT id FROM %s_nodes CROSS JOIN %s_label_index "
+      "ON label_id = ?1 AND node_id = id "
+      "WHERE %z AND " GRAPH_LABEL_HINT,
+      pGraph->zTableName, pGraph->zTableName, zWhere, pPlan->zLabel);
+  } else {
+    zSql = sqlite3_mprintf("SELECT id FROM %s_nodes WHERE %z",
+                           pGraph->zTableName, zWhere);
+  }
+  zSql = scanLimitSql(scanFilterSql(zSql, pPlan, 1, nKey + 2), pPlan);
   if (!zSql) {
     return SQLITE_NOMEM;
   }
   
-  int rc = sqlite3_prepare_v2(pGraph->pDb, zSql, -1, &pData->pStmt, NULL);
+  rc = sqlite3_prepare_v2(pGraph->pDb, zSql, -1, &pData->pStmt, NULL);
   sqlite3_free(zSql);
   
   if (rc != SQLITE_OK) {
     return rc;
   }
+  if( pPlan->zLabel ) sqlite3_bind_int64(pData->pStmt, 1, iLabelId);
+  for( i = 0; i < nKey && rc == SQLITE_OK; i++ ) {
+    rc = bindPlanValue(pData->pStmt, i + 2, aKey[i].zValue);
+  }
+  if( rc == SQLITE_OK ) rc = scanBindFilter(pData->pStmt, pPlan, nKey + 2);
+  if( rc != SQLITE_OK ) return rc;
+  scanBindLimit(pData->pStmt, pPlan);
   
   pIterator->bOpened = 1;
   pIterator->bEof = 0;
@@ -354,6 +790,11 @@ static int propertyIndexScanNext(CypherIterator *pIterator, CypherResult *pResul
   return SQLITE_OK;
 }
 
+static int propertyIndexScanNextBatch(CypherIterator *pIterator, CypherBatch *pBatch) {
+  PropertyIndexScanData *pData = (PropertyIndexScanData*)pIterator->pIterData;
+  return scanNextBatch(pIterator, pData->pStmt, CYPHER_VALUE_NODE, pBatch);
+}
+
 static int propertyIndexScanClose(CypherIterator *pIterator) {
   PropertyIndexScanData *pData = (PropertyIndexScanData*)pIterator->pIterData;
   sqlite3_finalize(pData->pStmt);
@@ -384,6 +825,7 @@ CypherIterator *cypherPropertyIndexScanCreate(PhysicalPlanNode *pPlan, Execution
   /* Set up iterator */
   pIterator->xOpen = propertyIndexScanOpen;
   pIterator->xNext = propertyIndexScanNext;
+  pIterator->xNextBatch = propertyIndexScanNextBatch;
   pIterator->xClose = propertyIndexScanClose;
   pIterator->xDestroy = propertyIndexScanDestroy;
   pIterator->pContext = pContext;
@@ -394,99 +836,3253 @@ CypherIterator *cypherPropertyIndexScanCreate(PhysicalPlanNode *pPlan, Execution
 }
 
 /*
-** Stub implementations for other iterators.
-** These will be implemented as needed.
+** RangeIndexScan iterator implementation.
+** Reads nodes through a range index, in key order when the plan asks for
+** it. Shares its state and row handling with PropertyIndexScan.
 */
 
-/* Filter iterator implementation */
-typedef struct FilterIteratorData {
-  CypherIterator *pSource;     /* Source iterator */
-  CypherExpression *pFilter;   /* Filter expression */
-} FilterIteratorData;
-
-static int filterIteratorOpen(CypherIterator *pIterator) {
-  FilterIteratorData *pData = (FilterIteratorData*)pIterator->pIterData;
-  return pData->pSource->xOpen(pData->pSource);
-}
-
-static int filterIteratorNext(CypherIterator *pIterator, CypherResult *pResult) {
-  FilterIteratorData *pData = (FilterIteratorData*)pIterator->pIterData;
-  CypherValue filterResult;
-  int rc;
+static int rangeIndexScanOpen(CypherIterator *pIterator) {
+  PropertyIndexScanData *pData = (PropertyIndexScanData*)pIterator->pIterData;
+  PhysicalPlanNode *pPlan = pIterator->pPlan;
+  GraphVtab *pGraph = pIterator->pContext->pGraph;
+  int bDate = (pPlan->iFlags & PLAN_FLAG_DATE_KEY) != 0;
+  sqlite3_int64 iLabelId = 0;
+  char *zKey;
+  char *zWhere = NULL;
+  char *zSql;
+  int rc, i;
   
-  /* Keep fetching from source until we find a matching row */
-  while ((rc = pData->pSource->xNext(pData->pSource, pResult)) == SQLITE_OK) {
-    /* Evaluate filter expression */
-    rc = cypherExpressionEvaluate(pData->pFilter, pIterator->pContext, &filterResult);
-    if (rc != SQLITE_OK) return rc;
-    
-    /* Check if filter passes (truthy value) */
-    if (!cypherValueIsNull(&filterResult) && 
-        (filterResult.type != CYPHER_VALUE_BOOLEAN || filterResult.u.bBoolean)) {
-      cypherValueDestroy(&filterResult);
-      return SQLITE_OK;
+  if( !pGraph || !pPlan->zProperty ) return SQLITE_ERROR;
+  
+  /* The key is spelled as in the index DDL so that SQLite uses the index
+  ** for the comparisons and for ORDER BY. Key values are ?2, ?3, ... */
+  zKey = graphRangeKeyExpr(bDate ? "date" : "number", pPlan->zProperty);
+  if( !zKey ) return SQLITE_NOMEM;
+  for( i = 0; i < pPlan->nIndexKey; i++ ) {
+    zWhere = sqlite3_mprintf(bDate ? "%z%s%s %s julianday(?%d)" : "%z%s%s %s ?%d",
+                             zWhere, i ? " AND " : "", zKey,
+                             pPlan->aIndexKey[i].zOperator, i + 2);
+    if( !zWhere ) {
+      sqlite3_free(zKey);
+      return SQLITE_NOMEM;
     }
-    
-    cypherValueDestroy(&filterResult);
   }
   
-  return rc;
-}
-
-static int filterIteratorClose(CypherIterator *pIterator) {
-  FilterIteratorData *pData = (FilterIteratorData*)pIterator->pIterData;
-  return pData->pSource->xClose(pData->pSource);
-}
-
-static void filterIteratorDestroy(CypherIterator *pIterator) {
-  if (pIterator) {
-    FilterIteratorData *pData = (FilterIteratorData*)pIterator->pIterData;
-    if (pData) {
-      if (pData->pSource) {
-        pData->pSource->xDestroy(pData->pSource);
-      }
-      sqlite3_free(pData);
+  if( pPlan->zLabel ) {
+    rc = graphLookupLabelId(pGraph, pPlan->zLabel, &iLabelId);
+    if( rc == SQLITE_OK ) {
+      zWhere = sqlite3_mprintf("%z%s" GRAPH_LABEL_HINT, zWhere,
+                               zWhere ? " AND " : "", pPlan->zLabel);
     }
-    sqlite3_free(pIterator);
+    zSql = sqlite3_mprintf(
+      "SELECT id FROM %s_nodes CROSS JOIN %s_label_index "
+      "ON label_id = ?1 AND node_id = id WHERE %s",
+      pGraph->zTableName, pGraph->zTableName, zWhere);
+  } else {
+    rc = SQLITE_OK;
+    zSql = sqlite3_mprintf("SELECT id FROM %s_nodes%s%s", pGraph->zTableName,
+                           zWhere ? " WHERE " : "", zWhere ? zWhere : "");
   }
-}
-
-CypherIterator *cypherFilterCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext) {
-  CypherIterator *pIterator;
-  FilterIteratorData *pData;
-  
-  if (!pPlan || !pPlan->pChild || !pPlan->pFilterExpr) return NULL;
-  
-  pIterator = sqlite3_malloc(sizeof(CypherIterator));
-  if (!pIterator) return NULL;
-  
-  pData = sqlite3_malloc(sizeof(FilterIteratorData));
-  if (!pData) {
-    sqlite3_free(pIterator);
-    return NULL;
+  if( zSql && (pPlan->iFlags & PLAN_FLAG_ORDERED) ) {
+    zSql = sqlite3_mprintf("%z ORDER BY %s%s", zSql, zKey,
+                           (pPlan->iFlags & PLAN_FLAG_DESC) ? " DESC" : "");
+  }
+  zSql = scanLimitSql(zSql, pPlan);
+  sqlite3_free(zKey);
+  sqlite3_free(zWhere);
+  if( rc != SQLITE_OK ) {
+    sqlite3_free(zSql);
+    return rc;
   }
+  if( !zSql ) return SQLITE_NOMEM;
   
-  memset(pIterator, 0, sizeof(CypherIterator));
-  memset(pData, 0, sizeof(FilterIteratorData));
+  rc = sqlite3_prepare_v2(pGraph->pDb, zSql, -1, &pData->pStmt, NULL);
+  sqlite3_free(zSql);
+  if( rc != SQLITE_OK ) return rc;
   
-  /* Create source iterator */
-  pData->pSource = cypherIteratorCreate(pPlan->pChild, pContext);
-  if (!pData->pSource) {
-    sqlite3_free(pData);
-    sqlite3_free(pIterator);
-    return NULL;
+  if( pPlan->zLabel ) sqlite3_bind_int64(pData->pStmt, 1, iLabelId);
+  for( i = 0; i < pPlan->nIndexKey && rc == SQLITE_OK; i++ ) {
+    rc = bindPlanValue(pData->pStmt, i + 2, pPlan->aIndexKey[i].zValue);
   }
+  if( rc != SQLITE_OK ) return rc;
+  scanBindLimit(pData->pStmt, pPlan);
   
-  pData->pFilter = pPlan->pFilterExpr;
-  
-  /* Set up iterator */
-  pIterator->xOpen = filterIteratorOpen;
-  pIterator->xNext = filterIteratorNext;
-  pIterator->xClose = filterIteratorClose;
-  pIterator->xDestroy = filterIteratorDestroy;
-  pIterator->pContext = pContext;
-  pIterator->pPlan = pPlan;
-  pIterator->pIterData = pData;
+  pIterator->bOpened = 1;
+  pIterator->bEof = 0;
+  
+  return SQLITE_OK;
+}
+
+CypherIterator *cypherRangeIndexScanCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext) {
+  CypherIterator *pIterator = cypherPropertyIndexScanCreate(pPlan, pContext);
+  if( pIterator ) {
+    pIterator->xOpen = rangeIndexScanOpen;
+  }
+  return pIterator;
+}
+
+/*
+** FulltextScan iterator implementation.
+** Searches a trigram full-text index for the strings of the plan's
+** CONTAINS, STARTS WITH and ENDS WITH comparisons, each as an FTS5
+** phrase. Shares its state and row handling with PropertyIndexScan.
+*/
+
+static int fulltextScanOpen(CypherIterator *pIterator) {
+  PropertyIndexScanData *pData = (PropertyIndexScanData*)pIterator->pIterData;
+  PhysicalPlanNode *pPlan = pIterator->pPlan;
+  GraphVtab *pGraph = pIterator->pContext->pGraph;
+  sqlite3_int64 iLabelId = 0;
+  char *zMatch = NULL;
+  char *zSql;
+  int rc = SQLITE_OK;
+  int i, j;
+  
+  if( !pGraph || !pPlan->zIndexName || pPlan->nIndexKey == 0 ) return SQLITE_ERROR;
+  
+  /* Each string loses its quotes and becomes a phrase, with any double
+  ** quotes in it doubled; phrases side by side must all match */
+  for( i = 0; i < pPlan->nIndexKey; i++ ) {
+    const char *zValue = pPlan->aIndexKey[i].zValue;
+    int n = (int)strlen(zValue);
+    
+    zMatch = sqlite3_mprintf("%z%s\"", zMatch, i ? " " : "");
+    for( j = 1; zMatch && j < n - 1; j++ ) {
+      zMatch = sqlite3_mprintf(zValue[j] == '"' ? "%z\"\"" : "%z%c", zMatch, zValue[j]);
+    }
+    if( zMatch ) zMatch = sqlite3_mprintf("%z\"", zMatch);
+    if( !zMatch ) return SQLITE_NOMEM;
+  }
+  
+  if( pPlan->zLabel ) {
+    rc = graphLookupLabelId(pGraph, pPlan->zLabel, &iLabelId);
+    zSql = sqlite3_mprintf(
+      "SELECT \"%w\".rowid FROM \"%w\" CROSS JOIN %s_label_index "
+      "ON label_id = ?2 AND node_id = \"%w\".rowid WHERE \"%w\" MATCH ?1",
+      pPlan->zIndexName, pPlan->zIndexName, pGraph->zTableName,
+      pPlan->zIndexName, pPlan->zIndexName);
+  } else {
+    zSql = sqlite3_mprintf("SELECT rowid FROM \"%w\" WHERE \"%w\" MATCH ?1",
+                           pPlan->zIndexName, pPlan->zIndexName);
+  }
+  zSql = scanLimitSql(zSql, pPlan);
+  if( rc == SQLITE_OK && !zSql ) rc = SQLITE_NOMEM;
+  if( rc == SQLITE_OK ) {
+    rc = sqlite3_prepare_v2(pGraph->pDb, zSql, -1, &pData->pStmt, NULL);
+  }
+  sqlite3_free(zSql);
+  if( rc != SQLITE_OK ) {
+    sqlite3_free(zMatch);
+    return rc;
+  }
+  
+  sqlite3_bind_text(pData->pStmt, 1, zMatch, -1, sqlite3_free);
+  if( pPlan->zLabel ) sqlite3_bind_int64(pData->pStmt, 2, iLabelId);
+  scanBindLimit(pData->pStmt, pPlan);
+  
+  pIterator->bOpened = 1;
+  pIterator->bEof = 0;
+  
+  return SQLITE_OK;
+}
+
+CypherIterator *cypherFulltextScanCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext) {
+  CypherIterator *pIterator = cypherPropertyIndexScanCreate(pPlan, pContext);
+  if( pIterator ) {
+    pIterator->xOpen = fulltextScanOpen;
+  }
+  return pIterator;
+}
+
+/*
+** BitmapScan iterator implementation.
+** Intersects the bitmaps of the scan's label and property equalities and
+** returns the surviving node ids without reading any node rows.
+*/
+
+typedef struct BitmapScanData {
+  sqlite3_int64 *aNodes;        /* Matching node ids, ascending */
+  int nNodes;                   /* Number of entries in aNodes */
+  int iNext;                    /* Next entry to return */
+} BitmapScanData;
+
+static int bitmapScanOpen(CypherIterator *pIterator) {
+  BitmapScanData *pData = (BitmapScanData*)pIterator->pIterData;
+  PhysicalPlanNode *pPlan = pIterator->pPlan;
+  GraphVtab *pGraph = pIterator->pContext->pGraph;
+  GraphBitmap *pResult = NULL;
+  const char **azArg;
+  char **azValue;
+  int nKey = pPlan->nIndexKey;
+  int rc = SQLITE_OK;
+  int i;
+  
+  if( !pGraph ) return SQLITE_ERROR;
+  
+  azArg = sqlite3_malloc((nKey * 2 + 1) * sizeof(char*));
+  if( !azArg ) return SQLITE_NOMEM;
+  azValue = (char**)&azArg[nKey];
+  memset(azValue, 0, nKey * sizeof(char*));
+  
+  /* Bitmaps are keyed by graphBitmapKey(), from the type of each literal
+  ** and its text. Null, of no type, is left as written to match no key */
+  for( i = 0; i < nKey && rc == SQLITE_OK; i++ ) {
+    const char *zValue = pPlan->aIndexKey[i].zValue;
+    const char *zType = planValueType(zValue);
+    
+    azArg[i] = pPlan->aIndexKey[i].zProperty;
+    if( zType && strcmp(zType, "text") == 0 ) {
+      char *zText = planLiteralText(zValue);
+      azValue[i] = zText ? graphBitmapKey(zType, zText) : NULL;
+      sqlite3_free(zText);
+    } else if( zType ) {
+      azValue[i] = graphBitmapKey(zType, zValue);
+    } else {
+      azValue[i] = sqlite3_mprintf("%s", zValue);
+    }
+    if( !azValue[i] ) rc = SQLITE_NOMEM;
+  }
+  if( rc == SQLITE_OK ) {
+    rc = graphBitmapIntersect(pGraph, pPlan->zLabel, azArg,
+                              (const char**)azValue, nKey, &pResult);
+  }
+  if( rc == SQLITE_OK ) {
+    rc = graphBitmapToArray(pResult, &pData->aNodes, &pData->nNodes);
+  }
+  graphBitmapDestroy(pResult);
+  for( i = 0; i < nKey; i++ ) {
+    sqlite3_free(azValue[i]);
+  }
+  sqlite3_free(azArg);
+  if( rc != SQLITE_OK ) return rc;
+  
+  pData->iNext = 0;
+  pIterator->bOpened = 1;
+  pIterator->bEof = 0;
+  
+  return SQLITE_OK;
+}
+
+static int bitmapScanNext(CypherIterator *pIterator, CypherResult *pResult) {
+  BitmapScanData *pData = (BitmapScanData*)pIterator->pIterData;
+  PhysicalPlanNode *pPlan = pIterator->pPlan;
+  CypherValue nodeValue;
+  int rc;
+  
+  if( pIterator->bEof || pData->iNext >= pData->nNodes ) {
+    pIterator->bEof = 1;
+    return SQLITE_DONE;
+  }
+  
+  memset(&nodeValue, 0, sizeof(nodeValue));
+  nodeValue.type = CYPHER_VALUE_NODE;
+  nodeValue.u.iNodeId = pData->aNodes[pData->iNext++];
+  
+  rc = cypherResultAddColumn(pResult, pPlan->zAlias ? pPlan->zAlias : "node", &nodeValue);
+  if( rc != SQLITE_OK ) return rc;
+  
+  pIterator->nRowsProduced++;
+  
+  return SQLITE_OK;
+}
+
+static int bitmapScanNextBatch(CypherIterator *pIterator, CypherBatch *pBatch) {
+  BitmapScanData *pData = (BitmapScanData*)pIterator->pIterData;
+  PhysicalPlanNode *pPlan = pIterator->pPlan;
+  int iCol;
+  int n;
+  
+  cypherBatchReset(pBatch);
+  if( pIterator->bEof || pData->iNext >= pData->nNodes ) {
+    pIterator->bEof = 1;
+    return SQLITE_DONE;
+  }
+  
+  iCol = cypherBatchAddColumn(pBatch, pPlan->zAlias ? pPlan->zAlias : "node", CYPHER_VALUE_NODE);
+  if( iCol < 0 ) return SQLITE_NOMEM;
+  if( !pBatch->aCol[iCol].aInt ) return SQLITE_MISMATCH;
+  
+  n = pData->nNodes - pData->iNext;
+  if( n > CYPHER_BATCH_SIZE ) n = CYPHER_BATCH_SIZE;
+  memcpy(pBatch->aCol[iCol].aInt, &pData->aNodes[pData->iNext], n * sizeof(sqlite3_int64));
+  pData->iNext += n;
+  pBatch->nRow = n;
+  pIterator->nRowsProduced += n;
+  return SQLITE_OK;
+}
+
+static int bitmapScanClose(CypherIterator *pIterator) {
+  BitmapScanData *pData = (BitmapScanData*)pIterator->pIterData;
+  sqlite3_free(pData->aNodes);
+  pData->aNodes = NULL;
+  pData->nNodes = 0;
+  pIterator->bOpened = 0;
+  return SQLITE_OK;
+}
+
+static void bitmapScanDestroy(CypherIterator *pIterator) {
+  BitmapScanData *pData = (BitmapScanData*)pIterator->pIterData;
+  if( pData ) sqlite3_free(pData->aNodes);
+  sqlite3_free(pData);
+}
+
+CypherIterator *cypherBitmapScanCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext) {
+  CypherIterator *pIterator;
+  BitmapScanData *pData;
+  
+  pIterator = sqlite3_malloc(sizeof(CypherIterator));
+  if( !pIterator ) return NULL;
+  
+  pData = sqlite3_malloc(sizeof(BitmapScanData));
+  if( !pData ) {
+    sqlite3_free(pIterator);
+    return NULL;
+  }
+  
+  memset(pIterator, 0, sizeof(CypherIterator));
+  memset(pData, 0, sizeof(BitmapScanData));
+  
+  /* Set up iterator */
+  pIterator->xOpen = bitmapScanOpen;
+  pIterator->xNext = bitmapScanNext;
+  pIterator->xNextBatch = bitmapScanNextBatch;
+  pIterator->xClose = bitmapScanClose;
+  pIterator->xDestroy = bitmapScanDestroy;
+  pIterator->pContext = pContext;
+  pIterator->pPlan = pPlan;
+  pIterator->pIterData = pData;
+  
+  return pIterator;
+}
+
+/*
+** Expand iterator implementation.
+** For each row of its child, walks the adjacency of the bound start node
+** and produces one row per matching edge, extended with the relationship
+** and (ExpandAll) the far node. ExpandInto instead keeps only the edges
+** that end at the node the row already binds to the far alias. Edges are
+** read through the typed adjacency statements of graphPrepareAdjacency(),
+** prepared once when the iterator opens and rebound for every start node.
+*/
+
+typedef struct ExpandData {
+  CypherIterator *pSource;      /* Iterator binding the start node */
+  CypherResult *pRow;           /* Current input row */
+  sqlite3_stmt *apAdj[2];       /* Outgoing and incoming adjacency */
+  sqlite3_stmt *pLabel;         /* Far node label check, if labelled */
+  int iDir;                     /* Direction being walked: 0 out, 1 in */
+  int iLastDir;                 /* Last direction to walk for this row */
+  sqlite3_int64 iFrom;          /* Start node of the current row */
+  sqlite3_int64 iInto;          /* ExpandInto: far node of the current row */
+} ExpandData;
+
+/*
+** Return the node bound to zAlias in pRow, or -1 if there is none.
+*/
+static sqlite3_int64 expandRowNode(CypherResult *pRow, const char *zAlias) {
+  int i;
+  for( i = pRow->nColumns - 1; zAlias && i >= 0; i-- ) {
+    if( strcmp(pRow->azColumnNames[i], zAlias) == 0 ) {
+      return pRow->aValues[i].type == CYPHER_VALUE_NODE ?
+             pRow->aValues[i].u.iNodeId : -1;
+    }
+  }
+  return -1;
+}
+
+/*
+** Return true if pRow already binds relationship iRel, alone or in the
+** relationship list of a variable-length step.
+*/
+static int expandRowHasRel(CypherResult *pRow, sqlite3_int64 iRel) {
+  int i, j;
+  for( i = 0; i < pRow->nColumns; i++ ) {
+    CypherValue *pVal = &pRow->aValues[i];
+    if( pVal->type == CYPHER_VALUE_RELATIONSHIP && pVal->u.iRelId == iRel ) return 1;
+    if( pVal->type == CYPHER_VALUE_LIST ) {
+      for( j = 0; j < pVal->u.list.nValues; j++ ) {
+        CypherValue *pElem = &pVal->u.list.apValues[j];
+        if( pElem->type == CYPHER_VALUE_RELATIONSHIP && pElem->u.iRelId == iRel ) return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+/*
+** Prepare "is node ?2 labelled zLabel" against the label index.
+*/
+static int expandPrepareLabel(GraphVtab *pGraph, const char *zLabel,
+                              sqlite3_stmt **ppStmt) {
+  sqlite3_int64 iLabelId = 0;
+  char *zSql;
+  int rc;
+  
+  rc = graphLookupLabelId(pGraph, zLabel, &iLabelId);
+  if( rc != SQLITE_OK ) return rc;
+  zSql = sqlite3_mprintf("SELECT 1 FROM %s_label_index WHERE label_id = ?1 AND node_id = ?2",
+                         pGraph->zTableName);
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_prepare_v2(pGraph->pDb, zSql, -1, ppStmt, 0);
+  sqlite3_free(zSql);
+  if( rc != SQLITE_OK ) return rc;
+  sqlite3_bind_int64(*ppStmt, 1, iLabelId);
+  return SQLITE_OK;
+}
+
+static int expandOpen(CypherIterator *pIterator) {
+  ExpandData *pData = (ExpandData*)pIterator->pIterData;
+  PhysicalPlanNode *pPlan = pIterator->pPlan;
+  GraphVtab *pGraph = pIterator->pContext->pGraph;
+  int bIn = (pPlan->iFlags & PLAN_FLAG_INCOMING) != 0;
+  int bAny = (pPlan->iFlags & PLAN_FLAG_UNDIRECTED) != 0;
+  int rc;
+  
+  if( !pGraph || !pPlan->zFromAlias ) return SQLITE_ERROR;
+  
+  rc = pData->pSource->xOpen(pData->pSource);
+  if( rc != SQLITE_OK ) return rc;
+  
+  if( !bIn || bAny ) {
+    rc = graphPrepareAdjacency(pGraph, 0, pPlan->zRelType, &pData->apAdj[0]);
+  }
+  if( rc == SQLITE_OK && (bIn || bAny) ) {
+    rc = graphPrepareAdjacency(pGraph, 1, pPlan->zRelType, &pData->apAdj[1]);
+  }
+  if( rc == SQLITE_OK && pPlan->zLabel ) {
+    rc = expandPrepareLabel(pGraph, pPlan->zLabel, &pData->pLabel);
+  }
+  if( rc != SQLITE_OK ) return rc;
+  
+  pData->iLastDir = (bIn || bAny) ? 1 : 0;
+  pData->iDir = 2;  /* No input row yet */
+  pIterator->bOpened = 1;
+  pIterator->bEof = 0;
+  
+  return SQLITE_OK;
+}
+
+/*
+** Fetch the next input row with a bound start node and start walking it.
+*/
+static int expandNextRow(CypherIterator *pIterator) {
+  ExpandData *pData = (ExpandData*)pIterator->pIterData;
+  PhysicalPlanNode *pPlan = pIterator->pPlan;
+  int rc;
+  
+  while( 1 ) {
+    cypherResultDestroy(pData->pRow);
+    pData->pRow = cypherResultCreate();
+    if( !pData->pRow ) return SQLITE_NOMEM;
+    
+    rc = pData->pSource->xNext(pData->pSource, pData->pRow);
+    if( rc != SQLITE_OK ) return rc;
+    
+    pData->iFrom = expandRowNode(pData->pRow, pPlan->zFromAlias);
+    if( pData->iFrom < 0 ) continue;
+    if( pPlan->type == PHYSICAL_EXPAND_INTO ) {
+      pData->iInto = expandRowNode(pData->pRow, pPlan->zAlias);
+      if( pData->iInto < 0 ) continue;
+    }
+    pData->iDir = pData->apAdj[0] ? 0 : 1;
+    sqlite3_reset(pData->apAdj[pData->iDir]);
+    sqlite3_bind_int64(pData->apAdj[pData->iDir], 1, pData->iFrom);
+    return SQLITE_OK;
+  }
+}
+
+static int expandNext(CypherIterator *pIterator, CypherResult *pResult) {
+  ExpandData *pData = (ExpandData*)pIterator->pIterData;
+  PhysicalPlanNode *pPlan = pIterator->pPlan;
+  CypherValue value;
+  sqlite3_int64 iRel, iNode;
+  int rc, i;
+  
+  if( pIterator->bEof ) return SQLITE_DONE;
+  
+  while( 1 ) {
+    sqlite3_stmt *pAdj;
+    
+    if( pData->iDir > pData->iLastDir ) {
+      rc = expandNextRow(pIterator);
+      if( rc != SQLITE_OK ) {
+        if( rc == SQLITE_DONE ) pIterator->bEof = 1;
+        return rc;
+      }
+    }
+    
+    pAdj = pData->apAdj[pData->iDir];
+    rc = sqlite3_step(pAdj);
+    if( rc != SQLITE_ROW ) {
+      if( rc != SQLITE_DONE ) return rc;
+      
+      /* An undirected step walks the incoming edges next */
+      pData->iDir++;
+      if( pData->iDir <= pData->iLastDir ) {
+        sqlite3_reset(pData->apAdj[pData->iDir]);
+        sqlite3_bind_int64(pData->apAdj[pData->iDir], 1, pData->iFrom);
+      }
+      continue;
+    }
+    
+    iRel = sqlite3_column_int64(pAdj, 0);
+    iNode = sqlite3_column_int64(pAdj, 1);
+    
+    /* Undirected, a self-loop is found both ways; report it once */
+    if( pData->iDir == 1 && pData->apAdj[0] && iNode == pData->iFrom ) continue;
+    if( pPlan->type == PHYSICAL_EXPAND_INTO && iNode != pData->iInto ) continue;
+    
+    /* A pattern never binds the same relationship twice */
+    if( expandRowHasRel(pData->pRow, iRel) ) continue;
+    if( pData->pLabel ) {
+      sqlite3_bind_int64(pData->pLabel, 2, iNode);
+      rc = sqlite3_step(pData->pLabel);
+      sqlite3_reset(pData->pLabel);
+      if( rc != SQLITE_ROW ) continue;
+    }
+    break;
+  }
+  
+  /* The input row, then the relationship and the far node */
+  for( i = 0; i < pData->pRow->nColumns; i++ ) {
+    rc = cypherResultAddColumn(pResult, pData->pRow->azColumnNames[i],
+                               &pData->pRow->aValues[i]);
+    if( rc != SQLITE_OK ) return rc;
+  }
+  if( pPlan->zRelAlias ) {
+    memset(&value, 0, sizeof(value));
+    value.type = CYPHER_VALUE_RELATIONSHIP;
+    value.u.iRelId = iRel;
+    rc = cypherResultAddColumn(pResult, pPlan->zRelAlias, &value);
+    if( rc != SQLITE_OK ) return rc;
+  }
+  if( pPlan->type == PHYSICAL_EXPAND_ALL && pPlan->zAlias ) {
+    memset(&value, 0, sizeof(value));
+    value.type = CYPHER_VALUE_NODE;
+    value.u.iNodeId = iNode;
+    rc = cypherResultAddColumn(pResult, pPlan->zAlias, &value);
+    if( rc != SQLITE_OK ) return rc;
+  }
+  
+  pIterator->nRowsProduced++;
+  
+  return SQLITE_OK;
+}
+
+static int expandClose(CypherIterator *pIterator) {
+  ExpandData *pData = (ExpandData*)pIterator->pIterData;
+  sqlite3_finalize(pData->apAdj[0]);
+  sqlite3_finalize(pData->apAdj[1]);
+  sqlite3_finalize(pData->pLabel);
+  pData->apAdj[0] = pData->apAdj[1] = pData->pLabel = NULL;
+  cypherResultDestroy(pData->pRow);
+  pData->pRow = NULL;
+  pIterator->bOpened = 0;
+  return pData->pSource->xClose(pData->pSource);
+}
+
+static void expandDestroy(CypherIterator *pIterator) {
+  ExpandData *pData = (ExpandData*)pIterator->pIterData;
+  if( pData ) {
+    cypherIteratorDestroy(pData->pSource);
+    sqlite3_free(pData);
+  }
+}
+
+CypherIterator *cypherExpandCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext) {
+  CypherIterator *pIterator;
+  ExpandData *pData;
+  
+  if( !pPlan || !pPlan->pChild ) return NULL;
+  
+  pIterator = sqlite3_malloc(sizeof(CypherIterator));
+  if( !pIterator ) return NULL;
+  
+  pData = sqlite3_malloc(sizeof(ExpandData));
+  if( !pData ) {
+    sqlite3_free(pIterator);
+    return NULL;
+  }
+  
+  memset(pIterator, 0, sizeof(CypherIterator));
+  memset(pData, 0, sizeof(ExpandData));
+  
+  pData->pSource = cypherIteratorCreate(pPlan->pChild, pContext);
+  if( !pData->pSource ) {
+    sqlite3_free(pData);
+    sqlite3_free(pIterator);
+    return NULL;
+  }
+  
+  /* Set up iterator */
+  pIterator->xOpen = expandOpen;
+  pIterator->xNext = expandNext;
+  pIterator->xClose = expandClose;
+  pIterator->xDestroy = expandDestroy;
+  pIterator->pContext = pContext;
+  pIterator->pPlan = pPlan;
+  pIterator->pIterData = pData;
+  
+  return pIterator;
+}
+
+/*
+** VarLengthExpand iterator implementation.
+** For each row of its child, streams the paths of min..max relationships
+** leaving the bound start node from a PathWalker, one output row per path:
+** the input row, the relationships of the path as a list and the end node.
+** Paths that reuse a relationship the row already binds are skipped. With
+** PLAN_FLAG_PRUNE_PATHS the walker instead reports each end node once and
+** no relationship list is bound.
+*/
+
+typedef struct VarExpandData {
+  CypherIterator *pSource;      /* Iterator binding the start node */
+  CypherResult *pRow;           /* Current input row */
+  PathWalker *pWalker;          /* Paths from the current start node */
+  sqlite3_stmt *pLabel;         /* End node label check, if labelled */
+  int bWalking;                 /* pWalker holds paths of pRow */
+  sqlite3_int64 iInto;          /* End node bound before the step, or -1 */
+} VarExpandData;
+
+static int varExpandOpen(CypherIterator *pIterator) {
+  VarExpandData *pData = (VarExpandData*)pIterator->pIterData;
+  PhysicalPlanNode *pPlan = pIterator->pPlan;
+  GraphVtab *pGraph = pIterator->pContext->pGraph;
+  PathBounds bounds;
+  int iDir = CYPHER_PATH_OUTGOING;
+  int rc;
+  
+  if( !pGraph || !pPlan->zFromAlias ) return SQLITE_ERROR;
+  
+  rc = pData->pSource->xOpen(pData->pSource);
+  if( rc != SQLITE_OK ) return rc;
+  
+  if( pPlan->iFlags & PLAN_FLAG_UNDIRECTED ) {
+    iDir = CYPHER_PATH_BOTH;
+  } else if( pPlan->iFlags & PLAN_FLAG_INCOMING ) {
+    iDir = CYPHER_PATH_INCOMING;
+  }
+  memset(&bounds, 0, sizeof(bounds));
+  bounds.minLength = pPlan->nMinHops;
+  bounds.maxLength = pPlan->nMaxHops;
+  bounds.isOptional = pPlan->nMinHops == 0;
+  rc = cypherPathWalkerCreate(pGraph, pPlan->zRelType, iDir, bounds,
+                              (pPlan->iFlags & PLAN_FLAG_PRUNE_PATHS) ? CYPHER_PATH_PRUNE : 0,
+                              &pData->pWalker);
+  if( rc == SQLITE_OK && pPlan->zLabel ) {
+    rc = expandPrepareLabel(pGraph, pPlan->zLabel, &pData->pLabel);
+  }
+  if( rc != SQLITE_OK ) return rc;
+  
+  pData->bWalking = 0;
+  pIterator->bOpened = 1;
+  pIterator->bEof = 0;
+  
+  return SQLITE_OK;
+}
+
+/*
+** Fetch the next input row with a bound start node and start walking it.
+*/
+static int varExpandNextRow(CypherIterator *pIterator) {
+  VarExpandData *pData = (VarExpandData*)pIterator->pIterData;
+  PhysicalPlanNode *pPlan = pIterator->pPlan;
+  sqlite3_int64 iFrom;
+  int rc;
+  
+  while( 1 ) {
+    cypherResultDestroy(pData->pRow);
+    pData->pRow = cypherResultCreate();
+    if( !pData->pRow ) return SQLITE_NOMEM;
+    
+    rc = pData->pSource->xNext(pData->pSource, pData->pRow);
+    if( rc != SQLITE_OK ) return rc;
+    
+    iFrom = expandRowNode(pData->pRow, pPlan->zFromAlias);
+    if( iFrom < 0 ) continue;
+    pData->iInto = -1;
+    if( pPlan->iFlags & PLAN_FLAG_EXPAND_INTO ) {
+      pData->iInto = expandRowNode(pData->pRow, pPlan->zAlias);
+      if( pData->iInto < 0 ) continue;
+    }
+    rc = cypherPathWalkerStart(pData->pWalker, iFrom);
+    if( rc != SQLITE_OK ) return rc;
+    pData->bWalking = 1;
+    return SQLITE_OK;
+  }
+}
+
+static int varExpandNext(CypherIterator *pIterator, CypherResult *pResult) {
+  VarExpandData *pData = (VarExpandData*)pIterator->pIterData;
+  PhysicalPlanNode *pPlan = pIterator->pPlan;
+  const sqlite3_int64 *aEdge;
+  CypherValue value;
+  sqlite3_int64 iEnd;
+  int nLen, rc, i;
+  
+  if( pIterator->bEof ) return SQLITE_DONE;
+  
+  while( 1 ) {
+    if( !pData->bWalking ) {
+      rc = varExpandNextRow(pIterator);
+      if( rc != SQLITE_OK ) {
+        if( rc == SQLITE_DONE ) pIterator->bEof = 1;
+        return rc;
+      }
+    }
+    
+    rc = cypherPathWalkerNext(pData->pWalker);
+    if( rc != SQLITE_ROW ) {
+      if( rc != SQLITE_DONE ) return rc;
+      pData->bWalking = 0;
+      continue;
+    }
+    
+    iEnd = cypherPathWalkerEnd(pData->pWalker);
+    if( pData->iInto >= 0 && iEnd != pData->iInto ) continue;
+    
+    /* Relationships bound by earlier steps are not walked again */
+    nLen = cypherPathWalkerLength(pData->pWalker);
+    aEdge = cypherPathWalkerEdges(pData->pWalker);
+    for( i = 0; aEdge && i < nLen && !expandRowHasRel(pData->pRow, aEdge[i]); i++ ) {}
+    if( aEdge && i < nLen ) continue;
+    if( pData->pLabel ) {
+      sqlite3_bind_int64(pData->pLabel, 2, iEnd);
+      rc = sqlite3_step(pData->pLabel);
+      sqlite3_reset(pData->pLabel);
+      if( rc != SQLITE_ROW ) continue;
+    }
+    break;
+  }
+  
+  /* The input row, then the relationship list and the end node */
+  for( i = 0; i < pData->pRow->nColumns; i++ ) {
+    rc = cypherResultAddColumn(pResult, pData->pRow->azColumnNames[i],
+                               &pData->pRow->aValues[i]);
+    if( rc != SQLITE_OK ) return rc;
+  }
+  if( pPlan->zRelAlias && aEdge ) {
+    CypherValue *aRel = NULL;
+    if( nLen > 0 ) {
+      aRel = sqlite3_malloc(nLen * sizeof(CypherValue));
+      if( !aRel ) return SQLITE_NOMEM;
+      for( i = 0; i < nLen; i++ ) {
+        cypherValueInit(&aRel[i]);
+        cypherValueSetRelationship(&aRel[i], aEdge[i]);
+      }
+    }
+    cypherValueInit(&value);
+    cypherValueSetList(&value, aRel, nLen);
+    rc = cypherResultAddColumn(pResult, pPlan->zRelAlias, &value);
+    cypherValueDestroy(&value);
+    if( rc != SQLITE_OK ) return rc;
+  }
+  if( pData->iInto < 0 && pPlan->zAlias ) {
+    memset(&value, 0, sizeof(value));
+    value.type = CYPHER_VALUE_NODE;
+    value.u.iNodeId = iEnd;
+    rc = cypherResultAddColumn(pResult, pPlan->zAlias, &value);
+    if( rc != SQLITE_OK ) return rc;
+  }
+  
+  pIterator->nRowsProduced++;
+  
+  return SQLITE_OK;
+}
+
+static int varExpandClose(CypherIterator *pIterator) {
+  VarExpandData *pData = (VarExpandData*)pIterator->pIterData;
+  cypherPathWalkerDestroy(pData->pWalker);
+  sqlite3_finalize(pData->pLabel);
+  pData->pWalker = NULL;
+  pData->pLabel = NULL;
+  cypherResultDestroy(pData->pRow);
+  pData->pRow = NULL;
+  pData->bWalking = 0;
+  pIterator->bOpened = 0;
+  return pData->pSource->xClose(pData->pSource);
+}
+
+static void varExpandDestroy(CypherIterator *pIterator) {
+  VarExpandData *pData = (VarExpandData*)pIterator->pIterData;
+  if( pData ) {
+    cypherIteratorDestroy(pData->pSource);
+    sqlite3_free(pData);
+  }
+}
+
+CypherIterator *cypherVarLengthExpandCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext) {
+  CypherIterator *pIterator;
+  VarExpandData *pData;
+  
+  if( !pPlan || !pPlan->pChild ) return NULL;
+  
+  pIterator = sqlite3_malloc(sizeof(CypherIterator));
+  if( !pIterator ) return NULL;
+  
+  pData = sqlite3_malloc(sizeof(VarExpandData));
+  if( !pData ) {
+    sqlite3_free(pIterator);
+    return NULL;
+  }
+  
+  memset(pIterator, 0, sizeof(CypherIterator));
+  memset(pData, 0, sizeof(VarExpandData));
+  
+  pData->pSource = cypherIteratorCreate(pPlan->pChild, pContext);
+  if( !pData->pSource ) {
+    sqlite3_free(pData);
+    sqlite3_free(pIterator);
+    return NULL;
+  }
+  
+  /* Set up iterator */
+  pIterator->xOpen = varExpandOpen;
+  pIterator->xNext = varExpandNext;
+  pIterator->xClose = varExpandClose;
+  pIterator->xDestroy = varExpandDestroy;
+  pIterator->pContext = pContext;
+  pIterator->pPlan = pPlan;
+  pIterator->pIterData = pData;
+  
+  return pIterator;
+}
+
+/*
+** ShortestPath iterator implementation.
+** For each row of its first child, and each row of its second child when
+** the end node comes from a separate scan, runs a bidirectional search
+** between the two bound nodes and produces one row per shortest path (per
+** path of equal length for allShortestPaths()): the input rows, the path
+** relationships as a list and the path itself.
+*/
+
+typedef struct ShortestPathData {
+  CypherIterator *pSource;      /* Iterator binding the start node */
+  CypherIterator *pEnds;        /* Iterator binding the end node, or NULL */
+  CypherResult *pRow;           /* Current start row */
+  CypherResult *pEndRow;        /* Current end row, if pEnds */
+  PathWalker *pWalker;
+  int bEndsOpen;                /* pEnds is open for pRow */
+  int bWalking;                 /* pWalker holds paths for the current pair */
+} ShortestPathData;
+
+static int shortestPathOpen(CypherIterator *pIterator) {
+  ShortestPathData *pData = (ShortestPathData*)pIterator->pIterData;
+  PhysicalPlanNode *pPlan = pIterator->pPlan;
+  GraphVtab *pGraph = pIterator->pContext->pGraph;
+  PathBounds bounds;
+  int iDir = CYPHER_PATH_OUTGOING;
+  int rc;
+  
+  if( !pGraph || !pPlan->zFromAlias || !pPlan->zAlias ) return SQLITE_ERROR;
+  
+  rc = pData->pSource->xOpen(pData->pSource);
+  if( rc != SQLITE_OK ) return rc;
+  
+  if( pPlan->iFlags & PLAN_FLAG_UNDIRECTED ) {
+    iDir = CYPHER_PATH_BOTH;
+  } else if( pPlan->iFlags & PLAN_FLAG_INCOMING ) {
+    iDir = CYPHER_PATH_INCOMING;
+  }
+  memset(&bounds, 0, sizeof(bounds));
+  bounds.minLength = pPlan->nMinHops;
+  bounds.maxLength = pPlan->nMaxHops;
+  rc = cypherPathWalkerCreate(pGraph, pPlan->zRelType, iDir, bounds,
+                              (pPlan->iFlags & PLAN_FLAG_ALL_PATHS) ?
+                              CYPHER_PATH_ALL_SHORTEST : CYPHER_PATH_SHORTEST,
+                              &pData->pWalker);
+  if( rc != SQLITE_OK ) return rc;
+  
+  pData->bEndsOpen = 0;
+  pData->bWalking = 0;
+  pIterator->bOpened = 1;
+  pIterator->bEof = 0;
+  
+  return SQLITE_OK;
+}
+
+/*
+** Advance to the next (start, end) pair and search it. The end node is
+** read from the end scan, restarted for every start row, or from the
+** start row itself.
+*/
+static int shortestPathNextPair(CypherIterator *pIterator) {
+  ShortestPathData *pData = (ShortestPathData*)pIterator->pIterData;
+  PhysicalPlanNode *pPlan = pIterator->pPlan;
+  sqlite3_int64 iFrom, iTo;
+  int rc;
+  
+  while( 1 ) {
+    if( !pData->bEndsOpen ) {
+      cypherResultDestroy(pData->pRow);
+      pData->pRow = cypherResultCreate();
+      if( !pData->pRow ) return SQLITE_NOMEM;
+      rc = pData->pSource->xNext(pData->pSource, pData->pRow);
+      if( rc != SQLITE_OK ) return rc;
+      if( expandRowNode(pData->pRow, pPlan->zFromAlias) < 0 ) continue;
+      if( pData->pEnds ) {
+        rc = pData->pEnds->xOpen(pData->pEnds);
+        if( rc != SQLITE_OK ) return rc;
+      }
+      pData->bEndsOpen = 1;
+    }
+    
+    iFrom = expandRowNode(pData->pRow, pPlan->zFromAlias);
+    if( pData->pEnds ) {
+      cypherResultDestroy(pData->pEndRow);
+      pData->pEndRow = cypherResultCreate();
+      if( !pData->pEndRow ) return SQLITE_NOMEM;
+      rc = pData->pEnds->xNext(pData->pEnds, pData->pEndRow);
+      if( rc == SQLITE_DONE ) {
+        pData->pEnds->xClose(pData->pEnds);
+        pData->bEndsOpen = 0;
+        continue;
+      }
+      if( rc != SQLITE_OK ) return rc;
+      iTo = expandRowNode(pData->pEndRow, pPlan->zAlias);
+    } else {
+      /* Both ends are the same variable */
+      iTo = expandRowNode(pData->pRow, pPlan->zAlias);
+      pData->bEndsOpen = 0;
+    }
+    if( iTo < 0 || (iTo == iFrom && pPlan->nMinHops > 0) ) continue;
+    
+    rc = cypherPathWalkerStartPair(pData->pWalker, iFrom, iTo);
+    if( rc != SQLITE_OK ) return rc;
+    pData->bWalking = 1;
+    return SQLITE_OK;
+  }
+}
+
+static int shortestPathNext(CypherIterator *pIterator, CypherResult *pResult) {
+  ShortestPathData *pData = (ShortestPathData*)pIterator->pIterData;
+  PhysicalPlanNode *pPlan = pIterator->pPlan;
+  const sqlite3_int64 *aEdge, *aNode;
+  CypherValue value;
+  int nLen, rc, i;
+  
+  if( pIterator->bEof ) return SQLITE_DONE;
+  
+  while( 1 ) {
+    if( !pData->bWalking ) {
+      rc = shortestPathNextPair(pIterator);
+      if( rc != SQLITE_OK ) {
+        if( rc == SQLITE_DONE ) pIterator->bEof = 1;
+        return rc;
+      }
+    }
+    rc = cypherPathWalkerNext(pData->pWalker);
+    if( rc == SQLITE_ROW ) break;
+    if( rc != SQLITE_DONE ) return rc;
+    pData->bWalking = 0;
+  }
+  
+  /* The input rows, then the relationship list and the path */
+  for( i = 0; i < pData->pRow->nColumns; i++ ) {
+    rc = cypherResultAddColumn(pResult, pData->pRow->azColumnNames[i],
+                               &pData->pRow->aValues[i]);
+    if( rc != SQLITE_OK ) return rc;
+  }
+  for( i = 0; pData->pEnds && i < pData->pEndRow->nColumns; i++ ) {
+    rc = cypherResultAddColumn(pResult, pData->pEndRow->azColumnNames[i],
+                               &pData->pEndRow->aValues[i]);
+    if( rc != SQLITE_OK ) return rc;
+  }
+  
+  nLen = cypherPathWalkerLength(pData->pWalker);
+  aEdge = cypherPathWalkerEdges(pData->pWalker);
+  aNode = cypherPathWalkerNodes(pData->pWalker);
+  if( pPlan->zRelAlias ) {
+    CypherValue *aRel = NULL;
+    if( nLen > 0 ) {
+      aRel = sqlite3_malloc(nLen * sizeof(CypherValue));
+      if( !aRel ) return SQLITE_NOMEM;
+      for( i = 0; i < nLen; i++ ) {
+        cypherValueInit(&aRel[i]);
+        cypherValueSetRelationship(&aRel[i], aEdge[i]);
+      }
+    }
+    cypherValueInit(&value);
+    cypherValueSetList(&value, aRel, nLen);
+    rc = cypherResultAddColumn(pResult, pPlan->zRelAlias, &value);
+    cypherValueDestroy(&value);
+    if( rc != SQLITE_OK ) return rc;
+  }
+  if( pPlan->zPathAlias ) {
+    sqlite3_int64 *aNodeIds = sqlite3_malloc((nLen + 1) * sizeof(sqlite3_int64));
+    sqlite3_int64 *aRelIds = sqlite3_malloc((nLen + 1) * sizeof(sqlite3_int64));
+    if( !aNodeIds || !aRelIds ) {
+      sqlite3_free(aNodeIds);
+      sqlite3_free(aRelIds);
+      return SQLITE_NOMEM;
+    }
+    memcpy(aNodeIds, aNode, (nLen + 1) * sizeof(sqlite3_int64));
+    if( nLen > 0 ) memcpy(aRelIds, aEdge, nLen * sizeof(sqlite3_int64));
+    cypherValueInit(&value);
+    cypherValueSetPath(&value, aNodeIds, aRelIds, nLen);
+    rc = cypherResultAddColumn(pResult, pPlan->zPathAlias, &value);
+    cypherValueDestroy(&value);
+    if( rc != SQLITE_OK ) return rc;
+  }
+  
+  pIterator->nRowsProduced++;
+  
+  return SQLITE_OK;
+}
+
+static int shortestPathClose(CypherIterator *pIterator) {
+  ShortestPathData *pData = (ShortestPathData*)pIterator->pIterData;
+  if( pData->bEndsOpen && pData->pEnds ) pData->pEnds->xClose(pData->pEnds);
+  cypherPathWalkerDestroy(pData->pWalker);
+  pData->pWalker = NULL;
+  cypherResultDestroy(pData->pRow);
+  cypherResultDestroy(pData->pEndRow);
+  pData->pRow = pData->pEndRow = NULL;
+  pData->bEndsOpen = pData->bWalking = 0;
+  pIterator->bOpened = 0;
+  return pData->pSource->xClose(pData->pSource);
+}
+
+static void shortestPathDestroy(CypherIterator *pIterator) {
+  ShortestPathData *pData = (ShortestPathData*)pIterator->pIterData;
+  if( pData ) {
+    cypherIteratorDestroy(pData->pSource);
+    cypherIteratorDestroy(pData->pEnds);
+    sqlite3_free(pData);
+  }
+}
+
+CypherIterator *cypherShortestPathCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext) {
+  CypherIterator *pIterator;
+  ShortestPathData *pData;
+  
+  if( !pPlan || !pPlan->pChild ) return NULL;
+  
+  pIterator = sqlite3_malloc(sizeof(CypherIterator));
+  if( !pIterator ) return NULL;
+  
+  pData = sqlite3_malloc(sizeof(ShortestPathData));
+  if( !pData ) {
+    sqlite3_free(pIterator);
+    return NULL;
+  }
+  
+  memset(pIterator, 0, sizeof(CypherIterator));
+  memset(pData, 0, sizeof(ShortestPathData));
+  
+  pData->pSource = cypherIteratorCreate(pPlan->apChildren[0], pContext);
+  if( pData->pSource && pPlan->nChildren > 1 ) {
+    pData->pEnds = cypherIteratorCreate(pPlan->apChildren[1], pContext);
+  }
+  if( !pData->pSource || (pPlan->nChildren > 1 && !pData->pEnds) ) {
+    cypherIteratorDestroy(pData->pSource);
+    sqlite3_free(pData);
+    sqlite3_free(pIterator);
+    return NULL;
+  }
+  
+  /* Set up iterator */
+  pIterator->xOpen = shortestPathOpen;
+  pIterator->xNext = shortestPathNext;
+  pIterator->xClose = shortestPathClose;
+  pIterator->xDestroy = shortestPathDestroy;
+  pIterator->pContext = pContext;
+  pIterator->pPlan = pPlan;
+  pIterator->pIterData = pData;
+  
+  return pIterator;
+}
+
+/*
+** Value hashing shared by the hash join and aggregation. Values that
+** iteratorValuesEqual() finds equal hash alike; lists, maps and paths are
+** hashed by type only.
+*/
+static sqlite3_uint64 iteratorHashValue(sqlite3_uint64 h, const CypherValue *pValue) {
+  sqlite3_uint64 v = 0;
+  
+  switch( pValue->type ) {
+    case CYPHER_VALUE_BOOLEAN:      v = pValue->u.bBoolean; break;
+    case CYPHER_VALUE_INTEGER:      v = pValue->u.iInteger; break;
+    case CYPHER_VALUE_NODE:         v = pValue->u.iNodeId; break;
+    case CYPHER_VALUE_RELATIONSHIP: v = pValue->u.iRelId; break;
+    case CYPHER_VALUE_FLOAT:
+      memcpy(&v, &pValue->u.rFloat, sizeof(v));
+      break;
+    case CYPHER_VALUE_STRING: {
+      const unsigned char *z = (const unsigned char*)pValue->u.zString;
+      while( z && *z ) v = (v ^ *z++) * 0x100000001b3ULL;
+      break;
+    }
+    default:
+      break;
+  }
+  h = (h ^ (sqlite3_uint64)pValue->type) * 0x100000001b3ULL;
+  return (h ^ v) * 0x100000001b3ULL;
+}
+
+/*
+** Mix a hash built by iteratorHashValue() down to 32 bits, so that both
+** the low bits (hash table slots) and the top bits (partitions) vary.
+*/
+static unsigned int iteratorHashFinish(sqlite3_uint64 h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  return (unsigned int)(h ^ (h >> 32));
+}
+
+#define ITERATOR_HASH_INIT 0xcbf29ce484222325ULL
+
+/*
+** Return true if two values are equal for joining and grouping: of the
+** same type and comparing equal. NULL equals NULL.
+*/
+static int iteratorValuesEqual(const CypherValue *pA, const CypherValue *pB) {
+  return pA->type == pB->type && cypherValueCompare(pA, pB) == 0;
+}
+
+/*
+** Order two values for sorting and for min() and max(): numbers by value
+** whatever their type, other values of one type by cypherValueCompare()
+** and values of different types by type.
+*/
+static int iteratorValueOrder(const CypherValue *pA, const CypherValue *pB) {
+  int bNumA = pA->type == CYPHER_VALUE_INTEGER || pA->type == CYPHER_VALUE_FLOAT;
+  int bNumB = pB->type == CYPHER_VALUE_INTEGER || pB->type == CYPHER_VALUE_FLOAT;
+  int c;
+  
+  if( bNumA && bNumB && pA->type != pB->type ) {
+    double rA = pA->type == CYPHER_VALUE_FLOAT ? pA->u.rFloat : (double)pA->u.iInteger;
+    double rB = pB->type == CYPHER_VALUE_FLOAT ? pB->u.rFloat : (double)pB->u.iInteger;
+    return rA < rB ? -1 : rA > rB;
+  }
+  if( pA->type != pB->type ) return pA->type < pB->type ? -1 : 1;
+  c = cypherValueCompare(pA, pB);
+  return c == SQLITE_MISMATCH ? 0 : c;
+}
+
+/*
+** Approximate number of bytes pValue holds beyond the CypherValue itself.
+*/
+static sqlite3_int64 iteratorValueBytes(const CypherValue *pValue) {
+  sqlite3_int64 n = 0;
+  int i;
+  switch( pValue->type ) {
+    case CYPHER_VALUE_STRING:
+      if( pValue->u.zString ) n = (sqlite3_int64)strlen(pValue->u.zString) + 1;
+      break;
+    case CYPHER_VALUE_PATH:
+      n = (2 * (sqlite3_int64)pValue->u.path.nLength + 2) * sizeof(sqlite3_int64);
+      break;
+    case CYPHER_VALUE_LIST:
+      for( i = 0; i < pValue->u.list.nValues; i++ ) {
+        n += sizeof(CypherValue) + iteratorValueBytes(&pValue->u.list.apValues[i]);
+      }
+      break;
+    case CYPHER_VALUE_MAP:
+      for( i = 0; i < pValue->u.map.nPairs; i++ ) {
+        n += sizeof(CypherValue) + sizeof(char*) + iteratorValueBytes(&pValue->u.map.apValues[i]);
+        if( pValue->u.map.azKeys[i] ) n += (sqlite3_int64)strlen(pValue->u.map.azKeys[i]) + 1;
+      }
+      break;
+    default:
+      break;
+  }
+  return n;
+}
+
+/*
+** Approximate number of bytes held by pRow.
+*/
+static sqlite3_int64 iteratorRowBytes(const CypherResult *pRow) {
+  sqlite3_int64 n = sizeof(CypherResult);
+  int i;
+  for( i = 0; i < pRow->nColumns; i++ ) {
+    n += sizeof(CypherValue) + sizeof(char*) + strlen(pRow->azColumnNames[i]) + 1 +
+         iteratorValueBytes(&pRow->aValues[i]);
+  }
+  return n;
+}
+
+/*
+** Return the value of column zName of pRow, or NULL if it has none.
+*/
+static CypherValue *iteratorColumn(CypherResult *pRow, const char *zName) {
+  int i;
+  for( i = 0; i < pRow->nColumns; i++ ) {
+    if( strcmp(pRow->azColumnNames[i], zName) == 0 ) return &pRow->aValues[i];
+  }
+  return NULL;
+}
+
+/*
+** Set pValue, which must not hold a value, to zVar.zProp of pRow, or to a
+** copy of zVar itself if zProp is NULL. A missing variable or property, or
+** a variable without properties, gives NULL.
+*/
+static int propertyReaderValue(CypherPropertyReader *p, CypherResult *pRow,
+                               const char *zVar, const char *zProp,
+                               CypherValue *pValue) {
+  CypherValue *pVar = zVar ? iteratorColumn(pRow, zVar) : NULL;
+  
+  cypherValueInit(pValue);
+  if( !pVar ) return SQLITE_OK;
+  if( !zProp ) return cypherValueCopyInto(pValue, pVar);
+  return cypherPropertyRead(p, pVar, zProp, pValue);
+}
+
+/*
+** Split the comma-separated names zList into a new array *pazName of
+** *pnName strings, freed with iteratorFreeNames().
+*/
+static int iteratorSplitNames(const char *zList, char ***pazName, int *pnName) {
+  const char *z;
+  
+  for( z = zList; z && *z; ) {
+    const char *zEnd = strchr(z, ',');
+    int n = zEnd ? (int)(zEnd - z) : (int)strlen(z);
+    char **azNew = sqlite3_realloc(*pazName, (*pnName + 1) * sizeof(char*));
+    if( !azNew ) return SQLITE_NOMEM;
+    *pazName = azNew;
+    azNew[*pnName] = sqlite3_mprintf("%.*s", n, z);
+    if( !azNew[*pnName] ) return SQLITE_NOMEM;
+    (*pnName)++;
+    z = zEnd ? zEnd + 1 : NULL;
+  }
+  return SQLITE_OK;
+}
+
+static void iteratorFreeNames(char **azName, int nName) {
+  int i;
+  for( i = 0; i < nName; i++ ) sqlite3_free(azName[i]);
+  sqlite3_free(azName);
+}
+
+/*
+** Return true if pValue, a relationship or a list of them, holds iRel.
+*/
+static int iteratorHasRel(const CypherValue *pValue, sqlite3_int64 iRel) {
+  int i;
+  
+  if( pValue->type == CYPHER_VALUE_RELATIONSHIP ) return pValue->u.iRelId == iRel;
+  if( pValue->type != CYPHER_VALUE_LIST ) return 0;
+  for( i = 0; i < pValue->u.list.nValues; i++ ) {
+    if( iteratorHasRel(&pValue->u.list.apValues[i], iRel) ) return 1;
+  }
+  return 0;
+}
+
+/*
+** Return true if pA and pB, each a relationship or a list of them, share
+** no relationship.
+*/
+static int iteratorRelsDisjoint(const CypherValue *pA, const CypherValue *pB) {
+  int i;
+  
+  if( pB->type == CYPHER_VALUE_RELATIONSHIP ) return !iteratorHasRel(pA, pB->u.iRelId);
+  if( pB->type != CYPHER_VALUE_LIST ) return 1;
+  for( i = 0; i < pB->u.list.nValues; i++ ) {
+    if( !iteratorRelsDisjoint(pA, &pB->u.list.apValues[i]) ) return 0;
+  }
+  return 1;
+}
+
+/*
+** Return true if joining pLeft and pRight binds no two of the relationship
+** variables azRel to the same edge. A variable both rows bind is one
+** binding, which the join keys already match.
+*/
+static int iteratorRelsDistinct(char **azRel, int nRel, CypherResult *pLeft,
+                                CypherResult *pRight) {
+  int i, j;
+  
+  for( i = 0; i < nRel; i++ ) {
+    CypherValue *pRightRel = iteratorColumn(pRight, azRel[i]);
+    if( !pRightRel || iteratorColumn(pLeft, azRel[i]) ) continue;
+    for( j = 0; j < nRel; j++ ) {
+      CypherValue *pLeftRel = j != i ? iteratorColumn(pLeft, azRel[j]) : NULL;
+      if( pLeftRel && !iteratorRelsDisjoint(pLeftRel, pRightRel) ) return 0;
+    }
+  }
+  return 1;
+}
+
+/*
+** Bytes a HashJoin, Distinct or Sort may hold before it spills, or 0 for
+** each operator's compile-time default. Operators read it when opened.
+*/
+static sqlite3_int64 iteratorSpillLimit = 0;
+
+sqlite3_int64 cypherSpillLimit(sqlite3_int64 nLimit) {
+  sqlite3_int64 nPrior = iteratorSpillLimit;
+  if( nLimit >= 0 ) iteratorSpillLimit = nLimit;
+  return nPrior;
+}
+
+static sqlite3_int64 iteratorSpillBudget(sqlite3_int64 nDefault) {
+  return iteratorSpillLimit > 0 ? iteratorSpillLimit : nDefault;
+}
+
+/*
+** HashJoin iterator implementation.
+** Reads every row of the second child (the build side) into an
+** open-addressing table keyed on the join variables, then streams the
+** first child (the probe side) through it: each probe row is produced once
+** per build row with equal keys, extended by the build row's other columns.
+** Nodes and relationships match by id, other values by equality, and a row
+** with a missing or NULL key matches nothing. When the sides are patterns
+** of one MATCH, pairs that bind two of their relationship variables to the
+** same edge are skipped.
+**
+** When the build rows outgrow CYPHER_HASH_JOIN_MEMORY bytes, or the limit
+** set with cypherSpillLimit(), they, and then all probe rows, are written
+** to a temporary table split into partitions by the top bits of the key
+** hash. The partitions are then joined one at a
+** time, each holding only its share of the build side in memory.
+*/
+
+#ifndef CYPHER_HASH_JOIN_MEMORY
+# define CYPHER_HASH_JOIN_MEMORY (32*1024*1024)
+#endif
+#define HASH_JOIN_PARTITION_BITS 4
+#define HASH_JOIN_PARTITIONS (1 << HASH_JOIN_PARTITION_BITS)
+
+typedef struct HashJoinData {
+  CypherIterator *pProbe;       /* First child, streamed */
+  CypherIterator *pBuild;       /* Second child, hashed */
+  char **azKey;                 /* Join variables */
+  int nKey;
+  char **azRel;                 /* Relationship variables to keep distinct */
+  int nRel;
+  
+  /* Build rows held in memory */
+  CypherResult **apRow;
+  unsigned int *aHash;          /* Key hash of each row */
+  int *aNext;                   /* Next row with the same hash, or -1 */
+  int nRow;
+  int nRowAlloc;
+  sqlite3_int64 nBytes;         /* Approximate size of the rows */
+  sqlite3_int64 nMemory;        /* Spill once nBytes exceeds this */
+  int *aSlot;                   /* First row of each hash, or -1 */
+  int nSlot;                    /* Size of aSlot, a power of two */
+  
+  /* Spilled partitions */
+  char *zSpill;                 /* Temporary table, NULL while in memory */
+  sqlite3_stmt *pInsert;        /* Appends a row to a partition */
+  sqlite3_stmt *pRead;          /* Reads one side of partition iPart */
+  int iPart;                    /* Partition being joined */
+  int bProbeOpen;               /* pProbe is open */
+  
+  /* Probe state */
+  CypherResult *pProbeRow;      /* Current probe row */
+  int iMatch;                   /* Next build row with its hash, or -1 */
+} HashJoinData;
+
+/*
+** Compute the hash of the join keys of pRow into *pHash. Returns 0 if a
+** key is missing or NULL, so that the row cannot match.
+*/
+static int hashJoinRowHash(HashJoinData *pData, CypherResult *pRow,
+                           unsigned int *pHash) {
+  sqlite3_uint64 h = ITERATOR_HASH_INIT;
+  int i;
+  
+  for( i = 0; i < pData->nKey; i++ ) {
+    CypherValue *pValue = iteratorColumn(pRow, pData->azKey[i]);
+    if( !pValue || pValue->type == CYPHER_VALUE_NULL ) return 0;
+    h = iteratorHashValue(h, pValue);
+  }
+  *pHash = iteratorHashFinish(h);
+  return 1;
+}
+
+/*
+** Return true if the join keys of pA and pB are equal.
+*/
+static int hashJoinKeysEqual(HashJoinData *pData, CypherResult *pA, CypherResult *pB) {
+  int i;
+  for( i = 0; i < pData->nKey; i++ ) {
+    if( !iteratorValuesEqual(iteratorColumn(pA, pData->azKey[i]),
+                             iteratorColumn(pB, pData->azKey[i])) ) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/*
+** Add pRow, whose keys hash to h, to the in-memory build rows. Takes
+** ownership of pRow.
+*/
+static int hashJoinAddRow(HashJoinData *pData, CypherResult *pRow, unsigned int h) {
+  if( pData->nRow >= pData->nRowAlloc ) {
+    int nNew = pData->nRowAlloc ? pData->nRowAlloc * 2 : 64;
+    CypherResult **apNew;
+    unsigned int *aHashNew;
+    int *aNextNew;
+    
+    apNew = sqlite3_realloc(pData->apRow, nNew * sizeof(CypherResult*));
+    if( apNew ) pData->apRow = apNew;
+    aHashNew = sqlite3_realloc(pData->aHash, nNew * sizeof(unsigned int));
+    if( aHashNew ) pData->aHash = aHashNew;
+    aNextNew = sqlite3_realloc(pData->aNext, nNew * sizeof(int));
+    if( aNextNew ) pData->aNext = aNextNew;
+    if( !apNew || !aHashNew || !aNextNew ) {
+      cypherResultDestroy(pRow);
+      return SQLITE_NOMEM;
+    }
+    pData->nRowAlloc = nNew;
+  }
+  pData->apRow[pData->nRow] = pRow;
+  pData->aHash[pData->nRow] = h;
+  pData->aNext[pData->nRow] = -1;
+  pData->nRow++;
+  
+  pData->nBytes += iteratorRowBytes(pRow) + sizeof(CypherResult*) + 2 * sizeof(int);
+  return SQLITE_OK;
+}
+
+/*
+** Free the in-memory build rows and their table.
+*/
+static void hashJoinReset(HashJoinData *pData) {
+  int i;
+  for( i = 0; i < pData->nRow; i++ ) {
+    cypherResultDestroy(pData->apRow[i]);
+  }
+  pData->nRow = 0;
+  pData->nBytes = 0;
+  sqlite3_free(pData->aSlot);
+  pData->aSlot = NULL;
+  pData->nSlot = 0;
+}
+
+/*
+** Return the slot of aSlot for hash h: the one holding rows with that
+** hash, or the empty slot where they would go.
+*/
+static int hashJoinSlot(HashJoinData *pData, unsigned int h) {
+  int iSlot = (int)(h & (unsigned int)(pData->nSlot - 1));
+  while( pData->aSlot[iSlot] >= 0 && pData->aHash[pData->aSlot[iSlot]] != h ) {
+    iSlot = (iSlot + 1) & (pData->nSlot - 1);
+  }
+  return iSlot;
+}
+
+/*
+** Build the hash table over the in-memory rows. Rows with equal hashes
+** share a slot and are chained through aNext in the order they were read.
+*/
+static int hashJoinBuildTable(HashJoinData *pData) {
+  int nSlot = 16;
+  int i;
+  
+  while( nSlot < 2 * pData->nRow ) nSlot *= 2;
+  sqlite3_free(pData->aSlot);
+  pData->aSlot = sqlite3_malloc(nSlot * sizeof(int));
+  if( !pData->aSlot ) return SQLITE_NOMEM;
+  memset(pData->aSlot, 0xff, nSlot * sizeof(int));
+  pData->nSlot = nSlot;
+  
+  for( i = pData->nRow - 1; i >= 0; i-- ) {
+    int iSlot = hashJoinSlot(pData, pData->aHash[i]);
+    pData->aNext[i] = pData->aSlot[iSlot];
+    pData->aSlot[iSlot] = i;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Write pRow to the partition of hash h on one side of the spill table.
+*/
+static int hashJoinSpillRow(HashJoinData *pData, int iSide, unsigned int h,
+                            CypherResult *pRow) {
+  unsigned char *aBlob;
+  int nBlob, rc;
+  
+  rc = cypherResultEncode(pRow, &aBlob, &nBlob);
+  if( rc != SQLITE_OK ) return rc;
+  sqlite3_bind_int(pData->pInsert, 1, (int)(h >> (32 - HASH_JOIN_PARTITION_BITS)));
+  sqlite3_bind_int(pData->pInsert, 2, iSide);
+  sqlite3_bind_blob(pData->pInsert, 3, aBlob, nBlob, sqlite3_free);
+  rc = sqlite3_step(pData->pInsert);
+  sqlite3_reset(pData->pInsert);
+  return rc == SQLITE_DONE ? SQLITE_OK : rc;
+}
+
+/*
+** Create the spill table and move the in-memory build rows into it.
+*/
+static int hashJoinSpillStart(CypherIterator *pIterator) {
+  HashJoinData *pData = (HashJoinData*)pIterator->pIterData;
+  sqlite3 *db = pIterator->pContext->pGraph->pDb;
+  char *zSql;
+  int rc, i;
+  
+  pData->zSpill = sqlite3_mprintf("cypher_hash_join_%p", (void*)pIterator);
+  if( !pData->zSpill ) return SQLITE_NOMEM;
+  zSql = sqlite3_mprintf("CREATE TEMP TABLE \"%w\"(part INTEGER, side INTEGER, row BLOB);"
+                         "CREATE INDEX temp.\"%w_part\" ON \"%w\"(part, side);",
+                         pData->zSpill, pData->zSpill, pData->zSpill);
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_exec(db, zSql, 0, 0, 0);
+  sqlite3_free(zSql);
+  if( rc != SQLITE_OK ) {
+    sqlite3_free(pData->zSpill);
+    pData->zSpill = NULL;
+    return rc;
+  }
+  
+  zSql = sqlite3_mprintf("INSERT INTO temp.\"%w\"(part, side, row) VALUES(?1, ?2, ?3)",
+                         pData->zSpill);
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_prepare_v2(db, zSql, -1, &pData->pInsert, 0);
+  sqlite3_free(zSql);
+  if( rc != SQLITE_OK ) return rc;
+  
+  zSql = sqlite3_mprintf("SELECT row FROM temp.\"%w\" WHERE part = ?1 AND side = ?2 "
+                         "ORDER BY rowid", pData->zSpill);
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_prepare_v2(db, zSql, -1, &pData->pRead, 0);
+  sqlite3_free(zSql);
+  if( rc != SQLITE_OK ) return rc;
+  
+  for( i = 0; rc == SQLITE_OK && i < pData->nRow; i++ ) {
+    rc = hashJoinSpillRow(pData, 0, pData->aHash[i], pData->apRow[i]);
+  }
+  hashJoinReset(pData);
+  return rc;
+}
+
+/*
+** Load the build rows of partition iPart into memory and position pRead
+** on its probe rows.
+*/
+static int hashJoinLoadPartition(HashJoinData *pData) {
+  int rc;
+  
+  hashJoinReset(pData);
+  sqlite3_reset(pData->pRead);
+  sqlite3_bind_int(pData->pRead, 1, pData->iPart);
+  sqlite3_bind_int(pData->pRead, 2, 0);
+  while( (rc = sqlite3_step(pData->pRead)) == SQLITE_ROW ) {
+    CypherResult *pRow = cypherResultCreate();
+    unsigned int h = 0;
+    if( !pRow ) return SQLITE_NOMEM;
+    rc = cypherResultDecode(sqlite3_column_blob(pData->pRead, 0),
+                            sqlite3_column_bytes(pData->pRead, 0), pRow);
+    if( rc != SQLITE_OK ) {
+      cypherResultDestroy(pRow);
+      return rc;
+    }
+    hashJoinRowHash(pData, pRow, &h);
+    rc = hashJoinAddRow(pData, pRow, h);
+    if( rc != SQLITE_OK ) return rc;
+  }
+  if( rc != SQLITE_DONE ) return rc;
+  
+  rc = hashJoinBuildTable(pData);
+  if( rc != SQLITE_OK ) return rc;
+  sqlite3_reset(pData->pRead);
+  sqlite3_bind_int(pData->pRead, 2, 1);
+  return SQLITE_OK;
+}
+
+/*
+** Read the next probe row that can match into pData->pProbeRow and set
+** iMatch to the first build row with its hash.
+*/
+static int hashJoinNextProbe(CypherIterator *pIterator) {
+  HashJoinData *pData = (HashJoinData*)pIterator->pIterData;
+  unsigned int h;
+  int rc;
+  
+  if( !pData->zSpill && pData->nRow == 0 ) return SQLITE_DONE;
+  while( 1 ) {
+    CypherResult *pRow = cypherResultCreate();
+    if( !pRow ) return SQLITE_NOMEM;
+    
+    if( pData->zSpill ) {
+      rc = sqlite3_step(pData->pRead);
+      if( rc == SQLITE_ROW ) {
+        rc = cypherResultDecode(sqlite3_column_blob(pData->pRead, 0),
+                                sqlite3_column_bytes(pData->pRead, 0), pRow);
+      } else if( rc == SQLITE_DONE && pData->iPart + 1 < HASH_JOIN_PARTITIONS ) {
+        cypherResultDestroy(pRow);
+        pData->iPart++;
+        rc = hashJoinLoadPartition(pData);
+        if( rc != SQLITE_OK ) return rc;
+        continue;
+      }
+    } else {
+      rc = pData->pProbe->xNext(pData->pProbe, pRow);
+    }
+    if( rc != SQLITE_OK ) {
+      cypherResultDestroy(pRow);
+      return rc;
+    }
+    
+    if( hashJoinRowHash(pData, pRow, &h) && pData->nRow > 0 ) {
+      int iSlot = hashJoinSlot(pData, h);
+      if( pData->aSlot[iSlot] >= 0 ) {
+        pData->pProbeRow = pRow;
+        pData->iMatch = pData->aSlot[iSlot];
+        return SQLITE_OK;
+      }
+    }
+    cypherResultDestroy(pRow);
+  }
+}
+
+static int hashJoinOpen(CypherIterator *pIterator) {
+  HashJoinData *pData = (HashJoinData*)pIterator->pIterData;
+  int rc;
+  
+  rc = pData->pBuild->xOpen(pData->pBuild);
+  if( rc != SQLITE_OK ) return rc;
+  pIterator->bOpened = 1;
+  pIterator->bEof = 0;
+  pData->nMemory = iteratorSpillBudget(CYPHER_HASH_JOIN_MEMORY);
+  
+  /* Build side */
+  while( 1 ) {
+    CypherResult *pRow = cypherResultCreate();
+    unsigned int h;
+    if( !pRow ) return SQLITE_NOMEM;
+    rc = pData->pBuild->xNext(pData->pBuild, pRow);
+    if( rc != SQLITE_OK ) {
+      cypherResultDestroy(pRow);
+      break;
+    }
+    if( !hashJoinRowHash(pData, pRow, &h) ) {
+      cypherResultDestroy(pRow);
+    } else if( pData->zSpill ) {
+      rc = hashJoinSpillRow(pData, 0, h, pRow);
+      cypherResultDestroy(pRow);
+    } else {
+      rc = hashJoinAddRow(pData, pRow, h);
+      if( rc == SQLITE_OK && pData->nBytes > pData->nMemory &&
+          pData->nKey > 0 && pIterator->pContext->pGraph ) {
+        rc = hashJoinSpillStart(pIterator);
+      }
+    }
+    if( rc != SQLITE_OK ) break;
+  }
+  pData->pBuild->xClose(pData->pBuild);
+  if( rc != SQLITE_DONE ) return rc;
+  
+  rc = pData->pProbe->xOpen(pData->pProbe);
+  if( rc != SQLITE_OK ) return rc;
+  pData->bProbeOpen = 1;
+  if( !pData->zSpill ) {
+    return hashJoinBuildTable(pData);
+  }
+  
+  /* Spilled: partition the probe side too, then start on partition 0 */
+  while( 1 ) {
+    CypherResult *pRow = cypherResultCreate();
+    unsigned int h;
+    if( !pRow ) return SQLITE_NOMEM;
+    rc = pData->pProbe->xNext(pData->pProbe, pRow);
+    if( rc == SQLITE_OK && hashJoinRowHash(pData, pRow, &h) ) {
+      rc = hashJoinSpillRow(pData, 1, h, pRow);
+    }
+    cypherResultDestroy(pRow);
+    if( rc != SQLITE_OK ) break;
+  }
+  pData->pProbe->xClose(pData->pProbe);
+  pData->bProbeOpen = 0;
+  if( rc != SQLITE_DONE ) return rc;
+  
+  pData->iPart = 0;
+  return hashJoinLoadPartition(pData);
+}
+
+static int hashJoinNext(CypherIterator *pIterator, CypherResult *pResult) {
+  HashJoinData *pData = (HashJoinData*)pIterator->pIterData;
+  CypherResult *pBuildRow = NULL;
+  int rc, i;
+  
+  if( pIterator->bEof ) return SQLITE_DONE;
+  
+  while( !pBuildRow ) {
+    while( pData->pProbeRow && pData->iMatch >= 0 ) {
+      int iRow = pData->iMatch;
+      pData->iMatch = pData->aNext[iRow];
+      if( hashJoinKeysEqual(pData, pData->pProbeRow, pData->apRow[iRow]) &&
+          iteratorRelsDistinct(pData->azRel, pData->nRel, pData->pProbeRow,
+                               pData->apRow[iRow]) ) {
+        pBuildRow = pData->apRow[iRow];
+        break;
+      }
+    }
+    if( pBuildRow ) break;
+    
+    cypherResultDestroy(pData->pProbeRow);
+    pData->pProbeRow = NULL;
+    rc = hashJoinNextProbe(pIterator);
+    if( rc != SQLITE_OK ) {
+      if( rc == SQLITE_DONE ) pIterator->bEof = 1;
+      return rc;
+    }
+  }
+  
+  /* The probe row, then the build columns it does not already have */
+  for( i = 0; i < pData->pProbeRow->nColumns; i++ ) {
+    rc = cypherResultAddColumn(pResult, pData->pProbeRow->azColumnNames[i],
+                               &pData->pProbeRow->aValues[i]);
+    if( rc != SQLITE_OK ) return rc;
+  }
+  for( i = 0; i < pBuildRow->nColumns; i++ ) {
+    if( iteratorColumn(pData->pProbeRow, pBuildRow->azColumnNames[i]) ) continue;
+    rc = cypherResultAddColumn(pResult, pBuildRow->azColumnNames[i],
+                               &pBuildRow->aValues[i]);
+    if( rc != SQLITE_OK ) return rc;
+  }
+  
+  pIterator->nRowsProduced++;
+  
+  return SQLITE_OK;
+}
+
+static int hashJoinClose(CypherIterator *pIterator) {
+  HashJoinData *pData = (HashJoinData*)pIterator->pIterData;
+  int rc = SQLITE_OK;
+  
+  if( pData->bProbeOpen ) rc = pData->pProbe->xClose(pData->pProbe);
+  pData->bProbeOpen = 0;
+  cypherResultDestroy(pData->pProbeRow);
+  pData->pProbeRow = NULL;
+  hashJoinReset(pData);
+  sqlite3_finalize(pData->pInsert);
+  sqlite3_finalize(pData->pRead);
+  pData->pInsert = pData->pRead = NULL;
+  if( pData->zSpill ) {
+    char *zSql = sqlite3_mprintf("DROP TABLE IF EXISTS temp.\"%w\"", pData->zSpill);
+    if( zSql ) sqlite3_exec(pIterator->pContext->pGraph->pDb, zSql, 0, 0, 0);
+    sqlite3_free(zSql);
+    sqlite3_free(pData->zSpill);
+    pData->zSpill = NULL;
+  }
+  pIterator->bOpened = 0;
+  return rc;
+}
+
+static void hashJoinDestroy(CypherIterator *pIterator) {
+  HashJoinData *pData = (HashJoinData*)pIterator->pIterData;
+  if( pData ) {
+    cypherIteratorDestroy(pData->pProbe);
+    cypherIteratorDestroy(pData->pBuild);
+    iteratorFreeNames(pData->azKey, pData->nKey);
+    iteratorFreeNames(pData->azRel, pData->nRel);
+    sqlite3_free(pData->apRow);
+    sqlite3_free(pData->aHash);
+    sqlite3_free(pData->aNext);
+    sqlite3_free(pData);
+  }
+}
+
+CypherIterator *cypherHashJoinCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext) {
+  CypherIterator *pIterator;
+  HashJoinData *pData;
+  int rc;
+  
+  if( !pPlan || pPlan->nChildren != 2 ) return NULL;
+  
+  pIterator = sqlite3_malloc(sizeof(CypherIterator));
+  if( !pIterator ) return NULL;
+  
+  pData = sqlite3_malloc(sizeof(HashJoinData));
+  if( !pData ) {
+    sqlite3_free(pIterator);
+    return NULL;
+  }
+  
+  memset(pIterator, 0, sizeof(CypherIterator));
+  memset(pData, 0, sizeof(HashJoinData));
+  pIterator->pIterData = pData;
+  pIterator->xDestroy = hashJoinDestroy;
+  
+  rc = iteratorSplitNames(pPlan->zJoinKeys, &pData->azKey, &pData->nKey);
+  if( rc == SQLITE_OK ) {
+    rc = iteratorSplitNames(pPlan->zDistinctRels, &pData->azRel, &pData->nRel);
+  }
+  
+  pData->pProbe = cypherIteratorCreate(pPlan->apChildren[0], pContext);
+  pData->pBuild = cypherIteratorCreate(pPlan->apChildren[1], pContext);
+  if( !pData->pProbe || !pData->pBuild || rc != SQLITE_OK ) {
+    cypherIteratorDestroy(pIterator);
+    return NULL;
+  }
+  
+  /* Set up iterator */
+  pIterator->xOpen = hashJoinOpen;
+  pIterator->xNext = hashJoinNext;
+  pIterator->xClose = hashJoinClose;
+  pIterator->pContext = pContext;
+  pIterator->pPlan = pPlan;
+  
+  return pIterator;
+}
+
+/*
+** NestedLoopJoin iterator implementation.
+** Joins two patterns that share no variable, so that every pair of rows
+** matches. The rows of the second child are read into memory once, then
+** each row of the first child is produced once per inner row, extended by
+** the inner row's columns. As in a HashJoin, pairs that bind two
+** relationship variables of one MATCH to the same edge are skipped.
+*/
+
+typedef struct NestedLoopJoinData {
+  CypherIterator *pOuter;       /* First child, streamed */
+  CypherIterator *pInner;       /* Second child, held in memory */
+  CypherResult **apRow;         /* Rows of the inner side */
+  int nRow;
+  int nRowAlloc;
+  int bOuterOpen;               /* pOuter is open */
+  CypherResult *pOuterRow;      /* Current outer row, or NULL */
+  int iInner;                   /* Next inner row to pair it with */
+  char **azRel;                 /* Relationship variables to keep distinct */
+  int nRel;
+} NestedLoopJoinData;
+
+static void nestedLoopJoinReset(NestedLoopJoinData *pData) {
+  int i;
+  for( i = 0; i < pData->nRow; i++ ) cypherResultDestroy(pData->apRow[i]);
+  pData->nRow = 0;
+  cypherResultDestroy(pData->pOuterRow);
+  pData->pOuterRow = NULL;
+}
+
+static int nestedLoopJoinOpen(CypherIterator *pIterator) {
+  NestedLoopJoinData *pData = (NestedLoopJoinData*)pIterator->pIterData;
+  int rc;
+  
+  rc = pData->pInner->xOpen(pData->pInner);
+  if( rc != SQLITE_OK ) return rc;
+  pIterator->bOpened = 1;
+  pIterator->bEof = 0;
+  
+  while( 1 ) {
+    CypherResult *pRow = cypherResultCreate();
+    if( !pRow ) {
+      rc = SQLITE_NOMEM;
+      break;
+    }
+    rc = pData->pInner->xNext(pData->pInner, pRow);
+    if( rc != SQLITE_OK ) {
+      cypherResultDestroy(pRow);
+      break;
+    }
+    if( pData->nRow >= pData->nRowAlloc ) {
+      int nNew = pData->nRowAlloc ? pData->nRowAlloc * 2 : 64;
+      CypherResult **apNew = sqlite3_realloc(pData->apRow, nNew * sizeof(CypherResult*));
+      if( !apNew ) {
+        cypherResultDestroy(pRow);
+        rc = SQLITE_NOMEM;
+        break;
+      }
+      pData->apRow = apNew;
+      pData->nRowAlloc = nNew;
+    }
+    pData->apRow[pData->nRow++] = pRow;
+  }
+  pData->pInner->xClose(pData->pInner);
+  if( rc != SQLITE_DONE ) return rc;
+  
+  /* An empty inner side joins nothing: the outer side is never read */
+  if( pData->nRow == 0 ) {
+    pIterator->bEof = 1;
+    return SQLITE_OK;
+  }
+  rc = pData->pOuter->xOpen(pData->pOuter);
+  if( rc == SQLITE_OK ) pData->bOuterOpen = 1;
+  return rc;
+}
+
+static int nestedLoopJoinNext(CypherIterator *pIterator, CypherResult *pResult) {
+  NestedLoopJoinData *pData = (NestedLoopJoinData*)pIterator->pIterData;
+  CypherResult *pInnerRow;
+  int rc, i;
+  
+  if( pIterator->bEof ) return SQLITE_DONE;
+  
+  do {
+    if( !pData->pOuterRow || pData->iInner >= pData->nRow ) {
+      cypherResultDestroy(pData->pOuterRow);
+      pData->pOuterRow = cypherResultCreate();
+      if( !pData->pOuterRow ) return SQLITE_NOMEM;
+      rc = pData->pOuter->xNext(pData->pOuter, pData->pOuterRow);
+      if( rc != SQLITE_OK ) {
+        cypherResultDestroy(pData->pOuterRow);
+        pData->pOuterRow = NULL;
+        if( rc == SQLITE_DONE ) pIterator->bEof = 1;
+        return rc;
+      }
+      pData->iInner = 0;
+    }
+    pInnerRow = pData->apRow[pData->iInner++];
+  } while( !iteratorRelsDistinct(pData->azRel, pData->nRel, pData->pOuterRow, pInnerRow) );
+  
+  for( i = 0; i < pData->pOuterRow->nColumns; i++ ) {
+    rc = cypherResultAddColumn(pResult, pData->pOuterRow->azColumnNames[i],
+                               &pData->pOuterRow->aValues[i]);
+    if( rc != SQLITE_OK ) return rc;
+  }
+  for( i = 0; i < pInnerRow->nColumns; i++ ) {
+    rc = cypherResultAddColumn(pResult, pInnerRow->azColumnNames[i],
+                               &pInnerRow->aValues[i]);
+    if( rc != SQLITE_OK ) return rc;
+  }
+  
+  pIterator->nRowsProduced++;
+  
+  return SQLITE_OK;
+}
+
+static int nestedLoopJoinClose(CypherIterator *pIterator) {
+  NestedLoopJoinData *pData = (NestedLoopJoinData*)pIterator->pIterData;
+  int rc = SQLITE_OK;
+  
+  if( pData->bOuterOpen ) rc = pData->pOuter->xClose(pData->pOuter);
+  pData->bOuterOpen = 0;
+  nestedLoopJoinReset(pData);
+  pIterator->bOpened = 0;
+  return rc;
+}
+
+static void nestedLoopJoinDestroy(CypherIterator *pIterator) {
+  NestedLoopJoinData *pData = (NestedLoopJoinData*)pIterator->pIterData;
+  if( pData ) {
+    nestedLoopJoinReset(pData);
+    cypherIteratorDestroy(pData->pOuter);
+    cypherIteratorDestroy(pData->pInner);
+    iteratorFreeNames(pData->azRel, pData->nRel);
+    sqlite3_free(pData->apRow);
+    sqlite3_free(pData);
+  }
+}
+
+CypherIterator *cypherNestedLoopJoinCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext) {
+  CypherIterator *pIterator;
+  NestedLoopJoinData *pData;
+  int rc;
+  
+  if( !pPlan || pPlan->nChildren != 2 ) return NULL;
+  
+  pIterator = sqlite3_malloc(sizeof(CypherIterator));
+  if( !pIterator ) return NULL;
+  
+  pData = sqlite3_malloc(sizeof(NestedLoopJoinData));
+  if( !pData ) {
+    sqlite3_free(pIterator);
+    return NULL;
+  }
+  
+  memset(pIterator, 0, sizeof(CypherIterator));
+  memset(pData, 0, sizeof(NestedLoopJoinData));
+  pIterator->pIterData = pData;
+  pIterator->xDestroy = nestedLoopJoinDestroy;
+  
+  rc = iteratorSplitNames(pPlan->zDistinctRels, &pData->azRel, &pData->nRel);
+  pData->pOuter = cypherIteratorCreate(pPlan->apChildren[0], pContext);
+  pData->pInner = cypherIteratorCreate(pPlan->apChildren[1], pContext);
+  if( !pData->pOuter || !pData->pInner || rc != SQLITE_OK ) {
+    cypherIteratorDestroy(pIterator);
+    return NULL;
+  }
+  
+  /* Set up iterator */
+  pIterator->xOpen = nestedLoopJoinOpen;
+  pIterator->xNext = nestedLoopJoinNext;
+  pIterator->xClose = nestedLoopJoinClose;
+  pIterator->pContext = pContext;
+  pIterator->pPlan = pPlan;
+  
+  return pIterator;
+}
+
+/*
+** Aggregation iterator implementation.
+** Streams its input into a hash table of groups keyed on the grouping
+** columns, each group holding one accumulator per aggregate, then produces
+** one row per group in the order the groups were first seen. Groups and
+** their accumulators are carved from an arena that is freed in one go.
+** Without grouping keys there is always exactly one group.
+**
+** A partial aggregation (PLAN_FLAG_AGG_PARTIAL) produces accumulator state
+** instead of final values, so that morsels of the input can be aggregated
+** independently, and a final aggregation (PLAN_FLAG_AGG_FINAL) merges the
+** partial rows. The state of count() and sum() is the running count or
+** sum, of avg() a [sum, count] list, of min() and max() the extreme so
+** far, and of a DISTINCT aggregate the list of distinct values seen.
+*/
+
+#define AGG_ARENA_BLOCK 16384
+
+typedef struct AggArenaBlock AggArenaBlock;
+struct AggArenaBlock {
+  AggArenaBlock *pNext;         /* Previously filled block */
+  int nUsed;                    /* Bytes handed out */
+  int nSize;                    /* Bytes following this header */
+};
+
+/* Distinct values seen by one DISTINCT aggregate of one group */
+typedef struct AggSeen {
+  CypherValue *aValue;          /* Values in the order seen */
+  unsigned int *aHash;          /* Hash of each value */
+  int nValue;
+  int nAlloc;
+  int *aSlot;                   /* Open-addressing table of aValue indexes */
+  int nSlot;                    /* Size of aSlot, a power of two */
+} AggSeen;
+
+typedef struct AggState {
+  sqlite3_int64 nCount;         /* Values counted or averaged */
+  sqlite3_int64 iSum;           /* Sum while every value is an integer */
+  double rSum;                  /* Sum once a float has been added */
+  int bFloat;                   /* rSum is the sum */
+  CypherValue best;             /* min() or max() so far, NULL at first */
+  AggSeen *pSeen;               /* DISTINCT aggregates: values seen */
+} AggState;
+
+typedef struct AggGroup AggGroup;
+struct AggGroup {
+  AggGroup *pNext;              /* Next group in first-seen order */
+  unsigned int h;               /* Hash of aKey */
+  CypherValue *aKey;            /* Grouping values */
+  AggState *aState;             /* One accumulator per aggregate */
+};
+
+typedef struct AggregateData {
+  CypherIterator *pSource;      /* Input rows */
+  CypherPropertyReader props;   /* Reads n.prop operands */
+  int *aiKey;                   /* Plan column of each grouping key */
+  int nKey;
+  int *aiAgg;                   /* Plan column of each aggregate */
+  int nAgg;
+  AggArenaBlock *pArena;        /* Block being filled */
+  AggGroup **apSlot;            /* Open-addressing table of groups */
+  int nSlot;                    /* Size of apSlot, a power of two */
+  int nGroup;
+  AggGroup *pFirst;             /* Groups in first-seen order */
+  AggGroup **ppLast;            /* Where to link the next new group */
+  AggGroup *pOut;               /* Next group to produce */
+} AggregateData;
+
+/*
+** Allocate n zeroed bytes from the arena.
+*/
+static void *aggArenaAlloc(AggregateData *pData, int n) {
+  AggArenaBlock *pBlock = pData->pArena;
+  void *p;
+  
+  n = (n + 7) & ~7;
+  if( !pBlock || pBlock->nUsed + n > pBlock->nSize ) {
+    int nSize = n > AGG_ARENA_BLOCK ? n : AGG_ARENA_BLOCK;
+    pBlock = sqlite3_malloc((int)sizeof(AggArenaBlock) + nSize);
+    if( !pBlock ) return NULL;
+    pBlock->pNext = pData->pArena;
+    pBlock->nUsed = 0;
+    pBlock->nSize = nSize;
+    pData->pArena = pBlock;
+  }
+  p = (char*)&pBlock[1] + pBlock->nUsed;
+  pBlock->nUsed += n;
+  memset(p, 0, n);
+  return p;
+}
+
+/*
+** Add pValue to pSeen unless an equal value is there. Returns SQLITE_OK
+** if it was added and SQLITE_DONE if it had been seen; either way the set
+** takes ownership of pValue.
+*/
+static int aggSeenAdd(AggSeen *pSeen, CypherValue *pValue) {
+  unsigned int h = iteratorHashFinish(iteratorHashValue(ITERATOR_HASH_INIT, pValue));
+  int iSlot, i;
+  
+  if( pSeen->nSlot > 0 ) {
+    iSlot = (int)(h & (unsigned int)(pSeen->nSlot - 1));
+    while( (i = pSeen->aSlot[iSlot]) >= 0 ) {
+      if( pSeen->aHash[i] == h && iteratorValuesEqual(&pSeen->aValue[i], pValue) ) {
+        cypherValueDestroy(pValue);
+        return SQLITE_DONE;
+      }
+      iSlot = (iSlot + 1) & (pSeen->nSlot - 1);
+    }
+  }
+  
+  if( pSeen->nValue >= pSeen->nAlloc ) {
+    int nNew = pSeen->nAlloc ? pSeen->nAlloc * 2 : 8;
+    CypherValue *aValue = sqlite3_realloc(pSeen->aValue, nNew * sizeof(CypherValue));
+    unsigned int *aHash;
+    if( aValue ) pSeen->aValue = aValue;
+    aHash = sqlite3_realloc(pSeen->aHash, nNew * sizeof(unsigned int));
+    if( aHash ) pSeen->aHash = aHash;
+    if( !aValue || !aHash ) {
+      cypherValueDestroy(pValue);
+      return SQLITE_NOMEM;
+    }
+    pSeen->nAlloc = nNew;
+  }
+  pSeen->aValue[pSeen->nValue] = *pValue;
+  pSeen->aHash[pSeen->nValue] = h;
+  pSeen->nValue++;
+  
+  /* Keep the table at most half full */
+  if( pSeen->nValue * 2 > pSeen->nSlot ) {
+    int nSlot = pSeen->nSlot ? pSeen->nSlot * 2 : 16;
+    int *aSlot = sqlite3_malloc(nSlot * sizeof(int));
+    if( !aSlot ) return SQLITE_NOMEM;
+    memset(aSlot, 0xff, nSlot * sizeof(int));
+    for( i = 0; i < pSeen->nValue; i++ ) {
+      iSlot = (int)(pSeen->aHash[i] & (unsigned int)(nSlot - 1));
+      while( aSlot[iSlot] >= 0 ) iSlot = (iSlot + 1) & (nSlot - 1);
+      aSlot[iSlot] = i;
+    }
+    sqlite3_free(pSeen->aSlot);
+    pSeen->aSlot = aSlot;
+    pSeen->nSlot = nSlot;
+  } else {
+    iSlot = (int)(h & (unsigned int)(pSeen->nSlot - 1));
+    while( pSeen->aSlot[iSlot] >= 0 ) iSlot = (iSlot + 1) & (pSeen->nSlot - 1);
+    pSeen->aSlot[iSlot] = pSeen->nValue - 1;
+  }
+  return SQLITE_OK;
+}
+
+static void aggSeenFree(AggSeen *pSeen) {
+  int i;
+  if( !pSeen ) return;
+  for( i = 0; i < pSeen->nValue; i++ ) cypherValueDestroy(&pSeen->aValue[i]);
+  sqlite3_free(pSeen->aValue);
+  sqlite3_free(pSeen->aHash);
+  sqlite3_free(pSeen->aSlot);
+  sqlite3_free(pSeen);
+}
+
+/*
+** Add a numeric value to the sum of pState.
+*/
+static int aggAddToSum(AggState *pState, const CypherValue *pValue) {
+  if( pValue->type == CYPHER_VALUE_INTEGER ) {
+    if( pState->bFloat ) {
+      pState->rSum += (double)pValue->u.iInteger;
+    } else {
+      pState->iSum += pValue->u.iInteger;
+    }
+  } else if( pValue->type == CYPHER_VALUE_FLOAT ) {
+    if( !pState->bFloat ) {
+      pState->rSum = (double)pState->iSum;
+      pState->bFloat = 1;
+    }
+    pState->rSum += pValue->u.rFloat;
+  } else {
+    return SQLITE_MISMATCH;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Accumulate one input value of aggregate pCol into pState. pValue is NULL
+** for count(*). Takes ownership of *pValue.
+*/
+static int aggStep(PlanColumn *pCol, AggState *pState, CypherValue *pValue) {
+  const char *zFunc = pCol->zFunction;
+  int rc = SQLITE_OK;
+  
+  if( !pValue ) {
+    pState->nCount++;
+    return SQLITE_OK;
+  }
+  if( pValue->type == CYPHER_VALUE_NULL ) return SQLITE_OK;
+  
+  if( zFunc[0] == 's' || zFunc[0] == 'a' ) {
+    rc = aggAddToSum(pState, pValue);
+    if( rc == SQLITE_OK ) pState->nCount++;
+  } else if( zFunc[0] == 'm' ) {
+    int c = pState->best.type == CYPHER_VALUE_NULL ? -1 : iteratorValueOrder(pValue, &pState->best);
+    if( zFunc[1] == 'a' ) c = -c;
+    if( pState->best.type == CYPHER_VALUE_NULL || c < 0 ) {
+      cypherValueDestroy(&pState->best);
+      pState->best = *pValue;
+      return SQLITE_OK;
+    }
+  } else {
+    pState->nCount++;
+  }
+  cypherValueDestroy(pValue);
+  return rc;
+}
+
+/*
+** Accumulate an input value of a DISTINCT aggregate, if it is new.
+** Takes ownership of *pValue.
+*/
+static int aggStepDistinct(PlanColumn *pCol, AggState *pState, CypherValue *pValue) {
+  CypherValue *pCopy;
+  int rc;
+  
+  if( pValue->type == CYPHER_VALUE_NULL ) return SQLITE_OK;
+  if( !pState->pSeen ) {
+    pState->pSeen = sqlite3_malloc(sizeof(AggSeen));
+    if( !pState->pSeen ) {
+      cypherValueDestroy(pValue);
+      return SQLITE_NOMEM;
+    }
+    memset(pState->pSeen, 0, sizeof(AggSeen));
+  }
+  pCopy = cypherValueCopy(pValue);
+  rc = aggSeenAdd(pState->pSeen, pValue);
+  if( rc == SQLITE_OK ) {
+    if( !pCopy ) return SQLITE_NOMEM;
+    rc = aggStep(pCol, pState, pCopy);
+  } else if( pCopy ) {
+    cypherValueDestroy(pCopy);
+  }
+  if( rc == SQLITE_DONE ) rc = SQLITE_OK;
+  sqlite3_free(pCopy);
+  return rc;
+}
+
+/*
+** Merge into pState the partial state pValue of aggregate pCol.
+*/
+static int aggMerge(PlanColumn *pCol, AggState *pState, CypherValue *pValue) {
+  const char *zFunc = pCol->zFunction;
+  CypherValue *pCopy;
+  int rc = SQLITE_OK;
+  int i;
+  
+  if( pCol->bDistinct ) {
+    /* The values seen by the partial aggregation */
+    if( pValue->type != CYPHER_VALUE_LIST ) return SQLITE_MISMATCH;
+    for( i = 0; rc == SQLITE_OK && i < pValue->u.list.nValues; i++ ) {
+      pCopy = cypherValueCopy(&pValue->u.list.apValues[i]);
+      if( !pCopy ) return SQLITE_NOMEM;
+      rc = aggStepDistinct(pCol, pState, pCopy);
+      sqlite3_free(pCopy);
+    }
+    return rc;
+  }
+  if( zFunc[0] == 'c' ) {
+    pState->nCount += cypherValueGetInteger(pValue);
+    return SQLITE_OK;
+  }
+  if( zFunc[0] == 'a' ) {
+    if( pValue->type != CYPHER_VALUE_LIST || pValue->u.list.nValues != 2 ) {
+      return SQLITE_MISMATCH;
+    }
+    rc = aggAddToSum(pState, &pValue->u.list.apValues[0]);
+    pState->nCount += cypherValueGetInteger(&pValue->u.list.apValues[1]);
+    return rc;
+  }
+  pCopy = cypherValueCopy(pValue);
+  if( !pCopy ) return SQLITE_NOMEM;
+  rc = aggStep(pCol, pState, pCopy);
+  sqlite3_free(pCopy);
+  return rc;
+}
+
+/*
+** Set pOut to the sum accumulated in pState.
+*/
+static void aggSumValue(AggState *pState, CypherValue *pOut) {
+  if( pState->bFloat ) {
+    cypherValueSetFloat(pOut, pState->rSum);
+  } else {
+    cypherValueSetInteger(pOut, pState->iSum);
+  }
+}
+
+/*
+** Set pOut to the final value of aggregate pCol, or to its partial state
+** if bPartial.
+*/
+static int aggValue(PlanColumn *pCol, AggState *pState, int bPartial, CypherValue *pOut) {
+  const char *zFunc = pCol->zFunction;
+  CypherValue *pCopy;
+  int i;
+  
+  cypherValueInit(pOut);
+  if( bPartial && pCol->bDistinct ) {
+    int n = pState->pSeen ? pState->pSeen->nValue : 0;
+    CypherValue *aList = NULL;
+    if( n > 0 ) {
+      aList = sqlite3_malloc(n * sizeof(CypherValue));
+      if( !aList ) return SQLITE_NOMEM;
+      for( i = 0; i < n; i++ ) {
+        pCopy = cypherValueCopy(&pState->pSeen->aValue[i]);
+        if( !pCopy ) {
+          while( --i >= 0 ) cypherValueDestroy(&aList[i]);
+          sqlite3_free(aList);
+          return SQLITE_NOMEM;
+        }
+        aList[i] = *pCopy;
+        sqlite3_free(pCopy);
+      }
+    }
+    cypherValueSetList(pOut, aList, n);
+  } else if( zFunc[0] == 'c' ) {
+    cypherValueSetInteger(pOut, pState->nCount);
+  } else if( zFunc[0] == 's' ) {
+    aggSumValue(pState, pOut);
+  } else if( zFunc[0] == 'a' ) {
+    if( bPartial ) {
+      CypherValue *aList = sqlite3_malloc(2 * sizeof(CypherValue));
+      if( !aList ) return SQLITE_NOMEM;
+      cypherValueInit(&aList[0]);
+      cypherValueInit(&aList[1]);
+      aggSumValue(pState, &aList[0]);
+      cypherValueSetInteger(&aList[1], pState->nCount);
+      cypherValueSetList(pOut, aList, 2);
+    } else if( pState->nCount > 0 ) {
+      double rSum = pState->bFloat ? pState->rSum : (double)pState->iSum;
+      cypherValueSetFloat(pOut, rSum / (double)pState->nCount);
+    }
+  } else if( pState->best.type != CYPHER_VALUE_NULL ) {
+    pCopy = cypherValueCopy(&pState->best);
+    if( !pCopy ) return SQLITE_NOMEM;
+    *pOut = *pCopy;
+    sqlite3_free(pCopy);
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Return the group for the grouping values aKey, which hash to h, creating
+** it if this is the first row of the group. A new group takes ownership of
+** aKey's values; otherwise the caller still owns them.
+*/
+static AggGroup *aggFindGroup(AggregateData *pData, CypherValue *aKey, unsigned int h,
+                              int *pbNew) {
+  AggGroup *pGroup;
+  int iSlot, i;
+  
+  *pbNew = 0;
+  if( pData->nSlot > 0 ) {
+    iSlot = (int)(h & (unsigned int)(pData->nSlot - 1));
+    while( (pGroup = pData->apSlot[iSlot]) != NULL ) {
+      if( pGroup->h == h ) {
+        for( i = 0; i < pData->nKey; i++ ) {
+          if( !iteratorValuesEqual(&pGroup->aKey[i], &aKey[i]) ) break;
+        }
+        if( i == pData->nKey ) return pGroup;
+      }
+      iSlot = (iSlot + 1) & (pData->nSlot - 1);
+    }
+  }
+  
+  /* Keep the table at most half full */
+  if( (pData->nGroup + 1) * 2 > pData->nSlot ) {
+    int nSlot = pData->nSlot ? pData->nSlot * 2 : 64;
+    AggGroup **apSlot = sqlite3_malloc(nSlot * sizeof(AggGroup*));
+    if( !apSlot ) return NULL;
+    memset(apSlot, 0, nSlot * sizeof(AggGroup*));
+    for( pGroup = pData->pFirst; pGroup; pGroup = pGroup->pNext ) {
+      iSlot = (int)(pGroup->h & (unsigned int)(nSlot - 1));
+      while( apSlot[iSlot] ) iSlot = (iSlot + 1) & (nSlot - 1);
+      apSlot[iSlot] = pGroup;
+    }
+    sqlite3_free(pData->apSlot);
+    pData->apSlot = apSlot;
+    pData->nSlot = nSlot;
+  }
+  
+  pGroup = aggArenaAlloc(pData, (int)(sizeof(AggGroup) +
+                                      pData->nKey * sizeof(CypherValue) +
+                                      pData->nAgg * sizeof(AggState)));
+  if( !pGroup ) return NULL;
+  pGroup->h = h;
+  pGroup->aKey = (CypherValue*)&pGroup[1];
+  pGroup->aState = (AggState*)&pGroup->aKey[pData->nKey];
+  for( i = 0; i < pData->nKey; i++ ) pGroup->aKey[i] = aKey[i];
+  
+  iSlot = (int)(h & (unsigned int)(pData->nSlot - 1));
+  while( pData->apSlot[iSlot] ) iSlot = (iSlot + 1) & (pData->nSlot - 1);
+  pData->apSlot[iSlot] = pGroup;
+  pData->nGroup++;
+  *pData->ppLast = pGroup;
+  pData->ppLast = &pGroup->pNext;
+  *pbNew = 1;
+  return pGroup;
+}
+
+/*
+** Aggregate one input row.
+*/
+static int aggAddRow(CypherIterator *pIterator, CypherResult *pRow, CypherValue *aKey) {
+  AggregateData *pData = (AggregateData*)pIterator->pIterData;
+  PhysicalPlanNode *pPlan = pIterator->pPlan;
+  int bFinal = (pPlan->iFlags & PLAN_FLAG_AGG_FINAL) != 0;
+  sqlite3_uint64 h = ITERATOR_HASH_INIT;
+  AggGroup *pGroup;
+  int bNew = 0, rc = SQLITE_OK, i;
+  
+  /* A final aggregation reads the columns its partial aggregations wrote */
+  for( i = 0; rc == SQLITE_OK && i < pData->nKey; i++ ) {
+    PlanColumn *pCol = &pPlan->aColumn[pData->aiKey[i]];
+    rc = propertyReaderValue(&pData->props, pRow, bFinal ? pCol->zName : pCol->zVariable,
+                             bFinal ? NULL : pCol->zProperty, &aKey[i]);
+    h = iteratorHashValue(h, &aKey[i]);
+  }
+  pGroup = rc == SQLITE_OK ? aggFindGroup(pData, aKey, iteratorHashFinish(h), &bNew) : NULL;
+  if( !bNew ) {
+    for( i = 0; i < pData->nKey; i++ ) {
+      cypherValueDestroy(&aKey[i]);
+      cypherValueInit(&aKey[i]);
+    }
+  }
+  if( !pGroup ) return rc == SQLITE_OK ? SQLITE_NOMEM : rc;
+  
+  for( i = 0; rc == SQLITE_OK && i < pData->nAgg; i++ ) {
+    PlanColumn *pCol = &pPlan->aColumn[pData->aiAgg[i]];
+    AggState *pState = &pGroup->aState[i];
+    CypherValue value;
+    
+    if( !bFinal && !pCol->zVariable ) {
+      rc = aggStep(pCol, pState, NULL);
+      continue;
+    }
+    rc = propertyReaderValue(&pData->props, pRow, bFinal ? pCol->zName : pCol->zVariable,
+                             bFinal ? NULL : pCol->zProperty, &value);
+    if( rc != SQLITE_OK ) break;
+    if( bFinal ) {
+      rc = aggMerge(pCol, pState, &value);
+      cypherValueDestroy(&value);
+    } else if( pCol->bDistinct ) {
+      rc = aggStepDistinct(pCol, pState, &value);
+    } else {
+      rc = aggStep(pCol, pState, &value);
+    }
+  }
+  return rc;
+}
+
+static int aggregateOpen(CypherIterator *pIterator) {
+  AggregateData *pData = (AggregateData*)pIterator->pIterData;
+  PhysicalPlanNode *pPlan = pIterator->pPlan;
+  CypherValue *aKey = NULL;
+  int bNew, rc, i;
+  
+  rc = pData->pSource->xOpen(pData->pSource);
+  if( rc != SQLITE_OK ) return rc;
+  pIterator->bOpened = 1;
+  pIterator->bEof = 0;
+  pData->ppLast = &pData->pFirst;
+  
+  if( pData->nKey > 0 ) {
+    aKey = sqlite3_malloc(pData->nKey * sizeof(CypherValue));
+    if( !aKey ) return SQLITE_NOMEM;
+    for( i = 0; i < pData->nKey; i++ ) cypherValueInit(&aKey[i]);
+  }
+  
+  /* Consume the whole input, one row at a time */
+  while( 1 ) {
+    CypherResult *pRow = cypherResultCreate();
+    if( !pRow ) {
+      rc = SQLITE_NOMEM;
+      break;
+    }
+    rc = pData->pSource->xNext(pData->pSource, pRow);
+    if( rc == SQLITE_OK ) rc = aggAddRow(pIterator, pRow, aKey);
+    cypherResultDestroy(pRow);
+    if( rc != SQLITE_OK ) break;
+  }
+  sqlite3_free(aKey);
+  pData->pSource->xClose(pData->pSource);
+  if( rc != SQLITE_DONE ) return rc;
+  
+  /* Aggregates over no rows at all still produce a row, unless partial */
+  if( pData->nKey == 0 && pData->nGroup == 0 && !(pPlan->iFlags & PLAN_FLAG_AGG_PARTIAL) &&
+      !aggFindGroup(pData, NULL, iteratorHashFinish(ITERATOR_HASH_INIT), &bNew) ) {
+    return SQLITE_NOMEM;
+  }
+  pData->pOut = pData->pFirst;
+  return SQLITE_OK;
+}
+
+static int aggregateNext(CypherIterator *pIterator, CypherResult *pResult) {
+  AggregateData *pData = (AggregateData*)pIterator->pIterData;
+  PhysicalPlanNode *pPlan = pIterator->pPlan;
+  int bPartial = (pPlan->iFlags & PLAN_FLAG_AGG_PARTIAL) != 0;
+  AggGroup *pGroup = pData->pOut;
+  int iKey = 0, iAgg = 0, rc = SQLITE_OK, i;
+  
+  if( pIterator->bEof || !pGroup ) {
+    pIterator->bEof = 1;
+    return SQLITE_DONE;
+  }
+  pData->pOut = pGroup->pNext;
+  
+  /* Columns in RETURN order */
+  for( i = 0; rc == SQLITE_OK && i < pPlan->nColumn; i++ ) {
+    PlanColumn *pCol = &pPlan->aColumn[i];
+    if( !pCol->zFunction ) {
+      rc = cypherResultAddColumn(pResult, pCol->zName, &pGroup->aKey[iKey++]);
+    } else {
+      CypherValue value;
+      rc = aggValue(pCol, &pGroup->aState[iAgg++], bPartial, &value);
+      if( rc == SQLITE_OK ) rc = cypherResultAddColumn(pResult, pCol->zName, &value);
+      cypherValueDestroy(&value);
+    }
+  }
+  if( rc != SQLITE_OK ) return rc;
+  
+  pIterator->nRowsProduced++;
+  
+  return SQLITE_OK;
+}
+
+static int aggregateClose(CypherIterator *pIterator) {
+  AggregateData *pData = (AggregateData*)pIterator->pIterData;
+  AggGroup *pGroup;
+  int i;
+  
+  for( pGroup = pData->pFirst; pGroup; pGroup = pGroup->pNext ) {
+    for( i = 0; i < pData->nKey; i++ ) cypherValueDestroy(&pGroup->aKey[i]);
+    for( i = 0; i < pData->nAgg; i++ ) {
+      cypherValueDestroy(&pGroup->aState[i].best);
+      aggSeenFree(pGroup->aState[i].pSeen);
+    }
+  }
+  while( pData->pArena ) {
+    AggArenaBlock *pNext = pData->pArena->pNext;
+    sqlite3_free(pData->pArena);
+    pData->pArena = pNext;
+  }
+  sqlite3_free(pData->apSlot);
+  pData->apSlot = NULL;
+  pData->nSlot = pData->nGroup = 0;
+  pData->pFirst = pData->pOut = NULL;
+  cypherPropertyReaderClose(&pData->props);
+  pIterator->bOpened = 0;
+  return SQLITE_OK;
+}
+
+static void aggregateDestroy(CypherIterator *pIterator) {
+  AggregateData *pData = (AggregateData*)pIterator->pIterData;
+  if( pData ) {
+    cypherIteratorDestroy(pData->pSource);
+    sqlite3_free(pData->aiKey);
+    sqlite3_free(pData);
+  }
+}
+
+CypherIterator *cypherAggregationCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext) {
+  CypherIterator *pIterator;
+  AggregateData *pData;
+  int i;
+  
+  if( !pPlan || !pPlan->pChild || pPlan->nColumn <= 0 ) return NULL;
+  
+  pIterator = sqlite3_malloc(sizeof(CypherIterator));
+  if( !pIterator ) return NULL;
+  
+  pData = sqlite3_malloc(sizeof(AggregateData));
+  if( !pData ) {
+    sqlite3_free(pIterator);
+    return NULL;
+  }
+  
+  memset(pIterator, 0, sizeof(CypherIterator));
+  memset(pData, 0, sizeof(AggregateData));
+  pIterator->pIterData = pData;
+  pIterator->xDestroy = aggregateDestroy;
+  
+  /* Split the plan columns into grouping keys and aggregates */
+  pData->aiKey = sqlite3_malloc(pPlan->nColumn * sizeof(int));
+  pData->pSource = cypherIteratorCreate(pPlan->pChild, pContext);
+  if( !pData->aiKey || !pData->pSource ) {
+    cypherIteratorDestroy(pIterator);
+    return NULL;
+  }
+  for( i = 0; i < pPlan->nColumn; i++ ) {
+    if( !pPlan->aColumn[i].zFunction ) pData->aiKey[pData->nKey++] = i;
+  }
+  pData->aiAgg = &pData->aiKey[pData->nKey];
+  for( i = 0; i < pPlan->nColumn; i++ ) {
+    if( pPlan->aColumn[i].zFunction ) pData->aiAgg[pData->nAgg++] = i;
+  }
+  pData->props.pGraph = pContext->pGraph;
+  
+  /* Set up iterator */
+  pIterator->xOpen = aggregateOpen;
+  pIterator->xNext = aggregateNext;
+  pIterator->xClose = aggregateClose;
+  pIterator->pContext = pContext;
+  pIterator->pPlan = pPlan;
+  
+  return pIterator;
+}
+
+/*
+** Distinct iterator implementation.
+** Streams its input and produces each row whose key has not been seen
+** before, in input order. With plan columns the key is those columns,
+** read like grouping keys, and the row produced holds just them; without,
+** the key is the whole row, which is produced as it is. Keys are hashed
+** and compared by type and value, as grouping keys are.
+**
+** When the keys seen outgrow CYPHER_DISTINCT_MEMORY bytes, or the limit
+** set with cypherSpillLimit(), they are moved to a temporary table whose
+** primary key is the encoded key, and from then on a row is new if
+** inserting its key into that index succeeds.
+*/
+
+#ifndef CYPHER_DISTINCT_MEMORY
+# define CYPHER_DISTINCT_MEMORY (32*1024*1024)
+#endif
+
+typedef struct DistinctKey {
+  unsigned int h;               /* Hash of aValue */
+  int nValue;
+  CypherValue *aValue;          /* Key values, allocated with this */
+} DistinctKey;
+
+typedef struct DistinctData {
+  CypherIterator *pSource;      /* Input rows */
+  CypherPropertyReader props;   /* Reads n.prop keys */
+  DistinctKey **apKey;          /* Keys seen, while in memory */
+  int nKey;
+  int nKeyAlloc;
+  int *aSlot;                   /* Open-addressing table of apKey indexes */
+  int nSlot;                    /* Size of aSlot, a power of two */
+  sqlite3_int64 nBytes;         /* Approximate size of the keys */
+  sqlite3_int64 nMemory;        /* Spill once nBytes exceeds this */
+  char *zSpill;                 /* Temporary table, NULL while in memory */
+  sqlite3_stmt *pInsert;        /* Adds a key to the table if it is new */
+} DistinctData;
+
+static void distinctKeyFree(DistinctKey *p) {
+  int i;
+  if( !p ) return;
+  for( i = 0; i < p->nValue; i++ ) cypherValueDestroy(&p->aValue[i]);
+  sqlite3_free(p);
+}
+
+/*
+** Read the key of pRow into a new DistinctKey.
+*/
+static int distinctKeyRead(CypherIterator *pIterator, CypherResult *pRow,
+                           DistinctKey **ppKey) {
+  DistinctData *pData = (DistinctData*)pIterator->pIterData;
+  PhysicalPlanNode *pPlan = pIterator->pPlan;
+  int nValue = pPlan->nColumn > 0 ? pPlan->nColumn : pRow->nColumns;
+  sqlite3_uint64 h = ITERATOR_HASH_INIT;
+  DistinctKey *p;
+  int rc = SQLITE_OK;
+  int i;
+  
+  *ppKey = NULL;
+  p = sqlite3_malloc((int)(sizeof(DistinctKey) + nValue * sizeof(CypherValue)));
+  if( !p ) return SQLITE_NOMEM;
+  p->nValue = nValue;
+  p->aValue = (CypherValue*)&p[1];
+  for( i = 0; i < nValue; i++ ) cypherValueInit(&p->aValue[i]);
+  
+  for( i = 0; rc == SQLITE_OK && i < nValue; i++ ) {
+    PlanColumn *pCol = pPlan->nColumn > 0 ? &pPlan->aColumn[i] : NULL;
+    CypherValue *pValue = pCol ? iteratorColumn(pRow, pCol->zName) : &pRow->aValues[i];
+    
+    if( pValue ) {
+      CypherValue *pCopy = cypherValueCopy(pValue);
+      if( !pCopy ) {
+        rc = SQLITE_NOMEM;
+        break;
+      }
+      p->aValue[i] = *pCopy;
+      sqlite3_free(pCopy);
+    } else {
+      rc = propertyReaderValue(&pData->props, pRow, pCol->zVariable, pCol->zProperty,
+                               &p->aValue[i]);
+    }
+    h = iteratorHashValue(h, &p->aValue[i]);
+  }
+  if( rc != SQLITE_OK ) {
+    distinctKeyFree(p);
+    return rc;
+  }
+  p->h = iteratorHashFinish(h);
+  *ppKey = p;
+  return SQLITE_OK;
+}
+
+/*
+** Add pKey to the spill table. Set *pbNew if it was not there already.
+*/
+static int distinctSpillKey(CypherIterator *pIterator, DistinctKey *pKey, int *pbNew) {
+  DistinctData *pData = (DistinctData*)pIterator->pIterData;
+  CypherResult row;
+  unsigned char *aBlob;
+  int nBlob, rc, i;
+  
+  memset(&row, 0, sizeof(row));
+  row.azColumnNames = sqlite3_malloc(pKey->nValue * sizeof(char*) + 1);
+  if( !row.azColumnNames ) return SQLITE_NOMEM;
+  for( i = 0; i < pKey->nValue; i++ ) row.azColumnNames[i] = "";
+  row.aValues = pKey->aValue;
+  row.nColumns = row.nColumnsAlloc = pKey->nValue;
+  rc = cypherResultEncode(&row, &aBlob, &nBlob);
+  sqlite3_free(row.azColumnNames);
+  if( rc != SQLITE_OK ) return rc;
+  
+  sqlite3_bind_blob(pData->pInsert, 1, aBlob, nBlob, sqlite3_free);
+  rc = sqlite3_step(pData->pInsert);
+  sqlite3_reset(pData->pInsert);
+  if( rc != SQLITE_DONE ) return rc;
+  *pbNew = sqlite3_changes(pIterator->pContext->pGraph->pDb) > 0;
+  return SQLITE_OK;
+}
+
+/*
+** Move the keys held in memory to a new spill table.
+*/
+static int distinctSpill(CypherIterator *pIterator) {
+  DistinctData *pData = (DistinctData*)pIterator->pIterData;
+  sqlite3 *db = pIterator->pContext->pGraph->pDb;
+  char *zSql;
+  int rc, bNew, i;
+  
+  pData->zSpill = sqlite3_mprintf("cypher_distinct_%p", (void*)pIterator);
+  if( !pData->zSpill ) return SQLITE_NOMEM;
+  zSql = sqlite3_mprintf("CREATE TEMP TABLE \"%w\"(k BLOB PRIMARY KEY) WITHOUT ROWID",
+                         pData->zSpill);
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_exec(db, zSql, 0, 0, 0);
+  sqlite3_free(zSql);
+  if( rc != SQLITE_OK ) {
+    sqlite3_free(pData->zSpill);
+    pData->zSpill = NULL;
+    return rc;
+  }
+  zSql = sqlite3_mprintf("INSERT OR IGNORE INTO temp.\"%w\"(k) VALUES(?1)", pData->zSpill);
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_prepare_v2(db, zSql, -1, &pData->pInsert, 0);
+  sqlite3_free(zSql);
+  
+  for( i = 0; rc == SQLITE_OK && i < pData->nKey; i++ ) {
+    rc = distinctSpillKey(pIterator, pData->apKey[i], &bNew);
+  }
+  for( i = 0; i < pData->nKey; i++ ) distinctKeyFree(pData->apKey[i]);
+  sqlite3_free(pData->apKey);
+  sqlite3_free(pData->aSlot);
+  pData->apKey = NULL;
+  pData->aSlot = NULL;
+  pData->nKey = pData->nKeyAlloc = pData->nSlot = 0;
+  pData->nBytes = 0;
+  return rc;
+}
+
+/*
+** Return the index in apKey of a key equal to pKey, or -1.
+*/
+static int distinctFind(DistinctData *pData, DistinctKey *pKey) {
+  int iSlot, i, j;
+  
+  if( pData->nSlot == 0 ) return -1;
+  iSlot = (int)(pKey->h & (unsigned int)(pData->nSlot - 1));
+  while( (i = pData->aSlot[iSlot]) >= 0 ) {
+    DistinctKey *p = pData->apKey[i];
+    if( p->h == pKey->h && p->nValue == pKey->nValue ) {
+      for( j = 0; j < p->nValue; j++ ) {
+        if( !iteratorValuesEqual(&p->aValue[j], &pKey->aValue[j]) ) break;
+      }
+      if( j == p->nValue ) return i;
+    }
+    iSlot = (iSlot + 1) & (pData->nSlot - 1);
+  }
+  return -1;
+}
+
+/*
+** Remember pKey, which is new, taking ownership of it.
+*/
+static int distinctKeep(CypherIterator *pIterator, DistinctKey *pKey) {
+  DistinctData *pData = (DistinctData*)pIterator->pIterData;
+  int iSlot, i;
+  
+  if( pData->nKey >= pData->nKeyAlloc ) {
+    int nNew = pData->nKeyAlloc ? pData->nKeyAlloc * 2 : 64;
+    DistinctKey **apNew = sqlite3_realloc(pData->apKey, nNew * sizeof(DistinctKey*));
+    if( !apNew ) {
+      distinctKeyFree(pKey);
+      return SQLITE_NOMEM;
+    }
+    pData->apKey = apNew;
+    pData->nKeyAlloc = nNew;
+  }
+  pData->apKey[pData->nKey++] = pKey;
+  
+  /* Keep the table at most half full */
+  if( pData->nKey * 2 > pData->nSlot ) {
+    int nSlot = pData->nSlot ? pData->nSlot * 2 : 128;
+    int *aSlot = sqlite3_malloc(nSlot * sizeof(int));
+    if( !aSlot ) return SQLITE_NOMEM;
+    memset(aSlot, 0xff, nSlot * sizeof(int));
+    for( i = 0; i < pData->nKey; i++ ) {
+      iSlot = (int)(pData->apKey[i]->h & (unsigned int)(nSlot - 1));
+      while( aSlot[iSlot] >= 0 ) iSlot = (iSlot + 1) & (nSlot - 1);
+      aSlot[iSlot] = i;
+    }
+    sqlite3_free(pData->aSlot);
+    pData->aSlot = aSlot;
+    pData->nSlot = nSlot;
+  } else {
+    iSlot = (int)(pKey->h & (unsigned int)(pData->nSlot - 1));
+    while( pData->aSlot[iSlot] >= 0 ) iSlot = (iSlot + 1) & (pData->nSlot - 1);
+    pData->aSlot[iSlot] = pData->nKey - 1;
+  }
+  
+  pData->nBytes += sizeof(DistinctKey) + sizeof(DistinctKey*) + 2 * sizeof(int);
+  for( i = 0; i < pKey->nValue; i++ ) {
+    pData->nBytes += sizeof(CypherValue) + iteratorValueBytes(&pKey->aValue[i]);
+  }
+  return pData->nBytes > pData->nMemory ? distinctSpill(pIterator) : SQLITE_OK;
+}
+
+static int distinctOpen(CypherIterator *pIterator) {
+  DistinctData *pData = (DistinctData*)pIterator->pIterData;
+  int rc;
+  
+  rc = pData->pSource->xOpen(pData->pSource);
+  if( rc != SQLITE_OK ) return rc;
+  pIterator->bOpened = 1;
+  pIterator->bEof = 0;
+  pData->nMemory = iteratorSpillBudget(CYPHER_DISTINCT_MEMORY);
+  return SQLITE_OK;
+}
+
+static int distinctNext(CypherIterator *pIterator, CypherResult *pResult) {
+  DistinctData *pData = (DistinctData*)pIterator->pIterData;
+  PhysicalPlanNode *pPlan = pIterator->pPlan;
+  int rc = SQLITE_OK;
+  int i;
+  
+  if( pIterator->bEof ) return SQLITE_DONE;
+  
+  while( 1 ) {
+    CypherResult *pRow = cypherResultCreate();
+    DistinctKey *pKey = NULL;
+    int bNew = 0;
+    
+    if( !pRow ) return SQLITE_NOMEM;
+    rc = pData->pSource->xNext(pData->pSource, pRow);
+    if( rc == SQLITE_OK ) rc = distinctKeyRead(pIterator, pRow, &pKey);
+    if( rc == SQLITE_OK ) {
+      if( pData->zSpill ) {
+        rc = distinctSpillKey(pIterator, pKey, &bNew);
+      } else {
+        bNew = distinctFind(pData, pKey) < 0;
+      }
+    }
+    
+    /* Produce the first row with each key */
+    for( i = 0; rc == SQLITE_OK && bNew && i < pKey->nValue; i++ ) {
+      if( pPlan->nColumn > 0 ) {
+        rc = cypherResultAddColumn(pResult, pPlan->aColumn[i].zName, &pKey->aValue[i]);
+      } else {
+        rc = cypherResultAddColumn(pResult, pRow->azColumnNames[i], &pRow->aValues[i]);
+      }
+    }
+    cypherResultDestroy(pRow);
+    if( rc == SQLITE_OK && bNew && !pData->zSpill ) {
+      rc = distinctKeep(pIterator, pKey);
+    } else {
+      distinctKeyFree(pKey);
+    }
+    
+    if( rc == SQLITE_DONE ) pIterator->bEof = 1;
+    if( rc != SQLITE_OK ) return rc;
+    if( bNew ) break;
+  }
+  
+  pIterator->nRowsProduced++;
+  
+  return SQLITE_OK;
+}
+
+static int distinctClose(CypherIterator *pIterator) {
+  DistinctData *pData = (DistinctData*)pIterator->pIterData;
+  int i;
+  
+  if( pData->pSource->bOpened ) pData->pSource->xClose(pData->pSource);
+  for( i = 0; i < pData->nKey; i++ ) distinctKeyFree(pData->apKey[i]);
+  sqlite3_free(pData->apKey);
+  sqlite3_free(pData->aSlot);
+  pData->apKey = NULL;
+  pData->aSlot = NULL;
+  pData->nKey = pData->nKeyAlloc = pData->nSlot = 0;
+  pData->nBytes = 0;
+  sqlite3_finalize(pData->pInsert);
+  pData->pInsert = NULL;
+  if( pData->zSpill ) {
+    char *zSql = sqlite3_mprintf("DROP TABLE IF EXISTS temp.\"%w\"", pData->zSpill);
+    if( zSql ) sqlite3_exec(pIterator->pContext->pGraph->pDb, zSql, 0, 0, 0);
+    sqlite3_free(zSql);
+    sqlite3_free(pData->zSpill);
+    pData->zSpill = NULL;
+  }
+  cypherPropertyReaderClose(&pData->props);
+  pIterator->bOpened = 0;
+  return SQLITE_OK;
+}
+
+static void distinctDestroy(CypherIterator *pIterator) {
+  DistinctData *pData = (DistinctData*)pIterator->pIterData;
+  if( pData ) {
+    cypherIteratorDestroy(pData->pSource);
+    sqlite3_free(pData);
+  }
+}
+
+CypherIterator *cypherDistinctCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext) {
+  CypherIterator *pIterator;
+  DistinctData *pData;
+  
+  if( !pPlan || !pPlan->pChild ) return NULL;
+  
+  pIterator = sqlite3_malloc(sizeof(CypherIterator));
+  if( !pIterator ) return NULL;
+  
+  pData = sqlite3_malloc(sizeof(DistinctData));
+  if( !pData ) {
+    sqlite3_free(pIterator);
+    return NULL;
+  }
+  
+  memset(pIterator, 0, sizeof(CypherIterator));
+  memset(pData, 0, sizeof(DistinctData));
+  pIterator->pIterData = pData;
+  pIterator->xDestroy = distinctDestroy;
+  
+  pData->pSource = cypherIteratorCreate(pPlan->pChild, pContext);
+  if( !pData->pSource ) {
+    cypherIteratorDestroy(pIterator);
+    return NULL;
+  }
+  pData->props.pGraph = pContext->pGraph;
+  
+  /* Set up iterator */
+  pIterator->xOpen = distinctOpen;
+  pIterator->xNext = distinctNext;
+  pIterator->xClose = distinctClose;
+  pIterator->pContext = pContext;
+  pIterator->pPlan = pPlan;
+  
+  return pIterator;
+}
+
+/*
+** Union iterator implementation.
+** Produces all rows of its first child, then of its second, and so on.
+** Only the child being read is open.
+*/
+
+typedef struct UnionData {
+  CypherIterator **apSource;    /* One iterator per child */
+  int nSource;
+  int iSource;                  /* Child being read */
+} UnionData;
+
+static int unionOpen(CypherIterator *pIterator) {
+  UnionData *pData = (UnionData*)pIterator->pIterData;
+  int rc = SQLITE_OK;
+  
+  pData->iSource = 0;
+  if( pData->nSource > 0 ) rc = pData->apSource[0]->xOpen(pData->apSource[0]);
+  if( rc != SQLITE_OK ) return rc;
+  pIterator->bOpened = 1;
+  pIterator->bEof = 0;
+  return SQLITE_OK;
+}
+
+static int unionNext(CypherIterator *pIterator, CypherResult *pResult) {
+  UnionData *pData = (UnionData*)pIterator->pIterData;
+  int rc;
+  
+  if( pIterator->bEof ) return SQLITE_DONE;
+  
+  while( pData->iSource < pData->nSource ) {
+    CypherIterator *pSource = pData->apSource[pData->iSource];
+    rc = pSource->xNext(pSource, pResult);
+    if( rc == SQLITE_OK ) {
+      pIterator->nRowsProduced++;
+      return SQLITE_OK;
+    }
+    if( rc != SQLITE_DONE ) return rc;
+    
+    /* Move on to the next child */
+    pSource->xClose(pSource);
+    if( ++pData->iSource < pData->nSource ) {
+      pSource = pData->apSource[pData->iSource];
+      rc = pSource->xOpen(pSource);
+      if( rc != SQLITE_OK ) return rc;
+    }
+  }
+  pIterator->bEof = 1;
+  return SQLITE_DONE;
+}
+
+static int unionClose(CypherIterator *pIterator) {
+  UnionData *pData = (UnionData*)pIterator->pIterData;
+  int i;
+  
+  for( i = 0; i < pData->nSource; i++ ) {
+    if( pData->apSource[i]->bOpened ) pData->apSource[i]->xClose(pData->apSource[i]);
+  }
+  pIterator->bOpened = 0;
+  return SQLITE_OK;
+}
+
+static void unionDestroy(CypherIterator *pIterator) {
+  UnionData *pData = (UnionData*)pIterator->pIterData;
+  int i;
+  if( pData ) {
+    for( i = 0; i < pData->nSource; i++ ) cypherIteratorDestroy(pData->apSource[i]);
+    sqlite3_free(pData->apSource);
+    sqlite3_free(pData);
+  }
+}
+
+CypherIterator *cypherUnionCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext) {
+  CypherIterator *pIterator;
+  UnionData *pData;
+  int i;
+  
+  if( !pPlan || pPlan->nChildren < 1 ) return NULL;
+  
+  pIterator = sqlite3_malloc(sizeof(CypherIterator));
+  if( !pIterator ) return NULL;
+  
+  pData = sqlite3_malloc(sizeof(UnionData));
+  if( !pData ) {
+    sqlite3_free(pIterator);
+    return NULL;
+  }
+  
+  memset(pIterator, 0, sizeof(CypherIterator));
+  memset(pData, 0, sizeof(UnionData));
+  pIterator->pIterData = pData;
+  pIterator->xDestroy = unionDestroy;
+  
+  pData->apSource = sqlite3_malloc(pPlan->nChildren * sizeof(CypherIterator*));
+  if( !pData->apSource ) {
+    cypherIteratorDestroy(pIterator);
+    return NULL;
+  }
+  for( i = 0; i < pPlan->nChildren; i++ ) {
+    pData->apSource[i] = cypherIteratorCreate(pPlan->apChildren[i], pContext);
+    if( !pData->apSource[i] ) {
+      cypherIteratorDestroy(pIterator);
+      return NULL;
+    }
+    pData->nSource++;
+  }
+  
+  /* Set up iterator */
+  pIterator->xOpen = unionOpen;
+  pIterator->xNext = unionNext;
+  pIterator->xClose = unionClose;
+  pIterator->pContext = pContext;
+  pIterator->pPlan = pPlan;
+  
+  return pIterator;
+}
+
+/*
+** Stub implementations for other iterators.
+** These will be implemented as needed.
+*/
+
+/*
+** Bind the columns of row iRow of a batch as variables, for expression
+** evaluation. Each column's context slot is resolved on first use, so
+** per-row binding involves no name comparisons.
+*/
+static int batchBindRow(ExecutionContext *pContext, CypherBatch *pBatch, int iRow) {
+  CypherValue value;
+  int i;
+  int rc = SQLITE_OK;
+  
+  for( i = 0; rc == SQLITE_OK && i < pBatch->nCol; i++ ) {
+    CypherVector *pVec = &pBatch->aCol[i];
+    if( pVec->iSlot < 0 ) {
+      pVec->iSlot = executionContextSlot(pContext, pVec->zName);
+      if( pVec->iSlot < 0 ) return SQLITE_NOMEM;
+    }
+    cypherBatchValue(pBatch, i, iRow, &value);
+    rc = executionContextBindSlot(pContext, pVec->iSlot, &value);
+  }
+  return rc;
+}
+
+/*
+** Bind the columns of a single result row as variables. The row-at-a-time
+** path binds by name; the batch path above caches slots per column.
+*/
+static int resultBindRow(ExecutionContext *pContext, CypherResult *pResult) {
+  int i;
+  int rc = SQLITE_OK;
+  
+  for( i = 0; rc == SQLITE_OK && i < pResult->nColumns; i++ ) {
+    rc = executionContextBind(pContext, pResult->azColumnNames[i], &pResult->aValues[i]);
+  }
+  return rc;
+}
+
+/* Filter iterator implementation */
+typedef struct FilterIteratorData {
+  CypherIterator *pSource;     /* Source iterator */
+  CypherExpression *pFilter;   /* Filter expression */
+  CypherProgram *pProgram;     /* pFilter compiled, or NULL */
+  int aSel[CYPHER_BATCH_SIZE]; /* Batch rows that pass the filter */
+} FilterIteratorData;
+
+/*
+** Evaluate the filter against the current bindings. *pbPass is set if
+** the result is truthy: not NULL, and true if boolean.
+*/
+static int filterIteratorTest(CypherIterator *pIterator, int *pbPass) {
+  FilterIteratorData *pData = (FilterIteratorData*)pIterator->pIterData;
+  const CypherValue *pValue;
+  CypherValue value;
+  int rc;
+  
+  if( pData->pProgram ) {
+    rc = cypherProgramExecute(pData->pProgram, pIterator->pContext, &pValue);
+    if( rc != SQLITE_OK ) return rc;
+    *pbPass = !cypherValueIsNull(pValue) &&
+              (pValue->type != CYPHER_VALUE_BOOLEAN || pValue->u.bBoolean);
+    return SQLITE_OK;
+  }
+  
+  rc = cypherExpressionEvaluate(pData->pFilter, pIterator->pContext, &value);
+  if( rc != SQLITE_OK ) return rc;
+  *pbPass = !cypherValueIsNull(&value) &&
+            (value.type != CYPHER_VALUE_BOOLEAN || value.u.bBoolean);
+  cypherValueDestroy(&value);
+  return SQLITE_OK;
+}
+
+static int filterIteratorOpen(CypherIterator *pIterator) {
+  FilterIteratorData *pData = (FilterIteratorData*)pIterator->pIterData;
+  int rc = pData->pSource->xOpen(pData->pSource);
+  if( rc == SQLITE_OK ) pIterator->bOpened = 1;
+  return rc;
+}
+
+static int filterIteratorNext(CypherIterator *pIterator, CypherResult *pResult) {
+  FilterIteratorData *pData = (FilterIteratorData*)pIterator->pIterData;
+  int nKeep = pResult->nColumns;
+  int bPass = 0;
+  int rc;
+  
+  /* Keep fetching from source until we find a matching row. Each is read
+  ** straight into pResult, and a rejected row is truncated away again */
+  while( 1 ) {
+    rc = pData->pSource->xNext(pData->pSource, pResult);
+    if( rc == SQLITE_OK ) rc = resultBindRow(pIterator->pContext, pResult);
+    if( rc == SQLITE_OK ) rc = filterIteratorTest(pIterator, &bPass);
+    if( rc != SQLITE_OK || bPass ) break;
+    cypherResultTruncate(pResult, nKeep);
+  }
+  if( rc != SQLITE_OK ) cypherResultTruncate(pResult, nKeep);
+  return rc;
+}
+
+/*
+** Evaluate the filter over each row of a source batch, collecting the
+** passing rows in a selection vector, then compact the batch to them.
+** Batches that lose every row are skipped.
+*/
+static int filterIteratorNextBatch(CypherIterator *pIterator, CypherBatch *pBatch) {
+  FilterIteratorData *pData = (FilterIteratorData*)pIterator->pIterData;
+  int nSel, i, bPass;
+  int rc;
+  
+  do {
+    rc = cypherIteratorNextBatch(pData->pSource, pBatch);
+    if( rc != SQLITE_OK ) return rc;
+    
+    for( i = 0, nSel = 0; i < pBatch->nRow; i++ ) {
+      rc = batchBindRow(pIterator->pContext, pBatch, i);
+      if( rc == SQLITE_OK ) {
+        rc = filterIteratorTest(pIterator, &bPass);
+      }
+      if( rc != SQLITE_OK ) return rc;
+      if( bPass ) pData->aSel[nSel++] = i;
+    }
+    cypherBatchSelect(pBatch, pData->aSel, nSel);
+  } while( pBatch->nRow == 0 );
+  
+  pIterator->nRowsProduced += pBatch->nRow;
+  return SQLITE_OK;
+}
+
+static int filterIteratorClose(CypherIterator *pIterator) {
+  FilterIteratorData *pData = (FilterIteratorData*)pIterator->pIterData;
+  pIterator->bOpened = 0;
+  return pData->pSource->xClose(pData->pSource);
+}
+
+static void filterIteratorDestroy(CypherIterator *pIterator) {
+  FilterIteratorData *pData = (FilterIteratorData*)pIterator->pIterData;
+  if( pData ) {
+    cypherIteratorDestroy(pData->pSource);
+    cypherProgramDestroy(pData->pProgram);
+    sqlite3_free(pData);
+  }
+}
+
+CypherIterator *cypherFilterCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext) {
+  CypherIterator *pIterator;
+  FilterIteratorData *pData;
+  
+  if (!pPlan || !pPlan->pChild || !pPlan->pFilterExpr) return NULL;
+  
+  pIterator = sqlite3_malloc(sizeof(CypherIterator));
+  if (!pIterator) return NULL;
+  
+  pData = sqlite3_malloc(sizeof(FilterIteratorData));
+  if (!pData) {
+    sqlite3_free(pIterator);
+    return NULL;
+  }
+  
+  memset(pIterator, 0, sizeof(CypherIterator));
+  memset(pData, 0, sizeof(FilterIteratorData));
+  
+  /* Create source iterator */
+  pData->pSource = cypherIteratorCreate(pPlan->pChild, pContext);
+  if (!pData->pSource) {
+    sqlite3_free(pData);
+    sqlite3_free(pIterator);
+    return NULL;
+  }
+  
+  pData->pFilter = pPlan->pFilterExpr;
+  
+  /* Compile the filter once. Should that fail, the tree is evaluated
+  ** instead, with variables resolved to context slots where possible */
+  if( cypherExpressionCompile(pData->pFilter, pContext, &pData->pProgram) != SQLITE_OK ) {
+    cypherExpressionResolve(pData->pFilter, pContext);
+  }
+  
+  /* Set up iterator */
+  pIterator->xOpen = filterIteratorOpen;
+  pIterator->xNext = filterIteratorNext;
+  pIterator->xNextBatch = filterIteratorNextBatch;
+  pIterator->xClose = filterIteratorClose;
+  pIterator->xDestroy = filterIteratorDestroy;
+  pIterator->pContext = pContext;
+  pIterator->pPlan = pPlan;
+  pIterator->pIterData = pData;
   
   return pIterator;
 }
@@ -495,79 +4091,158 @@ CypherIterator *cypherFilterCreate(PhysicalPlanNode *pPlan, ExecutionContext *pC
 typedef struct ProjectionIteratorData {
   CypherIterator *pSource;          /* Source iterator */
   CypherExpression **apProjections; /* Projection expressions */
+  CypherProgram **apPrograms;       /* Compiled projections, entries may be NULL */
   int nProjections;                 /* Number of projections */
+  CypherResult *pRow;               /* Source row for xNext, reused */
+  CypherBatch *pInput;              /* Source batch for xNextBatch */
+  int *aiCol;                       /* Batch column of each projection */
 } ProjectionIteratorData;
 
+/* Evaluate projection i against the current bindings */
+static int projectionIteratorEval(CypherIterator *pIterator, int i, CypherValue *pValue) {
+  ProjectionIteratorData *pData = (ProjectionIteratorData*)pIterator->pIterData;
+  
+  if( pData->apPrograms && pData->apPrograms[i] ) {
+    return cypherProgramEvaluate(pData->apPrograms[i], pIterator->pContext, pValue);
+  }
+  return cypherExpressionEvaluate(pData->apProjections[i], pIterator->pContext, pValue);
+}
+
 static int projectionIteratorOpen(CypherIterator *pIterator) {
   ProjectionIteratorData *pData = (ProjectionIteratorData*)pIterator->pIterData;
-  return pData->pSource->xOpen(pData->pSource);
+  int rc = pData->pSource->xOpen(pData->pSource);
+  if( rc == SQLITE_OK ) pIterator->bOpened = 1;
+  return rc;
+}
+
+/*
+** Name of output column i: the name the planner gave the RETURN item, or
+** col0, col1, ... for a plan built without names.
+*/
+static const char *projectionColumnName(CypherIterator *pIterator, int i,
+                                        char *zBuf, int nBuf) {
+  PhysicalPlanNode *pPlan = pIterator->pPlan;
+  
+  if( i < pPlan->nColumn && pPlan->aColumn[i].zName ) return pPlan->aColumn[i].zName;
+  sqlite3_snprintf(nBuf, zBuf, "col%d", i);
+  return zBuf;
 }
 
 static int projectionIteratorNext(CypherIterator *pIterator, CypherResult *pResult) {
   ProjectionIteratorData *pData = (ProjectionIteratorData*)pIterator->pIterData;
-  CypherResult sourceResult;
+  CypherResult *pSource;
   int rc, i;
   
-  /* Get next row from source */
-  rc = pData->pSource->xNext(pData->pSource, &sourceResult);
+  /* Get next row from source, into the row buffer, and bind its columns */
+  if( !pData->pRow ) {
+    pData->pRow = cypherResultCreate();
+    if( !pData->pRow ) return SQLITE_NOMEM;
+  }
+  pSource = pData->pRow;
+  cypherResultTruncate(pSource, 0);
+  rc = pData->pSource->xNext(pData->pSource, pSource);
+  if (rc == SQLITE_OK) {
+    rc = resultBindRow(pIterator->pContext, pSource);
+  }
   if (rc != SQLITE_OK) return rc;
   
   /* Create new result with projections */
   memset(pResult, 0, sizeof(CypherResult));
   
-  for (i = 0; i < pData->nProjections; i++) {
+  for (i = 0; rc == SQLITE_OK && i < pData->nProjections; i++) {
     CypherValue projValue;
+    char zColName[24];
     
     /* Evaluate projection expression */
-    rc = cypherExpressionEvaluate(pData->apProjections[i], pIterator->pContext, &projValue);
-    if (rc != SQLITE_OK) {
-      cypherResultDestroy(&sourceResult);
-      return rc;
-    }
+    rc = projectionIteratorEval(pIterator, i, &projValue);
+    if (rc != SQLITE_OK) break;
     
     /* Add to result */
-    char *zColName = sqlite3_mprintf("col%d", i);
-    if (!zColName) {
-      cypherValueDestroy(&projValue);
-      cypherResultDestroy(&sourceResult);
-      return SQLITE_NOMEM;
-    }
-    
-    rc = cypherResultAddColumn(pResult, zColName, &projValue);
-    sqlite3_free(zColName);
+    rc = cypherResultAddColumn(pResult, 
+                               projectionColumnName(pIterator, i, zColName, sizeof(zColName)),
+                               &projValue);
     cypherValueDestroy(&projValue);
-    
-    if (rc != SQLITE_OK) {
-      cypherResultDestroy(&sourceResult);
-      return rc;
+  }
+  
+  return rc;
+}
+
+/*
+** Evaluate the projections over a whole source batch into one output
+** vector per RETURN item. Each source row is bound once, and every
+** projection evaluated against it.
+*/
+static int projectionIteratorNextBatch(CypherIterator *pIterator, CypherBatch *pBatch) {
+  ProjectionIteratorData *pData = (ProjectionIteratorData*)pIterator->pIterData;
+  CypherBatch *pInput;
+  CypherValue projValue;
+  int rc, i, j;
+  
+  if( !pData->pInput ) {
+    pData->pInput = cypherBatchCreate();
+    pData->aiCol = sqlite3_malloc(pData->nProjections * sizeof(int));
+    if( !pData->pInput || !pData->aiCol ) return SQLITE_NOMEM;
+  }
+  pInput = pData->pInput;
+  
+  rc = cypherIteratorNextBatch(pData->pSource, pInput);
+  cypherBatchReset(pBatch);
+  if( rc != SQLITE_OK ) return rc;
+  
+  for( i = 0; i < pData->nProjections; i++ ) {
+    char zColName[24];
+    pData->aiCol[i] = cypherBatchAddColumn(pBatch,
+                                           projectionColumnName(pIterator, i, zColName, sizeof(zColName)),
+                                           CYPHER_VALUE_NULL);
+    if( pData->aiCol[i] < 0 ) return SQLITE_NOMEM;
+  }
+  
+  for( j = 0; j < pInput->nRow; j++ ) {
+    rc = batchBindRow(pIterator->pContext, pInput, j);
+    if( rc != SQLITE_OK ) return rc;
+    for( i = 0; i < pData->nProjections; i++ ) {
+      rc = projectionIteratorEval(pIterator, i, &projValue);
+      if( rc != SQLITE_OK ) return rc;
+      rc = cypherBatchSetValue(pBatch, pData->aiCol[i], j, &projValue);
+      cypherValueDestroy(&projValue);
+      if( rc != SQLITE_OK ) return rc;
     }
   }
   
-  cypherResultDestroy(&sourceResult);
+  pBatch->nRow = pInput->nRow;
+  pIterator->nRowsProduced += pBatch->nRow;
   return SQLITE_OK;
 }
 
 static int projectionIteratorClose(CypherIterator *pIterator) {
   ProjectionIteratorData *pData = (ProjectionIteratorData*)pIterator->pIterData;
+  pIterator->bOpened = 0;
   return pData->pSource->xClose(pData->pSource);
 }
 
 static void projectionIteratorDestroy(CypherIterator *pIterator) {
-  if (pIterator) {
-    ProjectionIteratorData *pData = (ProjectionIteratorData*)pIterator->pIterData;
-    if (pData) {
-      if (pData->pSource) {
-        pData->pSource->xDestroy(pData->pSource);
+  ProjectionIteratorData *pData = (ProjectionIteratorData*)pIterator->pIterData;
+  int i;
+  
+  if( pData ) {
+    cypherIteratorDestroy(pData->pSource);
+    if( pData->apPrograms ) {
+      for( i = 0; i < pData->nProjections; i++ ) {
+        cypherProgramDestroy(pData->apPrograms[i]);
       }
-      sqlite3_free(pData);
+      sqlite3_free(pData->apPrograms);
     }
-    sqlite3_free(pIterator);
+    cypherResultDestroy(pData->pRow);
+    cypherBatchDestroy(pData->pInput);
+    sqlite3_free(pData->aiCol);
+    sqlite3_free(pData);
   }
 }
 
 CypherIterator *cypherProjectionCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext) {
   CypherIterator *pIterator;
   ProjectionIteratorData *pData;
+  int i;
   
   if (!pPlan || !pPlan->pChild || !pPlan->apProjections || pPlan->nProjections <= 0) return NULL;
   
@@ -593,10 +4268,23 @@ CypherIterator *cypherProjectionCreate(PhysicalPlanNode *pPlan, ExecutionContext
   
   pData->apProjections = pPlan->apProjections;
   pData->nProjections = pPlan->nProjections;
+  /* Compile each projection once; any that cannot be compiled are
+  ** evaluated as trees */
+  pData->apPrograms = sqlite3_malloc(pData->nProjections * sizeof(CypherProgram*));
+  if( pData->apPrograms ) {
+    memset(pData->apPrograms, 0, pData->nProjections * sizeof(CypherProgram*));
+  }
+  for( i = 0; i < pData->nProjections; i++ ) {
+    if( !pData->apPrograms ||
+        cypherExpressionCompile(pData->apProjections[i], pContext, &pData->apPrograms[i]) != SQLITE_OK ) {
+      cypherExpressionResolve(pData->apProjections[i], pContext);
+    }
+  }
   
   /* Set up iterator */
   pIterator->xOpen = projectionIteratorOpen;
   pIterator->xNext = projectionIteratorNext;
+  pIterator->xNextBatch = projectionIteratorNextBatch;
   pIterator->xClose = projectionIteratorClose;
   pIterator->xDestroy = projectionIteratorDestroy;
   pIterator->pContext = pContext;
@@ -606,146 +4294,547 @@ CypherIterator *cypherProjectionCreate(PhysicalPlanNode *pPlan, ExecutionContext
   return pIterator;
 }
 
-/* Sort iterator implementation */
-typedef struct SortIteratorData {
-  CypherIterator *pSource;     /* Source iterator */
-  CypherResult *aResults;      /* Array of results to sort */
-  int nResults;                /* Number of results */
-  int nAllocated;              /* Allocated size */
-  int iCurrent;                /* Current position */
-  CypherExpression **apSortKeys; /* Sort key expressions */
-  int nSortKeys;               /* Number of sort keys */
-} SortIteratorData;
+/*
+** Sort iterator implementation.
+** Reads its whole input, computing the sort keys of each row once as it
+** arrives, and produces the rows in key order, equal keys in input order.
+** Keys compare as iteratorValueOrder() does with NULL after every other
+** value; a descending key reverses both.
+**
+** With a row limit, set when a LIMIT sits directly above the sort, only
+** that many rows are kept, in a bounded heap whose root is the last row
+** kept so far: ORDER BY x LIMIT k over n rows takes O(n log k) time and
+** holds k rows.
+**
+** Otherwise the rows are held in memory until they outgrow
+** CYPHER_SORT_MEMORY bytes, or the limit set with cypherSpillLimit(),
+** then sorted and written as a run to a temporary table. At the end of
+** the input the runs are merged, holding one row of each.
+*/
+
+#ifndef CYPHER_SORT_MEMORY
+# define CYPHER_SORT_MEMORY (32*1024*1024)
+#endif
+
+typedef struct SortRow {
+  CypherResult *pRow;
+  CypherValue *aKey;            /* Sort keys of pRow */
+  sqlite3_int64 iSeq;           /* Input position, or run while merging */
+} SortRow;
+
+typedef struct SortData {
+  CypherIterator *pSource;      /* Input rows */
+  CypherPropertyReader props;   /* Reads n.prop keys */
+  PlanColumn *aKey;             /* Sort keys, outermost first */
+  int nKey;
+  int nLimit;                   /* Rows kept, 0 for all */
+  
+  /* Rows held in memory: the rows read, the heap of rows kept, or the
+  ** next row of each run while merging */
+  SortRow **apRow;
+  int nRow;
+  int nRowAlloc;
+  sqlite3_int64 nBytes;         /* Approximate size of the rows */
+  sqlite3_int64 nMemory;        /* Spill once nBytes exceeds this */
+  sqlite3_int64 nSeq;           /* Rows read */
+  int iOut;                     /* Next row to produce, when not merging */
+  
+  /* Spilled runs */
+  char *zSpill;                 /* Temporary table, NULL while in memory */
+  sqlite3_stmt *pInsert;        /* Appends a row to a run */
+  sqlite3_stmt **apRun;         /* Reads each run, while merging */
+  int nRun;
+} SortData;
+
+static void sortRowFree(SortData *pData, SortRow *p) {
+  int i;
+  if( !p ) return;
+  if( p->aKey ) {
+    for( i = 0; i < pData->nKey; i++ ) cypherValueDestroy(&p->aKey[i]);
+    sqlite3_free(p->aKey);
+  }
+  cypherResultDestroy(p->pRow);
+  sqlite3_free(p);
+}
+
+/*
+** Return negative, zero or positive as row pA sorts before, with or after
+** row pB.
+*/
+static int sortCompare(SortData *pData, const SortRow *pA, const SortRow *pB) {
+  int i, c;
+  
+  for( i = 0; i < pData->nKey; i++ ) {
+    const CypherValue *pVA = &pA->aKey[i];
+    const CypherValue *pVB = &pB->aKey[i];
+    if( pVA->type == CYPHER_VALUE_NULL || pVB->type == CYPHER_VALUE_NULL ) {
+      c = (pVA->type == CYPHER_VALUE_NULL) - (pVB->type == CYPHER_VALUE_NULL);
+    } else {
+      c = iteratorValueOrder(pVA, pVB);
+    }
+    if( c ) return pData->aKey[i].bDesc ? -c : c;
+  }
+  return pA->iSeq < pB->iSeq ? -1 : pA->iSeq > pB->iSeq;
+}
+
+/*
+** Merge sort the n rows of ap, using aTmp as scratch space.
+*/
+static void sortRows(SortData *pData, SortRow **ap, SortRow **aTmp, int n) {
+  int nLeft = n / 2;
+  int i = 0, j = nLeft, k = 0;
+  
+  if( n < 2 ) return;
+  sortRows(pData, ap, aTmp, nLeft);
+  sortRows(pData, &ap[nLeft], aTmp, n - nLeft);
+  while( i < nLeft && j < n ) {
+    aTmp[k++] = sortCompare(pData, ap[j], ap[i]) < 0 ? ap[j++] : ap[i++];
+  }
+  while( i < nLeft ) aTmp[k++] = ap[i++];
+  memcpy(ap, aTmp, k * sizeof(SortRow*));
+}
+
+/*
+** Sort the rows held in memory.
+*/
+static int sortInMemory(SortData *pData) {
+  SortRow **aTmp;
+  
+  if( pData->nRow < 2 ) return SQLITE_OK;
+  aTmp = sqlite3_malloc(pData->nRow * sizeof(SortRow*));
+  if( !aTmp ) return SQLITE_NOMEM;
+  sortRows(pData, pData->apRow, aTmp, pData->nRow);
+  sqlite3_free(aTmp);
+  return SQLITE_OK;
+}
+
+/*
+** Restore the heap order of the n rows of apRow below slot i, given that
+** it holds everywhere else. With iSign 1 the root sorts last (the rows
+** kept under a limit), with -1 first (the runs being merged).
+*/
+static void sortSiftDown(SortData *pData, int n, int i, int iSign) {
+  SortRow **ap = pData->apRow;
+  
+  while( 2 * i + 1 < n ) {
+    int iChild = 2 * i + 1;
+    SortRow *p;
+    if( iChild + 1 < n && iSign * sortCompare(pData, ap[iChild + 1], ap[iChild]) > 0 ) {
+      iChild++;
+    }
+    if( iSign * sortCompare(pData, ap[iChild], ap[i]) <= 0 ) break;
+    p = ap[i];
+    ap[i] = ap[iChild];
+    ap[iChild] = p;
+    i = iChild;
+  }
+}
+
+static void sortHeapify(SortData *pData, int iSign) {
+  int i;
+  for( i = pData->nRow / 2 - 1; i >= 0; i-- ) sortSiftDown(pData, pData->nRow, i, iSign);
+}
+
+/*
+** Approximate number of bytes held by p.
+*/
+static sqlite3_int64 sortRowBytes(SortData *pData, const SortRow *p) {
+  sqlite3_int64 n = sizeof(SortRow) + sizeof(SortRow*) + iteratorRowBytes(p->pRow);
+  int i;
+  for( i = 0; i < pData->nKey; i++ ) {
+    n += sizeof(CypherValue) + iteratorValueBytes(&p->aKey[i]);
+  }
+  return n;
+}
+
+/*
+** Write the rows held in memory, in order, to a new run of the spill
+** table and free them. A row is stored with its keys as extra columns,
+** named after the keys.
+*/
+static int sortSpillRun(CypherIterator *pIterator) {
+  SortData *pData = (SortData*)pIterator->pIterData;
+  int rc, i, j;
+  
+  if( !pData->zSpill ) {
+    sqlite3 *db = pIterator->pContext->pGraph->pDb;
+    char *zSql;
+    
+    pData->zSpill = sqlite3_mprintf("cypher_sort_%p", (void*)pIterator);
+    if( !pData->zSpill ) return SQLITE_NOMEM;
+    zSql = sqlite3_mprintf("CREATE TEMP TABLE \"%w\"(run INTEGER, row BLOB);"
+                           "CREATE INDEX temp.\"%w_run\" ON \"%w\"(run);",
+                           pData->zSpill, pData->zSpill, pData->zSpill);
+    if( !zSql ) return SQLITE_NOMEM;
+    rc = sqlite3_exec(db, zSql, 0, 0, 0);
+    sqlite3_free(zSql);
+    if( rc != SQLITE_OK ) {
+      sqlite3_free(pData->zSpill);
+      pData->zSpill = NULL;
+      return rc;
+    }
+    zSql = sqlite3_mprintf("INSERT INTO temp.\"%w\"(run, row) VALUES(?1, ?2)", pData->zSpill);
+    if( !zSql ) return SQLITE_NOMEM;
+    rc = sqlite3_prepare_v2(db, zSql, -1, &pData->pInsert, 0);
+    sqlite3_free(zSql);
+    if( rc != SQLITE_OK ) return rc;
+  }
+  
+  rc = sortInMemory(pData);
+  for( i = 0; rc == SQLITE_OK && i < pData->nRow; i++ ) {
+    SortRow *p = pData->apRow[i];
+    int nCol = p->pRow->nColumns + pData->nKey;
+    CypherResult row;
+    unsigned char *aBlob;
+    int nBlob;
+    
+    memset(&row, 0, sizeof(row));
+    row.azColumnNames = sqlite3_malloc(nCol * sizeof(char*));
+    row.aValues = sqlite3_malloc(nCol * sizeof(CypherValue));
+    if( !row.azColumnNames || !row.aValues ) {
+      rc = SQLITE_NOMEM;
+    } else {
+      for( j = 0; j < p->pRow->nColumns; j++ ) {
+        row.azColumnNames[j] = p->pRow->azColumnNames[j];
+        row.aValues[j] = p->pRow->aValues[j];
+      }
+      for( j = 0; j < pData->nKey; j++ ) {
+        row.azColumnNames[p->pRow->nColumns + j] = pData->aKey[j].zName;
+        row.aValues[p->pRow->nColumns + j] = p->aKey[j];
+      }
+      row.nColumns = row.nColumnsAlloc = nCol;
+      rc = cypherResultEncode(&row, &aBlob, &nBlob);
+    }
+    sqlite3_free(row.azColumnNames);
+    sqlite3_free(row.aValues);
+    if( rc != SQLITE_OK ) break;
+    
+    sqlite3_bind_int(pData->pInsert, 1, pData->nRun);
+    sqlite3_bind_blob(pData->pInsert, 2, aBlob, nBlob, sqlite3_free);
+    rc = sqlite3_step(pData->pInsert);
+    sqlite3_reset(pData->pInsert);
+    if( rc == SQLITE_DONE ) rc = SQLITE_OK;
+  }
+  
+  for( i = 0; i < pData->nRow; i++ ) sortRowFree(pData, pData->apRow[i]);
+  pData->nRow = 0;
+  pData->nBytes = 0;
+  pData->nRun++;
+  return rc;
+}
+
+/*
+** Read the next row of run iRun into *ppRow, or set it to NULL if the run
+** is exhausted.
+*/
+static int sortReadRun(SortData *pData, int iRun, SortRow **ppRow) {
+  sqlite3_stmt *pStmt = pData->apRun[iRun];
+  SortRow *p;
+  int rc, i;
+  
+  *ppRow = NULL;
+  rc = sqlite3_step(pStmt);
+  if( rc != SQLITE_ROW ) return rc == SQLITE_DONE ? SQLITE_OK : rc;
+  
+  p = sqlite3_malloc(sizeof(SortRow));
+  if( !p ) return SQLITE_NOMEM;
+  memset(p, 0, sizeof(SortRow));
+  p->iSeq = iRun;
+  p->pRow = cypherResultCreate();
+  p->aKey = sqlite3_malloc(pData->nKey * sizeof(CypherValue) + 1);
+  if( !p->pRow || !p->aKey ) {
+    sqlite3_free(p->aKey);
+    p->aKey = NULL;
+    sortRowFree(pData, p);
+    return SQLITE_NOMEM;
+  }
+  rc = cypherResultDecode(sqlite3_column_blob(pStmt, 0), sqlite3_column_bytes(pStmt, 0),
+                          p->pRow);
+  if( rc == SQLITE_OK && p->pRow->nColumns < pData->nKey ) rc = SQLITE_CORRUPT;
+  if( rc != SQLITE_OK ) {
+    sqlite3_free(p->aKey);
+    p->aKey = NULL;
+    sortRowFree(pData, p);
+    return rc;
+  }
+  
+  /* The keys are the last columns */
+  p->pRow->nColumns -= pData->nKey;
+  for( i = 0; i < pData->nKey; i++ ) {
+    sqlite3_free(p->pRow->azColumnNames[p->pRow->nColumns + i]);
+    p->aKey[i] = p->pRow->aValues[p->pRow->nColumns + i];
+  }
+  *ppRow = p;
+  return SQLITE_OK;
+}
+
+/*
+** Spill the rows still in memory as the last run, then start merging the
+** runs: apRow becomes a heap of the next row of each run.
+*/
+static int sortMergeStart(CypherIterator *pIterator) {
+  SortData *pData = (SortData*)pIterator->pIterData;
+  sqlite3 *db = pIterator->pContext->pGraph->pDb;
+  char *zSql;
+  int rc = SQLITE_OK;
+  int i;
+  
+  if( pData->nRow > 0 ) rc = sortSpillRun(pIterator);
+  if( rc != SQLITE_OK ) return rc;
+  
+  pData->apRun = sqlite3_malloc(pData->nRun * sizeof(sqlite3_stmt*));
+  if( !pData->apRun ) return SQLITE_NOMEM;
+  memset(pData->apRun, 0, pData->nRun * sizeof(sqlite3_stmt*));
+  if( pData->nRowAlloc < pData->nRun ) {
+    SortRow **apNew = sqlite3_realloc(pData->apRow, pData->nRun * sizeof(SortRow*));
+    if( !apNew ) return SQLITE_NOMEM;
+    pData->apRow = apNew;
+    pData->nRowAlloc = pData->nRun;
+  }
+  
+  zSql = sqlite3_mprintf("SELECT row FROM temp.\"%w\" WHERE run = ?1 ORDER BY rowid",
+                         pData->zSpill);
+  if( !zSql ) return SQLITE_NOMEM;
+  for( i = 0; rc == SQLITE_OK && i < pData->nRun; i++ ) {
+    SortRow *p;
+    rc = sqlite3_prepare_v2(db, zSql, -1, &pData->apRun[i], 0);
+    if( rc != SQLITE_OK ) break;
+    sqlite3_bind_int(pData->apRun[i], 1, i);
+    rc = sortReadRun(pData, i, &p);
+    if( p ) pData->apRow[pData->nRow++] = p;
+  }
+  sqlite3_free(zSql);
+  if( rc != SQLITE_OK ) return rc;
+  
+  sortHeapify(pData, -1);
+  return SQLITE_OK;
+}
+
+/*
+** Take ownership of pRow, one row of the input.
+*/
+static int sortAddRow(CypherIterator *pIterator, CypherResult *pRow) {
+  SortData *pData = (SortData*)pIterator->pIterData;
+  SortRow *p;
+  int rc = SQLITE_OK;
+  int i;
+  
+  p = sqlite3_malloc(sizeof(SortRow));
+  if( !p ) {
+    cypherResultDestroy(pRow);
+    return SQLITE_NOMEM;
+  }
+  p->pRow = pRow;
+  p->iSeq = pData->nSeq++;
+  p->aKey = sqlite3_malloc(pData->nKey * sizeof(CypherValue) + 1);
+  if( !p->aKey ) {
+    sortRowFree(pData, p);
+    return SQLITE_NOMEM;
+  }
+  for( i = 0; i < pData->nKey; i++ ) cypherValueInit(&p->aKey[i]);
+  for( i = 0; rc == SQLITE_OK && i < pData->nKey; i++ ) {
+    PlanColumn *pKey = &pData->aKey[i];
+    CypherValue *pCol = iteratorColumn(pRow, pKey->zName);
+    
+    /* A key that was projected or aggregated is a column of the row */
+    if( pCol ) {
+      CypherValue *pCopy = cypherValueCopy(pCol);
+      if( !pCopy ) {
+        rc = SQLITE_NOMEM;
+        break;
+      }
+      p->aKey[i] = *pCopy;
+      sqlite3_free(pCopy);
+    } else {
+      rc = propertyReaderValue(&pData->props, pRow, pKey->zVariable, pKey->zProperty,
+                               &p->aKey[i]);
+    }
+  }
+  if( rc != SQLITE_OK ) {
+    sortRowFree(pData, p);
+    return rc;
+  }
+  
+  /* Under a limit, a full heap only admits rows before its root */
+  if( pData->nLimit > 0 && pData->nRow == pData->nLimit ) {
+    if( sortCompare(pData, p, pData->apRow[0]) < 0 ) {
+      sortRowFree(pData, pData->apRow[0]);
+      pData->apRow[0] = p;
+      sortSiftDown(pData, pData->nRow, 0, 1);
+    } else {
+      sortRowFree(pData, p);
+    }
+    return SQLITE_OK;
+  }
+  
+  if( pData->nRow >= pData->nRowAlloc ) {
+    int nNew = pData->nRowAlloc ? pData->nRowAlloc * 2 : 64;
+    SortRow **apNew;
+    if( pData->nLimit > 0 && nNew > pData->nLimit ) nNew = pData->nLimit;
+    apNew = sqlite3_realloc(pData->apRow, nNew * sizeof(SortRow*));
+    if( !apNew ) {
+      sortRowFree(pData, p);
+      return SQLITE_NOMEM;
+    }
+    pData->apRow = apNew;
+    pData->nRowAlloc = nNew;
+  }
+  pData->apRow[pData->nRow++] = p;
+  
+  if( pData->nLimit > 0 ) {
+    if( pData->nRow == pData->nLimit ) sortHeapify(pData, 1);
+  } else {
+    pData->nBytes += sortRowBytes(pData, p);
+    if( pData->nBytes > pData->nMemory ) rc = sortSpillRun(pIterator);
+  }
+  return rc;
+}
 
 static int sortIteratorOpen(CypherIterator *pIterator) {
-  SortIteratorData *pData = (SortIteratorData*)pIterator->pIterData;
-  CypherResult result;
+  SortData *pData = (SortData*)pIterator->pIterData;
   int rc;
   
-  /* Open source iterator */
   rc = pData->pSource->xOpen(pData->pSource);
-  if (rc != SQLITE_OK) return rc;
+  if( rc != SQLITE_OK ) return rc;
+  pIterator->bOpened = 1;
+  pIterator->bEof = 0;
+  pData->nSeq = 0;
+  pData->iOut = 0;
+  pData->nMemory = iteratorSpillBudget(CYPHER_SORT_MEMORY);
   
-  /* Collect all results */
-  pData->nResults = 0;
-  pData->iCurrent = 0;
-  
-  while ((rc = pData->pSource->xNext(pData->pSource, &result)) == SQLITE_OK) {
-    /* Resize array if needed */
-    if (pData->nResults >= pData->nAllocated) {
-      int nNew = pData->nAllocated ? pData->nAllocated * 2 : 16;
-      CypherResult *aNew = sqlite3_realloc(pData->aResults, nNew * sizeof(CypherResult));
-      if (!aNew) {
-        cypherResultDestroy(&result);
-        return SQLITE_NOMEM;
-      }
-      pData->aResults = aNew;
-      pData->nAllocated = nNew;
-    }
-    
-    /* Copy result */
-    pData->aResults[pData->nResults++] = result;
-  }
-  
-  /* Sort results - simple bubble sort for now */
-  for (int i = 0; i < pData->nResults - 1; i++) {
-    for (int j = 0; j < pData->nResults - i - 1; j++) {
-      /* Compare using first sort key only for simplicity */
-      if (pData->nSortKeys > 0) {
-        CypherValue v1, v2;
-        cypherExpressionEvaluate(pData->apSortKeys[0], pIterator->pContext, &v1);
-        cypherExpressionEvaluate(pData->apSortKeys[0], pIterator->pContext, &v2);
-        
-        if (cypherValueCompare(&v1, &v2) > 0) {
-          /* Swap */
-          CypherResult temp = pData->aResults[j];
-          pData->aResults[j] = pData->aResults[j + 1];
-          pData->aResults[j + 1] = temp;
-        }
-        
-        cypherValueDestroy(&v1);
-        cypherValueDestroy(&v2);
-      }
+  /* Consume the whole input */
+  while( 1 ) {
+    CypherResult *pRow = cypherResultCreate();
+    if( !pRow ) {
+      rc = SQLITE_NOMEM;
+      break;
     }
+    rc = pData->pSource->xNext(pData->pSource, pRow);
+    if( rc != SQLITE_OK ) {
+      cypherResultDestroy(pRow);
+      break;
+    }
+    rc = sortAddRow(pIterator, pRow);
+    if( rc != SQLITE_OK ) break;
   }
+  pData->pSource->xClose(pData->pSource);
+  if( rc != SQLITE_DONE ) return rc;
   
-  return (rc == SQLITE_DONE) ? SQLITE_OK : rc;
+  return pData->zSpill ? sortMergeStart(pIterator) : sortInMemory(pData);
 }
 
 static int sortIteratorNext(CypherIterator *pIterator, CypherResult *pResult) {
-  SortIteratorData *pData = (SortIteratorData*)pIterator->pIterData;
+  SortData *pData = (SortData*)pIterator->pIterData;
+  SortRow *p;
+  int rc = SQLITE_OK;
+  int i;
   
-  if (pData->iCurrent >= pData->nResults) {
-    return SQLITE_DONE;
+  if( pIterator->bEof ) return SQLITE_DONE;
+  
+  if( pData->zSpill ) {
+    /* The root of the heap is the first row of any run */
+    SortRow *pNext;
+    if( pData->nRow == 0 ) {
+      pIterator->bEof = 1;
+      return SQLITE_DONE;
+    }
+    p = pData->apRow[0];
+    rc = sortReadRun(pData, (int)p->iSeq, &pNext);
+    if( rc != SQLITE_OK ) return rc;
+    pData->apRow[0] = pNext ? pNext : pData->apRow[--pData->nRow];
+    sortSiftDown(pData, pData->nRow, 0, -1);
+  } else {
+    if( pData->iOut >= pData->nRow ) {
+      pIterator->bEof = 1;
+      return SQLITE_DONE;
+    }
+    p = pData->apRow[pData->iOut];
+    pData->apRow[pData->iOut++] = NULL;
+  }
+  
+  for( i = 0; rc == SQLITE_OK && i < p->pRow->nColumns; i++ ) {
+    rc = cypherResultAddColumn(pResult, p->pRow->azColumnNames[i], &p->pRow->aValues[i]);
   }
+  sortRowFree(pData, p);
+  if( rc != SQLITE_OK ) return rc;
+  
+  pIterator->nRowsProduced++;
   
-  /* Return copy of current result */
-  *pResult = pData->aResults[pData->iCurrent++];
   return SQLITE_OK;
 }
 
 static int sortIteratorClose(CypherIterator *pIterator) {
-  SortIteratorData *pData = (SortIteratorData*)pIterator->pIterData;
+  SortData *pData = (SortData*)pIterator->pIterData;
+  int i;
   
-  /* Free sorted results */
-  for (int i = 0; i < pData->nResults; i++) {
-    cypherResultDestroy(&pData->aResults[i]);
+  for( i = 0; i < pData->nRow; i++ ) sortRowFree(pData, pData->apRow[i]);
+  pData->nRow = 0;
+  pData->nBytes = 0;
+  for( i = 0; pData->apRun && i < pData->nRun; i++ ) sqlite3_finalize(pData->apRun[i]);
+  sqlite3_free(pData->apRun);
+  pData->apRun = NULL;
+  pData->nRun = 0;
+  sqlite3_finalize(pData->pInsert);
+  pData->pInsert = NULL;
+  if( pData->zSpill ) {
+    char *zSql = sqlite3_mprintf("DROP TABLE IF EXISTS temp.\"%w\"", pData->zSpill);
+    if( zSql ) sqlite3_exec(pIterator->pContext->pGraph->pDb, zSql, 0, 0, 0);
+    sqlite3_free(zSql);
+    sqlite3_free(pData->zSpill);
+    pData->zSpill = NULL;
   }
-  
-  return pData->pSource->xClose(pData->pSource);
+  cypherPropertyReaderClose(&pData->props);
+  pIterator->bOpened = 0;
+  return SQLITE_OK;
 }
 
 static void sortIteratorDestroy(CypherIterator *pIterator) {
-  if (pIterator) {
-    SortIteratorData *pData = (SortIteratorData*)pIterator->pIterData;
-    if (pData) {
-      if (pData->pSource) {
-        pData->pSource->xDestroy(pData->pSource);
-      }
-      sqlite3_free(pData->aResults);
-      sqlite3_free(pData);
-    }
-    sqlite3_free(pIterator);
+  SortData *pData = (SortData*)pIterator->pIterData;
+  if( pData ) {
+    cypherIteratorDestroy(pData->pSource);
+    sqlite3_free(pData->apRow);
+    sqlite3_free(pData);
   }
 }
 
 CypherIterator *cypherSortCreate(PhysicalPlanNode *pPlan, ExecutionContext *pContext) {
   CypherIterator *pIterator;
-  SortIteratorData *pData;
+  SortData *pData;
   
-  if (!pPlan || !pPlan->pChild) return NULL;
+  if( !pPlan || !pPlan->pChild ) return NULL;
   
   pIterator = sqlite3_malloc(sizeof(CypherIterator));
-  if (!pIterator) return NULL;
+  if( !pIterator ) return NULL;
   
-  pData = sqlite3_malloc(sizeof(SortIteratorData));
-  if (!pData) {
+  pData = sqlite3_malloc(sizeof(SortData));
+  if( !pData ) {
     sqlite3_free(pIterator);
     return NULL;
   }
   
   memset(pIterator, 0, sizeof(CypherIterator));
-  memset(pData, 0, sizeof(SortIteratorData));
+  memset(pData, 0, sizeof(SortData));
+  pIterator->pIterData = pData;
+  pIterator->xDestroy = sortIteratorDestroy;
   
   /* Create source iterator */
   pData->pSource = cypherIteratorCreate(pPlan->pChild, pContext);
-  if (!pData->pSource) {
-    sqlite3_free(pData);
-    sqlite3_free(pIterator);
+  if( !pData->pSource ) {
+    cypherIteratorDestroy(pIterator);
     return NULL;
   }
   
-  pData->apSortKeys = pPlan->apSortKeys;
-  pData->nSortKeys = pPlan->nSortKeys;
+  pData->aKey = pPlan->aColumn;
+  pData->nKey = pPlan->nColumn;
+  pData->nLimit = pPlan->nLimit;
+  pData->props.pGraph = pContext->pGraph;
   
   /* Set up iterator */
   pIterator->xOpen = sortIteratorOpen;
   pIterator->xNext = sortIteratorNext;
   pIterator->xClose = sortIteratorClose;
-  pIterator->xDestroy = sortIteratorDestroy;
   pIterator->pContext = pContext;
   pIterator->pPlan = pPlan;
-  pIterator->pIterData = pData;
   
   return pIterator;
 }
@@ -753,28 +4842,73 @@ CypherIterator *cypherSortCreate(PhysicalPlanNode *pPlan, ExecutionContext *pCon
 /* Limit iterator implementation */
 typedef struct LimitIteratorData {
   CypherIterator *pSource;  /* Source iterator */
-  int nLimit;               /* Limit count */
+  int nLimit;               /* Limit count, -1 for none */
+  int nSkip;                /* Rows to skip first */
   int nReturned;            /* Number returned so far */
+  int bSourceOpen;          /* pSource is open */
 } LimitIteratorData;
 
 static int limitIteratorOpen(CypherIterator *pIterator) {
   LimitIteratorData *pData = (LimitIteratorData*)pIterator->pIterData;
+  int rc;
+  
   pData->nReturned = 0;
-  return pData->pSource->xOpen(pData->pSource);
+  pIterator->bEof = 0;
+  
+  /* LIMIT 0 never reads its input */
+  if( pData->nLimit == 0 ) return SQLITE_OK;
+  rc = pData->pSource->xOpen(pData->pSource);
+  if( rc == SQLITE_OK ) pData->bSourceOpen = 1;
+  return rc;
+}
+
+/*
+** Close the source as soon as the quota is met, so that scans, expands
+** and any spill tables below stop and release their resources at once
+** rather than when the query is finished.
+*/
+static void limitIteratorStop(CypherIterator *pIterator) {
+  LimitIteratorData *pData = (LimitIteratorData*)pIterator->pIterData;
+  if( pData->bSourceOpen ) {
+    pData->pSource->xClose(pData->pSource);
+    pData->bSourceOpen = 0;
+  }
+  pIterator->bEof = 1;
 }
 
 static int limitIteratorNext(CypherIterator *pIterator, CypherResult *pResult) {
   LimitIteratorData *pData = (LimitIteratorData*)pIterator->pIterData;
+  int rc;
   
   /* Check if limit reached */
-  if (pData->nReturned >= pData->nLimit) {
+  if( pIterator->bEof || (pData->nLimit >= 0 && pData->nReturned >= pData->nLimit) ) {
+    limitIteratorStop(pIterator);
     return SQLITE_DONE;
   }
   
+  /* Rows the source did not skip itself are dropped here */
+  if( pData->nReturned == 0 ) {
+    while( pData->nSkip > 0 ) {
+      CypherResult *pRow = cypherResultCreate();
+      if( !pRow ) return SQLITE_NOMEM;
+      rc = pData->pSource->xNext(pData->pSource, pRow);
+      cypherResultDestroy(pRow);
+      if( rc != SQLITE_OK ) {
+        if( rc == SQLITE_DONE ) limitIteratorStop(pIterator);
+        return rc;
+      }
+      pData->nSkip--;
+    }
+  }
+  
   /* Get next from source */
-  int rc = pData->pSource->xNext(pData->pSource, pResult);
-  if (rc == SQLITE_OK) {
+  rc = pData->pSource->xNext(pData->pSource, pResult);
+  if( rc == SQLITE_OK ) {
     pData->nReturned++;
+    pIterator->nRowsProduced++;
+    if( pData->nReturned == pData->nLimit ) limitIteratorStop(pIterator);
+  } else if( rc == SQLITE_DONE ) {
+    limitIteratorStop(pIterator);
   }
   
   return rc;
@@ -782,19 +4916,16 @@ static int limitIteratorNext(CypherIterator *pIterator, CypherResult *pResult) {
 
 static int limitIteratorClose(CypherIterator *pIterator) {
   LimitIteratorData *pData = (LimitIteratorData*)pIterator->pIterData;
-  return pData->pSource->xClose(pData->pSource);
+  limitIteratorStop(pIterator);
+  pData->nSkip = pIterator->pPlan->nSkip;
+  return SQLITE_OK;
 }
 
 static void limitIteratorDestroy(CypherIterator *pIterator) {
-  if (pIterator) {
-    LimitIteratorData *pData = (LimitIteratorData*)pIterator->pIterData;
-    if (pData) {
-      if (pData->pSource) {
-        pData->pSource->xDestroy(pData->pSource);
-      }
-      sqlite3_free(pData);
-    }
-    sqlite3_free(pIterator);
+  LimitIteratorData *pData = (LimitIteratorData*)pIterator->pIterData;
+  if (pData) {
+    cypherIteratorDestroy(pData->pSource);
+    sqlite3_free(pData);
   }
 }
 
@@ -802,7 +4933,7 @@ CypherIterator *cypherLimitCreate(PhysicalPlanNode *pPlan, ExecutionContext *pCo
   CypherIterator *pIterator;
   LimitIteratorData *pData;
   
-  if (!pPlan || !pPlan->pChild || pPlan->nLimit <= 0) return NULL;
+  if (!pPlan || !pPlan->pChild) return NULL;
   
   pIterator = sqlite3_malloc(sizeof(CypherIterator));
   if (!pIterator) return NULL;
@@ -825,6 +4956,7 @@ CypherIterator *cypherLimitCreate(PhysicalPlanNode *pPlan, ExecutionContext *pCo
   }
   
   pData->nLimit = pPlan->nLimit;
+  pData->nSkip = pPlan->nSkip;
   pData->nReturned = 0;
   
   /* Set up iterator */
@@ -27,6 +27,8 @@ extern const sqlite3_api_routines *sqlite3_api;
 #include <stdio.h>
 #include <stdlib.h>
 #include <ctype.h>
+#include <errno.h>
+#include <math.h>
 
 /*
 ** Parse JSON properties string and populate a CypherValue map.
@@ -294,6 +296,303 @@ parse_error:
     return rc;
 }
 
+/* Nesting depth beyond which cypherParseJsonValue() gives up */
+#define CYPHER_JSON_MAX_DEPTH 1000
+
+static void jsonSkipSpace(const char **pz) {
+    while( isspace((unsigned char)**pz) ) (*pz)++;
+}
+
+/*
+** Append code point c to z as UTF-8 and return the number of bytes.
+*/
+static int jsonPutUtf8(char *z, unsigned int c) {
+    if( c < 0x80 ) {
+        z[0] = (char)c;
+        return 1;
+    }
+    if( c < 0x800 ) {
+        z[0] = (char)(0xc0 | (c >> 6));
+        z[1] = (char)(0x80 | (c & 0x3f));
+        return 2;
+    }
+    if( c < 0x10000 ) {
+        z[0] = (char)(0xe0 | (c >> 12));
+        z[1] = (char)(0x80 | ((c >> 6) & 0x3f));
+        z[2] = (char)(0x80 | (c & 0x3f));
+        return 3;
+    }
+    z[0] = (char)(0xf0 | (c >> 18));
+    z[1] = (char)(0x80 | ((c >> 12) & 0x3f));
+    z[2] = (char)(0x80 | ((c >> 6) & 0x3f));
+    z[3] = (char)(0x80 | (c & 0x3f));
+    return 4;
+}
+
+/*
+** Read the four hex digits of a \u escape at z into *pc.
+*/
+static int jsonHex4(const char *z, unsigned int *pc) {
+    unsigned int c = 0;
+    int i;
+    for( i = 0; i < 4; i++ ) {
+        if( !isxdigit((unsigned char)z[i]) ) return 0;
+        c = (c << 4) | (unsigned int)(isdigit((unsigned char)z[i]) ? z[i] - '0' :
+                                      (tolower((unsigned char)z[i]) - 'a' + 10));
+    }
+    *pc = c;
+    return 1;
+}
+
+/*
+** Parse the JSON string at *pz, which starts with its opening quote, into
+** a new nul-terminated string *pzOut with its escapes resolved.
+*/
+static int jsonParseString(const char **pz, char **pzOut) {
+    const char *p = *pz + 1;
+    const char *pEnd = p;
+    char *zOut;
+    int n = 0;
+    
+    /* Escapes only shrink the text, so its raw length is enough */
+    while( *pEnd != '"' ) {
+        if( *pEnd == '\0' ) return SQLITE_FORMAT;
+        if( *pEnd == '\\' && pEnd[1] != '\0' ) pEnd++;
+        pEnd++;
+    }
+    zOut = sqlite3_malloc((int)(pEnd - p) + 1);
+    if( !zOut ) return SQLITE_NOMEM;
+    
+    while( p < pEnd ) {
+        unsigned int c;
+        if( *p != '\\' ) {
+            zOut[n++] = *p++;
+            continue;
+        }
+        p++;
+        switch( *p++ ) {
+            case '"':  zOut[n++] = '"'; break;
+            case '\\': zOut[n++] = '\\'; break;
+            case '/':  zOut[n++] = '/'; break;
+            case 'b':  zOut[n++] = '\b'; break;
+            case 'f':  zOut[n++] = '\f'; break;
+            case 'n':  zOut[n++] = '\n'; break;
+            case 'r':  zOut[n++] = '\r'; break;
+            case 't':  zOut[n++] = '\t'; break;
+            case 'u':
+                if( !jsonHex4(p, &c) ) goto format_error;
+                p += 4;
+                /* A surrogate pair is one code point */
+                if( c >= 0xd800 && c < 0xdc00 && p[0] == '\\' && p[1] == 'u' ) {
+                    unsigned int c2;
+                    if( jsonHex4(p + 2, &c2) && c2 >= 0xdc00 && c2 < 0xe000 ) {
+                        c = 0x10000 + ((c - 0xd800) << 10) + (c2 - 0xdc00);
+                        p += 6;
+                    }
+                }
+                n += jsonPutUtf8(&zOut[n], c);
+                break;
+            default:
+                goto format_error;
+        }
+    }
+    zOut[n] = '\0';
+    *pz = pEnd + 1;
+    *pzOut = zOut;
+    return SQLITE_OK;
+    
+format_error:
+    sqlite3_free(zOut);
+    return SQLITE_FORMAT;
+}
+
+/*
+** Parse the JSON value at *pz into pResult, which must not hold a value,
+** and advance *pz past it.
+*/
+static int jsonParseValue(const char **pz, CypherValue *pResult, int nDepth) {
+    const char *p;
+    int rc = SQLITE_OK;
+    
+    if( nDepth > CYPHER_JSON_MAX_DEPTH ) return SQLITE_FORMAT;
+    jsonSkipSpace(pz);
+    p = *pz;
+    
+    if( *p == '"' ) {
+        char *z;
+        rc = jsonParseString(pz, &z);
+        if( rc == SQLITE_OK ) {
+            pResult->type = CYPHER_VALUE_STRING;
+            pResult->u.zString = z;
+        }
+        return rc;
+    }
+    
+    if( *p == '[' || *p == '{' ) {
+        int bMap = *p == '{';
+        char cEnd = bMap ? '}' : ']';
+        CypherValue *aValues = NULL;
+        char **azKeys = NULL;
+        int nValues = 0, nAlloc = 0;
+        
+        *pz = p + 1;
+        jsonSkipSpace(pz);
+        if( **pz == cEnd ) {
+            (*pz)++;
+        } else for(;;) {
+            if( nValues >= nAlloc ) {
+                int nNew = nAlloc ? nAlloc * 2 : 4;
+                CypherValue *aNew = sqlite3_realloc(aValues, nNew * sizeof(CypherValue));
+                if( !aNew ) { rc = SQLITE_NOMEM; break; }
+                aValues = aNew;
+                if( bMap ) {
+                    char **azNew = sqlite3_realloc(azKeys, nNew * sizeof(char*));
+                    if( !azNew ) { rc = SQLITE_NOMEM; break; }
+                    azKeys = azNew;
+                }
+                nAlloc = nNew;
+            }
+            if( bMap ) {
+                jsonSkipSpace(pz);
+                if( **pz != '"' ) { rc = SQLITE_FORMAT; break; }
+                rc = jsonParseString(pz, &azKeys[nValues]);
+                if( rc != SQLITE_OK ) break;
+                jsonSkipSpace(pz);
+                if( **pz != ':' ) {
+                    sqlite3_free(azKeys[nValues]);
+                    rc = SQLITE_FORMAT;
+                    break;
+                }
+                (*pz)++;
+            }
+            cypherValueInit(&aValues[nValues]);
+            rc = jsonParseValue(pz, &aValues[nValues], nDepth + 1);
+            if( rc != SQLITE_OK ) {
+                if( bMap ) sqlite3_free(azKeys[nValues]);
+                break;
+            }
+            nValues++;
+            jsonSkipSpace(pz);
+            if( **pz == ',' ) {
+                (*pz)++;
+            } else if( **pz == cEnd ) {
+                (*pz)++;
+                break;
+            } else {
+                rc = SQLITE_FORMAT;
+                break;
+            }
+        }
+        
+        if( rc != SQLITE_OK ) {
+            while( nValues-- > 0 ) {
+                if( bMap ) sqlite3_free(azKeys[nValues]);
+                cypherValueDestroy(&aValues[nValues]);
+            }
+            sqlite3_free(azKeys);
+            sqlite3_free(aValues);
+        } else if( bMap ) {
+            cypherValueSetMap(pResult, azKeys, aValues, nValues);
+        } else {
+            sqlite3_free(azKeys);
+            cypherValueSetList(pResult, aValues, nValues);
+        }
+        return rc;
+    }
+    
+    if( strncmp(p, "true", 4) == 0 || strncmp(p, "false", 5) == 0 ) {
+        cypherValueSetBoolean(pResult, *p == 't');
+        *pz = p + (*p == 't' ? 4 : 5);
+        return SQLITE_OK;
+    }
+    if( strncmp(p, "null", 4) == 0 ) {
+        cypherValueSetNull(pResult);
+        *pz = p + 4;
+        return SQLITE_OK;
+    }
+    if( *p == '-' || isdigit((unsigned char)*p) ) {
+        char *zEnd;
+        int bFloat = 0;
+        const char *q;
+        
+        for( q = p + 1; isdigit((unsigned char)*q) || (*q && strchr(".eE+-", *q)); q++ ) {
+            if( *q == '.' || *q == 'e' || *q == 'E' ) bFloat = 1;
+        }
+        if( !bFloat ) {
+            sqlite3_int64 iValue;
+            errno = 0;
+            iValue = strtoll(p, &zEnd, 10);
+            if( zEnd == q && errno == 0 ) {
+                cypherValueSetInteger(pResult, iValue);
+                *pz = zEnd;
+                return SQLITE_OK;
+            }
+        }
+        /* Integers out of range fall back to floats */
+        cypherValueSetFloat(pResult, strtod(p, &zEnd));
+        if( zEnd == p ) return SQLITE_FORMAT;
+        *pz = zEnd;
+        return SQLITE_OK;
+    }
+    return SQLITE_FORMAT;
+}
+
+/*
+** Parse any JSON value into a CypherValue: objects become maps, arrays
+** lists, and strings lose their escapes. Returns SQLITE_FORMAT if zJson
+** is not a single well-formed JSON value.
+*/
+int cypherParseJsonValue(const char *zJson, CypherValue *pResult) {
+    const char *p = zJson;
+    int rc;
+    
+    if( !zJson || !pResult ) return SQLITE_MISUSE;
+    cypherValueInit(pResult);
+    rc = jsonParseValue(&p, pResult, 0);
+    if( rc == SQLITE_OK ) {
+        jsonSkipSpace(&p);
+        if( *p != '\0' ) {
+            cypherValueDestroy(pResult);
+            rc = SQLITE_FORMAT;
+        }
+    }
+    return rc;
+}
+
+/*
+** Return z as a JSON string, quoted and with its quotes, backslashes and
+** control characters escaped. A NULL z gives "". Caller must
+** sqlite3_free() the result; returns NULL on allocation failure.
+*/
+char *cypherJsonQuote(const char *z) {
+    int nLen = z ? (int)strlen(z) : 0;
+    char *zResult = sqlite3_malloc(nLen * 6 + 3); /* Worst case: all \u00XX */
+    int n = 0;
+    
+    if( !zResult ) return NULL;
+    zResult[n++] = '"';
+    for( int i = 0; i < nLen; i++ ) {
+        unsigned char c = (unsigned char)z[i];
+        switch( c ) {
+            case '"':  zResult[n++] = '\\'; zResult[n++] = '"'; break;
+            case '\\': zResult[n++] = '\\'; zResult[n++] = '\\'; break;
+            case '\n': zResult[n++] = '\\'; zResult[n++] = 'n'; break;
+            case '\r': zResult[n++] = '\\'; zResult[n++] = 'r'; break;
+            case '\t': zResult[n++] = '\\'; zResult[n++] = 't'; break;
+            default:
+                if( c < 0x20 ) {
+                    n += snprintf(&zResult[n], 7, "\\u%04x", c);
+                } else {
+                    zResult[n++] = (char)c;
+                }
+                break;
+        }
+    }
+    zResult[n++] = '"';
+    zResult[n] = '\0';
+    return zResult;
+}
+
 /*
 ** Convert a CypherValue to JSON string representation.
 ** Caller must sqlite3_free() the returned string.
@@ -313,52 +612,12 @@ char *cypherValueToJson(const CypherValue *pValue) {
             return sqlite3_mprintf("%lld", pValue->u.iInteger);
             
         case CYPHER_VALUE_FLOAT:
-            return sqlite3_mprintf("%.15g", pValue->u.rFloat);
-            
-        case CYPHER_VALUE_STRING: {
-            /* Escape string for JSON */
-            const char *zStr = pValue->u.zString ? pValue->u.zString : "";
-            int nLen = strlen(zStr);
-            int nAlloc = nLen * 2 + 16; /* Worst case: every char escaped */
-            char *zResult = sqlite3_malloc(nAlloc);
-            if( !zResult ) return NULL;
-            
-            int nResult = 0;
-            zResult[nResult++] = '"';
+            /* JSON has no infinities or NaN; floats keep their point */
+            if( !isfinite(pValue->u.rFloat) ) return sqlite3_mprintf("null");
+            return sqlite3_mprintf("%!.15g", pValue->u.rFloat);
             
-            for( int i = 0; i < nLen && nResult < nAlloc - 2; i++ ) {
-                char c = zStr[i];
-                switch( c ) {
-                    case '"':
-                        zResult[nResult++] = '\\';
-                        zResult[nResult++] = '"';
-                        break;
-                    case '\\':
-                        zResult[nResult++] = '\\';
-                        zResult[nResult++] = '\\';
-                        break;
-                    case '\n':
-                        zResult[nResult++] = '\\';
-                        zResult[nResult++] = 'n';
-                        break;
-                    case '\r':
-                        zResult[nResult++] = '\\';
-                        zResult[nResult++] = 'r';
-                        break;
-                    case '\t':
-                        zResult[nResult++] = '\\';
-                        zResult[nResult++] = 't';
-                        break;
-                    default:
-                        zResult[nResult++] = c;
-                        break;
-                }
-            }
-            
-            zResult[nResult++] = '"';
-            zResult[nResult] = '\0';
-            return zResult;
-        }
+        case CYPHER_VALUE_STRING:
+            return cypherJsonQuote(pValue->u.zString);
         
         case CYPHER_VALUE_LIST: {
             /* Convert list to JSON array */
@@ -398,11 +657,12 @@ char *cypherValueToJson(const CypherValue *pValue) {
                     return NULL;
                 }
                 
-                char *zNew = sqlite3_mprintf("%s%s\"%s\":%s", zResult,
-                                           i > 0 ? "," : "",
-                                           pValue->u.map.azKeys[i],
-                                           zValue);
+                char *zKey = cypherJsonQuote(pValue->u.map.azKeys[i]);
+                char *zNew = zKey ? sqlite3_mprintf("%s%s%s:%s", zResult,
+                                                    i > 0 ? "," : "",
+                                                    zKey, zValue) : NULL;
                 sqlite3_free(zResult);
+                sqlite3_free(zKey);
                 sqlite3_free(zValue);
                 
                 if( !zNew ) return NULL;
@@ -420,6 +680,28 @@ char *cypherValueToJson(const CypherValue *pValue) {
         case CYPHER_VALUE_RELATIONSHIP:
             return sqlite3_mprintf("{\"_type\":\"relationship\",\"_id\":%lld}", pValue->u.iRelId);
             
+        case CYPHER_VALUE_PATH: {
+            char *zNodes = NULL, *zRels = NULL, *zResult;
+            for( int i = 0; i <= pValue->u.path.nLength; i++ ) {
+                zNodes = sqlite3_mprintf("%z%s%lld", zNodes, i > 0 ? "," : "",
+                                         pValue->u.path.aNodeIds[i]);
+                if( !zNodes ) return NULL;
+            }
+            for( int i = 0; i < pValue->u.path.nLength; i++ ) {
+                zRels = sqlite3_mprintf("%z%s%lld", zRels, i > 0 ? "," : "",
+                                        pValue->u.path.aRelIds[i]);
+                if( !zRels ) {
+                    sqlite3_free(zNodes);
+                    return NULL;
+                }
+            }
+            zResult = sqlite3_mprintf("{\"_type\":\"path\",\"nodes\":[%s],\"relationships\":[%s],\"length\":%d}",
+                                      zNodes, zRels ? zRels : "", pValue->u.path.nLength);
+            sqlite3_free(zNodes);
+            sqlite3_free(zRels);
+            return zResult;
+        }
+            
         default:
             return sqlite3_mprintf("null");
     }
@@ -229,7 +229,7 @@ static CypherToken *lexerTokenizeNumber(CypherLexer *pLexer) {
     while (isdigit(lexerPeek(pLexer, 0))) {
         lexerNext(pLexer);
     }
-    if (lexerPeek(pLexer, 0) == '.') {
+    if (lexerPeek(pLexer, 0) == '.' && isdigit(lexerPeek(pLexer, 1))) {
         type = CYPHER_TOK_FLOAT;
         lexerNext(pLexer);
         while (isdigit(lexerPeek(pLexer, 0))) {
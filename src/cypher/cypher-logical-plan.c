@@ -21,7 +21,9 @@ extern const sqlite3_api_routines *sqlite3_api;
 #endif
 /* SQLITE_EXTENSION_INIT1 - removed to prevent multiple definition */
 #include "cypher-planner.h"
+#include "cypher-expressions.h"
 #include <string.h>
+#include <stdlib.h>
 #include <assert.h>
 
 /*
@@ -62,6 +64,21 @@ void logicalPlanNodeDestroy(LogicalPlanNode *pNode) {
   sqlite3_free(pNode->zLabel);
   sqlite3_free(pNode->zProperty);
   sqlite3_free(pNode->zValue);
+  sqlite3_free(pNode->zOperator);
+  sqlite3_free(pNode->zIndexName);
+  sqlite3_free(pNode->zFromAlias);
+  sqlite3_free(pNode->zRelAlias);
+  sqlite3_free(pNode->zRelType);
+  sqlite3_free(pNode->zPathAlias);
+  sqlite3_free(pNode->zJoinKeys);
+  sqlite3_free(pNode->zDistinctRels);
+  planPredicatesFree(pNode->aIndexKey, pNode->nIndexKey);
+  planPredicatesFree(pNode->aScanFilter, pNode->nScanFilter);
+  planColumnsFree(pNode->aColumn, pNode->nColumn);
+  for( i = 0; i < pNode->nExpr; i++ ) {
+    cypherExpressionDestroy(pNode->apExpr[i]);
+  }
+  sqlite3_free(pNode->apExpr);
   sqlite3_free(pNode->pExtra);
   sqlite3_free(pNode);
 }
@@ -169,6 +186,197 @@ int logicalPlanNodeSetValue(LogicalPlanNode *pNode, const char *zValue) {
   return SQLITE_OK;
 }
 
+int logicalPlanNodeSetOperator(LogicalPlanNode *pNode, const char *zOperator) {
+  char *zNew;
+  
+  if( !pNode ) return SQLITE_MISUSE;
+  if( !zOperator ) {
+    sqlite3_free(pNode->zOperator);
+    pNode->zOperator = NULL;
+    return SQLITE_OK;
+  }
+  
+  zNew = sqlite3_mprintf("%s", zOperator);
+  if( !zNew ) return SQLITE_NOMEM;
+  
+  sqlite3_free(pNode->zOperator);
+  pNode->zOperator = zNew;
+  return SQLITE_OK;
+}
+
+/*
+** Append a comparison to the array *paPred of *pnPred predicates. Only
+** zProperty may be NULL.
+*/
+static int planPredicateAppend(PlanPredicate **paPred, int *pnPred,
+                               const char *zProperty, const char *zOperator,
+                               const char *zValue) {
+  PlanPredicate *aNew;
+  PlanPredicate *pPred;
+  
+  aNew = sqlite3_realloc(*paPred, (*pnPred + 1) * sizeof(PlanPredicate));
+  if( !aNew ) return SQLITE_NOMEM;
+  *paPred = aNew;
+  
+  pPred = &aNew[*pnPred];
+  pPred->zProperty = zProperty ? sqlite3_mprintf("%s", zProperty) : NULL;
+  pPred->zOperator = sqlite3_mprintf("%s", zOperator);
+  pPred->zValue = sqlite3_mprintf("%s", zValue);
+  (*pnPred)++;
+  if( (zProperty && !pPred->zProperty) || !pPred->zOperator || !pPred->zValue ) {
+    return SQLITE_NOMEM;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Append a comparison to the index key of a logical plan node.
+** Returns SQLITE_OK on success, SQLITE_NOMEM on allocation failure.
+*/
+int logicalPlanNodeAddIndexKey(LogicalPlanNode *pNode, const char *zProperty,
+                               const char *zOperator, const char *zValue) {
+  if( !pNode || !zProperty || !zOperator || !zValue ) return SQLITE_MISUSE;
+  return planPredicateAppend(&pNode->aIndexKey, &pNode->nIndexKey,
+                             zProperty, zOperator, zValue);
+}
+
+/*
+** Append a comparison to the filters a scan evaluates in its SQL.
+** Returns SQLITE_OK on success, SQLITE_NOMEM on allocation failure.
+*/
+int logicalPlanNodeAddScanFilter(LogicalPlanNode *pNode, const char *zProperty,
+                                 const char *zOperator, const char *zValue) {
+  if( !pNode || !zOperator || !zValue ) return SQLITE_MISUSE;
+  return planPredicateAppend(&pNode->aScanFilter, &pNode->nScanFilter,
+                             zProperty, zOperator, zValue);
+}
+
+/*
+** Return a deep copy of aPred, or NULL if nPred is 0 or on allocation
+** failure.
+*/
+PlanPredicate *planPredicatesCopy(const PlanPredicate *aPred, int nPred) {
+  PlanPredicate *aNew;
+  int i;
+  
+  if( !aPred || nPred <= 0 ) return NULL;
+  
+  aNew = sqlite3_malloc(nPred * sizeof(PlanPredicate));
+  if( !aNew ) return NULL;
+  
+  for( i = 0; i < nPred; i++ ) {
+    aNew[i].zProperty = aPred[i].zProperty ? 
+                        sqlite3_mprintf("%s", aPred[i].zProperty) : NULL;
+    aNew[i].zOperator = sqlite3_mprintf("%s", aPred[i].zOperator);
+    aNew[i].zValue = sqlite3_mprintf("%s", aPred[i].zValue);
+    if( (aPred[i].zProperty && !aNew[i].zProperty) || 
+        !aNew[i].zOperator || !aNew[i].zValue ) {
+      planPredicatesFree(aNew, i + 1);
+      return NULL;
+    }
+  }
+  return aNew;
+}
+
+/*
+** Free an array of plan predicates. Safe to call with NULL pointer.
+*/
+void planPredicatesFree(PlanPredicate *aPred, int nPred) {
+  int i;
+  
+  if( !aPred ) return;
+  for( i = 0; i < nPred; i++ ) {
+    sqlite3_free(aPred[i].zProperty);
+    sqlite3_free(aPred[i].zOperator);
+    sqlite3_free(aPred[i].zValue);
+  }
+  sqlite3_free(aPred);
+}
+
+/*
+** Return a copy of z, or NULL if z is NULL. Sets *pbOom on failure.
+*/
+static char *planColumnDup(const char *z, int *pbOom) {
+  char *zCopy;
+  if( !z ) return NULL;
+  zCopy = sqlite3_mprintf("%s", z);
+  if( !zCopy ) *pbOom = 1;
+  return zCopy;
+}
+
+/*
+** Append an output column to an aggregation node.
+** Returns SQLITE_OK on success, SQLITE_NOMEM on allocation failure.
+*/
+int logicalPlanNodeAddColumn(LogicalPlanNode *pNode, const char *zFunction,
+                             const char *zVariable, const char *zProperty,
+                             const char *zName, int bDistinct) {
+  PlanColumn *aNew;
+  PlanColumn *pCol;
+  int bOom = 0;
+  
+  if( !pNode || !zName ) return SQLITE_MISUSE;
+  
+  aNew = sqlite3_realloc(pNode->aColumn, (pNode->nColumn + 1) * sizeof(PlanColumn));
+  if( !aNew ) return SQLITE_NOMEM;
+  pNode->aColumn = aNew;
+  
+  pCol = &aNew[pNode->nColumn];
+  pCol->zFunction = planColumnDup(zFunction, &bOom);
+  pCol->zVariable = planColumnDup(zVariable, &bOom);
+  pCol->zProperty = planColumnDup(zProperty, &bOom);
+  pCol->zName = planColumnDup(zName, &bOom);
+  pCol->bDistinct = bDistinct;
+  pCol->bDesc = 0;
+  pNode->nColumn++;
+  return bOom ? SQLITE_NOMEM : SQLITE_OK;
+}
+
+/*
+** Return a deep copy of aCol, or NULL if nCol is 0 or on allocation
+** failure.
+*/
+PlanColumn *planColumnsCopy(const PlanColumn *aCol, int nCol) {
+  PlanColumn *aNew;
+  int bOom = 0;
+  int i;
+  
+  if( !aCol || nCol <= 0 ) return NULL;
+  
+  aNew = sqlite3_malloc(nCol * sizeof(PlanColumn));
+  if( !aNew ) return NULL;
+  
+  for( i = 0; i < nCol; i++ ) {
+    aNew[i].zFunction = planColumnDup(aCol[i].zFunction, &bOom);
+    aNew[i].zVariable = planColumnDup(aCol[i].zVariable, &bOom);
+    aNew[i].zProperty = planColumnDup(aCol[i].zProperty, &bOom);
+    aNew[i].zName = planColumnDup(aCol[i].zName, &bOom);
+    aNew[i].bDistinct = aCol[i].bDistinct;
+    aNew[i].bDesc = aCol[i].bDesc;
+  }
+  if( bOom ) {
+    planColumnsFree(aNew, nCol);
+    return NULL;
+  }
+  return aNew;
+}
+
+/*
+** Free an array of plan columns. Safe to call with NULL pointer.
+*/
+void planColumnsFree(PlanColumn *aCol, int nCol) {
+  int i;
+  
+  if( !aCol ) return;
+  for( i = 0; i < nCol; i++ ) {
+    sqlite3_free(aCol[i].zFunction);
+    sqlite3_free(aCol[i].zVariable);
+    sqlite3_free(aCol[i].zProperty);
+    sqlite3_free(aCol[i].zName);
+  }
+  sqlite3_free(aCol);
+}
+
 /*
 ** Get string representation of logical plan node type.
 ** Returns static string, do not free.
@@ -180,9 +388,13 @@ const char *logicalPlanNodeTypeName(LogicalPlanNodeType type) {
     case LOGICAL_INDEX_SCAN:        return "INDEX_SCAN";
     case LOGICAL_RELATIONSHIP_SCAN: return "RELATIONSHIP_SCAN";
     case LOGICAL_TYPE_SCAN:         return "TYPE_SCAN";
+    case LOGICAL_BITMAP_SCAN:       return "BITMAP_SCAN";
+    case LOGICAL_RANGE_SCAN:        return "RANGE_SCAN";
+    case LOGICAL_FULLTEXT_SCAN:     return "FULLTEXT_SCAN";
     case LOGICAL_EXPAND:            return "EXPAND";
     case LOGICAL_VAR_LENGTH_EXPAND: return "VAR_LENGTH_EXPAND";
     case LOGICAL_OPTIONAL_EXPAND:   return "OPTIONAL_EXPAND";
+    case LOGICAL_SHORTEST_PATH:     return "SHORTEST_PATH";
     case LOGICAL_FILTER:            return "FILTER";
     case LOGICAL_PROPERTY_FILTER:   return "PROPERTY_FILTER";
     case LOGICAL_LABEL_FILTER:      return "LABEL_FILTER";
@@ -191,6 +403,7 @@ const char *logicalPlanNodeTypeName(LogicalPlanNodeType type) {
     case LOGICAL_CARTESIAN_PRODUCT: return "CARTESIAN_PRODUCT";
     case LOGICAL_PROJECTION:        return "PROJECTION";
     case LOGICAL_DISTINCT:          return "DISTINCT";
+    case LOGICAL_UNION:             return "UNION";
     case LOGICAL_AGGREGATION:       return "AGGREGATION";
     case LOGICAL_SORT:              return "SORT";
     case LOGICAL_LIMIT:             return "LIMIT";
@@ -227,6 +440,9 @@ double logicalPlanEstimateCost(LogicalPlanNode *pNode, PlanContext *pContext) {
       break;
       
     case LOGICAL_INDEX_SCAN:
+    case LOGICAL_BITMAP_SCAN:
+    case LOGICAL_RANGE_SCAN:
+    case LOGICAL_FULLTEXT_SCAN:
       /* Property index scan - very cheap */
       rCost = 1.0;
       break;
@@ -241,16 +457,35 @@ double logicalPlanEstimateCost(LogicalPlanNode *pNode, PlanContext *pContext) {
       rCost = 5.0;
       break;
       
+    case LOGICAL_VAR_LENGTH_EXPAND:
+      /* One traversal per level walked */
+      rCost = 5.0 * (pNode->nMaxHops > 0 ? pNode->nMaxHops : 10);
+      break;
+      
+    case LOGICAL_SHORTEST_PATH:
+      /* Two searches of half the depth each, per pair of end nodes */
+      rCost = 5.0 * (pNode->nMaxHops > 0 ? pNode->nMaxHops : 10);
+      if( pNode->nChildren > 1 ) {
+        rCost *= logicalPlanEstimateRows(pNode->apChildren[1], pContext);
+      }
+      break;
+      
     case LOGICAL_HASH_JOIN:
       /* Hash join cost */
       rCost = 10.0;
       break;
       
     case LOGICAL_NESTED_LOOP_JOIN:
+    case LOGICAL_CARTESIAN_PRODUCT:
       /* Nested loop - expensive */
       rCost = 100.0;
       break;
       
+    case LOGICAL_AGGREGATION:
+      /* One hash table probe per input row */
+      rCost = 2.0;
+      break;
+      
     case LOGICAL_PROJECTION:
       /* Projection is cheap */
       rCost = 0.1;
@@ -281,6 +516,7 @@ double logicalPlanEstimateCost(LogicalPlanNode *pNode, PlanContext *pContext) {
 */
 sqlite3_int64 logicalPlanEstimateRows(LogicalPlanNode *pNode, PlanContext *pContext) {
   sqlite3_int64 iRows = 0;
+  int i;
   
   if( !pNode ) return 0;
   
@@ -297,6 +533,9 @@ sqlite3_int64 logicalPlanEstimateRows(LogicalPlanNode *pNode, PlanContext *pCont
       break;
       
     case LOGICAL_INDEX_SCAN:
+    case LOGICAL_BITMAP_SCAN:
+    case LOGICAL_RANGE_SCAN:
+    case LOGICAL_FULLTEXT_SCAN:
       /* Property indexes are very selective */
       iRows = 100;
       break;
@@ -319,6 +558,31 @@ sqlite3_int64 logicalPlanEstimateRows(LogicalPlanNode *pNode, PlanContext *pCont
       }
       break;
       
+    case LOGICAL_SHORTEST_PATH:
+      /* At most one row per pair of end nodes unless all paths are kept */
+      iRows = 1;
+      for( i = 0; i < pNode->nChildren; i++ ) {
+        iRows *= logicalPlanEstimateRows(pNode->apChildren[i], pContext);
+      }
+      if( pNode->iFlags & PLAN_FLAG_ALL_PATHS ) iRows *= 2;
+      break;
+      
+    case LOGICAL_VAR_LENGTH_EXPAND:
+      /* Paths multiply with every level; a pruned walk reaches each node
+      ** once */
+      if( pNode->nChildren > 0 ) {
+        iRows = logicalPlanEstimateRows(pNode->apChildren[0], pContext);
+      } else {
+        iRows = 100;
+      }
+      if( pNode->iFlags & PLAN_FLAG_PRUNE_PATHS ) {
+        iRows *= 50;
+      } else {
+        int nLevel = pNode->nMaxHops > 0 ? pNode->nMaxHops : 10;
+        while( nLevel-- > 0 && iRows < 1000000000 ) iRows *= 5;
+      }
+      break;
+      
     case LOGICAL_HASH_JOIN:
     case LOGICAL_NESTED_LOOP_JOIN:
       /* Join multiplies cardinalities */
@@ -331,6 +595,36 @@ sqlite3_int64 logicalPlanEstimateRows(LogicalPlanNode *pNode, PlanContext *pCont
       }
       break;
       
+    case LOGICAL_CARTESIAN_PRODUCT:
+      /* Every pair of rows */
+      if( pNode->nChildren >= 2 ) {
+        iRows = logicalPlanEstimateRows(pNode->apChildren[0], pContext) *
+                logicalPlanEstimateRows(pNode->apChildren[1], pContext);
+      } else {
+        iRows = 1000;
+      }
+      break;
+      
+    case LOGICAL_AGGREGATION:
+      /* One row per group; assume groups of ten rows */
+      iRows = 1;
+      for( i = 0; i < pNode->nColumn; i++ ) {
+        if( !pNode->aColumn[i].zFunction ) break;
+      }
+      if( i < pNode->nColumn && pNode->nChildren > 0 ) {
+        iRows = logicalPlanEstimateRows(pNode->apChildren[0], pContext) / 10;
+        if( iRows < 1 ) iRows = 1;
+      }
+      break;
+      
+    case LOGICAL_UNION:
+      /* Every row of every input */
+      iRows = 0;
+      for( i = 0; i < pNode->nChildren; i++ ) {
+        iRows += logicalPlanEstimateRows(pNode->apChildren[i], pContext);
+      }
+      break;
+      
     case LOGICAL_PROJECTION:
     case LOGICAL_DISTINCT:
       /* Projection doesn't change cardinality much */
@@ -342,8 +636,22 @@ sqlite3_int64 logicalPlanEstimateRows(LogicalPlanNode *pNode, PlanContext *pCont
       break;
       
     case LOGICAL_LIMIT:
-      /* Limit reduces cardinality */
+      /* Limit caps cardinality at its count */
       iRows = 10; /* Assume small limit */
+      if( pNode->zValue ) {
+        iRows = atoi(pNode->zValue);
+        if( pNode->nChildren > 0 ) {
+          sqlite3_int64 iInput = logicalPlanEstimateRows(pNode->apChildren[0], pContext);
+          if( iInput < iRows ) iRows = iInput;
+        }
+      }
+      break;
+      
+    case LOGICAL_SKIP:
+      /* Skip drops its count from the input */
+      iRows = pNode->nChildren > 0 ? logicalPlanEstimateRows(pNode->apChildren[0], pContext) : 100;
+      if( pNode->zValue ) iRows -= atoi(pNode->zValue);
+      if( iRows < 1 ) iRows = 1;
       break;
       
     default:
@@ -0,0 +1,329 @@
+/*
+** SQLite Graph Database Extension - Cypher Plan Optimizer
+**
+** This file implements the optimizer passes that rewrite a logical plan
+** after the planner has chosen its scans.
+**
+** Features:
+** - Predicate pushdown: comparisons on the node a scan produces are
+**   evaluated by the scan's SQL, so that SQLite indexes and the JSON
+**   functions discard rows before they reach the executor
+**
+** Memory allocation: All functions use sqlite3_malloc()/sqlite3_free()
+** Error handling: Functions return SQLite error codes
+*/
+
+#include "sqlite3ext.h"
+#ifndef SQLITE_CORE
+extern const sqlite3_api_routines *sqlite3_api;
+#endif
+/* SQLITE_EXTENSION_INIT1 - removed to prevent multiple definition */
+#include "cypher-optimizer.h"
+#include <string.h>
+#include <stdlib.h>
+
+/*
+** Return true if pNode is a scan whose SQL can evaluate filters.
+*/
+static int isPushdownScan(LogicalPlanNode *pNode) {
+  return pNode && pNode->zAlias &&
+         (pNode->type == LOGICAL_NODE_SCAN || pNode->type == LOGICAL_LABEL_SCAN ||
+          pNode->type == LOGICAL_INDEX_SCAN);
+}
+
+/*
+** Return true if pNode is a filter.
+*/
+static int isFilterNode(LogicalPlanNode *pNode) {
+  return pNode && (pNode->type == LOGICAL_FILTER ||
+                   pNode->type == LOGICAL_PROPERTY_FILTER ||
+                   pNode->type == LOGICAL_LABEL_FILTER);
+}
+
+/*
+** Return true if zOp is a comparison SQL evaluates as Cypher does.
+*/
+static int isPushableOperator(const char *zOp) {
+  return strcmp(zOp, "=") == 0 || strcmp(zOp, "<>") == 0 ||
+         strcmp(zOp, "<") == 0 || strcmp(zOp, "<=") == 0 ||
+         strcmp(zOp, ">") == 0 || strcmp(zOp, ">=") == 0;
+}
+
+/*
+** Return true if zValue is a literal the scan can bind as a parameter: a
+** number, or unless bNumeric is set a quoted string.
+*/
+static int isBindableValue(const char *zValue, int bNumeric) {
+  int n = (int)strlen(zValue);
+  char *zEnd;
+
+  if( n >= 2 && (zValue[0] == '\'' || zValue[0] == '"') && zValue[n-1] == zValue[0] ) {
+    return !bNumeric;
+  }
+  if( n == 0 ) return 0;
+  strtod(zValue, &zEnd);
+  return *zEnd == 0;
+}
+
+/*
+** Return true if the scan pScan can evaluate the filter pFilter in its
+** SQL: a comparison of a property or of the id of the scanned node with
+** a literal, or a test for the label the scan is restricted to, if any.
+*/
+static int isPushableFilter(LogicalPlanNode *pFilter, LogicalPlanNode *pScan) {
+  if( !pFilter->zAlias || strcmp(pFilter->zAlias, pScan->zAlias) != 0 ) return 0;
+
+  if( pFilter->type == LOGICAL_PROPERTY_FILTER ) {
+    return pFilter->zValue &&
+           isPushableOperator(pFilter->zOperator ? pFilter->zOperator : "=") &&
+           isBindableValue(pFilter->zValue, pFilter->zProperty == NULL);
+  }
+  if( pFilter->type == LOGICAL_LABEL_FILTER ) {
+    return pFilter->zLabel &&
+           (!pScan->zLabel || strcmp(pScan->zLabel, pFilter->zLabel) == 0);
+  }
+  return 0;
+}
+
+/*
+** Return the scan whose rows the filters at pNode filter, or NULL. Those
+** filters are either the tree of filters joined with the scan, in which
+** case *piFilter is set to its index among the join's children, or the
+** chain of filters rooted at pNode with the scan at its bottom, in which
+** case *piFilter is set to -1.
+*/
+static LogicalPlanNode *findPushdownScan(LogicalPlanNode *pNode, int *piFilter) {
+  int i;
+
+  if( (pNode->type == LOGICAL_HASH_JOIN || pNode->type == LOGICAL_NESTED_LOOP_JOIN) &&
+      pNode->nChildren == 2 ) {
+    for( i = 0; i < 2; i++ ) {
+      if( isPushdownScan(pNode->apChildren[i]) && isFilterNode(pNode->apChildren[1 - i]) ) {
+        *piFilter = 1 - i;
+        return pNode->apChildren[i];
+      }
+    }
+    return NULL;
+  }
+
+  *piFilter = -1;
+  while( isFilterNode(pNode) ) {
+    LogicalPlanNode *pNext = NULL;
+    for( i = 0; i < pNode->nChildren; i++ ) {
+      if( isPushdownScan(pNode->apChildren[i]) ) return pNode->apChildren[i];
+      if( isFilterNode(pNode->apChildren[i]) ) pNext = pNode->apChildren[i];
+    }
+    pNode = pNext;
+  }
+  return NULL;
+}
+
+/*
+** Append the pushable filters of the filter tree pNode to the array
+** *papCandidates of *pnCandidates entries.
+*/
+static int collectPushdownFilters(LogicalPlanNode *pNode, LogicalPlanNode *pScan,
+                                  LogicalPlanNode ***papCandidates, int *pnCandidates) {
+  int i, rc;
+
+  if( !isFilterNode(pNode) ) return SQLITE_OK;
+
+  if( isPushableFilter(pNode, pScan) ) {
+    LogicalPlanNode **apNew = sqlite3_realloc(*papCandidates,
+                                   (*pnCandidates + 1) * sizeof(LogicalPlanNode*));
+    if( !apNew ) return SQLITE_NOMEM;
+    apNew[(*pnCandidates)++] = pNode;
+    *papCandidates = apNew;
+  }
+  for( i = 0; i < pNode->nChildren; i++ ) {
+    rc = collectPushdownFilters(pNode->apChildren[i], pScan, papCandidates, pnCandidates);
+    if( rc != SQLITE_OK ) return rc;
+  }
+  return SQLITE_OK;
+}
+
+static int identifyCandidates(LogicalPlanNode *pNode, LogicalPlanNode ***papCandidates,
+                              int *pnCandidates) {
+  LogicalPlanNode *pScan;
+  int iFilter, i, rc;
+
+  if( !pNode ) return SQLITE_OK;
+
+  pScan = findPushdownScan(pNode, &iFilter);
+  if( pScan ) {
+    return collectPushdownFilters(iFilter >= 0 ? pNode->apChildren[iFilter] : pNode,
+                                  pScan, papCandidates, pnCandidates);
+  }
+  for( i = 0; i < pNode->nChildren; i++ ) {
+    rc = identifyCandidates(pNode->apChildren[i], papCandidates, pnCandidates);
+    if( rc != SQLITE_OK ) return rc;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Find the filters of pPlan that a scan could evaluate in its SQL. On
+** success *papCandidates is set to an array of the *pnCandidates filter
+** nodes, which the caller frees with sqlite3_free(). The plan is not
+** changed.
+*/
+int cypherIdentifyPushdownCandidates(LogicalPlanNode *pPlan,
+                                   LogicalPlanNode ***papCandidates,
+                                   int *pnCandidates) {
+  int rc;
+
+  if( !papCandidates || !pnCandidates ) return SQLITE_MISUSE;
+  *papCandidates = NULL;
+  *pnCandidates = 0;
+
+  rc = identifyCandidates(pPlan, papCandidates, pnCandidates);
+  if( rc != SQLITE_OK ) {
+    sqlite3_free(*papCandidates);
+    *papCandidates = NULL;
+    *pnCandidates = 0;
+  }
+  return rc;
+}
+
+/*
+** Make the scan pScan evaluate the filter pFilter. An equality the scan's
+** index key already answers needs nothing more. An ordering comparison
+** in the key is pushed all the same, for the JSON type test the scan adds
+** to it (see scanFilterSql()).
+*/
+static int pushFilter(LogicalPlanNode *pFilter, LogicalPlanNode *pScan) {
+  const char *zOp = pFilter->zOperator ? pFilter->zOperator : "=";
+  int i;
+
+  if( pFilter->type == LOGICAL_LABEL_FILTER ) {
+    if( pScan->zLabel ) return SQLITE_OK;
+    if( logicalPlanNodeSetLabel(pScan, pFilter->zLabel) != SQLITE_OK ) return SQLITE_NOMEM;
+    if( pScan->type == LOGICAL_NODE_SCAN ) pScan->type = LOGICAL_LABEL_SCAN;
+    pScan->iEstimatedRows = pScan->iEstimatedRows / 10;
+    return SQLITE_OK;
+  }
+
+  if( pFilter->zProperty && strcmp(zOp, "=") == 0 ) {
+    for( i = 0; i < pScan->nIndexKey; i++ ) {
+      PlanPredicate *pKey = &pScan->aIndexKey[i];
+      if( strcmp(pKey->zProperty, pFilter->zProperty) == 0 &&
+          strcmp(pKey->zOperator, zOp) == 0 && strcmp(pKey->zValue, pFilter->zValue) == 0 ) {
+        return SQLITE_OK;
+      }
+    }
+  }
+  return logicalPlanNodeAddScanFilter(pScan, pFilter->zProperty, zOp, pFilter->zValue);
+}
+
+/*
+** Remove the filter pFilter from the plan and free it. Its children take
+** its place under a filter among them, preferably, so that a chain of
+** filters over a scan stays one. Returns the node now in its place, or
+** NULL if it had no children.
+*/
+static LogicalPlanNode *removeFilter(LogicalPlanNode *pFilter) {
+  LogicalPlanNode *pKeep = NULL;
+  int i;
+
+  for( i = 0; i < pFilter->nChildren && !isFilterNode(pKeep); i++ ) {
+    pKeep = pFilter->apChildren[i];
+  }
+  if( pKeep ) {
+    /* Make room first, so that the children cannot be left split */
+    int nNeed = pKeep->nChildren + pFilter->nChildren - 1;
+    if( nNeed > pKeep->nChildrenAlloc ) {
+      LogicalPlanNode **apNew = sqlite3_realloc(pKeep->apChildren,
+                                                nNeed * sizeof(LogicalPlanNode*));
+      if( !apNew ) return pFilter;
+      pKeep->apChildren = apNew;
+      pKeep->nChildrenAlloc = nNeed;
+    }
+    for( i = 0; i < pFilter->nChildren; i++ ) {
+      LogicalPlanNode *pChild = pFilter->apChildren[i];
+      if( pChild != pKeep ) logicalPlanNodeAddChild(pKeep, pChild);
+    }
+    pKeep->pParent = pFilter->pParent;
+  }
+  pFilter->nChildren = 0;
+  logicalPlanNodeDestroy(pFilter);
+  return pKeep;
+}
+
+/*
+** Push the pushable filters in the filter tree at *ppNode into pScan and
+** remove them from the tree. *ppNode is set to what is left in its place,
+** NULL if the whole tree was pushed.
+*/
+static int pushdownFilterTree(LogicalPlanNode **ppNode, LogicalPlanNode *pScan) {
+  LogicalPlanNode *pNode = *ppNode;
+  int bPushed;
+  int i = 0;
+  int rc;
+
+  if( !isFilterNode(pNode) ) return SQLITE_OK;
+
+  /* The scan evaluates the filters in the order written */
+  bPushed = isPushableFilter(pNode, pScan);
+  if( bPushed ) {
+    rc = pushFilter(pNode, pScan);
+    if( rc != SQLITE_OK ) return rc;
+  }
+  while( i < pNode->nChildren ) {
+    rc = pushdownFilterTree(&pNode->apChildren[i], pScan);
+    if( rc != SQLITE_OK ) return rc;
+    if( pNode->apChildren[i] ) {
+      i++;
+    } else {
+      memmove(&pNode->apChildren[i], &pNode->apChildren[i + 1],
+              (pNode->nChildren - i - 1) * sizeof(LogicalPlanNode*));
+      pNode->nChildren--;
+    }
+  }
+
+  if( bPushed ) *ppNode = removeFilter(pNode);
+  return SQLITE_OK;
+}
+
+static int pushdownNode(LogicalPlanNode **ppNode) {
+  LogicalPlanNode *pNode = *ppNode;
+  LogicalPlanNode *pScan;
+  int iFilter, i, rc;
+
+  if( !pNode ) return SQLITE_OK;
+
+  pScan = findPushdownScan(pNode, &iFilter);
+  if( pScan && iFilter < 0 ) {
+    return pushdownFilterTree(ppNode, pScan);
+  }
+  if( pScan ) {
+    rc = pushdownFilterTree(&pNode->apChildren[iFilter], pScan);
+    if( rc == SQLITE_OK && !pNode->apChildren[iFilter] ) {
+      /* Every filter was pushed: the scan replaces the join */
+      pScan->pParent = pNode->pParent;
+      *ppNode = pScan;
+      pNode->nChildren = 0;
+      logicalPlanNodeDestroy(pNode);
+    }
+    return rc;
+  }
+
+  for( i = 0; i < pNode->nChildren; i++ ) {
+    rc = pushdownNode(&pNode->apChildren[i]);
+    if( rc != SQLITE_OK ) return rc;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Move the filters a scan can evaluate into the scan, as comparisons its
+** SQL checks with bound parameters, and remove them from the plan. A
+** join left with the scan alone is replaced by the scan, so *ppPlan may
+** change. pOptimizer may be NULL; otherwise its bEnablePushdown setting
+** is honoured.
+*/
+int cypherPushdownPredicates(CypherOptimizer *pOptimizer,
+                           LogicalPlanNode **ppPlan) {
+  if( !ppPlan ) return SQLITE_MISUSE;
+  if( pOptimizer && !pOptimizer->bEnablePushdown ) return SQLITE_OK;
+  return pushdownNode(ppPlan);
+}
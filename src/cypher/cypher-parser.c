@@ -35,6 +35,7 @@ extern const sqlite3_api_routines *sqlite3_api;
 
 #include "cypher.h"
 #include "cypher-errors.h"
+#include "cypher-paths.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -46,16 +47,18 @@ static CypherAst *parseSingleQuery(CypherLexer *pLexer, CypherParser *pParser);
 static CypherAst *parseMatchClause(CypherLexer *pLexer, CypherParser *pParser);
 static CypherAst *parsePatternList(CypherLexer *pLexer, CypherParser *pParser);
 static CypherAst *parsePattern(CypherLexer *pLexer, CypherParser *pParser);
+static CypherAst *parsePatternChain(CypherLexer *pLexer, CypherParser *pParser, CypherAst *pPattern);
 static CypherAst *parseNodePattern(CypherLexer *pLexer, CypherParser *pParser);
 static CypherAst *parseNodeLabels(CypherLexer *pLexer, CypherParser *pParser);
 static CypherAst *parsePropertyMap(CypherLexer *pLexer, CypherParser *pParser);
 static CypherAst *parseListLiteral(CypherLexer *pLexer, CypherParser *pParser);
 static CypherAst *parseMapLiteral(CypherLexer *pLexer, CypherParser *pParser);
 static CypherAst *parseFunctionCall(CypherLexer *pLexer, CypherParser *pParser, CypherAst *pFunctionName);
-/* static CypherAst *parseRelationshipPattern(CypherLexer *pLexer, CypherParser *pParser); */
+static CypherAst *parseRelationshipPattern(CypherLexer *pLexer, CypherParser *pParser);
 static CypherAst *parseWhereClause(CypherLexer *pLexer, CypherParser *pParser);
 static CypherAst *parseReturnClause(CypherLexer *pLexer, CypherParser *pParser);
 static CypherAst *parseProjectionList(CypherLexer *pLexer, CypherParser *pParser);
+static CypherAst *parseOrderBy(CypherLexer *pLexer, CypherParser *pParser);
 static CypherAst *parseProjectionItem(CypherLexer *pLexer, CypherParser *pParser);
 static CypherAst *parseExpression(CypherLexer *pLexer, CypherParser *pParser);
 static CypherAst *parseOrExpression(CypherLexer *pLexer, CypherParser *pParser);
@@ -90,13 +93,59 @@ static CypherToken *parserPeekToken(CypherLexer *pLexer) {
     return token;
 }
 
+// Consume the next token if it has the expected type. A token of any other
+// type is left in place, so that callers can try the alternatives. The
+// returned token is only valid until the next token is peeked or consumed.
 static CypherToken *parserConsumeToken(CypherLexer *pLexer, CypherTokenType expectedType) {
-    CypherToken *token = cypherLexerNextToken(pLexer);
-    printf("Consumed token: type=%d, text='%.*s', line=%d, column=%d\n", token->type, token->len, token->text, token->line, token->column);
-    if (token->type != expectedType) {
+    CypherToken *token = parserPeekToken(pLexer);
+    if (!token || token->type != expectedType) {
         return NULL;
     }
-    return token;
+    return cypherLexerNextToken(pLexer);
+}
+
+// Create an AST node of the given type whose value is the text of pToken.
+// Token text points into the query and is not terminated. String literals
+// keep their quotes, which is how later stages tell them from other
+// literals.
+static CypherAst *parserTokenAst(CypherToken *pToken, CypherAstNodeType type) {
+    CypherAst *pAst = cypherAstCreate(type, pToken->line, pToken->column);
+    char *zText;
+    if (!pAst) return NULL;
+    if (pToken->type == CYPHER_TOK_STRING) {
+        zText = sqlite3_mprintf("%.*s", pToken->len + 2, pToken->text - 1);
+    } else {
+        zText = sqlite3_mprintf("%.*s", pToken->len, pToken->text);
+    }
+    cypherAstSetValue(pAst, zText);
+    sqlite3_free(zText);
+    if (!pAst->zValue) {
+        cypherAstDestroy(pAst);
+        return NULL;
+    }
+    return pAst;
+}
+
+// Source text of an operator token
+static const char *parserOperatorText(CypherTokenType type) {
+    switch (type) {
+        case CYPHER_TOK_EQ: return "=";
+        case CYPHER_TOK_NE: return "<>";
+        case CYPHER_TOK_LT: return "<";
+        case CYPHER_TOK_LE: return "<=";
+        case CYPHER_TOK_GT: return ">";
+        case CYPHER_TOK_GE: return ">=";
+        case CYPHER_TOK_STARTS_WITH: return "STARTS WITH";
+        case CYPHER_TOK_ENDS_WITH: return "ENDS WITH";
+        case CYPHER_TOK_CONTAINS: return "CONTAINS";
+        case CYPHER_TOK_IN: return "IN";
+        case CYPHER_TOK_PLUS: return "+";
+        case CYPHER_TOK_MINUS: return "-";
+        case CYPHER_TOK_MULT: return "*";
+        case CYPHER_TOK_DIV: return "/";
+        case CYPHER_TOK_MOD: return "%";
+        default: return NULL;
+    }
 }
 
 CypherParser *cypherParserCreate(void) {
@@ -234,6 +283,11 @@ int cypherValidateQuery(const char *zQuery, char **pzError) {
     return result;
 }
 
+/*
+** A query is a single query followed by any number of UNION [ALL] single
+** query parts. Each part becomes a UNION child of the QUERY node holding
+** the single query, flagged CYPHER_AST_FLAG_ALL for UNION ALL.
+*/
 static CypherAst *parseQuery(CypherLexer *pLexer, CypherParser *pParser) {
     CypherAst *pQuery = cypherAstCreate(CYPHER_AST_QUERY, 0, 0);
     CypherAst *pSingleQuery = parseSingleQuery(pLexer, pParser);
@@ -242,6 +296,27 @@ static CypherAst *parseQuery(CypherLexer *pLexer, CypherParser *pParser) {
         return NULL;
     }
     cypherAstAddChild(pQuery, pSingleQuery);
+
+    while (parserPeekToken(pLexer)->type == CYPHER_TOK_UNION) {
+        CypherToken *pToken = parserConsumeToken(pLexer, CYPHER_TOK_UNION);
+        CypherAst *pUnion = cypherAstCreate(CYPHER_AST_UNION, pToken->line, pToken->column);
+        cypherAstAddChild(pQuery, pUnion);
+
+        // ALL is not a keyword token
+        pToken = parserPeekToken(pLexer);
+        if (pToken->type == CYPHER_TOK_IDENTIFIER && pToken->len == 3 &&
+            strncasecmp(pToken->text, "ALL", 3) == 0) {
+            parserConsumeToken(pLexer, CYPHER_TOK_IDENTIFIER);
+            pUnion->iFlags |= CYPHER_AST_FLAG_ALL;
+        }
+
+        pSingleQuery = parseSingleQuery(pLexer, pParser);
+        if (!pSingleQuery) {
+            cypherAstDestroy(pQuery);
+            return NULL;
+        }
+        cypherAstAddChild(pUnion, pSingleQuery);
+    }
     return pQuery;
 }
 
@@ -272,14 +347,11 @@ static CypherAst *parseSingleQuery(CypherLexer *pLexer, CypherParser *pParser) {
         cypherAstAddChild(pSingleQuery, pReturnClause);
     }
 
-    // Consume tokens until EOF
-    CypherToken *token;
-    do {
-        token = cypherLexerNextToken(pLexer);
-    } while (token->type != CYPHER_TOK_EOF && token->type != CYPHER_TOK_ERROR);
-
-    if (token->type == CYPHER_TOK_ERROR) {
-        parserSetError(pParser, pLexer, "Syntax error");
+    // The query ends here, or at the UNION of the next part
+    parserConsumeToken(pLexer, CYPHER_TOK_SEMICOLON);
+    CypherToken *token = parserPeekToken(pLexer);
+    if (token->type != CYPHER_TOK_EOF && token->type != CYPHER_TOK_UNION) {
+        if (!pParser->zErrorMsg) parserSetError(pParser, pLexer, "Syntax error");
         cypherAstDestroy(pSingleQuery);
         return NULL;
     }
@@ -302,25 +374,99 @@ static CypherAst *parseMatchClause(CypherLexer *pLexer, CypherParser *pParser) {
     return pMatchClause;
 }
 
+/*
+** The patterns of a MATCH, separated by commas, each become a PATTERN
+** child of the returned PATTERN node.
+*/
 static CypherAst *parsePatternList(CypherLexer *pLexer, CypherParser *pParser) {
     CypherAst *pPatternList = cypherAstCreate(CYPHER_AST_PATTERN, 0, 0);
-    CypherAst *pPattern = parsePattern(pLexer, pParser);
-    if (!pPattern) {
-        cypherAstDestroy(pPatternList);
-        return NULL;
-    }
-    cypherAstAddChild(pPatternList, pPattern);
+    do {
+        CypherAst *pPattern = parsePattern(pLexer, pParser);
+        if (!pPattern) {
+            cypherAstDestroy(pPatternList);
+            return NULL;
+        }
+        cypherAstAddChild(pPatternList, pPattern);
+    } while (parserConsumeToken(pLexer, CYPHER_TOK_COMMA));
     return pPatternList;
 }
 
+/*
+** A pattern is a chain (a)-[r]->(b)<-[s]-(c), held as a PATTERN node with
+** the node and relationship patterns as alternating children, or a call
+** p = shortestPath((a)-[*..n]-(b)). The call becomes a PATTERN holding the
+** path variable, if any, and a FUNCTION_CALL whose value is the function
+** name and whose child is the chain.
+*/
 static CypherAst *parsePattern(CypherLexer *pLexer, CypherParser *pParser) {
     CypherAst *pPattern = cypherAstCreate(CYPHER_AST_PATTERN, 0, 0);
+    CypherToken *pToken = parserConsumeToken(pLexer, CYPHER_TOK_IDENTIFIER);
+    if (!pToken) {
+        return parsePatternChain(pLexer, pParser, pPattern);
+    }
+
+    CypherAst *pName = parserTokenAst(pToken, CYPHER_AST_IDENTIFIER);
+    if (pName && parserConsumeToken(pLexer, CYPHER_TOK_EQ)) {
+        // p = ..., the path variable
+        cypherAstAddChild(pPattern, pName);
+        pToken = parserConsumeToken(pLexer, CYPHER_TOK_IDENTIFIER);
+        if (!pToken) {
+            parserSetError(pParser, pLexer, "Path variables are only supported with shortestPath()");
+            cypherAstDestroy(pPattern);
+            return NULL;
+        }
+        pName = parserTokenAst(pToken, CYPHER_AST_IDENTIFIER);
+    }
+    if (!pName || !parserConsumeToken(pLexer, CYPHER_TOK_LPAREN)) {
+        if (pName) parserSetError(pParser, pLexer, "Expected ( after %s", pName->zValue);
+        cypherAstDestroy(pName);
+        cypherAstDestroy(pPattern);
+        return NULL;
+    }
+
+    CypherAst *pCall = cypherAstCreate(CYPHER_AST_FUNCTION_CALL, pName->iLine, pName->iColumn);
+    cypherAstSetValue(pCall, pName->zValue);
+    cypherAstDestroy(pName);
+    cypherAstAddChild(pPattern, pCall);
+    CypherAst *pChain = parsePatternChain(pLexer, pParser, cypherAstCreate(CYPHER_AST_PATTERN, 0, 0));
+    if (!pChain) {
+        cypherAstDestroy(pPattern);
+        return NULL;
+    }
+    cypherAstAddChild(pCall, pChain);
+    if (!parserConsumeToken(pLexer, CYPHER_TOK_RPAREN)) {
+        parserSetError(pParser, pLexer, "Expected ) after pattern");
+        cypherAstDestroy(pPattern);
+        return NULL;
+    }
+    return pPattern;
+}
+
+// Add the nodes and relationships of a chain to pPattern
+static CypherAst *parsePatternChain(CypherLexer *pLexer, CypherParser *pParser, CypherAst *pPattern) {
     CypherAst *pNodePattern = parseNodePattern(pLexer, pParser);
     if (!pNodePattern) {
         cypherAstDestroy(pPattern);
         return NULL;
     }
     cypherAstAddChild(pPattern, pNodePattern);
+
+    CypherTokenType eNext = parserPeekToken(pLexer)->type;
+    while (eNext == CYPHER_TOK_MINUS || eNext == CYPHER_TOK_ARROW_LEFT) {
+        CypherAst *pRelPattern = parseRelationshipPattern(pLexer, pParser);
+        if (!pRelPattern) {
+            cypherAstDestroy(pPattern);
+            return NULL;
+        }
+        cypherAstAddChild(pPattern, pRelPattern);
+        pNodePattern = parseNodePattern(pLexer, pParser);
+        if (!pNodePattern) {
+            cypherAstDestroy(pPattern);
+            return NULL;
+        }
+        cypherAstAddChild(pPattern, pNodePattern);
+        eNext = parserPeekToken(pLexer)->type;
+    }
     return pPattern;
 }
 
@@ -332,12 +478,15 @@ static CypherAst *parseNodePattern(CypherLexer *pLexer, CypherParser *pParser) {
     CypherAst *pNodePattern = cypherAstCreate(CYPHER_AST_NODE_PATTERN, 0, 0);
     CypherToken *pId = parserConsumeToken(pLexer, CYPHER_TOK_IDENTIFIER);
     if (pId) {
-        cypherAstAddChild(pNodePattern, cypherAstCreateIdentifier(pId->text, pId->line, pId->column));
+        cypherAstAddChild(pNodePattern, parserTokenAst(pId, CYPHER_AST_IDENTIFIER));
     }
 
     CypherAst *pLabels = parseNodeLabels(pLexer, pParser);
     if (pLabels) {
         cypherAstAddChild(pNodePattern, pLabels);
+    } else if (pParser->zErrorMsg) {
+        cypherAstDestroy(pNodePattern);
+        return NULL;
     }
 
     // Check for property map
@@ -369,7 +518,7 @@ static CypherAst *parseNodeLabels(CypherLexer *pLexer, CypherParser *pParser) {
         parserSetError(pParser, pLexer, "Expected node label after ':'");
         return NULL;
     }
-    return cypherAstCreateNodeLabel(pLabel->text, pLabel->line, pLabel->column);
+    return parserTokenAst(pLabel, CYPHER_AST_LABELS);
 }
 
 static CypherAst *parsePropertyMap(CypherLexer *pLexer, CypherParser *pParser) {
@@ -388,13 +537,15 @@ static CypherAst *parsePropertyMap(CypherLexer *pLexer, CypherParser *pParser) {
     
     // Parse property pairs
     do {
-        // Parse key (identifier)
+        // Parse key (identifier), kept as the value of the pair
         CypherToken *pKey = parserConsumeToken(pLexer, CYPHER_TOK_IDENTIFIER);
-        if (!pKey) {
+        CypherAst *pPair = pKey ? parserTokenAst(pKey, CYPHER_AST_PROPERTY_PAIR) : NULL;
+        if (!pPair) {
             parserSetError(pParser, pLexer, "Expected property name");
             cypherAstDestroy(pMap);
             return NULL;
         }
+        cypherAstAddChild(pMap, pPair);
         
         // Parse colon
         if (!parserConsumeToken(pLexer, CYPHER_TOK_COLON)) {
@@ -410,12 +561,7 @@ static CypherAst *parsePropertyMap(CypherLexer *pLexer, CypherParser *pParser) {
             cypherAstDestroy(pMap);
             return NULL;
         }
-        
-        // Create property pair
-        CypherAst *pPair = cypherAstCreate(CYPHER_AST_PROPERTY_PAIR, pKey->line, pKey->column);
-        cypherAstSetValue(pPair, pKey->text);
         cypherAstAddChild(pPair, pValue);
-        cypherAstAddChild(pMap, pPair);
         
         // Check for comma
         CypherToken *pComma = parserPeekToken(pLexer);
@@ -435,39 +581,74 @@ static CypherAst *parsePropertyMap(CypherLexer *pLexer, CypherParser *pParser) {
     return pMap;
 }
 
-/* Currently unused - reserved for future relationship pattern parsing
+/*
+** A relationship between two node patterns: -[r:TYPE*min..max]->, <-[...]-
+** or -[...]-, with every part of the bracket optional and the bracket
+** itself optional (-->, <--, --). The REL_PATTERN value is the direction,
+** "->", "<-" or "-", and its children are the variable, a LABELS node
+** holding the type, and the bounds as a literal "*min..max".
+*/
 static CypherAst *parseRelationshipPattern(CypherLexer *pLexer, CypherParser *pParser) {
-    CypherToken *pArrow = parserConsumeToken(pLexer, CYPHER_TOK_ARROW_RIGHT);
-    if (!pArrow) {
-        pArrow = parserConsumeToken(pLexer, CYPHER_TOK_ARROW_LEFT);
-    }
-    if (!pArrow) {
-        return NULL;
-    }
-
-    CypherAst *pRelPattern = cypherAstCreate(CYPHER_AST_REL_PATTERN, pArrow->line, pArrow->column);
-    cypherAstSetValue(pRelPattern, pArrow->text);
-
-    if (!parserConsumeToken(pLexer, CYPHER_TOK_LBRACKET)) {
-        parserSetError(pParser, pLexer, "Expected [");
-        cypherAstDestroy(pRelPattern);
-        return NULL;
+    CypherToken *pToken = parserPeekToken(pLexer);
+    CypherAst *pRelPattern = cypherAstCreate(CYPHER_AST_REL_PATTERN, pToken->line, pToken->column);
+    int bLeft = parserConsumeToken(pLexer, CYPHER_TOK_ARROW_LEFT) != NULL;
+    if (!bLeft) {
+        parserConsumeToken(pLexer, CYPHER_TOK_MINUS);
     }
 
-    CypherToken *pId = parserConsumeToken(pLexer, CYPHER_TOK_IDENTIFIER);
-    if (pId) {
-        cypherAstAddChild(pRelPattern, cypherAstCreateIdentifier(pId->text, pId->line, pId->column));
+    if (parserConsumeToken(pLexer, CYPHER_TOK_LBRACKET)) {
+        CypherToken *pId = parserConsumeToken(pLexer, CYPHER_TOK_IDENTIFIER);
+        if (pId) {
+            cypherAstAddChild(pRelPattern, parserTokenAst(pId, CYPHER_AST_IDENTIFIER));
+        }
+        if (parserConsumeToken(pLexer, CYPHER_TOK_COLON)) {
+            CypherToken *pType = parserConsumeToken(pLexer, CYPHER_TOK_IDENTIFIER);
+            if (!pType) {
+                parserSetError(pParser, pLexer, "Expected relationship type after ':'");
+                cypherAstDestroy(pRelPattern);
+                return NULL;
+            }
+            cypherAstAddChild(pRelPattern, parserTokenAst(pType, CYPHER_AST_LABELS));
+        }
+        pToken = parserConsumeToken(pLexer, CYPHER_TOK_MULT);
+        if (pToken) {
+            // The bounds are read back from their source text
+            const char *zStart = pToken->text;
+            parserConsumeToken(pLexer, CYPHER_TOK_INTEGER);
+            if (parserConsumeToken(pLexer, CYPHER_TOK_DOT)) {
+                if (!parserConsumeToken(pLexer, CYPHER_TOK_DOT)) {
+                    parserSetError(pParser, pLexer, "Expected .. in relationship length");
+                    cypherAstDestroy(pRelPattern);
+                    return NULL;
+                }
+                parserConsumeToken(pLexer, CYPHER_TOK_INTEGER);
+            }
+            char *zBounds = sqlite3_mprintf("%.*s", (int)(&pLexer->zInput[pLexer->iPos] - zStart), zStart);
+            if (!zBounds || !cypherCreateVariableLengthPath(pRelPattern, zBounds)) {
+                sqlite3_free(zBounds);
+                cypherAstDestroy(pRelPattern);
+                return NULL;
+            }
+            sqlite3_free(zBounds);
+        }
+        if (!parserConsumeToken(pLexer, CYPHER_TOK_RBRACKET)) {
+            parserSetError(pParser, pLexer, "Expected ]");
+            cypherAstDestroy(pRelPattern);
+            return NULL;
+        }
     }
 
-    if (!parserConsumeToken(pLexer, CYPHER_TOK_RBRACKET)) {
-        parserSetError(pParser, pLexer, "Expected ]");
+    if (parserConsumeToken(pLexer, CYPHER_TOK_ARROW_RIGHT)) {
+        cypherAstSetValue(pRelPattern, bLeft ? "-" : "->");
+    } else if (parserConsumeToken(pLexer, CYPHER_TOK_MINUS)) {
+        cypherAstSetValue(pRelPattern, bLeft ? "<-" : "-");
+    } else {
+        parserSetError(pParser, pLexer, "Expected - or -> after relationship");
         cypherAstDestroy(pRelPattern);
         return NULL;
     }
-
     return pRelPattern;
 }
-*/
 
 static CypherAst *parseWhereClause(CypherLexer *pLexer, CypherParser *pParser) {
     if (!parserConsumeToken(pLexer, CYPHER_TOK_WHERE)) {
@@ -489,34 +670,120 @@ static CypherAst *parseReturnClause(CypherLexer *pLexer, CypherParser *pParser)
         return NULL;
     }
     CypherAst *pReturnClause = cypherAstCreate(CYPHER_AST_RETURN, 0, 0);
+    if (parserPeekToken(pLexer)->type == CYPHER_TOK_DISTINCT) {
+        parserConsumeToken(pLexer, CYPHER_TOK_DISTINCT);
+        pReturnClause->iFlags |= CYPHER_AST_FLAG_DISTINCT;
+    }
     CypherAst *pProjectionList = parseProjectionList(pLexer, pParser);
     if (!pProjectionList) {
         cypherAstDestroy(pReturnClause);
         return NULL;
     }
     cypherAstAddChild(pReturnClause, pProjectionList);
+
+    if (parserPeekToken(pLexer)->type == CYPHER_TOK_ORDER) {
+        CypherAst *pOrderBy = parseOrderBy(pLexer, pParser);
+        if (!pOrderBy) {
+            cypherAstDestroy(pReturnClause);
+            return NULL;
+        }
+        cypherAstAddChild(pReturnClause, pOrderBy);
+    }
+
+    if (parserPeekToken(pLexer)->type == CYPHER_TOK_SKIP) {
+        parserConsumeToken(pLexer, CYPHER_TOK_SKIP);
+        CypherToken *pToken = parserConsumeToken(pLexer, CYPHER_TOK_INTEGER);
+        if (!pToken) {
+            parserSetError(pParser, pLexer, "Expected integer after SKIP");
+            cypherAstDestroy(pReturnClause);
+            return NULL;
+        }
+        CypherAst *pSkip = cypherAstCreate(CYPHER_AST_SKIP, pToken->line, pToken->column);
+        cypherAstAddChild(pSkip, parserTokenAst(pToken, CYPHER_AST_LITERAL));
+        cypherAstAddChild(pReturnClause, pSkip);
+    }
+
+    if (parserPeekToken(pLexer)->type == CYPHER_TOK_LIMIT) {
+        parserConsumeToken(pLexer, CYPHER_TOK_LIMIT);
+        CypherToken *pToken = parserConsumeToken(pLexer, CYPHER_TOK_INTEGER);
+        if (!pToken) {
+            parserSetError(pParser, pLexer, "Expected integer after LIMIT");
+            cypherAstDestroy(pReturnClause);
+            return NULL;
+        }
+        CypherAst *pLimit = cypherAstCreate(CYPHER_AST_LIMIT, pToken->line, pToken->column);
+        cypherAstAddChild(pLimit, parserTokenAst(pToken, CYPHER_AST_LITERAL));
+        cypherAstAddChild(pReturnClause, pLimit);
+    }
     return pReturnClause;
 }
 
-static CypherAst *parseProjectionList(CypherLexer *pLexer, CypherParser *pParser) {
-    CypherAst *pProjectionList = cypherAstCreate(CYPHER_AST_PROJECTION_LIST, 0, 0);
-    CypherAst *pProjectionItem = parseProjectionItem(pLexer, pParser);
-    if (!pProjectionItem) {
-        cypherAstDestroy(pProjectionList);
+/*
+** ORDER BY expr [ASC|DESC], ... becomes an ORDER_BY node with one
+** SORT_ITEM per key. Each SORT_ITEM holds the expression and has the
+** value "ASC" or "DESC".
+*/
+static CypherAst *parseOrderBy(CypherLexer *pLexer, CypherParser *pParser) {
+    parserConsumeToken(pLexer, CYPHER_TOK_ORDER);
+    if (!parserConsumeToken(pLexer, CYPHER_TOK_BY)) {
+        parserSetError(pParser, pLexer, "Expected BY after ORDER");
         return NULL;
     }
-    cypherAstAddChild(pProjectionList, pProjectionItem);
+    CypherAst *pOrderBy = cypherAstCreate(CYPHER_AST_ORDER_BY, 0, 0);
+    do {
+        CypherAst *pExpr = parseExpression(pLexer, pParser);
+        if (!pExpr) {
+            parserSetError(pParser, pLexer, "Expected expression in ORDER BY");
+            cypherAstDestroy(pOrderBy);
+            return NULL;
+        }
+        CypherAst *pItem = cypherAstCreate(CYPHER_AST_SORT_ITEM, 0, 0);
+        cypherAstAddChild(pItem, pExpr);
+        CypherTokenType eDir = parserPeekToken(pLexer)->type;
+        if (eDir == CYPHER_TOK_ASC || eDir == CYPHER_TOK_DESC) {
+            parserConsumeToken(pLexer, eDir);
+        }
+        cypherAstSetValue(pItem, eDir == CYPHER_TOK_DESC ? "DESC" : "ASC");
+        cypherAstAddChild(pOrderBy, pItem);
+        if (parserPeekToken(pLexer)->type != CYPHER_TOK_COMMA) break;
+        parserConsumeToken(pLexer, CYPHER_TOK_COMMA);
+    } while (1);
+    return pOrderBy;
+}
+
+static CypherAst *parseProjectionList(CypherLexer *pLexer, CypherParser *pParser) {
+    CypherAst *pProjectionList = cypherAstCreate(CYPHER_AST_PROJECTION_LIST, 0, 0);
+    do {
+        CypherAst *pProjectionItem = parseProjectionItem(pLexer, pParser);
+        if (!pProjectionItem) {
+            cypherAstDestroy(pProjectionList);
+            return NULL;
+        }
+        cypherAstAddChild(pProjectionList, pProjectionItem);
+    } while (parserConsumeToken(pLexer, CYPHER_TOK_COMMA));
     return pProjectionList;
 }
 
+// expr [AS alias] becomes a PROJECTION_ITEM holding the expression and,
+// if given, the alias as an IDENTIFIER
 static CypherAst *parseProjectionItem(CypherLexer *pLexer, CypherParser *pParser) {
     CypherAst *pProjectionItem = cypherAstCreate(CYPHER_AST_PROJECTION_ITEM, 0, 0);
     CypherAst *pExpr = parseExpression(pLexer, pParser);
     if (!pExpr) {
+        if (!pParser->zErrorMsg) parserSetError(pParser, pLexer, "Expected expression in RETURN");
         cypherAstDestroy(pProjectionItem);
         return NULL;
     }
     cypherAstAddChild(pProjectionItem, pExpr);
+    if (parserConsumeToken(pLexer, CYPHER_TOK_AS)) {
+        CypherToken *pAlias = parserConsumeToken(pLexer, CYPHER_TOK_IDENTIFIER);
+        if (!pAlias) {
+            parserSetError(pParser, pLexer, "Expected alias after AS");
+            cypherAstDestroy(pProjectionItem);
+            return NULL;
+        }
+        cypherAstAddChild(pProjectionItem, parserTokenAst(pAlias, CYPHER_AST_IDENTIFIER));
+    }
     return pProjectionItem;
 }
 
@@ -536,10 +803,7 @@ static CypherAst *parseOrExpression(CypherLexer *pLexer, CypherParser *pParser)
             parserSetError(pParser, pLexer, "Expected expression after OR");
             return NULL;
         }
-        CypherAst *pOrExpr = cypherAstCreateBinaryOp("OR", pLeft, pRight, 0, 0);
-        cypherAstAddChild(pOrExpr, pLeft);
-        cypherAstAddChild(pOrExpr, pRight);
-        pLeft = pOrExpr;
+        pLeft = cypherAstCreateBinaryOp("OR", pLeft, pRight, 0, 0);
     }
     return pLeft;
 }
@@ -590,7 +854,8 @@ static CypherAst *parseComparisonExpression(CypherLexer *pLexer, CypherParser *p
            pToken->type == CYPHER_TOK_GT || pToken->type == CYPHER_TOK_GE ||
            pToken->type == CYPHER_TOK_STARTS_WITH || pToken->type == CYPHER_TOK_ENDS_WITH ||
            pToken->type == CYPHER_TOK_CONTAINS || pToken->type == CYPHER_TOK_IN) {
-        parserConsumeToken(pLexer, pToken->type);
+        CypherTokenType eOp = pToken->type;
+        parserConsumeToken(pLexer, eOp);
         CypherAst *pRight = parseAdditiveExpression(pLexer, pParser);
         if (!pRight) {
             cypherAstDestroy(pLeft);
@@ -598,7 +863,7 @@ static CypherAst *parseComparisonExpression(CypherLexer *pLexer, CypherParser *p
             return NULL;
         }
         CypherAst *pCompExpr = cypherAstCreate(CYPHER_AST_COMPARISON, 0, 0);
-        cypherAstSetValue(pCompExpr, pToken->text);
+        cypherAstSetValue(pCompExpr, parserOperatorText(eOp));
         cypherAstAddChild(pCompExpr, pLeft);
         cypherAstAddChild(pCompExpr, pRight);
         pLeft = pCompExpr;
@@ -613,7 +878,8 @@ static CypherAst *parseAdditiveExpression(CypherLexer *pLexer, CypherParser *pPa
 
     CypherToken *pToken = parserPeekToken(pLexer);
     while (pToken->type == CYPHER_TOK_PLUS || pToken->type == CYPHER_TOK_MINUS) {
-        parserConsumeToken(pLexer, pToken->type);
+        CypherTokenType eOp = pToken->type;
+        parserConsumeToken(pLexer, eOp);
         CypherAst *pRight = parseMultiplicativeExpression(pLexer, pParser);
         if (!pRight) {
             cypherAstDestroy(pLeft);
@@ -621,7 +887,7 @@ static CypherAst *parseAdditiveExpression(CypherLexer *pLexer, CypherParser *pPa
             return NULL;
         }
         CypherAst *pAddExpr = cypherAstCreate(CYPHER_AST_ADDITIVE, 0, 0);
-        cypherAstSetValue(pAddExpr, pToken->text);
+        cypherAstSetValue(pAddExpr, parserOperatorText(eOp));
         cypherAstAddChild(pAddExpr, pLeft);
         cypherAstAddChild(pAddExpr, pRight);
         pLeft = pAddExpr;
@@ -636,7 +902,8 @@ static CypherAst *parseMultiplicativeExpression(CypherLexer *pLexer, CypherParse
 
     CypherToken *pToken = parserPeekToken(pLexer);
     while (pToken->type == CYPHER_TOK_MULT || pToken->type == CYPHER_TOK_DIV || pToken->type == CYPHER_TOK_MOD) {
-        parserConsumeToken(pLexer, pToken->type);
+        CypherTokenType eOp = pToken->type;
+        parserConsumeToken(pLexer, eOp);
         CypherAst *pRight = parseUnaryExpression(pLexer, pParser);
         if (!pRight) {
             cypherAstDestroy(pLeft);
@@ -644,7 +911,7 @@ static CypherAst *parseMultiplicativeExpression(CypherLexer *pLexer, CypherParse
             return NULL;
         }
         CypherAst *pMulExpr = cypherAstCreate(CYPHER_AST_MULTIPLICATIVE, 0, 0);
-        cypherAstSetValue(pMulExpr, pToken->text);
+        cypherAstSetValue(pMulExpr, parserOperatorText(eOp));
         cypherAstAddChild(pMulExpr, pLeft);
         cypherAstAddChild(pMulExpr, pRight);
         pLeft = pMulExpr;
@@ -656,16 +923,14 @@ static CypherAst *parseMultiplicativeExpression(CypherLexer *pLexer, CypherParse
 static CypherAst *parseUnaryExpression(CypherLexer *pLexer, CypherParser *pParser) {
     CypherToken *pToken = parserPeekToken(pLexer);
     if (pToken->type == CYPHER_TOK_PLUS || pToken->type == CYPHER_TOK_MINUS) {
-        parserConsumeToken(pLexer, pToken->type);
+        CypherTokenType eOp = pToken->type;
+        parserConsumeToken(pLexer, eOp);
         CypherAst *pExpr = parseUnaryExpression(pLexer, pParser);
         if (!pExpr) {
             parserSetError(pParser, pLexer, "Expected expression after unary operator");
             return NULL;
         }
-        CypherAst *pUnaryExpr = cypherAstCreateUnaryOp(pToken->text, pExpr, 0, 0);
-        cypherAstSetValue(pUnaryExpr, pToken->text);
-        cypherAstAddChild(pUnaryExpr, pExpr);
-        return pUnaryExpr;
+        return cypherAstCreateUnaryOp(parserOperatorText(eOp), pExpr, 0, 0);
     }
     return parsePrimaryExpression(pLexer, pParser);
 }
@@ -697,7 +962,7 @@ static CypherAst *parsePropertyExpression(CypherLexer *pLexer, CypherParser *pPa
         }
         CypherAst *pPropExpr = cypherAstCreate(CYPHER_AST_PROPERTY, 0, 0);
         cypherAstAddChild(pPropExpr, pExpr);
-        cypherAstAddChild(pPropExpr, cypherAstCreateIdentifier(pProperty->text, pProperty->line, pProperty->column));
+        cypherAstAddChild(pPropExpr, parserTokenAst(pProperty, CYPHER_AST_IDENTIFIER));
         pExpr = pPropExpr;
         pToken = parserPeekToken(pLexer);
     }
@@ -733,7 +998,7 @@ static CypherAst *parseLiteral(CypherLexer *pLexer, CypherParser *pParser) {
     // Handle identifiers separately from literals
     if (pToken->type == CYPHER_TOK_IDENTIFIER) {
         pToken = cypherLexerNextToken(pLexer);
-        return cypherAstCreateIdentifier(pToken->text, pToken->line, pToken->column);
+        return parserTokenAst(pToken, CYPHER_AST_IDENTIFIER);
     }
     
     // Handle basic literals
@@ -741,7 +1006,7 @@ static CypherAst *parseLiteral(CypherLexer *pLexer, CypherParser *pParser) {
         pToken->type == CYPHER_TOK_STRING || pToken->type == CYPHER_TOK_BOOLEAN || 
         pToken->type == CYPHER_TOK_NULL) {
         pToken = cypherLexerNextToken(pLexer);
-        return cypherAstCreateLiteral(pToken->text, pToken->line, pToken->column);
+        return parserTokenAst(pToken, CYPHER_AST_LITERAL);
     }
     
     return NULL;
@@ -812,7 +1077,7 @@ static CypherAst *parseMapLiteral(CypherLexer *pLexer, CypherParser *pParser) {
             return NULL;
         }
         pToken = cypherLexerNextToken(pLexer);
-        CypherAst *pKey = cypherAstCreateLiteral(pToken->text, pToken->line, pToken->column);
+        CypherAst *pKey = parserTokenAst(pToken, CYPHER_AST_LITERAL);
         
         // Expect colon
         if (!parserConsumeToken(pLexer, CYPHER_TOK_COLON)) {
@@ -862,13 +1127,23 @@ static CypherAst *parseFunctionCall(CypherLexer *pLexer, CypherParser *pParser,
     CypherAst *pFunctionCall = cypherAstCreate(CYPHER_AST_FUNCTION_CALL, 0, 0);
     cypherAstAddChild(pFunctionCall, pFunctionName);
     
-    // Handle empty function call func()
+    // Handle empty function call func() and count(*)
     CypherToken *pToken = parserPeekToken(pLexer);
+    if (pToken->type == CYPHER_TOK_MULT) {
+        parserConsumeToken(pLexer, CYPHER_TOK_MULT);
+        pToken = parserPeekToken(pLexer);
+    }
     if (pToken->type == CYPHER_TOK_RPAREN) {
         parserConsumeToken(pLexer, CYPHER_TOK_RPAREN);
         return pFunctionCall;
     }
     
+    // Aggregates over distinct values: count(DISTINCT x)
+    if (pToken->type == CYPHER_TOK_DISTINCT) {
+        parserConsumeToken(pLexer, CYPHER_TOK_DISTINCT);
+        pFunctionCall->iFlags |= CYPHER_AST_FLAG_DISTINCT;
+    }
+    
     // Parse function arguments
     do {
         CypherAst *pArg = parseExpression(pLexer, pParser);
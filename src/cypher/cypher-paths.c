@@ -0,0 +1,985 @@
+/*
+** SQLite Graph Database Extension - Variable-Length Paths
+**
+** This file implements path enumeration for variable-length relationship
+** patterns such as (a)-[:KNOWS*1..3]->(b). A PathWalker streams the paths
+** leaving one start node: depth first over the typed adjacency statements
+** of graphPrepareAdjacency(), holding one neighbour list per level, so that
+** memory grows with path length rather than with the number of paths.
+** When only the end nodes matter the walker can instead run a pruning
+** breadth-first search that reports every reachable node once, and for
+** shortestPath() it runs a breadth-first search from both ends that stops
+** at the first level where the two meet.
+**
+** Memory allocation: All functions use sqlite3_malloc()/sqlite3_free()
+** Error handling: Functions return SQLite error codes
+*/
+
+#include "sqlite3ext.h"
+#ifndef SQLITE_CORE
+extern const sqlite3_api_routines *sqlite3_api;
+#endif
+/* SQLITE_EXTENSION_INIT1 - removed to prevent multiple definition */
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include "cypher-paths.h"
+
+/*
+** Neighbour list of one node: (relationship, neighbour) pairs.
+*/
+typedef struct PathFrame {
+  sqlite3_int64 *aAdj;          /* 2*nAdj ids: rel, neighbour, ... */
+  int nAdj;
+  int nAdjAlloc;
+  int iNext;                    /* Next pair to follow */
+  int bLoaded;                  /* aAdj holds this level's node */
+} PathFrame;
+
+/*
+** End node reported by a pruning search.
+*/
+typedef struct PathHit {
+  sqlite3_int64 iNode;
+  int nDepth;
+} PathHit;
+
+struct PathWalker {
+  GraphVtab *pGraph;
+  sqlite3_stmt *apAdj[2];       /* Outgoing, incoming adjacency */
+  int direction;                /* CYPHER_PATH_* */
+  PathBounds bounds;
+  int bPrune;                   /* Breadth-first, end nodes only */
+
+  /* Depth-first state */
+  PathFrame *aFrame;            /* One neighbour list per level */
+  sqlite3_int64 *aNode;         /* Nodes on the current path */
+  sqlite3_int64 *aEdge;         /* Relationships on the current path */
+  int nLevelAlloc;
+  int iDepth;                   /* Length of the current path, -1 at end */
+  int bZero;                    /* Zero-length path still to report */
+
+  /* Pruning state */
+  PathHit *aHit;
+  int nHit;
+  int nHitAlloc;
+  int iHit;
+
+  /* Shortest-path state: nPath paths of nPathLen relationships */
+  int bShortest;                /* Bidirectional search, CYPHER_PATH_SHORTEST */
+  int bAllShortest;             /* Keep every shortest path */
+  sqlite3_int64 *aPathNode;     /* nPathLen+1 nodes per path */
+  sqlite3_int64 *aPathEdge;     /* nPathLen relationships per path */
+  int nPath;
+  int nPathAlloc;
+  int nPathLen;
+  int iPath;                    /* Paths returned so far */
+};
+
+/*
+** Parse the bounds of a variable-length pattern: "*" (1 or more), "*2"
+** (exactly 2), "*1..3", "*..3" or "*2..". A missing upper bound is -1.
+*/
+PathBounds cypherParsePathBounds(const char *pattern) {
+  PathBounds bounds;
+  const char *z = pattern;
+
+  bounds.minLength = 1;
+  bounds.maxLength = -1;
+  bounds.isOptional = 0;
+  if( !z ) return bounds;
+
+  while( isspace((unsigned char)*z) ) z++;
+  if( *z == '*' ) z++;
+  while( isspace((unsigned char)*z) ) z++;
+  if( isdigit((unsigned char)*z) ) {
+    bounds.minLength = atoi(z);
+    while( isdigit((unsigned char)*z) ) z++;
+    bounds.maxLength = bounds.minLength;
+  }
+  while( isspace((unsigned char)*z) ) z++;
+  if( z[0] == '.' && z[1] == '.' ) {
+    z += 2;
+    while( isspace((unsigned char)*z) ) z++;
+    bounds.maxLength = isdigit((unsigned char)*z) ? atoi(z) : -1;
+  }
+  bounds.isOptional = bounds.minLength == 0;
+  return bounds;
+}
+
+/*
+** Mark a relationship pattern as variable-length. The bounds are kept as
+** a literal child ("*1..3") that the planner reads back with
+** cypherParsePathBounds().
+*/
+CypherAst* cypherCreateVariableLengthPath(CypherAst *relPattern,
+                                         const char *boundsStr) {
+  CypherAst *pBounds;
+
+  if( !relPattern ) return NULL;
+  pBounds = cypherAstCreateLiteral(boundsStr && boundsStr[0] ? boundsStr : "*", 0, 0);
+  if( !pBounds ) return NULL;
+  cypherAstAddChild(relPattern, pBounds);
+  return relPattern;
+}
+
+/*
+** Path walker.
+*/
+
+int cypherPathWalkerCreate(GraphVtab *pGraph, const char *relType,
+                           int direction, PathBounds bounds, int flags,
+                           PathWalker **ppWalker) {
+  PathWalker *pWalker;
+  int rc = SQLITE_OK;
+
+  if( !pGraph || !ppWalker ) return SQLITE_MISUSE;
+  *ppWalker = NULL;
+  if( bounds.minLength < 0 ) bounds.minLength = 0;
+
+  pWalker = sqlite3_malloc(sizeof(PathWalker));
+  if( !pWalker ) return SQLITE_NOMEM;
+  memset(pWalker, 0, sizeof(PathWalker));
+  pWalker->pGraph = pGraph;
+  pWalker->direction = direction;
+  pWalker->bounds = bounds;
+  pWalker->bShortest = (flags & (CYPHER_PATH_SHORTEST | CYPHER_PATH_ALL_SHORTEST)) != 0;
+  pWalker->bAllShortest = (flags & CYPHER_PATH_ALL_SHORTEST) != 0;
+  pWalker->bPrune = !pWalker->bShortest && (flags & CYPHER_PATH_PRUNE) &&
+                    bounds.minLength <= 1;
+  pWalker->iDepth = -1;
+
+  /* The search from the far end of a shortest path walks edges backwards */
+  if( direction != CYPHER_PATH_INCOMING || pWalker->bShortest ) {
+    rc = graphPrepareAdjacency(pGraph, 0, relType, &pWalker->apAdj[0]);
+  }
+  if( rc == SQLITE_OK && (direction != CYPHER_PATH_OUTGOING || pWalker->bShortest) ) {
+    rc = graphPrepareAdjacency(pGraph, 1, relType, &pWalker->apAdj[1]);
+  }
+  if( rc != SQLITE_OK ) {
+    cypherPathWalkerDestroy(pWalker);
+    return rc;
+  }
+  *ppWalker = pWalker;
+  return SQLITE_OK;
+}
+
+void cypherPathWalkerDestroy(PathWalker *pWalker) {
+  int i;
+
+  if( !pWalker ) return;
+  sqlite3_finalize(pWalker->apAdj[0]);
+  sqlite3_finalize(pWalker->apAdj[1]);
+  for( i = 0; i < pWalker->nLevelAlloc; i++ ) {
+    sqlite3_free(pWalker->aFrame[i].aAdj);
+  }
+  sqlite3_free(pWalker->aFrame);
+  sqlite3_free(pWalker->aNode);
+  sqlite3_free(pWalker->aEdge);
+  sqlite3_free(pWalker->aHit);
+  sqlite3_free(pWalker->aPathNode);
+  sqlite3_free(pWalker->aPathEdge);
+  sqlite3_free(pWalker);
+}
+
+/*
+** Make room for paths of nLevel relationships.
+*/
+static int pathWalkerReserve(PathWalker *pWalker, int nLevel) {
+  PathFrame *aFrame;
+  sqlite3_int64 *aNode, *aEdge;
+  int nNew;
+
+  if( nLevel < pWalker->nLevelAlloc ) return SQLITE_OK;
+  nNew = pWalker->nLevelAlloc ? pWalker->nLevelAlloc * 2 : 8;
+  while( nNew <= nLevel ) nNew *= 2;
+
+  aFrame = sqlite3_realloc(pWalker->aFrame, nNew * sizeof(PathFrame));
+  if( !aFrame ) return SQLITE_NOMEM;
+  memset(&aFrame[pWalker->nLevelAlloc], 0,
+         (nNew - pWalker->nLevelAlloc) * sizeof(PathFrame));
+  pWalker->aFrame = aFrame;
+  aNode = sqlite3_realloc(pWalker->aNode, nNew * sizeof(sqlite3_int64));
+  if( !aNode ) return SQLITE_NOMEM;
+  pWalker->aNode = aNode;
+  aEdge = sqlite3_realloc(pWalker->aEdge, nNew * sizeof(sqlite3_int64));
+  if( !aEdge ) return SQLITE_NOMEM;
+  pWalker->aEdge = aEdge;
+  pWalker->nLevelAlloc = nNew;
+  return SQLITE_OK;
+}
+
+/*
+** Load the relationships of iNode in the walker's direction, or against
+** it if bReverse is set, into pFrame. Walking both ways, a self-loop is
+** taken from the outgoing side only.
+*/
+static int pathWalkerLoad(PathWalker *pWalker, int bReverse, sqlite3_int64 iNode,
+                          PathFrame *pFrame) {
+  int bBoth = pWalker->direction == CYPHER_PATH_BOTH;
+  int iDir;
+
+  pFrame->nAdj = 0;
+  pFrame->iNext = 0;
+  for( iDir = 0; iDir < 2; iDir++ ) {
+    sqlite3_stmt *pStmt = pWalker->apAdj[iDir];
+    int rc;
+
+    if( !bBoth && iDir != ((pWalker->direction == CYPHER_PATH_INCOMING) ^ bReverse) ) {
+      continue;
+    }
+    sqlite3_reset(pStmt);
+    sqlite3_bind_int64(pStmt, 1, iNode);
+    while( (rc = sqlite3_step(pStmt)) == SQLITE_ROW ) {
+      sqlite3_int64 iRel = sqlite3_column_int64(pStmt, 0);
+      sqlite3_int64 iNbr = sqlite3_column_int64(pStmt, 1);
+
+      if( bBoth && iDir == 1 && iNbr == iNode ) continue;
+      if( pFrame->nAdj >= pFrame->nAdjAlloc ) {
+        int nNew = pFrame->nAdjAlloc ? pFrame->nAdjAlloc * 2 : 16;
+        sqlite3_int64 *aNew = sqlite3_realloc(pFrame->aAdj, nNew * 2 * sizeof(sqlite3_int64));
+        if( !aNew ) {
+          sqlite3_reset(pStmt);
+          return SQLITE_NOMEM;
+        }
+        pFrame->aAdj = aNew;
+        pFrame->nAdjAlloc = nNew;
+      }
+      pFrame->aAdj[pFrame->nAdj * 2] = iRel;
+      pFrame->aAdj[pFrame->nAdj * 2 + 1] = iNbr;
+      pFrame->nAdj++;
+    }
+    sqlite3_reset(pStmt);
+    if( rc != SQLITE_DONE ) return rc;
+  }
+  pFrame->bLoaded = 1;
+  return SQLITE_OK;
+}
+
+/*
+** Visited set of the pruning search, open addressing on node id. Each
+** node keeps its distance and the relationship its path left the start
+** node by.
+*/
+typedef struct PathSeenEntry {
+  sqlite3_int64 iNode;
+  sqlite3_int64 iBranch;        /* First relationship, 0 for the start */
+  int nDepth;
+  int bUsed;
+} PathSeenEntry;
+
+typedef struct PathSeen {
+  PathSeenEntry *aSlot;
+  int nUsed;
+  int nSlot;                    /* Power of two */
+} PathSeen;
+
+static PathSeenEntry *pathSeenSlot(PathSeen *p, sqlite3_int64 iNode) {
+  unsigned int h = (unsigned int)(((sqlite3_uint64)iNode * 0x9E3779B97F4A7C15ULL) >> 32);
+  h &= p->nSlot - 1;
+  while( p->aSlot[h].bUsed && p->aSlot[h].iNode != iNode ) {
+    h = (h + 1) & (p->nSlot - 1);
+  }
+  return &p->aSlot[h];
+}
+
+static PathSeenEntry *pathSeenFind(PathSeen *p, sqlite3_int64 iNode) {
+  PathSeenEntry *pEntry;
+  if( p->nSlot == 0 ) return NULL;
+  pEntry = pathSeenSlot(p, iNode);
+  return pEntry->bUsed ? pEntry : NULL;
+}
+
+static int pathSeenAdd(PathSeen *p, sqlite3_int64 iNode, sqlite3_int64 iBranch,
+                       int nDepth) {
+  PathSeenEntry *pEntry;
+
+  if( (p->nUsed + 1) * 2 > p->nSlot ) {
+    PathSeen s;
+    int i;
+    s.nSlot = p->nSlot ? p->nSlot * 2 : 64;
+    s.nUsed = p->nUsed;
+    s.aSlot = sqlite3_malloc(s.nSlot * sizeof(PathSeenEntry));
+    if( !s.aSlot ) return SQLITE_NOMEM;
+    memset(s.aSlot, 0, s.nSlot * sizeof(PathSeenEntry));
+    for( i = 0; i < p->nSlot; i++ ) {
+      if( p->aSlot[i].bUsed ) *pathSeenSlot(&s, p->aSlot[i].iNode) = p->aSlot[i];
+    }
+    sqlite3_free(p->aSlot);
+    *p = s;
+  }
+  pEntry = pathSeenSlot(p, iNode);
+  pEntry->iNode = iNode;
+  pEntry->iBranch = iBranch;
+  pEntry->nDepth = nDepth;
+  pEntry->bUsed = 1;
+  p->nUsed++;
+  return SQLITE_OK;
+}
+
+static int pathWalkerHit(PathWalker *pWalker, sqlite3_int64 iNode, int nDepth) {
+  if( pWalker->nHit >= pWalker->nHitAlloc ) {
+    int nNew = pWalker->nHitAlloc ? pWalker->nHitAlloc * 2 : 32;
+    PathHit *aNew = sqlite3_realloc(pWalker->aHit, nNew * sizeof(PathHit));
+    if( !aNew ) return SQLITE_NOMEM;
+    pWalker->aHit = aNew;
+    pWalker->nHitAlloc = nNew;
+  }
+  pWalker->aHit[pWalker->nHit].iNode = iNode;
+  pWalker->aHit[pWalker->nHit].nDepth = nDepth;
+  pWalker->nHit++;
+  return SQLITE_OK;
+}
+
+/*
+** Pruning search: every node reachable from iStart in at most maxLength
+** steps is reported once, at its shortest distance. With a minimum of 0
+** or 1 these are exactly the end nodes of the paths within bounds, as a
+** shortest walk never repeats a relationship. The start node itself is an
+** end node only if a cycle leads back to it. Following one direction that
+** is the case when the search reaches it again; walking both ways it takes
+** two paths leaving the start by different relationships that meet, or a
+** relationship back to the start other than the one a path left by.
+*/
+static int pathWalkerSearch(PathWalker *pWalker, sqlite3_int64 iStart) {
+  PathSeen seen;
+  PathFrame adj;
+  sqlite3_int64 *aCur = NULL, *aNext = NULL;
+  int nCur = 0, nCurAlloc = 0, nNext = 0, nNextAlloc = 0;
+  int nMax = pWalker->bounds.maxLength;
+  int bBoth = pWalker->direction == CYPHER_PATH_BOTH;
+  int bStartHit = 0;
+  int nDepth, i, j;
+  int rc;
+
+  memset(&seen, 0, sizeof(seen));
+  memset(&adj, 0, sizeof(adj));
+  pWalker->nHit = 0;
+  pWalker->iHit = 0;
+
+  rc = pathSeenAdd(&seen, iStart, 0, 0);
+  if( rc == SQLITE_OK && pWalker->bounds.minLength == 0 ) {
+    rc = pathWalkerHit(pWalker, iStart, 0);
+    bStartHit = 1;
+  }
+  if( rc == SQLITE_OK ) {
+    aCur = sqlite3_malloc(sizeof(sqlite3_int64));
+    if( !aCur ) rc = SQLITE_NOMEM;
+  }
+  if( rc == SQLITE_OK ) {
+    aCur[0] = iStart;
+    nCur = nCurAlloc = 1;
+  }
+
+  for( nDepth = 1; rc == SQLITE_OK && nCur > 0 && (nMax < 0 || nDepth <= nMax); nDepth++ ) {
+    nNext = 0;
+    for( i = 0; rc == SQLITE_OK && i < nCur; i++ ) {
+      PathSeenEntry *pFrom = pathSeenFind(&seen, aCur[i]);
+      sqlite3_int64 iBranch = pFrom->iBranch;
+
+      rc = pathWalkerLoad(pWalker, 0, aCur[i], &adj);
+      for( j = 0; rc == SQLITE_OK && j < adj.nAdj; j++ ) {
+        sqlite3_int64 iRel = adj.aAdj[j * 2];
+        sqlite3_int64 iNbr = adj.aAdj[j * 2 + 1];
+        PathSeenEntry *pTo = pathSeenFind(&seen, iNbr);
+
+        if( pTo ) {
+          /* Closing a cycle through the start node */
+          if( bStartHit ) continue;
+          if( iNbr == iStart && (!bBoth || iRel != iBranch) ) {
+            rc = pathWalkerHit(pWalker, iStart, nDepth);
+            bStartHit = 1;
+          } else if( bBoth && iNbr != iStart && pTo->iBranch != iBranch &&
+                     (nMax < 0 || nDepth + pTo->nDepth <= nMax) ) {
+            rc = pathWalkerHit(pWalker, iStart, nDepth + pTo->nDepth);
+            bStartHit = 1;
+          }
+          continue;
+        }
+
+        rc = pathSeenAdd(&seen, iNbr, nDepth == 1 ? iRel : iBranch, nDepth);
+        if( rc == SQLITE_OK ) rc = pathWalkerHit(pWalker, iNbr, nDepth);
+        if( rc != SQLITE_OK ) break;
+        if( nNext >= nNextAlloc ) {
+          int nNew = nNextAlloc ? nNextAlloc * 2 : 32;
+          sqlite3_int64 *aNew = sqlite3_realloc(aNext, nNew * sizeof(sqlite3_int64));
+          if( !aNew ) {
+            rc = SQLITE_NOMEM;
+            break;
+          }
+          aNext = aNew;
+          nNextAlloc = nNew;
+        }
+        aNext[nNext++] = iNbr;
+      }
+    }
+
+    /* The next level becomes the frontier */
+    {
+      sqlite3_int64 *aTmp = aCur;
+      int nTmp = nCurAlloc;
+      aCur = aNext;
+      nCur = nNext;
+      nCurAlloc = nNextAlloc;
+      aNext = aTmp;
+      nNextAlloc = nTmp;
+    }
+  }
+
+  sqlite3_free(aCur);
+  sqlite3_free(aNext);
+  sqlite3_free(adj.aAdj);
+  sqlite3_free(seen.aSlot);
+  return rc;
+}
+
+/*
+** Parent links of the shortest-path search. Every node found keeps a list
+** of the relationships that reach it from the previous level, threaded
+** through PathSeenEntry.iBranch (-1 ends a list).
+*/
+typedef struct PathParent {
+  sqlite3_int64 iRel;
+  sqlite3_int64 iNode;          /* Node one step nearer the search origin */
+  int iNext;
+} PathParent;
+
+typedef struct ShortestSearch {
+  PathWalker *pWalker;
+  PathSeen aSeen[2];            /* From the start, from the end */
+  PathParent *aParent;
+  int nParent;
+  int nParentAlloc;
+  sqlite3_int64 *aNode;         /* Path being assembled */
+  sqlite3_int64 *aEdge;
+  int nLen;                     /* Length of the shortest paths */
+  sqlite3_int64 iMeet;          /* Node where the two searches meet */
+  int iMeetPos;                 /* Its position on the path */
+  int bDone;                    /* One path wanted and found */
+  int rc;
+} ShortestSearch;
+
+static int shortestAddParent(ShortestSearch *p, sqlite3_int64 iRel,
+                             sqlite3_int64 iNode, int iNext) {
+  if( p->nParent >= p->nParentAlloc ) {
+    int nNew = p->nParentAlloc ? p->nParentAlloc * 2 : 64;
+    PathParent *aNew = sqlite3_realloc(p->aParent, nNew * sizeof(PathParent));
+    if( !aNew ) return -1;
+    p->aParent = aNew;
+    p->nParentAlloc = nNew;
+  }
+  p->aParent[p->nParent].iRel = iRel;
+  p->aParent[p->nParent].iNode = iNode;
+  p->aParent[p->nParent].iNext = iNext;
+  return p->nParent++;
+}
+
+/*
+** Append the assembled path to the walker's results.
+*/
+static int shortestEmit(ShortestSearch *p) {
+  PathWalker *pWalker = p->pWalker;
+  int nLen = p->nLen;
+
+  if( pWalker->nPath >= pWalker->nPathAlloc ) {
+    int nNew = pWalker->nPathAlloc ? pWalker->nPathAlloc * 2 : 4;
+    sqlite3_int64 *aNode, *aEdge;
+    aNode = sqlite3_realloc(pWalker->aPathNode, nNew * (nLen + 1) * sizeof(sqlite3_int64));
+    if( !aNode ) return SQLITE_NOMEM;
+    pWalker->aPathNode = aNode;
+    aEdge = sqlite3_realloc(pWalker->aPathEdge, nNew * (nLen + 1) * sizeof(sqlite3_int64));
+    if( !aEdge ) return SQLITE_NOMEM;
+    pWalker->aPathEdge = aEdge;
+    pWalker->nPathAlloc = nNew;
+  }
+  memcpy(&pWalker->aPathNode[pWalker->nPath * (nLen + 1)], p->aNode,
+         (nLen + 1) * sizeof(sqlite3_int64));
+  if( nLen > 0 ) {
+    memcpy(&pWalker->aPathEdge[pWalker->nPath * nLen], p->aEdge,
+           nLen * sizeof(sqlite3_int64));
+  }
+  pWalker->nPath++;
+  p->bDone = !pWalker->bAllShortest;
+  return SQLITE_OK;
+}
+
+/*
+** Fill in the path from position iPos, holding iNode, to the end node by
+** following the parent links of the search from the end.
+*/
+static void shortestFillBackward(ShortestSearch *p, sqlite3_int64 iNode, int iPos) {
+  PathSeenEntry *pEntry;
+  int iLink;
+
+  p->aNode[iPos] = iNode;
+  if( iPos == p->nLen ) {
+    p->rc = shortestEmit(p);
+    return;
+  }
+  pEntry = pathSeenFind(&p->aSeen[1], iNode);
+  for( iLink = (int)pEntry->iBranch; iLink >= 0 && p->rc == SQLITE_OK && !p->bDone;
+       iLink = p->aParent[iLink].iNext ) {
+    p->aEdge[iPos] = p->aParent[iLink].iRel;
+    shortestFillBackward(p, p->aParent[iLink].iNode, iPos + 1);
+  }
+}
+
+/*
+** Fill in the path from the start node to position iPos, holding iNode,
+** then on from the meeting node to the end.
+*/
+static void shortestFillForward(ShortestSearch *p, sqlite3_int64 iNode, int iPos) {
+  PathSeenEntry *pEntry;
+  int iLink;
+
+  p->aNode[iPos] = iNode;
+  if( iPos == 0 ) {
+    shortestFillBackward(p, p->iMeet, p->iMeetPos);
+    return;
+  }
+  pEntry = pathSeenFind(&p->aSeen[0], iNode);
+  for( iLink = (int)pEntry->iBranch; iLink >= 0 && p->rc == SQLITE_OK && !p->bDone;
+       iLink = p->aParent[iLink].iNext ) {
+    p->aEdge[iPos - 1] = p->aParent[iLink].iRel;
+    shortestFillForward(p, p->aParent[iLink].iNode, iPos - 1);
+  }
+}
+
+/*
+** Bidirectional breadth-first search for the shortest paths from iStart
+** to iEnd. The smaller frontier grows by one full level at a time; once a
+** level reaches nodes the other search has found, the shortest length is
+** the least sum of the two distances over those nodes, and every shortest
+** path runs through exactly one of the nodes that attain it. The paths are
+** then assembled from the parent links of both searches.
+*/
+static int pathWalkerShortest(PathWalker *pWalker, sqlite3_int64 iStart,
+                              sqlite3_int64 iEnd) {
+  ShortestSearch search;
+  PathFrame adj;
+  sqlite3_int64 *aFront[2] = {NULL, NULL};
+  int nFront[2] = {0, 0};
+  int nDepth[2] = {0, 0};
+  sqlite3_int64 *aNext = NULL;
+  int nNext = 0, nNextAlloc = 0;
+  int nMax = pWalker->bounds.maxLength;
+  int i, j, iSide;
+
+  memset(&search, 0, sizeof(search));
+  memset(&adj, 0, sizeof(adj));
+  search.pWalker = pWalker;
+  pWalker->nPath = 0;
+  pWalker->iPath = 0;
+
+  if( iStart == iEnd ) {
+    pWalker->nPathLen = 0;
+    search.nLen = 0;
+    search.aNode = &iStart;
+    return shortestEmit(&search);
+  }
+
+  search.rc = pathSeenAdd(&search.aSeen[0], iStart, -1, 0);
+  if( search.rc == SQLITE_OK ) search.rc = pathSeenAdd(&search.aSeen[1], iEnd, -1, 0);
+  for( iSide = 0; search.rc == SQLITE_OK && iSide < 2; iSide++ ) {
+    aFront[iSide] = sqlite3_malloc(sizeof(sqlite3_int64));
+    if( !aFront[iSide] ) {
+      search.rc = SQLITE_NOMEM;
+      break;
+    }
+    aFront[iSide][0] = iSide ? iEnd : iStart;
+    nFront[iSide] = 1;
+  }
+
+  while( search.rc == SQLITE_OK && nFront[0] > 0 && nFront[1] > 0 &&
+         (nMax < 0 || nDepth[0] + nDepth[1] < nMax) ) {
+    PathSeen *pSeen, *pOther;
+    int nBest = -1;
+
+    /* Grow the smaller frontier by one level */
+    iSide = nFront[0] <= nFront[1] ? 0 : 1;
+    pSeen = &search.aSeen[iSide];
+    pOther = &search.aSeen[!iSide];
+    nNext = 0;
+    for( i = 0; search.rc == SQLITE_OK && i < nFront[iSide]; i++ ) {
+      sqlite3_int64 iNode = aFront[iSide][i];
+
+      search.rc = pathWalkerLoad(pWalker, iSide, iNode, &adj);
+      for( j = 0; search.rc == SQLITE_OK && j < adj.nAdj; j++ ) {
+        sqlite3_int64 iRel = adj.aAdj[j * 2];
+        sqlite3_int64 iNbr = adj.aAdj[j * 2 + 1];
+        PathSeenEntry *pEntry = pathSeenFind(pSeen, iNbr);
+        int iLink;
+
+        if( pEntry ) {
+          /* Another shortest way to a node of this level */
+          if( pEntry->nDepth == nDepth[iSide] + 1 && pWalker->bAllShortest ) {
+            iLink = shortestAddParent(&search, iRel, iNode, (int)pEntry->iBranch);
+            if( iLink < 0 ) search.rc = SQLITE_NOMEM;
+            else pathSeenFind(pSeen, iNbr)->iBranch = iLink;
+          }
+          continue;
+        }
+        iLink = shortestAddParent(&search, iRel, iNode, -1);
+        if( iLink < 0 ) {
+          search.rc = SQLITE_NOMEM;
+          break;
+        }
+        search.rc = pathSeenAdd(pSeen, iNbr, iLink, nDepth[iSide] + 1);
+        if( search.rc != SQLITE_OK ) break;
+        if( nNext >= nNextAlloc ) {
+          int nNew = nNextAlloc ? nNextAlloc * 2 : 32;
+          sqlite3_int64 *aNew = sqlite3_realloc(aNext, nNew * sizeof(sqlite3_int64));
+          if( !aNew ) {
+            search.rc = SQLITE_NOMEM;
+            break;
+          }
+          aNext = aNew;
+          nNextAlloc = nNew;
+        }
+        aNext[nNext++] = iNbr;
+      }
+    }
+    if( search.rc != SQLITE_OK ) break;
+    sqlite3_free(aFront[iSide]);
+    aFront[iSide] = aNext;
+    nFront[iSide] = nNext;
+    nDepth[iSide]++;
+    aNext = NULL;
+    nNextAlloc = 0;
+
+    /* Did the new level meet the other search? */
+    for( i = 0; i < nFront[iSide]; i++ ) {
+      PathSeenEntry *pEntry = pathSeenFind(pOther, aFront[iSide][i]);
+      if( pEntry && (nBest < 0 || nDepth[iSide] + pEntry->nDepth < nBest) ) {
+        nBest = nDepth[iSide] + pEntry->nDepth;
+      }
+    }
+    if( nBest < 0 ) continue;
+    if( nMax >= 0 && nBest > nMax ) break;
+
+    search.nLen = nBest;
+    pWalker->nPathLen = nBest;
+    search.aNode = sqlite3_malloc((nBest + 1) * sizeof(sqlite3_int64));
+    search.aEdge = sqlite3_malloc((nBest + 1) * sizeof(sqlite3_int64));
+    if( !search.aNode || !search.aEdge ) {
+      search.rc = SQLITE_NOMEM;
+      break;
+    }
+    for( i = 0; search.rc == SQLITE_OK && !search.bDone && i < nFront[iSide]; i++ ) {
+      sqlite3_int64 iMeet = aFront[iSide][i];
+      PathSeenEntry *pEntry = pathSeenFind(pOther, iMeet);
+      if( !pEntry || nDepth[iSide] + pEntry->nDepth != nBest ) continue;
+      search.iMeet = iMeet;
+      search.iMeetPos = pathSeenFind(&search.aSeen[0], iMeet)->nDepth;
+      shortestFillForward(&search, iMeet, search.iMeetPos);
+    }
+    break;
+  }
+
+  sqlite3_free(aFront[0]);
+  sqlite3_free(aFront[1]);
+  sqlite3_free(aNext);
+  sqlite3_free(adj.aAdj);
+  sqlite3_free(search.aSeen[0].aSlot);
+  sqlite3_free(search.aSeen[1].aSlot);
+  sqlite3_free(search.aParent);
+  sqlite3_free(search.aNode);
+  sqlite3_free(search.aEdge);
+  return search.rc;
+}
+
+/*
+** Begin returning the shortest paths from startNode to endNode. Only for
+** a walker created with CYPHER_PATH_SHORTEST or CYPHER_PATH_ALL_SHORTEST.
+*/
+int cypherPathWalkerStartPair(PathWalker *pWalker, sqlite3_int64 startNode,
+                              sqlite3_int64 endNode) {
+  if( !pWalker || !pWalker->bShortest ) return SQLITE_MISUSE;
+  return pathWalkerShortest(pWalker, startNode, endNode);
+}
+
+/*
+** Begin enumerating the paths that start at startNode.
+*/
+int cypherPathWalkerStart(PathWalker *pWalker, sqlite3_int64 startNode) {
+  int rc;
+
+  if( !pWalker || pWalker->bShortest ) return SQLITE_MISUSE;
+  if( pWalker->bPrune ) {
+    pWalker->iDepth = -1;
+    return pathWalkerSearch(pWalker, startNode);
+  }
+  rc = pathWalkerReserve(pWalker, 1);
+  if( rc != SQLITE_OK ) return rc;
+  pWalker->iDepth = 0;
+  pWalker->aNode[0] = startNode;
+  pWalker->aFrame[0].bLoaded = 0;
+  pWalker->bZero = pWalker->bounds.minLength == 0;
+  return SQLITE_OK;
+}
+
+/*
+** Advance to the next path. Returns SQLITE_ROW, SQLITE_DONE or an error.
+*/
+int cypherPathWalkerNext(PathWalker *pWalker) {
+  if( !pWalker ) return SQLITE_MISUSE;
+
+  if( pWalker->bShortest ) {
+    if( pWalker->iPath >= pWalker->nPath ) return SQLITE_DONE;
+    pWalker->iPath++;
+    return SQLITE_ROW;
+  }
+  if( pWalker->bPrune ) {
+    if( pWalker->iHit >= pWalker->nHit ) return SQLITE_DONE;
+    pWalker->iHit++;
+    return SQLITE_ROW;
+  }
+
+  if( pWalker->bZero ) {
+    pWalker->bZero = 0;
+    return SQLITE_ROW;
+  }
+
+  while( pWalker->iDepth >= 0 ) {
+    int iDepth = pWalker->iDepth;
+    PathFrame *pFrame = &pWalker->aFrame[iDepth];
+    sqlite3_int64 iRel, iNbr;
+    int i, rc;
+
+    if( !pFrame->bLoaded ) {
+      if( pWalker->bounds.maxLength >= 0 && iDepth >= pWalker->bounds.maxLength ) {
+        pFrame->nAdj = 0;
+        pFrame->iNext = 0;
+        pFrame->bLoaded = 1;
+      } else {
+        rc = pathWalkerLoad(pWalker, 0, pWalker->aNode[iDepth], pFrame);
+        if( rc != SQLITE_OK ) return rc;
+      }
+    }
+
+    /* This level is exhausted: back up one relationship */
+    if( pFrame->iNext >= pFrame->nAdj ) {
+      pFrame->bLoaded = 0;
+      pWalker->iDepth--;
+      continue;
+    }
+
+    iRel = pFrame->aAdj[pFrame->iNext * 2];
+    iNbr = pFrame->aAdj[pFrame->iNext * 2 + 1];
+    pFrame->iNext++;
+
+    /* No relationship appears twice on a path */
+    for( i = 0; i < iDepth && pWalker->aEdge[i] != iRel; i++ ) {}
+    if( i < iDepth ) continue;
+
+    rc = pathWalkerReserve(pWalker, iDepth + 2);
+    if( rc != SQLITE_OK ) return rc;
+    pWalker->aEdge[iDepth] = iRel;
+    pWalker->aNode[iDepth + 1] = iNbr;
+    pWalker->aFrame[iDepth + 1].bLoaded = 0;
+    pWalker->iDepth = iDepth + 1;
+    if( pWalker->iDepth >= pWalker->bounds.minLength ) return SQLITE_ROW;
+  }
+  return SQLITE_DONE;
+}
+
+/*
+** End node and length of the current path.
+*/
+sqlite3_int64 cypherPathWalkerEnd(PathWalker *pWalker) {
+  if( pWalker->bShortest ) {
+    return cypherPathWalkerNodes(pWalker)[pWalker->nPathLen];
+  }
+  if( pWalker->bPrune ) return pWalker->aHit[pWalker->iHit - 1].iNode;
+  return pWalker->aNode[pWalker->iDepth];
+}
+
+int cypherPathWalkerLength(PathWalker *pWalker) {
+  if( pWalker->bShortest ) return pWalker->nPathLen;
+  if( pWalker->bPrune ) return pWalker->aHit[pWalker->iHit - 1].nDepth;
+  return pWalker->iDepth;
+}
+
+/*
+** Relationships and nodes of the current path; the node array has one
+** more entry than the path length. NULL when pruning.
+*/
+const sqlite3_int64 *cypherPathWalkerEdges(PathWalker *pWalker) {
+  if( pWalker->bShortest ) {
+    return &pWalker->aPathEdge[(pWalker->iPath - 1) * pWalker->nPathLen];
+  }
+  return pWalker->bPrune ? NULL : pWalker->aEdge;
+}
+
+const sqlite3_int64 *cypherPathWalkerNodes(PathWalker *pWalker) {
+  if( pWalker->bShortest ) {
+    return &pWalker->aPathNode[(pWalker->iPath - 1) * (pWalker->nPathLen + 1)];
+  }
+  return pWalker->bPrune ? NULL : pWalker->aNode;
+}
+
+/*
+** Path results.
+*/
+
+/*
+** Copy the walker's current path into a new PathResult.
+*/
+static PathResult *pathResultFromWalker(PathWalker *pWalker) {
+  PathResult *pPath;
+  int nLen = cypherPathWalkerLength(pWalker);
+
+  pPath = sqlite3_malloc(sizeof(PathResult));
+  if( !pPath ) return NULL;
+  memset(pPath, 0, sizeof(PathResult));
+  pPath->pathLength = nLen;
+  pPath->nodeIds = sqlite3_malloc((nLen + 1) * sizeof(sqlite3_int64));
+  pPath->edgeIds = sqlite3_malloc((nLen + 1) * sizeof(sqlite3_int64));
+  if( !pPath->nodeIds || !pPath->edgeIds ) {
+    cypherPathResultFree(pPath);
+    return NULL;
+  }
+  memcpy(pPath->nodeIds, cypherPathWalkerNodes(pWalker), (nLen + 1) * sizeof(sqlite3_int64));
+  if( nLen > 0 ) {
+    memcpy(pPath->edgeIds, cypherPathWalkerEdges(pWalker), nLen * sizeof(sqlite3_int64));
+  }
+  pPath->totalWeight = nLen;
+  return pPath;
+}
+
+/*
+** All outgoing paths from startNode within bounds, optionally only those
+** ending at endNode (pass a negative endNode for any end node).
+*/
+PathResult* cypherMatchVariableLengthPaths(GraphVtab *pGraph,
+                                          sqlite3_int64 startNode,
+                                          sqlite3_int64 endNode,
+                                          const char *relType,
+                                          PathBounds bounds) {
+  PathWalker *pWalker = NULL;
+  PathResult *pFirst = NULL, **ppTail = &pFirst;
+
+  if( cypherPathWalkerCreate(pGraph, relType, CYPHER_PATH_OUTGOING, bounds, 0,
+                             &pWalker) != SQLITE_OK ) {
+    return NULL;
+  }
+  if( cypherPathWalkerStart(pWalker, startNode) == SQLITE_OK ) {
+    while( cypherPathWalkerNext(pWalker) == SQLITE_ROW ) {
+      PathResult *pPath;
+      if( endNode >= 0 && cypherPathWalkerEnd(pWalker) != endNode ) continue;
+      pPath = pathResultFromWalker(pWalker);
+      if( !pPath ) break;
+      *ppTail = pPath;
+      ppTail = &pPath->pNext;
+    }
+  }
+  cypherPathWalkerDestroy(pWalker);
+  return pFirst;
+}
+
+/*
+** Shortest outgoing paths from startNode to endNode: one, or all of them.
+*/
+static PathResult *pathFindShortest(GraphVtab *pGraph, sqlite3_int64 startNode,
+                                    sqlite3_int64 endNode, const char *relType,
+                                    int flags) {
+  PathWalker *pWalker = NULL;
+  PathResult *pFirst = NULL, **ppTail = &pFirst;
+
+  if( cypherPathWalkerCreate(pGraph, relType, CYPHER_PATH_OUTGOING,
+                             cypherParsePathBounds("*0.."), flags,
+                             &pWalker) != SQLITE_OK ) {
+    return NULL;
+  }
+  if( cypherPathWalkerStartPair(pWalker, startNode, endNode) == SQLITE_OK ) {
+    while( cypherPathWalkerNext(pWalker) == SQLITE_ROW ) {
+      PathResult *pPath = pathResultFromWalker(pWalker);
+      if( !pPath ) break;
+      *ppTail = pPath;
+      ppTail = &pPath->pNext;
+    }
+  }
+  cypherPathWalkerDestroy(pWalker);
+  return pFirst;
+}
+
+PathResult* cypherFindShortestPath(GraphVtab *pGraph,
+                                   sqlite3_int64 startNode,
+                                   sqlite3_int64 endNode,
+                                   const char *relType) {
+  return pathFindShortest(pGraph, startNode, endNode, relType, CYPHER_PATH_SHORTEST);
+}
+
+PathResult* cypherFindAllShortestPaths(GraphVtab *pGraph,
+                                       sqlite3_int64 startNode,
+                                       sqlite3_int64 endNode,
+                                       const char *relType) {
+  return pathFindShortest(pGraph, startNode, endNode, relType, CYPHER_PATH_ALL_SHORTEST);
+}
+
+/*
+** Return 1 if an outgoing path within bounds leads from startNode to
+** endNode, 0 if not.
+*/
+int cypherPathExists(GraphVtab *pGraph,
+                    sqlite3_int64 startNode,
+                    sqlite3_int64 endNode,
+                    const char *relType,
+                    PathBounds bounds) {
+  PathWalker *pWalker = NULL;
+  int bFound = 0;
+
+  if( cypherPathWalkerCreate(pGraph, relType, CYPHER_PATH_OUTGOING, bounds,
+                             CYPHER_PATH_PRUNE, &pWalker) != SQLITE_OK ) {
+    return 0;
+  }
+  if( cypherPathWalkerStart(pWalker, startNode) == SQLITE_OK ) {
+    while( !bFound && cypherPathWalkerNext(pWalker) == SQLITE_ROW ) {
+      bFound = cypherPathWalkerEnd(pWalker) == endNode;
+    }
+  }
+  cypherPathWalkerDestroy(pWalker);
+  return bFound;
+}
+
+void cypherPathResultFree(PathResult *path) {
+  if( !path ) return;
+  sqlite3_free(path->nodeIds);
+  sqlite3_free(path->edgeIds);
+  sqlite3_free(path);
+}
+
+void cypherPathResultsFreeAll(PathResult *paths) {
+  while( paths ) {
+    PathResult *pNext = paths->pNext;
+    cypherPathResultFree(paths);
+    paths = pNext;
+  }
+}
+
+/*
+** {"nodes":[1,2,3],"relationships":[10,11],"length":2}
+*/
+char* cypherPathToJson(PathResult *path, GraphVtab *pGraph) {
+  char *zNodes = NULL, *zRels = NULL, *zJson;
+  int i;
+
+  (void)pGraph;
+  if( !path ) return sqlite3_mprintf("null");
+  for( i = 0; i <= path->pathLength; i++ ) {
+    zNodes = sqlite3_mprintf("%z%s%lld", zNodes, i ? "," : "", path->nodeIds[i]);
+    if( !zNodes ) return NULL;
+  }
+  for( i = 0; i < path->pathLength; i++ ) {
+    zRels = sqlite3_mprintf("%z%s%lld", zRels, i ? "," : "", path->edgeIds[i]);
+    if( !zRels ) {
+      sqlite3_free(zNodes);
+      return NULL;
+    }
+  }
+  zJson = sqlite3_mprintf("{\"nodes\":[%s],\"relationships\":[%s],\"length\":%d}",
+                          zNodes, zRels ? zRels : "", path->pathLength);
+  sqlite3_free(zNodes);
+  sqlite3_free(zRels);
+  return zJson;
+}
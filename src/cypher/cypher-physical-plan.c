@@ -22,6 +22,8 @@ extern const sqlite3_api_routines *sqlite3_api;
 /* SQLITE_EXTENSION_INIT1 - removed to prevent multiple definition */
 #include "cypher-planner.h"
 #include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
 #include <assert.h>
 
 /*
@@ -64,6 +66,15 @@ void physicalPlanNodeDestroy(PhysicalPlanNode *pNode) {
   sqlite3_free(pNode->zLabel);
   sqlite3_free(pNode->zProperty);
   sqlite3_free(pNode->zValue);
+  sqlite3_free(pNode->zFromAlias);
+  sqlite3_free(pNode->zRelAlias);
+  sqlite3_free(pNode->zRelType);
+  sqlite3_free(pNode->zPathAlias);
+  sqlite3_free(pNode->zJoinKeys);
+  sqlite3_free(pNode->zDistinctRels);
+  planPredicatesFree(pNode->aIndexKey, pNode->nIndexKey);
+  planPredicatesFree(pNode->aScanFilter, pNode->nScanFilter);
+  planColumnsFree(pNode->aColumn, pNode->nColumn);
   sqlite3_free(pNode->pExecState);
   sqlite3_free(pNode);
 }
@@ -90,6 +101,7 @@ int physicalPlanNodeAddChild(PhysicalPlanNode *pParent, PhysicalPlanNode *pChild
   
   /* Add child */
   pParent->apChildren[pParent->nChildren++] = pChild;
+  if( !pParent->pChild ) pParent->pChild = pChild;
   
   return SQLITE_OK;
 }
@@ -105,6 +117,13 @@ const char *physicalOperatorTypeName(PhysicalOperatorType type) {
     case PHYSICAL_PROPERTY_INDEX_SCAN: return "PropertyIndexScan";
     case PHYSICAL_ALL_RELS_SCAN:      return "AllRelsScan";
     case PHYSICAL_TYPE_INDEX_SCAN:    return "TypeIndexScan";
+    case PHYSICAL_BITMAP_SCAN:        return "BitmapScan";
+    case PHYSICAL_RANGE_INDEX_SCAN:   return "RangeIndexScan";
+    case PHYSICAL_FULLTEXT_SCAN:      return "FulltextScan";
+    case PHYSICAL_EXPAND_ALL:         return "ExpandAll";
+    case PHYSICAL_EXPAND_INTO:        return "ExpandInto";
+    case PHYSICAL_VAR_LENGTH_EXPAND:  return "VarLengthExpand";
+    case PHYSICAL_SHORTEST_PATH:      return "ShortestPath";
     case PHYSICAL_HASH_JOIN:          return "HashJoin";
     case PHYSICAL_NESTED_LOOP_JOIN:   return "NestedLoopJoin";
     case PHYSICAL_INDEX_NESTED_LOOP:  return "IndexNestedLoop";
@@ -113,10 +132,46 @@ const char *physicalOperatorTypeName(PhysicalOperatorType type) {
     case PHYSICAL_SORT:               return "Sort";
     case PHYSICAL_LIMIT:              return "Limit";
     case PHYSICAL_AGGREGATION:        return "Aggregation";
+    case PHYSICAL_DISTINCT:           return "Distinct";
+    case PHYSICAL_UNION:              return "Union";
     default:                          return "Unknown";
   }
 }
 
+/*
+** Push the quota of pLimit down the operators below it. A sort need only
+** keep the rows the limit can return. A scan reached through projections,
+** which produce one row per input row, applies the SKIP and LIMIT in its
+** SQL, so skipped rows never reach the executor. Filters, joins and
+** expansions change the number of rows and stop the push; the limit then
+** just stops pulling from them once it has its rows.
+*/
+static void pushLimit(PhysicalPlanNode *pLimit) {
+  PhysicalPlanNode *pNode = pLimit->pChild;
+  
+  if( pLimit->nLimit == 0 ) return;
+  while( pNode && pNode->type == PHYSICAL_PROJECTION ) pNode = pNode->pChild;
+  if( !pNode ) return;
+  
+  switch( pNode->type ) {
+    case PHYSICAL_SORT:
+      if( pLimit->nLimit > 0 ) pNode->nLimit = pLimit->nLimit + pLimit->nSkip;
+      break;
+    case PHYSICAL_ALL_NODES_SCAN:
+    case PHYSICAL_LABEL_INDEX_SCAN:
+    case PHYSICAL_TYPE_INDEX_SCAN:
+    case PHYSICAL_PROPERTY_INDEX_SCAN:
+    case PHYSICAL_RANGE_INDEX_SCAN:
+    case PHYSICAL_FULLTEXT_SCAN:
+      pNode->nLimit = pLimit->nLimit > 0 ? pLimit->nLimit : 0;
+      pNode->nSkip = pLimit->nSkip;
+      pLimit->nSkip = 0;
+      break;
+    default:
+      break;
+  }
+}
+
 /*
 ** Convert logical plan to physical plan with operator selection.
 ** Chooses the best physical operator for each logical operation.
@@ -124,6 +179,7 @@ const char *physicalOperatorTypeName(PhysicalOperatorType type) {
 PhysicalPlanNode *logicalPlanToPhysical(LogicalPlanNode *pLogical, PlanContext *pContext) {
   PhysicalPlanNode *pPhysical = NULL;
   PhysicalPlanNode *pChild;
+  LogicalPlanNode *pInput = pLogical;   /* Node whose children are converted */
   int i, rc;
   
   if( !pLogical ) return NULL;
@@ -150,15 +206,102 @@ PhysicalPlanNode *logicalPlanToPhysical(LogicalPlanNode *pLogical, PlanContext *
       }
       break;
       
+    case LOGICAL_TYPE_SCAN:
+      /* Relationship types are always indexed through type_id */
+      pPhysical = physicalPlanNodeCreate(PHYSICAL_TYPE_INDEX_SCAN);
+      if( pPhysical && pLogical->zLabel ) {
+        pPhysical->zLabel = sqlite3_mprintf("%s", pLogical->zLabel);
+        pPhysical->rCost = pLogical->rEstimatedCost * 0.1;
+      }
+      break;
+      
     case LOGICAL_INDEX_SCAN:
       pPhysical = physicalPlanNodeCreate(PHYSICAL_PROPERTY_INDEX_SCAN);
       if( pPhysical && pLogical->zProperty ) {
         pPhysical->zProperty = sqlite3_mprintf("%s", pLogical->zProperty);
         pPhysical->zValue = sqlite3_mprintf("%s", pLogical->zValue ? pLogical->zValue : "");
+        if( pLogical->zLabel ) {
+          pPhysical->zLabel = sqlite3_mprintf("%s", pLogical->zLabel);
+        }
+        if( pLogical->zIndexName ) {
+          pPhysical->zIndexName = sqlite3_mprintf("%s", pLogical->zIndexName);
+        }
+        if( pLogical->nIndexKey > 0 ) {
+          pPhysical->aIndexKey = planPredicatesCopy(pLogical->aIndexKey,
+                                                    pLogical->nIndexKey);
+          if( pPhysical->aIndexKey ) pPhysical->nIndexKey = pLogical->nIndexKey;
+        }
         pPhysical->rCost = pLogical->rEstimatedCost * 0.1; /* Index is much faster */
       }
       break;
       
+    case LOGICAL_BITMAP_SCAN:
+      pPhysical = physicalPlanNodeCreate(PHYSICAL_BITMAP_SCAN);
+      if( pPhysical ) {
+        if( pLogical->zLabel ) {
+          pPhysical->zLabel = sqlite3_mprintf("%s", pLogical->zLabel);
+        }
+        if( pLogical->nIndexKey > 0 ) {
+          pPhysical->aIndexKey = planPredicatesCopy(pLogical->aIndexKey,
+                                                    pLogical->nIndexKey);
+          if( pPhysical->aIndexKey ) pPhysical->nIndexKey = pLogical->nIndexKey;
+        }
+        pPhysical->rCost = pLogical->rEstimatedCost * 0.1; /* No rows touched */
+      }
+      break;
+      
+    case LOGICAL_RANGE_SCAN:
+    case LOGICAL_FULLTEXT_SCAN:
+      pPhysical = physicalPlanNodeCreate(pLogical->type == LOGICAL_RANGE_SCAN ?
+                                         PHYSICAL_RANGE_INDEX_SCAN :
+                                         PHYSICAL_FULLTEXT_SCAN);
+      if( pPhysical ) {
+        pPhysical->zIndexName = sqlite3_mprintf("%s", pLogical->zIndexName);
+        pPhysical->zProperty = sqlite3_mprintf("%s", pLogical->zProperty);
+        if( pLogical->zLabel ) {
+          pPhysical->zLabel = sqlite3_mprintf("%s", pLogical->zLabel);
+        }
+        if( pLogical->nIndexKey > 0 ) {
+          pPhysical->aIndexKey = planPredicatesCopy(pLogical->aIndexKey,
+                                                    pLogical->nIndexKey);
+          if( pPhysical->aIndexKey ) pPhysical->nIndexKey = pLogical->nIndexKey;
+        }
+        pPhysical->iFlags = pLogical->iFlags;
+        pPhysical->rCost = pLogical->rEstimatedCost * 0.1;
+      }
+      break;
+      
+    case LOGICAL_EXPAND:
+    case LOGICAL_VAR_LENGTH_EXPAND:
+    case LOGICAL_SHORTEST_PATH:
+      if( pLogical->type == LOGICAL_VAR_LENGTH_EXPAND ) {
+        pPhysical = physicalPlanNodeCreate(PHYSICAL_VAR_LENGTH_EXPAND);
+      } else if( pLogical->type == LOGICAL_SHORTEST_PATH ) {
+        pPhysical = physicalPlanNodeCreate(PHYSICAL_SHORTEST_PATH);
+      } else {
+        pPhysical = physicalPlanNodeCreate((pLogical->iFlags & PLAN_FLAG_EXPAND_INTO) ?
+                                           PHYSICAL_EXPAND_INTO : PHYSICAL_EXPAND_ALL);
+      }
+      if( pPhysical ) {
+        pPhysical->nMinHops = pLogical->nMinHops;
+        pPhysical->nMaxHops = pLogical->nMaxHops;
+        if( pLogical->zPathAlias ) {
+          pPhysical->zPathAlias = sqlite3_mprintf("%s", pLogical->zPathAlias);
+        }
+        pPhysical->zFromAlias = sqlite3_mprintf("%s", pLogical->zFromAlias);
+        if( pLogical->zRelAlias ) {
+          pPhysical->zRelAlias = sqlite3_mprintf("%s", pLogical->zRelAlias);
+        }
+        if( pLogical->zRelType ) {
+          pPhysical->zRelType = sqlite3_mprintf("%s", pLogical->zRelType);
+        }
+        if( pLogical->zLabel ) {
+          pPhysical->zLabel = sqlite3_mprintf("%s", pLogical->zLabel);
+        }
+        pPhysical->iFlags = pLogical->iFlags;
+      }
+      break;
+      
     case LOGICAL_FILTER:
     case LOGICAL_PROPERTY_FILTER:
     case LOGICAL_LABEL_FILTER:
@@ -170,12 +313,26 @@ PhysicalPlanNode *logicalPlanToPhysical(LogicalPlanNode *pLogical, PlanContext *
         if( pLogical->zValue ) {
           pPhysical->zValue = sqlite3_mprintf("%s", pLogical->zValue);
         }
+        if( pLogical->nExpr > 0 ) pPhysical->pFilterExpr = pLogical->apExpr[0];
         pPhysical->rSelectivity = 0.1; /* Assume 10% selectivity */
       }
       break;
       
     case LOGICAL_HASH_JOIN:
       pPhysical = physicalPlanNodeCreate(PHYSICAL_HASH_JOIN);
+      if( pPhysical && pLogical->zJoinKeys ) {
+        pPhysical->zJoinKeys = sqlite3_mprintf("%s", pLogical->zJoinKeys);
+      }
+      if( pPhysical && pLogical->zDistinctRels ) {
+        pPhysical->zDistinctRels = sqlite3_mprintf("%s", pLogical->zDistinctRels);
+      }
+      break;
+      
+    case LOGICAL_CARTESIAN_PRODUCT:
+      pPhysical = physicalPlanNodeCreate(PHYSICAL_NESTED_LOOP_JOIN);
+      if( pPhysical && pLogical->zDistinctRels ) {
+        pPhysical->zDistinctRels = sqlite3_mprintf("%s", pLogical->zDistinctRels);
+      }
       break;
       
     case LOGICAL_NESTED_LOOP_JOIN:
@@ -192,18 +349,86 @@ PhysicalPlanNode *logicalPlanToPhysical(LogicalPlanNode *pLogical, PlanContext *
       if( pPhysical && pLogical->zProperty ) {
         pPhysical->zProperty = sqlite3_mprintf("%s", pLogical->zProperty);
       }
+      if( pPhysical && pLogical->nExpr > 0 ) {
+        pPhysical->apProjections = pLogical->apExpr;
+        pPhysical->nProjections = pLogical->nExpr;
+        if( pLogical->nColumn > 0 ) {
+          pPhysical->aColumn = planColumnsCopy(pLogical->aColumn, pLogical->nColumn);
+          if( !pPhysical->aColumn ) {
+            physicalPlanNodeDestroy(pPhysical);
+            return NULL;
+          }
+          pPhysical->nColumn = pLogical->nColumn;
+        }
+      }
       break;
       
     case LOGICAL_SORT:
+      /* An ordered index scan below already returns this order */
+      if( (pLogical->iFlags & PLAN_FLAG_ORDERED) && pLogical->nChildren == 1 ) {
+        return logicalPlanToPhysical(pLogical->apChildren[0], pContext);
+      }
       pPhysical = physicalPlanNodeCreate(PHYSICAL_SORT);
+      if( pPhysical ) {
+        if( pLogical->zProperty ) {
+          pPhysical->zProperty = sqlite3_mprintf("%s", pLogical->zProperty);
+        }
+        if( pLogical->nColumn > 0 ) {
+          pPhysical->aColumn = planColumnsCopy(pLogical->aColumn, pLogical->nColumn);
+          if( !pPhysical->aColumn ) {
+            physicalPlanNodeDestroy(pPhysical);
+            return NULL;
+          }
+          pPhysical->nColumn = pLogical->nColumn;
+        }
+        pPhysical->iFlags = pLogical->iFlags;
+      }
       break;
       
     case LOGICAL_LIMIT:
+    case LOGICAL_SKIP:
+      /* SKIP is a limit without a count; a LIMIT over a SKIP takes it in */
       pPhysical = physicalPlanNodeCreate(PHYSICAL_LIMIT);
+      if( !pPhysical ) break;
+      pPhysical->nLimit = -1;
+      if( pLogical->type == LOGICAL_SKIP ) {
+        if( pLogical->zValue ) pPhysical->nSkip = atoi(pLogical->zValue);
+        break;
+      }
+      if( pLogical->zValue ) pPhysical->nLimit = atoi(pLogical->zValue);
+      if( pLogical->nChildren == 1 && pLogical->apChildren[0]->type == LOGICAL_SKIP ) {
+        pInput = pLogical->apChildren[0];
+        if( pInput->zValue ) pPhysical->nSkip = atoi(pInput->zValue);
+      }
       break;
       
     case LOGICAL_AGGREGATION:
       pPhysical = physicalPlanNodeCreate(PHYSICAL_AGGREGATION);
+      if( pPhysical && pLogical->nColumn > 0 ) {
+        pPhysical->aColumn = planColumnsCopy(pLogical->aColumn, pLogical->nColumn);
+        if( !pPhysical->aColumn ) {
+          physicalPlanNodeDestroy(pPhysical);
+          return NULL;
+        }
+        pPhysical->nColumn = pLogical->nColumn;
+        pPhysical->iFlags = pLogical->iFlags;
+      }
+      break;
+      
+    case LOGICAL_DISTINCT:
+      pPhysical = physicalPlanNodeCreate(PHYSICAL_DISTINCT);
+      if( pPhysical && pLogical->nColumn > 0 ) {
+        pPhysical->aColumn = planColumnsCopy(pLogical->aColumn, pLogical->nColumn);
+        if( !pPhysical->aColumn ) {
+          physicalPlanNodeDestroy(pPhysical);
+          return NULL;
+        }
+        pPhysical->nColumn = pLogical->nColumn;
+      }
+      break;
+      
+    case LOGICAL_UNION:
+      pPhysical = physicalPlanNodeCreate(PHYSICAL_UNION);
       break;
       
     default:
@@ -218,14 +443,23 @@ PhysicalPlanNode *logicalPlanToPhysical(LogicalPlanNode *pLogical, PlanContext *
   if( pLogical->zAlias ) {
     pPhysical->zAlias = sqlite3_mprintf("%s", pLogical->zAlias);
   }
+  if( pLogical->nScanFilter > 0 ) {
+    pPhysical->aScanFilter = planPredicatesCopy(pLogical->aScanFilter,
+                                                pLogical->nScanFilter);
+    if( !pPhysical->aScanFilter ) {
+      physicalPlanNodeDestroy(pPhysical);
+      return NULL;
+    }
+    pPhysical->nScanFilter = pLogical->nScanFilter;
+  }
   
   /* Set cost and row estimates */
   pPhysical->rCost = pLogical->rEstimatedCost;
   pPhysical->iRows = pLogical->iEstimatedRows;
   
   /* Convert children recursively */
-  for( i = 0; i < pLogical->nChildren; i++ ) {
-    pChild = logicalPlanToPhysical(pLogical->apChildren[i], pContext);
+  for( i = 0; i < pInput->nChildren; i++ ) {
+    pChild = logicalPlanToPhysical(pInput->apChildren[i], pContext);
     if( pChild ) {
       rc = physicalPlanNodeAddChild(pPhysical, pChild);
       if( rc != SQLITE_OK ) {
@@ -236,6 +470,8 @@ PhysicalPlanNode *logicalPlanToPhysical(LogicalPlanNode *pLogical, PlanContext *
     }
   }
   
+  if( pPhysical->type == PHYSICAL_LIMIT ) pushLimit(pPhysical);
+  
   return pPhysical;
 }
 
@@ -271,10 +507,62 @@ char *physicalPlanToString(PhysicalPlanNode *pNode) {
   }
   
   /* Build details string */
-  if( pNode->zIndexName ) {
+  if( pNode->type == PHYSICAL_EXPAND_ALL || pNode->type == PHYSICAL_EXPAND_INTO ||
+      pNode->type == PHYSICAL_VAR_LENGTH_EXPAND || pNode->type == PHYSICAL_SHORTEST_PATH ) {
+    int bIn = (pNode->iFlags & PLAN_FLAG_INCOMING) != 0;
+    int bAny = (pNode->iFlags & PLAN_FLAG_UNDIRECTED) != 0;
+    char *zHops = NULL;
+    if( pNode->type == PHYSICAL_VAR_LENGTH_EXPAND || pNode->type == PHYSICAL_SHORTEST_PATH ) {
+      if( pNode->nMaxHops < 0 ) {
+        zHops = sqlite3_mprintf("*%d..", pNode->nMinHops);
+      } else {
+        zHops = sqlite3_mprintf("*%d..%d", pNode->nMinHops, pNode->nMaxHops);
+      }
+    }
+    zDetails = sqlite3_mprintf("(%s)%s[%s%s%s%s]%s(%s%s%s)%s",
+                               pNode->zFromAlias ? pNode->zFromAlias : "",
+                               bIn ? "<-" : "-",
+                               pNode->zRelAlias ? pNode->zRelAlias : "",
+                               pNode->zRelType ? ":" : "",
+                               pNode->zRelType ? pNode->zRelType : "",
+                               zHops ? zHops : "",
+                               (bIn || bAny) ? "-" : "->",
+                               pNode->zAlias ? pNode->zAlias : "",
+                               pNode->zLabel ? ":" : "",
+                               pNode->zLabel ? pNode->zLabel : "",
+                               (pNode->iFlags & PLAN_FLAG_PRUNE_PATHS) ? " pruned" : "");
+    sqlite3_free(zHops);
+    if( zDetails && pNode->type == PHYSICAL_SHORTEST_PATH ) {
+      zDetails = sqlite3_mprintf("%s%s%s(%z)",
+                                 pNode->zPathAlias ? pNode->zPathAlias : "",
+                                 pNode->zPathAlias ? "=" : "",
+                                 (pNode->iFlags & PLAN_FLAG_ALL_PATHS) ?
+                                 "allShortestPaths" : "shortestPath", zDetails);
+    }
+  } else if( pNode->zJoinKeys ) {
+    zDetails = sqlite3_mprintf("on=%s", pNode->zJoinKeys);
+  } else if( pNode->type == PHYSICAL_AGGREGATION ||
+             (pNode->type == PHYSICAL_DISTINCT && pNode->nColumn > 0) ) {
+    zDetails = sqlite3_mprintf("%s", (pNode->iFlags & PLAN_FLAG_AGG_PARTIAL) ? "partial " :
+                               (pNode->iFlags & PLAN_FLAG_AGG_FINAL) ? "final " : "");
+    for( i = 0; zDetails && i < pNode->nColumn; i++ ) {
+      zDetails = sqlite3_mprintf("%z%s%s", zDetails, i ? "," : "", pNode->aColumn[i].zName);
+    }
+  } else if( pNode->type == PHYSICAL_SORT && pNode->nColumn > 0 ) {
+    zDetails = sqlite3_mprintf("by=");
+    for( i = 0; zDetails && i < pNode->nColumn; i++ ) {
+      zDetails = sqlite3_mprintf("%z%s%s%s", zDetails, i ? "," : "", pNode->aColumn[i].zName,
+                                 pNode->aColumn[i].bDesc ? " DESC" : "");
+    }
+    if( zDetails && pNode->nLimit > 0 ) {
+      zDetails = sqlite3_mprintf("%z top=%d", zDetails, pNode->nLimit);
+    }
+  } else if( pNode->zIndexName ) {
     zDetails = sqlite3_mprintf("index=%s", pNode->zIndexName);
   } else if( pNode->zLabel ) {
     zDetails = sqlite3_mprintf("label=%s", pNode->zLabel);
+  } else if( pNode->type == PHYSICAL_BITMAP_SCAN ) {
+    zDetails = sqlite3_mprintf("label=*");
   } else if( pNode->zProperty ) {
     if( pNode->zValue ) {
       zDetails = sqlite3_mprintf("prop=%s val=%s", pNode->zProperty, pNode->zValue);
@@ -283,6 +571,39 @@ char *physicalPlanToString(PhysicalPlanNode *pNode) {
     }
   }
   
+  /* Comparisons answered by a property, bitmap, range or full-text index.
+  ** Word operators such as CONTAINS are set off by spaces. */
+  for( i = 0; zDetails && i < pNode->nIndexKey; i++ ) {
+    PlanPredicate *pKey = &pNode->aIndexKey[i];
+    const char *zSep = isalpha((unsigned char)pKey->zOperator[0]) ? " " : "";
+    zDetails = sqlite3_mprintf("%z%s%s%s%s%s%s", zDetails, i ? "," : " key=",
+                               pKey->zProperty, zSep, pKey->zOperator, zSep,
+                               pKey->zValue);
+  }
+  /* Filters evaluated by the scan SQL */
+  for( i = 0; (zDetails || i == 0) && i < pNode->nScanFilter; i++ ) {
+    PlanPredicate *pFilter = &pNode->aScanFilter[i];
+    zDetails = sqlite3_mprintf("%z%s%s%s%s", zDetails,
+                               i ? "," : zDetails ? " where=" : "where=",
+                               pFilter->zProperty ? pFilter->zProperty : "id()",
+                               pFilter->zOperator, pFilter->zValue);
+  }
+  if( zDetails && (pNode->iFlags & PLAN_FLAG_ORDERED) ) {
+    zDetails = sqlite3_mprintf("%z order=%s%s", zDetails, pNode->zProperty,
+                               (pNode->iFlags & PLAN_FLAG_DESC) ? " DESC" : "");
+  }
+  if( pNode->type == PHYSICAL_LIMIT ) {
+    zDetails = pNode->nLimit >= 0 ? sqlite3_mprintf("count=%d", pNode->nLimit)
+                                  : sqlite3_mprintf("count=all");
+    if( zDetails && pNode->nSkip > 0 ) {
+      zDetails = sqlite3_mprintf("%z skip=%d", zDetails, pNode->nSkip);
+    }
+  } else if( pNode->type != PHYSICAL_SORT && (pNode->nLimit > 0 || pNode->nSkip > 0) ) {
+    /* SKIP and LIMIT pushed into a scan */
+    zDetails = sqlite3_mprintf("%z%slimit=%d skip=%d", zDetails, zDetails ? " " : "",
+                               pNode->nLimit, pNode->nSkip);
+  }
+  
   /* Build node string */
   if( pNode->zAlias && zDetails ) {
     zResult = sqlite3_mprintf("%s(%s %s cost=%.1f rows=%lld%s%s)",
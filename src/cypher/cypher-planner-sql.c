@@ -22,6 +22,7 @@ extern const sqlite3_api_routines *sqlite3_api;
 /* SQLITE_EXTENSION_INIT1 - removed to prevent multiple definition */
 #include "cypher-planner.h"
 #include <string.h>
+#include <stdlib.h>
 #include <assert.h>
 
 /*
@@ -70,13 +71,13 @@ static void cypherPlanSqlFunc(
   pAst = cypherParse(pParser, zQuery, &zErrMsg);
   if( !pAst ) {
     sqlite3_result_error(context, zErrMsg ? zErrMsg : "Parse error", -1);
-    if( zErrMsg ) sqlite3_free(zErrMsg);
+    if( zErrMsg ) free(zErrMsg);
     cypherParserDestroy(pParser);
     return;
   }
   
   /* Create planner and compile */
-  pPlanner = cypherPlannerCreate(sqlite3_context_db_handle(context), NULL);
+  pPlanner = cypherPlannerCreate(sqlite3_context_db_handle(context), getGlobalGraph());
   if( !pPlanner ) {
     sqlite3_result_error_nomem(context);
     cypherParserDestroy(pParser);
@@ -163,13 +164,13 @@ static void cypherLogicalPlanSqlFunc(
   pAst = cypherParse(pParser, zQuery, &zErrMsg);
   if( !pAst ) {
     sqlite3_result_error(context, zErrMsg ? zErrMsg : "Parse error", -1);
-    if( zErrMsg ) sqlite3_free(zErrMsg);
+    if( zErrMsg ) free(zErrMsg);
     cypherParserDestroy(pParser);
     return;
   }
   
   /* Create planner and compile to logical plan */
-  pPlanner = cypherPlannerCreate(sqlite3_context_db_handle(context), NULL);
+  pPlanner = cypherPlannerCreate(sqlite3_context_db_handle(context), getGlobalGraph());
   if( !pPlanner ) {
     sqlite3_result_error_nomem(context);
     cypherParserDestroy(pParser);
@@ -249,13 +250,13 @@ static void cypherExplainSqlFunc(
   pAst = cypherParse(pParser, zQuery, &zErrMsg);
   if( !pAst ) {
     sqlite3_result_error(context, zErrMsg ? zErrMsg : "Parse error", -1);
-    if( zErrMsg ) sqlite3_free(zErrMsg);
+    if( zErrMsg ) free(zErrMsg);
     cypherParserDestroy(pParser);
     return;
   }
   
   /* Create planner and compile */
-  pPlanner = cypherPlannerCreate(sqlite3_context_db_handle(context), NULL);
+  pPlanner = cypherPlannerCreate(sqlite3_context_db_handle(context), getGlobalGraph());
   if( !pPlanner ) {
     sqlite3_result_error_nomem(context);
     cypherParserDestroy(pParser);
@@ -296,12 +297,14 @@ static void cypherExplainSqlFunc(
     "%s\n\n"
     "Optimization Notes:\n"
     "- Index usage: %s\n"
+    "- Property indexes available: %d\n"
     "- Join reordering: %s\n"
     "- Estimated total cost: %.1f\n",
     zQuery,
     zLogical ? zLogical : "(failed to generate)",
     zPhysical ? zPhysical : "(failed to generate)",
     pPlanner->pContext->bUseIndexes ? "enabled" : "disabled",
+    pPlanner->pContext->nPropertyIndexes,
     pPlanner->pContext->bReorderJoins ? "enabled" : "disabled",
     pPhysical ? pPhysical->rCost : 0.0
   );
@@ -22,12 +22,18 @@ extern const sqlite3_api_routines *sqlite3_api;
 #endif
 /* SQLITE_EXTENSION_INIT1 - removed to prevent multiple definition */
 #include "cypher-planner.h"
+#include "cypher-paths.h"
+#include "cypher-optimizer.h"
+#include "cypher-expressions.h"
 #include <string.h>
+#include <stdlib.h>
 #include <assert.h>
 
 /* Forward declarations for optimization functions */
 static double calculateJoinCost(LogicalPlanNode *pLeft, LogicalPlanNode *pRight, int joinType);
 static int optimizeIndexUsage(LogicalPlanNode *pNode, PlanContext *pContext);
+static LogicalPlanNode *compileAstNode(CypherAst *pAst, PlanContext *pContext);
+static const char *aggregateCall(CypherAst *pExpr, CypherAst **ppArg);
 
 /*
 ** Create a new Cypher query planner.
@@ -56,8 +62,44 @@ CypherPlanner *cypherPlannerCreate(sqlite3 *pDb, GraphVtab *pGraph) {
   /* Set default optimization settings */
   pPlanner->pContext->bUseIndexes = 1;
   pPlanner->pContext->bReorderJoins = 1;
+  pPlanner->pContext->bPushdown = 1;
   pPlanner->pContext->rIndexCostFactor = 0.1;
   
+  /* Property indexes created with graph_create_index() */
+  if( pGraph ) {
+    if( graphLoadPropertyIndexes(pGraph, &pPlanner->pContext->azPropertyIndexes,
+                                 &pPlanner->pContext->azIndexLabels,
+                                 &pPlanner->pContext->azIndexColumns,
+                                 &pPlanner->pContext->nPropertyIndexes)!=SQLITE_OK ) {
+      cypherPlannerDestroy(pPlanner);
+      return NULL;
+    }
+    /* Bitmap indexes created with graph_create_bitmap_index() */
+    if( graphLoadBitmapIndexes(pGraph, &pPlanner->pContext->azBitmapIndexes,
+                               &pPlanner->pContext->nBitmapIndexes)!=SQLITE_OK ) {
+      cypherPlannerDestroy(pPlanner);
+      return NULL;
+    }
+    /* Range indexes created with graph_create_range_index() */
+    if( graphLoadRangeIndexes(pGraph, &pPlanner->pContext->azRangeIndexes,
+                              &pPlanner->pContext->azRangeLabels,
+                              &pPlanner->pContext->azRangeProps,
+                              &pPlanner->pContext->azRangeTypes,
+                              &pPlanner->pContext->nRangeIndexes)!=SQLITE_OK ) {
+      cypherPlannerDestroy(pPlanner);
+      return NULL;
+    }
+    /* Full-text indexes created with graph_create_fulltext_index() */
+    if( graphLoadFulltextIndexes(pGraph, &pPlanner->pContext->azFulltextIndexes,
+                                 &pPlanner->pContext->azFulltextLabels,
+                                 &pPlanner->pContext->azFulltextProps,
+                                 &pPlanner->pContext->azFulltextTokenizers,
+                                 &pPlanner->pContext->nFulltextIndexes)!=SQLITE_OK ) {
+      cypherPlannerDestroy(pPlanner);
+      return NULL;
+    }
+  }
+  
   return pPlanner;
 }
 
@@ -85,95 +127,1803 @@ void cypherPlannerDestroy(CypherPlanner *pPlanner) {
     }
     sqlite3_free(pPlanner->pContext->azLabelIndexes);
     
-    for( i = 0; i < pPlanner->pContext->nPropertyIndexes; i++ ) {
-      sqlite3_free(pPlanner->pContext->azPropertyIndexes[i]);
+    for( i = 0; i < pPlanner->pContext->nPropertyIndexes; i++ ) {
+      sqlite3_free(pPlanner->pContext->azPropertyIndexes[i]);
+      sqlite3_free(pPlanner->pContext->azIndexLabels[i]);
+      sqlite3_free(pPlanner->pContext->azIndexColumns[i]);
+    }
+    sqlite3_free(pPlanner->pContext->azPropertyIndexes);
+    sqlite3_free(pPlanner->pContext->azIndexLabels);
+    sqlite3_free(pPlanner->pContext->azIndexColumns);
+    
+    for( i = 0; i < pPlanner->pContext->nBitmapIndexes; i++ ) {
+      sqlite3_free(pPlanner->pContext->azBitmapIndexes[i]);
+    }
+    sqlite3_free(pPlanner->pContext->azBitmapIndexes);
+    
+    for( i = 0; i < pPlanner->pContext->nRangeIndexes; i++ ) {
+      sqlite3_free(pPlanner->pContext->azRangeIndexes[i]);
+      sqlite3_free(pPlanner->pContext->azRangeLabels[i]);
+      sqlite3_free(pPlanner->pContext->azRangeProps[i]);
+      sqlite3_free(pPlanner->pContext->azRangeTypes[i]);
+    }
+    sqlite3_free(pPlanner->pContext->azRangeIndexes);
+    sqlite3_free(pPlanner->pContext->azRangeLabels);
+    sqlite3_free(pPlanner->pContext->azRangeProps);
+    sqlite3_free(pPlanner->pContext->azRangeTypes);
+    
+    for( i = 0; i < pPlanner->pContext->nFulltextIndexes; i++ ) {
+      sqlite3_free(pPlanner->pContext->azFulltextIndexes[i]);
+      sqlite3_free(pPlanner->pContext->azFulltextLabels[i]);
+      sqlite3_free(pPlanner->pContext->azFulltextProps[i]);
+      sqlite3_free(pPlanner->pContext->azFulltextTokenizers[i]);
+    }
+    sqlite3_free(pPlanner->pContext->azFulltextIndexes);
+    sqlite3_free(pPlanner->pContext->azFulltextLabels);
+    sqlite3_free(pPlanner->pContext->azFulltextProps);
+    sqlite3_free(pPlanner->pContext->azFulltextTokenizers);
+    
+    sqlite3_free(pPlanner->pContext->zErrorMsg);
+    sqlite3_free(pPlanner->pContext);
+  }
+  
+  /* Free plans */
+  logicalPlanNodeDestroy(pPlanner->pLogicalPlan);
+  physicalPlanNodeDestroy(pPlanner->pPhysicalPlan);
+  
+  sqlite3_free(pPlanner->zErrorMsg);
+  sqlite3_free(pPlanner);
+}
+
+/*
+** Add a variable to the planning context.
+** Returns SQLITE_OK on success, SQLITE_NOMEM on allocation failure.
+*/
+static int planContextAddVariable(PlanContext *pContext, const char *zVar, LogicalPlanNode *pNode) {
+  char **azNew;
+  LogicalPlanNode **apNew;
+  
+  if( !pContext || !zVar ) return SQLITE_MISUSE;
+  
+  /* Resize arrays if needed */
+  if( pContext->nVariables >= pContext->nVariablesAlloc ) {
+    int nNew = pContext->nVariablesAlloc ? pContext->nVariablesAlloc * 2 : 8;
+    
+    azNew = sqlite3_realloc(pContext->azVariables, nNew * sizeof(char*));
+    if( !azNew ) return SQLITE_NOMEM;
+    pContext->azVariables = azNew;
+    
+    apNew = sqlite3_realloc(pContext->apVarNodes, nNew * sizeof(LogicalPlanNode*));
+    if( !apNew ) return SQLITE_NOMEM;
+    pContext->apVarNodes = apNew;
+    
+    pContext->nVariablesAlloc = nNew;
+  }
+  
+  /* Add variable */
+  pContext->azVariables[pContext->nVariables] = sqlite3_mprintf("%s", zVar);
+  pContext->apVarNodes[pContext->nVariables] = pNode;
+  
+  if( !pContext->azVariables[pContext->nVariables] ) {
+    return SQLITE_NOMEM;
+  }
+  
+  pContext->nVariables++;
+  return SQLITE_OK;
+}
+
+
+/*
+** Return true if zOp is a comparison a property index can answer.
+*/
+static int isIndexableOperator(const char *zOp) {
+  return zOp && (strcmp(zOp, "=") == 0 || strcmp(zOp, "<") == 0 ||
+                 strcmp(zOp, "<=") == 0 || strcmp(zOp, ">") == 0 ||
+                 strcmp(zOp, ">=") == 0);
+}
+
+/*
+** Return true if zOp is a string operator a full-text index can answer.
+*/
+static int isTextOperator(const char *zOp) {
+  return zOp && (sqlite3_stricmp(zOp, "CONTAINS") == 0 ||
+                 sqlite3_stricmp(zOp, "STARTS WITH") == 0 ||
+                 sqlite3_stricmp(zOp, "ENDS WITH") == 0);
+}
+
+/*
+** Kinds of literal recognised by the WHERE rewrite. Literals keep their
+** source text, so strings are still quoted and keywords in any case.
+*/
+#define PLAN_LIT_NONE    0
+#define PLAN_LIT_NULL    1
+#define PLAN_LIT_BOOLEAN 2
+#define PLAN_LIT_INTEGER 3
+#define PLAN_LIT_FLOAT   4
+#define PLAN_LIT_STRING  5
+
+#define PLAN_SMALLEST_INT64 (((sqlite3_int64)-1) - 0x7fffffffffffffffLL)
+
+typedef struct PlanLiteral {
+  int eKind;
+  int bValue;              /* PLAN_LIT_BOOLEAN */
+  sqlite3_int64 iValue;    /* PLAN_LIT_INTEGER */
+  double rValue;           /* PLAN_LIT_INTEGER and PLAN_LIT_FLOAT */
+  const char *zText;       /* PLAN_LIT_STRING: text between the quotes */
+  int nText;
+} PlanLiteral;
+
+/*
+** Classify pAst as a literal, filling in *pLit. Returns the kind, which is
+** PLAN_LIT_NONE for anything that is not a literal.
+*/
+static int planLiteral(CypherAst *pAst, PlanLiteral *pLit) {
+  const char *z = cypherAstGetValue(pAst);
+  char *zEnd;
+  int n;
+  
+  memset(pLit, 0, sizeof(*pLit));
+  if( !cypherAstIsType(pAst, CYPHER_AST_LITERAL) || !z ) return PLAN_LIT_NONE;
+  n = (int)strlen(z);
+  
+  if( sqlite3_stricmp(z, "null") == 0 ) {
+    pLit->eKind = PLAN_LIT_NULL;
+  } else if( sqlite3_stricmp(z, "true") == 0 || sqlite3_stricmp(z, "false") == 0 ) {
+    pLit->eKind = PLAN_LIT_BOOLEAN;
+    pLit->bValue = (z[0] == 't' || z[0] == 'T');
+  } else if( n >= 2 && (z[0] == '\'' || z[0] == '"') && z[n-1] == z[0] ) {
+    pLit->eKind = PLAN_LIT_STRING;
+    pLit->zText = z + 1;
+    pLit->nText = n - 2;
+  } else if( n > 0 ) {
+    pLit->iValue = strtoll(z, &zEnd, 10);
+    if( *zEnd == 0 ) {
+      pLit->eKind = PLAN_LIT_INTEGER;
+      pLit->rValue = (double)pLit->iValue;
+    } else {
+      pLit->rValue = strtod(z, &zEnd);
+      if( *zEnd == 0 ) pLit->eKind = PLAN_LIT_FLOAT;
+    }
+  }
+  return pLit->eKind;
+}
+
+/*
+** Free pAst, except for pKeep, which may be one of its children. The
+** parser lists the operands of some operators twice, so each distinct
+** child is freed once.
+*/
+static void planAstDestroyExcept(CypherAst *pAst, CypherAst *pKeep) {
+  int i, j;
+  
+  for( i = 0; i < pAst->nChildren; i++ ) {
+    CypherAst *pChild = pAst->apChildren[i];
+    if( pChild == pKeep ) continue;
+    for( j = 0; j < i && pAst->apChildren[j] != pChild; j++ );
+    if( j == i ) cypherAstDestroy(pChild);
+  }
+  pAst->nChildren = 0;
+  cypherAstDestroy(pAst);
+}
+
+/*
+** Replace pAst by a literal with text zText, which is freed. If zText is
+** NULL (out of memory) pAst is returned unchanged.
+*/
+static CypherAst *planFoldTo(CypherAst *pAst, char *zText) {
+  CypherAst *pNew;
+  
+  if( !zText ) return pAst;
+  pNew = cypherAstCreateLiteral(zText, pAst->iLine, pAst->iColumn);
+  sqlite3_free(zText);
+  if( !pNew ) return pAst;
+  planAstDestroyExcept(pAst, NULL);
+  return pNew;
+}
+
+/* Replace pAst by its operand pKeep */
+static CypherAst *planReplaceBy(CypherAst *pAst, CypherAst *pKeep) {
+  planAstDestroyExcept(pAst, pKeep);
+  return pKeep;
+}
+
+/*
+** Fold an arithmetic operator over two literals. Integers follow Cypher's
+** integer arithmetic; division by zero and overflow are left for run time.
+*/
+static char *planFoldArithmetic(const char *zOp, PlanLiteral *pL, PlanLiteral *pR) {
+  sqlite3_int64 x = pL->iValue, y = pR->iValue, r;
+  
+  if( pL->eKind == PLAN_LIT_NULL || pR->eKind == PLAN_LIT_NULL ) {
+    return sqlite3_mprintf("null");
+  }
+  if( pL->eKind == PLAN_LIT_STRING && pR->eKind == PLAN_LIT_STRING ) {
+    const char *zQ = pL->zText - 1;
+    if( strcmp(zOp, "+") != 0 || memchr(pR->zText, zQ[0], pR->nText) ) return NULL;
+    return sqlite3_mprintf("%c%.*s%.*s%c", zQ[0], pL->nText, pL->zText,
+                           pR->nText, pR->zText, zQ[0]);
+  }
+  if( pL->eKind == PLAN_LIT_INTEGER && pR->eKind == PLAN_LIT_INTEGER ) {
+    if( strcmp(zOp, "+") == 0 ) {
+      if( __builtin_add_overflow(x, y, &r) ) return NULL;
+    } else if( strcmp(zOp, "-") == 0 ) {
+      if( __builtin_sub_overflow(x, y, &r) ) return NULL;
+    } else if( strcmp(zOp, "*") == 0 ) {
+      if( __builtin_mul_overflow(x, y, &r) ) return NULL;
+    } else if( strcmp(zOp, "/") == 0 || strcmp(zOp, "%") == 0 ) {
+      if( y == 0 || (y == -1 && x == PLAN_SMALLEST_INT64) ) return NULL;
+      r = zOp[0] == '/' ? x / y : x % y;
+    } else {
+      return NULL;
+    }
+    return sqlite3_mprintf("%lld", r);
+  }
+  if( (pL->eKind == PLAN_LIT_INTEGER || pL->eKind == PLAN_LIT_FLOAT) &&
+      (pR->eKind == PLAN_LIT_INTEGER || pR->eKind == PLAN_LIT_FLOAT) ) {
+    double a = pL->rValue, b = pR->rValue;
+    if( strcmp(zOp, "+") == 0 ) return sqlite3_mprintf("%!.17g", a + b);
+    if( strcmp(zOp, "-") == 0 ) return sqlite3_mprintf("%!.17g", a - b);
+    if( strcmp(zOp, "*") == 0 ) return sqlite3_mprintf("%!.17g", a * b);
+    if( strcmp(zOp, "/") == 0 && b != 0.0 ) return sqlite3_mprintf("%!.17g", a / b);
+  }
+  return NULL;
+}
+
+/*
+** Fold a comparison of two literals to true, false or null. Returns NULL
+** if the comparison is not one that can be decided here.
+*/
+static char *planFoldComparison(const char *zOp, PlanLiteral *pL, PlanLiteral *pR) {
+  int c;
+  
+  if( !isIndexableOperator(zOp) && strcmp(zOp, "<>") != 0 ) return NULL;
+  if( pL->eKind == PLAN_LIT_NULL || pR->eKind == PLAN_LIT_NULL ) {
+    return sqlite3_mprintf("null");
+  }
+  if( (pL->eKind == PLAN_LIT_INTEGER || pL->eKind == PLAN_LIT_FLOAT) &&
+      (pR->eKind == PLAN_LIT_INTEGER || pR->eKind == PLAN_LIT_FLOAT) ) {
+    if( pL->eKind == PLAN_LIT_INTEGER && pR->eKind == PLAN_LIT_INTEGER ) {
+      c = (pL->iValue > pR->iValue) - (pL->iValue < pR->iValue);
+    } else {
+      c = (pL->rValue > pR->rValue) - (pL->rValue < pR->rValue);
+    }
+  } else if( pL->eKind == PLAN_LIT_STRING && pR->eKind == PLAN_LIT_STRING ) {
+    int n = pL->nText < pR->nText ? pL->nText : pR->nText;
+    /* The texts are as written: leave escaped strings to the executor */
+    if( memchr(pL->zText, '\\', pL->nText) || memchr(pR->zText, '\\', pR->nText) ) {
+      return NULL;
+    }
+    c = memcmp(pL->zText, pR->zText, n);
+    if( c == 0 ) c = pL->nText - pR->nText;
+  } else if( pL->eKind == PLAN_LIT_BOOLEAN && pR->eKind == PLAN_LIT_BOOLEAN ) {
+    c = pL->bValue - pR->bValue;
+  } else {
+    return NULL;
+  }
+  
+  if( strcmp(zOp, "=") == 0 )  c = (c == 0);
+  else if( strcmp(zOp, "<>") == 0 ) c = (c != 0);
+  else if( strcmp(zOp, "<") == 0 )  c = (c < 0);
+  else if( strcmp(zOp, "<=") == 0 ) c = (c <= 0);
+  else if( strcmp(zOp, ">") == 0 )  c = (c > 0);
+  else c = (c >= 0);
+  return sqlite3_mprintf(c ? "true" : "false");
+}
+
+/*
+** The comparison that holds with its operands swapped: 10 < n.x is
+** n.x > 10.
+*/
+static const char *planFlipComparison(const char *zOp) {
+  if( strcmp(zOp, "<") == 0 ) return ">";
+  if( strcmp(zOp, "<=") == 0 ) return ">=";
+  if( strcmp(zOp, ">") == 0 ) return "<";
+  if( strcmp(zOp, ">=") == 0 ) return "<=";
+  return zOp;
+}
+
+/*
+** Rewrite a WHERE expression in place and return its new root. Constant
+** subexpressions are folded into literals, AND, OR and NOT with a constant
+** operand are simplified, and a comparison with the literal on the left
+** is turned around so that the property filters and index matching,
+** which expect n.prop <op> value, recognise it.
+*/
+static CypherAst *simplifyWhereExpr(CypherAst *pExpr) {
+  PlanLiteral l, r;
+  const char *zOp;
+  int i, j;
+  
+  if( !pExpr ) return NULL;
+  
+  /* Operands first, each distinct child once */
+  for( i = 0; i < pExpr->nChildren; i++ ) {
+    CypherAst *pOld = pExpr->apChildren[i];
+    CypherAst *pNew;
+    for( j = 0; j < i && pExpr->apChildren[j] != pOld; j++ );
+    if( j < i ) continue;
+    pNew = simplifyWhereExpr(pOld);
+    for( j = i; pNew != pOld && j < pExpr->nChildren; j++ ) {
+      if( pExpr->apChildren[j] == pOld ) pExpr->apChildren[j] = pNew;
+    }
+  }
+  zOp = cypherAstGetValue(pExpr);
+  
+  switch( pExpr->type ) {
+    case CYPHER_AST_ADDITIVE:
+    case CYPHER_AST_MULTIPLICATIVE:
+      if( pExpr->nChildren == 2 && zOp && planLiteral(pExpr->apChildren[0], &l) &&
+          planLiteral(pExpr->apChildren[1], &r) ) {
+        char *zText = planFoldArithmetic(zOp, &l, &r);
+        if( zText ) return planFoldTo(pExpr, zText);
+      }
+      break;
+      
+    case CYPHER_AST_UNARY_OP:
+      if( pExpr->nChildren >= 1 && zOp && planLiteral(pExpr->apChildren[0], &l) ) {
+        if( strcmp(zOp, "+") == 0 && (l.eKind == PLAN_LIT_INTEGER || l.eKind == PLAN_LIT_FLOAT) ) {
+          return planReplaceBy(pExpr, pExpr->apChildren[0]);
+        }
+        if( strcmp(zOp, "-") == 0 && l.eKind == PLAN_LIT_INTEGER && l.iValue != PLAN_SMALLEST_INT64 ) {
+          return planFoldTo(pExpr, sqlite3_mprintf("%lld", -l.iValue));
+        }
+        if( strcmp(zOp, "-") == 0 && l.eKind == PLAN_LIT_FLOAT ) {
+          return planFoldTo(pExpr, sqlite3_mprintf("%!.17g", -l.rValue));
+        }
+      }
+      break;
+      
+    case CYPHER_AST_FUNCTION_CALL:
+      /* size() of a list literal or string literal */
+      if( pExpr->nChildren == 2 && 
+          sqlite3_stricmp(cypherAstGetValue(pExpr->apChildren[0]), "size") == 0 ) {
+        CypherAst *pArg = pExpr->apChildren[1];
+        if( cypherAstIsType(pArg, CYPHER_AST_ARRAY) || cypherAstIsType(pArg, CYPHER_AST_LIST) ) {
+          return planFoldTo(pExpr, sqlite3_mprintf("%d", pArg->nChildren));
+        }
+        if( planLiteral(pArg, &l) == PLAN_LIT_STRING && !memchr(l.zText, '\\', l.nText) ) {
+          return planFoldTo(pExpr, sqlite3_mprintf("%d", l.nText));
+        }
+        if( l.eKind == PLAN_LIT_NULL ) {
+          return planFoldTo(pExpr, sqlite3_mprintf("null"));
+        }
+      }
+      break;
+      
+    case CYPHER_AST_COMPARISON:
+    case CYPHER_AST_BINARY_OP:
+      if( pExpr->nChildren < 2 || !zOp ) break;
+      planLiteral(pExpr->apChildren[0], &l);
+      planLiteral(pExpr->apChildren[1], &r);
+      
+      if( sqlite3_stricmp(zOp, "OR") == 0 ) {
+        /* true OR x is true, false OR x is x */
+        if( l.eKind == PLAN_LIT_BOOLEAN && l.bValue ) return planReplaceBy(pExpr, pExpr->apChildren[0]);
+        if( r.eKind == PLAN_LIT_BOOLEAN && r.bValue ) return planReplaceBy(pExpr, pExpr->apChildren[1]);
+        if( l.eKind == PLAN_LIT_BOOLEAN ) return planReplaceBy(pExpr, pExpr->apChildren[1]);
+        if( r.eKind == PLAN_LIT_BOOLEAN ) return planReplaceBy(pExpr, pExpr->apChildren[0]);
+        break;
+      }
+      if( (l.eKind == PLAN_LIT_NULL || r.eKind == PLAN_LIT_NULL) &&
+          (isIndexableOperator(zOp) || strcmp(zOp, "<>") == 0) ) {
+        /* Comparing with null is null, whatever the other operand */
+        return planFoldTo(pExpr, sqlite3_mprintf("null"));
+      }
+      if( l.eKind && r.eKind ) {
+        char *zText = planFoldComparison(zOp, &l, &r);
+        if( zText ) return planFoldTo(pExpr, zText);
+      } else if( l.eKind && !r.eKind && pExpr->nChildren == 2 &&
+                 (isIndexableOperator(zOp) || strcmp(zOp, "<>") == 0) ) {
+        CypherAst *pLit = pExpr->apChildren[0];
+        pExpr->apChildren[0] = pExpr->apChildren[1];
+        pExpr->apChildren[1] = pLit;
+        cypherAstSetValue(pExpr, planFlipComparison(zOp));
+      }
+      break;
+      
+    case CYPHER_AST_AND:
+      if( pExpr->nChildren != 2 ) break;
+      planLiteral(pExpr->apChildren[0], &l);
+      planLiteral(pExpr->apChildren[1], &r);
+      /* false AND x is false, true AND x is x */
+      if( l.eKind == PLAN_LIT_BOOLEAN && !l.bValue ) return planReplaceBy(pExpr, pExpr->apChildren[0]);
+      if( r.eKind == PLAN_LIT_BOOLEAN && !r.bValue ) return planReplaceBy(pExpr, pExpr->apChildren[1]);
+      if( l.eKind == PLAN_LIT_BOOLEAN ) return planReplaceBy(pExpr, pExpr->apChildren[1]);
+      if( r.eKind == PLAN_LIT_BOOLEAN ) return planReplaceBy(pExpr, pExpr->apChildren[0]);
+      break;
+      
+    case CYPHER_AST_NOT:
+      if( pExpr->nChildren != 1 ) break;
+      if( planLiteral(pExpr->apChildren[0], &l) == PLAN_LIT_BOOLEAN ) {
+        return planFoldTo(pExpr, sqlite3_mprintf(l.bValue ? "false" : "true"));
+      }
+      if( l.eKind == PLAN_LIT_NULL ) {
+        return planReplaceBy(pExpr, pExpr->apChildren[0]);
+      }
+      if( cypherAstIsType(pExpr->apChildren[0], CYPHER_AST_NOT) &&
+          pExpr->apChildren[0]->nChildren == 1 ) {
+        CypherAst *pInner = pExpr->apChildren[0];
+        CypherAst *pKeep = pInner->apChildren[0];
+        planAstDestroyExcept(pInner, pKeep);
+        pExpr->nChildren = 0;
+        cypherAstDestroy(pExpr);
+        return pKeep;
+      }
+      break;
+      
+    default:
+      break;
+  }
+  return pExpr;
+}
+
+/*
+** Return true if the WHERE expression pExpr, once simplified, can never
+** hold: it is the literal false or null.
+*/
+static int whereIsAlwaysFalse(CypherAst *pExpr) {
+  PlanLiteral l;
+  int eKind = planLiteral(pExpr, &l);
+  return eKind == PLAN_LIT_NULL || (eKind == PLAN_LIT_BOOLEAN && !l.bValue);
+}
+
+/*
+** Operators of the expression evaluator, by their source text.
+*/
+static const struct {
+  const char *zOp;
+  CypherExpressionType eType;
+  int op;
+} aPlanOperator[] = {
+  { "=",           CYPHER_EXPR_COMPARISON, CYPHER_CMP_EQUAL },
+  { "<>",          CYPHER_EXPR_COMPARISON, CYPHER_CMP_NOT_EQUAL },
+  { "<",           CYPHER_EXPR_COMPARISON, CYPHER_CMP_LESS },
+  { "<=",          CYPHER_EXPR_COMPARISON, CYPHER_CMP_LESS_EQUAL },
+  { ">",           CYPHER_EXPR_COMPARISON, CYPHER_CMP_GREATER },
+  { ">=",          CYPHER_EXPR_COMPARISON, CYPHER_CMP_GREATER_EQUAL },
+  { "STARTS WITH", CYPHER_EXPR_COMPARISON, CYPHER_CMP_STARTS_WITH },
+  { "ENDS WITH",   CYPHER_EXPR_COMPARISON, CYPHER_CMP_ENDS_WITH },
+  { "CONTAINS",    CYPHER_EXPR_COMPARISON, CYPHER_CMP_CONTAINS },
+  { "IN",          CYPHER_EXPR_COMPARISON, CYPHER_CMP_IN },
+  { "AND",         CYPHER_EXPR_LOGICAL,    CYPHER_LOGIC_AND },
+  { "OR",          CYPHER_EXPR_LOGICAL,    CYPHER_LOGIC_OR },
+  { "XOR",         CYPHER_EXPR_LOGICAL,    CYPHER_LOGIC_XOR },
+  { "+",           CYPHER_EXPR_ARITHMETIC, CYPHER_OP_ADD },
+  { "-",           CYPHER_EXPR_ARITHMETIC, CYPHER_OP_SUBTRACT },
+  { "*",           CYPHER_EXPR_ARITHMETIC, CYPHER_OP_MULTIPLY },
+  { "/",           CYPHER_EXPR_ARITHMETIC, CYPHER_OP_DIVIDE },
+  { "%",           CYPHER_EXPR_ARITHMETIC, CYPHER_OP_MODULO },
+};
+
+/*
+** Copy the nText bytes of a string literal between its quotes, resolving
+** the escapes as the lexer leaves them: \n, \t and \r are control
+** characters and a backslash before any other character quotes it.
+*/
+static char *planUnescape(const char *zText, int nText) {
+  char *z = sqlite3_malloc(nText + 1);
+  int i, j;
+  
+  if( !z ) return NULL;
+  for( i = j = 0; i < nText; i++ ) {
+    char c = zText[i];
+    if( c == '\\' && i + 1 < nText ) {
+      c = zText[++i];
+      if( c == 'n' ) c = '\n';
+      else if( c == 't' ) c = '\t';
+      else if( c == 'r' ) c = '\r';
+    }
+    z[j++] = c;
+  }
+  z[j] = 0;
+  return z;
+}
+
+char *planLiteralText(const char *zValue) {
+  int n = (int)strlen(zValue);
+  
+  if( n < 2 || (zValue[0] != '\'' && zValue[0] != '"') || zValue[n-1] != zValue[0] ) {
+    return NULL;
+  }
+  return planUnescape(zValue + 1, n - 2);
+}
+
+/*
+** Set *pValue to the value of the literal pAst. Strings lose their quotes
+** and escapes. Returns SQLITE_ERROR if pAst is not a literal.
+*/
+static int planLiteralValue(CypherAst *pAst, CypherValue *pValue) {
+  PlanLiteral l;
+  char *z;
+  int rc;
+  
+  cypherValueInit(pValue);
+  switch( planLiteral(pAst, &l) ) {
+    case PLAN_LIT_NULL:
+      return SQLITE_OK;
+    case PLAN_LIT_BOOLEAN:
+      cypherValueSetBoolean(pValue, l.bValue);
+      return SQLITE_OK;
+    case PLAN_LIT_INTEGER:
+      cypherValueSetInteger(pValue, l.iValue);
+      return SQLITE_OK;
+    case PLAN_LIT_FLOAT:
+      cypherValueSetFloat(pValue, l.rValue);
+      return SQLITE_OK;
+    case PLAN_LIT_STRING:
+      z = planUnescape(l.zText, l.nText);
+      if( !z ) return SQLITE_NOMEM;
+      rc = cypherValueSetString(pValue, z);
+      sqlite3_free(z);
+      return rc;
+    default:
+      return SQLITE_ERROR;
+  }
+}
+
+/*
+** Compile the AST expression pAst into an expression the executor
+** evaluates. Returns SQLITE_ERROR, with an error message in pContext, for
+** an expression the evaluator does not support.
+*/
+static int planCompileExpr(CypherAst *pAst, PlanContext *pContext,
+                           CypherExpression **ppExpr) {
+  const char *zOp = cypherAstGetValue(pAst);
+  CypherExpression *apArg[2] = { NULL, NULL };
+  CypherExpression **apList = NULL;
+  CypherAst *pArg;
+  CypherValue value;
+  int rc = SQLITE_OK;
+  int nArg = 0, i;
+  
+  *ppExpr = NULL;
+  if( !pAst ) return SQLITE_MISUSE;
+  
+  switch( pAst->type ) {
+    case CYPHER_AST_LITERAL:
+      rc = planLiteralValue(pAst, &value);
+      if( rc == SQLITE_OK ) {
+        rc = cypherExpressionCreateLiteral(ppExpr, &value);
+        cypherValueDestroy(&value);
+        return rc;
+      }
+      if( rc != SQLITE_ERROR ) return rc;
+      break;
+      
+    case CYPHER_AST_IDENTIFIER:
+      if( !zOp ) break;
+      return cypherExpressionCreateVariable(ppExpr, zOp);
+      
+    case CYPHER_AST_PROPERTY:
+      if( pAst->nChildren != 2 || !cypherAstGetValue(pAst->apChildren[1]) ) break;
+      rc = planCompileExpr(pAst->apChildren[0], pContext, &apArg[0]);
+      if( rc == SQLITE_OK ) {
+        rc = cypherExpressionCreateProperty(ppExpr, apArg[0],
+                                            cypherAstGetValue(pAst->apChildren[1]));
+        if( rc != SQLITE_OK ) cypherExpressionDestroy(apArg[0]);
+      }
+      return rc;
+      
+    case CYPHER_AST_AND:
+      zOp = "AND";
+      /* fall through */
+    case CYPHER_AST_COMPARISON:
+    case CYPHER_AST_BINARY_OP:
+    case CYPHER_AST_ADDITIVE:
+    case CYPHER_AST_MULTIPLICATIVE:
+      if( pAst->nChildren != 2 || !zOp ) break;
+      for( i = 0; i < (int)(sizeof(aPlanOperator) / sizeof(aPlanOperator[0])); i++ ) {
+        if( sqlite3_stricmp(zOp, aPlanOperator[i].zOp) == 0 ) break;
+      }
+      if( i == (int)(sizeof(aPlanOperator) / sizeof(aPlanOperator[0])) ) break;
+      rc = planCompileExpr(pAst->apChildren[0], pContext, &apArg[0]);
+      if( rc == SQLITE_OK ) rc = planCompileExpr(pAst->apChildren[1], pContext, &apArg[1]);
+      if( rc == SQLITE_OK ) {
+        switch( aPlanOperator[i].eType ) {
+          case CYPHER_EXPR_COMPARISON:
+            rc = cypherExpressionCreateComparison(ppExpr, apArg[0], apArg[1],
+                                                  aPlanOperator[i].op);
+            break;
+          case CYPHER_EXPR_LOGICAL:
+            rc = cypherExpressionCreateLogical(ppExpr, apArg[0], apArg[1],
+                                               aPlanOperator[i].op);
+            break;
+          default:
+            rc = cypherExpressionCreateArithmetic(ppExpr, apArg[0], apArg[1],
+                                                  aPlanOperator[i].op);
+            break;
+        }
+      }
+      if( rc != SQLITE_OK ) {
+        cypherExpressionDestroy(apArg[0]);
+        cypherExpressionDestroy(apArg[1]);
+      }
+      return rc;
+      
+    case CYPHER_AST_NOT:
+    case CYPHER_AST_UNARY_OP:
+      if( pAst->nChildren != 1 ) break;
+      if( pAst->type == CYPHER_AST_UNARY_OP && (!zOp || strcmp(zOp, "+") == 0) ) {
+        return planCompileExpr(pAst->apChildren[0], pContext, ppExpr);
+      }
+      if( pAst->type == CYPHER_AST_UNARY_OP && strcmp(zOp, "-") != 0 ) break;
+      rc = planCompileExpr(pAst->apChildren[0], pContext, &apArg[1]);
+      if( rc != SQLITE_OK ) return rc;
+      if( pAst->type == CYPHER_AST_NOT ) {
+        rc = cypherExpressionCreateLogical(ppExpr, NULL, apArg[1], CYPHER_LOGIC_NOT);
+      } else {
+        /* -x is 0 - x */
+        cypherValueInit(&value);
+        cypherValueSetInteger(&value, 0);
+        rc = cypherExpressionCreateLiteral(&apArg[0], &value);
+        if( rc == SQLITE_OK ) {
+          rc = cypherExpressionCreateArithmetic(ppExpr, apArg[0], apArg[1], CYPHER_OP_SUBTRACT);
+        }
+      }
+      if( rc != SQLITE_OK ) {
+        cypherExpressionDestroy(apArg[0]);
+        cypherExpressionDestroy(apArg[1]);
+      }
+      return rc;
+      
+    case CYPHER_AST_FUNCTION_CALL:
+    case CYPHER_AST_ARRAY:
+    case CYPHER_AST_LIST:
+      /* The parser puts the function name in a first IDENTIFIER child */
+      i = 0;
+      if( pAst->type == CYPHER_AST_FUNCTION_CALL ) {
+        if( !zOp && pAst->nChildren > 0 &&
+            cypherAstIsType(pAst->apChildren[0], CYPHER_AST_IDENTIFIER) ) {
+          zOp = cypherAstGetValue(pAst->apChildren[0]);
+          i = 1;
+        }
+        /* Aggregates are computed by the aggregation operator only */
+        if( !zOp || (pAst->iFlags & CYPHER_AST_FLAG_DISTINCT) ||
+            aggregateCall(pAst, &pArg) || !cypherGetBuiltinFunction(zOp) ) {
+          break;
+        }
+      }
+      if( pAst->nChildren > i ) {
+        apList = sqlite3_malloc((pAst->nChildren - i) * sizeof(CypherExpression*));
+        if( !apList ) return SQLITE_NOMEM;
+      }
+      for( ; rc == SQLITE_OK && i < pAst->nChildren; i++ ) {
+        rc = planCompileExpr(pAst->apChildren[i], pContext, &apList[nArg]);
+        if( rc == SQLITE_OK ) nArg++;
+      }
+      if( rc == SQLITE_OK ) {
+        if( pAst->type == CYPHER_AST_FUNCTION_CALL ) {
+          rc = cypherExpressionCreateFunction(ppExpr, zOp, apList, nArg);
+        } else {
+          rc = cypherExpressionCreateList(ppExpr, apList, nArg);
+        }
+      }
+      if( rc != SQLITE_OK ) {
+        for( i = 0; i < nArg; i++ ) cypherExpressionDestroy(apList[i]);
+      }
+      sqlite3_free(apList);
+      return rc;
+      
+    default:
+      break;
+  }
+  
+  if( !pContext->zErrorMsg ) {
+    pContext->zErrorMsg = sqlite3_mprintf("Unsupported expression%s%s",
+                                          zOp ? ": " : "", zOp ? zOp : "");
+  }
+  pContext->nErrors++;
+  return SQLITE_ERROR;
+}
+
+/*
+** Compile a WHERE expression into filters over pInput. A conjunction
+** becomes a chain of filters, one per operand, each filtering the output
+** of the one below, so that the optimizer can push each into the scan or
+** answer it from an index separately. Every filter evaluates its own
+** expression; a comparison of a property or of id(n) with a literal also
+** describes itself as a property filter for the optimizer. On error
+** pInput is freed and NULL returned.
+*/
+static LogicalPlanNode *compileWhereExpr(CypherAst *pExpr, PlanContext *pContext,
+                                         LogicalPlanNode *pInput) {
+  LogicalPlanNode *pLogical = NULL;
+  
+  if( cypherAstIsType(pExpr, CYPHER_AST_AND) && pExpr->nChildren == 2 ) {
+    pInput = compileWhereExpr(pExpr->apChildren[0], pContext, pInput);
+    if( !pInput ) return NULL;
+    return compileWhereExpr(pExpr->apChildren[1], pContext, pInput);
+  }
+  
+  if( (cypherAstIsType(pExpr, CYPHER_AST_BINARY_OP) || 
+       cypherAstIsType(pExpr, CYPHER_AST_COMPARISON)) &&
+      (isIndexableOperator(cypherAstGetValue(pExpr)) ||
+       isTextOperator(cypherAstGetValue(pExpr)) ||
+       sqlite3_stricmp(cypherAstGetValue(pExpr), "<>") == 0) &&
+      pExpr->nChildren == 2 &&
+      cypherAstIsType(pExpr->apChildren[1], CYPHER_AST_LITERAL) ) {
+    
+    /* Property filter: n.prop <op> value */
+    CypherAst *pProp = pExpr->apChildren[0];
+    const char *zValue = cypherAstGetValue(pExpr->apChildren[1]);
+    if( cypherAstIsType(pProp, CYPHER_AST_PROPERTY) && pProp->nChildren >= 2 &&
+        cypherAstIsType(pProp->apChildren[0], CYPHER_AST_IDENTIFIER) && zValue ) {
+      pLogical = logicalPlanNodeCreate(LOGICAL_PROPERTY_FILTER);
+      if( pLogical ) {
+        logicalPlanNodeSetAlias(pLogical, cypherAstGetValue(pProp->apChildren[0]));
+        logicalPlanNodeSetProperty(pLogical, cypherAstGetValue(pProp->apChildren[1]));
+        logicalPlanNodeSetValue(pLogical, zValue);
+        logicalPlanNodeSetOperator(pLogical, cypherAstGetValue(pExpr));
+      }
+    } else if( cypherAstIsType(pProp, CYPHER_AST_FUNCTION_CALL) &&
+               pProp->nChildren == 2 && zValue &&
+               isIndexableOperator(cypherAstGetValue(pExpr)) &&
+               cypherAstGetValue(pProp->apChildren[0]) &&
+               sqlite3_stricmp(cypherAstGetValue(pProp->apChildren[0]), "id") == 0 &&
+               cypherAstIsType(pProp->apChildren[1], CYPHER_AST_IDENTIFIER) ) {
+      /* Id filter: id(n) <op> value, a property filter without property */
+      pLogical = logicalPlanNodeCreate(LOGICAL_PROPERTY_FILTER);
+      if( pLogical ) {
+        logicalPlanNodeSetAlias(pLogical, cypherAstGetValue(pProp->apChildren[1]));
+        logicalPlanNodeSetValue(pLogical, zValue);
+        logicalPlanNodeSetOperator(pLogical, cypherAstGetValue(pExpr));
+      }
+    }
+  }
+  
+  if( !pLogical ) {
+    /* Generic filter */
+    pLogical = logicalPlanNodeCreate(LOGICAL_FILTER);
+  }
+  if( pLogical ) {
+    pLogical->apExpr = sqlite3_malloc(sizeof(CypherExpression*));
+    if( pLogical->apExpr ) {
+      pLogical->nExpr = 1;
+      if( planCompileExpr(pExpr, pContext, &pLogical->apExpr[0]) != SQLITE_OK ||
+          logicalPlanNodeAddChild(pLogical, pInput) != SQLITE_OK ) {
+        logicalPlanNodeDestroy(pLogical);
+        pLogical = NULL;
+      }
+    } else {
+      logicalPlanNodeDestroy(pLogical);
+      pLogical = NULL;
+    }
+  }
+  if( !pLogical ) logicalPlanNodeDestroy(pInput);
+  return pLogical;
+}
+
+/*
+** Name of a RETURN item's expression as a column: var, var.prop or
+** fn([DISTINCT ]arg), or NULL for any other expression. Caller must
+** sqlite3_free() the result.
+*/
+static char *planExprName(CypherAst *pExpr) {
+  CypherAst *pArg = pExpr;
+  const char *zFunc = NULL;
+  int bDistinct = 0;
+  char *zArg;
+  
+  if( cypherAstIsType(pExpr, CYPHER_AST_FUNCTION_CALL) ) {
+    int iArg = 0;
+    zFunc = cypherAstGetValue(pExpr);
+    if( !zFunc && pExpr->nChildren > 0 &&
+        cypherAstIsType(pExpr->apChildren[0], CYPHER_AST_IDENTIFIER) ) {
+      zFunc = cypherAstGetValue(pExpr->apChildren[0]);
+      iArg = 1;
+    }
+    if( !zFunc ) return NULL;
+    pArg = iArg < pExpr->nChildren ? pExpr->apChildren[iArg] : NULL;
+    bDistinct = (pExpr->iFlags & CYPHER_AST_FLAG_DISTINCT) != 0;
+  }
+  
+  if( cypherAstIsType(pArg, CYPHER_AST_IDENTIFIER) ) {
+    zArg = sqlite3_mprintf("%s", cypherAstGetValue(pArg));
+  } else if( cypherAstIsType(pArg, CYPHER_AST_PROPERTY) && pArg->nChildren >= 2 ) {
+    zArg = sqlite3_mprintf("%s.%s", cypherAstGetValue(pArg->apChildren[0]),
+                           cypherAstGetValue(pArg->apChildren[1]));
+  } else if( zFunc && !pArg ) {
+    zArg = sqlite3_mprintf("*");
+  } else {
+    return NULL;
+  }
+  if( !zArg || !zFunc ) return zArg;
+  return sqlite3_mprintf("%s(%s%z)", zFunc, bDistinct ? "DISTINCT " : "", zArg);
+}
+
+/*
+** Name of the output column of the iItem'th RETURN item pItem: its alias,
+** else planExprName() of its expression, else column1, column2, ...
+** The cypher() table names its columns the same way. Caller must
+** sqlite3_free() the result.
+*/
+static char *planItemName(CypherAst *pItem, int iItem) {
+  char *zName;
+  
+  if( pItem->nChildren > 1 && cypherAstIsType(pItem->apChildren[1], CYPHER_AST_IDENTIFIER) ) {
+    return sqlite3_mprintf("%s", cypherAstGetValue(pItem->apChildren[1]));
+  }
+  zName = planExprName(pItem->nChildren > 0 ? pItem->apChildren[0] : NULL);
+  return zName ? zName : sqlite3_mprintf("column%d", iItem + 1);
+}
+
+/*
+** Add the ORDER BY key pExpr to the sort pSort. Over the columns of an
+** aggregation, DISTINCT or projection (bColumns) the key must be one of the RETURN
+** items of pList, named by its alias or written as in the item, and reads
+** that column. Otherwise the sort sits below the projection: the key is
+** a variable or a property of one, or the alias of an item that is.
+*/
+static int planAddSortKey(LogicalPlanNode *pSort, CypherAst *pExpr, CypherAst *pList,
+                          int bColumns, int bDesc, PlanContext *pContext) {
+  const char *zIdent = cypherAstIsType(pExpr, CYPHER_AST_IDENTIFIER) ?
+                       cypherAstGetValue(pExpr) : NULL;
+  const char *zVar = NULL, *zProp = NULL;
+  char *zKey = planExprName(pExpr);
+  char *zName = NULL;
+  int rc = SQLITE_OK;
+  int i;
+  
+  for( i = 0; i < pList->nChildren; i++ ) {
+    CypherAst *pItem = pList->apChildren[i];
+    CypherAst *pAlias = pItem->nChildren > 1 ? pItem->apChildren[1] : NULL;
+    char *zItem;
+    int bMatch;
+    
+    if( zIdent && cypherAstIsType(pAlias, CYPHER_AST_IDENTIFIER) &&
+        strcmp(zIdent, cypherAstGetValue(pAlias)) == 0 ) {
+      bMatch = 1;
+    } else {
+      zItem = bColumns && zKey ? planExprName(pItem->apChildren[0]) : NULL;
+      bMatch = zItem && strcmp(zItem, zKey) == 0;
+      sqlite3_free(zItem);
+    }
+    if( bMatch ) {
+      if( bColumns ) {
+        zName = planItemName(pItem, i);
+        if( !zName ) rc = SQLITE_NOMEM;
+      } else {
+        pExpr = pItem->apChildren[0];
+      }
+      break;
+    }
+  }
+  sqlite3_free(zKey);
+  if( rc != SQLITE_OK ) return rc;
+  
+  if( bColumns ) {
+    zVar = zName;
+  } else if( cypherAstIsType(pExpr, CYPHER_AST_PROPERTY) && pExpr->nChildren >= 2 &&
+             cypherAstIsType(pExpr->apChildren[0], CYPHER_AST_IDENTIFIER) ) {
+    zVar = cypherAstGetValue(pExpr->apChildren[0]);
+    zProp = cypherAstGetValue(pExpr->apChildren[1]);
+  } else if( cypherAstIsType(pExpr, CYPHER_AST_IDENTIFIER) ) {
+    zVar = cypherAstGetValue(pExpr);
+  }
+  if( !zVar ) {
+    pContext->zErrorMsg = sqlite3_mprintf(bColumns ?
+        "ORDER BY over returned columns must use one of them" :
+        "Unsupported ORDER BY expression");
+    pContext->nErrors++;
+    return SQLITE_ERROR;
+  }
+  
+  if( !zName ) {
+    zName = sqlite3_mprintf("%s%s%s", zVar, zProp ? "." : "", zProp ? zProp : "");
+  }
+  rc = zName ? logicalPlanNodeAddColumn(pSort, NULL, zVar, zProp, zName, 0) : SQLITE_NOMEM;
+  sqlite3_free(zName);
+  if( rc == SQLITE_OK && bDesc ) pSort->aColumn[pSort->nColumn - 1].bDesc = 1;
+  return rc;
+}
+
+/*
+** Sort pInput by the ORDER BY of a RETURN clause, if it has one, in a
+** single sort holding every key. Below a projection the alias, property
+** and direction of the sort are also those of the first key, which an
+** ordered index scan can provide. On error pInput is freed and NULL
+** returned.
+*/
+static LogicalPlanNode *compileReturnSort(CypherAst *pReturn, LogicalPlanNode *pInput,
+                                          int bColumns, PlanContext *pContext) {
+  LogicalPlanNode *pSort;
+  int rc = SQLITE_OK;
+  int i, j;
+  
+  for( i = 1; i < pReturn->nChildren; i++ ) {
+    CypherAst *pClause = pReturn->apChildren[i];
+    if( !cypherAstIsType(pClause, CYPHER_AST_ORDER_BY) ) continue;
+    
+    pSort = logicalPlanNodeCreate(LOGICAL_SORT);
+    if( !pSort ) rc = SQLITE_NOMEM;
+    for( j = 0; rc == SQLITE_OK && j < pClause->nChildren; j++ ) {
+      CypherAst *pItem = pClause->apChildren[j];
+      const char *zDir = cypherAstGetValue(pItem);
+      rc = planAddSortKey(pSort, pItem->nChildren > 0 ? pItem->apChildren[0] : NULL,
+                          pReturn->apChildren[0], bColumns,
+                          zDir && sqlite3_stricmp(zDir, "DESC") == 0, pContext);
+    }
+    if( rc == SQLITE_OK && pSort->nColumn > 0 && !bColumns ) {
+      logicalPlanNodeSetAlias(pSort, pSort->aColumn[0].zVariable);
+      if( pSort->aColumn[0].zProperty ) {
+        logicalPlanNodeSetProperty(pSort, pSort->aColumn[0].zProperty);
+      }
+      if( pSort->aColumn[0].bDesc ) pSort->iFlags |= PLAN_FLAG_DESC;
+    }
+    if( rc == SQLITE_OK ) rc = logicalPlanNodeAddChild(pSort, pInput);
+    if( rc != SQLITE_OK ) {
+      logicalPlanNodeDestroy(pSort);
+      logicalPlanNodeDestroy(pInput);
+      return NULL;
+    }
+    pInput = pSort;
+  }
+  return pInput;
+}
+
+/*
+** Apply the SKIP and LIMIT of a RETURN clause to pInput, the plan of the
+** whole query.
+*/
+static LogicalPlanNode *compileReturnModifiers(CypherAst *pReturn, 
+                                               LogicalPlanNode *pInput) {
+  LogicalPlanNode *pPlan = pInput;
+  LogicalPlanNode *pNode;
+  int i;
+  
+  for( i = 1; i < pReturn->nChildren; i++ ) {
+    CypherAst *pClause = pReturn->apChildren[i];
+    
+    if( (cypherAstIsType(pClause, CYPHER_AST_SKIP) ||
+         cypherAstIsType(pClause, CYPHER_AST_LIMIT)) && pClause->nChildren > 0 ) {
+      pNode = logicalPlanNodeCreate(cypherAstIsType(pClause, CYPHER_AST_SKIP) ?
+                                    LOGICAL_SKIP : LOGICAL_LIMIT);
+      if( !pNode ) return pPlan;
+      logicalPlanNodeSetValue(pNode, cypherAstGetValue(pClause->apChildren[0]));
+      if( logicalPlanNodeAddChild(pNode, pPlan) != SQLITE_OK ) {
+        logicalPlanNodeDestroy(pNode);
+        return pPlan;
+      }
+      pPlan = pNode;
+    }
+  }
+  return pPlan;
+}
+
+/*
+** Compile the items of a RETURN clause into a projection of pInput, which
+** evaluates one expression per item into a column named by planItemName().
+** On error pInput is freed and NULL returned.
+*/
+static LogicalPlanNode *compileProjection(CypherAst *pList, LogicalPlanNode *pInput,
+                                          PlanContext *pContext) {
+  LogicalPlanNode *pProjection;
+  int rc = SQLITE_OK;
+  int i;
+  
+  pProjection = logicalPlanNodeCreate(LOGICAL_PROJECTION);
+  if( pProjection ) {
+    pProjection->apExpr = sqlite3_malloc(pList->nChildren * sizeof(CypherExpression*));
+  }
+  if( !pProjection || !pProjection->apExpr ) rc = SQLITE_NOMEM;
+  
+  for( i = 0; rc == SQLITE_OK && i < pList->nChildren; i++ ) {
+    CypherAst *pItem = pList->apChildren[i];
+    char *zName;
+    
+    rc = planCompileExpr(pItem->nChildren > 0 ? pItem->apChildren[0] : NULL, pContext,
+                         &pProjection->apExpr[i]);
+    if( rc != SQLITE_OK ) break;
+    pProjection->nExpr++;
+    zName = planItemName(pItem, i);
+    rc = zName ? logicalPlanNodeAddColumn(pProjection, NULL, NULL, NULL, zName, 0)
+               : SQLITE_NOMEM;
+    sqlite3_free(zName);
+  }
+  if( rc == SQLITE_OK ) rc = logicalPlanNodeAddChild(pProjection, pInput);
+  if( rc != SQLITE_OK ) {
+    logicalPlanNodeDestroy(pProjection);
+    logicalPlanNodeDestroy(pInput);
+    return NULL;
+  }
+  return pProjection;
+}
+
+/*
+** Return true if pPlan produces rows with zVar bound: a scan or pattern
+** step below it names zVar as its node, relationship or path variable.
+*/
+static int planBindsVariable(LogicalPlanNode *pPlan, const char *zVar) {
+  int i;
+  
+  if( !pPlan || !zVar ) return 0;
+  switch( pPlan->type ) {
+    case LOGICAL_NODE_SCAN:
+    case LOGICAL_LABEL_SCAN:
+    case LOGICAL_INDEX_SCAN:
+    case LOGICAL_RELATIONSHIP_SCAN:
+    case LOGICAL_TYPE_SCAN:
+    case LOGICAL_BITMAP_SCAN:
+    case LOGICAL_RANGE_SCAN:
+    case LOGICAL_FULLTEXT_SCAN:
+    case LOGICAL_EXPAND:
+    case LOGICAL_VAR_LENGTH_EXPAND:
+    case LOGICAL_OPTIONAL_EXPAND:
+    case LOGICAL_SHORTEST_PATH:
+      if( (pPlan->zAlias && strcmp(pPlan->zAlias, zVar) == 0) ||
+          (pPlan->zRelAlias && strcmp(pPlan->zRelAlias, zVar) == 0) ||
+          (pPlan->zPathAlias && strcmp(pPlan->zPathAlias, zVar) == 0) ) {
+        return 1;
+      }
+      break;
+    default:
+      break;
+  }
+  for( i = 0; i < pPlan->nChildren; i++ ) {
+    if( planBindsVariable(pPlan->apChildren[i], zVar) ) return 1;
+  }
+  return 0;
+}
+
+/*
+** Append zVar to the comma-separated list *pzList unless it is there.
+*/
+static void planListAdd(char **pzList, const char *zVar) {
+  const char *z = *pzList;
+  int n = (int)strlen(zVar);
+  
+  while( z ) {
+    if( strncmp(z, zVar, n) == 0 && (z[n] == ',' || z[n] == 0) ) return;
+    z = strchr(z, ',');
+    if( z ) z++;
+  }
+  if( *pzList ) {
+    *pzList = sqlite3_mprintf("%z,%s", *pzList, zVar);
+  } else {
+    *pzList = sqlite3_mprintf("%s", zVar);
+  }
+}
+
+/*
+** Append zVar to the join keys of pJoin if pOther binds it too. Names the
+** planner made up for anonymous nodes never join.
+*/
+static void planAddJoinKey(LogicalPlanNode *pJoin, LogicalPlanNode *pOther,
+                           const char *zVar) {
+  if( !zVar || strncmp(zVar, "anon_", 5) == 0 ) return;
+  if( !planBindsVariable(pOther, zVar) ) return;
+  planListAdd(&pJoin->zJoinKeys, zVar);
+}
+
+/*
+** Collect into *pzList the relationship variables pPlan binds.
+*/
+static void planCollectRels(LogicalPlanNode *pPlan, char **pzList) {
+  int i;
+  
+  if( !pPlan ) return;
+  if( pPlan->zRelAlias ) planListAdd(pzList, pPlan->zRelAlias);
+  for( i = 0; i < pPlan->nChildren; i++ ) {
+    planCollectRels(pPlan->apChildren[i], pzList);
+  }
+}
+
+/*
+** Collect into pJoin->zJoinKeys the variables bound both by pPlan and by
+** pOther, the other input of the join.
+*/
+static void planCollectJoinKeys(LogicalPlanNode *pJoin, LogicalPlanNode *pPlan,
+                                LogicalPlanNode *pOther) {
+  int i;
+  
+  if( !pPlan ) return;
+  if( pPlan->type != LOGICAL_HASH_JOIN && pPlan->type != LOGICAL_CARTESIAN_PRODUCT &&
+      pPlan->type != LOGICAL_PROJECTION &&
+      pPlan->type != LOGICAL_SORT && pPlan->type != LOGICAL_LIMIT &&
+      pPlan->type != LOGICAL_SKIP && pPlan->type != LOGICAL_FILTER && pPlan->type != LOGICAL_PROPERTY_FILTER &&
+      pPlan->type != LOGICAL_LABEL_FILTER ) {
+    planAddJoinKey(pJoin, pOther, pPlan->zAlias);
+    planAddJoinKey(pJoin, pOther, pPlan->zRelAlias);
+    planAddJoinKey(pJoin, pOther, pPlan->zPathAlias);
+  }
+  for( i = 0; i < pPlan->nChildren; i++ ) {
+    planCollectJoinKeys(pJoin, pPlan->apChildren[i], pOther);
+  }
+}
+
+/*
+** Join pLeft and pRight, the plans of two patterns, on the variables both
+** bind with a hash join. Patterns that share no variable form a cartesian
+** product instead. On failure both are freed and NULL returned.
+*/
+static LogicalPlanNode *planJoin(LogicalPlanNode *pLeft, LogicalPlanNode *pRight) {
+  LogicalPlanNode *pJoin = logicalPlanNodeCreate(LOGICAL_HASH_JOIN);
+  
+  if( !pJoin || logicalPlanNodeAddChild(pJoin, pLeft) != SQLITE_OK ) {
+    logicalPlanNodeDestroy(pJoin);
+    logicalPlanNodeDestroy(pLeft);
+    logicalPlanNodeDestroy(pRight);
+    return NULL;
+  }
+  if( logicalPlanNodeAddChild(pJoin, pRight) != SQLITE_OK ) {
+    logicalPlanNodeDestroy(pJoin);
+    logicalPlanNodeDestroy(pRight);
+    return NULL;
+  }
+  planCollectJoinKeys(pJoin, pLeft, pRight);
+  if( !pJoin->zJoinKeys ) pJoin->type = LOGICAL_CARTESIAN_PRODUCT;
+  return pJoin;
+}
+
+/*
+** Name of the first label or relationship type in a LABELS node. The
+** parser stores it as the node value, hand-built ASTs as a child.
+*/
+static const char *patternLabel(CypherAst *pLabels) {
+  if( !cypherAstIsType(pLabels, CYPHER_AST_LABELS) ) return NULL;
+  if( pLabels->nChildren > 0 ) return cypherAstGetValue(pLabels->apChildren[0]);
+  return cypherAstGetValue(pLabels);
+}
+
+/*
+** Filter pInput by the property map of node pattern pNode, if it has one:
+** (n {name: 'Alice'}) becomes a property filter n.name = 'Alice' on the
+** variable zAlias the pattern binds. On error pInput is freed and NULL
+** returned.
+*/
+static LogicalPlanNode *compilePatternProperties(CypherAst *pNode, const char *zAlias,
+                                                 LogicalPlanNode *pInput,
+                                                 PlanContext *pContext) {
+  CypherAst *pMap = NULL;
+  int i;
+  
+  for( i = 0; i < pNode->nChildren; i++ ) {
+    if( cypherAstIsType(pNode->apChildren[i], CYPHER_AST_MAP) ) pMap = pNode->apChildren[i];
+  }
+  for( i = 0; pInput && pMap && i < pMap->nChildren; i++ ) {
+    CypherAst *pPair = pMap->apChildren[i];
+    CypherAst *pValue = pPair->nChildren > 0 ? pPair->apChildren[0] : NULL;
+    const char *zKey = cypherAstGetValue(pPair);
+    CypherExpression *pVar = NULL, *pProp = NULL, *pRight = NULL;
+    LogicalPlanNode *pFilter;
+    int rc;
+    
+    if( !zKey || !pValue ) continue;
+    pFilter = logicalPlanNodeCreate(cypherAstIsType(pValue, CYPHER_AST_LITERAL) ?
+                                    LOGICAL_PROPERTY_FILTER : LOGICAL_FILTER);
+    if( !pFilter ) {
+      logicalPlanNodeDestroy(pInput);
+      return NULL;
+    }
+    logicalPlanNodeSetAlias(pFilter, zAlias);
+    if( pFilter->type == LOGICAL_PROPERTY_FILTER ) {
+      logicalPlanNodeSetProperty(pFilter, zKey);
+      logicalPlanNodeSetValue(pFilter, cypherAstGetValue(pValue));
+      logicalPlanNodeSetOperator(pFilter, "=");
+    }
+    pFilter->apExpr = sqlite3_malloc(sizeof(CypherExpression*));
+    rc = pFilter->apExpr ? cypherExpressionCreateVariable(&pVar, zAlias) : SQLITE_NOMEM;
+    if( rc == SQLITE_OK ) {
+      rc = cypherExpressionCreateProperty(&pProp, pVar, zKey);
+      if( rc != SQLITE_OK ) cypherExpressionDestroy(pVar);
+    }
+    if( rc == SQLITE_OK ) rc = planCompileExpr(pValue, pContext, &pRight);
+    if( rc == SQLITE_OK ) {
+      rc = cypherExpressionCreateComparison(&pFilter->apExpr[0], pProp, pRight,
+                                            CYPHER_CMP_EQUAL);
+    }
+    if( rc == SQLITE_OK ) {
+      pFilter->nExpr = 1;
+      rc = logicalPlanNodeAddChild(pFilter, pInput);
+    } else {
+      cypherExpressionDestroy(pProp);
+      cypherExpressionDestroy(pRight);
+    }
+    if( rc != SQLITE_OK ) {
+      logicalPlanNodeDestroy(pFilter);
+      logicalPlanNodeDestroy(pInput);
+      return NULL;
+    }
+    pInput = pFilter;
+  }
+  return pInput;
+}
+
+/*
+** Compile one relationship step (zFrom)-[pRel]-(pNode) of a pattern into an
+** expand of pInput, the plan that binds zFrom. The step binds the
+** relationship variable and the far node; if the far node is already bound
+** the step only checks that an edge connects the two (ExpandInto). A
+** relationship with bounds (-[*1..3]->) becomes a variable-length expand.
+*/
+static LogicalPlanNode *compileExpand(CypherAst *pRel, CypherAst *pNode,
+                                      const char *zFrom, LogicalPlanNode *pInput,
+                                      PlanContext *pContext) {
+  LogicalPlanNode *pExpand;
+  const char *zArrow = cypherAstGetValue(pRel);
+  const char *zAlias = NULL;
+  int i;
+  
+  pExpand = logicalPlanNodeCreate(LOGICAL_EXPAND);
+  if( !pExpand ) return NULL;
+  pExpand->zFromAlias = sqlite3_mprintf("%s", zFrom);
+  if( zArrow && strcmp(zArrow, "<-") == 0 ) {
+    pExpand->iFlags |= PLAN_FLAG_INCOMING;
+  } else if( !zArrow || strcmp(zArrow, "->") != 0 ) {
+    pExpand->iFlags |= PLAN_FLAG_UNDIRECTED;
+  }
+  for( i = 0; i < pRel->nChildren; i++ ) {
+    CypherAst *pChild = pRel->apChildren[i];
+    const char *zBounds = cypherAstGetValue(pChild);
+    if( cypherAstIsType(pChild, CYPHER_AST_IDENTIFIER) ) {
+      pExpand->zRelAlias = sqlite3_mprintf("%s", cypherAstGetValue(pChild));
+    } else if( patternLabel(pChild) ) {
+      pExpand->zRelType = sqlite3_mprintf("%s", patternLabel(pChild));
+    } else if( cypherAstIsType(pChild, CYPHER_AST_LITERAL) && zBounds && zBounds[0] == '*' ) {
+      /* -[*min..max]-> */
+      PathBounds bounds = cypherParsePathBounds(zBounds);
+      pExpand->type = LOGICAL_VAR_LENGTH_EXPAND;
+      pExpand->nMinHops = bounds.minLength;
+      pExpand->nMaxHops = bounds.maxLength;
+    }
+  }
+  for( i = 0; i < pNode->nChildren; i++ ) {
+    CypherAst *pChild = pNode->apChildren[i];
+    if( cypherAstIsType(pChild, CYPHER_AST_IDENTIFIER) ) {
+      zAlias = cypherAstGetValue(pChild);
+    } else if( patternLabel(pChild) ) {
+      logicalPlanNodeSetLabel(pExpand, patternLabel(pChild));
+    }
+  }
+  
+  /* An anonymous node in the middle of a chain still needs a name for the
+  ** next step to start from */
+  if( zAlias ) {
+    logicalPlanNodeSetAlias(pExpand, zAlias);
+  } else {
+    pExpand->zAlias = sqlite3_mprintf("anon_%d", pContext->nVariables);
+  }
+  if( !pExpand->zFromAlias || !pExpand->zAlias ||
+      logicalPlanNodeAddChild(pExpand, pInput) != SQLITE_OK ) {
+    logicalPlanNodeDestroy(pExpand);
+    return NULL;
+  }
+  if( zAlias && planBindsVariable(pInput, zAlias) ) {
+    pExpand->iFlags |= PLAN_FLAG_EXPAND_INTO;
+  } else {
+    planContextAddVariable(pContext, pExpand->zAlias, pExpand);
+  }
+  return pExpand;
+}
+
+/*
+** Compile a pattern. A single node pattern becomes a scan; a chain
+** (a)-[r]->(b)-[s]->(c) becomes a scan of a with one expand per step. A
+** list of patterns, as in MATCH (a)-->(b), (b)-->(c), becomes a hash join
+** of the patterns on the variables they share.
+*/
+static LogicalPlanNode *compilePattern(CypherAst *pPattern, PlanContext *pContext) {
+  LogicalPlanNode *pLogical;
+  int i;
+  
+  if( pPattern->nChildren == 0 ) return NULL;
+  pLogical = compileAstNode(pPattern->apChildren[0], pContext);
+  
+  if( cypherAstIsType(pPattern->apChildren[0], CYPHER_AST_PATTERN) ||
+      cypherAstIsType(pPattern->apChildren[0], CYPHER_AST_PATH) ) {
+    for( i = 1; pLogical && i < pPattern->nChildren; i++ ) {
+      LogicalPlanNode *pRight = compileAstNode(pPattern->apChildren[i], pContext);
+      if( !pRight ) {
+        logicalPlanNodeDestroy(pLogical);
+        return NULL;
+      }
+      pLogical = planJoin(pLogical, pRight);
+      
+      /* The patterns of one MATCH never bind two variables to one edge */
+      if( pLogical ) planCollectRels(pLogical, &pLogical->zDistinctRels);
+    }
+    return pLogical;
+  }
+  
+  for( i = 1; pLogical && i + 1 < pPattern->nChildren; i += 2 ) {
+    CypherAst *pRel = pPattern->apChildren[i];
+    CypherAst *pNode = pPattern->apChildren[i + 1];
+    LogicalPlanNode *pExpand;
+    
+    if( !cypherAstIsType(pRel, CYPHER_AST_REL_PATTERN) ||
+        !cypherAstIsType(pNode, CYPHER_AST_NODE_PATTERN) || !pLogical->zAlias ) {
+      pContext->zErrorMsg = sqlite3_mprintf("Unsupported pattern element");
+      pContext->nErrors++;
+      logicalPlanNodeDestroy(pLogical);
+      return NULL;
+    }
+    pExpand = compileExpand(pRel, pNode, pLogical->zAlias, pLogical, pContext);
+    if( !pExpand ) {
+      logicalPlanNodeDestroy(pLogical);
+      return NULL;
+    }
+    pLogical = compilePatternProperties(pNode, pExpand->zAlias, pExpand, pContext);
+  }
+  return pLogical;
+}
+
+/*
+** Compile p = shortestPath((a)-[:T*..n]-(b)) or allShortestPaths(...) in a
+** MATCH. The first child of the operator binds the start node; the end
+** node comes from a second child scanning its pattern, or from the input
+** row when both ends are the same variable.
+*/
+static LogicalPlanNode *compileShortestPath(CypherAst *pCall, const char *zPath,
+                                            PlanContext *pContext) {
+  const char *zName = cypherAstGetValue(pCall);
+  CypherAst *pPattern = pCall->nChildren > 0 ? pCall->apChildren[0] : NULL;
+  LogicalPlanNode *pStart, *pEnd = NULL, *pShortest;
+  const char *zEnd = NULL;
+  int bAll, i;
+  
+  if( zName && sqlite3_stricmp(zName, "allShortestPaths") == 0 ) {
+    bAll = 1;
+  } else if( zName && sqlite3_stricmp(zName, "shortestPath") == 0 ) {
+    bAll = 0;
+  } else {
+    pContext->zErrorMsg = sqlite3_mprintf("Unsupported function in pattern: %s",
+                                          zName ? zName : "");
+    pContext->nErrors++;
+    return NULL;
+  }
+  if( !pPattern || pPattern->nChildren != 3 ||
+      !cypherAstIsType(pPattern->apChildren[1], CYPHER_AST_REL_PATTERN) ||
+      !cypherAstIsType(pPattern->apChildren[2], CYPHER_AST_NODE_PATTERN) ) {
+    pContext->zErrorMsg = sqlite3_mprintf("%s() requires a single relationship pattern", zName);
+    pContext->nErrors++;
+    return NULL;
+  }
+  for( i = 0; i < pPattern->apChildren[2]->nChildren; i++ ) {
+    CypherAst *pChild = pPattern->apChildren[2]->apChildren[i];
+    if( cypherAstIsType(pChild, CYPHER_AST_IDENTIFIER) ) zEnd = cypherAstGetValue(pChild);
+  }
+  
+  pStart = compileAstNode(pPattern->apChildren[0], pContext);
+  if( !pStart || !pStart->zAlias || !zEnd ) {
+    logicalPlanNodeDestroy(pStart);
+    pContext->zErrorMsg = sqlite3_mprintf("%s() requires named start and end nodes", zName);
+    pContext->nErrors++;
+    return NULL;
+  }
+  if( strcmp(zEnd, pStart->zAlias) != 0 ) {
+    pEnd = compileAstNode(pPattern->apChildren[2], pContext);
+    if( !pEnd ) {
+      logicalPlanNodeDestroy(pStart);
+      return NULL;
+    }
+  }
+  
+  /* The relationship step, with the end node now bound */
+  pShortest = compileExpand(pPattern->apChildren[1], pPattern->apChildren[2],
+                            pStart->zAlias, pStart, pContext);
+  if( !pShortest ) {
+    logicalPlanNodeDestroy(pStart);
+    logicalPlanNodeDestroy(pEnd);
+    return NULL;
+  }
+  if( pShortest->type == LOGICAL_EXPAND ) {
+    pShortest->nMinHops = pShortest->nMaxHops = 1;
+  }
+  pShortest->type = LOGICAL_SHORTEST_PATH;
+  pShortest->iFlags &= ~PLAN_FLAG_EXPAND_INTO;
+  if( bAll ) pShortest->iFlags |= PLAN_FLAG_ALL_PATHS;
+  if( pEnd && logicalPlanNodeAddChild(pShortest, pEnd) != SQLITE_OK ) {
+    logicalPlanNodeDestroy(pEnd);
+    logicalPlanNodeDestroy(pShortest);
+    return NULL;
+  }
+  if( zPath ) {
+    pShortest->zPathAlias = sqlite3_mprintf("%s", zPath);
+    planContextAddVariable(pContext, zPath, pShortest);
+  }
+  return pShortest;
+}
+
+/*
+** If pExpr calls an aggregate function return its name and set *ppArg to
+** its argument, NULL for count(*). The parser puts the function name in a
+** first IDENTIFIER child, hand-built ASTs in the node value.
+*/
+static const char *aggregateCall(CypherAst *pExpr, CypherAst **ppArg) {
+  static const char *azAggregate[] = { "count", "sum", "avg", "min", "max" };
+  const char *zName;
+  int iArg = 0, i;
+  
+  if( !cypherAstIsType(pExpr, CYPHER_AST_FUNCTION_CALL) ) return NULL;
+  zName = cypherAstGetValue(pExpr);
+  if( !zName && pExpr->nChildren > 0 &&
+      cypherAstIsType(pExpr->apChildren[0], CYPHER_AST_IDENTIFIER) ) {
+    zName = cypherAstGetValue(pExpr->apChildren[0]);
+    iArg = 1;
+  }
+  for( i = 0; zName && i < (int)(sizeof(azAggregate) / sizeof(azAggregate[0])); i++ ) {
+    if( sqlite3_stricmp(zName, azAggregate[i]) == 0 ) {
+      *ppArg = iArg < pExpr->nChildren ? pExpr->apChildren[iArg] : NULL;
+      return azAggregate[i];
+    }
+  }
+  return NULL;
+}
+
+/*
+** Return true if a RETURN clause computes an aggregate.
+*/
+static int returnHasAggregate(CypherAst *pReturn) {
+  CypherAst *pList, *pArg;
+  int i;
+  
+  if( !cypherAstIsType(pReturn, CYPHER_AST_RETURN) || pReturn->nChildren == 0 ) return 0;
+  pList = pReturn->apChildren[0];
+  for( i = 0; i < pList->nChildren; i++ ) {
+    CypherAst *pItem = pList->apChildren[i];
+    if( pItem->nChildren > 0 && aggregateCall(pItem->apChildren[0], &pArg) ) return 1;
+  }
+  return 0;
+}
+
+/*
+** Compile a RETURN clause into a node of type eType over pInput with one
+** column per item: an aggregation, whose items that are not aggregates are
+** the grouping keys, or a DISTINCT, whose items are all keys. Each item
+** must be a variable or a property of one, or an aggregate of such.
+*/
+static LogicalPlanNode *compileReturnColumns(CypherAst *pReturn, LogicalPlanNode *pInput,
+                                             LogicalPlanNodeType eType,
+                                             PlanContext *pContext) {
+  CypherAst *pList = pReturn->apChildren[0];
+  LogicalPlanNode *pAgg;
+  int rc = SQLITE_OK;
+  int i;
+  
+  pAgg = logicalPlanNodeCreate(eType);
+  if( !pAgg ) return NULL;
+  
+  for( i = 0; rc == SQLITE_OK && i < pList->nChildren; i++ ) {
+    CypherAst *pItem = pList->apChildren[i];
+    CypherAst *pExpr = pItem->nChildren > 0 ? pItem->apChildren[0] : NULL;
+    CypherAst *pArg = NULL;
+    const char *zFunc = aggregateCall(pExpr, &pArg);
+    const char *zVar = NULL, *zProp = NULL;
+    int bDistinct = zFunc && (pExpr->iFlags & CYPHER_AST_FLAG_DISTINCT) != 0;
+    char *zName;
+    
+    if( !zFunc ) pArg = pExpr;
+    if( cypherAstIsType(pArg, CYPHER_AST_IDENTIFIER) ) {
+      zVar = cypherAstGetValue(pArg);
+    } else if( cypherAstIsType(pArg, CYPHER_AST_PROPERTY) && pArg->nChildren >= 2 ) {
+      zVar = cypherAstGetValue(pArg->apChildren[0]);
+      zProp = cypherAstGetValue(pArg->apChildren[1]);
+    } else if( pArg || !zFunc || sqlite3_stricmp(zFunc, "count") != 0 ) {
+      pContext->zErrorMsg = sqlite3_mprintf("Unsupported %s in RETURN",
+                                            zFunc ? "aggregate argument" :
+                                            eType == LOGICAL_AGGREGATION ? "grouping key" :
+                                            "DISTINCT expression");
+      pContext->nErrors++;
+      logicalPlanNodeDestroy(pAgg);
+      return NULL;
+    }
+    
+    /* Column names follow the expression text unless aliased */
+    zName = planItemName(pItem, i);
+    rc = zName ? logicalPlanNodeAddColumn(pAgg, zFunc, zVar, zProp, zName, bDistinct)
+               : SQLITE_NOMEM;
+    sqlite3_free(zName);
+  }
+  if( rc != SQLITE_OK || logicalPlanNodeAddChild(pAgg, pInput) != SQLITE_OK ) {
+    logicalPlanNodeDestroy(pAgg);
+    return NULL;
+  }
+  return pAgg;
+}
+
+/*
+** Return true if a RETURN clause is DISTINCT over plain values, so that
+** repeated input rows cannot change the result.
+*/
+static int returnIsDistinct(CypherAst *pReturn) {
+  CypherAst *pList;
+  int i;
+  
+  if( !cypherAstIsType(pReturn, CYPHER_AST_RETURN) ) return 0;
+  if( !(pReturn->iFlags & CYPHER_AST_FLAG_DISTINCT) || pReturn->nChildren == 0 ) return 0;
+  pList = pReturn->apChildren[0];
+  for( i = 0; i < pList->nChildren; i++ ) {
+    CypherAst *pItem = pList->apChildren[i];
+    if( pItem->nChildren == 0 ||
+        (!cypherAstIsType(pItem->apChildren[0], CYPHER_AST_IDENTIFIER) &&
+         !cypherAstIsType(pItem->apChildren[0], CYPHER_AST_PROPERTY)) ) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/*
+** Under a DISTINCT result a variable-length step with an unnamed
+** relationship only has to reach each end node once, not along every
+** path. The pruning search that does so ignores relationship uniqueness
+** beyond the start node, so it is used only for a step that is alone in
+** its pattern and has a minimum length of 0 or 1.
+*/
+static void markPrunableExpands(LogicalPlanNode *pNode, int bInChain) {
+  int bExpand, i;
+  
+  if( !pNode ) return;
+  bExpand = pNode->type == LOGICAL_EXPAND || pNode->type == LOGICAL_VAR_LENGTH_EXPAND;
+  if( pNode->type == LOGICAL_VAR_LENGTH_EXPAND && !bInChain && !pNode->zRelAlias &&
+      pNode->nMinHops <= 1 && pNode->nChildren > 0 &&
+      pNode->apChildren[0]->type != LOGICAL_EXPAND &&
+      pNode->apChildren[0]->type != LOGICAL_VAR_LENGTH_EXPAND ) {
+    pNode->iFlags |= PLAN_FLAG_PRUNE_PATHS;
+  }
+  for( i = 0; i < pNode->nChildren; i++ ) {
+    markPrunableExpands(pNode->apChildren[i], bExpand);
+  }
+}
+
+/*
+** Return true if an ORDER BY key of the RETURN clause pReturn is the alias
+** of an item that is not a variable or a property, which only the
+** projection computes.
+*/
+static int returnSortsComputedItem(CypherAst *pReturn) {
+  CypherAst *pList = pReturn->apChildren[0];
+  int i, j, k;
+  
+  for( i = 1; i < pReturn->nChildren; i++ ) {
+    CypherAst *pClause = pReturn->apChildren[i];
+    if( !cypherAstIsType(pClause, CYPHER_AST_ORDER_BY) ) continue;
+    for( j = 0; j < pClause->nChildren; j++ ) {
+      CypherAst *pKey = pClause->apChildren[j]->nChildren > 0 ?
+                        pClause->apChildren[j]->apChildren[0] : NULL;
+      if( !cypherAstIsType(pKey, CYPHER_AST_IDENTIFIER) ) continue;
+      for( k = 0; k < pList->nChildren; k++ ) {
+        CypherAst *pItem = pList->apChildren[k];
+        if( pItem->nChildren > 1 &&
+            cypherAstIsType(pItem->apChildren[1], CYPHER_AST_IDENTIFIER) &&
+            strcmp(cypherAstGetValue(pKey), cypherAstGetValue(pItem->apChildren[1])) == 0 &&
+            !cypherAstIsType(pItem->apChildren[0], CYPHER_AST_IDENTIFIER) &&
+            !cypherAstIsType(pItem->apChildren[0], CYPHER_AST_PROPERTY) ) {
+          return 1;
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+/*
+** Compile a RETURN clause over pInput, the rows of the clauses before it.
+** An aggregation, or a DISTINCT over plain values, produces the result
+** columns itself and ORDER BY sorts them. Otherwise ORDER BY sorts the
+** input rows, so that its keys may use any variable, and a projection
+** then evaluates the items; a key naming a computed item sorts the
+** projected rows instead. A DISTINCT over other expressions compares
+** whole projected rows. SKIP and LIMIT come last. On error pInput is
+** freed and NULL returned.
+*/
+static LogicalPlanNode *compileReturn(CypherAst *pReturn, LogicalPlanNode *pInput,
+                                      PlanContext *pContext) {
+  CypherAst *pList = pReturn->nChildren > 0 ? pReturn->apChildren[0] : NULL;
+  LogicalPlanNode *pPlan;
+  int bColumns = 1, bDistinctRows = 0;
+  
+  if( !cypherAstIsType(pList, CYPHER_AST_PROJECTION_LIST) || pList->nChildren == 0 ) {
+    pContext->zErrorMsg = sqlite3_mprintf("RETURN requires at least one item");
+    pContext->nErrors++;
+    logicalPlanNodeDestroy(pInput);
+    return NULL;
+  }
+  
+  if( returnHasAggregate(pReturn) ) {
+    pPlan = compileReturnColumns(pReturn, pInput, LOGICAL_AGGREGATION, pContext);
+  } else if( returnIsDistinct(pReturn) ) {
+    markPrunableExpands(pInput, 0);
+    pPlan = compileReturnColumns(pReturn, pInput, LOGICAL_DISTINCT, pContext);
+  } else {
+    bDistinctRows = (pReturn->iFlags & CYPHER_AST_FLAG_DISTINCT) != 0;
+    if( returnSortsComputedItem(pReturn) ) {
+      pPlan = compileProjection(pList, pInput, pContext);
+      if( !pPlan ) return NULL;
+    } else {
+      pPlan = pInput;
+      bColumns = 0;
+    }
+  }
+  if( !pPlan ) {
+    logicalPlanNodeDestroy(pInput);
+    return NULL;
+  }
+  
+  pPlan = compileReturnSort(pReturn, pPlan, bColumns, pContext);
+  if( pPlan && !bColumns ) {
+    pPlan = compileProjection(pList, pPlan, pContext);
+  }
+  if( pPlan && bDistinctRows ) {
+    /* A DISTINCT without columns compares whole rows */
+    LogicalPlanNode *pDistinct = logicalPlanNodeCreate(LOGICAL_DISTINCT);
+    if( !pDistinct || logicalPlanNodeAddChild(pDistinct, pPlan) != SQLITE_OK ) {
+      logicalPlanNodeDestroy(pDistinct);
+      logicalPlanNodeDestroy(pPlan);
+      return NULL;
+    }
+    pPlan = pDistinct;
+  }
+  return pPlan ? compileReturnModifiers(pReturn, pPlan) : NULL;
+}
+
+/*
+** Compile a single query. Each MATCH clause is joined with the clauses
+** before it on the variables they share, each WHERE filters the rows so
+** far, and the RETURN projects them. A WHERE that can never hold leaves
+** nothing to scan: a LIMIT 0 takes its place, which never opens its
+** input. One that always holds is dropped.
+*/
+static LogicalPlanNode *compileSingleQuery(CypherAst *pAst, PlanContext *pContext) {
+  LogicalPlanNode *pPlan = NULL;
+  LogicalPlanNode *pNode;
+  int i;
+  
+  for( i = 0; i < pAst->nChildren; i++ ) {
+    CypherAst *pClause = pAst->apChildren[i];
+    
+    if( cypherAstIsType(pClause, CYPHER_AST_MATCH) ) {
+      pNode = compileAstNode(pClause, pContext);
+      if( !pNode ) break;
+      pPlan = pPlan ? planJoin(pPlan, pNode) : pNode;
+      if( !pPlan ) return NULL;
+      continue;
     }
-    sqlite3_free(pPlanner->pContext->azPropertyIndexes);
+    if( !pPlan ) break;
     
-    sqlite3_free(pPlanner->pContext->zErrorMsg);
-    sqlite3_free(pPlanner->pContext);
+    if( cypherAstIsType(pClause, CYPHER_AST_WHERE) && pClause->nChildren > 0 ) {
+      pClause->apChildren[0] = simplifyWhereExpr(pClause->apChildren[0]);
+      if( whereIsAlwaysFalse(pClause->apChildren[0]) ) {
+        pNode = logicalPlanNodeCreate(LOGICAL_LIMIT);
+        if( !pNode || logicalPlanNodeSetValue(pNode, "0") != SQLITE_OK ||
+            logicalPlanNodeAddChild(pNode, pPlan) != SQLITE_OK ) {
+          logicalPlanNodeDestroy(pNode);
+          break;
+        }
+        pPlan = pNode;
+      } else if( !cypherAstIsType(pClause->apChildren[0], CYPHER_AST_LITERAL) ) {
+        pPlan = compileWhereExpr(pClause->apChildren[0], pContext, pPlan);
+        if( !pPlan ) return NULL;
+      }
+    } else if( cypherAstIsType(pClause, CYPHER_AST_RETURN) && i == pAst->nChildren - 1 ) {
+      return compileReturn(pClause, pPlan, pContext);
+    } else {
+      break;
+    }
   }
   
-  /* Free plans */
-  logicalPlanNodeDestroy(pPlanner->pLogicalPlan);
-  physicalPlanNodeDestroy(pPlanner->pPhysicalPlan);
+  if( i < pAst->nChildren ) {
+    if( !pContext->zErrorMsg ) {
+      pContext->zErrorMsg = sqlite3_mprintf(pPlan ? "Unsupported clause" :
+                                            "A query must start with MATCH");
+    }
+    pContext->nErrors++;
+    logicalPlanNodeDestroy(pPlan);
+    return NULL;
+  }
+  return pPlan;
+}
+
+/*
+** Return true if the single queries pA and pB return the same columns,
+** named as planItemName() names them, in the same order.
+*/
+static int planSameColumns(CypherAst *pA, CypherAst *pB) {
+  CypherAst *pListA, *pListB;
+  int bSame = 1;
+  int i;
   
-  sqlite3_free(pPlanner->zErrorMsg);
-  sqlite3_free(pPlanner);
+  if( !pA || !pB || pA->nChildren == 0 || pB->nChildren == 0 ) return 0;
+  pA = pA->apChildren[pA->nChildren - 1];
+  pB = pB->apChildren[pB->nChildren - 1];
+  if( !cypherAstIsType(pA, CYPHER_AST_RETURN) || pA->nChildren == 0 ||
+      !cypherAstIsType(pB, CYPHER_AST_RETURN) || pB->nChildren == 0 ) {
+    return 0;
+  }
+  pListA = pA->apChildren[0];
+  pListB = pB->apChildren[0];
+  if( pListA->nChildren != pListB->nChildren ) return 0;
+  for( i = 0; bSame && i < pListA->nChildren; i++ ) {
+    char *zA = planItemName(pListA->apChildren[i], i);
+    char *zB = planItemName(pListB->apChildren[i], i);
+    bSame = zA && zB && strcmp(zA, zB) == 0;
+    sqlite3_free(zA);
+    sqlite3_free(zB);
+  }
+  return bSame;
 }
 
 /*
-** Add a variable to the planning context.
-** Returns SQLITE_OK on success, SQLITE_NOMEM on allocation failure.
+** Compile a query whose single queries are joined by UNION or UNION ALL.
+** The results of all sides are concatenated, and for UNION the rows are
+** then deduplicated as a whole. The two forms cannot be mixed, and every
+** side must return the same columns.
 */
-static int planContextAddVariable(PlanContext *pContext, const char *zVar, LogicalPlanNode *pNode) {
-  char **azNew;
-  LogicalPlanNode **apNew;
+static LogicalPlanNode *compileQuery(CypherAst *pAst, PlanContext *pContext) {
+  LogicalPlanNode *pUnion, *pChild;
+  CypherAst *pFirst = NULL;
+  int bAll = -1;
+  int i;
   
-  if( !pContext || !zVar ) return SQLITE_MISUSE;
+  pUnion = logicalPlanNodeCreate(LOGICAL_UNION);
+  if( !pUnion ) return NULL;
   
-  /* Resize arrays if needed */
-  if( pContext->nVariables >= pContext->nVariablesAlloc ) {
-    int nNew = pContext->nVariablesAlloc ? pContext->nVariablesAlloc * 2 : 8;
-    
-    azNew = sqlite3_realloc(pContext->azVariables, nNew * sizeof(char*));
-    if( !azNew ) return SQLITE_NOMEM;
-    pContext->azVariables = azNew;
-    
-    apNew = sqlite3_realloc(pContext->apVarNodes, nNew * sizeof(LogicalPlanNode*));
-    if( !apNew ) return SQLITE_NOMEM;
-    pContext->apVarNodes = apNew;
+  for( i = 0; i < pAst->nChildren; i++ ) {
+    CypherAst *pSide = pAst->apChildren[i];
     
-    pContext->nVariablesAlloc = nNew;
+    if( cypherAstIsType(pSide, CYPHER_AST_UNION) ) {
+      int bThisAll = (pSide->iFlags & CYPHER_AST_FLAG_ALL) != 0;
+      if( bAll >= 0 && bAll != bThisAll ) {
+        pContext->zErrorMsg = sqlite3_mprintf("Cannot mix UNION and UNION ALL");
+        pContext->nErrors++;
+        logicalPlanNodeDestroy(pUnion);
+        return NULL;
+      }
+      bAll = bThisAll;
+      pSide = pSide->nChildren > 0 ? pSide->apChildren[0] : NULL;
+    }
+    if( i > 0 && !planSameColumns(pFirst, pSide) ) {
+      pContext->zErrorMsg = sqlite3_mprintf(
+          "All sides of a UNION must return the same column names");
+      pContext->nErrors++;
+      logicalPlanNodeDestroy(pUnion);
+      return NULL;
+    }
+    if( i == 0 ) pFirst = pSide;
+    pChild = compileAstNode(pSide, pContext);
+    if( !pChild || logicalPlanNodeAddChild(pUnion, pChild) != SQLITE_OK ) {
+      logicalPlanNodeDestroy(pChild);
+      logicalPlanNodeDestroy(pUnion);
+      return NULL;
+    }
   }
   
-  /* Add variable */
-  pContext->azVariables[pContext->nVariables] = sqlite3_mprintf("%s", zVar);
-  pContext->apVarNodes[pContext->nVariables] = pNode;
+  if( bAll != 0 ) return pUnion;
   
-  if( !pContext->azVariables[pContext->nVariables] ) {
-    return SQLITE_NOMEM;
+  /* A DISTINCT without columns compares whole rows */
+  pChild = logicalPlanNodeCreate(LOGICAL_DISTINCT);
+  if( !pChild || logicalPlanNodeAddChild(pChild, pUnion) != SQLITE_OK ) {
+    logicalPlanNodeDestroy(pChild);
+    logicalPlanNodeDestroy(pUnion);
+    return NULL;
   }
-  
-  pContext->nVariables++;
-  return SQLITE_OK;
+  return pChild;
 }
 
-
 /*
 ** Compile a Cypher AST node into a logical plan node.
 ** Returns the compiled logical plan node, or NULL on error.
 */
 static LogicalPlanNode *compileAstNode(CypherAst *pAst, PlanContext *pContext) {
   LogicalPlanNode *pLogical = NULL;
-  LogicalPlanNode *pChild;
-  const char *zAlias;
+  const char *zAlias, *zLabel;
   int i;
   
   if( !pAst ) return NULL;
   
   switch( pAst->type ) {
     case CYPHER_AST_QUERY:
-    case CYPHER_AST_SINGLE_QUERY:
-      /* Compile children and combine them */
-      if( pAst->nChildren > 0 ) {
+      if( pAst->nChildren > 1 ) {
+        pLogical = compileQuery(pAst, pContext);
+      } else if( pAst->nChildren == 1 ) {
         pLogical = compileAstNode(pAst->apChildren[0], pContext);
-        
-        for( i = 1; i < pAst->nChildren; i++ ) {
-          pChild = compileAstNode(pAst->apChildren[i], pContext);
-          if( pChild && pLogical ) {
-            /* Create a join or sequence node */
-            LogicalPlanNode *pJoin = logicalPlanNodeCreate(LOGICAL_HASH_JOIN);
-            if( pJoin ) {
-              logicalPlanNodeAddChild(pJoin, pLogical);
-              logicalPlanNodeAddChild(pJoin, pChild);
-              pLogical = pJoin;
-            }
-          }
-        }
       }
       break;
       
+    case CYPHER_AST_SINGLE_QUERY:
+      pLogical = compileSingleQuery(pAst, pContext);
+      break;
+      
     case CYPHER_AST_MATCH:
       /* Compile MATCH clause */
       if( pAst->nChildren > 0 ) {
@@ -181,98 +1931,49 @@ static LogicalPlanNode *compileAstNode(CypherAst *pAst, PlanContext *pContext) {
       }
       break;
       
-    case CYPHER_AST_NODE_PATTERN:
-      /* Node pattern becomes a scan operation */
-      if( pAst->nChildren > 0 && cypherAstIsType(pAst->apChildren[0], CYPHER_AST_IDENTIFIER) ) {
-        zAlias = cypherAstGetValue(pAst->apChildren[0]);
-        
-        /* Check if this is a labeled node */
-        if( pAst->nChildren > 1 && cypherAstIsType(pAst->apChildren[1], CYPHER_AST_LABELS) ) {
-          /* Label scan */
-          pLogical = logicalPlanNodeCreate(LOGICAL_LABEL_SCAN);
-          if( pLogical ) {
-            logicalPlanNodeSetAlias(pLogical, zAlias);
-            
-            /* Get first label */
-            if( pAst->apChildren[1]->nChildren > 0 ) {
-              const char *zLabel = cypherAstGetValue(pAst->apChildren[1]->apChildren[0]);
-              logicalPlanNodeSetLabel(pLogical, zLabel);
-            }
-            
-            /* Add variable to context */
-            planContextAddVariable(pContext, zAlias, pLogical);
-          }
-        } else {
-          /* Full node scan */
-          pLogical = logicalPlanNodeCreate(LOGICAL_NODE_SCAN);
-          if( pLogical ) {
-            logicalPlanNodeSetAlias(pLogical, zAlias);
-            planContextAddVariable(pContext, zAlias, pLogical);
-          }
-        }
+    case CYPHER_AST_PATTERN:
+    case CYPHER_AST_PATH:
+      /* p = shortestPath(...) is a path holding the variable and the call */
+      if( pAst->nChildren == 2 && cypherAstIsType(pAst->apChildren[0], CYPHER_AST_IDENTIFIER) &&
+          cypherAstIsType(pAst->apChildren[1], CYPHER_AST_FUNCTION_CALL) ) {
+        pLogical = compileShortestPath(pAst->apChildren[1],
+                                       cypherAstGetValue(pAst->apChildren[0]), pContext);
+      } else if( pAst->nChildren == 1 &&
+                 cypherAstIsType(pAst->apChildren[0], CYPHER_AST_FUNCTION_CALL) ) {
+        pLogical = compileShortestPath(pAst->apChildren[0], NULL, pContext);
+      } else {
+        pLogical = compilePattern(pAst, pContext);
       }
       break;
       
-    case CYPHER_AST_WHERE:
-      /* WHERE clause becomes a filter */
-      if( pAst->nChildren > 0 ) {
-        CypherAst *pExpr = pAst->apChildren[0];
-        
-        if( cypherAstIsType(pExpr, CYPHER_AST_BINARY_OP) && 
-            strcmp(cypherAstGetValue(pExpr), "=") == 0 &&
-            pExpr->nChildren >= 2 ) {
-          
-          /* Property filter: n.prop = value */
-          if( cypherAstIsType(pExpr->apChildren[0], CYPHER_AST_PROPERTY) ) {
-            pLogical = logicalPlanNodeCreate(LOGICAL_PROPERTY_FILTER);
-            if( pLogical ) {
-              CypherAst *pProp = pExpr->apChildren[0];
-              if( pProp->nChildren >= 2 ) {
-                const char *zVar = cypherAstGetValue(pProp->apChildren[0]);
-                const char *zProp = cypherAstGetValue(pProp->apChildren[1]);
-                const char *zValue = cypherAstGetValue(pExpr->apChildren[1]);
-                
-                logicalPlanNodeSetAlias(pLogical, zVar);
-                logicalPlanNodeSetProperty(pLogical, zProp);
-                logicalPlanNodeSetValue(pLogical, zValue);
-              }
-            }
-          }
-        }
-        
-        if( !pLogical ) {
-          /* Generic filter */
-          pLogical = logicalPlanNodeCreate(LOGICAL_FILTER);
+    case CYPHER_AST_NODE_PATTERN:
+      /* Node pattern becomes a scan, by label if it has one, filtered by
+      ** its property map. An anonymous node still needs a name for the
+      ** scan to bind */
+      zAlias = NULL;
+      zLabel = NULL;
+      for( i = 0; i < pAst->nChildren; i++ ) {
+        if( cypherAstIsType(pAst->apChildren[i], CYPHER_AST_IDENTIFIER) ) {
+          zAlias = cypherAstGetValue(pAst->apChildren[i]);
+        } else if( patternLabel(pAst->apChildren[i]) ) {
+          zLabel = patternLabel(pAst->apChildren[i]);
         }
       }
-      break;
-      
-    case CYPHER_AST_RETURN:
-      /* RETURN clause becomes a projection */
-      pLogical = logicalPlanNodeCreate(LOGICAL_PROJECTION);
-      if( pLogical && pAst->nChildren > 0 ) {
-        /* Process projection list */
-        CypherAst *pProjList = pAst->apChildren[0];
-        if( cypherAstIsType(pProjList, CYPHER_AST_PROJECTION_LIST) && 
-            pProjList->nChildren > 0 ) {
-          CypherAst *pItem = pProjList->apChildren[0];
-          if( cypherAstIsType(pItem, CYPHER_AST_PROJECTION_ITEM) && 
-              pItem->nChildren > 0 ) {
-            CypherAst *pExpr = pItem->apChildren[0];
-            
-            if( cypherAstIsType(pExpr, CYPHER_AST_IDENTIFIER) ) {
-              logicalPlanNodeSetAlias(pLogical, cypherAstGetValue(pExpr));
-            } else if( cypherAstIsType(pExpr, CYPHER_AST_PROPERTY) && 
-                       pExpr->nChildren >= 2 ) {
-              const char *zVar = cypherAstGetValue(pExpr->apChildren[0]);
-              const char *zProp = cypherAstGetValue(pExpr->apChildren[1]);
-              
-              logicalPlanNodeSetAlias(pLogical, zVar);
-              logicalPlanNodeSetProperty(pLogical, zProp);
-            }
-          }
-        }
+      pLogical = logicalPlanNodeCreate(zLabel ? LOGICAL_LABEL_SCAN : LOGICAL_NODE_SCAN);
+      if( !pLogical ) break;
+      if( zAlias ) {
+        logicalPlanNodeSetAlias(pLogical, zAlias);
+      } else {
+        pLogical->zAlias = sqlite3_mprintf("anon_%d", pContext->nVariables);
+      }
+      if( zLabel ) logicalPlanNodeSetLabel(pLogical, zLabel);
+      if( !pLogical->zAlias ) {
+        logicalPlanNodeDestroy(pLogical);
+        pLogical = NULL;
+        break;
       }
+      planContextAddVariable(pContext, pLogical->zAlias, pLogical);
+      pLogical = compilePatternProperties(pAst, pLogical->zAlias, pLogical, pContext);
       break;
       
     default:
@@ -355,6 +2056,14 @@ int cypherPlannerOptimize(CypherPlanner *pPlanner) {
   /* Index usage optimization */
   optimizeIndexUsage(pPlanner->pLogicalPlan, pPlanner->pContext);
   
+  /* Filters on what a scan produces move into the scan's SQL. This runs
+  ** after index selection, which reads the same filters. */
+  if( pPlanner->pContext->bPushdown &&
+      cypherPushdownPredicates(NULL, &pPlanner->pLogicalPlan) != SQLITE_OK ) {
+    pPlanner->zErrorMsg = sqlite3_mprintf("Out of memory pushing down filters");
+    return SQLITE_NOMEM;
+  }
+  
   /* Convert logical plan to physical plan */
   pPhysical = logicalPlanToPhysical(pPlanner->pLogicalPlan, pPlanner->pContext);
   if( !pPhysical ) {
@@ -454,18 +2163,496 @@ static double calculateJoinCost(LogicalPlanNode *pLeft, LogicalPlanNode *pRight,
   return cost;
 }
 
+/* Most comparisons considered when matching a scan against indexes */
+#define PLAN_MAX_INDEX_PREDICATES 16
+
+/*
+** Return true if pNode is a scan that an index scan could replace.
+*/
+static int isIndexableScan(LogicalPlanNode *pNode) {
+  return pNode && pNode->zAlias &&
+         (pNode->type == LOGICAL_NODE_SCAN || pNode->type == LOGICAL_LABEL_SCAN);
+}
+
+/*
+** Return true if pNode is a filter.
+*/
+static int isFilter(LogicalPlanNode *pNode) {
+  return pNode && (pNode->type == LOGICAL_FILTER || 
+                   pNode->type == LOGICAL_PROPERTY_FILTER);
+}
+
+/*
+** Collect the property comparisons on zAlias in the chain of filters
+** rooted at pNode into apPred, which holds nPred entries already.
+** Returns the new number of entries.
+*/
+static int collectPropertyFilters(LogicalPlanNode *pNode, const char *zAlias,
+                                  LogicalPlanNode **apPred, int nPred) {
+  int i;
+  
+  if( !isFilter(pNode) ) return nPred;
+  
+  if( pNode->type == LOGICAL_PROPERTY_FILTER && pNode->zAlias && 
+      strcmp(pNode->zAlias, zAlias) == 0 && pNode->zProperty && 
+      pNode->zValue && nPred < PLAN_MAX_INDEX_PREDICATES ) {
+    apPred[nPred++] = pNode;
+  }
+  for( i = 0; i < pNode->nChildren; i++ ) {
+    nPred = collectPropertyFilters(pNode->apChildren[i], zAlias, apPred, nPred);
+  }
+  return nPred;
+}
+
+/*
+** Return the scan at the bottom of the chain of filters rooted at pNode,
+** or NULL if the chain does not end in an indexable scan.
+*/
+static LogicalPlanNode *findFilteredScan(LogicalPlanNode *pNode) {
+  int i;
+  
+  for( i = 0; isFilter(pNode) && i < pNode->nChildren; i++ ) {
+    LogicalPlanNode *pChild = pNode->apChildren[i];
+    if( isIndexableScan(pChild) ) return pChild;
+    if( isFilter(pChild) ) return findFilteredScan(pChild);
+  }
+  return NULL;
+}
+
+/*
+** Match the comparisons in apPred against an index on the comma-separated
+** property list zColumns. An index answers equality on a prefix of its
+** properties followed by range comparisons on the next property. Returns
+** the number of comparisons answered. If pScan is not NULL they are also
+** appended, in index order, to its index key.
+*/
+static int matchIndexColumns(const char *zColumns, LogicalPlanNode **apPred,
+                             int nPred, LogicalPlanNode *pScan) {
+  const char *zCol = zColumns;
+  int nKey = 0;
+  int i;
+  
+  while( zCol && *zCol ) {
+    int nCol = (int)strcspn(zCol, ",");
+    int bEq = 0;
+    
+    for( i = 0; i < nPred && !bEq; i++ ) {
+      const char *zOp = apPred[i]->zOperator ? apPred[i]->zOperator : "=";
+      if( strncmp(apPred[i]->zProperty, zCol, nCol) == 0 && 
+          apPred[i]->zProperty[nCol] == 0 && strcmp(zOp, "=") == 0 ) {
+        if( pScan ) {
+          logicalPlanNodeAddIndexKey(pScan, apPred[i]->zProperty, zOp, 
+                                     apPred[i]->zValue);
+        }
+        bEq = 1;
+      }
+    }
+    if( !bEq ) {
+      /* Both bounds of a range can use the same index column */
+      for( i = 0; i < nPred; i++ ) {
+        const char *zOp = apPred[i]->zOperator ? apPred[i]->zOperator : "=";
+        if( strncmp(apPred[i]->zProperty, zCol, nCol) == 0 && 
+            apPred[i]->zProperty[nCol] == 0 && strcmp(zOp, "=") != 0 &&
+            isIndexableOperator(zOp) ) {
+          if( pScan ) {
+            logicalPlanNodeAddIndexKey(pScan, apPred[i]->zProperty, zOp, 
+                                       apPred[i]->zValue);
+          }
+          nKey++;
+        }
+      }
+      break;
+    }
+    nKey++;
+    zCol += nCol;
+    if( *zCol == ',' ) zCol++;
+  }
+  return nKey;
+}
+
+/*
+** Return true if property zProperty has a bitmap index.
+*/
+static int hasBitmapIndex(PlanContext *pContext, const char *zProperty) {
+  int i;
+  for( i = 0; i < pContext->nBitmapIndexes; i++ ) {
+    if( strcmp(pContext->azBitmapIndexes[i], zProperty) == 0 ) return 1;
+  }
+  return 0;
+}
+
+/*
+** Replace pScan with an intersection of bitmap indexes if that answers
+** more than nBest of the comparisons in apPred, counting the scan's label
+** as one. Only equalities can be answered from a bitmap. Returns true if
+** pScan was replaced.
+*/
+static int applyBitmapIndexes(PlanContext *pContext, LogicalPlanNode *pScan,
+                              LogicalPlanNode **apPred, int nPred, int nBest) {
+  int nKey = pScan->zLabel ? 1 : 0;
+  int i;
+  
+  for( i = 0; i < nPred; i++ ) {
+    const char *zOp = apPred[i]->zOperator ? apPred[i]->zOperator : "=";
+    if( strcmp(zOp, "=") == 0 && hasBitmapIndex(pContext, apPred[i]->zProperty) ) {
+      nKey++;
+    }
+  }
+  if( nKey < 2 || nKey <= nBest ) return 0;
+  
+  planPredicatesFree(pScan->aIndexKey, pScan->nIndexKey);
+  pScan->aIndexKey = NULL;
+  pScan->nIndexKey = 0;
+  for( i = 0; i < nPred; i++ ) {
+    const char *zOp = apPred[i]->zOperator ? apPred[i]->zOperator : "=";
+    if( strcmp(zOp, "=") == 0 && hasBitmapIndex(pContext, apPred[i]->zProperty) ) {
+      if( logicalPlanNodeAddIndexKey(pScan, apPred[i]->zProperty, zOp,
+                                     apPred[i]->zValue) != SQLITE_OK ) {
+        return 0;
+      }
+    }
+  }
+  
+  pScan->type = LOGICAL_BITMAP_SCAN;
+  for( i = 0; i < nKey; i++ ) {
+    pScan->iEstimatedRows = pScan->iEstimatedRows / 10; /* Each bitmap */
+  }
+  if( pScan->iEstimatedRows < 1 ) pScan->iEstimatedRows = 1;
+  pScan->rEstimatedCost = pScan->rEstimatedCost * pContext->rIndexCostFactor;
+  return 1;
+}
+
+/*
+** Return the range index on zProperty usable by pScan, preferring one
+** scoped to the scan's label, or -1 if there is none.
+*/
+static int findRangeIndex(PlanContext *pContext, LogicalPlanNode *pScan,
+                          const char *zProperty) {
+  int iBest = -1;
+  int i;
+  
+  for( i = 0; i < pContext->nRangeIndexes; i++ ) {
+    const char *zIdxLabel = pContext->azRangeLabels[i];
+    
+    if( strcmp(pContext->azRangeProps[i], zProperty) != 0 ) continue;
+    if( zIdxLabel[0] == 0 ) {
+      if( iBest < 0 ) iBest = i;
+    } else if( pScan->zLabel && strcmp(zIdxLabel, pScan->zLabel) == 0 ) {
+      return i;
+    }
+  }
+  return iBest;
+}
+
+/*
+** Replace pScan with a scan of range index iIdx, taking the comparisons in
+** apPred on the indexed property as its key.
+*/
+static void applyRangeIndex(PlanContext *pContext, LogicalPlanNode *pScan,
+                            int iIdx, LogicalPlanNode **apPred, int nPred) {
+  const char *zProp = pContext->azRangeProps[iIdx];
+  int i;
+  
+  planPredicatesFree(pScan->aIndexKey, pScan->nIndexKey);
+  pScan->aIndexKey = NULL;
+  pScan->nIndexKey = 0;
+  for( i = 0; i < nPred; i++ ) {
+    const char *zOp = apPred[i]->zOperator ? apPred[i]->zOperator : "=";
+    if( strcmp(apPred[i]->zProperty, zProp) == 0 && isIndexableOperator(zOp) ) {
+      logicalPlanNodeAddIndexKey(pScan, zProp, zOp, apPred[i]->zValue);
+    }
+  }
+  
+  sqlite3_free(pScan->zIndexName);
+  pScan->zIndexName = sqlite3_mprintf("%s", pContext->azRangeIndexes[iIdx]);
+  logicalPlanNodeSetProperty(pScan, zProp);
+  if( strcmp(pContext->azRangeTypes[iIdx], "date") == 0 ) {
+    pScan->iFlags |= PLAN_FLAG_DATE_KEY;
+  }
+  pScan->type = LOGICAL_RANGE_SCAN;
+  if( pScan->nIndexKey > 0 ) {
+    pScan->iEstimatedRows = pScan->iEstimatedRows / 10; /* Assume 10x improvement */
+    if( pScan->iEstimatedRows < 1 ) pScan->iEstimatedRows = 1;
+    pScan->rEstimatedCost = pScan->rEstimatedCost * pContext->rIndexCostFactor;
+  }
+}
+
+/*
+** Return true if pPred is a string comparison a trigram index can answer:
+** its value must be a string literal of at least three characters, as
+** shorter strings contain no trigram.
+*/
+static int isFulltextPredicate(LogicalPlanNode *pPred) {
+  const char *zValue = pPred->zValue;
+  int n = (int)strlen(zValue);
+  int nChar = 0;
+  int i;
+  
+  if( !isTextOperator(pPred->zOperator) ) return 0;
+  if( n < 2 || (zValue[0] != '\'' && zValue[0] != '"') || zValue[n-1] != zValue[0] ) {
+    return 0;
+  }
+  for( i = 1; i < n - 1; i++ ) {
+    if( (zValue[i] & 0xc0) != 0x80 ) nChar++;
+  }
+  return nChar >= 3;
+}
+
+/*
+** Return the trigram full-text index on zProperty usable by pScan,
+** preferring one scoped to the scan's label, or -1 if there is none.
+*/
+static int findFulltextIndex(PlanContext *pContext, LogicalPlanNode *pScan,
+                             const char *zProperty) {
+  int iBest = -1;
+  int i;
+  
+  for( i = 0; i < pContext->nFulltextIndexes; i++ ) {
+    const char *zIdxLabel = pContext->azFulltextLabels[i];
+    
+    if( strcmp(pContext->azFulltextProps[i], zProperty) != 0 ) continue;
+    if( strcmp(pContext->azFulltextTokenizers[i], "trigram") != 0 ) continue;
+    if( zIdxLabel[0] == 0 ) {
+      if( iBest < 0 ) iBest = i;
+    } else if( pScan->zLabel && strcmp(zIdxLabel, pScan->zLabel) == 0 ) {
+      return i;
+    }
+  }
+  return iBest;
+}
+
+/*
+** Replace pScan with a search of a full-text index if one answers a
+** string comparison in apPred. Every such comparison on the indexed
+** property becomes part of the search. The index finds a superset of the
+** matching nodes (it ignores case and where in the value the string
+** occurs), so the comparisons stay in the plan as filters. Returns true
+** if pScan was replaced.
+*/
+static int applyFulltextIndex(PlanContext *pContext, LogicalPlanNode *pScan,
+                              LogicalPlanNode **apPred, int nPred) {
+  const char *zProp = NULL;
+  int iIdx = -1;
+  int i;
+  
+  for( i = 0; i < nPred && iIdx < 0; i++ ) {
+    if( isFulltextPredicate(apPred[i]) ) {
+      zProp = apPred[i]->zProperty;
+      iIdx = findFulltextIndex(pContext, pScan, zProp);
+    }
+  }
+  if( iIdx < 0 ) return 0;
+  
+  planPredicatesFree(pScan->aIndexKey, pScan->nIndexKey);
+  pScan->aIndexKey = NULL;
+  pScan->nIndexKey = 0;
+  for( i = 0; i < nPred; i++ ) {
+    if( strcmp(apPred[i]->zProperty, zProp) == 0 && isFulltextPredicate(apPred[i]) ) {
+      if( logicalPlanNodeAddIndexKey(pScan, zProp, apPred[i]->zOperator,
+                                     apPred[i]->zValue) != SQLITE_OK ) {
+        return 0;
+      }
+    }
+  }
+  
+  sqlite3_free(pScan->zIndexName);
+  pScan->zIndexName = sqlite3_mprintf("%s", pContext->azFulltextIndexes[iIdx]);
+  logicalPlanNodeSetProperty(pScan, zProp);
+  pScan->type = LOGICAL_FULLTEXT_SCAN;
+  pScan->iEstimatedRows = pScan->iEstimatedRows / 100; /* Assume 100x improvement */
+  if( pScan->iEstimatedRows < 1 ) pScan->iEstimatedRows = 1;
+  pScan->rEstimatedCost = pScan->rEstimatedCost * pContext->rIndexCostFactor;
+  return 1;
+}
+
+/*
+** Replace pScan with a scan of the property index that answers the most
+** comparisons in apPred. An index scoped to the scan's label is preferred
+** over one covering all nodes. The comparisons stay in the plan as
+** filters, so the plan is correct whichever scan is chosen.
+*/
+static void applyBestIndex(PlanContext *pContext, LogicalPlanNode *pScan,
+                           LogicalPlanNode **apPred, int nPred) {
+  int iBest = -1, nBestKey = 0, bBestScoped = 0;
+  int i;
+  
+  if( !pContext || !pContext->bUseIndexes || nPred == 0 ) return;
+  
+  for( i = 0; i < pContext->nPropertyIndexes; i++ ) {
+    const char *zIdxLabel = pContext->azIndexLabels[i];
+    int bScoped = zIdxLabel[0] != 0;
+    int nKey;
+    
+    if( bScoped && (!pScan->zLabel || strcmp(zIdxLabel, pScan->zLabel) != 0) ) {
+      continue;
+    }
+    nKey = matchIndexColumns(pContext->azIndexColumns[i], apPred, nPred, NULL);
+    if( nKey > nBestKey || (nKey > 0 && nKey == nBestKey && bScoped && !bBestScoped) ) {
+      iBest = i;
+      nBestKey = nKey;
+      bBestScoped = bScoped;
+    }
+  }
+  
+  /* A label-scoped index answers the label as well */
+  if( applyBitmapIndexes(pContext, pScan, apPred, nPred, nBestKey + bBestScoped) ) {
+    return;
+  }
+  if( iBest < 0 ) {
+    /* Without a property index, a full-text index may answer a string
+    ** comparison, or a range index an ordinary one */
+    if( applyFulltextIndex(pContext, pScan, apPred, nPred) ) return;
+    for( i = 0; i < nPred; i++ ) {
+      int iRange;
+      if( !isIndexableOperator(apPred[i]->zOperator ? apPred[i]->zOperator : "=") ) {
+        continue;
+      }
+      iRange = findRangeIndex(pContext, pScan, apPred[i]->zProperty);
+      if( iRange >= 0 ) {
+        applyRangeIndex(pContext, pScan, iRange, apPred, nPred);
+        return;
+      }
+    }
+    return;
+  }
+  
+  /* Convert to property index scan - highly selective */
+  planPredicatesFree(pScan->aIndexKey, pScan->nIndexKey);
+  pScan->aIndexKey = NULL;
+  pScan->nIndexKey = 0;
+  matchIndexColumns(pContext->azIndexColumns[iBest], apPred, nPred, pScan);
+  if( pScan->nIndexKey != nBestKey ) return; /* Out of memory */
+  
+  sqlite3_free(pScan->zIndexName);
+  pScan->zIndexName = sqlite3_mprintf("%s", pContext->azPropertyIndexes[iBest]);
+  logicalPlanNodeSetProperty(pScan, pScan->aIndexKey[0].zProperty);
+  logicalPlanNodeSetValue(pScan, pScan->aIndexKey[0].zValue);
+  pScan->type = LOGICAL_INDEX_SCAN;
+  pScan->iEstimatedRows = pScan->iEstimatedRows / 100;  /* Assume 100x improvement */
+  for( i = 1; i < nBestKey; i++ ) {
+    pScan->iEstimatedRows = pScan->iEstimatedRows / 10; /* Each further key */
+  }
+  if( pScan->iEstimatedRows < 1 ) pScan->iEstimatedRows = 1;
+  pScan->rEstimatedCost = pScan->rEstimatedCost * pContext->rIndexCostFactor;
+}
+
+/*
+** Return the scan of zAlias whose order the rows of pNode keep, or NULL.
+** Filters, projections, SKIP and LIMIT keep the order of their input, and
+** a join keeps the order of its first input.
+*/
+static LogicalPlanNode *findOrderedScan(LogicalPlanNode *pNode, const char *zAlias) {
+  while( pNode ) {
+    if( isIndexableScan(pNode) ) {
+      return strcmp(pNode->zAlias, zAlias) == 0 ? pNode : NULL;
+    }
+    if( pNode->nChildren == 0 ) return NULL;
+    switch( pNode->type ) {
+      case LOGICAL_FILTER:
+      case LOGICAL_PROPERTY_FILTER:
+      case LOGICAL_LABEL_FILTER:
+      case LOGICAL_PROJECTION:
+      case LOGICAL_LIMIT:
+      case LOGICAL_SKIP:
+      case LOGICAL_HASH_JOIN:
+      case LOGICAL_NESTED_LOOP_JOIN:
+      case LOGICAL_CARTESIAN_PRODUCT:
+        pNode = pNode->apChildren[0];
+        break;
+      default:
+        return NULL;
+    }
+  }
+  return NULL;
+}
+
+/*
+** Collect the property comparisons on zAlias in the filters of the plan
+** rooted at pNode, looking through joins.
+*/
+static int collectScanPredicates(LogicalPlanNode *pNode, const char *zAlias,
+                                 LogicalPlanNode **apPred, int nPred) {
+  int i;
+  
+  if( isFilter(pNode) ) {
+    return collectPropertyFilters(pNode, zAlias, apPred, nPred);
+  }
+  if( pNode->type == LOGICAL_HASH_JOIN || pNode->type == LOGICAL_NESTED_LOOP_JOIN ) {
+    for( i = 0; i < pNode->nChildren; i++ ) {
+      nPred = collectScanPredicates(pNode->apChildren[i], zAlias, apPred, nPred);
+    }
+  }
+  return nPred;
+}
+
+/*
+** If a range index on the sort key of pSort can produce the rows of the
+** scan below it in order, scan that index instead and mark the sort as
+** satisfied, so that no sort operator is planned. A LIMIT above then
+** stops the scan early. Only single-key sorts qualify.
+*/
+static void applyOrderedIndex(PlanContext *pContext, LogicalPlanNode *pSort) {
+  LogicalPlanNode *apPred[PLAN_MAX_INDEX_PREDICATES];
+  LogicalPlanNode *pScan;
+  int nPred, iIdx;
+  
+  if( !pContext->bUseIndexes || !pSort->zAlias || !pSort->zProperty ) return;
+  if( pSort->nChildren != 1 || pSort->nColumn > 1 ) return;
+  
+  pScan = findOrderedScan(pSort->apChildren[0], pSort->zAlias);
+  if( !pScan ) return;
+  iIdx = findRangeIndex(pContext, pScan, pSort->zProperty);
+  if( iIdx < 0 ) return;
+  
+  nPred = collectScanPredicates(pSort->apChildren[0], pScan->zAlias, apPred, 0);
+  if( pScan->zProperty && pScan->zValue && nPred < PLAN_MAX_INDEX_PREDICATES ) {
+    apPred[nPred++] = pScan;
+  }
+  applyRangeIndex(pContext, pScan, iIdx, apPred, nPred);
+  pScan->iFlags |= PLAN_FLAG_ORDERED | (pSort->iFlags & PLAN_FLAG_DESC);
+  pSort->iFlags |= PLAN_FLAG_ORDERED;
+}
+
 /*
 ** Analyze and optimize index usage for node scans.
 ** Replaces full table scans with index scans when beneficial.
 */
 static int optimizeIndexUsage(LogicalPlanNode *pNode, PlanContext *pContext) {
+  LogicalPlanNode *apPred[PLAN_MAX_INDEX_PREDICATES];
+  LogicalPlanNode *pScan = NULL;
+  int nPred = 0;
   int i;
   
   if (!pNode) return SQLITE_OK;
   
-  /* Recursively optimize children first */
-  for (i = 0; i < pNode->nChildren; i++) {
-    optimizeIndexUsage(pNode->apChildren[i], pContext);
+  /* A sort first claims the scan below it for an ordered index scan */
+  if (pNode->type == LOGICAL_SORT) {
+    applyOrderedIndex(pContext, pNode);
+  }
+  
+  /* Comparisons on the variable a scan produces can be answered by a
+  ** property index. They come from the filters joined with the scan, or
+  ** from the chain of filters above it. This runs top-down so that the
+  ** whole chain is seen at once. */
+  if ((pNode->type == LOGICAL_HASH_JOIN || pNode->type == LOGICAL_NESTED_LOOP_JOIN)
+      && pNode->nChildren == 2) {
+    for (i = 0; i < 2 && !pScan; i++) {
+      if (isIndexableScan(pNode->apChildren[i]) && isFilter(pNode->apChildren[1 - i])) {
+        pScan = pNode->apChildren[i];
+        nPred = collectPropertyFilters(pNode->apChildren[1 - i], pScan->zAlias, 
+                                       apPred, 0);
+      }
+    }
+  } else if (isFilter(pNode)) {
+    pScan = findFilteredScan(pNode);
+    if (pScan) nPred = collectPropertyFilters(pNode, pScan->zAlias, apPred, 0);
+  } else if (isIndexableScan(pNode) && pNode->zProperty && pNode->zValue) {
+    /* Scan with an inline property equality */
+    pScan = pNode;
+    apPred[nPred++] = pNode;
+  }
+  if (pScan) {
+    applyBestIndex(pContext, pScan, apPred, nPred);
   }
   
   /* Optimize node scan operations */
@@ -476,14 +2663,12 @@ static int optimizeIndexUsage(LogicalPlanNode *pNode, PlanContext *pContext) {
       pNode->type = LOGICAL_LABEL_SCAN;
       pNode->iEstimatedRows = pNode->iEstimatedRows / 10;  /* Assume 10x improvement */
     }
-    
-    /* Check if we have property filters that can use property index */
-    if (pNode->zProperty && pNode->zValue) {
-      /* Convert to property index scan - highly selective */
-      pNode->type = LOGICAL_INDEX_SCAN;
-      pNode->iEstimatedRows = pNode->iEstimatedRows / 100;  /* Assume 100x improvement */
-    }
+  }
+  
+  /* Recursively optimize children */
+  for (i = 0; i < pNode->nChildren; i++) {
+    optimizeIndexUsage(pNode->apChildren[i], pContext);
   }
   
   return SQLITE_OK;
-}
\ No newline at end of file
+}
@@ -59,7 +59,7 @@ NodeIndexMap *createNodeIndexMap(GraphVtab *pVtab) {
   pMap->aNodeIds = NULL;
   pMap->nNodes = 0;
   
-  char *zSql = sqlite3_mprintf("SELECT id FROM %s_nodes ORDER BY id", pVtab->zTableName);
+  char *zSql = sqlite3_mprintf("SELECT id FROM %s ORDER BY id", pVtab->zNodeTableName);
   sqlite3_stmt *pStmt;
   int rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, NULL);
   sqlite3_free(zSql);
@@ -89,7 +89,7 @@ NodeIndexMap *createNodeIndexMap(GraphVtab *pVtab) {
   }
   
   /* Fill array with node IDs */
-  zSql = sqlite3_mprintf("SELECT id FROM %s_nodes ORDER BY id", pVtab->zTableName);
+  zSql = sqlite3_mprintf("SELECT id FROM %s ORDER BY id", pVtab->zNodeTableName);
   rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, NULL);
   sqlite3_free(zSql);
   
@@ -164,7 +164,7 @@ static void tarjanStrongConnect(GraphVtab *pVtab, TarjanState *pState,
     pState->aOnStack[iNodeIdx] = 1;
   }
   
-  zSql = sqlite3_mprintf("SELECT to_id FROM %s_edges WHERE from_id = %lld", pVtab->zTableName, iNodeId);
+  zSql = sqlite3_mprintf("SELECT to_id FROM %s WHERE from_id = %lld", pVtab->zEdgeTableName, iNodeId);
   rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0);
   sqlite3_free(zSql);
   if( rc!=SQLITE_OK ) return;
@@ -236,7 +236,7 @@ int graphStronglyConnectedComponents(GraphVtab *pVtab, char **pzSCC){
   char *zSql;
   sqlite3_stmt *pStmt;
 
-  zSql = sqlite3_mprintf("SELECT count(*) FROM %s_nodes", pVtab->zTableName);
+  zSql = sqlite3_mprintf("SELECT count(*) FROM %s", pVtab->zNodeTableName);
   rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0);
   sqlite3_free(zSql);
   if( rc==SQLITE_OK && sqlite3_step(pStmt)==SQLITE_ROW ){
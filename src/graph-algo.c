@@ -383,7 +383,7 @@ int graphDijkstra(GraphVtab *pVtab, sqlite3_int64 iStartId,
   *pzPath = 0;
   if( prDistance ) *prDistance = DBL_MAX;
 
-  zSql = sqlite3_mprintf("SELECT count(*) FROM %s_nodes", pVtab->zTableName);
+  zSql = sqlite3_mprintf("SELECT count(*) FROM %s", pVtab->zNodeTableName);
   rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0);
   sqlite3_free(zSql);
   if( rc==SQLITE_OK && sqlite3_step(pStmt)==SQLITE_ROW ){
@@ -426,7 +426,7 @@ int graphDijkstra(GraphVtab *pVtab, sqlite3_int64 iStartId,
       continue;
     }
     
-    zSql = sqlite3_mprintf("SELECT to_id, weight FROM %s_edges WHERE from_id = %lld", pVtab->zTableName, iCurrentId);
+    zSql = sqlite3_mprintf("SELECT to_id, weight FROM %s WHERE from_id = %lld", pVtab->zEdgeTableName, iCurrentId);
     rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0);
     sqlite3_free(zSql);
     if( rc!=SQLITE_OK ) continue;
@@ -560,7 +560,7 @@ int graphPageRank(GraphVtab *pVtab, double rDamping, int nMaxIter,
 
   *pzResults = 0;
 
-  zSql = sqlite3_mprintf("SELECT count(*) FROM %s_nodes", pVtab->zTableName);
+  zSql = sqlite3_mprintf("SELECT count(*) FROM %s", pVtab->zNodeTableName);
   rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0);
   sqlite3_free(zSql);
   if( rc==SQLITE_OK && sqlite3_step(pStmt)==SQLITE_ROW ){
@@ -587,7 +587,7 @@ int graphPageRank(GraphVtab *pVtab, double rDamping, int nMaxIter,
     aOutDegree[i] = 0;
   }
   
-  zSql = sqlite3_mprintf("SELECT from_id, count(*) FROM %s_edges GROUP BY from_id", pVtab->zTableName);
+  zSql = sqlite3_mprintf("SELECT from_id, count(*) FROM %s GROUP BY from_id", pVtab->zEdgeTableName);
   rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0);
   sqlite3_free(zSql);
   while( sqlite3_step(pStmt)==SQLITE_ROW ){
@@ -602,7 +602,7 @@ int graphPageRank(GraphVtab *pVtab, double rDamping, int nMaxIter,
       aNewPageRank[i] = (1.0 - rDamping) / nNodes;
     }
     
-    zSql = sqlite3_mprintf("SELECT from_id, to_id FROM %s_edges", pVtab->zTableName);
+    zSql = sqlite3_mprintf("SELECT from_id, to_id FROM %s", pVtab->zEdgeTableName);
     rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0);
     sqlite3_free(zSql);
     while( sqlite3_step(pStmt)==SQLITE_ROW ){
@@ -628,7 +628,7 @@ int graphPageRank(GraphVtab *pVtab, double rDamping, int nMaxIter,
   }
   
   *pzResults = sqlite3_mprintf("{");
-  zSql = sqlite3_mprintf("SELECT id FROM %s_nodes", pVtab->zTableName);
+  zSql = sqlite3_mprintf("SELECT id FROM %s", pVtab->zNodeTableName);
   rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0);
   sqlite3_free(zSql);
   int bFirst = 1;
@@ -673,7 +673,7 @@ int graphInDegree(GraphVtab *pVtab, sqlite3_int64 iNodeId){
   int rc;
   int nInDegree = 0;
 
-  zSql = sqlite3_mprintf("SELECT count(*) FROM %s_edges WHERE to_id = %lld", pVtab->zTableName, iNodeId);
+  zSql = sqlite3_mprintf("SELECT count(*) FROM %s WHERE to_id = %lld", pVtab->zEdgeTableName, iNodeId);
   rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0);
   sqlite3_free(zSql);
   if( rc==SQLITE_OK && sqlite3_step(pStmt)==SQLITE_ROW ){
@@ -689,7 +689,7 @@ int graphOutDegree(GraphVtab *pVtab, sqlite3_int64 iNodeId){
   int rc;
   int nOutDegree = 0;
 
-  zSql = sqlite3_mprintf("SELECT count(*) FROM %s_edges WHERE from_id = %lld", pVtab->zTableName, iNodeId);
+  zSql = sqlite3_mprintf("SELECT count(*) FROM %s WHERE from_id = %lld", pVtab->zEdgeTableName, iNodeId);
   rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0);
   sqlite3_free(zSql);
   if( rc==SQLITE_OK && sqlite3_step(pStmt)==SQLITE_ROW ){
@@ -707,7 +707,7 @@ double graphDegreeCentrality(GraphVtab *pVtab, sqlite3_int64 iNodeId,
   sqlite3_stmt *pStmt;
   int rc;
 
-  zSql = sqlite3_mprintf("SELECT count(*) FROM %s_nodes", pVtab->zTableName);
+  zSql = sqlite3_mprintf("SELECT count(*) FROM %s", pVtab->zNodeTableName);
   rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0);
   sqlite3_free(zSql);
   if( rc==SQLITE_OK && sqlite3_step(pStmt)==SQLITE_ROW ){
@@ -733,7 +733,7 @@ int graphIsConnected(GraphVtab *pVtab){
   int nNodes = 0;
   sqlite3_int64 iStartId = -1;
 
-  zSql = sqlite3_mprintf("SELECT count(*) FROM %s_nodes", pVtab->zTableName);
+  zSql = sqlite3_mprintf("SELECT count(*) FROM %s", pVtab->zNodeTableName);
   rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0);
   sqlite3_free(zSql);
   if( rc==SQLITE_OK && sqlite3_step(pStmt)==SQLITE_ROW ){
@@ -743,7 +743,7 @@ int graphIsConnected(GraphVtab *pVtab){
 
   if( nNodes<=1 ) return 1;
 
-  zSql = sqlite3_mprintf("SELECT id FROM %s_nodes LIMIT 1", pVtab->zTableName);
+  zSql = sqlite3_mprintf("SELECT id FROM %s LIMIT 1", pVtab->zNodeTableName);
   rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0);
   sqlite3_free(zSql);
   if( rc==SQLITE_OK && sqlite3_step(pStmt)==SQLITE_ROW ){
@@ -775,7 +775,7 @@ double graphDensity(GraphVtab *pVtab, int bDirected){
   sqlite3_stmt *pStmt;
   int rc;
 
-  zSql = sqlite3_mprintf("SELECT count(*) FROM %s_nodes", pVtab->zTableName);
+  zSql = sqlite3_mprintf("SELECT count(*) FROM %s", pVtab->zNodeTableName);
   rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0);
   sqlite3_free(zSql);
   if( rc==SQLITE_OK && sqlite3_step(pStmt)==SQLITE_ROW ){
@@ -783,7 +783,7 @@ double graphDensity(GraphVtab *pVtab, int bDirected){
   }
   sqlite3_finalize(pStmt);
 
-  zSql = sqlite3_mprintf("SELECT count(*) FROM %s_edges", pVtab->zTableName);
+  zSql = sqlite3_mprintf("SELECT count(*) FROM %s", pVtab->zEdgeTableName);
   rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0);
   sqlite3_free(zSql);
   if( rc==SQLITE_OK && sqlite3_step(pStmt)==SQLITE_ROW ){
@@ -0,0 +1,1066 @@
+/*
+** SQLite Graph Database Extension - Bitmap Indexes
+**
+** Compressed bitmaps of node ids and bitmap indexes over low-cardinality
+** node properties and labels. A conjunction of equality filters such as
+** status = 'open' AND region = 'EU' is answered by intersecting one
+** bitmap per filter, without reading any node row.
+**
+** Bitmaps are Roaring-style: node ids are split into the high bits, which
+** select a container, and the low 16 bits, which are stored in it. A
+** container holding at most GRAPH_BITMAP_ARRAY_MAX values is a sorted
+** array, a fuller one a 65536-bit bitmap. Bitmap containers are combined
+** a word at a time, using AVX2 when the CPU supports it.
+**
+** Bitmap indexes are built from the node table on first use and cached
+** on the graph. A cache is rebuilt after the database has been written.
+**
+** Memory allocation: All functions use sqlite3_malloc()/sqlite3_free()
+** Error handling: Functions return SQLite error codes
+*/
+
+#include "sqlite3ext.h"
+#ifndef SQLITE_CORE
+extern const sqlite3_api_routines *sqlite3_api;
+#endif
+/* SQLITE_EXTENSION_INIT1 - removed to prevent multiple definition */
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include "graph.h"
+#include "graph-performance.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+    && !defined(GRAPH_NO_AVX2)
+# define GRAPH_BITMAP_AVX2 1
+# include <immintrin.h>
+#else
+# define GRAPH_BITMAP_AVX2 0
+#endif
+
+#define GRAPH_BITMAP_ARRAY_MAX 4096  /* Largest array container */
+#define GRAPH_BITMAP_WORDS     1024  /* 64-bit words in a bitmap container */
+
+/* Most distinct values a property may have to get a bitmap index */
+#define GRAPH_BITMAP_MAX_VALUES 4096
+
+/*
+** One container: the node ids whose high bits are iKey. Exactly one of
+** aArray and aWord is set.
+*/
+typedef struct GraphBitmapContainer GraphBitmapContainer;
+struct GraphBitmapContainer {
+  sqlite3_int64 iKey;         /* Node id >> 16 */
+  int nCard;                  /* Number of ids in the container */
+  int nAlloc;                 /* Allocated entries of aArray */
+  unsigned short *aArray;     /* Sorted low bits, for array containers */
+  sqlite3_uint64 *aWord;      /* GRAPH_BITMAP_WORDS words, for bitmaps */
+};
+
+struct GraphBitmap {
+  GraphBitmapContainer *aCont;  /* Containers in iKey order */
+  int nCont;                    /* Number of containers in use */
+  int nContAlloc;               /* Allocated entries of aCont */
+};
+
+/*
+** Cached bitmap indexes of one graph. apIndex[i]->property is NULL for the
+** label index.
+*/
+struct GraphBitmapCache {
+  BitmapIndex **apIndex;        /* Indexes built so far */
+  int nIndex;
+  sqlite3_int64 nChanges;       /* sqlite3_total_changes64() when built */
+  unsigned int iDataVersion;    /* SQLITE_FCNTL_DATA_VERSION when built */
+};
+
+/*
+** Word kernels. Each combines two GRAPH_BITMAP_WORDS-word bitmaps into
+** aOut, which may alias either input.
+*/
+#define GRAPH_BITMAP_AND    1
+#define GRAPH_BITMAP_OR     2
+#define GRAPH_BITMAP_ANDNOT 3
+
+static void graphWordsOpScalar(int op, const sqlite3_uint64 *aA,
+                               const sqlite3_uint64 *aB, sqlite3_uint64 *aOut){
+  int i;
+  switch( op ){
+    case GRAPH_BITMAP_AND:
+      for(i=0; i<GRAPH_BITMAP_WORDS; i++) aOut[i] = aA[i] & aB[i];
+      break;
+    case GRAPH_BITMAP_OR:
+      for(i=0; i<GRAPH_BITMAP_WORDS; i++) aOut[i] = aA[i] | aB[i];
+      break;
+    default:
+      for(i=0; i<GRAPH_BITMAP_WORDS; i++) aOut[i] = aA[i] & ~aB[i];
+      break;
+  }
+}
+
+#if GRAPH_BITMAP_AVX2
+__attribute__((target("avx2")))
+static void graphWordsOpAvx2(int op, const sqlite3_uint64 *aA,
+                             const sqlite3_uint64 *aB, sqlite3_uint64 *aOut){
+  int i;
+  switch( op ){
+    case GRAPH_BITMAP_AND:
+      for(i=0; i<GRAPH_BITMAP_WORDS; i+=4){
+        __m256i a = _mm256_loadu_si256((const __m256i*)&aA[i]);
+        __m256i b = _mm256_loadu_si256((const __m256i*)&aB[i]);
+        _mm256_storeu_si256((__m256i*)&aOut[i], _mm256_and_si256(a, b));
+      }
+      break;
+    case GRAPH_BITMAP_OR:
+      for(i=0; i<GRAPH_BITMAP_WORDS; i+=4){
+        __m256i a = _mm256_loadu_si256((const __m256i*)&aA[i]);
+        __m256i b = _mm256_loadu_si256((const __m256i*)&aB[i]);
+        _mm256_storeu_si256((__m256i*)&aOut[i], _mm256_or_si256(a, b));
+      }
+      break;
+    default:
+      for(i=0; i<GRAPH_BITMAP_WORDS; i+=4){
+        __m256i a = _mm256_loadu_si256((const __m256i*)&aA[i]);
+        __m256i b = _mm256_loadu_si256((const __m256i*)&aB[i]);
+        _mm256_storeu_si256((__m256i*)&aOut[i], _mm256_andnot_si256(b, a));
+      }
+      break;
+  }
+}
+#endif
+
+static void graphWordsOp(int op, const sqlite3_uint64 *aA,
+                         const sqlite3_uint64 *aB, sqlite3_uint64 *aOut){
+#if GRAPH_BITMAP_AVX2
+  static int bAvx2 = -1;
+  if( bAvx2<0 ){
+    __builtin_cpu_init();
+    bAvx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+  }
+  if( bAvx2 ){
+    graphWordsOpAvx2(op, aA, aB, aOut);
+    return;
+  }
+#endif
+  graphWordsOpScalar(op, aA, aB, aOut);
+}
+
+static int graphWordsCount(const sqlite3_uint64 *aWord){
+  int i, n = 0;
+  for(i=0; i<GRAPH_BITMAP_WORDS; i++) n += __builtin_popcountll(aWord[i]);
+  return n;
+}
+
+/*
+** Container helpers.
+*/
+static void graphContFree(GraphBitmapContainer *pCont){
+  sqlite3_free(pCont->aArray);
+  sqlite3_free(pCont->aWord);
+  memset(pCont, 0, sizeof(*pCont));
+}
+
+static int graphContHas(const GraphBitmapContainer *pCont, unsigned short v){
+  int lo, hi;
+  if( pCont->aWord ) return (pCont->aWord[v>>6] >> (v & 63)) & 1;
+  lo = 0;
+  hi = pCont->nCard - 1;
+  while( lo<=hi ){
+    int mid = (lo + hi) / 2;
+    if( pCont->aArray[mid]==v ) return 1;
+    if( pCont->aArray[mid]<v ) lo = mid + 1; else hi = mid - 1;
+  }
+  return 0;
+}
+
+/* Turn an array container into a bitmap container */
+static int graphContToBitmap(GraphBitmapContainer *pCont){
+  sqlite3_uint64 *aWord;
+  int i;
+  if( pCont->aWord ) return SQLITE_OK;
+  aWord = sqlite3_malloc(GRAPH_BITMAP_WORDS * sizeof(sqlite3_uint64));
+  if( !aWord ) return SQLITE_NOMEM;
+  memset(aWord, 0, GRAPH_BITMAP_WORDS * sizeof(sqlite3_uint64));
+  for(i=0; i<pCont->nCard; i++){
+    unsigned short v = pCont->aArray[i];
+    aWord[v>>6] |= (sqlite3_uint64)1 << (v & 63);
+  }
+  sqlite3_free(pCont->aArray);
+  pCont->aArray = 0;
+  pCont->nAlloc = 0;
+  pCont->aWord = aWord;
+  return SQLITE_OK;
+}
+
+/* Turn a sparse bitmap container back into an array container */
+static int graphContShrink(GraphBitmapContainer *pCont){
+  unsigned short *aArray;
+  int i, n = 0;
+  if( !pCont->aWord || pCont->nCard>GRAPH_BITMAP_ARRAY_MAX ) return SQLITE_OK;
+  aArray = sqlite3_malloc((pCont->nCard ? pCont->nCard : 1) * sizeof(unsigned short));
+  if( !aArray ) return SQLITE_NOMEM;
+  for(i=0; i<GRAPH_BITMAP_WORDS; i++){
+    sqlite3_uint64 w = pCont->aWord[i];
+    while( w ){
+      int b = __builtin_ctzll(w);
+      aArray[n++] = (unsigned short)(i*64 + b);
+      w &= w - 1;
+    }
+  }
+  sqlite3_free(pCont->aWord);
+  pCont->aWord = 0;
+  pCont->aArray = aArray;
+  pCont->nAlloc = pCont->nCard ? pCont->nCard : 1;
+  return SQLITE_OK;
+}
+
+static int graphContAdd(GraphBitmapContainer *pCont, unsigned short v){
+  int i;
+  if( pCont->aWord ){
+    sqlite3_uint64 m = (sqlite3_uint64)1 << (v & 63);
+    if( !(pCont->aWord[v>>6] & m) ){
+      pCont->aWord[v>>6] |= m;
+      pCont->nCard++;
+    }
+    return SQLITE_OK;
+  }
+  if( graphContHas(pCont, v) ) return SQLITE_OK;
+  if( pCont->nCard>=GRAPH_BITMAP_ARRAY_MAX ){
+    int rc = graphContToBitmap(pCont);
+    if( rc!=SQLITE_OK ) return rc;
+    return graphContAdd(pCont, v);
+  }
+  if( pCont->nCard>=pCont->nAlloc ){
+    int nNew = pCont->nAlloc ? pCont->nAlloc*2 : 8;
+    unsigned short *aNew;
+    if( nNew>GRAPH_BITMAP_ARRAY_MAX ) nNew = GRAPH_BITMAP_ARRAY_MAX;
+    aNew = sqlite3_realloc(pCont->aArray, nNew * sizeof(unsigned short));
+    if( !aNew ) return SQLITE_NOMEM;
+    pCont->aArray = aNew;
+    pCont->nAlloc = nNew;
+  }
+  /* Ids usually arrive in order, so this rarely moves anything */
+  for(i=pCont->nCard; i>0 && pCont->aArray[i-1]>v; i--){
+    pCont->aArray[i] = pCont->aArray[i-1];
+  }
+  pCont->aArray[i] = v;
+  pCont->nCard++;
+  return SQLITE_OK;
+}
+
+/*
+** Combine containers pA and pB (same key) into *pOut, which must be
+** zeroed. Sets pOut->nCard to 0 for an empty result.
+*/
+static int graphContOp(int op, const GraphBitmapContainer *pA,
+                       const GraphBitmapContainer *pB,
+                       GraphBitmapContainer *pOut){
+  int i, j, rc = SQLITE_OK;
+
+  pOut->iKey = pA->iKey;
+
+  /* Two bitmaps: word kernel */
+  if( pA->aWord && pB->aWord ){
+    pOut->aWord = sqlite3_malloc(GRAPH_BITMAP_WORDS * sizeof(sqlite3_uint64));
+    if( !pOut->aWord ) return SQLITE_NOMEM;
+    graphWordsOp(op, pA->aWord, pB->aWord, pOut->aWord);
+    pOut->nCard = graphWordsCount(pOut->aWord);
+    return graphContShrink(pOut);
+  }
+
+  /* An array filtered by the other container */
+  if( op==GRAPH_BITMAP_AND || (op==GRAPH_BITMAP_ANDNOT && pA->aArray) ){
+    const GraphBitmapContainer *pArr = pA->aArray ? pA : pB;
+    const GraphBitmapContainer *pOther = pArr==pA ? pB : pA;
+    int bKeep = op==GRAPH_BITMAP_AND;
+    pOut->aArray = sqlite3_malloc((pArr->nCard ? pArr->nCard : 1) * sizeof(unsigned short));
+    if( !pOut->aArray ) return SQLITE_NOMEM;
+    pOut->nAlloc = pArr->nCard ? pArr->nCard : 1;
+    if( pOther->aArray ){
+      /* Two sorted arrays: merge */
+      for(i=j=0; i<pArr->nCard; i++){
+        unsigned short v = pArr->aArray[i];
+        while( j<pOther->nCard && pOther->aArray[j]<v ) j++;
+        if( (j<pOther->nCard && pOther->aArray[j]==v)==bKeep ){
+          pOut->aArray[pOut->nCard++] = v;
+        }
+      }
+    }else{
+      for(i=0; i<pArr->nCard; i++){
+        unsigned short v = pArr->aArray[i];
+        if( graphContHas(pOther, v)==bKeep ) pOut->aArray[pOut->nCard++] = v;
+      }
+    }
+    return SQLITE_OK;
+  }
+
+  /* OR with an array, or a bitmap minus an array: start from a copy of
+  ** the bitmap (or of pA) and add or clear the array's values */
+  if( op==GRAPH_BITMAP_OR && !pA->aWord && !pB->aWord
+   && pA->nCard + pB->nCard<=GRAPH_BITMAP_ARRAY_MAX ){
+    pOut->aArray = sqlite3_malloc((pA->nCard + pB->nCard) * sizeof(unsigned short));
+    if( !pOut->aArray ) return SQLITE_NOMEM;
+    pOut->nAlloc = pA->nCard + pB->nCard;
+    for(i=j=0; i<pA->nCard || j<pB->nCard; ){
+      unsigned short v;
+      if( j>=pB->nCard || (i<pA->nCard && pA->aArray[i]<pB->aArray[j]) ){
+        v = pA->aArray[i++];
+      }else if( i>=pA->nCard || pB->aArray[j]<pA->aArray[i] ){
+        v = pB->aArray[j++];
+      }else{
+        v = pA->aArray[i++];
+        j++;
+      }
+      pOut->aArray[pOut->nCard++] = v;
+    }
+    return SQLITE_OK;
+  }
+  {
+    const GraphBitmapContainer *pBase = op==GRAPH_BITMAP_OR && pB->aWord ? pB : pA;
+    const GraphBitmapContainer *pArr = pBase==pA ? pB : pA;
+    pOut->aWord = sqlite3_malloc(GRAPH_BITMAP_WORDS * sizeof(sqlite3_uint64));
+    if( !pOut->aWord ) return SQLITE_NOMEM;
+    if( pBase->aWord ){
+      memcpy(pOut->aWord, pBase->aWord, GRAPH_BITMAP_WORDS * sizeof(sqlite3_uint64));
+    }else{
+      memset(pOut->aWord, 0, GRAPH_BITMAP_WORDS * sizeof(sqlite3_uint64));
+      for(i=0; i<pBase->nCard; i++){
+        unsigned short v = pBase->aArray[i];
+        pOut->aWord[v>>6] |= (sqlite3_uint64)1 << (v & 63);
+      }
+    }
+    for(i=0; i<pArr->nCard; i++){
+      unsigned short v = pArr->aArray[i];
+      sqlite3_uint64 m = (sqlite3_uint64)1 << (v & 63);
+      if( op==GRAPH_BITMAP_OR ){
+        pOut->aWord[v>>6] |= m;
+      }else{
+        pOut->aWord[v>>6] &= ~m;
+      }
+    }
+    pOut->nCard = graphWordsCount(pOut->aWord);
+    rc = graphContShrink(pOut);
+  }
+  return rc;
+}
+
+/* Copy container pSrc into the zeroed container *pOut */
+static int graphContCopy(const GraphBitmapContainer *pSrc,
+                         GraphBitmapContainer *pOut){
+  pOut->iKey = pSrc->iKey;
+  pOut->nCard = pSrc->nCard;
+  if( pSrc->aWord ){
+    pOut->aWord = sqlite3_malloc(GRAPH_BITMAP_WORDS * sizeof(sqlite3_uint64));
+    if( !pOut->aWord ) return SQLITE_NOMEM;
+    memcpy(pOut->aWord, pSrc->aWord, GRAPH_BITMAP_WORDS * sizeof(sqlite3_uint64));
+  }else{
+    pOut->nAlloc = pSrc->nCard ? pSrc->nCard : 1;
+    pOut->aArray = sqlite3_malloc(pOut->nAlloc * sizeof(unsigned short));
+    if( !pOut->aArray ) return SQLITE_NOMEM;
+    memcpy(pOut->aArray, pSrc->aArray, pSrc->nCard * sizeof(unsigned short));
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Append a container to p, taking ownership of its buffers. Empty
+** containers are freed instead.
+*/
+static int graphBitmapAppend(GraphBitmap *p, GraphBitmapContainer *pCont){
+  if( pCont->nCard==0 ){
+    graphContFree(pCont);
+    return SQLITE_OK;
+  }
+  if( p->nCont>=p->nContAlloc ){
+    int nNew = p->nContAlloc ? p->nContAlloc*2 : 4;
+    GraphBitmapContainer *aNew;
+    aNew = sqlite3_realloc(p->aCont, nNew * sizeof(GraphBitmapContainer));
+    if( !aNew ){
+      graphContFree(pCont);
+      return SQLITE_NOMEM;
+    }
+    p->aCont = aNew;
+    p->nContAlloc = nNew;
+  }
+  p->aCont[p->nCont++] = *pCont;
+  return SQLITE_OK;
+}
+
+/*
+** Public bitmap interface.
+*/
+GraphBitmap *graphBitmapCreate(void){
+  GraphBitmap *p = sqlite3_malloc(sizeof(GraphBitmap));
+  if( p ) memset(p, 0, sizeof(GraphBitmap));
+  return p;
+}
+
+void graphBitmapDestroy(GraphBitmap *p){
+  int i;
+  if( !p ) return;
+  for(i=0; i<p->nCont; i++) graphContFree(&p->aCont[i]);
+  sqlite3_free(p->aCont);
+  sqlite3_free(p);
+}
+
+/*
+** Add node id iNode to the bitmap.
+** Returns SQLITE_OK, or SQLITE_NOMEM on allocation failure.
+*/
+int graphBitmapAdd(GraphBitmap *p, sqlite3_int64 iNode){
+  sqlite3_int64 iKey = iNode >> 16;
+  unsigned short v = (unsigned short)(iNode & 0xffff);
+  int lo = 0, hi = p->nCont - 1;
+
+  /* Ids usually arrive in order: try the last container first */
+  if( p->nCont>0 && p->aCont[p->nCont-1].iKey<=iKey ){
+    lo = p->nCont - 1;
+    if( p->aCont[lo].iKey<iKey ) lo = p->nCont;
+  }else{
+    while( lo<=hi ){
+      int mid = (lo + hi) / 2;
+      if( p->aCont[mid].iKey==iKey ){ lo = mid; break; }
+      if( p->aCont[mid].iKey<iKey ) lo = mid + 1; else hi = mid - 1;
+    }
+  }
+  if( lo>=p->nCont || p->aCont[lo].iKey!=iKey ){
+    GraphBitmapContainer cont;
+    int rc;
+    memset(&cont, 0, sizeof(cont));
+    cont.iKey = iKey;
+    rc = graphContAdd(&cont, v);
+    if( rc==SQLITE_OK ) rc = graphBitmapAppend(p, &cont);
+    if( rc!=SQLITE_OK ) return rc;
+    /* Move the new container from the end into position lo */
+    if( lo<p->nCont-1 ){
+      cont = p->aCont[p->nCont-1];
+      memmove(&p->aCont[lo+1], &p->aCont[lo],
+              (p->nCont - 1 - lo) * sizeof(GraphBitmapContainer));
+      p->aCont[lo] = cont;
+    }
+    return SQLITE_OK;
+  }
+  return graphContAdd(&p->aCont[lo], v);
+}
+
+int graphBitmapContains(const GraphBitmap *p, sqlite3_int64 iNode){
+  sqlite3_int64 iKey = iNode >> 16;
+  int lo = 0, hi = p->nCont - 1;
+  while( lo<=hi ){
+    int mid = (lo + hi) / 2;
+    if( p->aCont[mid].iKey==iKey ){
+      return graphContHas(&p->aCont[mid], (unsigned short)(iNode & 0xffff));
+    }
+    if( p->aCont[mid].iKey<iKey ) lo = mid + 1; else hi = mid - 1;
+  }
+  return 0;
+}
+
+sqlite3_int64 graphBitmapCount(const GraphBitmap *p){
+  sqlite3_int64 n = 0;
+  int i;
+  for(i=0; i<p->nCont; i++) n += p->aCont[i].nCard;
+  return n;
+}
+
+/*
+** Return a copy of p, or NULL on allocation failure.
+*/
+static GraphBitmap *graphBitmapCopy(const GraphBitmap *p){
+  GraphBitmap *pOut = graphBitmapCreate();
+  int i, rc = SQLITE_OK;
+  if( !pOut ) return 0;
+  for(i=0; rc==SQLITE_OK && i<p->nCont; i++){
+    GraphBitmapContainer cont;
+    memset(&cont, 0, sizeof(cont));
+    rc = graphContCopy(&p->aCont[i], &cont);
+    if( rc==SQLITE_OK ){
+      rc = graphBitmapAppend(pOut, &cont);
+    }else{
+      graphContFree(&cont);
+    }
+  }
+  if( rc!=SQLITE_OK ){
+    graphBitmapDestroy(pOut);
+    return 0;
+  }
+  return pOut;
+}
+
+/*
+** Combine two bitmaps. Containers present in only one input are copied
+** (OR, and the left side of ANDNOT) or skipped.
+*/
+static GraphBitmap *graphBitmapOp(int op, const GraphBitmap *pA,
+                                  const GraphBitmap *pB){
+  GraphBitmap *pOut = graphBitmapCreate();
+  int i = 0, j = 0;
+  int rc = SQLITE_OK;
+
+  if( !pOut ) return 0;
+  while( rc==SQLITE_OK && (i<pA->nCont || j<pB->nCont) ){
+    GraphBitmapContainer cont;
+    memset(&cont, 0, sizeof(cont));
+    if( j>=pB->nCont || (i<pA->nCont && pA->aCont[i].iKey<pB->aCont[j].iKey) ){
+      if( op==GRAPH_BITMAP_AND ){ i++; continue; }
+      rc = graphContCopy(&pA->aCont[i++], &cont);
+    }else if( i>=pA->nCont || pB->aCont[j].iKey<pA->aCont[i].iKey ){
+      if( op!=GRAPH_BITMAP_OR ){
+        /* AND and ANDNOT never keep ids that are only in pB */
+        if( op==GRAPH_BITMAP_AND && i>=pA->nCont ) break;
+        j++;
+        continue;
+      }
+      rc = graphContCopy(&pB->aCont[j++], &cont);
+    }else{
+      rc = graphContOp(op, &pA->aCont[i++], &pB->aCont[j++], &cont);
+    }
+    if( rc==SQLITE_OK ){
+      rc = graphBitmapAppend(pOut, &cont);
+    }else{
+      graphContFree(&cont);
+    }
+  }
+  if( rc!=SQLITE_OK ){
+    graphBitmapDestroy(pOut);
+    return 0;
+  }
+  return pOut;
+}
+
+/*
+** Set operations. Each returns a new bitmap, or NULL on allocation
+** failure. The caller frees the result with graphBitmapDestroy().
+*/
+GraphBitmap *graphBitmapAnd(const GraphBitmap *pA, const GraphBitmap *pB){
+  return graphBitmapOp(GRAPH_BITMAP_AND, pA, pB);
+}
+GraphBitmap *graphBitmapOr(const GraphBitmap *pA, const GraphBitmap *pB){
+  return graphBitmapOp(GRAPH_BITMAP_OR, pA, pB);
+}
+GraphBitmap *graphBitmapAndNot(const GraphBitmap *pA, const GraphBitmap *pB){
+  return graphBitmapOp(GRAPH_BITMAP_ANDNOT, pA, pB);
+}
+
+/*
+** Return the ids in p in ascending order in *paNodes, an array of *pnNodes
+** entries that the caller frees with sqlite3_free().
+*/
+int graphBitmapToArray(const GraphBitmap *p, sqlite3_int64 **paNodes,
+                       int *pnNodes){
+  sqlite3_int64 nTotal = graphBitmapCount(p);
+  sqlite3_int64 *aNodes;
+  int i, j, n = 0;
+
+  *paNodes = 0;
+  *pnNodes = 0;
+  if( nTotal==0 ) return SQLITE_OK;
+  aNodes = sqlite3_malloc64(nTotal * sizeof(sqlite3_int64));
+  if( !aNodes ) return SQLITE_NOMEM;
+  for(i=0; i<p->nCont; i++){
+    const GraphBitmapContainer *pCont = &p->aCont[i];
+    sqlite3_uint64 iBase = (sqlite3_uint64)pCont->iKey << 16;
+    if( pCont->aWord ){
+      for(j=0; j<GRAPH_BITMAP_WORDS; j++){
+        sqlite3_uint64 w = pCont->aWord[j];
+        while( w ){
+          aNodes[n++] = (sqlite3_int64)(iBase | (sqlite3_uint64)(j*64 + __builtin_ctzll(w)));
+          w &= w - 1;
+        }
+      }
+    }else{
+      for(j=0; j<pCont->nCard; j++){
+        aNodes[n++] = (sqlite3_int64)(iBase | pCont->aArray[j]);
+      }
+    }
+  }
+  *paNodes = aNodes;
+  *pnNodes = n;
+  return SQLITE_OK;
+}
+
+/*
+** Bitmap indexes.
+*/
+
+void graphDestroyBitmapIndex(BitmapIndex *index){
+  int i;
+  if( !index ) return;
+  for(i=0; i<index->nValues; i++){
+    sqlite3_free(index->values[i]);
+    graphBitmapDestroy(index->bitmaps[i]);
+  }
+  sqlite3_free(index->values);
+  sqlite3_free(index->bitmaps);
+  sqlite3_free(index->property);
+  sqlite3_free(index);
+}
+
+/*
+** Return the bitmap key of a property value, given its JSON type as
+** json_type() names it and its text. Keys carry the type, so that 30 and
+** '30' are different values, and numbers are written in one canonical
+** form, so that 30 and 30.0 are the same one. Returns NULL for a value no
+** equality can match (null, arrays and objects) or on OOM.
+*/
+char *graphBitmapKey(const char *zType, const char *zText){
+  double r;
+
+  if( !zType || !zText ) return 0;
+  if( strcmp(zType, "integer")==0 ){
+    return sqlite3_mprintf("#%lld", strtoll(zText, 0, 10));
+  }
+  if( strcmp(zType, "real")==0 ){
+    r = strtod(zText, 0);
+    if( r>=-9223372036854775808.0 && r<9223372036854775808.0
+     && (double)(sqlite3_int64)r==r ){
+      return sqlite3_mprintf("#%lld", (sqlite3_int64)r);
+    }
+    return sqlite3_mprintf("#%!.17g", r);
+  }
+  if( strcmp(zType, "text")==0 ) return sqlite3_mprintf("'%s", zText);
+  if( strcmp(zType, "true")==0 || strcmp(zType, "false")==0 ){
+    return sqlite3_mprintf("%s", zType);
+  }
+  return 0;
+}
+
+/* Return the slot of zValue in index, adding it if needed, or -1 */
+static int graphBitmapIndexSlot(BitmapIndex *index, const char *zValue){
+  int i;
+  for(i=0; i<index->nValues; i++){
+    if( strcmp(index->values[i], zValue)==0 ) return i;
+  }
+  if( index->nValues>=GRAPH_BITMAP_MAX_VALUES ) return -1;
+  {
+    char **azNew = sqlite3_realloc(index->values, (i+1) * sizeof(char*));
+    GraphBitmap **apNew;
+    if( !azNew ) return -1;
+    index->values = azNew;
+    apNew = sqlite3_realloc(index->bitmaps, (i+1) * sizeof(GraphBitmap*));
+    if( !apNew ) return -1;
+    index->bitmaps = apNew;
+    index->values[i] = sqlite3_mprintf("%s", zValue);
+    index->bitmaps[i] = graphBitmapCreate();
+    if( !index->values[i] || !index->bitmaps[i] ){
+      sqlite3_free(index->values[i]);
+      graphBitmapDestroy(index->bitmaps[i]);
+      return -1;
+    }
+    index->nValues++;
+  }
+  return i;
+}
+
+/*
+** Build a bitmap index over the values of property, or over node labels
+** when property is NULL. Property values are keyed by graphBitmapKey().
+** Nodes without the property, or whose value is null, a list or a map,
+** are not indexed. Returns NULL if the property has more than
+** GRAPH_BITMAP_MAX_VALUES distinct values or on error.
+*/
+BitmapIndex* graphCreateBitmapIndex(GraphVtab *pGraph, const char *property){
+  BitmapIndex *index;
+  sqlite3_stmt *pStmt = 0;
+  char *zSql;
+  int rc;
+
+  if( !pGraph ) return NULL;
+  if( property ){
+    zSql = sqlite3_mprintf(
+      "SELECT id, json_type(properties, '$.%q') AS t, " GRAPH_PROPERTY_EXPR
+      " FROM %s WHERE t IN ('integer', 'real', 'text', 'true', 'false') "
+      "ORDER BY id",
+      property, property, pGraph->zNodeTableName);
+  }else{
+    zSql = sqlite3_mprintf(
+      "SELECT node_id, name FROM %s_label_index JOIN %s_labels ON id = label_id "
+      "ORDER BY node_id",
+      pGraph->zTableName, pGraph->zTableName);
+  }
+  if( !zSql ) return NULL;
+  rc = sqlite3_prepare_v2(pGraph->pDb, zSql, -1, &pStmt, 0);
+  sqlite3_free(zSql);
+  if( rc!=SQLITE_OK ) return NULL;
+
+  index = sqlite3_malloc(sizeof(BitmapIndex));
+  if( !index ){
+    sqlite3_finalize(pStmt);
+    return NULL;
+  }
+  memset(index, 0, sizeof(BitmapIndex));
+  index->property = property ? sqlite3_mprintf("%s", property) : 0;
+  if( property && !index->property ) rc = SQLITE_NOMEM;
+
+  while( rc==SQLITE_OK && sqlite3_step(pStmt)==SQLITE_ROW ){
+    sqlite3_int64 iNode = sqlite3_column_int64(pStmt, 0);
+    char *zKey = 0;
+    int iSlot;
+    if( property ){
+      zKey = graphBitmapKey((const char*)sqlite3_column_text(pStmt, 1),
+                            (const char*)sqlite3_column_text(pStmt, 2));
+      if( !zKey ){
+        rc = SQLITE_NOMEM;
+        break;
+      }
+    }
+    iSlot = graphBitmapIndexSlot(index, zKey ? zKey
+                                 : (const char*)sqlite3_column_text(pStmt, 1));
+    sqlite3_free(zKey);
+    if( iSlot<0 ){
+      rc = SQLITE_ERROR;
+      break;
+    }
+    rc = graphBitmapAdd(index->bitmaps[iSlot], iNode);
+    index->nNodes++;
+  }
+  if( rc==SQLITE_OK ) rc = sqlite3_finalize(pStmt); else sqlite3_finalize(pStmt);
+  if( rc!=SQLITE_OK ){
+    graphDestroyBitmapIndex(index);
+    return NULL;
+  }
+  return index;
+}
+
+/*
+** Return the bitmap of nodes whose property (label, if NULL) is zValue, or
+** NULL if there are none. For a property zValue is a graphBitmapKey().
+*/
+const GraphBitmap *graphBitmapIndexLookup(const BitmapIndex *index,
+                                          const char *zValue){
+  int i;
+  for(i=0; i<index->nValues; i++){
+    if( strcmp(index->values[i], zValue)==0 ) return index->bitmaps[i];
+  }
+  return NULL;
+}
+
+/*
+** Bitmap index cache.
+*/
+
+void graphBitmapCacheDestroy(GraphBitmapCache *pCache){
+  int i;
+  if( !pCache ) return;
+  for(i=0; i<pCache->nIndex; i++) graphDestroyBitmapIndex(pCache->apIndex[i]);
+  sqlite3_free(pCache->apIndex);
+  sqlite3_free(pCache);
+}
+
+/*
+** Return the cached bitmap index of property (labels, if NULL) in *ppIndex,
+** building it if needed. Cached indexes are dropped once this connection
+** or another one has written to the database.
+*/
+int graphGetBitmapIndex(GraphVtab *pGraph, const char *property,
+                        const BitmapIndex **ppIndex){
+  GraphBitmapCache *pCache = pGraph->pBitmapCache;
+  unsigned int iDataVersion = 0;
+  sqlite3_int64 nChanges = sqlite3_total_changes64(pGraph->pDb);
+  BitmapIndex **apNew;
+  BitmapIndex *index;
+  int i;
+
+  *ppIndex = 0;
+  sqlite3_file_control(pGraph->pDb, pGraph->zDbName, SQLITE_FCNTL_DATA_VERSION,
+                       &iDataVersion);
+  if( pCache && (pCache->nChanges!=nChanges || pCache->iDataVersion!=iDataVersion) ){
+    graphBitmapCacheDestroy(pCache);
+    pCache = pGraph->pBitmapCache = 0;
+  }
+  if( !pCache ){
+    pCache = sqlite3_malloc(sizeof(GraphBitmapCache));
+    if( !pCache ) return SQLITE_NOMEM;
+    memset(pCache, 0, sizeof(GraphBitmapCache));
+    pCache->nChanges = nChanges;
+    pCache->iDataVersion = iDataVersion;
+    pGraph->pBitmapCache = pCache;
+  }
+
+  for(i=0; i<pCache->nIndex; i++){
+    const char *z = pCache->apIndex[i]->property;
+    if( (z==0 && property==0) || (z && property && strcmp(z, property)==0) ){
+      *ppIndex = pCache->apIndex[i];
+      return SQLITE_OK;
+    }
+  }
+
+  index = graphCreateBitmapIndex(pGraph, property);
+  if( !index ) return SQLITE_ERROR;
+  apNew = sqlite3_realloc(pCache->apIndex, (pCache->nIndex+1) * sizeof(BitmapIndex*));
+  if( !apNew ){
+    graphDestroyBitmapIndex(index);
+    return SQLITE_NOMEM;
+  }
+  pCache->apIndex = apNew;
+  pCache->apIndex[pCache->nIndex++] = index;
+  *ppIndex = index;
+  return SQLITE_OK;
+}
+
+/*
+** Intersect the nodes with label zLabel (may be NULL) and, for each i,
+** property azProp[i] equal to the value whose graphBitmapKey() is
+** azValue[i]. The most selective bitmap is
+** taken first so that intermediate results stay small. On success
+** *ppResult is a new bitmap that the caller must destroy.
+*/
+int graphBitmapIntersect(GraphVtab *pGraph, const char *zLabel,
+                         const char **azProp, const char **azValue, int nProp,
+                         GraphBitmap **ppResult){
+  const GraphBitmap **apBitmap;
+  GraphBitmap *pResult = 0;
+  int nBitmap = 0;
+  int i, rc = SQLITE_OK;
+
+  *ppResult = 0;
+  apBitmap = sqlite3_malloc((nProp + 1) * sizeof(GraphBitmap*));
+  if( !apBitmap ) return SQLITE_NOMEM;
+
+  for(i=-1; i<nProp && rc==SQLITE_OK; i++){
+    const BitmapIndex *index;
+    const GraphBitmap *pBitmap;
+    if( i<0 && !zLabel ) continue;
+    rc = graphGetBitmapIndex(pGraph, i<0 ? 0 : azProp[i], &index);
+    if( rc!=SQLITE_OK ) break;
+    pBitmap = graphBitmapIndexLookup(index, i<0 ? zLabel : azValue[i]);
+    if( !pBitmap ){
+      nBitmap = 0;    /* A value no node has: the result is empty */
+      break;
+    }
+    apBitmap[nBitmap++] = pBitmap;
+  }
+
+  if( rc==SQLITE_OK ){
+    /* Smallest first */
+    for(i=1; i<nBitmap; i++){
+      const GraphBitmap *p = apBitmap[i];
+      int j = i;
+      while( j>0 && graphBitmapCount(apBitmap[j-1])>graphBitmapCount(p) ){
+        apBitmap[j] = apBitmap[j-1];
+        j--;
+      }
+      apBitmap[j] = p;
+    }
+    if( nBitmap==0 ){
+      pResult = graphBitmapCreate();
+    }else if( nBitmap==1 ){
+      pResult = graphBitmapCopy(apBitmap[0]);
+    }else{
+      pResult = graphBitmapAnd(apBitmap[0], apBitmap[1]);
+      for(i=2; pResult && i<nBitmap && pResult->nCont>0; i++){
+        GraphBitmap *pNext = graphBitmapAnd(pResult, apBitmap[i]);
+        graphBitmapDestroy(pResult);
+        pResult = pNext;
+      }
+    }
+    if( !pResult ) rc = SQLITE_NOMEM;
+  }
+  sqlite3_free(apBitmap);
+  *ppResult = pResult;
+  return rc;
+}
+
+/*
+** Bitmap index catalog and SQL functions.
+**
+** graph_create_bitmap_index(property) records property in
+** <graph>_bitmap_indexes, which tells the Cypher planner that equality
+** filters on it can be answered from bitmaps. The bitmaps themselves live
+** only in memory.
+*/
+
+/*
+** Load the properties with a bitmap index into *pazProps, an array of
+** *pnProps sqlite3_malloc'd strings.
+*/
+int graphLoadBitmapIndexes(GraphVtab *pVtab, char ***pazProps, int *pnProps){
+  sqlite3_stmt *pStmt = 0;
+  char **azProps = 0;
+  int nProps = 0;
+  char *zSql;
+  int rc, i;
+
+  *pazProps = 0;
+  *pnProps = 0;
+  if( !pVtab || !pVtab->zTableName ) return SQLITE_MISUSE;
+
+  zSql = sqlite3_mprintf("SELECT property FROM %s_bitmap_indexes ORDER BY property",
+                         pVtab->zTableName);
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0);
+  sqlite3_free(zSql);
+  if( rc!=SQLITE_OK ) return SQLITE_OK; /* No bitmap index created yet */
+
+  while( (rc = sqlite3_step(pStmt))==SQLITE_ROW ){
+    char **azNew = sqlite3_realloc(azProps, sizeof(char*) * (nProps + 1));
+    if( !azNew ){
+      rc = SQLITE_NOMEM;
+      break;
+    }
+    azProps = azNew;
+    azProps[nProps] = sqlite3_mprintf("%s", sqlite3_column_text(pStmt, 0));
+    if( !azProps[nProps] ){
+      rc = SQLITE_NOMEM;
+      break;
+    }
+    nProps++;
+  }
+  sqlite3_finalize(pStmt);
+  if( rc!=SQLITE_DONE ){
+    for(i=0; i<nProps; i++) sqlite3_free(azProps[i]);
+    sqlite3_free(azProps);
+    return rc;
+  }
+  *pazProps = azProps;
+  *pnProps = nProps;
+  return SQLITE_OK;
+}
+
+/*
+** SQL function: graph_create_bitmap_index(property)
+**               graph_drop_bitmap_index(property)
+**
+** Create fails if the property has too many distinct values. Both return 1.
+*/
+static void graphBitmapIndexFunc(sqlite3_context *pCtx, int argc,
+                                 sqlite3_value **argv){
+  GraphVtab *pGraph = getGlobalGraph();
+  const char *zProp = (const char*)sqlite3_value_text(argv[0]);
+  int bCreate = sqlite3_user_data(pCtx)!=0;
+  char *zSql;
+  int rc;
+
+  (void)argc;
+  if( !pGraph ){
+    sqlite3_result_error(pCtx, "No graph table available. Create a graph table first using: CREATE VIRTUAL TABLE mygraph USING graph();", -1);
+    return;
+  }
+  if( !graphIsIdentifier(zProp) ){
+    sqlite3_result_error(pCtx, "property must be a plain identifier", -1);
+    return;
+  }
+  if( bCreate ){
+    BitmapIndex *index = graphCreateBitmapIndex(pGraph, zProp);
+    if( !index ){
+      sqlite3_result_error(pCtx, "graph_create_bitmap_index(): property has "
+                                 "too many distinct values", -1);
+      return;
+    }
+    graphDestroyBitmapIndex(index);
+  }
+  zSql = sqlite3_mprintf(
+    "CREATE TABLE IF NOT EXISTS %s_bitmap_indexes(property TEXT PRIMARY KEY)",
+    pGraph->zTableName);
+  if( !zSql ){
+    sqlite3_result_error_nomem(pCtx);
+    return;
+  }
+  rc = sqlite3_exec(pGraph->pDb, zSql, 0, 0, 0);
+  sqlite3_free(zSql);
+  if( rc==SQLITE_OK ){
+    sqlite3_stmt *pStmt;
+    zSql = sqlite3_mprintf(bCreate
+        ? "INSERT OR IGNORE INTO %s_bitmap_indexes(property) VALUES(?1)"
+        : "DELETE FROM %s_bitmap_indexes WHERE property = ?1",
+        pGraph->zTableName);
+    rc = zSql ? sqlite3_prepare_v2(pGraph->pDb, zSql, -1, &pStmt, 0) : SQLITE_NOMEM;
+    sqlite3_free(zSql);
+    if( rc==SQLITE_OK ){
+      sqlite3_bind_text(pStmt, 1, zProp, -1, SQLITE_STATIC);
+      sqlite3_step(pStmt);
+      rc = sqlite3_finalize(pStmt);
+    }
+  }
+  if( rc!=SQLITE_OK ){
+    sqlite3_result_error(pCtx, sqlite3_errmsg(pGraph->pDb), -1);
+    sqlite3_result_error_code(pCtx, rc);
+    return;
+  }
+  sqlite3_result_int(pCtx, 1);
+}
+
+/*
+** SQL function: graph_bitmap_count(label, property, value, ...)
+**
+** Count the nodes with label (any node, if NULL) whose properties equal
+** the given values, by intersecting bitmaps. Every property must be
+** indexable: a bitmap is built for it if needed. Values match as Cypher
+** equality does: 30 matches 30.0 but not '30'.
+*/
+static void graphBitmapCountFunc(sqlite3_context *pCtx, int argc,
+                                 sqlite3_value **argv){
+  GraphVtab *pGraph = getGlobalGraph();
+  const char *zLabel;
+  const char **azArg;
+  GraphBitmap *pResult = 0;
+  int nProp, i, rc = SQLITE_OK;
+
+  if( !pGraph ){
+    sqlite3_result_error(pCtx, "No graph table available. Create a graph table first using: CREATE VIRTUAL TABLE mygraph USING graph();", -1);
+    return;
+  }
+  if( argc<1 || (argc % 2)!=1 ){
+    sqlite3_result_error(pCtx, "graph_bitmap_count(): expected a label and "
+                               "property/value pairs", -1);
+    return;
+  }
+  zLabel = (const char*)sqlite3_value_text(argv[0]);
+  nProp = (argc - 1) / 2;
+  azArg = sqlite3_malloc((nProp * 2 + 1) * sizeof(char*));
+  if( !azArg ){
+    sqlite3_result_error_nomem(pCtx);
+    return;
+  }
+  memset(azArg, 0, (nProp * 2 + 1) * sizeof(char*));
+  for(i=0; i<nProp && rc==SQLITE_OK; i++){
+    sqlite3_value *pVal = argv[2 + i*2];
+    const char *zType = 0;
+    switch( sqlite3_value_type(pVal) ){
+      case SQLITE_INTEGER: zType = "integer"; break;
+      case SQLITE_FLOAT:   zType = "real";    break;
+      case SQLITE_TEXT:    zType = "text";    break;
+    }
+    azArg[i] = (const char*)sqlite3_value_text(argv[1 + i*2]);
+    if( !graphIsIdentifier(azArg[i]) || !zType ){
+      rc = SQLITE_MISUSE;
+      break;
+    }
+    azArg[nProp + i] = graphBitmapKey(zType, (const char*)sqlite3_value_text(pVal));
+    if( !azArg[nProp + i] ) rc = SQLITE_NOMEM;
+  }
+  if( rc==SQLITE_OK ){
+    rc = graphBitmapIntersect(pGraph, zLabel, azArg, azArg + nProp, nProp, &pResult);
+  }
+  for(i=0; i<nProp; i++) sqlite3_free((char*)azArg[nProp + i]);
+  sqlite3_free(azArg);
+  if( rc==SQLITE_MISUSE ){
+    sqlite3_result_error(pCtx, "graph_bitmap_count(): properties must be "
+                               "plain identifiers and values numbers or text", -1);
+    return;
+  }
+  if( rc!=SQLITE_OK ){
+    sqlite3_result_error_code(pCtx, rc);
+    return;
+  }
+  sqlite3_result_int64(pCtx, graphBitmapCount(pResult));
+  graphBitmapDestroy(pResult);
+}
+
+/*
+** Register the bitmap index SQL functions.
+*/
+int graphRegisterBitmapFunctions(sqlite3 *pDb){
+  int rc;
+  rc = sqlite3_create_function(pDb, "graph_create_bitmap_index", 1, SQLITE_UTF8,
+                               (void*)1, graphBitmapIndexFunc, 0, 0);
+  if( rc==SQLITE_OK ){
+    rc = sqlite3_create_function(pDb, "graph_drop_bitmap_index", 1, SQLITE_UTF8,
+                                 0, graphBitmapIndexFunc, 0, 0);
+  }
+  if( rc==SQLITE_OK ){
+    rc = sqlite3_create_function(pDb, "graph_bitmap_count", -1, SQLITE_UTF8,
+                                 0, graphBitmapCountFunc, 0, 0);
+  }
+  return rc;
+}
@@ -85,6 +85,9 @@ static size_t calculatePlanSize(PhysicalPlanNode *pPlan) {
             break;
         case PHYSICAL_LABEL_INDEX_SCAN:
         case PHYSICAL_PROPERTY_INDEX_SCAN:
+        case PHYSICAL_BITMAP_SCAN:
+        case PHYSICAL_RANGE_INDEX_SCAN:
+        case PHYSICAL_FULLTEXT_SCAN:
             if (pPlan->zLabel) {
                 size += strlen(pPlan->zLabel) + 1;
             }
@@ -98,6 +101,16 @@ static size_t calculatePlanSize(PhysicalPlanNode *pPlan) {
             /* Join operators */
             size += 200; /* Estimate */
             break;
+        case PHYSICAL_EXPAND_ALL:
+        case PHYSICAL_EXPAND_INTO:
+        case PHYSICAL_VAR_LENGTH_EXPAND:
+        case PHYSICAL_SHORTEST_PATH:
+            /* Pattern operators */
+            if (pPlan->zRelType) {
+                size += strlen(pPlan->zRelType) + 1;
+            }
+            size += 100; /* Estimate */
+            break;
         case PHYSICAL_FILTER:
             /* Add expression size */
             size += 100; /* Estimate */
@@ -106,6 +119,8 @@ static size_t calculatePlanSize(PhysicalPlanNode *pPlan) {
         case PHYSICAL_SORT:
         case PHYSICAL_LIMIT:
         case PHYSICAL_AGGREGATION:
+        case PHYSICAL_DISTINCT:
+        case PHYSICAL_UNION:
             /* Other operators */
             size += 100; /* Estimate */
             break;
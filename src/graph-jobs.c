@@ -0,0 +1,511 @@
+/*
+** SQLite Graph Database Extension - Asynchronous Algorithm Jobs
+**
+** Long-running graph algorithms (PageRank, Dijkstra, SCC, traversals)
+** normally run on the connection that owns the graph virtual table, so a
+** single expensive call blocks every other statement on that connection.
+** This file lets such algorithms run off-thread instead:
+**
+**   SELECT graph_job_submit('pagerank', 0.85, 100, 0.0001);  -> job id
+**   SELECT graph_job_status(1);       -> 'pending'|'running'|'done'|'error'
+**   SELECT graph_job_result(1);       -> JSON result, NULL while running
+**   SELECT graph_job_result(1, 1);    -> blocks until the job finishes
+**
+** Each job opens its own read-only connection on the database file that
+** holds the graph and runs the algorithm inside a single read transaction
+** on a worker thread owned by this file. In WAL mode the job
+** therefore sees a consistent snapshot and never blocks writers; in
+** rollback-journal mode it holds a shared lock for the duration of the job.
+** Changes not yet committed on the submitting connection are not visible
+** to the job. In-memory and temporary databases cannot be shared across
+** connections and are rejected at submit time.
+**
+** Memory allocation: All functions use sqlite3_malloc()/sqlite3_free()
+** Error handling: Functions return SQLite error codes (SQLITE_OK, etc.)
+** Thread safety: The job registry is protected by g_jobs.mutex
+*/
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE  /* dladdr() */
+#endif
+#include "sqlite3ext.h"
+#ifndef SQLITE_CORE
+extern const sqlite3_api_routines *sqlite3_api;
+#endif
+/* SQLITE_EXTENSION_INIT1 - removed to prevent multiple definition */
+#include <string.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include "graph.h"
+
+/* Macro to suppress unused parameter warnings */
+#ifndef UNUSED
+#define UNUSED(x) ((void)(x))
+#endif
+
+/*
+** Algorithms that can be run as background jobs.
+*/
+#define GRAPH_JOB_PAGERANK       1
+#define GRAPH_JOB_SHORTEST_PATH  2
+#define GRAPH_JOB_BFS            3
+#define GRAPH_JOB_DFS            4
+#define GRAPH_JOB_SCC            5
+
+/*
+** Job life cycle states.
+*/
+#define GRAPH_JOB_PENDING  0
+#define GRAPH_JOB_RUNNING  1
+#define GRAPH_JOB_DONE     2
+#define GRAPH_JOB_ERROR    3
+
+/*
+** Most worker threads running jobs at once. Further jobs wait in the
+** registry until a worker is free.
+*/
+#define GRAPH_JOB_MAX_WORKERS  4
+
+/*
+** A submitted algorithm run. All fields except eState, zResult and
+** zErrMsg are immutable once the job is queued, so the worker may read
+** them without holding g_jobs.mutex.
+*/
+typedef struct GraphJob GraphJob;
+struct GraphJob {
+  sqlite3_int64 iJobId;     /* Handle returned by graph_job_submit() */
+  int eAlgorithm;           /* One of the GRAPH_JOB_* algorithm codes */
+  int eState;               /* GRAPH_JOB_PENDING, RUNNING, DONE or ERROR */
+  char *zDbFile;            /* Database file holding the graph tables */
+  char *zTableName;         /* Graph virtual table name */
+  char *zNodeTable;         /* Backing nodes table of the graph */
+  char *zEdgeTable;         /* Backing edges table of the graph */
+  double rDamping;          /* PageRank damping factor */
+  int nMaxIter;             /* PageRank iteration limit */
+  double rEpsilon;          /* PageRank convergence threshold */
+  sqlite3_int64 iStartId;   /* Start node for paths and traversals */
+  sqlite3_int64 iEndId;     /* End node for shortest_path */
+  int nMaxDepth;            /* Traversal depth limit (-1 for unlimited) */
+  char *zResult;            /* JSON result once eState==GRAPH_JOB_DONE */
+  char *zErrMsg;            /* Error text once eState==GRAPH_JOB_ERROR */
+  GraphJob *pNext;          /* Next job in g_jobs.pJobs */
+};
+
+/*
+** Process-wide job registry. Jobs outlive the statement that submitted
+** them and may be collected from any connection that loaded the extension.
+*/
+static struct {
+  pthread_mutex_t mutex;        /* Protects everything below */
+  pthread_cond_t jobDone;       /* Signalled whenever a job finishes */
+  int nWorkers;                 /* Worker threads currently alive */
+  GraphJob *pJobs;              /* All jobs not yet collected, newest first */
+  sqlite3_int64 iNextJobId;     /* Next handle to hand out */
+} g_jobs = {
+  PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, 1
+};
+
+static void graphJobFree(GraphJob *pJob){
+  if( pJob ){
+    sqlite3_free(pJob->zDbFile);
+    sqlite3_free(pJob->zTableName);
+    sqlite3_free(pJob->zNodeTable);
+    sqlite3_free(pJob->zEdgeTable);
+    sqlite3_free(pJob->zResult);
+    sqlite3_free(pJob->zErrMsg);
+    sqlite3_free(pJob);
+  }
+}
+
+/*
+** Find a job by handle. Caller must hold g_jobs.mutex.
+*/
+static GraphJob *graphJobFind(sqlite3_int64 iJobId){
+  GraphJob *pJob;
+  for( pJob=g_jobs.pJobs; pJob; pJob=pJob->pNext ){
+    if( pJob->iJobId==iJobId ) return pJob;
+  }
+  return 0;
+}
+
+/*
+** Unlink and free a job. Caller must hold g_jobs.mutex.
+*/
+static void graphJobRemove(GraphJob *pJob){
+  GraphJob **pp;
+  for( pp=&g_jobs.pJobs; *pp; pp=&(*pp)->pNext ){
+    if( *pp==pJob ){
+      *pp = pJob->pNext;
+      break;
+    }
+  }
+  graphJobFree(pJob);
+}
+
+/*
+** Run the job's algorithm against a private graph handle. The handle
+** shares nothing with the submitting connection except the table names,
+** so the algorithm code in graph-algo.c and graph-traverse.c can be used
+** unchanged.
+*/
+static int graphJobExecute(GraphJob *pJob, sqlite3 *pDb, char **pzResult){
+  GraphVtab sGraph;
+
+  memset(&sGraph, 0, sizeof(sGraph));
+  sGraph.pDb = pDb;
+  sGraph.zDbName = "main";
+  sGraph.zTableName = pJob->zTableName;
+  sGraph.zNodeTableName = pJob->zNodeTable;
+  sGraph.zEdgeTableName = pJob->zEdgeTable;
+
+  switch( pJob->eAlgorithm ){
+    case GRAPH_JOB_PAGERANK:
+      return graphPageRank(&sGraph, pJob->rDamping, pJob->nMaxIter,
+                           pJob->rEpsilon, pzResult);
+    case GRAPH_JOB_SHORTEST_PATH:
+      return graphDijkstra(&sGraph, pJob->iStartId, pJob->iEndId,
+                           pzResult, 0);
+    case GRAPH_JOB_BFS:
+      return graphBFS(&sGraph, pJob->iStartId, pJob->nMaxDepth, pzResult);
+    case GRAPH_JOB_DFS:
+      return graphDFS(&sGraph, pJob->iStartId, pJob->nMaxDepth, pzResult);
+    case GRAPH_JOB_SCC:
+      return graphStronglyConnectedComponents(&sGraph, pzResult);
+  }
+  return SQLITE_MISUSE;
+}
+
+/*
+** Run one job: open a read-only connection, pin a read snapshot with
+** BEGIN plus a first read, run the algorithm and record the outcome in
+** the registry.
+*/
+static void graphJobRun(GraphJob *pJob){
+  sqlite3 *pDb = 0;
+  char *zResult = 0;
+  char *zErrMsg = 0;
+  int rc;
+
+  rc = sqlite3_open_v2(pJob->zDbFile, &pDb,
+                       SQLITE_OPEN_READONLY|SQLITE_OPEN_NOMUTEX, 0);
+  if( rc==SQLITE_OK ){
+    sqlite3_busy_timeout(pDb, 5000);
+    rc = sqlite3_exec(pDb, "BEGIN; SELECT count(*) FROM sqlite_master",
+                      0, 0, 0);
+  }
+  if( rc==SQLITE_OK ){
+    rc = graphJobExecute(pJob, pDb, &zResult);
+    /* Keep the error of the failed statement, which COMMIT would clear */
+    if( rc!=SQLITE_OK && sqlite3_errcode(pDb)!=SQLITE_OK ){
+      zErrMsg = sqlite3_mprintf("%s", sqlite3_errmsg(pDb));
+    }
+    sqlite3_exec(pDb, "COMMIT", 0, 0, 0);
+  }
+  if( rc!=SQLITE_OK ){
+    if( zErrMsg==0 ){
+      zErrMsg = sqlite3_mprintf("%s", pDb && sqlite3_errcode(pDb)!=SQLITE_OK ?
+                                      sqlite3_errmsg(pDb) : sqlite3_errstr(rc));
+    }
+    sqlite3_free(zResult);
+    zResult = 0;
+  }
+  sqlite3_close(pDb);
+
+  pthread_mutex_lock(&g_jobs.mutex);
+  pJob->zResult = zResult;
+  pJob->zErrMsg = zErrMsg;
+  pJob->eState = rc==SQLITE_OK ? GRAPH_JOB_DONE : GRAPH_JOB_ERROR;
+  pthread_cond_broadcast(&g_jobs.jobDone);
+  pthread_mutex_unlock(&g_jobs.mutex);
+}
+
+/*
+** Return the oldest job still waiting for a worker, or NULL. Caller must
+** hold g_jobs.mutex.
+*/
+static GraphJob *graphJobNextPending(void){
+  GraphJob *pJob;
+  GraphJob *pOldest = 0;
+  for( pJob=g_jobs.pJobs; pJob; pJob=pJob->pNext ){
+    if( pJob->eState==GRAPH_JOB_PENDING ) pOldest = pJob;
+  }
+  return pOldest;
+}
+
+/*
+** Worker thread main function. Runs pending jobs oldest first and exits
+** once none are left.
+*/
+static void *graphJobWorker(void *pArg){
+  GraphJob *pJob;
+
+  UNUSED(pArg);
+  pthread_mutex_lock(&g_jobs.mutex);
+  while( (pJob = graphJobNextPending())!=0 ){
+    pJob->eState = GRAPH_JOB_RUNNING;
+    pthread_mutex_unlock(&g_jobs.mutex);
+    graphJobRun(pJob);
+    pthread_mutex_lock(&g_jobs.mutex);
+  }
+  g_jobs.nWorkers--;
+  pthread_mutex_unlock(&g_jobs.mutex);
+  return 0;
+}
+
+/*
+** SQLite unloads the extension library when the last connection that
+** loaded it closes, which may happen while a worker is still running its
+** code. Once a worker has been started the library stays loaded for the
+** life of the process. Caller must hold g_jobs.mutex.
+*/
+static void graphJobPinLibrary(void){
+#ifndef SQLITE_CORE
+  static int bPinned = 0;
+  Dl_info info;
+
+  if( bPinned ) return;
+  if( dladdr((void*)graphJobWorker, &info) && info.dli_fname ){
+    dlopen(info.dli_fname, RTLD_NOW|RTLD_NODELETE);
+  }
+  bPinned = 1;
+#endif
+}
+
+/*
+** Make sure a worker will pick up a newly queued job. Caller must hold
+** g_jobs.mutex. Jobs have worker threads of their own, detached so that
+** nothing ever has to join them: a pool shared with graph-parallel.c
+** could be torn down under a queued job, which would then never finish.
+*/
+static int graphJobSchedule(void){
+  pthread_attr_t attr;
+  pthread_t thread;
+  int rc;
+
+  if( g_jobs.nWorkers>=GRAPH_JOB_MAX_WORKERS ) return SQLITE_OK;
+  graphJobPinLibrary();
+  if( pthread_attr_init(&attr)!=0 ) return SQLITE_NOMEM;
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  rc = pthread_create(&thread, &attr, graphJobWorker, 0);
+  pthread_attr_destroy(&attr);
+  if( rc!=0 ){
+    /* A running worker still reaches the job before it exits */
+    return g_jobs.nWorkers>0 ? SQLITE_OK : SQLITE_ERROR;
+  }
+  g_jobs.nWorkers++;
+  return SQLITE_OK;
+}
+
+/*
+** Map an algorithm name to its GRAPH_JOB_* code, or 0 if unknown.
+*/
+static int graphJobAlgorithm(const char *zName){
+  static const struct {
+    const char *zName;
+    int eAlgorithm;
+  } aAlgo[] = {
+    { "pagerank",                      GRAPH_JOB_PAGERANK },
+    { "shortest_path",                 GRAPH_JOB_SHORTEST_PATH },
+    { "bfs",                           GRAPH_JOB_BFS },
+    { "dfs",                           GRAPH_JOB_DFS },
+    { "strongly_connected_components", GRAPH_JOB_SCC },
+  };
+  int i;
+  if( zName==0 ) return 0;
+  for( i=0; i<(int)(sizeof(aAlgo)/sizeof(aAlgo[0])); i++ ){
+    if( sqlite3_stricmp(zName, aAlgo[i].zName)==0 ) return aAlgo[i].eAlgorithm;
+  }
+  return 0;
+}
+
+/*
+** SQL function: graph_job_submit(algorithm, ...)
+** Queues an algorithm for a worker thread and returns its job id.
+** Usage:
+**   SELECT graph_job_submit('pagerank' [, damping, max_iter, epsilon]);
+**   SELECT graph_job_submit('shortest_path', start_id, end_id);
+**   SELECT graph_job_submit('bfs', start_id [, max_depth]);
+**   SELECT graph_job_submit('dfs', start_id [, max_depth]);
+**   SELECT graph_job_submit('strongly_connected_components');
+*/
+static void graphJobSubmitFunc(sqlite3_context *pCtx, int argc,
+                               sqlite3_value **argv){
+  GraphVtab *pVtab = getGlobalGraph();
+  GraphJob *pJob;
+  const char *zFile;
+  int eAlgorithm;
+  int rc;
+
+  if( argc<1 ){
+    sqlite3_result_error(pCtx, "graph_job_submit() requires an algorithm name", -1);
+    return;
+  }
+  if( pVtab==0 ){
+    sqlite3_result_error(pCtx, "No graph table available. Create a graph table first using: CREATE VIRTUAL TABLE mygraph USING graph();", -1);
+    return;
+  }
+
+  eAlgorithm = graphJobAlgorithm((const char*)sqlite3_value_text(argv[0]));
+  if( eAlgorithm==0 ){
+    sqlite3_result_error(pCtx, "graph_job_submit(): unknown algorithm", -1);
+    return;
+  }
+
+  zFile = sqlite3_db_filename(pVtab->pDb, pVtab->zDbName ? pVtab->zDbName : "main");
+  if( zFile==0 || zFile[0]==0 ){
+    sqlite3_result_error(pCtx, "graph_job_submit() requires a file-backed database", -1);
+    return;
+  }
+
+  pJob = sqlite3_malloc(sizeof(GraphJob));
+  if( pJob==0 ){
+    sqlite3_result_error_nomem(pCtx);
+    return;
+  }
+  memset(pJob, 0, sizeof(GraphJob));
+  pJob->eAlgorithm = eAlgorithm;
+  pJob->eState = GRAPH_JOB_PENDING;
+  pJob->rDamping = 0.85;
+  pJob->nMaxIter = 100;
+  pJob->rEpsilon = 0.0001;
+  pJob->nMaxDepth = -1;
+  pJob->zDbFile = sqlite3_mprintf("%s", zFile);
+  pJob->zTableName = sqlite3_mprintf("%s", pVtab->zTableName);
+  /* Backing tables as given to CREATE VIRTUAL TABLE ... USING graph() */
+  pJob->zNodeTable = sqlite3_mprintf("%s", pVtab->zNodeTableName);
+  pJob->zEdgeTable = sqlite3_mprintf("%s", pVtab->zEdgeTableName);
+  if( pJob->zDbFile==0 || pJob->zTableName==0
+   || pJob->zNodeTable==0 || pJob->zEdgeTable==0 ){
+    graphJobFree(pJob);
+    sqlite3_result_error_nomem(pCtx);
+    return;
+  }
+
+  switch( eAlgorithm ){
+    case GRAPH_JOB_PAGERANK:
+      if( argc>=2 ) pJob->rDamping = sqlite3_value_double(argv[1]);
+      if( argc>=3 ) pJob->nMaxIter = sqlite3_value_int(argv[2]);
+      if( argc>=4 ) pJob->rEpsilon = sqlite3_value_double(argv[3]);
+      if( pJob->rDamping<0.0 || pJob->rDamping>1.0
+       || pJob->nMaxIter<1 || pJob->rEpsilon<=0.0 ){
+        graphJobFree(pJob);
+        sqlite3_result_error(pCtx, "graph_job_submit(): invalid pagerank parameters", -1);
+        return;
+      }
+      break;
+    case GRAPH_JOB_SHORTEST_PATH:
+      if( argc!=3 ){
+        graphJobFree(pJob);
+        sqlite3_result_error(pCtx, "graph_job_submit('shortest_path') requires start and end node ids", -1);
+        return;
+      }
+      pJob->iStartId = sqlite3_value_int64(argv[1]);
+      pJob->iEndId = sqlite3_value_int64(argv[2]);
+      break;
+    case GRAPH_JOB_BFS:
+    case GRAPH_JOB_DFS:
+      if( argc<2 ){
+        graphJobFree(pJob);
+        sqlite3_result_error(pCtx, "graph_job_submit(): traversal requires a start node id", -1);
+        return;
+      }
+      pJob->iStartId = sqlite3_value_int64(argv[1]);
+      if( argc>=3 ) pJob->nMaxDepth = sqlite3_value_int(argv[2]);
+      break;
+    default:
+      break;
+  }
+
+  pthread_mutex_lock(&g_jobs.mutex);
+  pJob->iJobId = g_jobs.iNextJobId++;
+  pJob->pNext = g_jobs.pJobs;
+  g_jobs.pJobs = pJob;
+  rc = graphJobSchedule();
+  if( rc!=SQLITE_OK ){
+    graphJobRemove(pJob);
+    pthread_mutex_unlock(&g_jobs.mutex);
+    sqlite3_result_error_code(pCtx, rc);
+    return;
+  }
+  sqlite3_result_int64(pCtx, pJob->iJobId);
+  pthread_mutex_unlock(&g_jobs.mutex);
+}
+
+/*
+** SQL function: graph_job_status(job_id)
+** Returns 'pending', 'running', 'done' or 'error', or NULL if the job id
+** is unknown or its result has already been collected.
+*/
+static void graphJobStatusFunc(sqlite3_context *pCtx, int argc,
+                               sqlite3_value **argv){
+  static const char *azState[] = { "pending", "running", "done", "error" };
+  GraphJob *pJob;
+
+  UNUSED(argc);
+  pthread_mutex_lock(&g_jobs.mutex);
+  pJob = graphJobFind(sqlite3_value_int64(argv[0]));
+  if( pJob ){
+    sqlite3_result_text(pCtx, azState[pJob->eState], -1, SQLITE_STATIC);
+  }else{
+    sqlite3_result_null(pCtx);
+  }
+  pthread_mutex_unlock(&g_jobs.mutex);
+}
+
+/*
+** SQL function: graph_job_result(job_id [, wait])
+** Returns the JSON result of a finished job and releases it. Returns NULL
+** while the job is still pending or running, unless wait is non-zero in
+** which case the call blocks until the job completes. A failed job raises
+** its error message, and is released as well.
+*/
+static void graphJobResultFunc(sqlite3_context *pCtx, int argc,
+                               sqlite3_value **argv){
+  sqlite3_int64 iJobId = sqlite3_value_int64(argv[0]);
+  int bWait = argc>=2 ? sqlite3_value_int(argv[1]) : 0;
+  GraphJob *pJob;
+
+  pthread_mutex_lock(&g_jobs.mutex);
+  pJob = graphJobFind(iJobId);
+  while( bWait && pJob
+      && (pJob->eState==GRAPH_JOB_PENDING || pJob->eState==GRAPH_JOB_RUNNING) ){
+    pthread_cond_wait(&g_jobs.jobDone, &g_jobs.mutex);
+    pJob = graphJobFind(iJobId);
+  }
+
+  if( pJob==0 ){
+    sqlite3_result_error(pCtx, "graph_job_result(): unknown job id", -1);
+  }else if( pJob->eState==GRAPH_JOB_DONE ){
+    sqlite3_result_text(pCtx, pJob->zResult, -1, sqlite3_free);
+    pJob->zResult = 0;
+    graphJobRemove(pJob);
+  }else if( pJob->eState==GRAPH_JOB_ERROR ){
+    sqlite3_result_error(pCtx, pJob->zErrMsg ? pJob->zErrMsg : "graph job failed", -1);
+    graphJobRemove(pJob);
+  }else{
+    sqlite3_result_null(pCtx);
+  }
+  pthread_mutex_unlock(&g_jobs.mutex);
+}
+
+/*
+** Register the job SQL functions. Called from sqlite3_graph_init().
+*/
+int graphRegisterJobFunctions(sqlite3 *pDb){
+  int rc;
+
+  rc = sqlite3_create_function(pDb, "graph_job_submit", -1, SQLITE_UTF8, 0,
+                               graphJobSubmitFunc, 0, 0);
+  if( rc!=SQLITE_OK ) return rc;
+
+  rc = sqlite3_create_function(pDb, "graph_job_status", 1, SQLITE_UTF8, 0,
+                               graphJobStatusFunc, 0, 0);
+  if( rc!=SQLITE_OK ) return rc;
+
+  rc = sqlite3_create_function(pDb, "graph_job_result", 1, SQLITE_UTF8, 0,
+                               graphJobResultFunc, 0, 0);
+  if( rc!=SQLITE_OK ) return rc;
+
+  return sqlite3_create_function(pDb, "graph_job_result", 2, SQLITE_UTF8, 0,
+                                 graphJobResultFunc, 0, 0);
+}
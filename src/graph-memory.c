@@ -288,6 +288,8 @@ void graph_cursor_destroy(GraphCursor *cursor) {
   if (cursor->pEdgeStmt) {
     sqlite3_finalize(cursor->pEdgeStmt);
   }
+  sqlite3_finalize(cursor->pNodePropStmt);
+  sqlite3_finalize(cursor->pEdgePropStmt);
   
   sqlite3_free(cursor);
 }
@@ -101,13 +101,16 @@ SelectivityEstimate graphEstimateSelectivity(GraphVtab *pGraph,
     if (zLabel) {
         /* Estimate based on label index statistics */
         int labelCount = 0;
-        zSql = sqlite3_mprintf("SELECT count(*) FROM %s_nodes WHERE labels LIKE '%%\"%s\"%%'", pGraph->zTableName, zLabel);
-        rc = sqlite3_prepare_v2(pGraph->pDb, zSql, -1, &pStmt, 0);
-        sqlite3_free(zSql);
-        if( rc==SQLITE_OK && sqlite3_step(pStmt)==SQLITE_ROW ){
-          labelCount = sqlite3_column_int(pStmt, 0);
+        sqlite3_int64 iLabelId = 0;
+        if( graphLookupLabelId(pGraph, zLabel, &iLabelId)==SQLITE_OK && iLabelId ){
+          zSql = sqlite3_mprintf("SELECT count(*) FROM %s_label_index WHERE label_id = %lld", pGraph->zTableName, iLabelId);
+          rc = sqlite3_prepare_v2(pGraph->pDb, zSql, -1, &pStmt, 0);
+          sqlite3_free(zSql);
+          if( rc==SQLITE_OK && sqlite3_step(pStmt)==SQLITE_ROW ){
+            labelCount = sqlite3_column_int(pStmt, 0);
+          }
+          sqlite3_finalize(pStmt);
         }
-        sqlite3_finalize(pStmt);
 
         if (totalNodes > 0) {
             estimate.selectivity = (double)labelCount / totalNodes;
@@ -382,48 +385,95 @@ void graphEndMetrics(PerfMetrics *metrics) {
 */
 
 /*
-** Create composite index
+** Create composite index over properties, in order, for nodes with label
+** (NULL for all nodes). The index is a SQLite index on the extracted
+** property values, created through graphCreatePropertyIndex() so that the
+** Cypher planner can use it. Returns NULL on error.
 */
 CompositeIndex* graphCreateCompositeIndex(GraphVtab *pGraph,
+                                         const char *label,
                                          const char **properties,
                                          int nProperties) {
-    CompositeIndex *index = sqlite3_malloc(sizeof(CompositeIndex));
-    if (!index) return NULL;
+    if (!pGraph || !properties || nProperties <= 0) return NULL;
+    if (label && !label[0]) label = NULL;
     
-    /* Initialize composite index with graph reference - implicit via context */
-    (void)pGraph; /* Graph reference maintained through calling context */
-    
-    /* Build index name */
-    char name[256] = "idx_composite_";
+    /* The catalog spells a composite index as a property list */
+    char *zList = NULL;
     for (int i = 0; i < nProperties; i++) {
-        if (i > 0) strcat(name, "_");
-        strcat(name, properties[i]);
+        zList = sqlite3_mprintf("%z%s%s", zList, i ? "," : "", properties[i]);
+        if (!zList) return NULL;
     }
     
-    index->indexName = sqlite3_mprintf("%s", name);
-    index->nProperties = nProperties;
-    index->properties = sqlite3_malloc(nProperties * sizeof(char*));
+    int rc = graphCreatePropertyIndex(pGraph, label, zList);
+    if (rc != SQLITE_OK) {
+        sqlite3_free(zList);
+        return NULL;
+    }
     
-    if (!index->properties) {
-        sqlite3_free(index->indexName);
-        sqlite3_free(index);
+    CompositeIndex *index = sqlite3_malloc(sizeof(CompositeIndex));
+    if (!index) {
+        sqlite3_free(zList);
+        return NULL;
+    }
+    memset(index, 0, sizeof(CompositeIndex));
+    
+    index->indexName = graphPropertyIndexName(pGraph, label, zList);
+    sqlite3_free(zList);
+    index->label = label ? sqlite3_mprintf("%s", label) : NULL;
+    index->properties = sqlite3_malloc(nProperties * sizeof(char*));
+    if (!index->indexName || (label && !index->label) || !index->properties) {
+        graphDestroyCompositeIndex(index);
         return NULL;
     }
     
     /* Copy property names */
+    index->nProperties = nProperties;
     for (int i = 0; i < nProperties; i++) {
         index->properties[i] = sqlite3_mprintf("%s", properties[i]);
     }
     
-    /* B-tree index structure implementation */
-    /* For Phase 1/2, we use simple in-memory structures */
-    /* Full B-tree implementation would be added in later phases */
-    index->btree = NULL;  /* Would point to B-tree root */
-    index->nEntries = 0;  /* Would track number of indexed entries */
+    /* Count the nodes the index covers */
+    char *zSql;
+    if (label) {
+        zSql = sqlite3_mprintf(
+            "SELECT count(*) FROM %s_label_index "
+            "WHERE label_id = (SELECT id FROM %s_labels WHERE name = %Q)",
+            pGraph->zTableName, pGraph->zTableName, label);
+    } else {
+        zSql = sqlite3_mprintf("SELECT count(*) FROM %s_nodes", pGraph->zTableName);
+    }
+    if (zSql) {
+        sqlite3_stmt *pStmt;
+        if (sqlite3_prepare_v2(pGraph->pDb, zSql, -1, &pStmt, NULL) == SQLITE_OK) {
+            if (sqlite3_step(pStmt) == SQLITE_ROW) {
+                index->nEntries = sqlite3_column_int64(pStmt, 0);
+            }
+            sqlite3_finalize(pStmt);
+        }
+        sqlite3_free(zSql);
+    }
     
     return index;
 }
 
+/*
+** Free a CompositeIndex. The SQLite index itself is left in place; use
+** graphDropPropertyIndex() to remove it.
+*/
+void graphDestroyCompositeIndex(CompositeIndex *index) {
+    if (!index) return;
+    
+    if (index->properties) {
+        for (int i = 0; i < index->nProperties; i++) {
+            sqlite3_free(index->properties[i]);
+        }
+        sqlite3_free(index->properties);
+    }
+    sqlite3_free(index->label);
+    sqlite3_free(index->indexName);
+    sqlite3_free(index);
+}
+
 /*
 ** Convert graph to Compressed Sparse Row format
 */
@@ -68,11 +68,16 @@ int graphInitSchema(GraphVtab *pVtab) {
   
   /* Initialize with small capacity, will grow as needed */
   pSchema->azNodeLabels = sqlite3_malloc(sizeof(char*) * 16);
+  pSchema->aiNodeLabelIds = sqlite3_malloc(sizeof(sqlite3_int64) * 16);
   pSchema->azRelTypes = sqlite3_malloc(sizeof(char*) * 16);
+  pSchema->aiRelTypeIds = sqlite3_malloc(sizeof(sqlite3_int64) * 16);
   
-  if( !pSchema->azNodeLabels || !pSchema->azRelTypes ) {
+  if( !pSchema->azNodeLabels || !pSchema->aiNodeLabelIds
+   || !pSchema->azRelTypes || !pSchema->aiRelTypeIds ) {
     sqlite3_free(pSchema->azNodeLabels);
+    sqlite3_free(pSchema->aiNodeLabelIds);
     sqlite3_free(pSchema->azRelTypes);
+    sqlite3_free(pSchema->aiRelTypeIds);
     sqlite3_free(pSchema);
     return SQLITE_NOMEM;
   }
@@ -95,6 +100,7 @@ void graphDestroySchema(CypherSchema *pSchema) {
     }
     sqlite3_free(pSchema->azNodeLabels);
   }
+  sqlite3_free(pSchema->aiNodeLabelIds);
   
   /* Free relationship types */
   if( pSchema->azRelTypes ) {
@@ -103,6 +109,7 @@ void graphDestroySchema(CypherSchema *pSchema) {
     }
     sqlite3_free(pSchema->azRelTypes);
   }
+  sqlite3_free(pSchema->aiRelTypeIds);
   
   /* Free property schemas */
   GraphPropertySchema *pProp = pSchema->pPropSchema;
@@ -140,18 +147,23 @@ int graphRegisterLabel(CypherSchema *pSchema, const char *zLabel) {
     }
   }
   
-  /* Grow array if needed (double when full) */
+  /* Grow arrays if needed (double when full) */
   if( pSchema->nNodeLabels >= 16 && (pSchema->nNodeLabels & (pSchema->nNodeLabels - 1)) == 0 ) {
     char **azNew = sqlite3_realloc(pSchema->azNodeLabels, 
                                    sizeof(char*) * pSchema->nNodeLabels * 2);
     if( !azNew ) return SQLITE_NOMEM;
     pSchema->azNodeLabels = azNew;
+    sqlite3_int64 *aiNew = sqlite3_realloc(pSchema->aiNodeLabelIds,
+                               sizeof(sqlite3_int64) * pSchema->nNodeLabels * 2);
+    if( !aiNew ) return SQLITE_NOMEM;
+    pSchema->aiNodeLabelIds = aiNew;
   }
   
-  /* Add new label */
+  /* Add new label, not yet interned */
   char *zLabelCopy = sqlite3_mprintf("%s", zLabel);
   if( !zLabelCopy ) return SQLITE_NOMEM;
   
+  pSchema->aiNodeLabelIds[pSchema->nNodeLabels] = 0;
   pSchema->azNodeLabels[pSchema->nNodeLabels++] = zLabelCopy;
   return SQLITE_OK;
 }
@@ -176,73 +188,1390 @@ int graphRegisterRelationshipType(CypherSchema *pSchema, const char *zType) {
                                    sizeof(char*) * pSchema->nRelTypes * 2);
     if( !azNew ) return SQLITE_NOMEM;
     pSchema->azRelTypes = azNew;
+    sqlite3_int64 *aiNew = sqlite3_realloc(pSchema->aiRelTypeIds,
+                               sizeof(sqlite3_int64) * pSchema->nRelTypes * 2);
+    if( !aiNew ) return SQLITE_NOMEM;
+    pSchema->aiRelTypeIds = aiNew;
   }
   
-  /* Add new type */
+  /* Add new type, not yet interned */
   char *zTypeCopy = sqlite3_mprintf("%s", zType);
   if( !zTypeCopy ) return SQLITE_NOMEM;
   
+  pSchema->aiRelTypeIds[pSchema->nRelTypes] = 0;
   pSchema->azRelTypes[pSchema->nRelTypes++] = zTypeCopy;
   return SQLITE_OK;
 }
 
+/*
+** Label index.
+**
+** Label names are interned into <graph>_labels(id, name) and every
+** (label, node) pair is stored in <graph>_label_index, a WITHOUT ROWID
+** table whose primary key is (label_id, node_id). Finding the nodes with
+** a label is then a range scan on that key instead of a LIKE over the
+** labels column of every node.
+**
+** Triggers on the node table keep the index in step with every write
+** path: the vtab, the graph_* SQL functions, the Cypher engine and plain
+** SQL against the backing table alike.
+*/
+
+/*
+** Intern the labels of node row R and index the node under each of them.
+*/
+#define GRAPH_LABEL_INDEX_INSERT(R) \
+  "INSERT OR IGNORE INTO %s_labels(name) SELECT j.value " \
+  "FROM json_each(" GRAPH_LABELS_JSON(R) ") AS j " \
+  "WHERE j.type='text' AND j.value<>'';" \
+  "INSERT OR IGNORE INTO %s_label_index(label_id, node_id) " \
+  "SELECT l.id, " R ".id FROM json_each(" GRAPH_LABELS_JSON(R) ") AS j " \
+  "JOIN %s_labels AS l ON l.name=j.value WHERE j.type='text';"
+
+/*
+** Repopulate the label index from the node table.
+*/
+static int graphFillLabelIndex(GraphVtab *pVtab) {
+  const char *zGraph = pVtab->zTableName;
+  const char *zNodes = pVtab->zNodeTableName;
+  char *zSql;
+  int rc;
+
+  zSql = sqlite3_mprintf(
+    "DELETE FROM %s_label_index;"
+    "INSERT OR IGNORE INTO %s_labels(name) SELECT DISTINCT j.value "
+    "FROM %s AS n, json_each(" GRAPH_LABELS_JSON("n") ") AS j "
+    "WHERE j.type='text' AND j.value<>'';"
+    "INSERT OR IGNORE INTO %s_label_index(label_id, node_id) "
+    "SELECT l.id, n.id FROM %s AS n, json_each(" GRAPH_LABELS_JSON("n") ") AS j "
+    "JOIN %s_labels AS l ON l.name=j.value WHERE j.type='text';",
+    zGraph, zGraph, zNodes, zGraph, zNodes, zGraph
+  );
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_exec(pVtab->pDb, zSql, 0, 0, 0);
+  sqlite3_free(zSql);
+  return rc;
+}
+
+/*
+** Create the label tables and the node table triggers that maintain
+** them. A node table that already holds data when the triggers are first
+** installed is indexed in full.
+** Returns SQLITE_OK on success.
+*/
+int graphInitLabelIndex(GraphVtab *pVtab) {
+  const char *zGraph;
+  const char *zNodes;
+  sqlite3_stmt *pStmt = 0;
+  char *zSql;
+  int bExists = 0;
+  int rc;
+
+  if( !pVtab || !pVtab->zTableName ) return SQLITE_MISUSE;
+  zGraph = pVtab->zTableName;
+  zNodes = pVtab->zNodeTableName;
+  if( !zNodes ) return SQLITE_MISUSE;
+
+  zSql = sqlite3_mprintf(
+    "CREATE TABLE IF NOT EXISTS %s_labels("
+    "id INTEGER PRIMARY KEY, name TEXT NOT NULL UNIQUE);"
+    "CREATE TABLE IF NOT EXISTS %s_label_index("
+    "label_id INTEGER NOT NULL, node_id INTEGER NOT NULL, "
+    "PRIMARY KEY(label_id, node_id)) WITHOUT ROWID;"
+    "CREATE INDEX IF NOT EXISTS %s_label_index_node "
+    "ON %s_label_index(node_id);",
+    zGraph, zGraph, zGraph, zGraph
+  );
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_exec(pVtab->pDb, zSql, 0, 0, 0);
+  sqlite3_free(zSql);
+  if( rc!=SQLITE_OK ) return rc;
+
+  zSql = sqlite3_mprintf(
+    "SELECT 1 FROM sqlite_master WHERE type='trigger' AND name='%q_labels_ai'",
+    zGraph
+  );
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0);
+  sqlite3_free(zSql);
+  if( rc!=SQLITE_OK ) return rc;
+  bExists = sqlite3_step(pStmt)==SQLITE_ROW;
+  sqlite3_finalize(pStmt);
+  if( bExists ) return SQLITE_OK;
+
+  /* The insert trigger clears the node's old entries first so that
+  ** INSERT OR REPLACE works without recursive triggers enabled. */
+  zSql = sqlite3_mprintf(
+    "CREATE TRIGGER IF NOT EXISTS %s_labels_ai AFTER INSERT ON %s BEGIN "
+    "DELETE FROM %s_label_index WHERE node_id=NEW.id;"
+    GRAPH_LABEL_INDEX_INSERT("NEW")
+    "END;"
+    "CREATE TRIGGER IF NOT EXISTS %s_labels_au "
+    "AFTER UPDATE OF id, labels ON %s BEGIN "
+    "DELETE FROM %s_label_index WHERE node_id=OLD.id;"
+    GRAPH_LABEL_INDEX_INSERT("NEW")
+    "END;"
+    "CREATE TRIGGER IF NOT EXISTS %s_labels_ad AFTER DELETE ON %s BEGIN "
+    "DELETE FROM %s_label_index WHERE node_id=OLD.id;"
+    "END;",
+    zGraph, zNodes, zGraph, zGraph, zGraph, zGraph,
+    zGraph, zNodes, zGraph, zGraph, zGraph, zGraph,
+    zGraph, zNodes, zGraph
+  );
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_exec(pVtab->pDb, zSql, 0, 0, 0);
+  sqlite3_free(zSql);
+  if( rc!=SQLITE_OK ) return rc;
+
+  return graphFillLabelIndex(pVtab);
+}
+
+/*
+** Look up the interned id of a node label (bRelType==0) or relationship
+** type (bRelType!=0). Ids are cached in the schema; on a miss the name
+** table is consulted, since other connections and plain SQL writes may
+** have added names since the cache was filled.
+** Sets *piId to 0 if no node or edge has ever carried the name.
+** Names are case sensitive, as in Cypher.
+*/
+static int graphLookupInternedId(GraphVtab *pVtab, int bRelType,
+                                 const char *zName, sqlite3_int64 *piId) {
+  CypherSchema *pSchema;
+  sqlite3_stmt *pStmt = 0;
+  char **azNames;
+  sqlite3_int64 *aiIds;
+  int nNames;
+  char *zSql;
+  int rc;
+
+  if( !pVtab || !zName || !piId ) return SQLITE_MISUSE;
+  *piId = 0;
+
+  rc = graphInitSchema(pVtab);
+  if( rc!=SQLITE_OK ) return rc;
+  pSchema = pVtab->pSchema;
+
+  azNames = bRelType ? pSchema->azRelTypes : pSchema->azNodeLabels;
+  aiIds = bRelType ? pSchema->aiRelTypeIds : pSchema->aiNodeLabelIds;
+  nNames = bRelType ? pSchema->nRelTypes : pSchema->nNodeLabels;
+  for( int i = 0; i < nNames; i++ ) {
+    if( aiIds[i] && strcmp(azNames[i], zName)==0 ) {
+      *piId = aiIds[i];
+      return SQLITE_OK;
+    }
+  }
+
+  zSql = sqlite3_mprintf("SELECT id FROM %s_%s WHERE name=?",
+                         pVtab->zTableName, bRelType ? "rel_types" : "labels");
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0);
+  sqlite3_free(zSql);
+  if( rc!=SQLITE_OK ) return rc;
+  sqlite3_bind_text(pStmt, 1, zName, -1, SQLITE_STATIC);
+  rc = sqlite3_step(pStmt);
+  if( rc==SQLITE_ROW ) {
+    *piId = sqlite3_column_int64(pStmt, 0);
+    rc = SQLITE_OK;
+  }else if( rc==SQLITE_DONE ) {
+    rc = SQLITE_OK;
+  }
+  sqlite3_finalize(pStmt);
+  if( rc!=SQLITE_OK || *piId==0 ) return rc;
+
+  /* Cache the id. The register functions ignore case, so an entry for a
+  ** name differing only in case may exist without an id. */
+  rc = bRelType ? graphRegisterRelationshipType(pSchema, zName)
+                : graphRegisterLabel(pSchema, zName);
+  if( rc!=SQLITE_OK ) return rc;
+  azNames = bRelType ? pSchema->azRelTypes : pSchema->azNodeLabels;
+  aiIds = bRelType ? pSchema->aiRelTypeIds : pSchema->aiNodeLabelIds;
+  nNames = bRelType ? pSchema->nRelTypes : pSchema->nNodeLabels;
+  for( int i = 0; i < nNames; i++ ) {
+    if( strcmp(azNames[i], zName)==0 ) {
+      aiIds[i] = *piId;
+      break;
+    }
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Look up the interned id of a label, or 0 if it is unknown.
+*/
+int graphLookupLabelId(GraphVtab *pVtab, const char *zLabel,
+                       sqlite3_int64 *piLabelId) {
+  return graphLookupInternedId(pVtab, 0, zLabel, piLabelId);
+}
+
 /*
 ** Create a label-based index for fast node lookups.
-** Creates hash table for O(1) label-based node access.
+** All labels share one index table, so zLabel only matters in that the
+** label is interned up front. The index is (re)built from the node table.
 ** Returns SQLITE_OK on success.
 */
 int graphCreateLabelIndex(GraphVtab *pVtab, const char *zLabel) {
-  (void)pVtab;
-  (void)zLabel;
-  // This function is now a no-op, as indexing is handled by the underlying SQLite tables.
+  char *zSql;
+  int rc;
+
+  if( !pVtab ) return SQLITE_MISUSE;
+
+  rc = graphInitLabelIndex(pVtab);
+  if( rc!=SQLITE_OK ) return rc;
+
+  if( zLabel && zLabel[0] ) {
+    zSql = sqlite3_mprintf("INSERT OR IGNORE INTO %s_labels(name) VALUES(%Q)",
+                           pVtab->zTableName, zLabel);
+    if( !zSql ) return SQLITE_NOMEM;
+    rc = sqlite3_exec(pVtab->pDb, zSql, 0, 0, 0);
+    sqlite3_free(zSql);
+    if( rc!=SQLITE_OK ) return rc;
+  }
+
+  return graphFillLabelIndex(pVtab);
+}
+
+/*
+** Relationship type index.
+**
+** Relationship types are interned into <graph>_rel_types(id, name) and
+** each edge carries the id in an integer type_id column next to the
+** rel_type string. The edge table is indexed on (from_id, type_id),
+** (to_id, type_id) and type_id, so a typed expansion reads only the
+** adjacency of one type and a type scan is an index range scan.
+**
+** SQLite cannot assign NEW columns from a trigger, so type_id is filled in
+** by an UPDATE from the insert and update triggers.
+*/
+
+/*
+** Recompute type_id for every edge from its rel_type.
+*/
+static int graphFillTypeIndex(GraphVtab *pVtab) {
+  const char *zGraph = pVtab->zTableName;
+  const char *zEdges = pVtab->zEdgeTableName;
+  char *zSql;
+  int rc;
+
+  zSql = sqlite3_mprintf(
+    "INSERT OR IGNORE INTO %s_rel_types(name) "
+    "SELECT DISTINCT rel_type FROM %s WHERE rel_type IS NOT NULL;"
+    "UPDATE %s SET type_id=(SELECT id FROM %s_rel_types WHERE name=rel_type);",
+    zGraph, zEdges, zEdges, zGraph
+  );
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_exec(pVtab->pDb, zSql, 0, 0, 0);
+  sqlite3_free(zSql);
+  return rc;
+}
+
+/*
+** Create the type table and the edge table triggers that maintain
+** type_id. Edges already present when the triggers are first installed
+** have their type_id filled in.
+** The type_id column and its indexes are created by the vtab along with
+** the other edge table columns.
+** Returns SQLITE_OK on success.
+*/
+int graphInitTypeIndex(GraphVtab *pVtab) {
+  const char *zGraph;
+  const char *zEdges;
+  sqlite3_stmt *pStmt = 0;
+  char *zSql;
+  int bExists = 0;
+  int rc;
+
+  if( !pVtab || !pVtab->zTableName ) return SQLITE_MISUSE;
+  zGraph = pVtab->zTableName;
+  zEdges = pVtab->zEdgeTableName;
+  if( !zEdges ) return SQLITE_MISUSE;
+
+  zSql = sqlite3_mprintf(
+    "CREATE TABLE IF NOT EXISTS %s_rel_types("
+    "id INTEGER PRIMARY KEY, name TEXT NOT NULL UNIQUE);",
+    zGraph
+  );
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_exec(pVtab->pDb, zSql, 0, 0, 0);
+  sqlite3_free(zSql);
+  if( rc!=SQLITE_OK ) return rc;
+
+  zSql = sqlite3_mprintf(
+    "SELECT 1 FROM sqlite_master WHERE type='trigger' AND name='%q_rel_types_ai'",
+    zGraph
+  );
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0);
+  sqlite3_free(zSql);
+  if( rc!=SQLITE_OK ) return rc;
+  bExists = sqlite3_step(pStmt)==SQLITE_ROW;
+  sqlite3_finalize(pStmt);
+  if( bExists ) return SQLITE_OK;
+
+  zSql = sqlite3_mprintf(
+    "CREATE TRIGGER IF NOT EXISTS %s_rel_types_ai AFTER INSERT ON %s "
+    "WHEN NEW.rel_type IS NOT NULL BEGIN "
+    "INSERT OR IGNORE INTO %s_rel_types(name) VALUES(NEW.rel_type);"
+    "UPDATE %s SET type_id=(SELECT id FROM %s_rel_types WHERE name=NEW.rel_type) "
+    "WHERE id=NEW.id;"
+    "END;"
+    "CREATE TRIGGER IF NOT EXISTS %s_rel_types_au AFTER UPDATE OF rel_type ON %s BEGIN "
+    "INSERT OR IGNORE INTO %s_rel_types(name) "
+    "SELECT NEW.rel_type WHERE NEW.rel_type IS NOT NULL;"
+    "UPDATE %s SET type_id=(SELECT id FROM %s_rel_types WHERE name=NEW.rel_type) "
+    "WHERE id=NEW.id;"
+    "END;",
+    zGraph, zEdges, zGraph, zEdges, zGraph,
+    zGraph, zEdges, zGraph, zEdges, zGraph
+  );
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_exec(pVtab->pDb, zSql, 0, 0, 0);
+  sqlite3_free(zSql);
+  if( rc!=SQLITE_OK ) return rc;
+
+  return graphFillTypeIndex(pVtab);
+}
+
+/*
+** Look up the interned id of a relationship type, or 0 if it is unknown.
+*/
+int graphLookupRelTypeId(GraphVtab *pVtab, const char *zType,
+                         sqlite3_int64 *piTypeId) {
+  return graphLookupInternedId(pVtab, 1, zType, piTypeId);
+}
+
+/*
+** Prepare a typed adjacency lookup. The statement returns (id, neighbor)
+** for the edges leaving (bIncoming==0) or entering (bIncoming!=0) the
+** node bound to parameter 1, restricted to relationship type zType, or
+** untyped if zType is NULL. With a type the lookup is a range scan on
+** the (from_id, type_id) or (to_id, type_id) index and never visits edges
+** of other types. A type that no edge carries yields an empty result.
+** Caller binds the node id, steps, resets and finalizes the statement.
+*/
+int graphPrepareAdjacency(GraphVtab *pVtab, int bIncoming, const char *zType,
+                          sqlite3_stmt **ppStmt) {
+  const char *zNear = bIncoming ? "to_id" : "from_id";
+  const char *zFar = bIncoming ? "from_id" : "to_id";
+  sqlite3_int64 iTypeId = 0;
+  char *zSql;
+  int rc;
+
+  if( !pVtab || !pVtab->zEdgeTableName || !ppStmt ) return SQLITE_MISUSE;
+  *ppStmt = 0;
+
+  if( zType ) {
+    rc = graphLookupRelTypeId(pVtab, zType, &iTypeId);
+    if( rc!=SQLITE_OK ) return rc;
+    zSql = sqlite3_mprintf("SELECT id, %s FROM %s WHERE %s=?1 AND type_id=?2",
+                           zFar, pVtab->zEdgeTableName, zNear);
+  }else{
+    zSql = sqlite3_mprintf("SELECT id, %s FROM %s WHERE %s=?1",
+                           zFar, pVtab->zEdgeTableName, zNear);
+  }
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, ppStmt, 0);
+  sqlite3_free(zSql);
+  if( rc!=SQLITE_OK ) return rc;
+  if( zType ) sqlite3_bind_int64(*ppStmt, 2, iTypeId);
   return SQLITE_OK;
 }
 
 /*
-** Create a property-based index for fast property lookups.
-** Implements property-based indexing for graph optimization.
+** Property indexes.
+**
+** graph_create_index(label, property, ...) creates a SQLite expression
+** index on GRAPH_PROPERTY_EXPR of each property over the node table. The
+** index b-tree holds the extracted values, so a composite index serves
+** equality on a prefix of its properties followed by a range on the next
+** one. With a label the index is partial: it covers only nodes matching
+** GRAPH_LABEL_HINT, a cheap test that every node carrying the label
+** passes. Scans repeat the hint so that SQLite can use the partial index,
+** and check the label index for the exact answer. Indexes are recorded in
+** <graph>_indexes(name, label, property) for the Cypher planner, where
+** property is the comma-separated list of indexed properties.
+*/
+
+/*
+** Return true if z is a plain identifier. Labels and property names are
+** spliced into index DDL and JSON paths, so only these are indexable.
+*/
+int graphIsIdentifier(const char *z) {
+  if( !z || !(z[0]=='_' || (z[0]>='A' && z[0]<='Z') || (z[0]>='a' && z[0]<='z')) ) {
+    return 0;
+  }
+  for( z++; *z; z++ ) {
+    if( !(*z=='_' || (*z>='0' && *z<='9') || (*z>='A' && *z<='Z')
+          || (*z>='a' && *z<='z')) ) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/*
+** Return true if z is a comma-separated list of plain identifiers.
+*/
+static int graphIsPropertyList(const char *z) {
+  int bStart = 1;  /* True at the start of a property name */
+
+  if( !z || !z[0] ) return 0;
+  for( ; *z; z++ ){
+    if( *z==',' ){
+      if( bStart ) return 0;
+      bStart = 1;
+    }else if( *z=='_' || (*z>='A' && *z<='Z') || (*z>='a' && *z<='z') ){
+      bStart = 0;
+    }else if( !(*z>='0' && *z<='9') || bStart ){
+      return 0;
+    }
+  }
+  return !bStart;
+}
+
+/*
+** Name of the index on zProperty (a property or comma-separated list of
+** properties) scoped to zLabel (NULL or "" for all nodes). Label-scoped
+** names contain a '.', so they never collide with unscoped ones.
+** Caller must sqlite3_free() the result.
+*/
+char *graphPropertyIndexName(GraphVtab *pVtab, const char *zLabel,
+                             const char *zProperty) {
+  if( zLabel && zLabel[0] ) {
+    return sqlite3_mprintf("%s_idx_%s.%s", pVtab->zTableName, zLabel, zProperty);
+  }
+  return sqlite3_mprintf("%s_idx_%s", pVtab->zTableName, zProperty);
+}
+
+/*
+** Create a property-based index for fast property lookups. zProperty is
+** a property name, or a comma-separated list of them for a composite
+** index. zLabel may be NULL to index the properties on all nodes.
+** Returns SQLITE_OK on success, SQLITE_ERROR for names that cannot be
+** indexed. Creating an index that already exists is not an error.
 */
 int graphCreatePropertyIndex(GraphVtab *pVtab, const char *zLabel,
                              const char *zProperty) {
+  char *zName;
+  char *zExpr = 0;
+  char *zWhere = 0;
+  char *zSql;
+  const char *z;
+  int rc;
+
   if( !pVtab || !zProperty ) return SQLITE_MISUSE;
-  
-  /* Suppress unused parameter warning */
-  (void)zLabel;
-  
-  /* Initialize schema if needed */
-  if( !pVtab->pSchema ) {
-    int rc = graphInitSchema(pVtab);
-    if( rc != SQLITE_OK ) return rc;
+  if( zLabel && !zLabel[0] ) zLabel = 0;
+  if( !graphIsPropertyList(zProperty) || (zLabel && !graphIsIdentifier(zLabel)) ) {
+    return SQLITE_ERROR;
   }
-  
-  /* Property indexing implementation will be added in next iteration */
-  testcase( zLabel != 0 );
-  testcase( zProperty != 0 );
-  
+  if( !pVtab->zNodeTableName ) return SQLITE_MISUSE;
+
+  zName = graphPropertyIndexName(pVtab, zLabel, zProperty);
+  for( z = zProperty; zName; ){
+    int n = (int)strcspn(z, ",");
+    char *zProp = sqlite3_mprintf("%.*s", n, z);
+    if( !zProp ) break;
+    zExpr = sqlite3_mprintf("%z%s" GRAPH_PROPERTY_EXPR, zExpr, zExpr ? ", " : "", zProp);
+    sqlite3_free(zProp);
+    if( !zExpr || !z[n] ) break;
+    z += n + 1;
+  }
+  if( zLabel ) zWhere = sqlite3_mprintf(" WHERE " GRAPH_LABEL_HINT, zLabel);
+  if( !zName || !zExpr || (zLabel && !zWhere) ) {
+    rc = SQLITE_NOMEM;
+    goto create_index_out;
+  }
+
+  zSql = sqlite3_mprintf(
+    "CREATE TABLE IF NOT EXISTS %s_indexes("
+    "name TEXT PRIMARY KEY, label TEXT NOT NULL DEFAULT '', "
+    "property TEXT NOT NULL, UNIQUE(label, property));"
+    "CREATE INDEX IF NOT EXISTS \"%w\" ON %s(%s)%s;"
+    "INSERT OR IGNORE INTO %s_indexes(name, label, property) VALUES(%Q, %Q, %Q);",
+    pVtab->zTableName,
+    zName, pVtab->zNodeTableName, zExpr, zWhere ? zWhere : "",
+    pVtab->zTableName, zName, zLabel ? zLabel : "", zProperty
+  );
+  if( !zSql ) {
+    rc = SQLITE_NOMEM;
+    goto create_index_out;
+  }
+  rc = sqlite3_exec(pVtab->pDb, zSql, 0, 0, 0);
+  sqlite3_free(zSql);
+
+create_index_out:
+  sqlite3_free(zName);
+  sqlite3_free(zExpr);
+  sqlite3_free(zWhere);
+  return rc;
+}
+
+/*
+** Drop an index created by graphCreatePropertyIndex().
+** Dropping an index that does not exist is not an error.
+*/
+int graphDropPropertyIndex(GraphVtab *pVtab, const char *zLabel,
+                           const char *zProperty) {
+  char *zName;
+  char *zSql;
+  int rc;
+
+  if( !pVtab || !zProperty ) return SQLITE_MISUSE;
+  if( zLabel && !zLabel[0] ) zLabel = 0;
+  if( !graphIsPropertyList(zProperty) || (zLabel && !graphIsIdentifier(zLabel)) ) {
+    return SQLITE_ERROR;
+  }
+
+  zName = graphPropertyIndexName(pVtab, zLabel, zProperty);
+  if( !zName ) return SQLITE_NOMEM;
+  zSql = sqlite3_mprintf(
+    "DROP INDEX IF EXISTS \"%w\";"
+    "CREATE TABLE IF NOT EXISTS %s_indexes("
+    "name TEXT PRIMARY KEY, label TEXT NOT NULL DEFAULT '', "
+    "property TEXT NOT NULL, UNIQUE(label, property));"
+    "DELETE FROM %s_indexes WHERE name=%Q;",
+    zName, pVtab->zTableName, pVtab->zTableName, zName
+  );
+  sqlite3_free(zName);
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_exec(pVtab->pDb, zSql, 0, 0, 0);
+  sqlite3_free(zSql);
+  return rc;
+}
+
+/*
+** Run zSql, a query on an index catalog, and load its nCol columns into
+** parallel arrays aaz[0..nCol-1] of *pnRow sqlite3_malloc'd strings. A
+** catalog that does not exist yet yields empty arrays.
+*/
+static int graphLoadCatalog(GraphVtab *pVtab, char *zSql, int nCol,
+                            char ***aaz, int *pnRow) {
+  sqlite3_stmt *pStmt = 0;
+  int nRow = 0;
+  int rc, i, j;
+
+  for( j = 0; j < nCol; j++ ) aaz[j] = 0;
+  *pnRow = 0;
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0);
+  sqlite3_free(zSql);
+  if( rc!=SQLITE_OK ) return SQLITE_OK; /* No index created yet */
+
+  while( (rc = sqlite3_step(pStmt))==SQLITE_ROW ) {
+    for( j = 0; j < nCol; j++ ) {
+      char **azNew = sqlite3_realloc(aaz[j], sizeof(char*) * (nRow + 1));
+      if( !azNew ) break;
+      aaz[j] = azNew;
+      aaz[j][nRow] = sqlite3_mprintf("%s", sqlite3_column_text(pStmt, j));
+      if( !aaz[j][nRow] ) break;
+    }
+    if( j < nCol ) {
+      while( j-- > 0 ) sqlite3_free(aaz[j][nRow]);
+      rc = SQLITE_NOMEM;
+      break;
+    }
+    nRow++;
+  }
+  sqlite3_finalize(pStmt);
+  if( rc!=SQLITE_DONE ) {
+    for( j = 0; j < nCol; j++ ) {
+      for( i = 0; i < nRow; i++ ) sqlite3_free(aaz[j][i]);
+      sqlite3_free(aaz[j]);
+      aaz[j] = 0;
+    }
+    return rc;
+  }
+  *pnRow = nRow;
   return SQLITE_OK;
 }
 
+/*
+** Load the property index catalog into three parallel arrays of *pnNames
+** sqlite3_malloc'd strings: index names, labels ("" for indexes over all
+** nodes) and comma-separated property lists. A graph without any
+** property index yields empty lists.
+*/
+int graphLoadPropertyIndexes(GraphVtab *pVtab, char ***pazNames,
+                             char ***pazLabels, char ***pazColumns,
+                             int *pnNames) {
+  char **az[3];
+  int rc;
+
+  *pazNames = 0;
+  *pazLabels = 0;
+  *pazColumns = 0;
+  *pnNames = 0;
+  if( !pVtab || !pVtab->zTableName ) return SQLITE_MISUSE;
+
+  rc = graphLoadCatalog(pVtab,
+      sqlite3_mprintf("SELECT name, label, property FROM %s_indexes ORDER BY name",
+                      pVtab->zTableName),
+      3, az, pnNames);
+  if( rc==SQLITE_OK ) {
+    *pazNames = az[0];
+    *pazLabels = az[1];
+    *pazColumns = az[2];
+  }
+  return rc;
+}
+
+/*
+** Range indexes.
+**
+** A range index orders the nodes by one property, read either as a number
+** (the JSON value itself) or as an ISO-8601 date (GRAPH_DATE_EXPR). The
+** catalog <graph>_range_indexes records the key type, which the Cypher
+** planner needs to spell the key expression in its lookups.
+*/
+
+/*
+** Return the key expression of a range index of type zType ("number" or
+** "date") on zProperty, or NULL for an unknown type.
+** Caller must sqlite3_free() the result.
+*/
+char *graphRangeKeyExpr(const char *zType, const char *zProperty) {
+  if( !zType || !zProperty ) return 0;
+  if( sqlite3_stricmp(zType, "number")==0 ) {
+    return sqlite3_mprintf(GRAPH_PROPERTY_EXPR, zProperty);
+  }
+  if( sqlite3_stricmp(zType, "date")==0 ) {
+    return sqlite3_mprintf(GRAPH_DATE_EXPR, zProperty, zProperty);
+  }
+  return 0;
+}
+
+/*
+** Name of the range index on zProperty scoped to zLabel (NULL or "" for
+** all nodes). Caller must sqlite3_free() the result.
+*/
+char *graphRangeIndexName(GraphVtab *pVtab, const char *zLabel,
+                          const char *zProperty) {
+  if( zLabel && zLabel[0] ) {
+    return sqlite3_mprintf("%s_ridx_%s.%s", pVtab->zTableName, zLabel, zProperty);
+  }
+  return sqlite3_mprintf("%s_ridx_%s", pVtab->zTableName, zProperty);
+}
+
+/*
+** Create a range index of type zType ("number" or "date") on zProperty,
+** optionally only over nodes with label zLabel. Returns SQLITE_ERROR for
+** names that cannot be indexed or an unknown type. Re-creating an index
+** with another type replaces it.
+*/
+int graphCreateRangeIndex(GraphVtab *pVtab, const char *zLabel,
+                          const char *zProperty, const char *zType) {
+  char *zName;
+  char *zExpr;
+  char *zWhere = 0;
+  char *zSql = 0;
+  int rc;
+
+  if( !pVtab || !zProperty || !zType ) return SQLITE_MISUSE;
+  if( zLabel && !zLabel[0] ) zLabel = 0;
+  if( !graphIsIdentifier(zProperty) || (zLabel && !graphIsIdentifier(zLabel)) ) {
+    return SQLITE_ERROR;
+  }
+  if( !pVtab->zNodeTableName ) return SQLITE_MISUSE;
+
+  zExpr = graphRangeKeyExpr(zType, zProperty);
+  if( !zExpr ) return SQLITE_ERROR;
+  zName = graphRangeIndexName(pVtab, zLabel, zProperty);
+  if( zLabel ) zWhere = sqlite3_mprintf(" WHERE " GRAPH_LABEL_HINT, zLabel);
+  if( zName && (zWhere || !zLabel) ) {
+    zSql = sqlite3_mprintf(
+      "CREATE TABLE IF NOT EXISTS %s_range_indexes("
+      "name TEXT PRIMARY KEY, label TEXT NOT NULL DEFAULT '', "
+      "property TEXT NOT NULL, type TEXT NOT NULL, UNIQUE(label, property));"
+      "DROP INDEX IF EXISTS \"%w\";"
+      "CREATE INDEX \"%w\" ON %s(%s)%s;"
+      "INSERT OR REPLACE INTO %s_range_indexes(name, label, property, type) "
+      "VALUES(%Q, %Q, %Q, lower(%Q));",
+      pVtab->zTableName, zName,
+      zName, pVtab->zNodeTableName, zExpr, zWhere ? zWhere : "",
+      pVtab->zTableName, zName, zLabel ? zLabel : "", zProperty, zType
+    );
+  }
+  rc = zSql ? sqlite3_exec(pVtab->pDb, zSql, 0, 0, 0) : SQLITE_NOMEM;
+  sqlite3_free(zSql);
+  sqlite3_free(zName);
+  sqlite3_free(zExpr);
+  sqlite3_free(zWhere);
+  return rc;
+}
+
+/*
+** Drop an index created by graphCreateRangeIndex().
+** Dropping an index that does not exist is not an error.
+*/
+int graphDropRangeIndex(GraphVtab *pVtab, const char *zLabel,
+                        const char *zProperty) {
+  char *zName;
+  char *zSql;
+  int rc;
+
+  if( !pVtab || !zProperty ) return SQLITE_MISUSE;
+  if( zLabel && !zLabel[0] ) zLabel = 0;
+  if( !graphIsIdentifier(zProperty) || (zLabel && !graphIsIdentifier(zLabel)) ) {
+    return SQLITE_ERROR;
+  }
+
+  zName = graphRangeIndexName(pVtab, zLabel, zProperty);
+  if( !zName ) return SQLITE_NOMEM;
+  zSql = sqlite3_mprintf(
+    "DROP INDEX IF EXISTS \"%w\";"
+    "CREATE TABLE IF NOT EXISTS %s_range_indexes("
+    "name TEXT PRIMARY KEY, label TEXT NOT NULL DEFAULT '', "
+    "property TEXT NOT NULL, type TEXT NOT NULL, UNIQUE(label, property));"
+    "DELETE FROM %s_range_indexes WHERE name=%Q;",
+    zName, pVtab->zTableName, pVtab->zTableName, zName
+  );
+  sqlite3_free(zName);
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_exec(pVtab->pDb, zSql, 0, 0, 0);
+  sqlite3_free(zSql);
+  return rc;
+}
+
+/*
+** Load the range index catalog into four parallel arrays of *pnNames
+** sqlite3_malloc'd strings: index names, labels ("" for all nodes),
+** properties and key types.
+*/
+int graphLoadRangeIndexes(GraphVtab *pVtab, char ***pazNames,
+                          char ***pazLabels, char ***pazProps,
+                          char ***pazTypes, int *pnNames) {
+  char **az[4];
+  int rc;
+
+  *pazNames = 0;
+  *pazLabels = 0;
+  *pazProps = 0;
+  *pazTypes = 0;
+  *pnNames = 0;
+  if( !pVtab || !pVtab->zTableName ) return SQLITE_MISUSE;
+
+  rc = graphLoadCatalog(pVtab,
+      sqlite3_mprintf("SELECT name, label, property, type FROM %s_range_indexes "
+                      "ORDER BY name", pVtab->zTableName),
+      4, az, pnNames);
+  if( rc==SQLITE_OK ) {
+    *pazNames = az[0];
+    *pazLabels = az[1];
+    *pazProps = az[2];
+    *pazTypes = az[3];
+  }
+  return rc;
+}
+
+/*
+** Full-text indexes.
+**
+** A full-text index keeps the text values of one property in a
+** contentless FTS5 table whose rowids are node ids. Triggers on the node
+** table keep it in step with every write path, as for the label index.
+** The catalog <graph>_fulltext_indexes records the tokenizer: only a
+** trigram index can answer CONTAINS, STARTS WITH and ENDS WITH, since
+** any substring of three or more characters is a trigram phrase.
+*/
+
+#define GRAPH_FULLTEXT_CATALOG \
+  "CREATE TABLE IF NOT EXISTS %s_fulltext_indexes(" \
+  "name TEXT PRIMARY KEY, label TEXT NOT NULL DEFAULT '', " \
+  "property TEXT NOT NULL, tokenizer TEXT NOT NULL, UNIQUE(label, property));"
+
+/*
+** Index the text value of zProperty in node row R, if R carries label
+** zLabel (the format expects either the label or no label test). Values
+** of other types, and malformed property documents, are not indexed.
+*/
+#define GRAPH_FULLTEXT_INSERT(R) \
+  "INSERT INTO \"%w\"(rowid, value) SELECT " R ".id, " \
+  "json_extract(" R ".properties, '$.%q') " \
+  "WHERE CASE WHEN json_valid(" R ".properties) " \
+  "THEN json_type(" R ".properties, '$.%q') END = 'text'%s;"
+
+/*
+** Return true if zTokenizer names an FTS5 tokenizer a full-text index
+** may use.
+*/
+int graphIsFulltextTokenizer(const char *zTokenizer) {
+  static const char *azTok[] = { "trigram", "unicode61", "porter", "ascii" };
+  int i;
+  if( !zTokenizer ) return 0;
+  for( i = 0; i < (int)(sizeof(azTok)/sizeof(azTok[0])); i++ ) {
+    if( sqlite3_stricmp(zTokenizer, azTok[i])==0 ) return 1;
+  }
+  return 0;
+}
+
+/*
+** Name of the full-text index on zProperty scoped to zLabel (NULL or ""
+** for all nodes). Caller must sqlite3_free() the result.
+*/
+char *graphFulltextIndexName(GraphVtab *pVtab, const char *zLabel,
+                             const char *zProperty) {
+  if( zLabel && zLabel[0] ) {
+    return sqlite3_mprintf("%s_fts_%s.%s", pVtab->zTableName, zLabel, zProperty);
+  }
+  return sqlite3_mprintf("%s_fts_%s", pVtab->zTableName, zProperty);
+}
+
+/*
+** SQL that drops full-text index zName and its triggers.
+*/
+static char *graphFulltextDropSql(const char *zName) {
+  return sqlite3_mprintf(
+    "DROP TRIGGER IF EXISTS \"%w_ai\";"
+    "DROP TRIGGER IF EXISTS \"%w_au\";"
+    "DROP TRIGGER IF EXISTS \"%w_ad\";"
+    "DROP TABLE IF EXISTS \"%w\";",
+    zName, zName, zName, zName
+  );
+}
+
+/*
+** Create a full-text index on zProperty using FTS5 tokenizer zTokenizer
+** (NULL for "trigram"), optionally only over nodes with label zLabel, and
+** index the existing nodes. Re-creating an index rebuilds it. Returns
+** SQLITE_ERROR for names that cannot be indexed or an unknown tokenizer.
+*/
+int graphCreateFulltextIndex(GraphVtab *pVtab, const char *zLabel,
+                             const char *zProperty, const char *zTokenizer) {
+  const char *zNodes;
+  char *zName;
+  char *zHasLabel = 0;
+  char *zHasLabelN = 0;
+  char *zSql = 0;
+  int rc;
+
+  if( !pVtab || !zProperty ) return SQLITE_MISUSE;
+  if( zLabel && !zLabel[0] ) zLabel = 0;
+  if( !zTokenizer ) zTokenizer = "trigram";
+  if( !graphIsIdentifier(zProperty) || (zLabel && !graphIsIdentifier(zLabel)) ||
+      !graphIsFulltextTokenizer(zTokenizer) ) {
+    return SQLITE_ERROR;
+  }
+  zNodes = pVtab->zNodeTableName;
+  if( !zNodes ) return SQLITE_MISUSE;
+
+  zName = graphFulltextIndexName(pVtab, zLabel, zProperty);
+  if( !zName ) return SQLITE_NOMEM;
+  zSql = graphFulltextDropSql(zName);
+  rc = zSql ? sqlite3_exec(pVtab->pDb, zSql, 0, 0, 0) : SQLITE_NOMEM;
+  sqlite3_free(zSql);
+  zSql = 0;
+
+  if( rc==SQLITE_OK ) {
+    if( zLabel ) {
+      zHasLabel = sqlite3_mprintf(" AND EXISTS(SELECT 1 FROM json_each("
+          GRAPH_LABELS_JSON("NEW") ") WHERE value=%Q)", zLabel);
+      zHasLabelN = sqlite3_mprintf(" AND EXISTS(SELECT 1 FROM json_each("
+          GRAPH_LABELS_JSON("n") ") WHERE value=%Q)", zLabel);
+    } else {
+      zHasLabel = sqlite3_mprintf("");
+      zHasLabelN = sqlite3_mprintf("");
+    }
+    if( zHasLabel && zHasLabelN ) {
+      /* The insert trigger clears the node's old entry first so that
+      ** INSERT OR REPLACE works without recursive triggers enabled. */
+      zSql = sqlite3_mprintf(
+        GRAPH_FULLTEXT_CATALOG
+        "CREATE VIRTUAL TABLE \"%w\" USING fts5("
+        "value, content='', contentless_delete=1, tokenize=%Q);"
+        "CREATE TRIGGER \"%w_ai\" AFTER INSERT ON %s BEGIN "
+        "DELETE FROM \"%w\" WHERE rowid=NEW.id;"
+        GRAPH_FULLTEXT_INSERT("NEW")
+        "END;"
+        "CREATE TRIGGER \"%w_au\" AFTER UPDATE OF id, labels, properties ON %s BEGIN "
+        "DELETE FROM \"%w\" WHERE rowid=OLD.id;"
+        GRAPH_FULLTEXT_INSERT("NEW")
+        "END;"
+        "CREATE TRIGGER \"%w_ad\" AFTER DELETE ON %s BEGIN "
+        "DELETE FROM \"%w\" WHERE rowid=OLD.id;"
+        "END;"
+        "INSERT INTO \"%w\"(rowid, value) SELECT n.id, "
+        "json_extract(n.properties, '$.%q') FROM %s AS n "
+        "WHERE CASE WHEN json_valid(n.properties) "
+        "THEN json_type(n.properties, '$.%q') END = 'text'%s;"
+        "INSERT OR REPLACE INTO %s_fulltext_indexes(name, label, property, tokenizer) "
+        "VALUES(%Q, %Q, %Q, lower(%Q));",
+        pVtab->zTableName,
+        zName, zTokenizer,
+        zName, zNodes, zName, zName, zProperty, zProperty, zHasLabel,
+        zName, zNodes, zName, zName, zProperty, zProperty, zHasLabel,
+        zName, zNodes, zName,
+        zName, zProperty, zNodes, zProperty, zHasLabelN,
+        pVtab->zTableName, zName, zLabel ? zLabel : "", zProperty, zTokenizer
+      );
+    }
+    rc = zSql ? sqlite3_exec(pVtab->pDb, zSql, 0, 0, 0) : SQLITE_NOMEM;
+  }
+  sqlite3_free(zSql);
+  sqlite3_free(zHasLabel);
+  sqlite3_free(zHasLabelN);
+  sqlite3_free(zName);
+  return rc;
+}
+
+/*
+** Drop an index created by graphCreateFulltextIndex().
+** Dropping an index that does not exist is not an error.
+*/
+int graphDropFulltextIndex(GraphVtab *pVtab, const char *zLabel,
+                           const char *zProperty) {
+  char *zName;
+  char *zSql;
+  int rc;
+
+  if( !pVtab || !zProperty ) return SQLITE_MISUSE;
+  if( zLabel && !zLabel[0] ) zLabel = 0;
+  if( !graphIsIdentifier(zProperty) || (zLabel && !graphIsIdentifier(zLabel)) ) {
+    return SQLITE_ERROR;
+  }
+
+  zName = graphFulltextIndexName(pVtab, zLabel, zProperty);
+  if( !zName ) return SQLITE_NOMEM;
+  zSql = graphFulltextDropSql(zName);
+  if( zSql ) {
+    zSql = sqlite3_mprintf(
+      "%z" GRAPH_FULLTEXT_CATALOG
+      "DELETE FROM %s_fulltext_indexes WHERE name=%Q;",
+      zSql, pVtab->zTableName, pVtab->zTableName, zName
+    );
+  }
+  sqlite3_free(zName);
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_exec(pVtab->pDb, zSql, 0, 0, 0);
+  sqlite3_free(zSql);
+  return rc;
+}
+
+/*
+** Load the full-text index catalog into four parallel arrays of
+** *pnNames sqlite3_malloc'd strings: index names, labels ("" for all
+** nodes), properties and tokenizers.
+*/
+int graphLoadFulltextIndexes(GraphVtab *pVtab, char ***pazNames,
+                             char ***pazLabels, char ***pazProps,
+                             char ***pazTokenizers, int *pnNames) {
+  char **az[4];
+  int rc;
+
+  *pazNames = 0;
+  *pazLabels = 0;
+  *pazProps = 0;
+  *pazTokenizers = 0;
+  *pnNames = 0;
+  if( !pVtab || !pVtab->zTableName ) return SQLITE_MISUSE;
+
+  rc = graphLoadCatalog(pVtab,
+      sqlite3_mprintf("SELECT name, label, property, tokenizer "
+                      "FROM %s_fulltext_indexes ORDER BY name",
+                      pVtab->zTableName),
+      4, az, pnNames);
+  if( rc==SQLITE_OK ) {
+    *pazNames = az[0];
+    *pazLabels = az[1];
+    *pazProps = az[2];
+    *pazTokenizers = az[3];
+  }
+  return rc;
+}
+
+/*
+** Decode the arguments of graph_create_index() and graph_drop_index():
+** (property) or (label, property, ...). Sets *pzLabel (NULL when there
+** is none) and returns the comma-separated property list, or NULL if the
+** arguments cannot be indexed (an error has been set on pCtx).
+** Caller must sqlite3_free() the result.
+*/
+static char *graphIndexArgs(sqlite3_context *pCtx, const char *zFunc,
+                            int argc, sqlite3_value **argv,
+                            const char **pzLabel) {
+  const char *zLabel = argc>=2 ? (const char*)sqlite3_value_text(argv[0]) : 0;
+  char *zProps = 0;
+  int i;
+
+  *pzLabel = 0;
+  if( argc<1 ) {
+    char *zErr = sqlite3_mprintf("%s(): wrong number of arguments", zFunc);
+    sqlite3_result_error(pCtx, zErr ? zErr : "wrong number of arguments", -1);
+    sqlite3_free(zErr);
+    return 0;
+  }
+  for( i = argc>=2 ? 1 : 0; i < argc; i++ ) {
+    const char *zProp = (const char*)sqlite3_value_text(argv[i]);
+    if( !graphIsIdentifier(zProp) ) {
+      sqlite3_free(zProps);
+      zProps = 0;
+      break;
+    }
+    zProps = sqlite3_mprintf("%z%s%s", zProps, zProps ? "," : "", zProp);
+    if( !zProps ) {
+      sqlite3_result_error_nomem(pCtx);
+      return 0;
+    }
+  }
+  if( !zProps || (zLabel && zLabel[0] && !graphIsIdentifier(zLabel)) ) {
+    char *zErr = sqlite3_mprintf(
+        "%s(): label and properties must be plain identifiers", zFunc);
+    sqlite3_result_error(pCtx, zErr ? zErr : "invalid index", -1);
+    sqlite3_free(zErr);
+    sqlite3_free(zProps);
+    return 0;
+  }
+  *pzLabel = zLabel;
+  return zProps;
+}
+
+/*
+** SQL function: graph_create_index(label, property, ...)
+**               graph_create_index(property)
+**
+** Index node property values, optionally only for nodes with a label.
+** With several properties the index is composite, usable for equality on
+** leading properties followed by a range on the next. Returns the index
+** name.
+*/
+static void graphCreateIndexFunc(sqlite3_context *pCtx, int argc,
+                                 sqlite3_value **argv) {
+  GraphVtab *pGraph = getGlobalGraph();
+  const char *zLabel;
+  char *zProps;
+  int rc;
+
+  if( !pGraph ) {
+    sqlite3_result_error(pCtx, "No graph table available. Create a graph table first using: CREATE VIRTUAL TABLE mygraph USING graph();", -1);
+    return;
+  }
+  zProps = graphIndexArgs(pCtx, "graph_create_index", argc, argv, &zLabel);
+  if( !zProps ) return;
+  rc = graphCreatePropertyIndex(pGraph, zLabel, zProps);
+  if( rc!=SQLITE_OK ) {
+    sqlite3_result_error(pCtx, sqlite3_errmsg(pGraph->pDb), -1);
+    sqlite3_result_error_code(pCtx, rc);
+  }else{
+    sqlite3_result_text(pCtx, graphPropertyIndexName(pGraph, zLabel, zProps),
+                        -1, sqlite3_free);
+  }
+  sqlite3_free(zProps);
+}
+
+/*
+** SQL function: graph_drop_index(label, property, ...)
+**               graph_drop_index(property)
+*/
+static void graphDropIndexFunc(sqlite3_context *pCtx, int argc,
+                               sqlite3_value **argv) {
+  GraphVtab *pGraph = getGlobalGraph();
+  const char *zLabel;
+  char *zProps;
+  int rc;
+
+  if( !pGraph ) {
+    sqlite3_result_error(pCtx, "No graph table available. Create a graph table first using: CREATE VIRTUAL TABLE mygraph USING graph();", -1);
+    return;
+  }
+  zProps = graphIndexArgs(pCtx, "graph_drop_index", argc, argv, &zLabel);
+  if( !zProps ) return;
+  rc = graphDropPropertyIndex(pGraph, zLabel, zProps);
+  if( rc!=SQLITE_OK ) {
+    sqlite3_result_error(pCtx, sqlite3_errmsg(pGraph->pDb), -1);
+    sqlite3_result_error_code(pCtx, rc);
+  }else{
+    sqlite3_result_int(pCtx, 1);
+  }
+  sqlite3_free(zProps);
+}
+
+/*
+** SQL function: graph_create_range_index(label, property, type)
+**               graph_create_range_index(property, type)
+**
+** Index a numeric (type 'number') or ISO-8601 date (type 'date') property
+** in key order, optionally only for nodes with a label. Returns the index
+** name.
+*/
+static void graphCreateRangeIndexFunc(sqlite3_context *pCtx, int argc,
+                                      sqlite3_value **argv) {
+  GraphVtab *pGraph = getGlobalGraph();
+  const char *zLabel;
+  const char *zProp;
+  const char *zType;
+  int rc;
+
+  if( !pGraph ) {
+    sqlite3_result_error(pCtx, "No graph table available. Create a graph table first using: CREATE VIRTUAL TABLE mygraph USING graph();", -1);
+    return;
+  }
+  if( argc<2 || argc>3 ) {
+    sqlite3_result_error(pCtx, "graph_create_range_index(): wrong number of arguments", -1);
+    return;
+  }
+  zLabel = argc==3 ? (const char*)sqlite3_value_text(argv[0]) : 0;
+  zProp = (const char*)sqlite3_value_text(argv[argc-2]);
+  zType = (const char*)sqlite3_value_text(argv[argc-1]);
+  if( !graphIsIdentifier(zProp) || (zLabel && zLabel[0] && !graphIsIdentifier(zLabel)) ) {
+    sqlite3_result_error(pCtx, "graph_create_range_index(): label and property "
+                               "must be plain identifiers", -1);
+    return;
+  }
+  if( !zType || (sqlite3_stricmp(zType, "number")!=0 && sqlite3_stricmp(zType, "date")!=0) ) {
+    sqlite3_result_error(pCtx, "graph_create_range_index(): type must be "
+                               "'number' or 'date'", -1);
+    return;
+  }
+  rc = graphCreateRangeIndex(pGraph, zLabel, zProp, zType);
+  if( rc!=SQLITE_OK ) {
+    sqlite3_result_error(pCtx, sqlite3_errmsg(pGraph->pDb), -1);
+    sqlite3_result_error_code(pCtx, rc);
+  }else{
+    sqlite3_result_text(pCtx, graphRangeIndexName(pGraph, zLabel, zProp),
+                        -1, sqlite3_free);
+  }
+}
+
+/*
+** SQL function: graph_drop_range_index(label, property)
+**               graph_drop_range_index(property)
+*/
+static void graphDropRangeIndexFunc(sqlite3_context *pCtx, int argc,
+                                    sqlite3_value **argv) {
+  GraphVtab *pGraph = getGlobalGraph();
+  const char *zLabel;
+  const char *zProp;
+  int rc;
+
+  if( !pGraph ) {
+    sqlite3_result_error(pCtx, "No graph table available. Create a graph table first using: CREATE VIRTUAL TABLE mygraph USING graph();", -1);
+    return;
+  }
+  if( argc<1 || argc>2 ) {
+    sqlite3_result_error(pCtx, "graph_drop_range_index(): wrong number of arguments", -1);
+    return;
+  }
+  zLabel = argc==2 ? (const char*)sqlite3_value_text(argv[0]) : 0;
+  zProp = (const char*)sqlite3_value_text(argv[argc-1]);
+  if( !graphIsIdentifier(zProp) || (zLabel && zLabel[0] && !graphIsIdentifier(zLabel)) ) {
+    sqlite3_result_error(pCtx, "graph_drop_range_index(): label and property "
+                               "must be plain identifiers", -1);
+    return;
+  }
+  rc = graphDropRangeIndex(pGraph, zLabel, zProp);
+  if( rc!=SQLITE_OK ) {
+    sqlite3_result_error(pCtx, sqlite3_errmsg(pGraph->pDb), -1);
+    sqlite3_result_error_code(pCtx, rc);
+  }else{
+    sqlite3_result_int(pCtx, 1);
+  }
+}
+
+/*
+** SQL function: graph_create_fulltext_index(label, property, tokenizer)
+**               graph_create_fulltext_index(label, property)
+**               graph_create_fulltext_index(property)
+**
+** Keep an FTS5 index of the text values of a property, optionally only
+** for nodes with a label ('' for all nodes). The tokenizer defaults to
+** 'trigram', which the Cypher planner can use for CONTAINS, STARTS WITH
+** and ENDS WITH. Returns the index name.
+*/
+static void graphCreateFulltextIndexFunc(sqlite3_context *pCtx, int argc,
+                                         sqlite3_value **argv) {
+  GraphVtab *pGraph = getGlobalGraph();
+  const char *zLabel;
+  const char *zProp;
+  const char *zTokenizer;
+  int rc;
+
+  if( !pGraph ) {
+    sqlite3_result_error(pCtx, "No graph table available. Create a graph table first using: CREATE VIRTUAL TABLE mygraph USING graph();", -1);
+    return;
+  }
+  if( argc<1 || argc>3 ) {
+    sqlite3_result_error(pCtx, "graph_create_fulltext_index(): wrong number of arguments", -1);
+    return;
+  }
+  zLabel = argc>=2 ? (const char*)sqlite3_value_text(argv[0]) : 0;
+  zProp = (const char*)sqlite3_value_text(argv[argc>=2 ? 1 : 0]);
+  zTokenizer = argc==3 ? (const char*)sqlite3_value_text(argv[2]) : 0;
+  if( !graphIsIdentifier(zProp) || (zLabel && zLabel[0] && !graphIsIdentifier(zLabel)) ) {
+    sqlite3_result_error(pCtx, "graph_create_fulltext_index(): label and property "
+                               "must be plain identifiers", -1);
+    return;
+  }
+  if( argc==3 && !graphIsFulltextTokenizer(zTokenizer) ) {
+    sqlite3_result_error(pCtx, "graph_create_fulltext_index(): tokenizer must be "
+                               "'trigram', 'unicode61', 'porter' or 'ascii'", -1);
+    return;
+  }
+  rc = graphCreateFulltextIndex(pGraph, zLabel, zProp, zTokenizer);
+  if( rc!=SQLITE_OK ) {
+    sqlite3_result_error(pCtx, sqlite3_errmsg(pGraph->pDb), -1);
+    sqlite3_result_error_code(pCtx, rc);
+  }else{
+    sqlite3_result_text(pCtx, graphFulltextIndexName(pGraph, zLabel, zProp),
+                        -1, sqlite3_free);
+  }
+}
+
+/*
+** SQL function: graph_drop_fulltext_index(label, property)
+**               graph_drop_fulltext_index(property)
+*/
+static void graphDropFulltextIndexFunc(sqlite3_context *pCtx, int argc,
+                                       sqlite3_value **argv) {
+  GraphVtab *pGraph = getGlobalGraph();
+  const char *zLabel;
+  const char *zProp;
+  int rc;
+
+  if( !pGraph ) {
+    sqlite3_result_error(pCtx, "No graph table available. Create a graph table first using: CREATE VIRTUAL TABLE mygraph USING graph();", -1);
+    return;
+  }
+  if( argc<1 || argc>2 ) {
+    sqlite3_result_error(pCtx, "graph_drop_fulltext_index(): wrong number of arguments", -1);
+    return;
+  }
+  zLabel = argc==2 ? (const char*)sqlite3_value_text(argv[0]) : 0;
+  zProp = (const char*)sqlite3_value_text(argv[argc-1]);
+  if( !graphIsIdentifier(zProp) || (zLabel && zLabel[0] && !graphIsIdentifier(zLabel)) ) {
+    sqlite3_result_error(pCtx, "graph_drop_fulltext_index(): label and property "
+                               "must be plain identifiers", -1);
+    return;
+  }
+  rc = graphDropFulltextIndex(pGraph, zLabel, zProp);
+  if( rc!=SQLITE_OK ) {
+    sqlite3_result_error(pCtx, sqlite3_errmsg(pGraph->pDb), -1);
+    sqlite3_result_error_code(pCtx, rc);
+  }else{
+    sqlite3_result_int(pCtx, 1);
+  }
+}
+
+/*
+** Register the index management SQL functions.
+*/
+int graphRegisterIndexFunctions(sqlite3 *pDb) {
+  int rc;
+  rc = sqlite3_create_function(pDb, "graph_create_index", -1, SQLITE_UTF8, 0,
+                               graphCreateIndexFunc, 0, 0);
+  if( rc==SQLITE_OK ) {
+    rc = sqlite3_create_function(pDb, "graph_drop_index", -1, SQLITE_UTF8, 0,
+                                 graphDropIndexFunc, 0, 0);
+  }
+  if( rc==SQLITE_OK ) {
+    rc = sqlite3_create_function(pDb, "graph_create_range_index", -1, SQLITE_UTF8, 0,
+                                 graphCreateRangeIndexFunc, 0, 0);
+  }
+  if( rc==SQLITE_OK ) {
+    rc = sqlite3_create_function(pDb, "graph_drop_range_index", -1, SQLITE_UTF8, 0,
+                                 graphDropRangeIndexFunc, 0, 0);
+  }
+  if( rc==SQLITE_OK ) {
+    rc = sqlite3_create_function(pDb, "graph_create_fulltext_index", -1, SQLITE_UTF8, 0,
+                                 graphCreateFulltextIndexFunc, 0, 0);
+  }
+  if( rc==SQLITE_OK ) {
+    rc = sqlite3_create_function(pDb, "graph_drop_fulltext_index", -1, SQLITE_UTF8, 0,
+                                 graphDropFulltextIndexFunc, 0, 0);
+  }
+  return rc;
+}
+
 /*
 ** Find nodes by label using index.
-** Returns first node in the bucket chain for the label.
-** Caller should iterate through pLabelNext to get all nodes.
+** Returns the first node with the label in node id order, or NULL if
+** there are none. Caller should iterate through pLabelNext (pNext links
+** the same list) and release each node with graph_node_destroy().
 */
 GraphNode *graphFindNodesByLabel(GraphVtab *pVtab, const char *zLabel) {
-  (void)pVtab;
-  (void)zLabel;
-  // This function is now a no-op, as node lookups are done via SQL queries.
-  return 0;
+  GraphNode *pFirst = 0;
+  GraphNode *pLast = 0;
+  sqlite3_stmt *pStmt = 0;
+  sqlite3_int64 iLabelId = 0;
+  char *zSql;
+
+  if( !pVtab || !pVtab->zNodeTableName || !zLabel ) return 0;
+  if( graphLookupLabelId(pVtab, zLabel, &iLabelId)!=SQLITE_OK ) return 0;
+  if( iLabelId==0 ) return 0;
+
+  zSql = sqlite3_mprintf(
+    "SELECT n.id, n.properties FROM %s_label_index AS x "
+    "JOIN %s AS n ON n.id=x.node_id WHERE x.label_id=? ORDER BY x.node_id",
+    pVtab->zTableName, pVtab->zNodeTableName
+  );
+  if( !zSql ) return 0;
+  if( sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0)!=SQLITE_OK ) {
+    sqlite3_free(zSql);
+    return 0;
+  }
+  sqlite3_free(zSql);
+  sqlite3_bind_int64(pStmt, 1, iLabelId);
+
+  while( sqlite3_step(pStmt)==SQLITE_ROW ) {
+    GraphNode *pNode = graph_node_create(0, sqlite3_column_int64(pStmt, 0),
+                                         &zLabel, 1,
+                                         (const char*)sqlite3_column_text(pStmt, 1));
+    if( !pNode ) break;
+    if( pLast ) {
+      pLast->pNext = pLast->pLabelNext = pNode;
+    }else{
+      pFirst = pNode;
+    }
+    pLast = pNode;
+  }
+  sqlite3_finalize(pStmt);
+  return pFirst;
 }
 
 /*
 ** Find edges by relationship type.
-** Linear search through edge list - will be optimized with type indexing.
+** Returns the first edge of the type in edge id order, linked through
+** pNext, or NULL if there are none. Caller releases each edge with
+** graph_edge_destroy().
 */
 GraphEdge *graphFindEdgesByType(GraphVtab *pVtab, const char *zType) {
-  (void)pVtab;
-  (void)zType;
-  // This function is now a no-op, as edge lookups are done via SQL queries.
-  return 0;
+  GraphEdge *pFirst = 0;
+  GraphEdge *pLast = 0;
+  sqlite3_stmt *pStmt = 0;
+  sqlite3_int64 iTypeId = 0;
+  char *zSql;
+
+  if( !pVtab || !pVtab->zEdgeTableName || !zType ) return 0;
+  if( graphLookupRelTypeId(pVtab, zType, &iTypeId)!=SQLITE_OK ) return 0;
+  if( iTypeId==0 ) return 0;
+
+  zSql = sqlite3_mprintf(
+    "SELECT id, from_id, to_id, weight, properties FROM %s "
+    "WHERE type_id=? ORDER BY id",
+    pVtab->zEdgeTableName
+  );
+  if( !zSql ) return 0;
+  if( sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0)!=SQLITE_OK ) {
+    sqlite3_free(zSql);
+    return 0;
+  }
+  sqlite3_free(zSql);
+  sqlite3_bind_int64(pStmt, 1, iTypeId);
+
+  while( sqlite3_step(pStmt)==SQLITE_ROW ) {
+    GraphEdge *pEdge = graph_edge_create(0, sqlite3_column_int64(pStmt, 0),
+                                         sqlite3_column_int64(pStmt, 1),
+                                         sqlite3_column_int64(pStmt, 2),
+                                         zType,
+                                         sqlite3_column_double(pStmt, 3),
+                                         (const char*)sqlite3_column_text(pStmt, 4));
+    if( !pEdge ) break;
+    if( pLast ) {
+      pLast->pNext = pEdge;
+    }else{
+      pFirst = pEdge;
+    }
+    pLast = pEdge;
+  }
+  sqlite3_finalize(pStmt);
+  return pFirst;
 }
 
 /*
@@ -407,7 +1736,13 @@ int graphValidateRelationshipType(GraphVtab *pVtab, const char *zType) {
 ** Returns SQLITE_OK on success.
 */
 int graphRebuildIndexes(GraphVtab *pVtab) {
-  (void)pVtab;
-  // This function is now a no-op, as indexing is handled by the underlying SQLite tables.
-  return SQLITE_OK;
+  int rc;
+
+  if( !pVtab ) return SQLITE_MISUSE;
+  /* The SQLite indexes on the backing tables maintain themselves; only
+  ** the label index and the edge type ids are derived data that can need
+  ** rebuilding. */
+  rc = graphCreateLabelIndex(pVtab, 0);
+  if( rc==SQLITE_OK && pVtab->zEdgeTableName ) rc = graphFillTypeIndex(pVtab);
+  return rc;
 }
\ No newline at end of file
@@ -219,7 +219,7 @@ static int graphDFSRecursive(GraphVtab *pVtab, sqlite3_int64 iNodeId,
     return SQLITE_NOMEM;
   }
   
-  zSql = sqlite3_mprintf("SELECT to_id FROM %s_edges WHERE from_id = %lld", pVtab->zTableName, iNodeId);
+  zSql = sqlite3_mprintf("SELECT to_id FROM %s WHERE from_id = %lld", pVtab->zEdgeTableName, iNodeId);
   rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0);
   sqlite3_free(zSql);
   if( rc!=SQLITE_OK ) return rc;
@@ -306,7 +306,7 @@ int graphBFS(GraphVtab *pVtab, sqlite3_int64 iStartId, int nMaxDepth,
       continue;
     }
     
-    zSql = sqlite3_mprintf("SELECT to_id FROM %s_edges WHERE from_id = %lld", pVtab->zTableName, iCurrentId);
+    zSql = sqlite3_mprintf("SELECT to_id FROM %s WHERE from_id = %lld", pVtab->zEdgeTableName, iCurrentId);
     rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0);
     sqlite3_free(zSql);
     if( rc!=SQLITE_OK ) continue;
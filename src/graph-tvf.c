@@ -2,8 +2,8 @@
 ** SQLite Graph Database Extension - Table-Valued Functions
 **
 ** This file implements table-valued functions for graph traversal including
-** graph_dfs() and graph_bfs(). These functions return virtual tables with
-** traversal results.
+** graph_dfs() and graph_bfs(), which return virtual tables with traversal
+** results, and graph_fulltext(), which searches a full-text index.
 **
 ** Table-valued functions are implemented as virtual tables in SQLite.
 ** Each function creates a specialized virtual table module.
@@ -452,6 +452,289 @@ static int graphDFSRowid(sqlite3_vtab_cursor *pCursor, sqlite3_int64 *pRowid){
   return SQLITE_OK;
 }
 
+/*
+** graph_fulltext(label, property, query) table-valued function.
+**
+** Runs an FTS5 query against the full-text index on property and returns
+** the matching nodes, best match first. The index scoped to label is
+** preferred; an index over all nodes is restricted to the label through
+** the label index. A NULL or empty label searches every indexed node.
+**
+** Columns: node_id, score (BM25 relevance, higher is better).
+*/
+typedef struct GraphFulltextCursor GraphFulltextCursor;
+struct GraphFulltextCursor {
+  sqlite3_vtab_cursor base;  /* Base class - must be first */
+  sqlite3_stmt *pStmt;       /* FTS5 query, NULL when exhausted */
+  sqlite3_int64 iRow;        /* Position in the result */
+};
+
+#define GRAPH_FULLTEXT_LABEL    2
+#define GRAPH_FULLTEXT_PROPERTY 3
+#define GRAPH_FULLTEXT_QUERY    4
+
+static int graphFulltextConnect(sqlite3 *pDb, void *pAux, int argc,
+                                const char *const *argv, sqlite3_vtab **ppVtab,
+                                char **pzErr){
+  sqlite3_vtab *pNew;
+  int rc;
+
+  UNUSED(pAux);
+  UNUSED(argc);
+  UNUSED(argv);
+  UNUSED(pzErr);
+
+  rc = sqlite3_declare_vtab(pDb, "CREATE TABLE x("
+                                 "node_id INTEGER,"
+                                 "score REAL,"
+                                 "label HIDDEN,"
+                                 "property HIDDEN,"
+                                 "query HIDDEN"
+                                 ")");
+  if( rc!=SQLITE_OK ){
+    return rc;
+  }
+  pNew = sqlite3_malloc(sizeof(*pNew));
+  if( pNew==0 ){
+    return SQLITE_NOMEM;
+  }
+  memset(pNew, 0, sizeof(*pNew));
+  *ppVtab = pNew;
+  return SQLITE_OK;
+}
+
+/*
+** The three arguments are required and passed in column order.
+*/
+static int graphFulltextBestIndex(sqlite3_vtab *pVtab, sqlite3_index_info *pInfo){
+  int aArg[3] = { -1, -1, -1 };
+  int i;
+
+  UNUSED(pVtab);
+
+  for( i=0; i<pInfo->nConstraint; i++ ){
+    int iCol = pInfo->aConstraint[i].iColumn;
+    if( iCol<GRAPH_FULLTEXT_LABEL ) continue;
+    if( !pInfo->aConstraint[i].usable ||
+        pInfo->aConstraint[i].op!=SQLITE_INDEX_CONSTRAINT_EQ ){
+      return SQLITE_CONSTRAINT;
+    }
+    aArg[iCol - GRAPH_FULLTEXT_LABEL] = i;
+  }
+  for( i=0; i<3; i++ ){
+    if( aArg[i]<0 ){
+      return SQLITE_CONSTRAINT;
+    }
+    pInfo->aConstraintUsage[aArg[i]].argvIndex = i + 1;
+    pInfo->aConstraintUsage[aArg[i]].omit = 1;
+  }
+
+  /* Rows come back best match first */
+  if( pInfo->nOrderBy==1 && pInfo->aOrderBy[0].iColumn==1 &&
+      pInfo->aOrderBy[0].desc ){
+    pInfo->orderByConsumed = 1;
+  }
+  pInfo->estimatedCost = 100.0;
+  pInfo->estimatedRows = 100;
+  return SQLITE_OK;
+}
+
+static int graphFulltextDisconnect(sqlite3_vtab *pVtab){
+  sqlite3_free(pVtab);
+  return SQLITE_OK;
+}
+
+static int graphFulltextOpen(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor){
+  GraphFulltextCursor *pCur;
+
+  UNUSED(pVtab);
+
+  pCur = sqlite3_malloc(sizeof(*pCur));
+  if( pCur==0 ){
+    return SQLITE_NOMEM;
+  }
+  memset(pCur, 0, sizeof(*pCur));
+  *ppCursor = &pCur->base;
+  return SQLITE_OK;
+}
+
+static int graphFulltextClose(sqlite3_vtab_cursor *pCursor){
+  GraphFulltextCursor *pCur = (GraphFulltextCursor*)pCursor;
+  sqlite3_finalize(pCur->pStmt);
+  sqlite3_free(pCur);
+  return SQLITE_OK;
+}
+
+static int graphFulltextNext(sqlite3_vtab_cursor *pCursor){
+  GraphFulltextCursor *pCur = (GraphFulltextCursor*)pCursor;
+  int rc = sqlite3_step(pCur->pStmt);
+
+  pCur->iRow++;
+  if( rc==SQLITE_ROW ){
+    return SQLITE_OK;
+  }
+  sqlite3_finalize(pCur->pStmt);
+  pCur->pStmt = 0;
+  return rc==SQLITE_DONE ? SQLITE_OK : rc;
+}
+
+/*
+** Find the index on the property and start the FTS5 query.
+*/
+static int graphFulltextFilter(sqlite3_vtab_cursor *pCursor, int idxNum,
+                               const char *idxStr, int argc, sqlite3_value **argv){
+  GraphFulltextCursor *pCur = (GraphFulltextCursor*)pCursor;
+  GraphVtab *pGraph = getGlobalGraph();
+  sqlite3_stmt *pFind = 0;
+  const char *zLabel;
+  const char *zProp;
+  char *zName = 0;
+  char *zSql;
+  int bScoped = 0;
+  int rc;
+
+  UNUSED(idxNum);
+  UNUSED(idxStr);
+
+  sqlite3_finalize(pCur->pStmt);
+  pCur->pStmt = 0;
+  pCur->iRow = 0;
+  if( argc!=3 ){
+    return SQLITE_ERROR;
+  }
+  if( !pGraph ){
+    sqlite3_free(pCursor->pVtab->zErrMsg);
+    pCursor->pVtab->zErrMsg = sqlite3_mprintf("No graph table available. Create a graph table first using: CREATE VIRTUAL TABLE mygraph USING graph();");
+    return SQLITE_ERROR;
+  }
+  zLabel = (const char*)sqlite3_value_text(argv[0]);
+  zProp = (const char*)sqlite3_value_text(argv[1]);
+  if( zLabel && !zLabel[0] ) zLabel = 0;
+
+  /* An index scoped to the label sorts before one over all nodes */
+  zSql = sqlite3_mprintf("SELECT name, label<>'' FROM %s_fulltext_indexes "
+                         "WHERE property=?1 AND label IN (?2, '') "
+                         "ORDER BY label DESC LIMIT 1", pGraph->zTableName);
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_prepare_v2(pGraph->pDb, zSql, -1, &pFind, 0);
+  sqlite3_free(zSql);
+  if( rc==SQLITE_OK ){
+    sqlite3_bind_text(pFind, 1, zProp, -1, SQLITE_STATIC);
+    sqlite3_bind_text(pFind, 2, zLabel ? zLabel : "", -1, SQLITE_STATIC);
+    if( sqlite3_step(pFind)==SQLITE_ROW ){
+      zName = sqlite3_mprintf("%s", sqlite3_column_text(pFind, 0));
+      bScoped = sqlite3_column_int(pFind, 1);
+      if( !zName ) rc = SQLITE_NOMEM;
+    }
+    sqlite3_finalize(pFind);
+  }
+  if( rc==SQLITE_OK && !zName ){
+    rc = SQLITE_ERROR;
+  }
+  if( rc!=SQLITE_OK ){
+    sqlite3_free(pCursor->pVtab->zErrMsg);
+    pCursor->pVtab->zErrMsg = sqlite3_mprintf(
+        "graph_fulltext(): no full-text index on %s%s%s",
+        zLabel ? zLabel : "", zLabel ? "." : "", zProp ? zProp : "NULL");
+    return rc;
+  }
+
+  if( zLabel && !bScoped ){
+    zSql = sqlite3_mprintf(
+        "SELECT \"%w\".rowid, -bm25(\"%w\") FROM \"%w\" "
+        "JOIN %s_label_index AS li ON li.node_id=\"%w\".rowid "
+        "JOIN %s_labels AS l ON l.id=li.label_id AND l.name=?2 "
+        "WHERE \"%w\" MATCH ?1 ORDER BY rank",
+        zName, zName, zName, pGraph->zTableName, zName,
+        pGraph->zTableName, zName);
+  }else{
+    zSql = sqlite3_mprintf(
+        "SELECT rowid, -bm25(\"%w\") FROM \"%w\" WHERE \"%w\" MATCH ?1 "
+        "ORDER BY rank", zName, zName, zName);
+  }
+  sqlite3_free(zName);
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_prepare_v2(pGraph->pDb, zSql, -1, &pCur->pStmt, 0);
+  sqlite3_free(zSql);
+  if( rc!=SQLITE_OK ){
+    sqlite3_free(pCursor->pVtab->zErrMsg);
+    pCursor->pVtab->zErrMsg = sqlite3_mprintf("%s", sqlite3_errmsg(pGraph->pDb));
+    return rc;
+  }
+  sqlite3_bind_value(pCur->pStmt, 1, argv[2]);
+  if( zLabel && !bScoped ){
+    sqlite3_bind_text(pCur->pStmt, 2, zLabel, -1, SQLITE_TRANSIENT);
+  }
+  pCur->iRow = -1;
+  rc = graphFulltextNext(pCursor);
+  if( rc!=SQLITE_OK ){
+    sqlite3_free(pCursor->pVtab->zErrMsg);
+    pCursor->pVtab->zErrMsg = sqlite3_mprintf("%s", sqlite3_errmsg(pGraph->pDb));
+  }
+  return rc;
+}
+
+static int graphFulltextEof(sqlite3_vtab_cursor *pCursor){
+  GraphFulltextCursor *pCur = (GraphFulltextCursor*)pCursor;
+  return pCur->pStmt==0;
+}
+
+static int graphFulltextColumn(sqlite3_vtab_cursor *pCursor, sqlite3_context *pCtx,
+                               int iCol){
+  GraphFulltextCursor *pCur = (GraphFulltextCursor*)pCursor;
+
+  switch( iCol ){
+    case 0:  /* node_id */
+      sqlite3_result_int64(pCtx, sqlite3_column_int64(pCur->pStmt, 0));
+      break;
+    case 1:  /* score */
+      sqlite3_result_double(pCtx, sqlite3_column_double(pCur->pStmt, 1));
+      break;
+    default: /* Arguments are consumed by xBestIndex */
+      sqlite3_result_null(pCtx);
+      break;
+  }
+  return SQLITE_OK;
+}
+
+static int graphFulltextRowid(sqlite3_vtab_cursor *pCursor, sqlite3_int64 *pRowid){
+  GraphFulltextCursor *pCur = (GraphFulltextCursor*)pCursor;
+  *pRowid = pCur->iRow;
+  return SQLITE_OK;
+}
+
+/*
+** Virtual table module for graph_fulltext(). Eponymous only: there is no
+** xCreate, so it cannot be instantiated with CREATE VIRTUAL TABLE.
+*/
+static sqlite3_module graphFulltextModule = {
+  0,                        /* iVersion */
+  0,                        /* xCreate */
+  graphFulltextConnect,     /* xConnect */
+  graphFulltextBestIndex,   /* xBestIndex */
+  graphFulltextDisconnect,  /* xDisconnect */
+  0,                        /* xDestroy */
+  graphFulltextOpen,        /* xOpen */
+  graphFulltextClose,       /* xClose */
+  graphFulltextFilter,      /* xFilter */
+  graphFulltextNext,        /* xNext */
+  graphFulltextEof,         /* xEof */
+  graphFulltextColumn,      /* xColumn */
+  graphFulltextRowid,       /* xRowid */
+  0,                        /* xUpdate */
+  0,                        /* xBegin */
+  0,                        /* xSync */
+  0,                        /* xCommit */
+  0,                        /* xRollback */
+  0,                        /* xFindFunction */
+  0,                        /* xRename */
+  0,                        /* xSavepoint */
+  0,                        /* xRelease */
+  0,                        /* xRollbackTo */
+  0,                        /* xShadowName */
+  0                         /* xIntegrity */
+};
+
 /*
 ** Register table-valued functions with SQLite.
 ** Called from main extension init function.
@@ -471,5 +754,11 @@ int graphRegisterTVF(sqlite3 *pDb){
     return rc;
   }
   
+  /* Register graph_fulltext() table-valued function */
+  rc = sqlite3_create_module(pDb, "graph_fulltext", &graphFulltextModule, 0);
+  if( rc!=SQLITE_OK ){
+    return rc;
+  }
+  
   return SQLITE_OK;
 }
\ No newline at end of file
@@ -0,0 +1,1613 @@
+/*
+** SQLite Graph Database Extension - Vector Indexes
+**
+** HNSW (hierarchical navigable small world) indexes over a node property
+** holding a fixed-dimension vector of floats, and the graph_knn()
+** table-valued function that finds the nearest neighbours of a query
+** vector through them.
+**
+** An HNSW index is a stack of proximity graphs. Every indexed node is in
+** layer 0; each node also appears in the layers above up to a random
+** level drawn from an exponential distribution, so that higher layers
+** are sparse. A search descends greedily from the single entry point in
+** the top layer and widens to a beam of ef candidates in layer 0.
+**
+** The index is persisted next to <graph>_nodes:
+**
+**   <index>_vectors(node_id, level, vector)      float32 vectors
+**   <index>_links(node_id, level, neighbors)     int64 neighbour lists
+**   <index>_pending(node_id)                     nodes written since
+**
+** and <graph>_vector_indexes records its parameters and entry point.
+** Triggers on the node table reject vectors of the wrong dimension and
+** queue the nodes they touch in <index>_pending; graph_knn() brings the
+** index up to date from the queue before searching. The triggers are
+** plain SQL, so any connection can write the node table, whether or not
+** it has loaded the extension or trusts the schema.
+**
+** Distances are computed with AVX2/FMA kernels when the CPU supports them.
+**
+** Memory allocation: All functions use sqlite3_malloc()/sqlite3_free()
+** Error handling: Functions return SQLite error codes
+*/
+
+#include "sqlite3ext.h"
+#ifndef SQLITE_CORE
+extern const sqlite3_api_routines *sqlite3_api;
+#endif
+/* SQLITE_EXTENSION_INIT1 - removed to prevent multiple definition */
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include "graph.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+    && !defined(GRAPH_NO_AVX2)
+# define GRAPH_VECTOR_AVX2 1
+# include <immintrin.h>
+#else
+# define GRAPH_VECTOR_AVX2 0
+#endif
+
+#define GRAPH_VECTOR_L2      1  /* Squared Euclidean distance */
+#define GRAPH_VECTOR_COSINE  2  /* 1 - cosine similarity */
+#define GRAPH_VECTOR_DOT     3  /* Negated dot product */
+
+#define GRAPH_VECTOR_MAX_DIMS  4096
+#define GRAPH_HNSW_MAX_LEVEL   16
+#define GRAPH_HNSW_DEFAULT_M   16
+#define GRAPH_HNSW_DEFAULT_EFC 64
+#define GRAPH_KNN_DEFAULT_K    10
+#define GRAPH_KNN_DEFAULT_EF   40
+
+/*
+** Distance kernels. Each returns the distance between two n-float
+** vectors under one metric; smaller is closer.
+*/
+static float graphVecL2Scalar(const float *a, const float *b, int n){
+  float s = 0.0f;
+  int i;
+  for(i=0; i<n; i++){
+    float d = a[i] - b[i];
+    s += d * d;
+  }
+  return s;
+}
+
+static float graphVecDotScalar(const float *a, const float *b, int n){
+  float s = 0.0f;
+  int i;
+  for(i=0; i<n; i++) s += a[i] * b[i];
+  return s;
+}
+
+static float graphVecCosineScalar(const float *a, const float *b, int n){
+  float ab = 0.0f, aa = 0.0f, bb = 0.0f;
+  int i;
+  for(i=0; i<n; i++){
+    ab += a[i] * b[i];
+    aa += a[i] * a[i];
+    bb += b[i] * b[i];
+  }
+  if( aa==0.0f || bb==0.0f ) return 1.0f;
+  return 1.0f - ab / sqrtf(aa * bb);
+}
+
+#if GRAPH_VECTOR_AVX2
+__attribute__((target("avx2,fma")))
+static float graphVecSum256(__m256 v){
+  __m128 lo = _mm256_castps256_ps128(v);
+  __m128 hi = _mm256_extractf128_ps(v, 1);
+  lo = _mm_add_ps(lo, hi);
+  lo = _mm_add_ps(lo, _mm_movehl_ps(lo, lo));
+  lo = _mm_add_ss(lo, _mm_shuffle_ps(lo, lo, 1));
+  return _mm_cvtss_f32(lo);
+}
+
+__attribute__((target("avx2,fma")))
+static float graphVecL2Avx2(const float *a, const float *b, int n){
+  __m256 acc = _mm256_setzero_ps();
+  float s;
+  int i;
+  for(i=0; i+8<=n; i+=8){
+    __m256 d = _mm256_sub_ps(_mm256_loadu_ps(&a[i]), _mm256_loadu_ps(&b[i]));
+    acc = _mm256_fmadd_ps(d, d, acc);
+  }
+  s = graphVecSum256(acc);
+  return s + graphVecL2Scalar(&a[i], &b[i], n - i);
+}
+
+__attribute__((target("avx2,fma")))
+static float graphVecDotAvx2(const float *a, const float *b, int n){
+  __m256 acc = _mm256_setzero_ps();
+  float s;
+  int i;
+  for(i=0; i+8<=n; i+=8){
+    acc = _mm256_fmadd_ps(_mm256_loadu_ps(&a[i]), _mm256_loadu_ps(&b[i]), acc);
+  }
+  s = graphVecSum256(acc);
+  return s + graphVecDotScalar(&a[i], &b[i], n - i);
+}
+
+__attribute__((target("avx2,fma")))
+static float graphVecCosineAvx2(const float *a, const float *b, int n){
+  __m256 vab = _mm256_setzero_ps();
+  __m256 vaa = _mm256_setzero_ps();
+  __m256 vbb = _mm256_setzero_ps();
+  float ab, aa, bb;
+  int i;
+  for(i=0; i+8<=n; i+=8){
+    __m256 va = _mm256_loadu_ps(&a[i]);
+    __m256 vb = _mm256_loadu_ps(&b[i]);
+    vab = _mm256_fmadd_ps(va, vb, vab);
+    vaa = _mm256_fmadd_ps(va, va, vaa);
+    vbb = _mm256_fmadd_ps(vb, vb, vbb);
+  }
+  ab = graphVecSum256(vab);
+  aa = graphVecSum256(vaa);
+  bb = graphVecSum256(vbb);
+  for(; i<n; i++){
+    ab += a[i] * b[i];
+    aa += a[i] * a[i];
+    bb += b[i] * b[i];
+  }
+  if( aa==0.0f || bb==0.0f ) return 1.0f;
+  return 1.0f - ab / sqrtf(aa * bb);
+}
+#endif
+
+static float graphVectorDistance(int eMetric, const float *a, const float *b,
+                                 int n){
+#if GRAPH_VECTOR_AVX2
+  static int bAvx2 = -1;
+  if( bAvx2<0 ){
+    __builtin_cpu_init();
+    bAvx2 = (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            ? 1 : 0;
+  }
+  if( bAvx2 ){
+    switch( eMetric ){
+      case GRAPH_VECTOR_COSINE: return graphVecCosineAvx2(a, b, n);
+      case GRAPH_VECTOR_DOT:    return -graphVecDotAvx2(a, b, n);
+      default:                  return graphVecL2Avx2(a, b, n);
+    }
+  }
+#endif
+  switch( eMetric ){
+    case GRAPH_VECTOR_COSINE: return graphVecCosineScalar(a, b, n);
+    case GRAPH_VECTOR_DOT:    return -graphVecDotScalar(a, b, n);
+    default:                  return graphVecL2Scalar(a, b, n);
+  }
+}
+
+/*
+** Return the GRAPH_VECTOR_* code of metric zMetric, or 0 if unknown.
+*/
+static int graphVectorMetric(const char *zMetric){
+  if( !zMetric ) return 0;
+  if( sqlite3_stricmp(zMetric, "l2")==0 ) return GRAPH_VECTOR_L2;
+  if( sqlite3_stricmp(zMetric, "cosine")==0 ) return GRAPH_VECTOR_COSINE;
+  if( sqlite3_stricmp(zMetric, "dot")==0 ) return GRAPH_VECTOR_DOT;
+  return 0;
+}
+
+/*
+** Read an nDim-float vector from pVal into aOut. A vector is a JSON array
+** of numbers or a blob of nDim native-endian float32 values. Returns
+** SQLITE_MISMATCH for anything else, including a wrong dimension.
+*/
+static int graphVectorParse(sqlite3_value *pVal, int nDim, float *aOut){
+  const char *z;
+  char *zEnd;
+  int n = 0;
+
+  if( sqlite3_value_type(pVal)==SQLITE_BLOB ){
+    if( sqlite3_value_bytes(pVal)!=nDim * (int)sizeof(float) ){
+      return SQLITE_MISMATCH;
+    }
+    memcpy(aOut, sqlite3_value_blob(pVal), nDim * sizeof(float));
+    return SQLITE_OK;
+  }
+  if( sqlite3_value_type(pVal)!=SQLITE_TEXT ) return SQLITE_MISMATCH;
+
+  z = (const char*)sqlite3_value_text(pVal);
+  while( *z==' ' || *z=='\t' || *z=='\n' || *z=='\r' ) z++;
+  if( *z++!='[' ) return SQLITE_MISMATCH;
+  for(;;){
+    double r;
+    while( *z==' ' || *z=='\t' || *z=='\n' || *z=='\r' ) z++;
+    if( *z==']' && n==0 ) break;
+    r = strtod(z, &zEnd);
+    if( zEnd==z || n>=nDim ) return SQLITE_MISMATCH;
+    aOut[n++] = (float)r;
+    z = zEnd;
+    while( *z==' ' || *z=='\t' || *z=='\n' || *z=='\r' ) z++;
+    if( *z==']' ) break;
+    if( *z++!=',' ) return SQLITE_MISMATCH;
+  }
+  return n==nDim ? SQLITE_OK : SQLITE_MISMATCH;
+}
+
+/*
+** Candidate heaps. A heap of (distance, node) pairs ordered closest first
+** (bMax==0) or furthest first (bMax!=0).
+*/
+typedef struct HnswCand HnswCand;
+struct HnswCand {
+  float rDist;
+  sqlite3_int64 iNode;
+};
+
+typedef struct HnswHeap HnswHeap;
+struct HnswHeap {
+  HnswCand *a;
+  int n;
+  int nAlloc;
+  int bMax;
+};
+
+static int hnswBefore(const HnswHeap *p, int i, int j){
+  return p->bMax ? p->a[i].rDist > p->a[j].rDist : p->a[i].rDist < p->a[j].rDist;
+}
+
+static int hnswHeapPush(HnswHeap *p, float rDist, sqlite3_int64 iNode){
+  int i;
+  if( p->n>=p->nAlloc ){
+    int nNew = p->nAlloc ? p->nAlloc*2 : 64;
+    HnswCand *aNew = sqlite3_realloc(p->a, nNew * sizeof(HnswCand));
+    if( !aNew ) return SQLITE_NOMEM;
+    p->a = aNew;
+    p->nAlloc = nNew;
+  }
+  i = p->n++;
+  p->a[i].rDist = rDist;
+  p->a[i].iNode = iNode;
+  while( i>0 && hnswBefore(p, i, (i-1)/2) ){
+    HnswCand t = p->a[i];
+    p->a[i] = p->a[(i-1)/2];
+    p->a[(i-1)/2] = t;
+    i = (i-1)/2;
+  }
+  return SQLITE_OK;
+}
+
+static HnswCand hnswHeapPop(HnswHeap *p){
+  HnswCand top = p->a[0];
+  int i = 0;
+  p->a[0] = p->a[--p->n];
+  for(;;){
+    int l = 2*i + 1, r = l + 1, m = i;
+    HnswCand t;
+    if( l<p->n && hnswBefore(p, l, m) ) m = l;
+    if( r<p->n && hnswBefore(p, r, m) ) m = r;
+    if( m==i ) break;
+    t = p->a[i];
+    p->a[i] = p->a[m];
+    p->a[m] = t;
+    i = m;
+  }
+  return top;
+}
+
+static int hnswCandCmp(const void *pA, const void *pB){
+  float a = ((const HnswCand*)pA)->rDist;
+  float b = ((const HnswCand*)pB)->rDist;
+  return a<b ? -1 : a>b ? 1 : 0;
+}
+
+/* Sort the entries of a heap closest first; it is no longer a heap */
+static void hnswHeapSort(HnswHeap *p){
+  qsort(p->a, p->n, sizeof(HnswCand), hnswCandCmp);
+}
+
+/*
+** Set of node ids visited by one search, open addressing.
+*/
+typedef struct HnswSeen HnswSeen;
+struct HnswSeen {
+  sqlite3_int64 *aKey;
+  unsigned char *aUsed;
+  int n;
+  int nAlloc;                 /* Power of two */
+};
+
+static unsigned int hnswHash(sqlite3_int64 i){
+  sqlite3_uint64 h = (sqlite3_uint64)i * 0x9E3779B97F4A7C15ULL;
+  return (unsigned int)(h >> 32);
+}
+
+static void hnswSeenFree(HnswSeen *p){
+  sqlite3_free(p->aKey);
+  sqlite3_free(p->aUsed);
+  memset(p, 0, sizeof(*p));
+}
+
+/* Add iNode; sets *pbNew if it was not in the set */
+static int hnswSeenAdd(HnswSeen *p, sqlite3_int64 iNode, int *pbNew){
+  unsigned int h;
+  if( (p->n+1)*2 > p->nAlloc ){
+    HnswSeen s;
+    int i, bDummy;
+    memset(&s, 0, sizeof(s));
+    s.nAlloc = p->nAlloc ? p->nAlloc*2 : 256;
+    s.aKey = sqlite3_malloc(s.nAlloc * sizeof(sqlite3_int64));
+    s.aUsed = sqlite3_malloc(s.nAlloc);
+    if( !s.aKey || !s.aUsed ){
+      hnswSeenFree(&s);
+      return SQLITE_NOMEM;
+    }
+    memset(s.aUsed, 0, s.nAlloc);
+    for(i=0; i<p->nAlloc; i++){
+      if( p->aUsed[i] ) hnswSeenAdd(&s, p->aKey[i], &bDummy);
+    }
+    hnswSeenFree(p);
+    *p = s;
+  }
+  h = hnswHash(iNode) & (p->nAlloc - 1);
+  while( p->aUsed[h] ){
+    if( p->aKey[h]==iNode ){
+      *pbNew = 0;
+      return SQLITE_OK;
+    }
+    h = (h + 1) & (p->nAlloc - 1);
+  }
+  p->aUsed[h] = 1;
+  p->aKey[h] = iNode;
+  p->n++;
+  *pbNew = 1;
+  return SQLITE_OK;
+}
+
+/*
+** An open HNSW index: its parameters and the statements that read and
+** write its shadow tables.
+*/
+typedef struct GraphHnsw GraphHnsw;
+struct GraphHnsw {
+  sqlite3 *pDb;
+  char *zGraph;               /* Graph table name */
+  char *zName;                /* Index name */
+  int nDim;                   /* Vector dimension */
+  int eMetric;                /* GRAPH_VECTOR_* */
+  int nM;                     /* Links per node above layer 0 */
+  int nEfConstruction;        /* Beam width while inserting */
+  sqlite3_int64 iEntry;       /* Entry point node */
+  int iMaxLevel;              /* Level of the entry point, -1 if empty */
+  float *aVec;                /* Scratch vector */
+  float *aBase;               /* Scratch vector */
+  sqlite3_stmt *pGetVec;      /* SELECT vector, level by node */
+  sqlite3_stmt *pPutVec;      /* Store a vector */
+  sqlite3_stmt *pDelVec;      /* Remove a vector */
+  sqlite3_stmt *pGetLinks;    /* SELECT neighbors by node and level */
+  sqlite3_stmt *pPutLinks;    /* Store a neighbour list */
+  sqlite3_stmt *pDelLinks;    /* Remove all lists of a node */
+  sqlite3_stmt *pGetEntry;    /* Read entry point from the catalog */
+  sqlite3_stmt *pPutEntry;    /* Write entry point to the catalog */
+};
+
+static void graphHnswClose(GraphHnsw *p){
+  if( !p ) return;
+  sqlite3_finalize(p->pGetVec);
+  sqlite3_finalize(p->pPutVec);
+  sqlite3_finalize(p->pDelVec);
+  sqlite3_finalize(p->pGetLinks);
+  sqlite3_finalize(p->pPutLinks);
+  sqlite3_finalize(p->pDelLinks);
+  sqlite3_finalize(p->pGetEntry);
+  sqlite3_finalize(p->pPutEntry);
+  sqlite3_free(p->aVec);
+  sqlite3_free(p->zGraph);
+  sqlite3_free(p->zName);
+  sqlite3_free(p);
+}
+
+static int graphHnswPrepare(GraphHnsw *p, sqlite3_stmt **ppStmt, char *zSql){
+  int rc;
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_prepare_v2(p->pDb, zSql, -1, ppStmt, 0);
+  sqlite3_free(zSql);
+  return rc;
+}
+
+/*
+** Read the entry point of the index from the catalog.
+*/
+static int graphHnswLoadEntry(GraphHnsw *p){
+  int rc;
+  sqlite3_bind_text(p->pGetEntry, 1, p->zName, -1, SQLITE_STATIC);
+  if( sqlite3_step(p->pGetEntry)==SQLITE_ROW ){
+    p->iEntry = sqlite3_column_int64(p->pGetEntry, 0);
+    p->iMaxLevel = sqlite3_column_type(p->pGetEntry, 0)==SQLITE_NULL
+                   ? -1 : sqlite3_column_int(p->pGetEntry, 1);
+  }
+  rc = sqlite3_reset(p->pGetEntry);
+  return rc;
+}
+
+static int graphHnswSaveEntry(GraphHnsw *p){
+  if( p->iMaxLevel<0 ){
+    sqlite3_bind_null(p->pPutEntry, 1);
+  }else{
+    sqlite3_bind_int64(p->pPutEntry, 1, p->iEntry);
+  }
+  sqlite3_bind_int(p->pPutEntry, 2, p->iMaxLevel);
+  sqlite3_bind_text(p->pPutEntry, 3, p->zName, -1, SQLITE_STATIC);
+  sqlite3_step(p->pPutEntry);
+  return sqlite3_reset(p->pPutEntry);
+}
+
+/*
+** Open index zName of graph zGraph. Returns SQLITE_ERROR if there is no
+** such index.
+*/
+static int graphHnswOpen(sqlite3 *pDb, const char *zGraph, const char *zName,
+                         GraphHnsw **pp){
+  GraphHnsw *p;
+  sqlite3_stmt *pStmt = 0;
+  char *zSql;
+  int rc;
+
+  *pp = 0;
+  p = sqlite3_malloc(sizeof(*p));
+  if( !p ) return SQLITE_NOMEM;
+  memset(p, 0, sizeof(*p));
+  p->pDb = pDb;
+  p->iMaxLevel = -1;
+  p->zGraph = sqlite3_mprintf("%s", zGraph);
+  p->zName = sqlite3_mprintf("%s", zName);
+  if( !p->zGraph || !p->zName ){
+    graphHnswClose(p);
+    return SQLITE_NOMEM;
+  }
+
+  zSql = sqlite3_mprintf("SELECT dims, metric, m, ef_construction "
+                         "FROM %s_vector_indexes WHERE name=?1", zGraph);
+  rc = graphHnswPrepare(p, &pStmt, zSql);
+  if( rc==SQLITE_OK ){
+    sqlite3_bind_text(pStmt, 1, zName, -1, SQLITE_STATIC);
+    if( sqlite3_step(pStmt)==SQLITE_ROW ){
+      p->nDim = sqlite3_column_int(pStmt, 0);
+      p->eMetric = graphVectorMetric((const char*)sqlite3_column_text(pStmt, 1));
+      p->nM = sqlite3_column_int(pStmt, 2);
+      p->nEfConstruction = sqlite3_column_int(pStmt, 3);
+    }
+    rc = sqlite3_finalize(pStmt);
+  }
+  if( rc==SQLITE_OK && (p->nDim<=0 || p->eMetric==0 || p->nM<2) ){
+    rc = SQLITE_ERROR;
+  }
+  if( rc==SQLITE_OK ){
+    p->aVec = sqlite3_malloc(2 * p->nDim * sizeof(float));
+    if( !p->aVec ) rc = SQLITE_NOMEM;
+    p->aBase = p->aVec + p->nDim;
+  }
+
+  if( rc==SQLITE_OK ) rc = graphHnswPrepare(p, &p->pGetVec, sqlite3_mprintf(
+      "SELECT vector, level FROM \"%w_vectors\" WHERE node_id=?1", zName));
+  if( rc==SQLITE_OK ) rc = graphHnswPrepare(p, &p->pPutVec, sqlite3_mprintf(
+      "INSERT OR REPLACE INTO \"%w_vectors\"(node_id, level, vector) "
+      "VALUES(?1, ?2, ?3)", zName));
+  if( rc==SQLITE_OK ) rc = graphHnswPrepare(p, &p->pDelVec, sqlite3_mprintf(
+      "DELETE FROM \"%w_vectors\" WHERE node_id=?1", zName));
+  if( rc==SQLITE_OK ) rc = graphHnswPrepare(p, &p->pGetLinks, sqlite3_mprintf(
+      "SELECT neighbors FROM \"%w_links\" WHERE node_id=?1 AND level=?2", zName));
+  if( rc==SQLITE_OK ) rc = graphHnswPrepare(p, &p->pPutLinks, sqlite3_mprintf(
+      "INSERT OR REPLACE INTO \"%w_links\"(node_id, level, neighbors) "
+      "VALUES(?1, ?2, ?3)", zName));
+  if( rc==SQLITE_OK ) rc = graphHnswPrepare(p, &p->pDelLinks, sqlite3_mprintf(
+      "DELETE FROM \"%w_links\" WHERE node_id=?1", zName));
+  if( rc==SQLITE_OK ) rc = graphHnswPrepare(p, &p->pGetEntry, sqlite3_mprintf(
+      "SELECT entry, max_level FROM %s_vector_indexes WHERE name=?1", zGraph));
+  if( rc==SQLITE_OK ) rc = graphHnswPrepare(p, &p->pPutEntry, sqlite3_mprintf(
+      "UPDATE %s_vector_indexes SET entry=?1, max_level=?2 WHERE name=?3", zGraph));
+  if( rc==SQLITE_OK ) rc = graphHnswLoadEntry(p);
+
+  if( rc!=SQLITE_OK ){
+    graphHnswClose(p);
+    return rc;
+  }
+  *pp = p;
+  return SQLITE_OK;
+}
+
+/*
+** Load the vector of iNode into aOut and its level into *piLevel (may be
+** NULL). Returns SQLITE_NOTFOUND if the node is not indexed.
+*/
+static int graphHnswLoad(GraphHnsw *p, sqlite3_int64 iNode, float *aOut,
+                         int *piLevel){
+  int rc = SQLITE_NOTFOUND;
+  sqlite3_bind_int64(p->pGetVec, 1, iNode);
+  if( sqlite3_step(p->pGetVec)==SQLITE_ROW &&
+      sqlite3_column_bytes(p->pGetVec, 0)==p->nDim * (int)sizeof(float) ){
+    if( aOut ){
+      memcpy(aOut, sqlite3_column_blob(p->pGetVec, 0), p->nDim * sizeof(float));
+    }
+    if( piLevel ) *piLevel = sqlite3_column_int(p->pGetVec, 1);
+    rc = SQLITE_OK;
+  }
+  sqlite3_reset(p->pGetVec);
+  return rc;
+}
+
+/*
+** Distance from aQuery to indexed node iNode.
+*/
+static int graphHnswDist(GraphHnsw *p, const float *aQuery, sqlite3_int64 iNode,
+                         float *prDist){
+  int rc = graphHnswLoad(p, iNode, p->aVec, 0);
+  if( rc==SQLITE_OK ){
+    *prDist = graphVectorDistance(p->eMetric, aQuery, p->aVec, p->nDim);
+  }
+  return rc;
+}
+
+/*
+** Read the neighbours of iNode in layer iLevel into a new array.
+*/
+static int graphHnswGetLinks(GraphHnsw *p, sqlite3_int64 iNode, int iLevel,
+                             sqlite3_int64 **paLink, int *pnLink){
+  int rc = SQLITE_OK;
+  *paLink = 0;
+  *pnLink = 0;
+  sqlite3_bind_int64(p->pGetLinks, 1, iNode);
+  sqlite3_bind_int(p->pGetLinks, 2, iLevel);
+  if( sqlite3_step(p->pGetLinks)==SQLITE_ROW ){
+    int nByte = sqlite3_column_bytes(p->pGetLinks, 0);
+    int n = nByte / (int)sizeof(sqlite3_int64);
+    if( n>0 ){
+      *paLink = sqlite3_malloc(n * sizeof(sqlite3_int64));
+      if( *paLink ){
+        memcpy(*paLink, sqlite3_column_blob(p->pGetLinks, 0),
+               n * sizeof(sqlite3_int64));
+        *pnLink = n;
+      }else{
+        rc = SQLITE_NOMEM;
+      }
+    }
+  }
+  sqlite3_reset(p->pGetLinks);
+  return rc;
+}
+
+static int graphHnswPutLinks(GraphHnsw *p, sqlite3_int64 iNode, int iLevel,
+                             const sqlite3_int64 *aLink, int nLink){
+  sqlite3_bind_int64(p->pPutLinks, 1, iNode);
+  sqlite3_bind_int(p->pPutLinks, 2, iLevel);
+  sqlite3_bind_blob(p->pPutLinks, 3, aLink ? (const void*)aLink : (const void*)"",
+                    nLink * (int)sizeof(sqlite3_int64), SQLITE_STATIC);
+  sqlite3_step(p->pPutLinks);
+  return sqlite3_reset(p->pPutLinks);
+}
+
+/*
+** Beam search of layer iLevel for aQuery, starting from the candidates in
+** pW. On return pW holds (as a max-heap) the ef closest nodes found.
+** Neighbours that are no longer indexed are skipped.
+*/
+static int graphHnswSearchLayer(GraphHnsw *p, const float *aQuery, int nEf,
+                                int iLevel, HnswHeap *pW){
+  HnswHeap cand;
+  HnswSeen seen;
+  int rc = SQLITE_OK;
+  int i, bNew;
+
+  memset(&cand, 0, sizeof(cand));
+  memset(&seen, 0, sizeof(seen));
+  for(i=0; i<pW->n && rc==SQLITE_OK; i++){
+    rc = hnswSeenAdd(&seen, pW->a[i].iNode, &bNew);
+    if( rc==SQLITE_OK ) rc = hnswHeapPush(&cand, pW->a[i].rDist, pW->a[i].iNode);
+  }
+  while( pW->n>nEf ) hnswHeapPop(pW);
+
+  while( rc==SQLITE_OK && cand.n>0 ){
+    HnswCand c = hnswHeapPop(&cand);
+    sqlite3_int64 *aLink;
+    int nLink;
+
+    if( pW->n>=nEf && c.rDist>pW->a[0].rDist ) break;
+    rc = graphHnswGetLinks(p, c.iNode, iLevel, &aLink, &nLink);
+    for(i=0; i<nLink && rc==SQLITE_OK; i++){
+      float rDist;
+      rc = hnswSeenAdd(&seen, aLink[i], &bNew);
+      if( rc!=SQLITE_OK || !bNew ) continue;
+      if( graphHnswDist(p, aQuery, aLink[i], &rDist)!=SQLITE_OK ) continue;
+      if( pW->n<nEf || rDist<pW->a[0].rDist ){
+        rc = hnswHeapPush(&cand, rDist, aLink[i]);
+        if( rc==SQLITE_OK ) rc = hnswHeapPush(pW, rDist, aLink[i]);
+        if( pW->n>nEf ) hnswHeapPop(pW);
+      }
+    }
+    sqlite3_free(aLink);
+  }
+  sqlite3_free(cand.a);
+  hnswSeenFree(&seen);
+  return rc;
+}
+
+/*
+** Descend from the entry point to layer iLevel+1 greedily and leave the
+** closest node found in pW, which must be an empty max-heap.
+*/
+static int graphHnswDescend(GraphHnsw *p, const float *aQuery, int iLevel,
+                            HnswHeap *pW){
+  float rDist;
+  int rc, l;
+
+  rc = graphHnswDist(p, aQuery, p->iEntry, &rDist);
+  if( rc!=SQLITE_OK ) return rc==SQLITE_NOTFOUND ? SQLITE_CORRUPT : rc;
+  rc = hnswHeapPush(pW, rDist, p->iEntry);
+  for(l=p->iMaxLevel; l>iLevel && rc==SQLITE_OK; l--){
+    rc = graphHnswSearchLayer(p, aQuery, 1, l, pW);
+  }
+  return rc;
+}
+
+/* Most links a node keeps in layer iLevel */
+static int graphHnswMaxLinks(GraphHnsw *p, int iLevel){
+  return iLevel==0 ? p->nM * 2 : p->nM;
+}
+
+/*
+** Choose up to nMax neighbours from the n candidates in a, sorted closest
+** first, writing their ids to aOut. This is the HNSW selection heuristic:
+** a candidate is taken only if it is closer to the base node than to every
+** neighbour already taken, so that links point in different directions
+** and outlying nodes stay reachable. Free slots are then filled with the
+** closest candidates passed over.
+*/
+static int graphHnswSelect(GraphHnsw *p, const HnswCand *a, int n, int nMax,
+                           sqlite3_int64 *aOut, int *pnOut){
+  float *aSel;
+  unsigned char *aTaken;
+  int nSel = 0;
+  int i, j;
+
+  *pnOut = 0;
+  if( n<=0 ) return SQLITE_OK;
+  aSel = sqlite3_malloc((nMax + 1) * p->nDim * sizeof(float) + n);
+  if( !aSel ) return SQLITE_NOMEM;
+  aTaken = (unsigned char*)&aSel[(nMax + 1) * p->nDim];
+  memset(aTaken, 0, n);
+
+  for(i=0; i<n && nSel<nMax; i++){
+    float *aCand = &aSel[nSel * p->nDim];
+    if( graphHnswLoad(p, a[i].iNode, aCand, 0)!=SQLITE_OK ) continue;
+    for(j=0; j<nSel; j++){
+      float r = graphVectorDistance(p->eMetric, aCand, &aSel[j * p->nDim], p->nDim);
+      if( r<a[i].rDist ) break;
+    }
+    if( j==nSel ){
+      aOut[nSel++] = a[i].iNode;
+      aTaken[i] = 1;
+    }
+  }
+  for(i=0; i<n && nSel<nMax; i++){
+    if( !aTaken[i] ) aOut[nSel++] = a[i].iNode;
+  }
+  sqlite3_free(aSel);
+  *pnOut = nSel;
+  return SQLITE_OK;
+}
+
+/*
+** Reduce the neighbour list aLink of the node with vector aBase to at
+** most nMax entries, dropping any that are no longer indexed. Updates
+** *pnLink.
+*/
+static int graphHnswPrune(GraphHnsw *p, const float *aBase,
+                          sqlite3_int64 *aLink, int *pnLink, int nMax){
+  HnswCand *a;
+  int i, n = 0;
+  int rc;
+
+  if( *pnLink==0 ) return SQLITE_OK;
+  a = sqlite3_malloc(*pnLink * sizeof(HnswCand));
+  if( !a ) return SQLITE_NOMEM;
+  for(i=0; i<*pnLink; i++){
+    if( graphHnswDist(p, aBase, aLink[i], &a[n].rDist)==SQLITE_OK ){
+      a[n++].iNode = aLink[i];
+    }
+  }
+  qsort(a, n, sizeof(HnswCand), hnswCandCmp);
+  rc = graphHnswSelect(p, a, n, nMax, aLink, pnLink);
+  sqlite3_free(a);
+  return rc;
+}
+
+/*
+** Add iNode to the neighbour list of iOther in layer iLevel, pruning the
+** list back to its limit around iOther.
+*/
+static int graphHnswLink(GraphHnsw *p, sqlite3_int64 iOther, int iLevel,
+                         sqlite3_int64 iNode){
+  sqlite3_int64 *aLink, *aNew;
+  int nLink, nMax = graphHnswMaxLinks(p, iLevel);
+  int rc;
+
+  rc = graphHnswGetLinks(p, iOther, iLevel, &aLink, &nLink);
+  if( rc!=SQLITE_OK ) return rc;
+  aNew = sqlite3_realloc(aLink, (nLink + 1) * sizeof(sqlite3_int64));
+  if( !aNew ){
+    sqlite3_free(aLink);
+    return SQLITE_NOMEM;
+  }
+  aNew[nLink++] = iNode;
+  if( nLink>nMax ){
+    rc = graphHnswLoad(p, iOther, p->aBase, 0);
+    if( rc==SQLITE_OK ) rc = graphHnswPrune(p, p->aBase, aNew, &nLink, nMax);
+  }
+  if( rc==SQLITE_OK ) rc = graphHnswPutLinks(p, iOther, iLevel, aNew, nLink);
+  sqlite3_free(aNew);
+  return rc;
+}
+
+/*
+** Draw the level of a new node: floor(-ln(U) / ln(M)).
+*/
+static int graphHnswRandomLevel(GraphHnsw *p){
+  sqlite3_uint64 r;
+  double u;
+  int iLevel;
+  sqlite3_randomness(sizeof(r), &r);
+  u = ((r >> 11) + 1) * (1.0 / 9007199254740993.0);
+  iLevel = (int)floor(-log(u) / log((double)p->nM));
+  return iLevel>GRAPH_HNSW_MAX_LEVEL ? GRAPH_HNSW_MAX_LEVEL : iLevel;
+}
+
+/*
+** Insert iNode with vector aVec, which must not alias the scratch
+** vectors. The node must not be in the index.
+*/
+static int graphHnswInsert(GraphHnsw *p, sqlite3_int64 iNode, const float *aVec){
+  HnswHeap w;
+  int iLevel = graphHnswRandomLevel(p);
+  int rc, l, i;
+
+  sqlite3_bind_int64(p->pPutVec, 1, iNode);
+  sqlite3_bind_int(p->pPutVec, 2, iLevel);
+  sqlite3_bind_blob(p->pPutVec, 3, aVec, p->nDim * (int)sizeof(float), SQLITE_STATIC);
+  sqlite3_step(p->pPutVec);
+  rc = sqlite3_reset(p->pPutVec);
+  if( rc!=SQLITE_OK ) return rc;
+
+  if( p->iMaxLevel<0 ){
+    p->iEntry = iNode;
+    p->iMaxLevel = iLevel;
+    return graphHnswSaveEntry(p);
+  }
+
+  memset(&w, 0, sizeof(w));
+  w.bMax = 1;
+  rc = graphHnswDescend(p, aVec, iLevel, &w);
+  for(l = iLevel<p->iMaxLevel ? iLevel : p->iMaxLevel; l>=0 && rc==SQLITE_OK; l--){
+    sqlite3_int64 *aLink;
+    int nLink, nMax = graphHnswMaxLinks(p, l);
+    HnswHeap next;
+
+    rc = graphHnswSearchLayer(p, aVec, p->nEfConstruction, l, &w);
+    if( rc!=SQLITE_OK ) break;
+
+    /* Link to a selection of the nodes found; all of them seed the next layer */
+    memset(&next, 0, sizeof(next));
+    next.bMax = 1;
+    aLink = sqlite3_malloc((w.n ? w.n : 1) * sizeof(sqlite3_int64));
+    if( !aLink ){
+      rc = SQLITE_NOMEM;
+      break;
+    }
+    hnswHeapSort(&w);
+    rc = graphHnswSelect(p, w.a, w.n, nMax, aLink, &nLink);
+    for(i=0; i<w.n && rc==SQLITE_OK; i++){
+      rc = hnswHeapPush(&next, w.a[i].rDist, w.a[i].iNode);
+    }
+    if( rc==SQLITE_OK ) rc = graphHnswPutLinks(p, iNode, l, aLink, nLink);
+    for(i=0; i<nLink && rc==SQLITE_OK; i++){
+      rc = graphHnswLink(p, aLink[i], l, iNode);
+    }
+    sqlite3_free(aLink);
+    sqlite3_free(w.a);
+    w = next;
+  }
+  sqlite3_free(w.a);
+
+  if( rc==SQLITE_OK && iLevel>p->iMaxLevel ){
+    p->iEntry = iNode;
+    p->iMaxLevel = iLevel;
+    rc = graphHnswSaveEntry(p);
+  }
+  return rc;
+}
+
+/*
+** Remove iNode from the index. Each of its neighbours loses the link and
+** is offered the node's other neighbours instead, so that the layer
+** stays connected. Removing a node that is not indexed is a no-op.
+*/
+static int graphHnswDelete(GraphHnsw *p, sqlite3_int64 iNode){
+  int iLevel, l, i, j;
+  int rc;
+
+  if( graphHnswLoad(p, iNode, 0, &iLevel)!=SQLITE_OK ) return SQLITE_OK;
+
+  sqlite3_bind_int64(p->pDelVec, 1, iNode);
+  sqlite3_step(p->pDelVec);
+  rc = sqlite3_reset(p->pDelVec);
+
+  for(l=0; l<=iLevel && rc==SQLITE_OK; l++){
+    sqlite3_int64 *aLink;
+    int nLink;
+    rc = graphHnswGetLinks(p, iNode, l, &aLink, &nLink);
+    for(i=0; i<nLink && rc==SQLITE_OK; i++){
+      sqlite3_int64 *aOther, *aNew;
+      int nOther, n = 0;
+      rc = graphHnswGetLinks(p, aLink[i], l, &aOther, &nOther);
+      if( rc!=SQLITE_OK ) break;
+      aNew = sqlite3_malloc((nOther + nLink) * sizeof(sqlite3_int64) + 1);
+      if( !aNew ){
+        sqlite3_free(aOther);
+        rc = SQLITE_NOMEM;
+        break;
+      }
+      for(j=0; j<nOther; j++){
+        if( aOther[j]!=iNode ) aNew[n++] = aOther[j];
+      }
+      for(j=0; j<nLink; j++){
+        int k;
+        if( j==i ) continue;
+        for(k=0; k<n && aNew[k]!=aLink[j]; k++){}
+        if( k==n ) aNew[n++] = aLink[j];
+      }
+      if( graphHnswLoad(p, aLink[i], p->aBase, 0)==SQLITE_OK ){
+        rc = graphHnswPrune(p, p->aBase, aNew, &n, graphHnswMaxLinks(p, l));
+        if( rc==SQLITE_OK ) rc = graphHnswPutLinks(p, aLink[i], l, aNew, n);
+      }
+      sqlite3_free(aOther);
+      sqlite3_free(aNew);
+    }
+    sqlite3_free(aLink);
+  }
+
+  if( rc==SQLITE_OK ){
+    sqlite3_bind_int64(p->pDelLinks, 1, iNode);
+    sqlite3_step(p->pDelLinks);
+    rc = sqlite3_reset(p->pDelLinks);
+  }
+
+  /* A new entry point is the highest remaining node */
+  if( rc==SQLITE_OK && p->iEntry==iNode ){
+    sqlite3_stmt *pStmt = 0;
+    p->iMaxLevel = -1;
+    rc = graphHnswPrepare(p, &pStmt, sqlite3_mprintf(
+        "SELECT node_id, level FROM \"%w_vectors\" ORDER BY level DESC LIMIT 1",
+        p->zName));
+    if( rc==SQLITE_OK ){
+      if( sqlite3_step(pStmt)==SQLITE_ROW ){
+        p->iEntry = sqlite3_column_int64(pStmt, 0);
+        p->iMaxLevel = sqlite3_column_int(pStmt, 1);
+      }
+      rc = sqlite3_finalize(pStmt);
+    }
+    if( rc==SQLITE_OK ) rc = graphHnswSaveEntry(p);
+  }
+  return rc;
+}
+
+/*
+** Find the nEf nodes closest to aQuery. On success *pW holds them sorted
+** closest first; the caller frees pW->a.
+*/
+static int graphHnswSearch(GraphHnsw *p, const float *aQuery, int nEf,
+                           HnswHeap *pW){
+  int rc;
+  memset(pW, 0, sizeof(*pW));
+  pW->bMax = 1;
+  if( p->iMaxLevel<0 ) return SQLITE_OK;
+  rc = graphHnswDescend(p, aQuery, 0, pW);
+  if( rc==SQLITE_OK ) rc = graphHnswSearchLayer(p, aQuery, nEf, 0, pW);
+  if( rc==SQLITE_OK ) hnswHeapSort(pW);
+  return rc;
+}
+
+/*
+** Vector indexes.
+*/
+
+#define GRAPH_VECTOR_CATALOG \
+  "CREATE TABLE IF NOT EXISTS %s_vector_indexes(" \
+  "name TEXT PRIMARY KEY, label TEXT NOT NULL DEFAULT '', " \
+  "property TEXT NOT NULL, dims INTEGER NOT NULL, metric TEXT NOT NULL, " \
+  "m INTEGER NOT NULL, ef_construction INTEGER NOT NULL, " \
+  "entry INTEGER, max_level INTEGER NOT NULL DEFAULT -1, " \
+  "UNIQUE(label, property));"
+
+/*
+** Name of the vector index on zProperty scoped to zLabel (NULL or "" for
+** all nodes). Caller must sqlite3_free() the result.
+*/
+char *graphVectorIndexName(GraphVtab *pVtab, const char *zLabel,
+                           const char *zProperty){
+  if( zLabel && zLabel[0] ){
+    return sqlite3_mprintf("%s_hnsw_%s.%s", pVtab->zTableName, zLabel, zProperty);
+  }
+  return sqlite3_mprintf("%s_hnsw_%s", pVtab->zTableName, zProperty);
+}
+
+/*
+** SQL that drops vector index zName of graph zGraph with its triggers
+** and shadow tables.
+*/
+static char *graphVectorDropSql(const char *zGraph, const char *zName){
+  return sqlite3_mprintf(
+    "DROP TRIGGER IF EXISTS \"%w_ai\";"
+    "DROP TRIGGER IF EXISTS \"%w_au\";"
+    "DROP TRIGGER IF EXISTS \"%w_ad\";"
+    "DROP TABLE IF EXISTS \"%w_vectors\";"
+    "DROP TABLE IF EXISTS \"%w_links\";"
+    "DROP TABLE IF EXISTS \"%w_pending\";"
+    GRAPH_VECTOR_CATALOG
+    "DELETE FROM %s_vector_indexes WHERE name=%Q;",
+    zName, zName, zName, zName, zName, zName, zGraph, zGraph, zName
+  );
+}
+
+/*
+** SQL expression for the vector of node table row zRow, or NULL if the
+** index on zProperty scoped to zLabel (NULL for all nodes) does not
+** cover the row. Caller must sqlite3_free() the result.
+*/
+static char *graphVectorExpr(const char *zRow, const char *zLabel,
+                             const char *zProperty){
+  if( zLabel ){
+    return sqlite3_mprintf(
+      "CASE WHEN json_valid(%s.properties) AND EXISTS(SELECT 1 FROM "
+      "json_each(CASE WHEN json_valid(%s.labels) THEN %s.labels "
+      "ELSE json_array(%s.labels) END) WHERE value=%Q) "
+      "THEN json_extract(%s.properties, '$.%q') END",
+      zRow, zRow, zRow, zRow, zLabel, zRow, zProperty);
+  }
+  return sqlite3_mprintf(
+    "CASE WHEN json_valid(%s.properties) "
+    "THEN json_extract(%s.properties, '$.%q') END",
+    zRow, zRow, zProperty);
+}
+
+/*
+** Bring index p on zProperty scoped to zLabel up to date with the nodes
+** queued in its pending table by the triggers. An empty queue is only
+** read, so searching an index that is current writes nothing.
+*/
+static int graphHnswApplyPending(GraphHnsw *p, const char *zNodes,
+                                 const char *zLabel, const char *zProperty){
+  sqlite3_stmt *pStmt = 0;
+  char *zVec;
+  float *aVec;
+  int nApplied = 0;
+  int rc;
+
+  zVec = graphVectorExpr("n", zLabel, zProperty);
+  rc = graphHnswPrepare(p, &pStmt, zVec ? sqlite3_mprintf(
+      "SELECT q.node_id, %s FROM \"%w_pending\" AS q "
+      "LEFT JOIN %s AS n ON n.id=q.node_id", zVec, p->zName, zNodes) : 0);
+  sqlite3_free(zVec);
+  if( rc!=SQLITE_OK ) return rc;
+
+  aVec = sqlite3_malloc(p->nDim * sizeof(float));
+  if( !aVec ) rc = SQLITE_NOMEM;
+  while( rc==SQLITE_OK && sqlite3_step(pStmt)==SQLITE_ROW ){
+    sqlite3_int64 iNode = sqlite3_column_int64(pStmt, 0);
+    nApplied++;
+    rc = graphHnswDelete(p, iNode);
+    if( rc==SQLITE_OK && sqlite3_column_type(pStmt, 1)!=SQLITE_NULL
+     && graphVectorParse(sqlite3_column_value(pStmt, 1), p->nDim, aVec)==SQLITE_OK ){
+      rc = graphHnswInsert(p, iNode, aVec);
+    }
+  }
+  sqlite3_free(aVec);
+  if( rc==SQLITE_OK ) rc = sqlite3_finalize(pStmt);
+  else sqlite3_finalize(pStmt);
+
+  if( rc==SQLITE_OK && nApplied>0 ){
+    char *zSql = sqlite3_mprintf("DELETE FROM \"%w_pending\"", p->zName);
+    rc = zSql ? sqlite3_exec(p->pDb, zSql, 0, 0, 0) : SQLITE_NOMEM;
+    sqlite3_free(zSql);
+  }
+  return rc;
+}
+
+/*
+** Create an HNSW index over the nDim-float vectors in zProperty, optionally
+** only for nodes with label zLabel, and index the existing nodes. zMetric
+** is "l2", "cosine" or "dot"; nM is the number of links per node and
+** nEfConstruction the beam width used while inserting. Re-creating an
+** index rebuilds it. Returns SQLITE_ERROR for invalid arguments, and
+** SQLITE_MISMATCH if a node to index holds something other than a vector
+** of nDim numbers.
+*/
+int graphCreateVectorIndex(GraphVtab *pVtab, const char *zLabel,
+                           const char *zProperty, int nDim, const char *zMetric,
+                           int nM, int nEfConstruction){
+  const char *zGraph;
+  const char *zNodes;
+  GraphHnsw *pHnsw = 0;
+  sqlite3_stmt *pStmt = 0;
+  char *zName;
+  char *zVecNew = 0;
+  char *zVecOld = 0;
+  char *zBad = 0;
+  char *zErr = 0;
+  char *zSql;
+  int rc;
+
+  if( !pVtab || !zProperty ) return SQLITE_MISUSE;
+  if( zLabel && !zLabel[0] ) zLabel = 0;
+  if( !zMetric ) zMetric = "l2";
+  if( !graphIsIdentifier(zProperty) || (zLabel && !graphIsIdentifier(zLabel)) ||
+      nDim<1 || nDim>GRAPH_VECTOR_MAX_DIMS || !graphVectorMetric(zMetric) ||
+      nM<2 || nM>256 || nEfConstruction<1 ){
+    return SQLITE_ERROR;
+  }
+  zGraph = pVtab->zTableName;
+  zNodes = pVtab->zNodeTableName;
+  if( !zNodes ) return SQLITE_MISUSE;
+
+  zName = graphVectorIndexName(pVtab, zLabel, zProperty);
+  if( !zName ) return SQLITE_NOMEM;
+  zSql = graphVectorDropSql(zGraph, zName);
+  rc = zSql ? sqlite3_exec(pVtab->pDb, zSql, 0, 0, 0) : SQLITE_NOMEM;
+  sqlite3_free(zSql);
+
+  /* The vector of row R, or NULL if R is not indexed */
+  if( rc==SQLITE_OK ){
+    zVecNew = graphVectorExpr("NEW", zLabel, zProperty);
+    zVecOld = graphVectorExpr("OLD", zLabel, zProperty);
+    if( !zVecNew || !zVecOld ) rc = SQLITE_NOMEM;
+  }
+
+  /* True if the new row is covered but holds no vector of nDim numbers */
+  if( rc==SQLITE_OK ){
+    zBad = sqlite3_mprintf(
+      "CASE WHEN (%s) IS NOT NULL THEN "
+      "json_type(NEW.properties, '$.%q')<>'array' "
+      "OR json_array_length(NEW.properties, '$.%q')<>%d "
+      "OR EXISTS(SELECT 1 FROM json_each(NEW.properties, '$.%q') "
+      "WHERE type NOT IN ('integer', 'real')) ELSE 0 END",
+      zVecNew, zProperty, zProperty, nDim, zProperty);
+    zErr = sqlite3_mprintf("vector index %s: node does not hold a vector "
+                           "of %d numbers", zName, nDim);
+    if( !zBad || !zErr ) rc = SQLITE_NOMEM;
+  }
+
+  if( rc==SQLITE_OK ){
+    zSql = sqlite3_mprintf(
+      GRAPH_VECTOR_CATALOG
+      "CREATE TABLE \"%w_vectors\"(node_id INTEGER PRIMARY KEY, "
+      "level INTEGER NOT NULL, vector BLOB NOT NULL);"
+      "CREATE TABLE \"%w_links\"(node_id INTEGER NOT NULL, level INTEGER NOT NULL, "
+      "neighbors BLOB NOT NULL, PRIMARY KEY(node_id, level)) WITHOUT ROWID;"
+      "CREATE TABLE \"%w_pending\"(node_id INTEGER PRIMARY KEY);"
+      "INSERT INTO %s_vector_indexes(name, label, property, dims, metric, m, "
+      "ef_construction) VALUES(%Q, %Q, %Q, %d, lower(%Q), %d, %d);"
+      "CREATE TRIGGER \"%w_ai\" AFTER INSERT ON %s "
+      "WHEN (%s) IS NOT NULL BEGIN "
+      "SELECT RAISE(ABORT, %Q) WHERE %s;"
+      "INSERT OR IGNORE INTO \"%w_pending\"(node_id) VALUES(NEW.id);"
+      "END;"
+      "CREATE TRIGGER \"%w_au\" AFTER UPDATE OF id, labels, properties ON %s "
+      "WHEN ((%s) IS NOT NULL OR (%s) IS NOT NULL) "
+      "AND (OLD.id<>NEW.id OR (%s) IS NOT (%s)) BEGIN "
+      "SELECT RAISE(ABORT, %Q) WHERE %s;"
+      "INSERT OR IGNORE INTO \"%w_pending\"(node_id) VALUES(OLD.id), (NEW.id);"
+      "END;"
+      "CREATE TRIGGER \"%w_ad\" AFTER DELETE ON %s "
+      "WHEN (%s) IS NOT NULL BEGIN "
+      "INSERT OR IGNORE INTO \"%w_pending\"(node_id) VALUES(OLD.id);"
+      "END;",
+      zGraph, zName, zName, zName,
+      zGraph, zName, zLabel ? zLabel : "", zProperty, nDim, zMetric, nM,
+      nEfConstruction,
+      zName, zNodes, zVecNew, zErr, zBad, zName,
+      zName, zNodes, zVecOld, zVecNew, zVecOld, zVecNew, zErr, zBad, zName,
+      zName, zNodes, zVecOld, zName
+    );
+    rc = zSql ? sqlite3_exec(pVtab->pDb, zSql, 0, 0, 0) : SQLITE_NOMEM;
+    sqlite3_free(zSql);
+  }
+
+  /* Index the nodes already in the graph */
+  if( rc==SQLITE_OK ) rc = graphHnswOpen(pVtab->pDb, zGraph, zName, &pHnsw);
+  if( rc==SQLITE_OK ){
+    char *zVec = graphVectorExpr("n", zLabel, zProperty);
+    zSql = zVec ? sqlite3_mprintf("SELECT n.id, %s FROM %s AS n", zVec, zNodes) : 0;
+    sqlite3_free(zVec);
+    rc = graphHnswPrepare(pHnsw, &pStmt, zSql);
+  }
+  if( rc==SQLITE_OK ){
+    float *aVec = sqlite3_malloc(nDim * sizeof(float));
+    if( !aVec ) rc = SQLITE_NOMEM;
+    while( rc==SQLITE_OK && sqlite3_step(pStmt)==SQLITE_ROW ){
+      if( sqlite3_column_type(pStmt, 1)==SQLITE_NULL ) continue;
+      rc = graphVectorParse(sqlite3_column_value(pStmt, 1), nDim, aVec);
+      if( rc==SQLITE_OK ){
+        rc = graphHnswInsert(pHnsw, sqlite3_column_int64(pStmt, 0), aVec);
+      }
+    }
+    sqlite3_free(aVec);
+    if( rc==SQLITE_OK ) rc = sqlite3_finalize(pStmt);
+    else sqlite3_finalize(pStmt);
+  }
+  graphHnswClose(pHnsw);
+  if( rc!=SQLITE_OK ){
+    /* Leave no half-built index behind */
+    zSql = graphVectorDropSql(zGraph, zName);
+    if( zSql ) sqlite3_exec(pVtab->pDb, zSql, 0, 0, 0);
+    sqlite3_free(zSql);
+  }
+  sqlite3_free(zVecNew);
+  sqlite3_free(zVecOld);
+  sqlite3_free(zBad);
+  sqlite3_free(zErr);
+  sqlite3_free(zName);
+  return rc;
+}
+
+/*
+** Drop an index created by graphCreateVectorIndex().
+** Dropping an index that does not exist is not an error.
+*/
+int graphDropVectorIndex(GraphVtab *pVtab, const char *zLabel,
+                         const char *zProperty){
+  char *zName;
+  char *zSql;
+  int rc;
+
+  if( !pVtab || !zProperty ) return SQLITE_MISUSE;
+  if( zLabel && !zLabel[0] ) zLabel = 0;
+  if( !graphIsIdentifier(zProperty) || (zLabel && !graphIsIdentifier(zLabel)) ){
+    return SQLITE_ERROR;
+  }
+  zName = graphVectorIndexName(pVtab, zLabel, zProperty);
+  if( !zName ) return SQLITE_NOMEM;
+  zSql = graphVectorDropSql(pVtab->zTableName, zName);
+  sqlite3_free(zName);
+  if( !zSql ) return SQLITE_NOMEM;
+  rc = sqlite3_exec(pVtab->pDb, zSql, 0, 0, 0);
+  sqlite3_free(zSql);
+  return rc;
+}
+
+/*
+** SQL function: graph_create_vector_index(label, property, dims
+**                                         [, metric [, m [, ef_construction]]])
+**
+** Index the dims-dimensional vectors in a node property for graph_knn(),
+** optionally only for nodes with a label ('' for all nodes). metric is
+** 'l2' (default), 'cosine' or 'dot'. Returns the index name.
+*/
+static void graphCreateVectorIndexFunc(sqlite3_context *pCtx, int argc,
+                                       sqlite3_value **argv){
+  GraphVtab *pGraph = getGlobalGraph();
+  const char *zLabel;
+  const char *zProp;
+  const char *zMetric;
+  int nDim, nM, nEfc;
+  int rc;
+
+  if( !pGraph ){
+    sqlite3_result_error(pCtx, "No graph table available. Create a graph table first using: CREATE VIRTUAL TABLE mygraph USING graph();", -1);
+    return;
+  }
+  if( argc<3 || argc>6 ){
+    sqlite3_result_error(pCtx, "graph_create_vector_index(): wrong number of arguments", -1);
+    return;
+  }
+  zLabel = (const char*)sqlite3_value_text(argv[0]);
+  zProp = (const char*)sqlite3_value_text(argv[1]);
+  nDim = sqlite3_value_int(argv[2]);
+  zMetric = argc>3 ? (const char*)sqlite3_value_text(argv[3]) : "l2";
+  nM = argc>4 ? sqlite3_value_int(argv[4]) : GRAPH_HNSW_DEFAULT_M;
+  nEfc = argc>5 ? sqlite3_value_int(argv[5]) : GRAPH_HNSW_DEFAULT_EFC;
+  if( !graphIsIdentifier(zProp) || (zLabel && zLabel[0] && !graphIsIdentifier(zLabel)) ){
+    sqlite3_result_error(pCtx, "graph_create_vector_index(): label and property "
+                               "must be plain identifiers", -1);
+    return;
+  }
+  if( nDim<1 || nDim>GRAPH_VECTOR_MAX_DIMS ){
+    sqlite3_result_error(pCtx, "graph_create_vector_index(): dims must be "
+                               "between 1 and 4096", -1);
+    return;
+  }
+  if( !graphVectorMetric(zMetric) ){
+    sqlite3_result_error(pCtx, "graph_create_vector_index(): metric must be "
+                               "'l2', 'cosine' or 'dot'", -1);
+    return;
+  }
+  if( nM<2 || nM>256 || nEfc<1 ){
+    sqlite3_result_error(pCtx, "graph_create_vector_index(): m must be between "
+                               "2 and 256 and ef_construction positive", -1);
+    return;
+  }
+  rc = graphCreateVectorIndex(pGraph, zLabel, zProp, nDim, zMetric, nM, nEfc);
+  if( rc==SQLITE_MISMATCH ){
+    char *zErr = sqlite3_mprintf("graph_create_vector_index(): a node holds a "
+                                 "value that is not a vector of %d numbers", nDim);
+    sqlite3_result_error(pCtx, zErr ? zErr : "vector dimension mismatch", -1);
+    sqlite3_free(zErr);
+  }else if( rc!=SQLITE_OK ){
+    sqlite3_result_error(pCtx, sqlite3_errmsg(pGraph->pDb), -1);
+    sqlite3_result_error_code(pCtx, rc);
+  }else{
+    sqlite3_result_text(pCtx, graphVectorIndexName(pGraph, zLabel, zProp),
+                        -1, sqlite3_free);
+  }
+}
+
+/*
+** SQL function: graph_drop_vector_index(label, property)
+**               graph_drop_vector_index(property)
+*/
+static void graphDropVectorIndexFunc(sqlite3_context *pCtx, int argc,
+                                     sqlite3_value **argv){
+  GraphVtab *pGraph = getGlobalGraph();
+  const char *zLabel;
+  const char *zProp;
+  int rc;
+
+  if( !pGraph ){
+    sqlite3_result_error(pCtx, "No graph table available. Create a graph table first using: CREATE VIRTUAL TABLE mygraph USING graph();", -1);
+    return;
+  }
+  if( argc<1 || argc>2 ){
+    sqlite3_result_error(pCtx, "graph_drop_vector_index(): wrong number of arguments", -1);
+    return;
+  }
+  zLabel = argc==2 ? (const char*)sqlite3_value_text(argv[0]) : 0;
+  zProp = (const char*)sqlite3_value_text(argv[argc-1]);
+  if( !graphIsIdentifier(zProp) || (zLabel && zLabel[0] && !graphIsIdentifier(zLabel)) ){
+    sqlite3_result_error(pCtx, "graph_drop_vector_index(): label and property "
+                               "must be plain identifiers", -1);
+    return;
+  }
+  rc = graphDropVectorIndex(pGraph, zLabel, zProp);
+  if( rc!=SQLITE_OK ){
+    sqlite3_result_error(pCtx, sqlite3_errmsg(pGraph->pDb), -1);
+    sqlite3_result_error_code(pCtx, rc);
+  }else{
+    sqlite3_result_int(pCtx, 1);
+  }
+}
+
+/*
+** graph_knn(label, property, query_vector [, k [, ef]]) table-valued
+** function.
+**
+** Returns the k nodes (default 10) whose vectors are closest to
+** query_vector, closest first, searching with a beam of ef candidates
+** (default max(k, 40)); a wider beam finds the true neighbours more
+** reliably. The index scoped to label is preferred; with an index over
+** all nodes the label filters the ef candidates, so fewer than k rows may
+** come back.
+**
+** Columns: node_id, distance.
+*/
+typedef struct GraphKnnCursor GraphKnnCursor;
+struct GraphKnnCursor {
+  sqlite3_vtab_cursor base;  /* Base class - must be first */
+  HnswCand *aResult;         /* Neighbours, closest first */
+  int nResult;
+  int iResult;               /* Current position */
+};
+
+#define GRAPH_KNN_LABEL    2
+#define GRAPH_KNN_PROPERTY 3
+#define GRAPH_KNN_QUERY    4
+#define GRAPH_KNN_K        5
+#define GRAPH_KNN_EF       6
+
+static int graphKnnConnect(sqlite3 *pDb, void *pAux, int argc,
+                           const char *const *argv, sqlite3_vtab **ppVtab,
+                           char **pzErr){
+  sqlite3_vtab *pNew;
+  int rc;
+
+  (void)pAux;
+  (void)argc;
+  (void)argv;
+  (void)pzErr;
+
+  rc = sqlite3_declare_vtab(pDb, "CREATE TABLE x("
+                                 "node_id INTEGER,"
+                                 "distance REAL,"
+                                 "label HIDDEN,"
+                                 "property HIDDEN,"
+                                 "query HIDDEN,"
+                                 "k HIDDEN,"
+                                 "ef HIDDEN"
+                                 ")");
+  if( rc!=SQLITE_OK ){
+    return rc;
+  }
+  pNew = sqlite3_malloc(sizeof(*pNew));
+  if( pNew==0 ){
+    return SQLITE_NOMEM;
+  }
+  memset(pNew, 0, sizeof(*pNew));
+  *ppVtab = pNew;
+  return SQLITE_OK;
+}
+
+/*
+** label, property and query are required; k and ef are optional. idxNum
+** has bit 0 set if k is passed and bit 1 if ef is.
+*/
+static int graphKnnBestIndex(sqlite3_vtab *pVtab, sqlite3_index_info *pInfo){
+  int aArg[5] = { -1, -1, -1, -1, -1 };
+  int nArg = 0;
+  int i;
+
+  (void)pVtab;
+
+  for(i=0; i<pInfo->nConstraint; i++){
+    int iCol = pInfo->aConstraint[i].iColumn;
+    if( iCol<GRAPH_KNN_LABEL ) continue;
+    if( !pInfo->aConstraint[i].usable ||
+        pInfo->aConstraint[i].op!=SQLITE_INDEX_CONSTRAINT_EQ ){
+      return SQLITE_CONSTRAINT;
+    }
+    aArg[iCol - GRAPH_KNN_LABEL] = i;
+  }
+  for(i=0; i<3; i++){
+    if( aArg[i]<0 ) return SQLITE_CONSTRAINT;
+  }
+  pInfo->idxNum = 0;
+  for(i=0; i<5; i++){
+    if( aArg[i]<0 ) continue;
+    pInfo->aConstraintUsage[aArg[i]].argvIndex = ++nArg;
+    pInfo->aConstraintUsage[aArg[i]].omit = 1;
+    if( i>=3 ) pInfo->idxNum |= 1 << (i - 3);
+  }
+
+  /* Rows come back closest first */
+  if( pInfo->nOrderBy==1 && pInfo->aOrderBy[0].iColumn==1 &&
+      !pInfo->aOrderBy[0].desc ){
+    pInfo->orderByConsumed = 1;
+  }
+  pInfo->estimatedCost = 100.0;
+  pInfo->estimatedRows = 10;
+  return SQLITE_OK;
+}
+
+static int graphKnnDisconnect(sqlite3_vtab *pVtab){
+  sqlite3_free(pVtab);
+  return SQLITE_OK;
+}
+
+static int graphKnnOpen(sqlite3_vtab *pVtab, sqlite3_vtab_cursor **ppCursor){
+  GraphKnnCursor *pCur;
+
+  (void)pVtab;
+
+  pCur = sqlite3_malloc(sizeof(*pCur));
+  if( pCur==0 ){
+    return SQLITE_NOMEM;
+  }
+  memset(pCur, 0, sizeof(*pCur));
+  *ppCursor = &pCur->base;
+  return SQLITE_OK;
+}
+
+static int graphKnnClose(sqlite3_vtab_cursor *pCursor){
+  GraphKnnCursor *pCur = (GraphKnnCursor*)pCursor;
+  sqlite3_free(pCur->aResult);
+  sqlite3_free(pCur);
+  return SQLITE_OK;
+}
+
+static int graphKnnError(sqlite3_vtab_cursor *pCursor, int rc, char *zMsg){
+  sqlite3_free(pCursor->pVtab->zErrMsg);
+  pCursor->pVtab->zErrMsg = zMsg;
+  return rc;
+}
+
+static int graphKnnFilter(sqlite3_vtab_cursor *pCursor, int idxNum,
+                          const char *idxStr, int argc, sqlite3_value **argv){
+  GraphKnnCursor *pCur = (GraphKnnCursor*)pCursor;
+  GraphVtab *pGraph = getGlobalGraph();
+  GraphHnsw *pHnsw = 0;
+  sqlite3_stmt *pStmt = 0;
+  HnswHeap w;
+  const char *zLabel;
+  const char *zProp;
+  char *zName = 0;
+  float *aQuery = 0;
+  int bScoped = 0;
+  int nK = GRAPH_KNN_DEFAULT_K;
+  int nEf = 0;
+  int iArg = 3;
+  int rc, i;
+
+  (void)idxStr;
+
+  sqlite3_free(pCur->aResult);
+  pCur->aResult = 0;
+  pCur->nResult = 0;
+  pCur->iResult = 0;
+  if( argc<3 ) return SQLITE_ERROR;
+  if( !pGraph ){
+    return graphKnnError(pCursor, SQLITE_ERROR, sqlite3_mprintf("No graph table available. Create a graph table first using: CREATE VIRTUAL TABLE mygraph USING graph();"));
+  }
+  zLabel = (const char*)sqlite3_value_text(argv[0]);
+  zProp = (const char*)sqlite3_value_text(argv[1]);
+  if( zLabel && !zLabel[0] ) zLabel = 0;
+  if( (idxNum & 1) && iArg<argc ) nK = sqlite3_value_int(argv[iArg++]);
+  if( (idxNum & 2) && iArg<argc ) nEf = sqlite3_value_int(argv[iArg++]);
+  if( nK<=0 ) return SQLITE_OK;
+  if( nEf<nK ) nEf = nK>GRAPH_KNN_DEFAULT_EF ? nK : GRAPH_KNN_DEFAULT_EF;
+
+  /* An index scoped to the label sorts before one over all nodes */
+  rc = SQLITE_OK;
+  {
+    char *zSql = sqlite3_mprintf("SELECT name, label<>'' FROM %s_vector_indexes "
+                                 "WHERE property=?1 AND label IN (?2, '') "
+                                 "ORDER BY label DESC LIMIT 1", pGraph->zTableName);
+    if( !zSql ) return SQLITE_NOMEM;
+    if( sqlite3_prepare_v2(pGraph->pDb, zSql, -1, &pStmt, 0)==SQLITE_OK ){
+      sqlite3_bind_text(pStmt, 1, zProp, -1, SQLITE_STATIC);
+      sqlite3_bind_text(pStmt, 2, zLabel ? zLabel : "", -1, SQLITE_STATIC);
+      if( sqlite3_step(pStmt)==SQLITE_ROW ){
+        zName = sqlite3_mprintf("%s", sqlite3_column_text(pStmt, 0));
+        bScoped = sqlite3_column_int(pStmt, 1);
+        if( !zName ) rc = SQLITE_NOMEM;
+      }
+    }
+    sqlite3_finalize(pStmt);
+    sqlite3_free(zSql);
+    pStmt = 0;
+  }
+  if( rc==SQLITE_OK && !zName ){
+    return graphKnnError(pCursor, SQLITE_ERROR, sqlite3_mprintf(
+        "graph_knn(): no vector index on %s%s%s",
+        zLabel ? zLabel : "", zLabel ? "." : "", zProp ? zProp : "NULL"));
+  }
+  if( rc==SQLITE_OK ) rc = graphHnswOpen(pGraph->pDb, pGraph->zTableName, zName, &pHnsw);
+  sqlite3_free(zName);
+  if( rc==SQLITE_OK ){
+    rc = graphHnswApplyPending(pHnsw, pGraph->zNodeTableName,
+                               bScoped ? zLabel : 0, zProp);
+    if( rc!=SQLITE_OK ) graphHnswClose(pHnsw);
+  }
+  if( rc!=SQLITE_OK ) return rc;
+
+  aQuery = sqlite3_malloc(pHnsw->nDim * sizeof(float));
+  if( !aQuery ){
+    graphHnswClose(pHnsw);
+    return SQLITE_NOMEM;
+  }
+  if( graphVectorParse(argv[2], pHnsw->nDim, aQuery)!=SQLITE_OK ){
+    rc = graphKnnError(pCursor, SQLITE_MISMATCH, sqlite3_mprintf(
+        "graph_knn(): query must be a vector of %d numbers", pHnsw->nDim));
+    sqlite3_free(aQuery);
+    graphHnswClose(pHnsw);
+    return rc;
+  }
+
+  rc = graphHnswSearch(pHnsw, aQuery, nEf, &w);
+  sqlite3_free(aQuery);
+  graphHnswClose(pHnsw);
+  if( rc!=SQLITE_OK ){
+    sqlite3_free(w.a);
+    return rc;
+  }
+
+  /* With an index over all nodes, keep only the label's nodes */
+  if( zLabel && !bScoped ){
+    char *zSql = sqlite3_mprintf(
+        "SELECT 1 FROM %s_label_index AS li JOIN %s_labels AS l "
+        "ON l.id=li.label_id WHERE li.node_id=?1 AND l.name=?2",
+        pGraph->zTableName, pGraph->zTableName);
+    rc = zSql ? sqlite3_prepare_v2(pGraph->pDb, zSql, -1, &pStmt, 0) : SQLITE_NOMEM;
+    sqlite3_free(zSql);
+    if( rc==SQLITE_OK ){
+      int n = 0;
+      sqlite3_bind_text(pStmt, 2, zLabel, -1, SQLITE_TRANSIENT);
+      for(i=0; i<w.n && n<nK; i++){
+        sqlite3_bind_int64(pStmt, 1, w.a[i].iNode);
+        if( sqlite3_step(pStmt)==SQLITE_ROW ) w.a[n++] = w.a[i];
+        sqlite3_reset(pStmt);
+      }
+      w.n = n;
+      sqlite3_finalize(pStmt);
+    }
+  }
+  if( rc!=SQLITE_OK ){
+    sqlite3_free(w.a);
+    return rc;
+  }
+  pCur->aResult = w.a;
+  pCur->nResult = w.n<nK ? w.n : nK;
+  return SQLITE_OK;
+}
+
+static int graphKnnNext(sqlite3_vtab_cursor *pCursor){
+  GraphKnnCursor *pCur = (GraphKnnCursor*)pCursor;
+  pCur->iResult++;
+  return SQLITE_OK;
+}
+
+static int graphKnnEof(sqlite3_vtab_cursor *pCursor){
+  GraphKnnCursor *pCur = (GraphKnnCursor*)pCursor;
+  return pCur->iResult>=pCur->nResult;
+}
+
+static int graphKnnColumn(sqlite3_vtab_cursor *pCursor, sqlite3_context *pCtx,
+                          int iCol){
+  GraphKnnCursor *pCur = (GraphKnnCursor*)pCursor;
+  HnswCand *p = &pCur->aResult[pCur->iResult];
+
+  switch( iCol ){
+    case 0:  /* node_id */
+      sqlite3_result_int64(pCtx, p->iNode);
+      break;
+    case 1:  /* distance */
+      sqlite3_result_double(pCtx, p->rDist);
+      break;
+    default: /* Arguments are consumed by xBestIndex */
+      sqlite3_result_null(pCtx);
+      break;
+  }
+  return SQLITE_OK;
+}
+
+static int graphKnnRowid(sqlite3_vtab_cursor *pCursor, sqlite3_int64 *pRowid){
+  GraphKnnCursor *pCur = (GraphKnnCursor*)pCursor;
+  *pRowid = pCur->iResult;
+  return SQLITE_OK;
+}
+
+/*
+** Virtual table module for graph_knn(). Eponymous only.
+*/
+static sqlite3_module graphKnnModule = {
+  0,                      /* iVersion */
+  0,                      /* xCreate */
+  graphKnnConnect,        /* xConnect */
+  graphKnnBestIndex,      /* xBestIndex */
+  graphKnnDisconnect,     /* xDisconnect */
+  0,                      /* xDestroy */
+  graphKnnOpen,           /* xOpen */
+  graphKnnClose,          /* xClose */
+  graphKnnFilter,         /* xFilter */
+  graphKnnNext,           /* xNext */
+  graphKnnEof,            /* xEof */
+  graphKnnColumn,         /* xColumn */
+  graphKnnRowid,          /* xRowid */
+  0,                      /* xUpdate */
+  0,                      /* xBegin */
+  0,                      /* xSync */
+  0,                      /* xCommit */
+  0,                      /* xRollback */
+  0,                      /* xFindFunction */
+  0,                      /* xRename */
+  0,                      /* xSavepoint */
+  0,                      /* xRelease */
+  0,                      /* xRollbackTo */
+  0,                      /* xShadowName */
+  0                       /* xIntegrity */
+};
+
+/*
+** Register the vector index SQL functions and graph_knn().
+*/
+int graphRegisterVectorFunctions(sqlite3 *pDb){
+  int rc;
+  rc = sqlite3_create_function(pDb, "graph_create_vector_index", -1, SQLITE_UTF8,
+                               0, graphCreateVectorIndexFunc, 0, 0);
+  if( rc==SQLITE_OK ){
+    rc = sqlite3_create_function(pDb, "graph_drop_vector_index", -1, SQLITE_UTF8,
+                                 0, graphDropVectorIndexFunc, 0, 0);
+  }
+  if( rc==SQLITE_OK ){
+    rc = sqlite3_create_module(pDb, "graph_knn", &graphKnnModule, 0);
+  }
+  return rc;
+}
@@ -19,6 +19,7 @@ extern const sqlite3_api_routines *sqlite3_api;
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 /* Forward declaration for the update function */
 static int graphUpdate(sqlite3_vtab *pVtab, int argc, sqlite3_value **argv, sqlite3_int64 *pRowid);
@@ -60,6 +61,174 @@ sqlite3_module graphModule = {
   0                     /* xIntegrity */
 };
 
+/*
+** Column numbers of the graph virtual table, in declaration order.
+*/
+#define GRAPH_COL_TYPE        0
+#define GRAPH_COL_ID          1
+#define GRAPH_COL_FROM_ID     2
+#define GRAPH_COL_TO_ID       3
+#define GRAPH_COL_LABELS      4
+#define GRAPH_COL_REL_TYPE    5
+#define GRAPH_COL_WEIGHT      6
+#define GRAPH_COL_PROPERTIES  7
+#define GRAPH_COL_QUERY       8
+
+/*
+** Edge rowids are tagged with this bit so they never collide with the
+** rowids of nodes, which are the node ids themselves.
+*/
+#define GRAPH_EDGE_ROWID_FLAG  (((sqlite3_int64)1)<<62)
+
+/*
+** idxNum bits chosen by graphBestIndex(). GRAPH_SCAN_NODES and
+** GRAPH_SCAN_EDGES say which backing tables the plan visits at all.
+** GRAPH_SCAN_ORDERED means idxStr carries an ORDER BY clause after ';'.
+** GRAPH_SCAN_LAZY_PROPS defers reading properties to graphColumn().
+** The vtab columns the statement uses are stored from GRAPH_SCAN_COLS_SHIFT
+** upwards, one bit per column as in sqlite3_index_info.colUsed.
+*/
+#define GRAPH_SCAN_NODES       0x01
+#define GRAPH_SCAN_EDGES       0x02
+#define GRAPH_SCAN_ORDERED     0x04
+#define GRAPH_SCAN_LAZY_PROPS  0x08
+#define GRAPH_SCAN_COLS_SHIFT  8
+
+/*
+** Constraint codes stored in idxStr, one character per xFilter argument.
+** Lower case is a single "=" value, upper case an IN list that is passed
+** to xFilter all at once (see sqlite3_vtab_in()).
+*/
+#define GRAPH_TERM_ROWID     'r'   /* rowid = ?, value is a tagged rowid */
+#define GRAPH_TERM_ID        'i'   /* id = ? on both tables */
+#define GRAPH_TERM_TYPE      't'   /* type = 'node' / 'edge' */
+#define GRAPH_TERM_FROM_ID   'f'   /* from_id = ? (edges) */
+#define GRAPH_TERM_TO_ID     'o'   /* to_id = ? (edges) */
+#define GRAPH_TERM_REL_TYPE  'y'   /* rel_type = ? (edges) */
+#define GRAPH_TERM_LABELS    'l'   /* labels = ? (nodes) */
+
+/*
+** Assumed number of values in an IN list when costing a plan. SQLite does
+** not tell xBestIndex how long the list on the right-hand side is.
+*/
+#define GRAPH_IN_LIST_ESTIMATE  4
+
+/*
+** Work out the backing table names. CREATE VIRTUAL TABLE g USING graph()
+** stores its data in g_nodes and g_edges; graph(nodes, edges) names
+** existing tables explicitly.
+*/
+static int graphSetBackingTableNames(GraphVtab *pNew, int argc,
+                                     const char *const *argv){
+  if( argc>=5 ){
+    pNew->zNodeTableName = sqlite3_mprintf("%s", argv[3]);
+    pNew->zEdgeTableName = sqlite3_mprintf("%s", argv[4]);
+  }else{
+    pNew->zNodeTableName = sqlite3_mprintf("%s_nodes", argv[2]);
+    pNew->zEdgeTableName = sqlite3_mprintf("%s_edges", argv[2]);
+  }
+  if( pNew->zNodeTableName==0 || pNew->zEdgeTableName==0 ){
+    return SQLITE_NOMEM;
+  }
+  return SQLITE_OK;
+}
+
+/*
+** Add column zCol with type zType to the edge table if the table lacks it.
+** The existing columns are read with PRAGMA table_info.
+*/
+static int graphAddEdgeColumn(GraphVtab *pNew, const char *zCol,
+                              const char *zType){
+  sqlite3_stmt *pStmt = 0;
+  char *zSql;
+  int bFound = 0;
+  int rc;
+
+  zSql = sqlite3_mprintf("PRAGMA table_info(%Q)", pNew->zEdgeTableName);
+  if( zSql==0 ) return SQLITE_NOMEM;
+  rc = sqlite3_prepare_v2(pNew->pDb, zSql, -1, &pStmt, 0);
+  sqlite3_free(zSql);
+  if( rc!=SQLITE_OK ) return rc;
+  while( !bFound && sqlite3_step(pStmt)==SQLITE_ROW ){
+    const char *zName = (const char*)sqlite3_column_text(pStmt, 1);
+    bFound = zName && sqlite3_stricmp(zName, zCol)==0;
+  }
+  rc = sqlite3_finalize(pStmt);
+  if( rc!=SQLITE_OK || bFound ) return rc;
+
+  zSql = sqlite3_mprintf("ALTER TABLE %s ADD COLUMN %s %s",
+                         pNew->zEdgeTableName, zCol, zType);
+  if( zSql==0 ) return SQLITE_NOMEM;
+  sqlite3_exec(pNew->pDb, zSql, 0, 0, 0);
+  sqlite3_free(zSql);
+  return SQLITE_OK;
+}
+
+/*
+** Create the backing tables if they are missing, together with the
+** indexes xFilter relies on for from_id, to_id and relationship type
+** lookups, the label index and the relationship type index.
+** Edge tables in this layout that predate the rel_type or type_id
+** columns gain them here.
+** Index creation is best effort: tables supplied by the user may use a
+** different layout, in which case the vtab still works by scanning.
+*/
+static int graphInitBackingTables(GraphVtab *pNew, char **pzErr){
+  char *zSql;
+  int rc;
+
+  zSql = sqlite3_mprintf(
+    "CREATE TABLE IF NOT EXISTS %s(id INTEGER PRIMARY KEY, labels TEXT DEFAULT '[]', properties TEXT DEFAULT '{}');"
+    "CREATE TABLE IF NOT EXISTS %s(id INTEGER PRIMARY KEY, from_id INTEGER, to_id INTEGER, weight REAL, labels TEXT DEFAULT '[]', properties TEXT DEFAULT '{}', rel_type TEXT, type_id INTEGER);",
+    pNew->zNodeTableName, pNew->zEdgeTableName
+  );
+  if( zSql==0 ) return SQLITE_NOMEM;
+  rc = sqlite3_exec(pNew->pDb, zSql, 0, 0, pzErr);
+  sqlite3_free(zSql);
+  if( rc!=SQLITE_OK ) return rc;
+
+  rc = graphAddEdgeColumn(pNew, "rel_type", "TEXT");
+  if( rc!=SQLITE_OK ) return rc;
+  rc = graphAddEdgeColumn(pNew, "type_id", "INTEGER");
+  if( rc!=SQLITE_OK ) return rc;
+
+  /* (from_id, type_id) and (to_id, type_id) serve both untyped lookups,
+  ** through their prefix, and typed expansion. Databases written before
+  ** type_id existed keep their single column from_id/to_id/rel_type
+  ** indexes, as a btree cannot be dropped from within xCreate/xConnect. */
+  zSql = sqlite3_mprintf(
+    "CREATE INDEX IF NOT EXISTS %s_from_type ON %s(from_id, type_id);"
+    "CREATE INDEX IF NOT EXISTS %s_to_type ON %s(to_id, type_id);"
+    "CREATE INDEX IF NOT EXISTS %s_type_id ON %s(type_id);",
+    pNew->zEdgeTableName, pNew->zEdgeTableName,
+    pNew->zEdgeTableName, pNew->zEdgeTableName,
+    pNew->zEdgeTableName, pNew->zEdgeTableName
+  );
+  if( zSql==0 ) return SQLITE_NOMEM;
+  sqlite3_exec(pNew->pDb, zSql, 0, 0, 0);
+  sqlite3_free(zSql);
+
+  /* Also best effort: a node table without a labels column simply has
+  ** nothing to index, and likewise edges without rel_type. */
+  graphInitLabelIndex(pNew);
+  pNew->bTypeIndex = graphInitTypeIndex(pNew)==SQLITE_OK;
+
+  return SQLITE_OK;
+}
+
+/*
+** Free a GraphVtab that failed to initialize.
+*/
+static void graphVtabFree(GraphVtab *pVtab){
+  sqlite3_free(pVtab->zDbName);
+  sqlite3_free(pVtab->zTableName);
+  sqlite3_free(pVtab->zNodeTableName);
+  sqlite3_free(pVtab->zEdgeTableName);
+  graphDestroySchema(pVtab->pSchema);
+  graphBitmapCacheDestroy(pVtab->pBitmapCache);
+  sqlite3_free(pVtab);
+}
+
 /*
 ** Create a new virtual table instance.
 ** Called when CREATE VIRTUAL TABLE is executed.
@@ -97,29 +266,9 @@ int graphCreate(sqlite3 *pDb, void *pAux, int argc,
   /* Copy database and table names */
   pNew->zDbName = sqlite3_mprintf("%s", argv[1]);
   pNew->zTableName = sqlite3_mprintf("%s", argv[2]);
-/* 
- * Minimal patch for graphCreate to support custom table names
- * This adds the logic after the original table name copying
- */
-
-  /* Parse node and edge table names from arguments if provided */
-  if (argc >= 5) {
-    /* Custom table names: CREATE VIRTUAL TABLE graph USING graph(nodes_table, edges_table) */
-    pNew->zNodeTableName = sqlite3_mprintf("%s", argv[3]);
-    pNew->zEdgeTableName = sqlite3_mprintf("%s", argv[4]);
-  } else {
-    /* Default: use virtual table name with _nodes and _edges suffixes */
-    pNew->zNodeTableName = sqlite3_mprintf("%s", argv[2]);
-    pNew->zEdgeTableName = sqlite3_mprintf("%s", argv[2]);
-  }
-  
-  
-  if( pNew->zDbName==0 || pNew->zTableName==0 || pNew->zNodeTableName==0 || pNew->zEdgeTableName==0 ){
-    sqlite3_free(pNew->zDbName);
-    sqlite3_free(pNew->zTableName);
-    sqlite3_free(pNew->zNodeTableName);
-    sqlite3_free(pNew->zEdgeTableName);
-    sqlite3_free(pNew);
+  rc = graphSetBackingTableNames(pNew, argc, argv);
+  if( rc!=SQLITE_OK || pNew->zDbName==0 || pNew->zTableName==0 ){
+    graphVtabFree(pNew);
     return SQLITE_NOMEM;
   }
   
@@ -139,30 +288,15 @@ int graphCreate(sqlite3 *pDb, void *pAux, int argc,
   );
   
   if( rc!=SQLITE_OK ){
-    sqlite3_free(pNew->zDbName);
-    sqlite3_free(pNew->zTableName);
-    sqlite3_free(pNew->zNodeTableName);
-    sqlite3_free(pNew->zEdgeTableName);
-    sqlite3_free(pNew);
+    graphVtabFree(pNew);
     *pzErr = sqlite3_mprintf("Failed to declare vtab schema: %s", 
                              sqlite3_errmsg(pDb));
     return rc;
   }
 
-  char *zSql = sqlite3_mprintf(
-    "CREATE TABLE IF NOT EXISTS %s(id INTEGER PRIMARY KEY, labels TEXT DEFAULT '[]', properties TEXT DEFAULT '{}');" 
-    "CREATE TABLE IF NOT EXISTS %s(id INTEGER PRIMARY KEY, from_id INTEGER, to_id INTEGER, weight REAL, labels TEXT DEFAULT '[]', properties TEXT DEFAULT '{}');",
-    pNew->zNodeTableName, pNew->zEdgeTableName
-  );
-  rc = sqlite3_exec(pDb, zSql, 0, 0, pzErr);
-  sqlite3_free(zSql);
-
+  rc = graphInitBackingTables(pNew, pzErr);
   if( rc!=SQLITE_OK ){
-    sqlite3_free(pNew->zDbName);
-    sqlite3_free(pNew->zTableName);
-    sqlite3_free(pNew->zNodeTableName);
-    sqlite3_free(pNew->zEdgeTableName);
-    sqlite3_free(pNew);
+    graphVtabFree(pNew);
     return rc;
   }
   
@@ -181,9 +315,6 @@ int graphConnect(sqlite3 *pDb, void *pAux, int argc,
                  const char *const *argv, sqlite3_vtab **ppVtab,
                  char **pzErr){
   (void)pAux;
-  (void)argc;
-  (void)argv;
-  (void)pzErr;
   GraphVtab *pNew;
   int rc = SQLITE_OK;
 
@@ -199,13 +330,9 @@ int graphConnect(sqlite3 *pDb, void *pAux, int argc,
   
   pNew->zDbName = sqlite3_mprintf("%s", argv[1]);
   pNew->zTableName = sqlite3_mprintf("%s", argv[2]);
-  
-  if( pNew->zDbName==0 || pNew->zTableName==0 || pNew->zNodeTableName==0 || pNew->zEdgeTableName==0 ){
-    sqlite3_free(pNew->zDbName);
-    sqlite3_free(pNew->zTableName);
-    sqlite3_free(pNew->zNodeTableName);
-    sqlite3_free(pNew->zEdgeTableName);
-    sqlite3_free(pNew);
+  rc = graphSetBackingTableNames(pNew, argc, argv);
+  if( rc!=SQLITE_OK || pNew->zDbName==0 || pNew->zTableName==0 ){
+    graphVtabFree(pNew);
     return SQLITE_NOMEM;
   }
   
@@ -224,52 +351,19 @@ int graphConnect(sqlite3 *pDb, void *pAux, int argc,
   );
   
   if( rc!=SQLITE_OK ){
-    sqlite3_free(pNew->zDbName);
-    sqlite3_free(pNew->zTableName);
-    sqlite3_free(pNew->zNodeTableName);
-    sqlite3_free(pNew->zEdgeTableName);
-    sqlite3_free(pNew);
+    graphVtabFree(pNew);
     *pzErr = sqlite3_mprintf("Failed to declare vtab schema: %s", 
                              sqlite3_errmsg(pDb));
     return rc;
   }
 
-  /* xConnect: Connect to existing virtual table - backing tables should already exist */
-  /* But since extensions may be loaded after database open, we need to handle missing tables gracefully */
-  char *zCheckSql = sqlite3_mprintf(
-    "SELECT count(*) FROM sqlite_master WHERE type='table' AND name IN ('%s', '%s')",
-    pNew->zNodeTableName, pNew->zEdgeTableName
-  );
-  
-  sqlite3_stmt *pStmt;
-  rc = sqlite3_prepare_v2(pDb, zCheckSql, -1, &pStmt, 0);
-  sqlite3_free(zCheckSql);
-  
-  int tableCount = 0;
-  if( rc==SQLITE_OK && sqlite3_step(pStmt)==SQLITE_ROW ){
-    tableCount = sqlite3_column_int(pStmt, 0);
-  }
-  sqlite3_finalize(pStmt);
-  
-  /* If backing tables don't exist, create them (this handles the case where
-     the virtual table was created but module wasn't loaded until now) */
-  if( tableCount != 2 ){
-    char *zCreateSql = sqlite3_mprintf(
-      "CREATE TABLE IF NOT EXISTS %s(id INTEGER PRIMARY KEY, labels TEXT DEFAULT '[]', properties TEXT DEFAULT '{}');" 
-      "CREATE TABLE IF NOT EXISTS %s(id INTEGER PRIMARY KEY, from_id INTEGER, to_id INTEGER, weight REAL, labels TEXT DEFAULT '[]', properties TEXT DEFAULT '{}');",
-      pNew->zNodeTableName, pNew->zEdgeTableName
-    );
-    rc = sqlite3_exec(pDb, zCreateSql, 0, 0, pzErr);
-    sqlite3_free(zCreateSql);
-
-    if( rc!=SQLITE_OK ){
-      sqlite3_free(pNew->zDbName);
-      sqlite3_free(pNew->zTableName);
-    sqlite3_free(pNew->zNodeTableName);
-    sqlite3_free(pNew->zEdgeTableName);
-      sqlite3_free(pNew);
-      return rc;
-    }
+  /* xConnect: backing tables normally exist already, but the extension may
+  ** be loaded against a database written by an older version, so make sure
+  ** tables, columns and indexes are all in place. */
+  rc = graphInitBackingTables(pNew, pzErr);
+  if( rc!=SQLITE_OK ){
+    graphVtabFree(pNew);
+    return rc;
   }
 
   *ppVtab = &pNew->base;
@@ -278,50 +372,282 @@ int graphConnect(sqlite3 *pDb, void *pAux, int argc,
   return SQLITE_OK;
 }
 
+/*
+** Read the first (iField==0) or second (iField==1) integer of the
+** sqlite_stat1 entry for zTable, optionally restricted to index zIdx.
+** The first is the table row count, the second the average number of rows
+** per distinct key of the index. Returns -1 if ANALYZE has not been run.
+*/
+static sqlite3_int64 graphStat1Value(GraphVtab *pVtab, const char *zTable,
+                                     const char *zIdx, int iField){
+  sqlite3_stmt *pStmt = 0;
+  sqlite3_int64 iVal = -1;
+  char *zSql;
+
+  if( zIdx ){
+    zSql = sqlite3_mprintf(
+        "SELECT stat FROM sqlite_stat1 WHERE tbl=%Q AND idx=%Q", zTable, zIdx);
+  }else{
+    zSql = sqlite3_mprintf(
+        "SELECT stat FROM sqlite_stat1 WHERE tbl=%Q LIMIT 1", zTable);
+  }
+  if( zSql==0 ) return -1;
+  if( sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0)==SQLITE_OK
+   && sqlite3_step(pStmt)==SQLITE_ROW ){
+    const char *z = (const char*)sqlite3_column_text(pStmt, 0);
+    while( z && iField>0 ){
+      z = strchr(z, ' ');
+      if( z ) z++;
+      iField--;
+    }
+    if( z ) iVal = strtoll(z, 0, 10);
+  }
+  sqlite3_finalize(pStmt);
+  sqlite3_free(zSql);
+  return iVal;
+}
+
+/*
+** Estimate the number of rows in a backing table. Uses sqlite_stat1 when
+** available and otherwise max(id), which is a single b-tree seek on an
+** INTEGER PRIMARY KEY and exact for tables that are not sparse.
+*/
+static sqlite3_int64 graphEstimateTableRows(GraphVtab *pVtab,
+                                            const char *zTable){
+  sqlite3_stmt *pStmt = 0;
+  sqlite3_int64 nRow;
+  char *zSql;
+
+  nRow = graphStat1Value(pVtab, zTable, 0, 0);
+  if( nRow>=0 ) return nRow;
+
+  nRow = 0;
+  zSql = sqlite3_mprintf("SELECT max(id) FROM %s", zTable);
+  if( zSql==0 ) return 0;
+  if( sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pStmt, 0)==SQLITE_OK
+   && sqlite3_step(pStmt)==SQLITE_ROW ){
+    nRow = sqlite3_column_int64(pStmt, 0);
+  }
+  sqlite3_finalize(pStmt);
+  sqlite3_free(zSql);
+  return nRow;
+}
+
+/*
+** Estimate the rows matching the first key column of an edge index
+** created by graphInitBackingTables(), named by its suffix, falling back
+** to nDefault without statistics.
+*/
+static double graphEstimateKeyRows(GraphVtab *pVtab, const char *zSuffix,
+                                   double nDefault){
+  sqlite3_int64 nPerKey;
+  char *zIdx;
+
+  zIdx = sqlite3_mprintf("%s_%s", pVtab->zEdgeTableName, zSuffix);
+  if( zIdx==0 ) return nDefault;
+  nPerKey = graphStat1Value(pVtab, pVtab->zEdgeTableName, zIdx, 1);
+  sqlite3_free(zIdx);
+  return nPerKey>0 ? (double)nPerKey : nDefault;
+}
+
 /*
 ** Query planner interface.
 ** Provides cost estimates and index usage hints to SQLite.
 ** Performance: Critical for query optimization.
+**
+** Equality and IN constraints on rowid, id, type, from_id, to_id, rel_type
+** and labels are passed to xFilter and evaluated by the backing tables.
+** Constraints on edge-only or node-only columns also drop the other table
+** from the plan entirely. ORDER BY on rowid, id, from_id and to_id is
+** consumed when the backing tables can deliver that order from an index.
 */
 int graphBestIndex(sqlite3_vtab *pVtab, sqlite3_index_info *pInfo){
-  int nNodes = 0, nEdges = 0;
-  int hasRowidConstraint = 0;
-  int constraintIdx = 0;
-  /* Debug output removed for production */
-
-  /* Check for rowid constraints (column == -1) */
-  for(int i = 0; i < pInfo->nConstraint; i++){
-    if( pInfo->aConstraint[i].usable ){
-      if( pInfo->aConstraint[i].iColumn == -1 && pInfo->aConstraint[i].op == SQLITE_INDEX_CONSTRAINT_EQ ){
-        /* This is a rowid = ? constraint - we can handle this efficiently */
-        pInfo->aConstraintUsage[i].argvIndex = ++constraintIdx;
-        pInfo->aConstraintUsage[i].omit = 1;  /* We'll handle this constraint */
-        hasRowidConstraint = 1;
-      } else {
-        /* Other constraints - let SQLite handle them */
-        pInfo->aConstraintUsage[i].argvIndex = 0;
-        pInfo->aConstraintUsage[i].omit = 0;
+  GraphVtab *pGraphVtab = (GraphVtab*)pVtab;
+  sqlite3_int64 nNodes, nEdges;
+  double rNodeRows, rEdgeRows;
+  double rNodeCost, rEdgeCost;
+  double rOutDegree;
+  int eScan = GRAPH_SCAN_NODES|GRAPH_SCAN_EDGES;
+  int eTables;
+  int colMask;
+  int bRowidEq = 0;
+  int bIdEq = 0;
+  int nArg = 0;
+  char zTerms[64];
+  char *zOrder = 0;
+  int i;
+
+  nNodes = graphEstimateTableRows(pGraphVtab, pGraphVtab->zNodeTableName);
+  nEdges = graphEstimateTableRows(pGraphVtab, pGraphVtab->zEdgeTableName);
+  rOutDegree = nNodes>0 ? (double)nEdges/(double)nNodes : (double)nEdges;
+  if( rOutDegree<1.0 ) rOutDegree = 1.0;
+
+  rNodeRows = (double)nNodes;
+  rEdgeRows = (double)nEdges;
+  rNodeCost = (double)nNodes;
+  rEdgeCost = (double)nEdges;
+
+  for( i=0; i<pInfo->nConstraint; i++ ){
+    const struct sqlite3_index_constraint *pCons = &pInfo->aConstraint[i];
+    sqlite3_value *pRhs = 0;
+    int bIn = 0;
+    char cTerm = 0;
+    double rKeyRows;
+
+    if( !pCons->usable || nArg>=(int)sizeof(zTerms)-1 ) continue;
+    if( pCons->op!=SQLITE_INDEX_CONSTRAINT_EQ ) continue;
+    bIn = sqlite3_vtab_in(pInfo, i, -1);
+    rKeyRows = bIn ? GRAPH_IN_LIST_ESTIMATE : 1.0;
+
+    switch( pCons->iColumn ){
+      case -1:
+        if( bIn ) break;
+        cTerm = GRAPH_TERM_ROWID;
+        bRowidEq = 1;
+        break;
+      case GRAPH_COL_ID:
+        cTerm = GRAPH_TERM_ID;
+        if( !bIn ) bIdEq = 1;
+        if( rNodeRows>rKeyRows ) rNodeRows = rNodeCost = rKeyRows;
+        if( rEdgeRows>rKeyRows ) rEdgeRows = rEdgeCost = rKeyRows;
+        break;
+      case GRAPH_COL_TYPE:
+        if( bIn ) break;
+        cTerm = GRAPH_TERM_TYPE;
+        if( sqlite3_vtab_rhs_value(pInfo, i, &pRhs)==SQLITE_OK && pRhs ){
+          const char *zType = (const char*)sqlite3_value_text(pRhs);
+          if( zType && strcmp(zType, "node")==0 ){
+            eScan &= ~GRAPH_SCAN_EDGES;
+          }else if( zType && strcmp(zType, "edge")==0 ){
+            eScan &= ~GRAPH_SCAN_NODES;
+          }else{
+            eScan = 0;
+          }
+        }
+        break;
+      case GRAPH_COL_FROM_ID:
+      case GRAPH_COL_TO_ID:
+        cTerm = pCons->iColumn==GRAPH_COL_FROM_ID ?
+                GRAPH_TERM_FROM_ID : GRAPH_TERM_TO_ID;
+        eScan &= ~GRAPH_SCAN_NODES;
+        rKeyRows *= graphEstimateKeyRows(pGraphVtab,
+            pCons->iColumn==GRAPH_COL_FROM_ID ? "from_type" : "to_type",
+            rOutDegree);
+        if( rEdgeCost>rKeyRows ) rEdgeCost = rKeyRows;
+        rEdgeRows = rEdgeRows*rKeyRows/(nEdges>0 ? (double)nEdges : 1.0);
+        break;
+      case GRAPH_COL_REL_TYPE:
+        cTerm = GRAPH_TERM_REL_TYPE;
+        eScan &= ~GRAPH_SCAN_NODES;
+        rKeyRows *= graphEstimateKeyRows(pGraphVtab, "type_id",
+                                         (double)nEdges/10.0);
+        if( rEdgeCost>rKeyRows ) rEdgeCost = rKeyRows;
+        rEdgeRows = rEdgeRows*rKeyRows/(nEdges>0 ? (double)nEdges : 1.0);
+        break;
+      case GRAPH_COL_LABELS:
+        cTerm = GRAPH_TERM_LABELS;
+        eScan &= ~GRAPH_SCAN_EDGES;
+        rNodeRows = rNodeRows*rKeyRows/10.0;
+        break;
+      default:
+        break;
+    }
+    if( cTerm==0 ) continue;
+
+    if( bIn ){
+      sqlite3_vtab_in(pInfo, i, 1);
+      cTerm = (char)(cTerm - 'a' + 'A');
+    }
+    zTerms[nArg++] = cTerm;
+    pInfo->aConstraintUsage[i].argvIndex = nArg;
+    pInfo->aConstraintUsage[i].omit = 1;
+  }
+  zTerms[nArg] = 0;
+
+  if( bRowidEq ){
+    /* A tagged rowid names exactly one node or one edge */
+    rNodeRows = rNodeCost = rEdgeRows = rEdgeCost = 0.5;
+  }
+  if( !(eScan & GRAPH_SCAN_NODES) ) rNodeRows = rNodeCost = 0.0;
+  if( !(eScan & GRAPH_SCAN_EDGES) ) rEdgeRows = rEdgeCost = 0.0;
+  if( rNodeRows<1.0 && (eScan & GRAPH_SCAN_NODES) && !bRowidEq ) rNodeRows = 1.0;
+  if( rEdgeRows<1.0 && (eScan & GRAPH_SCAN_EDGES) && !bRowidEq ) rEdgeRows = 1.0;
+
+  /* Ordering by rowid holds across both tables because edge rowids carry
+  ** GRAPH_EDGE_ROWID_FLAG and nodes are returned first. Any other order
+  ** can only be delivered when a single backing table is scanned. */
+  if( pInfo->nOrderBy>0 ){
+    int bSingle = eScan==GRAPH_SCAN_NODES || eScan==GRAPH_SCAN_EDGES;
+    int bOk = 1;
+    for( i=0; i<pInfo->nOrderBy && bOk; i++ ){
+      const struct sqlite3_index_orderby *pOrder = &pInfo->aOrderBy[i];
+      const char *zCol = 0;
+      switch( pOrder->iColumn ){
+        case -1:
+          if( pOrder->desc==0 || bSingle ) zCol = "id";
+          break;
+        case GRAPH_COL_ID:
+          if( bSingle ) zCol = "id";
+          break;
+        case GRAPH_COL_FROM_ID:
+          if( eScan==GRAPH_SCAN_EDGES ) zCol = "from_id";
+          break;
+        case GRAPH_COL_TO_ID:
+          if( eScan==GRAPH_SCAN_EDGES ) zCol = "to_id";
+          break;
+      }
+      if( zCol==0 ){
+        bOk = 0;
+      }else{
+        char *zNew = sqlite3_mprintf("%z%s%s%s", zOrder, zOrder ? "," : "",
+                                     zCol, pOrder->desc ? " DESC" : "");
+        if( zNew==0 ) return SQLITE_NOMEM;
+        zOrder = zNew;
+      }
+    }
+    if( bOk ){
+      pInfo->orderByConsumed = 1;
+      eScan |= GRAPH_SCAN_ORDERED;
+    }else{
+      sqlite3_free(zOrder);
+      zOrder = 0;
+    }
+  }
+
+  /* Only read the backing columns the statement refers to. Properties are
+  ** usually most of the bytes of a row; when SQLite still has to apply
+  ** filters of its own, many rows are discarded before their properties
+  ** are looked at, so those are fetched per row on demand instead. */
+  colMask = (int)(pInfo->colUsed & ((1<<GRAPH_VTAB_NCOL)-1));
+  if( colMask & (1<<GRAPH_COL_PROPERTIES) ){
+    int bResidual = 0;
+    int bPropResidual = 0;
+    for( i=0; i<pInfo->nConstraint; i++ ){
+      if( pInfo->aConstraintUsage[i].omit ) continue;
+      bResidual = 1;
+      if( pInfo->aConstraint[i].iColumn==GRAPH_COL_PROPERTIES ){
+        bPropResidual = 1;
       }
     }
+    if( bResidual && !bPropResidual ) eScan |= GRAPH_SCAN_LAZY_PROPS;
   }
 
-  /* Use static estimates to avoid potential infinite loops */
-  nNodes = 1000;  /* Default estimate */
-  nEdges = 2000;  /* Default estimate */
-  if( hasRowidConstraint ){
-    /* If we have a rowid constraint, this should be very efficient */
-    pInfo->estimatedCost = 1.0;
+  pInfo->idxNum = eScan | (colMask<<GRAPH_SCAN_COLS_SHIFT);
+  pInfo->idxStr = sqlite3_mprintf("%s%s%s", zTerms, zOrder ? ";" : "",
+                                  zOrder ? zOrder : "");
+  sqlite3_free(zOrder);
+  if( pInfo->idxStr==0 ) return SQLITE_NOMEM;
+  pInfo->needToFreeIdxStr = 1;
+
+  pInfo->estimatedRows = (sqlite3_int64)(rNodeRows + rEdgeRows + 0.5);
+  pInfo->estimatedCost = rNodeCost + rEdgeCost + 1.0;
+  eTables = eScan & (GRAPH_SCAN_NODES|GRAPH_SCAN_EDGES);
+  if( bRowidEq
+   || (bIdEq && (eTables==GRAPH_SCAN_NODES || eTables==GRAPH_SCAN_EDGES)) ){
+    pInfo->idxFlags |= SQLITE_INDEX_SCAN_UNIQUE;
     pInfo->estimatedRows = 1;
-    pInfo->idxNum = 1;  /* Indicate we're using rowid lookup */
-  } else {
-    pInfo->estimatedCost = (double)(nNodes + nEdges);
-    pInfo->estimatedRows = nNodes + nEdges;
-    pInfo->idxNum = 0;  /* Full table scan */
   }
   
-  pInfo->idxStr = 0;
-  pInfo->needToFreeIdxStr = 0;
-  
   return SQLITE_OK;
 }
 
@@ -339,9 +665,7 @@ int graphDisconnect(sqlite3_vtab *pVtab){
   pGraphVtab->nRef--;
   if( pGraphVtab->nRef<=0 ){
     /* Free memory but DON'T drop backing tables */
-    sqlite3_free(pGraphVtab->zDbName);
-    sqlite3_free(pGraphVtab->zTableName);
-    sqlite3_free(pGraphVtab);
+    graphVtabFree(pGraphVtab);
   }
   
   return SQLITE_OK;
@@ -370,9 +694,7 @@ int graphDestroy(sqlite3_vtab *pVtab){
   }
   
   /* Free table names and structure */
-  sqlite3_free(pGraphVtab->zDbName);
-  sqlite3_free(pGraphVtab->zTableName);
-  sqlite3_free(pGraphVtab);
+  graphVtabFree(pGraphVtab);
   
   return SQLITE_OK;
 }
@@ -408,89 +730,223 @@ int graphClose(sqlite3_vtab_cursor *pCursor){
   GraphCursor *pGraphCursor = (GraphCursor*)pCursor;
   sqlite3_finalize(pGraphCursor->pNodeStmt);
   sqlite3_finalize(pGraphCursor->pEdgeStmt);
+  sqlite3_finalize(pGraphCursor->pNodePropStmt);
+  sqlite3_finalize(pGraphCursor->pEdgePropStmt);
   assert( pCursor!=0 );
   sqlite3_free(pCursor);
   return SQLITE_OK;
 }
 
+/*
+** Return the backing column an idxStr constraint code applies to on the
+** node table (bEdges==0) or edge table (bEdges!=0), or NULL if the code
+** does not restrict that table through SQL.
+*/
+static const char *graphTermColumn(char cTerm, int bEdges){
+  switch( cTerm ){
+    case GRAPH_TERM_ROWID:
+    case GRAPH_TERM_ID:       return "id";
+    case GRAPH_TERM_FROM_ID:  return bEdges ? "from_id" : 0;
+    case GRAPH_TERM_TO_ID:    return bEdges ? "to_id" : 0;
+    case GRAPH_TERM_REL_TYPE: return bEdges ? "rel_type" : 0;
+    case GRAPH_TERM_LABELS:   return bEdges ? 0 : "labels";
+  }
+  return 0;
+}
+
+/*
+** Prepare the scan of one backing table for the constraints encoded in
+** zTerms/argv. zColumns is the projection, zOrder an optional ORDER BY
+** clause. Equality terms become "col = ?" and IN lists "col IN (?,...)"
+** so that SQLite can use the rowid or the edge indexes.
+*/
+static int graphPrepareScan(GraphVtab *pVtab, int bEdges,
+                            const char *zColumns, const char *zTerms,
+                            const char *zOrder, int argc,
+                            sqlite3_value **argv, sqlite3_stmt **ppStmt){
+  const char *zTable = bEdges ? pVtab->zEdgeTableName : pVtab->zNodeTableName;
+  sqlite3_value *pVal;
+  char *zSql;
+  int iParam = 0;
+  int rc;
+  int i;
+
+  *ppStmt = 0;
+  zSql = sqlite3_mprintf("SELECT %s FROM %s WHERE 1", zColumns, zTable);
+  for( i=0; zSql && i<argc; i++ ){
+    char cTerm = (char)(zTerms[i] | 0x20);
+    const char *zCol = graphTermColumn(cTerm, bEdges);
+    const char *zClose = "";
+    if( zCol==0 ) continue;
+    if( cTerm==GRAPH_TERM_REL_TYPE && pVtab->bTypeIndex ){
+      /* Match interned type ids so that the type_id index is used. Without
+      ** the type table the rel_type column is compared directly. */
+      zSql = sqlite3_mprintf(
+          "%z AND type_id IN (SELECT id FROM %s_rel_types WHERE 1",
+          zSql, pVtab->zTableName);
+      zCol = "name";
+      zClose = ")";
+    }
+    if( zTerms[i]!=cTerm ){
+      int nVal = 0;
+      for( rc=sqlite3_vtab_in_first(argv[i], &pVal); rc==SQLITE_OK;
+           rc=sqlite3_vtab_in_next(argv[i], &pVal) ){
+        zSql = sqlite3_mprintf("%z%s", zSql, nVal==0 ? "" : ",?");
+        if( nVal==0 && zSql ){
+          zSql = sqlite3_mprintf("%z AND %s IN (?", zSql, zCol);
+        }
+        nVal++;
+      }
+      zSql = sqlite3_mprintf("%z%s", zSql, nVal==0 ? " AND 0" : ")");
+    }else{
+      zSql = sqlite3_mprintf("%z AND %s = ?", zSql, zCol);
+    }
+    zSql = sqlite3_mprintf("%z%s", zSql, zClose);
+  }
+  if( zSql && zOrder ){
+    zSql = sqlite3_mprintf("%z ORDER BY %s", zSql, zOrder);
+  }
+  if( zSql==0 ) return SQLITE_NOMEM;
+
+  rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, ppStmt, 0);
+  sqlite3_free(zSql);
+  if( rc!=SQLITE_OK ) return rc;
+
+  for( i=0; rc==SQLITE_OK && i<argc; i++ ){
+    char cTerm = (char)(zTerms[i] | 0x20);
+    if( graphTermColumn(cTerm, bEdges)==0 ) continue;
+    if( zTerms[i]!=cTerm ){
+      int rcIn;
+      for( rcIn=sqlite3_vtab_in_first(argv[i], &pVal);
+           rc==SQLITE_OK && rcIn==SQLITE_OK;
+           rcIn=sqlite3_vtab_in_next(argv[i], &pVal) ){
+        rc = sqlite3_bind_value(*ppStmt, ++iParam, pVal);
+      }
+    }else if( cTerm==GRAPH_TERM_ROWID ){
+      rc = sqlite3_bind_int64(*ppStmt, ++iParam,
+          sqlite3_value_int64(argv[i]) & ~GRAPH_EDGE_ROWID_FLAG);
+    }else{
+      rc = sqlite3_bind_value(*ppStmt, ++iParam, argv[i]);
+    }
+  }
+  if( rc!=SQLITE_OK ){
+    sqlite3_finalize(*ppStmt);
+    *ppStmt = 0;
+  }
+  return rc;
+}
+
+/*
+** Build the select list for a node (bEdges==0) or edge scan containing id
+** plus every backing column named in colMask, and record in aCol where
+** each vtab column ended up (-1 if not selected).
+*/
+static char *graphProjection(int bEdges, int colMask, int *aCol){
+  static const struct {
+    int iCol;
+    const char *zName;
+    int bNode;
+    int bEdge;
+  } aColumn[] = {
+    { GRAPH_COL_FROM_ID,    "from_id",    0, 1 },
+    { GRAPH_COL_TO_ID,      "to_id",      0, 1 },
+    { GRAPH_COL_LABELS,     "labels",     1, 0 },
+    { GRAPH_COL_REL_TYPE,   "rel_type",   0, 1 },
+    { GRAPH_COL_WEIGHT,     "weight",     0, 1 },
+    { GRAPH_COL_PROPERTIES, "properties", 1, 1 },
+  };
+  char *zList;
+  int nSel = 1;
+  int i;
+
+  for( i=0; i<GRAPH_VTAB_NCOL; i++ ) aCol[i] = -1;
+  aCol[GRAPH_COL_ID] = 0;
+  zList = sqlite3_mprintf("id");
+  for( i=0; zList && i<(int)(sizeof(aColumn)/sizeof(aColumn[0])); i++ ){
+    if( !(colMask & (1<<aColumn[i].iCol)) ) continue;
+    if( !(bEdges ? aColumn[i].bEdge : aColumn[i].bNode) ) continue;
+    zList = sqlite3_mprintf("%z, %s", zList, aColumn[i].zName);
+    aCol[aColumn[i].iCol] = nSel++;
+  }
+  return zList;
+}
+
 /*
 ** Filter cursor based on constraints.
 ** Query processing: Implements WHERE clause filtering.
 ** Performance: Optimizes iteration based on provided constraints.
+**
+** idxNum and idxStr come from graphBestIndex(). Values of the type and
+** rowid constraints decide which backing tables are scanned at all; the
+** remaining constraints are evaluated by the backing table scans.
 */
 int graphFilter(sqlite3_vtab_cursor *pCursor, int idxNum,
                 const char *idxStr, int argc, sqlite3_value **argv){
-  (void)idxStr;
   GraphCursor *pGraphCursor = (GraphCursor*)pCursor;
   GraphVtab *pVtab = pGraphCursor->pVtab;
-  char *zSql;
-  int rc;
-
-  /* Debug output removed for production */
+  int bNodes = (idxNum & GRAPH_SCAN_NODES)!=0;
+  int bEdges = (idxNum & GRAPH_SCAN_EDGES)!=0;
+  const char *zOrder = 0;
+  char *zColumns;
+  int colMask;
+  int rc = SQLITE_OK;
+  int i;
 
   sqlite3_finalize(pGraphCursor->pNodeStmt);
   pGraphCursor->pNodeStmt = 0;
   sqlite3_finalize(pGraphCursor->pEdgeStmt);
   pGraphCursor->pEdgeStmt = 0;
 
-  pGraphCursor->iIterMode = 0;
+  if( idxStr==0 ) idxStr = "";
+  if( idxNum & GRAPH_SCAN_ORDERED ){
+    zOrder = strchr(idxStr, ';');
+    if( zOrder ) zOrder++;
+  }
 
-  if( idxNum == 1 && argc > 0 ){
-    /* Rowid constraint - look up specific row */
-    sqlite3_int64 targetRowid = sqlite3_value_int64(argv[0]);
-    
-    if( targetRowid & (1LL << 62) ){
-      /* This is an edge rowid */
-      sqlite3_int64 edgeId = targetRowid & ~(1LL << 62);
-      zSql = sqlite3_mprintf("SELECT id, source, target, edge_type, weight, properties FROM %s WHERE id = %lld", 
-                             pVtab->zTableName, edgeId);
-      rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pGraphCursor->pEdgeStmt, 0);
-      sqlite3_free(zSql);
-      if( rc!=SQLITE_OK ) return rc;
-      
-      /* Skip nodes for this specific lookup */
-      pGraphCursor->iIterMode = 1;
-    } else {
-      /* This is a node rowid */
-      zSql = sqlite3_mprintf("SELECT id, properties FROM %s WHERE id = %lld", 
-                             pVtab->zTableName, targetRowid);
-      rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pGraphCursor->pNodeStmt, 0);
-      sqlite3_free(zSql);
-      if( rc!=SQLITE_OK ) return rc;
-      
-      /* Skip edges for this specific lookup */
-      pGraphCursor->iIterMode = 0;
-    }
-    
-    /* For rowid lookup, we don't need both statements */
-    if( pGraphCursor->iIterMode == 0 && !pGraphCursor->pEdgeStmt ){
-      /* Create empty edge statement to avoid issues in graphNext */
-      zSql = sqlite3_mprintf("SELECT id, source, target, edge_type, weight, properties FROM %s WHERE 0", pVtab->zTableName);
-      rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pGraphCursor->pEdgeStmt, 0);
-      sqlite3_free(zSql);
-      if( rc!=SQLITE_OK ) return rc;
-    }
-    
-    if( pGraphCursor->iIterMode == 1 && !pGraphCursor->pNodeStmt ){
-      /* Create empty node statement to avoid issues in graphNext */
-      zSql = sqlite3_mprintf("SELECT id, properties FROM %s WHERE 0", pVtab->zTableName);
-      rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pGraphCursor->pNodeStmt, 0);
-      sqlite3_free(zSql);
-      if( rc!=SQLITE_OK ) return rc;
+  for( i=0; i<argc; i++ ){
+    switch( idxStr[i] ){
+      case GRAPH_TERM_TYPE: {
+        const char *zType = (const char*)sqlite3_value_text(argv[i]);
+        if( zType==0 || strcmp(zType, "node")!=0 ) bNodes = 0;
+        if( zType==0 || strcmp(zType, "edge")!=0 ) bEdges = 0;
+        break;
+      }
+      case GRAPH_TERM_ROWID:
+        if( sqlite3_value_numeric_type(argv[i])!=SQLITE_INTEGER ){
+          bNodes = bEdges = 0;
+        }else if( sqlite3_value_int64(argv[i]) & GRAPH_EDGE_ROWID_FLAG ){
+          bNodes = 0;
+        }else{
+          bEdges = 0;
+        }
+        break;
     }
-  } else {
-    /* Full table scan */
-    zSql = sqlite3_mprintf("SELECT id, properties FROM %s", pVtab->zTableName);
-    rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pGraphCursor->pNodeStmt, 0);
-    sqlite3_free(zSql);
-    if( rc!=SQLITE_OK ) return rc;
+  }
 
-    zSql = sqlite3_mprintf("SELECT id, source, target, edge_type, weight, properties FROM %s", pVtab->zTableName);
-    rc = sqlite3_prepare_v2(pVtab->pDb, zSql, -1, &pGraphCursor->pEdgeStmt, 0);
-    sqlite3_free(zSql);
-    if( rc!=SQLITE_OK ) return rc;
+  pGraphCursor->bLazyProps = (idxNum & GRAPH_SCAN_LAZY_PROPS)!=0;
+  colMask = idxNum>>GRAPH_SCAN_COLS_SHIFT;
+  if( pGraphCursor->bLazyProps ) colMask &= ~(1<<GRAPH_COL_PROPERTIES);
+
+  if( bNodes ){
+    zColumns = graphProjection(0, colMask, pGraphCursor->aNodeCol);
+    rc = zColumns ? graphPrepareScan(pVtab, 0, zColumns, idxStr, zOrder,
+                                     argc, argv, &pGraphCursor->pNodeStmt)
+                  : SQLITE_NOMEM;
+    sqlite3_free(zColumns);
+  }
+  if( rc==SQLITE_OK && bEdges ){
+    zColumns = graphProjection(1, colMask, pGraphCursor->aEdgeCol);
+    rc = zColumns ? graphPrepareScan(pVtab, 1, zColumns, idxStr, zOrder,
+                                     argc, argv, &pGraphCursor->pEdgeStmt)
+                  : SQLITE_NOMEM;
+    sqlite3_free(zColumns);
+  }
+  if( rc!=SQLITE_OK ){
+    pCursor->pVtab->zErrMsg = sqlite3_mprintf("%s", sqlite3_errmsg(pVtab->pDb));
+    return rc;
   }
 
+  pGraphCursor->iIterMode = 0;
   return graphNext(pCursor);
 }
 
@@ -504,13 +960,23 @@ int graphNext(sqlite3_vtab_cursor *pCursor){
   int rc;
 
   if( pGraphCursor->iIterMode==0 ){
-    rc = sqlite3_step(pGraphCursor->pNodeStmt);
-    if( rc==SQLITE_ROW ) return SQLITE_OK;
+    if( pGraphCursor->pNodeStmt ){
+      rc = sqlite3_step(pGraphCursor->pNodeStmt);
+      if( rc==SQLITE_ROW ) return SQLITE_OK;
+      if( rc!=SQLITE_DONE ) return rc;
+    }
     pGraphCursor->iIterMode = 1;
   }
 
-  rc = sqlite3_step(pGraphCursor->pEdgeStmt);
-  if (rc == SQLITE_ROW) return SQLITE_OK; pGraphCursor->iIterMode = 2; return SQLITE_DONE;
+  if( pGraphCursor->iIterMode==1 ){
+    if( pGraphCursor->pEdgeStmt ){
+      rc = sqlite3_step(pGraphCursor->pEdgeStmt);
+      if( rc==SQLITE_ROW ) return SQLITE_OK;
+      if( rc!=SQLITE_DONE ) return rc;
+    }
+    pGraphCursor->iIterMode = 2;
+  }
+  return SQLITE_OK;
 }
 
 /*
@@ -522,77 +988,58 @@ int graphEof(sqlite3_vtab_cursor *pCursor){
   return pGraphCursor->iIterMode >= 2;
 }
 
+/*
+** Return the properties of the current row by looking them up in the
+** backing table. Used when graphBestIndex() chose GRAPH_SCAN_LAZY_PROPS.
+*/
+static int graphLazyProperties(GraphCursor *pCur, sqlite3_context *pCtx){
+  int bEdges = pCur->iIterMode!=0;
+  sqlite3_stmt *pScan = bEdges ? pCur->pEdgeStmt : pCur->pNodeStmt;
+  sqlite3_stmt **ppStmt = bEdges ? &pCur->pEdgePropStmt : &pCur->pNodePropStmt;
+  int rc;
+
+  if( *ppStmt==0 ){
+    char *zSql = sqlite3_mprintf("SELECT properties FROM %s WHERE id = ?",
+        bEdges ? pCur->pVtab->zEdgeTableName : pCur->pVtab->zNodeTableName);
+    if( zSql==0 ) return SQLITE_NOMEM;
+    rc = sqlite3_prepare_v2(pCur->pVtab->pDb, zSql, -1, ppStmt, 0);
+    sqlite3_free(zSql);
+    if( rc!=SQLITE_OK ) return rc;
+  }
+
+  sqlite3_bind_int64(*ppStmt, 1, sqlite3_column_int64(pScan, 0));
+  if( sqlite3_step(*ppStmt)==SQLITE_ROW ){
+    sqlite3_result_value(pCtx, sqlite3_column_value(*ppStmt, 0));
+  }else{
+    sqlite3_result_null(pCtx);
+  }
+  return sqlite3_reset(*ppStmt);
+}
+
 /*
 ** Return column value for current cursor position.
 ** Data retrieval: Extracts node/edge properties as SQLite values.
 ** Memory management: Uses sqlite3_result_* functions appropriately.
+**
+** Only the columns chosen by graphProjection() are read by the scan;
+** aNodeCol/aEdgeCol map vtab columns to positions in the scan result.
 */
 int graphColumn(sqlite3_vtab_cursor *pCursor, sqlite3_context *pCtx,
                 int iCol){
   GraphCursor *pGraphCursor = (GraphCursor*)pCursor;
-  
-  if( pGraphCursor->iIterMode==0 ){
-    /* Return node data */
-    switch( iCol ){
-      case 0: /* type */
-        sqlite3_result_text(pCtx, "node", -1, SQLITE_STATIC);
-        break;
-      case 1: /* id */
-        sqlite3_result_int64(pCtx, sqlite3_column_int64(pGraphCursor->pNodeStmt, 0));
-        break;
-      case 2: /* from_id */
-        sqlite3_result_null(pCtx);
-        break;
-      case 3: /* to_id */
-        sqlite3_result_null(pCtx);
-        break;
-      case 4: /* labels */
-        sqlite3_result_text(pCtx, "[]", -1, SQLITE_STATIC);
-        break;
-      case 5: /* rel_type */
-        sqlite3_result_null(pCtx);
-        break;
-      case 6: /* weight */
-        sqlite3_result_null(pCtx);
-        break;
-      case 7: /* properties */
-        sqlite3_result_text(pCtx, (const char*)sqlite3_column_text(pGraphCursor->pNodeStmt, 1), -1, SQLITE_TRANSIENT);
-        break;
-      default:
-        sqlite3_result_null(pCtx);
-        break;
-    }
-  } else {
-    /* Return edge data */
-    switch( iCol ){
-      case 0: /* type */
-        sqlite3_result_text(pCtx, "edge", -1, SQLITE_STATIC);
-        break;
-      case 1: /* id */
-        sqlite3_result_int64(pCtx, sqlite3_column_int64(pGraphCursor->pEdgeStmt, 0));
-        break;
-      case 2: /* from_id */
-        sqlite3_result_int64(pCtx, sqlite3_column_int64(pGraphCursor->pEdgeStmt, 1));
-        break;
-      case 3: /* to_id */
-        sqlite3_result_int64(pCtx, sqlite3_column_int64(pGraphCursor->pEdgeStmt, 2));
-        break;
-      case 4: /* labels */
-        sqlite3_result_null(pCtx);
-        break;
-      case 5: /* rel_type */
-        sqlite3_result_null(pCtx);
-        break;
-      case 6: /* weight */
-        sqlite3_result_double(pCtx, sqlite3_column_double(pGraphCursor->pEdgeStmt, 3));
-        break;
-      case 7: /* properties */
-        sqlite3_result_text(pCtx, (const char*)sqlite3_column_text(pGraphCursor->pEdgeStmt, 4), -1, SQLITE_TRANSIENT);
-        break;
-      default:
-        sqlite3_result_null(pCtx);
-        break;
-    }
+  int bEdges = pGraphCursor->iIterMode!=0;
+  sqlite3_stmt *pStmt = bEdges ? pGraphCursor->pEdgeStmt
+                               : pGraphCursor->pNodeStmt;
+  const int *aCol = bEdges ? pGraphCursor->aEdgeCol : pGraphCursor->aNodeCol;
+
+  if( iCol==GRAPH_COL_TYPE ){
+    sqlite3_result_text(pCtx, bEdges ? "edge" : "node", -1, SQLITE_STATIC);
+  }else if( iCol==GRAPH_COL_PROPERTIES && pGraphCursor->bLazyProps ){
+    return graphLazyProperties(pGraphCursor, pCtx);
+  }else if( iCol>=0 && iCol<GRAPH_VTAB_NCOL && aCol[iCol]>=0 ){
+    sqlite3_result_value(pCtx, sqlite3_column_value(pStmt, aCol[iCol]));
+  }else{
+    sqlite3_result_null(pCtx);
   }
   
   return SQLITE_OK;
@@ -604,12 +1051,11 @@ int graphColumn(sqlite3_vtab_cursor *pCursor, sqlite3_context *pCtx,
 */
 int graphRowid(sqlite3_vtab_cursor *pCursor, sqlite3_int64 *pRowid){
   GraphCursor *pGraphCursor = (GraphCursor*)pCursor;
-  if (pGraphCursor->iIterMode == 0) {
-    // Node
+  if( pGraphCursor->iIterMode==0 ){
     *pRowid = sqlite3_column_int64(pGraphCursor->pNodeStmt, 0);
-  } else {
-    // Edge: encode with a sentinel value
-    *pRowid = sqlite3_column_int64(pGraphCursor->pEdgeStmt, 0) | (1LL << 62);
+  }else{
+    *pRowid = sqlite3_column_int64(pGraphCursor->pEdgeStmt, 0)
+            | GRAPH_EDGE_ROWID_FLAG;
   }
   return SQLITE_OK;
 }
@@ -755,7 +1201,7 @@ int graphUpdate(sqlite3_vtab *pVtab, int argc, sqlite3_value **argv, sqlite3_int
       sqlite3_int64 from_id = 0, to_id = 0;
       double weight = 0.0;
       const char *properties = "";
-      const char *edge_type = "";
+      const char *edge_type = 0;
       
       // Get from_id (argv[4])
       if (sqlite3_value_type(argv[4]) != SQLITE_NULL) {
@@ -798,7 +1244,7 @@ int graphUpdate(sqlite3_vtab *pVtab, int argc, sqlite3_value **argv, sqlite3_int
           sqlite3_finalize(pStmt);
           
           char *zSql = sqlite3_mprintf(
-            "INSERT INTO %s (source, target, edge_type, weight, properties) VALUES (%lld, %lld, %Q, %f, %Q)", 
+            "INSERT INTO %s (from_id, to_id, rel_type, weight, properties) VALUES (%lld, %lld, %Q, %f, %Q)", 
             pGraphVtab->zEdgeTableName, from_id, to_id, edge_type, weight, properties);
           
           rc = sqlite3_exec(pGraphVtab->pDb, zSql, 0, 0, &zErr);
@@ -835,7 +1281,7 @@ int graphUpdate(sqlite3_vtab *pVtab, int argc, sqlite3_value **argv, sqlite3_int
       if (old_rowid & (1LL << 62)) { // Edge
         // Update edge
         sqlite3_int64 edge_id = old_rowid & ~(1LL << 62);
-        char *zUpdates[4] = {0, 0, 0, 0};
+        char *zUpdates[5] = {0, 0, 0, 0, 0};
         int nUpdates = 0;
 
         // from_id (argv[4])
@@ -848,6 +1294,11 @@ int graphUpdate(sqlite3_vtab *pVtab, int argc, sqlite3_value **argv, sqlite3_int
           zUpdates[nUpdates++] = sqlite3_mprintf("to_id = %lld", sqlite3_value_int64(argv[5]));
         }
         
+        // rel_type (argv[7])
+        if (sqlite3_value_type(argv[7]) != SQLITE_NULL) {
+          zUpdates[nUpdates++] = sqlite3_mprintf("rel_type = %Q", sqlite3_value_text(argv[7]));
+        }
+        
         // weight (argv[8])
         if (sqlite3_value_type(argv[8]) != SQLITE_NULL) {
           zUpdates[nUpdates++] = sqlite3_mprintf("weight = %f", sqlite3_value_double(argv[8]));
@@ -868,7 +1319,7 @@ int graphUpdate(sqlite3_vtab *pVtab, int argc, sqlite3_value **argv, sqlite3_int
           }
 
           zSql = sqlite3_mprintf("UPDATE %s SET %s WHERE id = %lld", 
-                                 pGraphVtab->zTableName, zJoinedUpdates, edge_id);
+                                 pGraphVtab->zEdgeTableName, zJoinedUpdates, edge_id);
           rc = sqlite3_exec(pGraphVtab->pDb, zSql, 0, 0, &zErr);
           sqlite3_free(zSql);
           sqlite3_free(zJoinedUpdates);
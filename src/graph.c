@@ -77,6 +77,14 @@ static void graphCascadeDeleteNodeFunc(sqlite3_context*, int, sqlite3_value**);
 /* Table-valued function registration from graph-tvf.c */
 extern int graphRegisterTVF(sqlite3 *pDb);
 
+/* Asynchronous algorithm job functions from graph-jobs.c */
+extern int graphRegisterJobFunctions(sqlite3 *pDb);
+
+/* Property index management functions from graph-schema.c */
+extern int graphRegisterIndexFunctions(sqlite3 *pDb);
+extern int graphRegisterBitmapFunctions(sqlite3 *pDb);
+extern int graphRegisterVectorFunctions(sqlite3 *pDb);
+
 /*
 ** Extension initialization function.
 ** Called when SQLite loads the extension via .load or sqlite3_load_extension.
@@ -147,6 +155,38 @@ int sqlite3_graph_init(
     return rc;
   }
   
+  /* Register asynchronous algorithm job functions */
+  rc = graphRegisterJobFunctions(pDb);
+  if( rc!=SQLITE_OK ){
+    *pzErrMsg = sqlite3_mprintf("Failed to register graph job functions: %s",
+                                sqlite3_errmsg(pDb));
+    return rc;
+  }
+  
+  /* Register property index functions */
+  rc = graphRegisterIndexFunctions(pDb);
+  if( rc!=SQLITE_OK ){
+    *pzErrMsg = sqlite3_mprintf("Failed to register graph index functions: %s",
+                                sqlite3_errmsg(pDb));
+    return rc;
+  }
+  
+  /* Register bitmap index functions */
+  rc = graphRegisterBitmapFunctions(pDb);
+  if( rc!=SQLITE_OK ){
+    *pzErrMsg = sqlite3_mprintf("Failed to register graph bitmap functions: %s",
+                                sqlite3_errmsg(pDb));
+    return rc;
+  }
+  
+  /* Register vector index functions and graph_knn() */
+  rc = graphRegisterVectorFunctions(pDb);
+  if( rc!=SQLITE_OK ){
+    *pzErrMsg = sqlite3_mprintf("Failed to register graph vector functions: %s",
+                                sqlite3_errmsg(pDb));
+    return rc;
+  }
+  
   /* Register algorithm functions */
   rc = sqlite3_create_function(pDb, "graph_shortest_path", 2, SQLITE_UTF8, 0,
                               graphShortestPathFunc, 0, 0);
@@ -0,0 +1,733 @@
+/*
+** test_cypher_queries.c - Cypher queries run end to end through cypher()
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <sqlite3.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <time.h>
+#include "unity.h"
+
+static sqlite3 *db = NULL;
+static char db_file[256];
+
+// Opens a file-backed database holding graph g:
+// 1 Alice (30, Paris), 2 Bob (25, London) and 3 Carol (35, Paris) are
+// Persons, 4 is the City Paris. Alice KNOWS Bob, Bob KNOWS Carol, and
+// Alice and Carol LIVE_IN Paris.
+static void open_graph_db(const char *zName) {
+    snprintf(db_file, sizeof(db_file), "test_%s_%ld.db", zName, (long)time(NULL));
+    unlink(db_file);
+
+    int rc = sqlite3_open(db_file, &db);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+
+    rc = sqlite3_enable_load_extension(db, 1);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+
+    rc = sqlite3_load_extension(db, "../build/libgraph.so", "sqlite3_graph_init", NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+
+    rc = sqlite3_exec(db,
+        "CREATE VIRTUAL TABLE g USING graph();"
+        "INSERT INTO g_nodes (id, labels, properties) VALUES"
+        " (1, '[\"Person\"]', '{\"name\":\"Alice\",\"age\":30,\"city\":\"Paris\"}'),"
+        " (2, '[\"Person\"]', '{\"name\":\"Bob\",\"age\":25,\"city\":\"London\"}'),"
+        " (3, '[\"Person\"]', '{\"name\":\"Carol\",\"age\":35,\"city\":\"Paris\"}'),"
+        " (4, '[\"City\"]', '{\"name\":\"Paris\"}');"
+        "INSERT INTO g_edges (from_id, to_id, weight, rel_type) VALUES"
+        " (1, 2, 1.0, 'KNOWS'), (2, 3, 1.0, 'KNOWS'),"
+        " (1, 4, 1.0, 'LIVES_IN'), (3, 4, 1.0, 'LIVES_IN');",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+}
+
+// Runs zSql and writes its rows into zOut, columns separated by '|' and
+// rows by ';', "NULL" for null. On error zOut holds the error message.
+// Returns the result code of the last step.
+static int query_rows(const char *zSql, char *zOut, int nOut) {
+    sqlite3_stmt *stmt;
+    int n = 0;
+    int rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL);
+    zOut[0] = 0;
+    if (rc != SQLITE_OK) {
+        snprintf(zOut, nOut, "%s", sqlite3_errmsg(db));
+        return rc;
+    }
+    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        for (int i = 0; i < sqlite3_column_count(stmt); i++) {
+            const char *z = (const char*)sqlite3_column_text(stmt, i);
+            n += snprintf(zOut + n, nOut - n, "%s%s", i ? "|" : (n ? ";" : ""), z ? z : "NULL");
+            if (n >= nOut) n = nOut - 1;
+        }
+    }
+    if (rc != SQLITE_DONE) snprintf(zOut, nOut, "%s", sqlite3_errmsg(db));
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+// Runs the Cypher query zQuery through the eponymous cypher() table and
+// checks its rows, one JSON object per row
+static void assert_cypher(const char *zQuery, const char *zExpected) {
+    char zOut[2048];
+    char *zSql = sqlite3_mprintf("SELECT value FROM cypher(%Q)", zQuery);
+    TEST_ASSERT_EQUAL_MESSAGE(SQLITE_DONE, query_rows(zSql, zOut, sizeof(zOut)), zOut);
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(zExpected, zOut, zQuery);
+    sqlite3_free(zSql);
+}
+
+void setUp(void) {
+    db = NULL;
+    db_file[0] = 0;
+}
+
+void tearDown(void) {
+    if (db) {
+        sqlite3_close(db);
+        db = NULL;
+    }
+    if (db_file[0]) unlink(db_file);
+}
+
+void test_scan_filter_projection(void) {
+    open_graph_db("scan_filter");
+
+    assert_cypher("MATCH (n) RETURN n.name",
+        "{\"n.name\":\"Alice\"};{\"n.name\":\"Bob\"};{\"n.name\":\"Carol\"};{\"n.name\":\"Paris\"}");
+    assert_cypher("MATCH (n:Person) WHERE n.age > 26 RETURN n.name, n.age",
+        "{\"n.name\":\"Alice\",\"n.age\":30};{\"n.name\":\"Carol\",\"n.age\":35}");
+    assert_cypher("MATCH (n:Person {city: 'Paris'}) RETURN n.name",
+        "{\"n.name\":\"Alice\"};{\"n.name\":\"Carol\"}");
+    assert_cypher("MATCH (n:Person) WHERE n.age >= 30 OR NOT n.city = 'London' RETURN n.name AS who",
+        "{\"who\":\"Alice\"};{\"who\":\"Carol\"}");
+    assert_cypher("MATCH (n:Person) WHERE n.city = 'Paris' AND n.age < 32 RETURN n.age * 2 + 1 AS x",
+        "{\"x\":61}");
+    assert_cypher("MATCH (n:City) RETURN toUpper(n.name), n.missing",
+        "{\"toUpper(n.name)\":\"PARIS\",\"n.missing\":null}");
+}
+
+void test_named_columns(void) {
+    char zOut[1024];
+    open_graph_db("named_columns");
+
+    // With a query argument the table has one column per RETURN item
+    int rc = sqlite3_exec(db,
+        "CREATE VIRTUAL TABLE people USING cypher("
+        "'MATCH (n:Person) WHERE n.age > 26 RETURN n.name, n.age AS age')",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL_MESSAGE(SQLITE_OK, rc, sqlite3_errmsg(db));
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows("SELECT \"n.name\", age FROM people", zOut, sizeof(zOut)));
+    TEST_ASSERT_EQUAL_STRING("Alice|30;Carol|35", zOut);
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows("SELECT sum(age) FROM people", zOut, sizeof(zOut)));
+    TEST_ASSERT_EQUAL_STRING("65", zOut);
+}
+
+void test_pattern_joins(void) {
+    char zOut[1024];
+    open_graph_db("pattern_joins");
+
+    // Comma patterns sharing a variable are hash joined on it, and never
+    // bind two of their relationship variables to the same edge
+    assert_cypher("MATCH (a:Person)-[r1:LIVES_IN]->(c), (b:Person)-[r2:LIVES_IN]->(c) "
+                  "RETURN a.name, b.name, c.name",
+        "{\"a.name\":\"Alice\",\"b.name\":\"Carol\",\"c.name\":\"Paris\"};"
+        "{\"a.name\":\"Carol\",\"b.name\":\"Alice\",\"c.name\":\"Paris\"}");
+    assert_cypher("MATCH (a)-[r1:KNOWS]->(b), (c)-[r2:KNOWS]->(d) RETURN a.name, c.name",
+        "{\"a.name\":\"Alice\",\"c.name\":\"Bob\"};{\"a.name\":\"Bob\",\"c.name\":\"Alice\"}");
+    assert_cypher("MATCH (a)-[r:KNOWS]->(b), (b)-[r:KNOWS]->(c) RETURN a.name", "");
+    assert_cypher("MATCH (a)-[r:KNOWS*1..2]->(b), (c)-[s:KNOWS]->(b) RETURN a.name", "");
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "SELECT cypher_plan('MATCH (a)-[:LIVES_IN]->(c), (b)-[:LIVES_IN]->(c) RETURN a, b')",
+        zOut, sizeof(zOut)));
+    TEST_ASSERT_NOT_NULL(strstr(zOut, "HashJoin(on=c "));
+
+    // Unrelated patterns form a cross product
+    assert_cypher("MATCH (a:Person), (b:City) RETURN a.name, b.name",
+        "{\"a.name\":\"Alice\",\"b.name\":\"Paris\"};"
+        "{\"a.name\":\"Bob\",\"b.name\":\"Paris\"};"
+        "{\"a.name\":\"Carol\",\"b.name\":\"Paris\"}");
+    assert_cypher("MATCH (a:Person), (b:Nothing) RETURN a.name", "");
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "SELECT cypher_plan('MATCH (a:Person), (b:City) RETURN a, b')", zOut, sizeof(zOut)));
+    TEST_ASSERT_NOT_NULL(strstr(zOut, "NestedLoopJoin("));
+    TEST_ASSERT_NULL(strstr(zOut, "HashJoin"));
+}
+
+void test_expand(void) {
+    open_graph_db("expand");
+
+    assert_cypher("MATCH (a:Person)-[:KNOWS]->(b) RETURN a.name, b.name",
+        "{\"a.name\":\"Alice\",\"b.name\":\"Bob\"};{\"a.name\":\"Bob\",\"b.name\":\"Carol\"}");
+    assert_cypher("MATCH (c:City)<-[:LIVES_IN]-(p) RETURN c.name, p.name",
+        "{\"c.name\":\"Paris\",\"p.name\":\"Alice\"};{\"c.name\":\"Paris\",\"p.name\":\"Carol\"}");
+    assert_cypher("MATCH (a {name: 'Bob'})-[:KNOWS]-(b) RETURN b.name",
+        "{\"b.name\":\"Carol\"};{\"b.name\":\"Alice\"}");
+
+    // Without a type every relationship is followed, and r is bound
+    assert_cypher("MATCH (a:Person {name: 'Alice'})-[r]->(b) RETURN id(r), b.name",
+        "{\"id(r)\":1,\"b.name\":\"Bob\"};{\"id(r)\":3,\"b.name\":\"Paris\"}");
+
+    // Labels and properties on the far node filter the step
+    assert_cypher("MATCH (a:Person)-[:KNOWS]->(b:Person)-[:LIVES_IN]->(c:City) RETURN a.name, c.name",
+        "{\"a.name\":\"Bob\",\"c.name\":\"Paris\"}");
+    assert_cypher("MATCH (a)-[:KNOWS]->(b {name: 'Carol'}) RETURN a.name", "{\"a.name\":\"Bob\"}");
+    assert_cypher("MATCH (a)-[:KNOWS]->(b) WHERE b.age > 30 RETURN a.name", "{\"a.name\":\"Bob\"}");
+
+    // A step back to a bound node only checks the edge (ExpandInto)
+    assert_cypher("MATCH (a)-[:KNOWS]->(b)-[:KNOWS]->(c)-[:LIVES_IN]->(p)<-[:LIVES_IN]-(a) "
+                  "RETURN a.name, c.name, p.name",
+        "{\"a.name\":\"Alice\",\"c.name\":\"Carol\",\"p.name\":\"Paris\"}");
+    assert_cypher("MATCH (a)-[:KNOWS]->(b)-[:KNOWS]->(a) RETURN a.name", "");
+}
+
+void test_var_length_expand(void) {
+    char zOut[1024];
+    open_graph_db("var_length");
+
+    assert_cypher("MATCH (a:Person {name: 'Alice'})-[:KNOWS*]->(b) RETURN b.name",
+        "{\"b.name\":\"Bob\"};{\"b.name\":\"Carol\"}");
+    assert_cypher("MATCH (a:Person {name: 'Alice'})-[:KNOWS*0..1]->(b) RETURN b.name",
+        "{\"b.name\":\"Alice\"};{\"b.name\":\"Bob\"}");
+    assert_cypher("MATCH (a:Person)-[*2..2]->(b) RETURN a.name, b.name",
+        "{\"a.name\":\"Alice\",\"b.name\":\"Carol\"};{\"a.name\":\"Bob\",\"b.name\":\"Paris\"}");
+    assert_cypher("MATCH (a:Person {name: 'Carol'})<-[:KNOWS*1..]-(b) RETURN b.name",
+        "{\"b.name\":\"Bob\"};{\"b.name\":\"Alice\"}");
+    assert_cypher("MATCH (a:Person {name: 'Alice'})-[r:KNOWS*2]->(b) RETURN b.name, size(r)",
+        "{\"b.name\":\"Carol\",\"size(r)\":2}");
+
+    // Every path is produced: Paris is reached directly and through Carol
+    assert_cypher("MATCH (a:Person {name: 'Alice'})-[*1..3]->(b) RETURN b.name",
+        "{\"b.name\":\"Bob\"};{\"b.name\":\"Carol\"};{\"b.name\":\"Paris\"};{\"b.name\":\"Paris\"}");
+
+    // Under DISTINCT each end node is reached once
+    assert_cypher("MATCH (a:Person {name: 'Alice'})-[*1..3]->(b) RETURN DISTINCT b.name",
+        "{\"b.name\":\"Bob\"};{\"b.name\":\"Paris\"};{\"b.name\":\"Carol\"}");
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "SELECT cypher_plan('MATCH (a)-[*1..3]->(b) RETURN DISTINCT b.name')", zOut, sizeof(zOut)));
+    TEST_ASSERT_NOT_NULL(strstr(zOut, " pruned "));
+}
+
+void test_shortest_path(void) {
+    char zOut[1024];
+    open_graph_db("shortest_path");
+
+    assert_cypher("MATCH p = shortestPath((a:Person {name: 'Alice'})-[*]->(b:Person {name: 'Carol'})) "
+                  "RETURN a.name, b.name, length(p)",
+        "{\"a.name\":\"Alice\",\"b.name\":\"Carol\",\"length(p)\":2}");
+    assert_cypher("MATCH p = shortestPath((a:Person {name: 'Bob'})-[*]-(b:Person {name: 'Alice'})) "
+                  "RETURN length(p)",
+        "{\"length(p)\":1}");
+
+    // Direction and type are respected: no KNOWS path leads back to Alice
+    assert_cypher("MATCH p = shortestPath((a:Person {name: 'Bob'})-[:KNOWS*]->(b:Person {name: 'Alice'})) "
+                  "RETURN length(p)", "");
+
+    // Alice reaches Carol through Bob and through Paris
+    assert_cypher("MATCH p = allShortestPaths((a:Person {name: 'Alice'})-[*]-(b:Person {name: 'Carol'})) "
+                  "RETURN length(p)",
+        "{\"length(p)\":2};{\"length(p)\":2}");
+    assert_cypher("MATCH p = shortestPath((a:Person)-[*]->(b:City)) RETURN a.name, length(p)",
+        "{\"a.name\":\"Alice\",\"length(p)\":1};{\"a.name\":\"Bob\",\"length(p)\":2};"
+        "{\"a.name\":\"Carol\",\"length(p)\":1}");
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "SELECT cypher_plan('MATCH p = shortestPath((a)-[*]->(b)) RETURN p')", zOut, sizeof(zOut)));
+    TEST_ASSERT_NOT_NULL(strstr(zOut, "ShortestPath(b p=shortestPath("));
+}
+
+void test_aggregation(void) {
+    open_graph_db("aggregation");
+
+    assert_cypher("MATCH (n:Person) RETURN count(*)", "{\"count(*)\":3}");
+    assert_cypher("MATCH (n:Person) RETURN count(n), avg(n.age)",
+        "{\"count(n)\":3,\"avg(n.age)\":30.0}");
+    assert_cypher("MATCH (n:Person) RETURN count(DISTINCT n.city)",
+        "{\"count(DISTINCT n.city)\":2}");
+
+    // Non-aggregated items group the rows
+    assert_cypher("MATCH (n:Person) RETURN n.city, min(n.age), max(n.age), sum(n.age) ORDER BY n.city",
+        "{\"n.city\":\"London\",\"min(n.age)\":25,\"max(n.age)\":25,\"sum(n.age)\":25};"
+        "{\"n.city\":\"Paris\",\"min(n.age)\":30,\"max(n.age)\":35,\"sum(n.age)\":65}");
+    assert_cypher("MATCH (n:Person) RETURN n.city, count(n) AS c ORDER BY c DESC",
+        "{\"n.city\":\"Paris\",\"c\":2};{\"n.city\":\"London\",\"c\":1}");
+    assert_cypher("MATCH (a:Person)-[:KNOWS]->(b) RETURN a.name, count(b)",
+        "{\"a.name\":\"Alice\",\"count(b)\":1};{\"a.name\":\"Bob\",\"count(b)\":1}");
+
+    // Without grouping keys an empty input still yields one row
+    assert_cypher("MATCH (n:Nothing) RETURN count(n), sum(n.age)",
+        "{\"count(n)\":0,\"sum(n.age)\":0}");
+}
+
+void test_sort(void) {
+    char zOut[1024];
+    open_graph_db("sort");
+
+    assert_cypher("MATCH (n:Person) RETURN n.name ORDER BY n.age DESC",
+        "{\"n.name\":\"Carol\"};{\"n.name\":\"Alice\"};{\"n.name\":\"Bob\"}");
+    assert_cypher("MATCH (n:Person) RETURN n.name, n.city ORDER BY n.city, n.age DESC",
+        "{\"n.name\":\"Bob\",\"n.city\":\"London\"};"
+        "{\"n.name\":\"Carol\",\"n.city\":\"Paris\"};"
+        "{\"n.name\":\"Alice\",\"n.city\":\"Paris\"}");
+    assert_cypher("MATCH (n:Person) RETURN n.age + 1 AS x ORDER BY x DESC",
+        "{\"x\":36};{\"x\":31};{\"x\":26}");
+
+    // ORDER BY followed by LIMIT keeps only the top rows while sorting
+    assert_cypher("MATCH (n:Person) RETURN n.name ORDER BY n.age LIMIT 2",
+        "{\"n.name\":\"Bob\"};{\"n.name\":\"Alice\"}");
+    assert_cypher("MATCH (n:Person) RETURN n.name, n.age * 2 AS d ORDER BY n.age DESC LIMIT 2",
+        "{\"n.name\":\"Carol\",\"d\":70};{\"n.name\":\"Alice\",\"d\":60}");
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "SELECT cypher_plan('MATCH (n:Person) RETURN n.name ORDER BY n.age LIMIT 2')", zOut, sizeof(zOut)));
+    TEST_ASSERT_NOT_NULL(strstr(zOut, "Sort(n by=n.age top=2 "));
+}
+
+void test_distinct_union(void) {
+    char zOut[1024];
+    open_graph_db("distinct_union");
+
+    assert_cypher("MATCH (n:Person) RETURN DISTINCT n.city",
+        "{\"n.city\":\"Paris\"};{\"n.city\":\"London\"}");
+    assert_cypher("MATCH (n:Person) RETURN DISTINCT n.age % 2 AS x ORDER BY x",
+        "{\"x\":0};{\"x\":1}");
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "SELECT cypher_plan('MATCH (n:Person) RETURN DISTINCT n.city')", zOut, sizeof(zOut)));
+    TEST_ASSERT_NOT_NULL(strstr(zOut, "Distinct(n.city "));
+
+    // UNION removes the rows repeated across its sides, UNION ALL keeps them
+    assert_cypher("MATCH (n:Person) RETURN n.city AS name UNION MATCH (c:City) RETURN c.name AS name",
+        "{\"name\":\"Paris\"};{\"name\":\"London\"}");
+    assert_cypher("MATCH (n:Person) RETURN n.city AS name UNION ALL MATCH (c:City) RETURN c.name AS name",
+        "{\"name\":\"Paris\"};{\"name\":\"London\"};{\"name\":\"Paris\"};{\"name\":\"Paris\"}");
+
+    TEST_ASSERT_EQUAL(SQLITE_ERROR, query_rows(
+        "SELECT value FROM cypher('MATCH (n:Person) RETURN n.city UNION MATCH (c:City) RETURN c.name')",
+        zOut, sizeof(zOut)));
+    TEST_ASSERT_NOT_NULL(strstr(zOut, "All sides of a UNION must return the same column names"));
+}
+
+void test_skip_limit(void) {
+    char zOut[1024];
+    open_graph_db("skip_limit");
+
+    assert_cypher("MATCH (n:Person) RETURN n.name LIMIT 2",
+        "{\"n.name\":\"Alice\"};{\"n.name\":\"Bob\"}");
+    assert_cypher("MATCH (n:Person) RETURN n.name SKIP 2", "{\"n.name\":\"Carol\"}");
+    assert_cypher("MATCH (n:Person) RETURN n.name SKIP 1 LIMIT 1", "{\"n.name\":\"Bob\"}");
+    assert_cypher("MATCH (n:Person) RETURN n.name SKIP 5", "");
+    assert_cypher("MATCH (a:Person)-[:KNOWS]->(b) RETURN b.name SKIP 1", "{\"b.name\":\"Carol\"}");
+
+    // A scan feeding the projection directly skips and limits its own rows
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "SELECT cypher_plan('MATCH (n:Person) RETURN n.name SKIP 1 LIMIT 1')", zOut, sizeof(zOut)));
+    TEST_ASSERT_NOT_NULL(strstr(zOut, "LabelIndexScan(n label=Person limit=1 skip=1 "));
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "SELECT cypher_plan('MATCH (n:Person) WHERE n.age > 20 RETURN n.name LIMIT 2')", zOut, sizeof(zOut)));
+    TEST_ASSERT_NOT_NULL(strstr(zOut, "where=age>20 limit=2 skip=0 "));
+
+    // but not when the rows are sorted first
+    assert_cypher("MATCH (n:Person) RETURN n.name ORDER BY n.name DESC SKIP 1 LIMIT 1",
+        "{\"n.name\":\"Bob\"}");
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "SELECT cypher_plan('MATCH (n:Person) RETURN n.name ORDER BY n.name SKIP 1 LIMIT 1')", zOut, sizeof(zOut)));
+    TEST_ASSERT_NOT_NULL(strstr(zOut, "LabelIndexScan(n label=Person cost="));
+}
+
+void test_batches(void) {
+    char zOut[1024];
+    open_graph_db("batches");
+
+    // Enough rows for scans, filters and projections to fill several batches
+    int rc = sqlite3_exec(db,
+        "WITH RECURSIVE seq(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM seq WHERE i < 2500) "
+        "INSERT INTO g_nodes (id, labels, properties) "
+        "SELECT 100 + i, '[\"Item\"]', json_object('v', i) FROM seq;",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "SELECT count(*), sum(json_extract(value, '$.v')) "
+        "FROM cypher('MATCH (n:Item) RETURN n.v AS v')", zOut, sizeof(zOut)));
+    TEST_ASSERT_EQUAL_STRING("2500|3126250", zOut);
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "SELECT count(*), sum(json_extract(value, '$.x')) "
+        "FROM cypher('MATCH (n:Item) WHERE n.v % 3 = 0 RETURN n.v * 2 AS x')", zOut, sizeof(zOut)));
+    TEST_ASSERT_EQUAL_STRING("833|2084166", zOut);
+
+    // Rows after the first batch keep their order
+    assert_cypher("MATCH (n:Item) WHERE n.v > 2497 RETURN n.v",
+        "{\"n.v\":2498};{\"n.v\":2499};{\"n.v\":2500}");
+    assert_cypher("MATCH (n:Item) RETURN count(n), max(n.v)",
+        "{\"count(n)\":2500,\"max(n.v)\":2500}");
+}
+
+void test_variable_slots(void) {
+    open_graph_db("variable_slots");
+
+    // Filters comparing the properties of two bound variables
+    assert_cypher("MATCH (a:Person)-[r:KNOWS]->(b:Person) WHERE a.age < b.age RETURN a.name, b.name",
+        "{\"a.name\":\"Bob\",\"b.name\":\"Carol\"}");
+    assert_cypher("MATCH (a:Person)-[r:KNOWS]->(b:Person) WHERE a.age > b.age RETURN a.name, b.name",
+        "{\"a.name\":\"Alice\",\"b.name\":\"Bob\"}");
+    assert_cypher("MATCH (a:Person)-[:LIVES_IN]->(c) WHERE c.name = a.city RETURN a.name, c.name",
+        "{\"a.name\":\"Alice\",\"c.name\":\"Paris\"};{\"a.name\":\"Carol\",\"c.name\":\"Paris\"}");
+
+    // Every variable of a longer pattern keeps its own binding
+    assert_cypher("MATCH (a)-[:KNOWS]->(b)-[:KNOWS]->(c) RETURN a.name, b.name, c.name",
+        "{\"a.name\":\"Alice\",\"b.name\":\"Bob\",\"c.name\":\"Carol\"}");
+    assert_cypher("MATCH (a:Person)-[r:KNOWS]->(b) RETURN id(r), a.name AS from, b.name AS to",
+        "{\"id(r)\":1,\"from\":\"Alice\",\"to\":\"Bob\"};"
+        "{\"id(r)\":2,\"from\":\"Bob\",\"to\":\"Carol\"}");
+    assert_cypher("MATCH (n:Person) WHERE n.age >= 30 RETURN n.name AS name, n.age AS age ORDER BY age",
+        "{\"name\":\"Alice\",\"age\":30};{\"name\":\"Carol\",\"age\":35}");
+}
+
+void test_expression_programs(void) {
+    open_graph_db("expression_programs");
+
+    assert_cypher("MATCH (n:Person) WHERE n.age * 2 - 10 > 50 RETURN n.name", "{\"n.name\":\"Carol\"}");
+    assert_cypher("MATCH (n:Person) RETURN n.name, n.age / 5 AS q, n.age % 7 AS r",
+        "{\"n.name\":\"Alice\",\"q\":6.0,\"r\":2};"
+        "{\"n.name\":\"Bob\",\"q\":5.0,\"r\":4};"
+        "{\"n.name\":\"Carol\",\"q\":7.0,\"r\":0}");
+    assert_cypher("MATCH (n:Person) WHERE n.age > 26 AND NOT n.city = 'London' OR n.name = 'Bob' "
+                  "RETURN n.name, n.age > 32 AS old",
+        "{\"n.name\":\"Alice\",\"old\":false};"
+        "{\"n.name\":\"Bob\",\"old\":false};"
+        "{\"n.name\":\"Carol\",\"old\":true}");
+
+    // Missing properties are null, and so is any arithmetic over them
+    assert_cypher("MATCH (n:Person) WHERE n.missing > 1 RETURN count(n)", "{\"count(n)\":0}");
+    assert_cypher("MATCH (n:Person) WHERE n.age < 30 RETURN n.missing + 1 AS m, n.age / 0 AS z",
+        "{\"m\":null,\"z\":null}");
+
+    // Lists and functions
+    assert_cypher("MATCH (n:Person) WHERE n.name IN ['Bob', 'Carol'] RETURN n.name",
+        "{\"n.name\":\"Bob\"};{\"n.name\":\"Carol\"}");
+    assert_cypher("MATCH (n:Person) WHERE size(n.name) = 3 RETURN toUpper(n.name)",
+        "{\"toUpper(n.name)\":\"BOB\"}");
+
+    // A rejected row leaves none of its columns in the next one
+    assert_cypher("MATCH (a)-[]-(b) WHERE a.name = 'Bob' RETURN b.name, a.name ORDER BY b.name",
+        "{\"b.name\":\"Alice\",\"a.name\":\"Bob\"};{\"b.name\":\"Carol\",\"a.name\":\"Bob\"}");
+}
+
+// Runs zQuery through cypher_plan() and checks that its plan contains zPart
+static void assert_plan_has(const char *zQuery, const char *zPart) {
+    char zOut[1024];
+    char *zSql = sqlite3_mprintf("SELECT cypher_plan(%Q)", zQuery);
+    TEST_ASSERT_EQUAL_MESSAGE(SQLITE_DONE, query_rows(zSql, zOut, sizeof(zOut)), zOut);
+    sqlite3_free(zSql);
+    TEST_ASSERT_NOT_NULL_MESSAGE(strstr(zOut, zPart), zOut);
+}
+
+void test_scan_pushdown(void) {
+    open_graph_db("scan_pushdown");
+
+    assert_cypher("MATCH (n:Person) WHERE n.age > 30 RETURN n.name", "{\"n.name\":\"Carol\"}");
+    assert_plan_has("MATCH (n:Person) WHERE n.age > 30 RETURN n.name",
+        "[LabelIndexScan(n label=Person where=age>30 ");
+    assert_cypher("MATCH (n:Person) WHERE 30 < n.age RETURN n.name", "{\"n.name\":\"Carol\"}");
+    assert_cypher("MATCH (n) WHERE n.name = 'Paris' RETURN id(n)", "{\"id(n)\":4}");
+    assert_plan_has("MATCH (n) WHERE n.name = 'Paris' RETURN id(n)",
+        "[AllNodesScan(n where=name='Paris' ");
+
+    // Conjunctions and property maps are pushed down together
+    assert_cypher("MATCH (n:Person) WHERE n.age < 35 AND n.city = 'Paris' RETURN n.name",
+        "{\"n.name\":\"Alice\"}");
+    assert_plan_has("MATCH (n:Person) WHERE n.age < 35 AND n.city = 'Paris' RETURN n.name",
+        "where=city='Paris',age<35 ");
+    assert_cypher("MATCH (n:Person {city: 'Paris'}) RETURN n.name",
+        "{\"n.name\":\"Alice\"};{\"n.name\":\"Carol\"}");
+    assert_plan_has("MATCH (n:Person {city: 'Paris'}) RETURN n.name", "where=city='Paris' ");
+
+    // Values keep their type in the scan
+    assert_cypher("MATCH (n:Person) WHERE n.age = '30' RETURN n.name", "");
+    assert_cypher("MATCH (n:Person) WHERE n.age = 30.0 RETURN n.name", "{\"n.name\":\"Alice\"}");
+
+    // Whatever cannot be pushed down stays in a filter above the scan
+    assert_cypher("MATCH (n:Person) WHERE n.age >= 30 AND size(n.name) = 5 RETURN n.name",
+        "{\"n.name\":\"Alice\"};{\"n.name\":\"Carol\"}");
+    assert_plan_has("MATCH (n:Person) WHERE n.age >= 30 AND size(n.name) = 5 RETURN n.name",
+        "[Filter(cost=12.0 rows=100 [LabelIndexScan(n label=Person where=age>=30 ");
+}
+
+void test_pushdown_literals(void) {
+    char zOut[1024];
+    open_graph_db("pushdown_literals");
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "INSERT INTO g_nodes (id, labels, properties) VALUES"
+        " (5, '[\"Person\"]', '{\"name\":\"O''Brien\",\"city\":\"Cork\",\"flag\":true}'),"
+        " (6, '[\"Person\"]', '{\"name\":\"One\",\"flag\":1}')",
+        zOut, sizeof(zOut)));
+
+    // Escaped strings match as the evaluator reads them; the OR keeps the
+    // comparison out of the scan
+    assert_plan_has("MATCH (n:Person) WHERE n.name = 'O\\'Brien' RETURN id(n)",
+        "where=name='O\\'Brien' ");
+    assert_cypher("MATCH (n:Person) WHERE n.name = 'O\\'Brien' RETURN id(n)", "{\"id(n)\":5}");
+    assert_cypher("MATCH (n:Person) WHERE n.name = 'O\\'Brien' OR n.age = -1 RETURN id(n)",
+        "{\"id(n)\":5}");
+    assert_cypher("MATCH (n:Person) WHERE n.name > 'O\\'A' AND n.name < 'O\\'C' RETURN id(n)",
+        "{\"id(n)\":5}");
+
+    // JSON true is not the number 1
+    assert_cypher("MATCH (n:Person) WHERE n.flag = 1 RETURN id(n)", "{\"id(n)\":6}");
+    assert_plan_has("MATCH (n:Person) WHERE n.flag <> 1 RETURN id(n)", "where=flag<>1 ");
+    assert_cypher("MATCH (n:Person) WHERE n.flag <> 1 RETURN id(n)", "{\"id(n)\":5}");
+    assert_cypher("MATCH (n:Person) WHERE n.flag >= 1 RETURN id(n)", "{\"id(n)\":6}");
+
+    // Property index keys are unescaped and typed the same way
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "SELECT graph_create_index('Person', 'name'), graph_create_index('Person', 'flag')",
+        zOut, sizeof(zOut)));
+    assert_plan_has("MATCH (n:Person) WHERE n.name = 'O\\'Brien' RETURN id(n)",
+        "[PropertyIndexScan(n index=g_idx_Person.name key=name='O\\'Brien' ");
+    assert_cypher("MATCH (n:Person) WHERE n.name = 'O\\'Brien' RETURN id(n)", "{\"id(n)\":5}");
+    assert_cypher("MATCH (n:Person) WHERE n.flag = 1 RETURN id(n)", "{\"id(n)\":6}");
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "SELECT graph_create_index('Person', 'name', 'city')", zOut, sizeof(zOut)));
+    assert_plan_has("MATCH (n:Person) WHERE n.name = 'O\\'Brien' AND n.city = 'Cork' RETURN id(n)",
+        "key=name='O\\'Brien',city='Cork' ");
+    assert_cypher("MATCH (n:Person) WHERE n.name = 'O\\'Brien' AND n.city = 'Cork' RETURN id(n)",
+        "{\"id(n)\":5}");
+}
+
+void test_property_types(void) {
+    char zOut[1024];
+    open_graph_db("property_types");
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "INSERT INTO g_nodes (id, labels, properties) VALUES"
+        " (5, '[\"Person\"]', '{\"name\":\"Eve\",\"flag\":true,"
+        "\"tags\":[\"a\",\"b\\\"c\"],\"meta\":{\"k\":[1,2.5,null]}}'),"
+        " (6, '[\"Person\"]', '{\"name\":\"One\",\"flag\":1}'),"
+        " (7, '[\"Person\"]', '{\"name\":\"Two\",\"flag\":false}')",
+        zOut, sizeof(zOut)));
+
+    // JSON booleans are booleans, not 1 and 0, whether or not the
+    // comparison is pushed into the scan
+    assert_cypher("MATCH (n:Person) WHERE n.flag = true RETURN id(n)", "{\"id(n)\":5}");
+    assert_cypher("MATCH (n:Person) WHERE n.flag = false RETURN id(n)", "{\"id(n)\":7}");
+    assert_cypher("MATCH (n:Person) WHERE n.flag = 1 RETURN id(n)", "{\"id(n)\":6}");
+    assert_cypher("MATCH (n:Person) WHERE n.flag = 1 OR n.age = -1 RETURN id(n)", "{\"id(n)\":6}");
+    assert_cypher("MATCH (n:Person) WHERE n.flag <> 1 RETURN id(n)",
+        "{\"id(n)\":5};{\"id(n)\":7}");
+    assert_cypher("MATCH (n:Person) WHERE n.flag <> 1 OR n.age = -1 RETURN id(n)",
+        "{\"id(n)\":5};{\"id(n)\":7}");
+    assert_cypher("MATCH (n:Person) WHERE n.flag IN [true, false] RETURN n.flag",
+        "{\"n.flag\":true};{\"n.flag\":false}");
+
+    // Arrays and objects are lists and maps
+    assert_cypher("MATCH (n:Person) WHERE id(n) = 5 RETURN size(n.tags)", "{\"size(n.tags)\":2}");
+    TEST_ASSERT_EQUAL(SQLITE_OK, sqlite3_exec(db,
+        "CREATE VIRTUAL TABLE eve USING cypher("
+        "'MATCH (n:Person) WHERE id(n) = 5 RETURN n.tags AS tags, n.meta AS meta')",
+        NULL, NULL, NULL));
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows("SELECT tags, meta FROM eve", zOut, sizeof(zOut)));
+    TEST_ASSERT_EQUAL_STRING("[\"a\",\"b\\\"c\"]|{\"k\":[1,2.5,null]}", zOut);
+}
+
+void test_value_json(void) {
+    char zOut[1024];
+    open_graph_db("value_json");
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "INSERT INTO g_nodes (id, labels, properties) VALUES"
+        " (5, '[\"Quote\"]', '{\"text\":\"say \\\"hi\\\"\\\\now\",\"tags\":[\"a\",\"b\"],\"meta\":{\"a\\\"b\":1}}')",
+        zOut, sizeof(zOut)));
+
+    // Every value column is a JSON object, whatever its items hold
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "SELECT json_valid(value), json_extract(value, '$.a._type'),"
+        " json_extract(value, '$.a._id'), json_extract(value, '$.r._type'),"
+        " json_extract(value, '$.r._id') FROM cypher("
+        "'MATCH (a)-[r:KNOWS]->(b) WHERE a.name = ''Bob'' RETURN a, r')",
+        zOut, sizeof(zOut)));
+    TEST_ASSERT_EQUAL_STRING("1|node|2|relationship|2", zOut);
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "SELECT json_valid(value), json_extract(value, '$.p.nodes'),"
+        " json_extract(value, '$.p.length') FROM cypher("
+        "'MATCH p = shortestPath((a)-[:KNOWS*]->(b))"
+        " WHERE a.name = ''Alice'' AND b.name = ''Carol'' RETURN p')",
+        zOut, sizeof(zOut)));
+    TEST_ASSERT_EQUAL_STRING("1|[1,2,3]|2", zOut);
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "SELECT json_valid(value), json_extract(value, '$.t'),"
+        " json_extract(value, '$.\"n.tags\"[1]'), json_extract(value, '$.l[2]')"
+        " FROM cypher('MATCH (n:Quote) RETURN n.text AS t, n.tags, [1, 2.5, ''x''] AS l')",
+        zOut, sizeof(zOut)));
+    TEST_ASSERT_EQUAL_STRING("1|say \"hi\"\\now|b|x", zOut);
+
+    // Floats stay floats and the names of keys are escaped
+    assert_cypher("MATCH (n:Person) WHERE n.name = 'Alice' RETURN n.age / 4.0 AS q, 2.0 AS f",
+        "{\"q\":7.5,\"f\":2.0}");
+    assert_cypher("MATCH (n:Quote) RETURN n.meta", "{\"n.meta\":{\"a\\\"b\":1}}");
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "SELECT json_valid(value), typeof(json_extract(value, '$.f')) FROM cypher("
+        "'MATCH (n:City) RETURN 2.0 AS f')",
+        zOut, sizeof(zOut)));
+    TEST_ASSERT_EQUAL_STRING("1|real", zOut);
+}
+
+// Counts the temporary tables the statements traced create
+static int trace_temp_tables(unsigned int eType, void *pCtx, void *pStmt, void *pSql) {
+    (void)eType; (void)pStmt;
+    if (strstr((const char*)pSql, "CREATE TEMP TABLE")) (*(int*)pCtx)++;
+    return 0;
+}
+
+// Runs zQuery with the default memory budgets and again with every
+// operator spilling, and checks that both give the same rows, sorted
+// first if bSort. Returns the number of spill tables the second run made.
+static int assert_spill_same(const char *zQuery, int bSort) {
+    static char zMemory[32768], zSpill[32768];
+    char zLimit[32];
+    int nTemp = 0;
+    char *zSql = sqlite3_mprintf(bSort ?
+        "SELECT count(*), group_concat(value, ';') FROM (SELECT value FROM cypher(%Q) ORDER BY value)" :
+        "SELECT count(*), group_concat(value, ';') FROM cypher(%Q)", zQuery);
+
+    TEST_ASSERT_EQUAL_MESSAGE(SQLITE_DONE, query_rows(zSql, zMemory, sizeof(zMemory)), zMemory);
+    query_rows("SELECT cypher_spill_limit(1)", zLimit, sizeof(zLimit));
+    sqlite3_trace_v2(db, SQLITE_TRACE_STMT, trace_temp_tables, &nTemp);
+    TEST_ASSERT_EQUAL_MESSAGE(SQLITE_DONE, query_rows(zSql, zSpill, sizeof(zSpill)), zSpill);
+    sqlite3_trace_v2(db, 0, NULL, NULL);
+    query_rows("SELECT cypher_spill_limit(0)", zLimit, sizeof(zLimit));
+    TEST_ASSERT_EQUAL_STRING_MESSAGE(zMemory, zSpill, zQuery);
+    sqlite3_free(zSql);
+    return nTemp;
+}
+
+void test_spill(void) {
+    char zOut[256];
+    open_graph_db("spill");
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "WITH RECURSIVE s(i) AS (SELECT 5 UNION ALL SELECT i + 1 FROM s WHERE i < 400) "
+        "INSERT INTO g_nodes (id, labels, properties) "
+        "SELECT i, '[\"Item\"]', json_object('k', i % 37, 'name', 'item' || i) FROM s",
+        zOut, sizeof(zOut)));
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "WITH RECURSIVE s(i) AS (SELECT 5 UNION ALL SELECT i + 1 FROM s WHERE i < 400) "
+        "INSERT INTO g_edges (from_id, to_id, weight, rel_type) "
+        "SELECT i, 5 + (i * 7) % 396, 1.0, 'LINK' FROM s",
+        zOut, sizeof(zOut)));
+
+    // The budget is set for operators opened afterwards, and reported
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "SELECT cypher_spill_limit(1000), cypher_spill_limit(), cypher_spill_limit(0)",
+        zOut, sizeof(zOut)));
+    TEST_ASSERT_EQUAL_STRING("0|1000|1000", zOut);
+    TEST_ASSERT_EQUAL(SQLITE_ERROR, query_rows("SELECT cypher_spill_limit(-1)", zOut, sizeof(zOut)));
+
+    // Merge sort of spilled runs, the spilled DISTINCT index and the
+    // partitioned hash join all give what they give in memory
+    TEST_ASSERT_TRUE(assert_spill_same(
+        "MATCH (n:Item) RETURN n.k, n.name ORDER BY n.k DESC, n.name", 0) > 0);
+    TEST_ASSERT_TRUE(assert_spill_same("MATCH (n:Item) RETURN DISTINCT n.k", 0) > 0);
+    TEST_ASSERT_TRUE(assert_spill_same(
+        "MATCH (a:Item)-[:LINK]->(b), (c:Item)-[:LINK]->(b) RETURN a.name, c.name", 1) > 0);
+}
+
+void test_bitmap_scan(void) {
+    char zOut[1024];
+    open_graph_db("bitmap_scan");
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "SELECT graph_create_bitmap_index('city'), graph_create_bitmap_index('age')",
+        zOut, sizeof(zOut)));
+
+    assert_plan_has("MATCH (n:Person) WHERE n.city = 'Paris' AND n.age = 30.0 RETURN n.name",
+        "BitmapScan(n label=Person key=age=30.0,city='Paris' ");
+
+    // Numbers match whether written as integers or floats, but not as text
+    assert_cypher("MATCH (n:Person) WHERE n.city = 'Paris' AND n.age = 30.0 RETURN n.name",
+        "{\"n.name\":\"Alice\"}");
+    assert_cypher("MATCH (n:Person) WHERE n.city = 'Paris' AND n.age = 30 RETURN n.name",
+        "{\"n.name\":\"Alice\"}");
+    assert_cypher("MATCH (n:Person) WHERE n.city = 'Paris' AND n.age = '30' RETURN n.name", "");
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "SELECT graph_bitmap_count('Person', 'age', 35.0), graph_bitmap_count('Person', 'age', '35')",
+        zOut, sizeof(zOut)));
+    TEST_ASSERT_EQUAL_STRING("1|0", zOut);
+}
+
+// Returns the logical plan of zQuery in zOut
+static void logical_plan(const char *zQuery, char *zOut, int nOut) {
+    char *zSql = sqlite3_mprintf("SELECT cypher_logical_plan(%Q)", zQuery);
+    TEST_ASSERT_EQUAL_MESSAGE(SQLITE_DONE, query_rows(zSql, zOut, nOut), zOut);
+    sqlite3_free(zSql);
+}
+
+void test_where_folding(void) {
+    char zOut[1024];
+    open_graph_db("where_folding");
+
+    // A WHERE that always holds is dropped
+    logical_plan("MATCH (n:Person) WHERE 1 < 2 AND 'a' = 'a' RETURN n.name", zOut, sizeof(zOut));
+    TEST_ASSERT_EQUAL_STRING("PROJECTION(cost=10.1 rows=1000 [LABEL_SCAN(n cost=10.0 rows=1000))]", zOut);
+    assert_cypher("MATCH (n:Person) WHERE 1 < 2 RETURN count(n)", "{\"count(n)\":3}");
+
+    // One that never holds, false or null, becomes a LIMIT 0
+    logical_plan("MATCH (n:Person) WHERE 2.5 < 1 RETURN n.name", zOut, sizeof(zOut));
+    TEST_ASSERT_NOT_NULL(strstr(zOut, "LIMIT(cost=11.0 rows=0 [LABEL_SCAN"));
+    logical_plan("MATCH (n:Person) WHERE null = 1 OR n.age > 1 AND false RETURN n.name", zOut, sizeof(zOut));
+    TEST_ASSERT_NOT_NULL(strstr(zOut, "LIMIT(cost=11.0 rows=0 [LABEL_SCAN"));
+    assert_cypher("MATCH (n:Person) WHERE 2 < 1 RETURN n.name", "");
+    assert_cypher("MATCH (n:Person) WHERE null = null RETURN n.name", "");
+
+    // A constant operand of AND is dropped
+    logical_plan("MATCH (n:Person) WHERE n.age > 26 AND 1 = 1 RETURN n.name", zOut, sizeof(zOut));
+    TEST_ASSERT_EQUAL_STRING("PROJECTION(cost=11.1 rows=1000 [PROPERTY_FILTER(n cost=11.0 rows=1000 "
+                             "[LABEL_SCAN(n cost=10.0 rows=1000))])]", zOut);
+
+    // A literal on the left is flipped so that the scan can take the filter
+    TEST_ASSERT_EQUAL(SQLITE_DONE, query_rows(
+        "SELECT cypher_plan('MATCH (n:Person) WHERE 30 < n.age RETURN n.name')", zOut, sizeof(zOut)));
+    TEST_ASSERT_NOT_NULL(strstr(zOut, "LabelIndexScan(n label=Person where=age>30 "));
+    assert_cypher("MATCH (n:Person) WHERE 30 < n.age RETURN n.name", "{\"n.name\":\"Carol\"}");
+    assert_cypher("MATCH (n:Person) WHERE 30 >= n.age RETURN n.name",
+        "{\"n.name\":\"Alice\"};{\"n.name\":\"Bob\"}");
+
+    // Escaped strings are compared by the executor, unescaped
+    logical_plan("MATCH (n:Person) WHERE 'a\\tb' < 'a b' RETURN n.name", zOut, sizeof(zOut));
+    TEST_ASSERT_NOT_NULL(strstr(zOut, "FILTER("));
+    assert_cypher("MATCH (n:Person) WHERE 'a\\tb' < 'a b' RETURN count(n)", "{\"count(n)\":3}");
+    assert_cypher("MATCH (n:Person) WHERE 'a\\'b' = \"a'b\" RETURN count(n)", "{\"count(n)\":3}");
+}
+
+void test_query_errors(void) {
+    char zOut[1024];
+    open_graph_db("query_errors");
+
+    TEST_ASSERT_EQUAL(SQLITE_ERROR,
+        query_rows("SELECT value FROM cypher('MATCH (n) RETURN collect(n.name)')", zOut, sizeof(zOut)));
+    TEST_ASSERT_NOT_NULL(strstr(zOut, "Unsupported expression: collect"));
+    TEST_ASSERT_EQUAL(SQLITE_ERROR,
+        query_rows("SELECT value FROM cypher('RETURN 1')", zOut, sizeof(zOut)));
+}
+
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_scan_filter_projection);
+    RUN_TEST(test_named_columns);
+    RUN_TEST(test_pattern_joins);
+    RUN_TEST(test_expand);
+    RUN_TEST(test_var_length_expand);
+    RUN_TEST(test_shortest_path);
+    RUN_TEST(test_aggregation);
+    RUN_TEST(test_sort);
+    RUN_TEST(test_distinct_union);
+    RUN_TEST(test_skip_limit);
+    RUN_TEST(test_batches);
+    RUN_TEST(test_variable_slots);
+    RUN_TEST(test_expression_programs);
+    RUN_TEST(test_scan_pushdown);
+    RUN_TEST(test_pushdown_literals);
+    RUN_TEST(test_property_types);
+    RUN_TEST(test_value_json);
+    RUN_TEST(test_spill);
+    RUN_TEST(test_bitmap_scan);
+    RUN_TEST(test_where_folding);
+    RUN_TEST(test_query_errors);
+
+    return UNITY_END();
+}
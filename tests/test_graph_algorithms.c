@@ -0,0 +1,209 @@
+/*
+** test_graph_algorithms.c - Graph algorithm and background job tests
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <sqlite3.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <time.h>
+#include "unity.h"
+
+static sqlite3 *db = NULL;
+static char db_file[256];
+
+// Opens a file-backed database holding graph g:
+// 1 -> 2 -> 3 with weights 1 and 2, and 1 -> 3 with weight 5
+static void open_graph_db(const char *zName) {
+    snprintf(db_file, sizeof(db_file), "test_%s_%ld.db", zName, (long)time(NULL));
+    unlink(db_file);
+
+    int rc = sqlite3_open(db_file, &db);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+
+    rc = sqlite3_enable_load_extension(db, 1);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+
+    rc = sqlite3_load_extension(db, "../build/libgraph.so", "sqlite3_graph_init", NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+
+    rc = sqlite3_exec(db,
+        "CREATE VIRTUAL TABLE g USING graph();"
+        "INSERT INTO g_nodes (id, properties) VALUES (1, '{}'), (2, '{}'), (3, '{}');"
+        "INSERT INTO g_edges (from_id, to_id, weight) VALUES (1, 2, 1.0), (2, 3, 2.0), (1, 3, 5.0);",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+}
+
+// Runs a query returning one integer
+static sqlite3_int64 query_int(const char *zSql) {
+    sqlite3_stmt *stmt;
+    int rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL_MESSAGE(SQLITE_OK, rc, sqlite3_errmsg(db));
+    TEST_ASSERT_EQUAL_MESSAGE(SQLITE_ROW, sqlite3_step(stmt), sqlite3_errmsg(db));
+    sqlite3_int64 iVal = sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return iVal;
+}
+
+// Runs a query returning one text value into zOut, "NULL" for null.
+// Returns the result code of the step.
+static int query_text(const char *zSql, char *zOut, int nOut) {
+    sqlite3_stmt *stmt;
+    int rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL_MESSAGE(SQLITE_OK, rc, sqlite3_errmsg(db));
+    rc = sqlite3_step(stmt);
+    if (rc == SQLITE_ROW) {
+        const char *z = (const char*)sqlite3_column_text(stmt, 0);
+        snprintf(zOut, nOut, "%s", z ? z : "NULL");
+    } else {
+        snprintf(zOut, nOut, "%s", sqlite3_errmsg(db));
+    }
+    sqlite3_finalize(stmt);
+    return rc;
+}
+
+void setUp(void) {
+    db = NULL;
+    db_file[0] = 0;
+}
+
+void tearDown(void) {
+    if (db) {
+        sqlite3_close(db);
+        db = NULL;
+    }
+    if (db_file[0]) unlink(db_file);
+}
+
+void test_job_submit_status_result(void) {
+    char zSql[128], zOut[256];
+    open_graph_db("job_submit");
+
+    sqlite3_int64 iJob = query_int("SELECT graph_job_submit('shortest_path', 1, 3)");
+    TEST_ASSERT_TRUE(iJob > 0);
+
+    // Poll until the job has finished
+    snprintf(zSql, sizeof(zSql), "SELECT graph_job_status(%lld)", iJob);
+    for (int i = 0; i < 500; i++) {
+        TEST_ASSERT_EQUAL(SQLITE_ROW, query_text(zSql, zOut, sizeof(zOut)));
+        if (strcmp(zOut, "done") == 0) break;
+        TEST_ASSERT_TRUE(strcmp(zOut, "pending") == 0 || strcmp(zOut, "running") == 0);
+        usleep(10000);
+    }
+    TEST_ASSERT_EQUAL_STRING("done", zOut);
+
+    // The result is returned once, then the job is released
+    snprintf(zSql, sizeof(zSql), "SELECT graph_job_result(%lld)", iJob);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, query_text(zSql, zOut, sizeof(zOut)));
+    TEST_ASSERT_EQUAL_STRING("[1,2,3]", zOut);
+    snprintf(zSql, sizeof(zSql), "SELECT graph_job_status(%lld)", iJob);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, query_text(zSql, zOut, sizeof(zOut)));
+    TEST_ASSERT_EQUAL_STRING("NULL", zOut);
+    snprintf(zSql, sizeof(zSql), "SELECT graph_job_result(%lld)", iJob);
+    TEST_ASSERT_EQUAL(SQLITE_ERROR, query_text(zSql, zOut, sizeof(zOut)));
+    TEST_ASSERT_EQUAL_STRING("graph_job_result(): unknown job id", zOut);
+}
+
+void test_job_blocking_wait(void) {
+    sqlite3_int64 aJob[12];
+    char zSql[128], zOut[256];
+    open_graph_db("job_wait");
+
+    // More jobs than worker threads; every one still completes
+    for (int i = 0; i < 12; i++) {
+        aJob[i] = query_int(i % 2 ? "SELECT graph_job_submit('bfs', 1)"
+                                  : "SELECT graph_job_submit('pagerank', 0.85, 50)");
+    }
+    for (int i = 11; i >= 0; i--) {
+        snprintf(zSql, sizeof(zSql), "SELECT graph_job_result(%lld, 1)", aJob[i]);
+        TEST_ASSERT_EQUAL(SQLITE_ROW, query_text(zSql, zOut, sizeof(zOut)));
+        if (i % 2) {
+            TEST_ASSERT_EQUAL_STRING("[1,2,3]", zOut);
+        } else {
+            TEST_ASSERT_EQUAL('{', zOut[0]);
+            TEST_ASSERT_NOT_NULL(strstr(zOut, "\"3\":"));
+        }
+    }
+}
+
+void test_job_failing_sql(void) {
+    char zSql[128], zOut[256];
+    open_graph_db("job_error");
+
+    int rc = sqlite3_exec(db, "DROP TABLE g_edges;", NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+
+    // The error of the job's statement is raised by graph_job_result()
+    sqlite3_int64 iJob = query_int("SELECT graph_job_submit('shortest_path', 1, 3)");
+    snprintf(zSql, sizeof(zSql), "SELECT graph_job_result(%lld, 1)", iJob);
+    TEST_ASSERT_EQUAL(SQLITE_ERROR, query_text(zSql, zOut, sizeof(zOut)));
+    TEST_ASSERT_EQUAL_STRING("no such table: g_edges", zOut);
+
+    // and the failed job is released as well
+    snprintf(zSql, sizeof(zSql), "SELECT graph_job_status(%lld)", iJob);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, query_text(zSql, zOut, sizeof(zOut)));
+    TEST_ASSERT_EQUAL_STRING("NULL", zOut);
+}
+
+void test_job_custom_tables(void) {
+    char zSql[128], zOut[256];
+    snprintf(db_file, sizeof(db_file), "test_job_tables_%ld.db", (long)time(NULL));
+    unlink(db_file);
+    TEST_ASSERT_EQUAL(SQLITE_OK, sqlite3_open(db_file, &db));
+    sqlite3_enable_load_extension(db, 1);
+    TEST_ASSERT_EQUAL(SQLITE_OK, sqlite3_load_extension(db, "../build/libgraph.so", "sqlite3_graph_init", NULL));
+
+    // Jobs read the backing tables named by the graph, not g_nodes/g_edges
+    int rc = sqlite3_exec(db,
+        "CREATE VIRTUAL TABLE g USING graph(people, links);"
+        "INSERT INTO people (id, properties) VALUES (1, '{}'), (2, '{}'), (3, '{}');"
+        "INSERT INTO links (from_id, to_id, weight) VALUES (1, 2, 1.0), (2, 3, 2.0), (1, 3, 5.0);",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+
+    sqlite3_int64 iJob = query_int("SELECT graph_job_submit('shortest_path', 1, 3)");
+    snprintf(zSql, sizeof(zSql), "SELECT graph_job_result(%lld, 1)", iJob);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, query_text(zSql, zOut, sizeof(zOut)));
+    TEST_ASSERT_EQUAL_STRING("[1,2,3]", zOut);
+
+    iJob = query_int("SELECT graph_job_submit('pagerank', 0.85, 50)");
+    snprintf(zSql, sizeof(zSql), "SELECT graph_job_result(%lld, 1)", iJob);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, query_text(zSql, zOut, sizeof(zOut)));
+    TEST_ASSERT_NOT_NULL(strstr(zOut, "\"3\":"));
+}
+
+void test_job_submit_errors(void) {
+    char zOut[256];
+    open_graph_db("job_submit_errors");
+
+    TEST_ASSERT_EQUAL(SQLITE_ERROR, query_text("SELECT graph_job_submit('nope')", zOut, sizeof(zOut)));
+    TEST_ASSERT_EQUAL_STRING("graph_job_submit(): unknown algorithm", zOut);
+    TEST_ASSERT_EQUAL(SQLITE_ERROR, query_text("SELECT graph_job_submit('shortest_path', 1)", zOut, sizeof(zOut)));
+    TEST_ASSERT_EQUAL(SQLITE_ERROR, query_text("SELECT graph_job_submit('pagerank', 2.0)", zOut, sizeof(zOut)));
+    TEST_ASSERT_EQUAL_STRING("graph_job_submit(): invalid pagerank parameters", zOut);
+
+    // Jobs open their own connection, which cannot see an in-memory database
+    sqlite3_close(db);
+    unlink(db_file);
+    db_file[0] = 0;
+    TEST_ASSERT_EQUAL(SQLITE_OK, sqlite3_open(":memory:", &db));
+    sqlite3_enable_load_extension(db, 1);
+    TEST_ASSERT_EQUAL(SQLITE_OK, sqlite3_load_extension(db, "../build/libgraph.so", "sqlite3_graph_init", NULL));
+    TEST_ASSERT_EQUAL(SQLITE_OK, sqlite3_exec(db, "CREATE VIRTUAL TABLE g USING graph();", NULL, NULL, NULL));
+    TEST_ASSERT_EQUAL(SQLITE_ERROR, query_text("SELECT graph_job_submit('strongly_connected_components')", zOut, sizeof(zOut)));
+    TEST_ASSERT_EQUAL_STRING("graph_job_submit() requires a file-backed database", zOut);
+}
+
+int main(void) {
+    UNITY_BEGIN();
+
+    RUN_TEST(test_job_submit_status_result);
+    RUN_TEST(test_job_blocking_wait);
+    RUN_TEST(test_job_failing_sql);
+    RUN_TEST(test_job_custom_tables);
+    RUN_TEST(test_job_submit_errors);
+
+    return UNITY_END();
+}
@@ -258,6 +258,724 @@ void test_storage_optimization(void) {
     unlink(db_file);
 }
 
+void test_label_index_maintenance(void) {
+    char db_file[256];
+    snprintf(db_file, sizeof(db_file), "test_label_index_%ld.db", (long)time(NULL));
+    
+    db = create_test_db(db_file);
+    
+    // Plain SQL writes to the node table must keep the label index current
+    int rc = sqlite3_exec(db, 
+        "INSERT INTO nodes (id, labels, properties) VALUES "
+        "(1, '[\"Person\", \"Employee\"]', '{}'), "
+        "(2, 'Person', '{}'), "
+        "(3, '[\"PersonX\"]', '{}');"
+        "INSERT OR REPLACE INTO nodes (id, labels, properties) VALUES (1, '[\"Robot\"]', '{}');"
+        "UPDATE nodes SET labels = '[\"Person\"]' WHERE id = 3;"
+        "DELETE FROM nodes WHERE id = 2;",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    sqlite3_stmt *stmt;
+    rc = sqlite3_prepare_v2(db, 
+        "SELECT group_concat(x.node_id) FROM graph_label_index x "
+        "JOIN graph_labels l ON l.id = x.label_id WHERE l.name = 'Person';",
+        -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    rc = sqlite3_step(stmt);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, rc);
+    TEST_ASSERT_EQUAL_STRING("3", (const char*)sqlite3_column_text(stmt, 0));
+    sqlite3_finalize(stmt);
+    
+    rc = sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM graph_label_index;", -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    rc = sqlite3_step(stmt);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, rc);
+    TEST_ASSERT_EQUAL(2, sqlite3_column_int(stmt, 0));
+    sqlite3_finalize(stmt);
+    
+    sqlite3_close(db);
+    db = NULL;
+    unlink(db_file);
+}
+
+void test_rel_type_index_maintenance(void) {
+    char db_file[256];
+    snprintf(db_file, sizeof(db_file), "test_type_index_%ld.db", (long)time(NULL));
+    
+    db = create_test_db(db_file);
+    
+    // type_id follows rel_type through inserts and updates
+    int rc = sqlite3_exec(db, 
+        "CREATE VIRTUAL TABLE kg USING graph();"
+        "INSERT INTO kg_edges (from_id, to_id, rel_type) VALUES "
+        "(1, 2, 'KNOWS'), (1, 3, 'LIKES'), (2, 3, 'KNOWS');"
+        "UPDATE kg_edges SET rel_type = 'KNOWS' WHERE id = 2;",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    sqlite3_stmt *stmt;
+    rc = sqlite3_prepare_v2(db, 
+        "SELECT COUNT(*) FROM kg_edges e JOIN kg_rel_types t ON t.id = e.type_id "
+        "WHERE t.name = 'KNOWS' AND e.from_id = 1;",
+        -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    rc = sqlite3_step(stmt);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, rc);
+    TEST_ASSERT_EQUAL(2, sqlite3_column_int(stmt, 0));
+    sqlite3_finalize(stmt);
+    
+    // rel_type constraints on the vtab are answered through type_id
+    rc = sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM kg WHERE rel_type = 'LIKES';", -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    rc = sqlite3_step(stmt);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, rc);
+    TEST_ASSERT_EQUAL(0, sqlite3_column_int(stmt, 0));
+    sqlite3_finalize(stmt);
+    
+    sqlite3_close(db);
+    db = NULL;
+    unlink(db_file);
+}
+
+void test_property_index(void) {
+    char db_file[256];
+    snprintf(db_file, sizeof(db_file), "test_prop_index_%ld.db", (long)time(NULL));
+    
+    db = create_test_db(db_file);
+    
+    int rc = sqlite3_exec(db, 
+        "CREATE VIRTUAL TABLE pg USING graph();"
+        "SELECT graph_create_index('Person', 'email');",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    // The label-scoped expression index answers property lookups
+    sqlite3_stmt *stmt;
+    rc = sqlite3_prepare_v2(db, 
+        "EXPLAIN QUERY PLAN SELECT id FROM pg_nodes "
+        "WHERE json_extract(properties, '$.email') = 'a@b.c' "
+        "AND instr(labels, 'Person') > 0;",
+        -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    rc = sqlite3_step(stmt);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, rc);
+    TEST_ASSERT_NOT_NULL(strstr((const char*)sqlite3_column_text(stmt, 3), "pg_idx_Person.email"));
+    sqlite3_finalize(stmt);
+    
+    // A composite index serves equality on country and a range on age
+    rc = sqlite3_exec(db, "SELECT graph_create_index('Person', 'country', 'age');", NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    rc = sqlite3_prepare_v2(db, 
+        "EXPLAIN QUERY PLAN SELECT id FROM pg_nodes "
+        "WHERE json_extract(properties, '$.country') = 'US' "
+        "AND json_extract(properties, '$.age') > 30 "
+        "AND instr(labels, 'Person') > 0;",
+        -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    rc = sqlite3_step(stmt);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, rc);
+    TEST_ASSERT_NOT_NULL(strstr((const char*)sqlite3_column_text(stmt, 3), "pg_idx_Person.country,age (<expr>=? AND <expr>>?)"));
+    sqlite3_finalize(stmt);
+    
+    rc = sqlite3_exec(db, 
+        "SELECT graph_drop_index('Person', 'email');"
+        "SELECT graph_drop_index('Person', 'country', 'age');",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    rc = sqlite3_prepare_v2(db, "SELECT COUNT(*) FROM pg_indexes;", -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    rc = sqlite3_step(stmt);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, rc);
+    TEST_ASSERT_EQUAL(0, sqlite3_column_int(stmt, 0));
+    sqlite3_finalize(stmt);
+    
+    sqlite3_close(db);
+    db = NULL;
+    unlink(db_file);
+}
+
+void test_bitmap_index(void) {
+    char db_file[256];
+    snprintf(db_file, sizeof(db_file), "test_bitmap_index_%ld.db", (long)time(NULL));
+    
+    db = create_test_db(db_file);
+    
+    int rc = sqlite3_exec(db, 
+        "CREATE VIRTUAL TABLE bm USING graph();"
+        "INSERT INTO bm_nodes (id, labels, properties) VALUES "
+        "(1, '[\"Person\"]', '{\"country\":\"US\",\"tier\":\"gold\"}'), "
+        "(2, '[\"Person\"]', '{\"country\":\"US\",\"tier\":\"free\"}'), "
+        "(3, '[\"Person\"]', '{\"country\":\"FR\",\"tier\":\"gold\"}'), "
+        "(4, '[\"Company\"]', '{\"country\":\"US\",\"tier\":\"gold\"}');"
+        "SELECT graph_create_bitmap_index('country');"
+        "SELECT graph_create_bitmap_index('tier');",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    // Label and two property bitmaps intersect to node 1 only
+    sqlite3_stmt *stmt;
+    rc = sqlite3_prepare_v2(db, 
+        "SELECT graph_bitmap_count('Person', 'country', 'US', 'tier', 'gold'), "
+        "graph_bitmap_count(NULL, 'country', 'US', 'tier', 'gold'), "
+        "graph_bitmap_count('Person', 'country', 'DE');",
+        -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    rc = sqlite3_step(stmt);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, rc);
+    TEST_ASSERT_EQUAL(1, sqlite3_column_int(stmt, 0));
+    TEST_ASSERT_EQUAL(2, sqlite3_column_int(stmt, 1));
+    TEST_ASSERT_EQUAL(0, sqlite3_column_int(stmt, 2));
+    sqlite3_finalize(stmt);
+    
+    // Writes invalidate the cached bitmaps
+    rc = sqlite3_exec(db, 
+        "UPDATE bm_nodes SET properties = '{\"country\":\"US\",\"tier\":\"gold\"}' WHERE id = 2;",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    rc = sqlite3_prepare_v2(db, 
+        "SELECT graph_bitmap_count('Person', 'country', 'US', 'tier', 'gold'), "
+        "(SELECT COUNT(*) FROM bm_bitmap_indexes);",
+        -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    rc = sqlite3_step(stmt);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, rc);
+    TEST_ASSERT_EQUAL(2, sqlite3_column_int(stmt, 0));
+    TEST_ASSERT_EQUAL(2, sqlite3_column_int(stmt, 1));
+    sqlite3_finalize(stmt);
+    
+    sqlite3_close(db);
+    db = NULL;
+    unlink(db_file);
+}
+
+void test_range_index(void) {
+    char db_file[256];
+    snprintf(db_file, sizeof(db_file), "test_range_index_%ld.db", (long)time(NULL));
+    
+    db = create_test_db(db_file);
+    
+    int rc = sqlite3_exec(db, 
+        "CREATE VIRTUAL TABLE rg USING graph();"
+        "SELECT graph_create_range_index('Post', 'created', 'date');"
+        "INSERT INTO rg_nodes (id, labels, properties) VALUES "
+        "(1, '[\"Post\"]', '{\"created\":\"2024-03-01\"}'), "
+        "(2, '[\"Post\"]', '{\"created\":\"2023-12-01\"}'), "
+        "(3, '[\"Post\"]', '{\"created\":\"2024-05-01T10:00:00Z\"}'), "
+        "(4, '[\"Post\"]', '{\"created\":\"now\"}');",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    // Inequality and ORDER BY ... DESC are both answered by the index
+    const char *zSql = 
+        "SELECT id FROM rg_nodes "
+        "WHERE julianday(CASE WHEN json_extract(properties, '$.created') "
+        "GLOB '[0-9][0-9][0-9][0-9]-*' THEN json_extract(properties, '$.created') END) "
+        "> julianday('2024-01-01') AND instr(labels, 'Post') > 0 "
+        "ORDER BY julianday(CASE WHEN json_extract(properties, '$.created') "
+        "GLOB '[0-9][0-9][0-9][0-9]-*' THEN json_extract(properties, '$.created') END) DESC";
+    char *zPlan = sqlite3_mprintf("EXPLAIN QUERY PLAN %s", zSql);
+    sqlite3_stmt *stmt;
+    rc = sqlite3_prepare_v2(db, zPlan, -1, &stmt, NULL);
+    sqlite3_free(zPlan);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    rc = sqlite3_step(stmt);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, rc);
+    TEST_ASSERT_NOT_NULL(strstr((const char*)sqlite3_column_text(stmt, 3), "rg_ridx_Post.created"));
+    
+    // No second plan row: the ORDER BY needs no temp b-tree
+    TEST_ASSERT_NOT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    sqlite3_finalize(stmt);
+    
+    rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    TEST_ASSERT_EQUAL(3, sqlite3_column_int(stmt, 0));
+    TEST_ASSERT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    TEST_ASSERT_EQUAL(1, sqlite3_column_int(stmt, 0));
+    TEST_ASSERT_EQUAL(SQLITE_DONE, sqlite3_step(stmt));
+    sqlite3_finalize(stmt);
+    
+    rc = sqlite3_exec(db, "SELECT graph_create_range_index('created', 'text');", NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_ERROR, rc);
+    
+    rc = sqlite3_exec(db, "SELECT graph_drop_range_index('Post', 'created');", NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    sqlite3_close(db);
+    db = NULL;
+    unlink(db_file);
+}
+
+void test_fulltext_index(void) {
+    char db_file[256];
+    snprintf(db_file, sizeof(db_file), "test_fulltext_index_%ld.db", (long)time(NULL));
+    
+    db = create_test_db(db_file);
+    
+    int rc = sqlite3_exec(db, 
+        "CREATE VIRTUAL TABLE fg USING graph();"
+        "INSERT INTO fg_nodes (id, labels, properties) VALUES "
+        "(1, '[\"Doc\"]', '{\"body\":\"graph databases store graph data\"}'), "
+        "(2, '[\"Doc\"]', '{\"body\":\"relational tables\"}'), "
+        "(3, '[\"Note\"]', '{\"body\":\"a graph of notes\"}'), "
+        "(4, '[\"Doc\"]', '{\"body\":42}');"
+        "SELECT graph_create_fulltext_index('body');",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    // Nodes added after the index was created are indexed by the triggers
+    rc = sqlite3_exec(db, 
+        "INSERT INTO fg_nodes (id, labels, properties) VALUES "
+        "(5, '[\"Doc\"]', '{\"body\":\"paragraphs about sqlite\"}');"
+        "UPDATE fg_nodes SET properties = '{\"body\":\"no longer relevant\"}' WHERE id = 1;",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    // Trigram search finds substrings, restricted to the label
+    sqlite3_stmt *stmt;
+    rc = sqlite3_prepare_v2(db, 
+        "SELECT node_id FROM graph_fulltext('Doc', 'body', '\"raph\"') ORDER BY node_id",
+        -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    TEST_ASSERT_EQUAL(5, sqlite3_column_int(stmt, 0));
+    TEST_ASSERT_EQUAL(SQLITE_DONE, sqlite3_step(stmt));
+    sqlite3_finalize(stmt);
+    
+    // Without a label every indexed node is searched
+    rc = sqlite3_prepare_v2(db, 
+        "SELECT node_id, score FROM graph_fulltext(NULL, 'body', 'notes')",
+        -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    TEST_ASSERT_EQUAL(3, sqlite3_column_int(stmt, 0));
+    TEST_ASSERT_TRUE(sqlite3_column_double(stmt, 1) > 0.0);
+    TEST_ASSERT_EQUAL(SQLITE_DONE, sqlite3_step(stmt));
+    sqlite3_finalize(stmt);
+    
+    rc = sqlite3_exec(db, "SELECT node_id FROM graph_fulltext('Doc', 'title', 'x');", NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_ERROR, rc);
+    rc = sqlite3_exec(db, "SELECT graph_create_fulltext_index('Doc', 'body', 'bogus');", NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_ERROR, rc);
+    
+    rc = sqlite3_exec(db, "SELECT graph_drop_fulltext_index('body');", NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    rc = sqlite3_exec(db, "DELETE FROM fg_nodes WHERE id = 5;", NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    sqlite3_close(db);
+    db = NULL;
+    unlink(db_file);
+}
+
+void test_vector_index(void) {
+    char db_file[256];
+    snprintf(db_file, sizeof(db_file), "test_vector_index_%ld.db", (long)time(NULL));
+    
+    db = create_test_db(db_file);
+    
+    int rc = sqlite3_exec(db, 
+        "CREATE VIRTUAL TABLE vg USING graph();"
+        "WITH RECURSIVE c(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM c WHERE i < 200) "
+        "INSERT INTO vg_nodes (id, labels, properties) "
+        "SELECT i, CASE WHEN i % 2 THEN '[\"Odd\"]' ELSE '[\"Even\"]' END, "
+        "json_object('emb', json_array(i, i % 7, 0.5)) FROM c;"
+        "SELECT graph_create_vector_index('', 'emb', 3);",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    // Wrong-sized vectors are rejected, with the write that holds them
+    rc = sqlite3_exec(db, 
+        "INSERT INTO vg_nodes (id, labels, properties) VALUES "
+        "(201, '[\"Odd\"]', '{\"emb\":[1, 2]}');",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_CONSTRAINT, rc);
+    sqlite3_stmt *stmt;
+    rc = sqlite3_prepare_v2(db, 
+        "SELECT (SELECT count(*) FROM \"vg_hnsw_emb_vectors\"), "
+        "(SELECT count(*) FROM vg_nodes)", -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    TEST_ASSERT_EQUAL(200, sqlite3_column_int(stmt, 0));
+    TEST_ASSERT_EQUAL(200, sqlite3_column_int(stmt, 1));
+    sqlite3_finalize(stmt);
+    rc = sqlite3_exec(db, 
+        "INSERT INTO vg_nodes (id, properties) VALUES (202, '{\"other\":[1, 2]}');"
+        "SELECT graph_create_vector_index('', 'other', 3);",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_ERROR, rc);
+    TEST_ASSERT_EQUAL_STRING("graph_create_vector_index(): a node holds a value "
+                             "that is not a vector of 3 numbers", sqlite3_errmsg(db));
+    rc = sqlite3_exec(db, "SELECT * FROM \"vg_hnsw_other_vectors\";", NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_ERROR, rc);
+    
+    // Nearest neighbours come back closest first
+    rc = sqlite3_prepare_v2(db, 
+        "SELECT node_id, distance FROM graph_knn('', 'emb', '[100, 2, 0.5]', 3)",
+        -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    TEST_ASSERT_EQUAL(100, sqlite3_column_int(stmt, 0));
+    TEST_ASSERT_TRUE(sqlite3_column_double(stmt, 1) == 0.0);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    TEST_ASSERT_TRUE(sqlite3_column_int(stmt, 0) == 99 || sqlite3_column_int(stmt, 0) == 101);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    TEST_ASSERT_EQUAL(SQLITE_DONE, sqlite3_step(stmt));
+    sqlite3_finalize(stmt);
+    
+    // Triggers keep the index current; the label filters the candidates
+    rc = sqlite3_exec(db, 
+        "DELETE FROM vg_nodes WHERE id = 100;"
+        "UPDATE vg_nodes SET properties = '{\"emb\":[500, 0, 0.5]}' WHERE id = 7;",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    rc = sqlite3_prepare_v2(db, 
+        "SELECT node_id FROM graph_knn('Odd', 'emb', '[480, 0, 0.5]', 2, 50)",
+        -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    TEST_ASSERT_EQUAL(7, sqlite3_column_int(stmt, 0));
+    TEST_ASSERT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    TEST_ASSERT_EQUAL(199, sqlite3_column_int(stmt, 0));
+    TEST_ASSERT_EQUAL(SQLITE_DONE, sqlite3_step(stmt));
+    sqlite3_finalize(stmt);
+    
+    // Cosine distance ignores magnitude
+    rc = sqlite3_exec(db, "SELECT graph_create_vector_index('Even', 'emb', 3, 'cosine');", NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    rc = sqlite3_prepare_v2(db, 
+        "SELECT node_id FROM graph_knn('Even', 'emb', '[0.8, 0.1, 0.05]', 1)",
+        -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    TEST_ASSERT_EQUAL(8, sqlite3_column_int(stmt, 0));
+    sqlite3_finalize(stmt);
+    
+    rc = sqlite3_exec(db, "SELECT node_id FROM graph_knn('', 'emb', '[1, 2]');", NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_MISMATCH, rc);
+    rc = sqlite3_exec(db, "SELECT graph_create_vector_index('', 'emb', 3, 'manhattan');", NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_ERROR, rc);
+    
+    // The triggers are plain SQL: they run with an untrusted schema, and
+    // connections without the extension can write indexed nodes
+    rc = sqlite3_exec(db, 
+        "PRAGMA trusted_schema = OFF;"
+        "UPDATE vg_nodes SET properties = '{\"emb\":[3, 3, 0.5]}' WHERE id = 3;"
+        "PRAGMA trusted_schema = ON;",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL_MESSAGE(SQLITE_OK, rc, sqlite3_errmsg(db));
+    sqlite3 *db2;
+    TEST_ASSERT_EQUAL(SQLITE_OK, sqlite3_open(db_file, &db2));
+    rc = sqlite3_exec(db2, 
+        "INSERT INTO vg_nodes (id, properties) VALUES (203, '{\"emb\":[900, 0, 0.5]}');"
+        "DELETE FROM vg_nodes WHERE id = 7;",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL_MESSAGE(SQLITE_OK, rc, sqlite3_errmsg(db2));
+    rc = sqlite3_exec(db2, 
+        "UPDATE vg_nodes SET properties = '{\"emb\":[1, \"x\", 3]}' WHERE id = 3;",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_CONSTRAINT, rc);
+    sqlite3_close(db2);
+    
+    // The index catches up with their writes
+    rc = sqlite3_prepare_v2(db, 
+        "SELECT node_id FROM graph_knn('', 'emb', '[600, 0, 0.5]', 2)",
+        -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    TEST_ASSERT_EQUAL(203, sqlite3_column_int(stmt, 0));
+    TEST_ASSERT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    TEST_ASSERT_EQUAL(200, sqlite3_column_int(stmt, 0));
+    sqlite3_finalize(stmt);
+    rc = sqlite3_prepare_v2(db, 
+        "SELECT (SELECT count(*) FROM \"vg_hnsw_emb_vectors\"), "
+        "(SELECT count(*) FROM \"vg_hnsw_emb_pending\")", -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    TEST_ASSERT_EQUAL(199, sqlite3_column_int(stmt, 0));
+    TEST_ASSERT_EQUAL(0, sqlite3_column_int(stmt, 1));
+    sqlite3_finalize(stmt);
+    
+    rc = sqlite3_exec(db, "SELECT graph_drop_vector_index('emb');", NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    rc = sqlite3_exec(db, "DELETE FROM vg_nodes WHERE id = 8;", NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    sqlite3_close(db);
+    db = NULL;
+    unlink(db_file);
+}
+
+// Returns the EXPLAIN QUERY PLAN details of zSql joined by " | "
+static char *query_plan(const char *zSql) {
+    static char zPlan[1024];
+    sqlite3_stmt *stmt;
+    char *zEqp = sqlite3_mprintf("EXPLAIN QUERY PLAN %s", zSql);
+    
+    zPlan[0] = 0;
+    int rc = sqlite3_prepare_v2(db, zEqp, -1, &stmt, NULL);
+    sqlite3_free(zEqp);
+    TEST_ASSERT_EQUAL_MESSAGE(SQLITE_OK, rc, sqlite3_errmsg(db));
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        if (zPlan[0]) strncat(zPlan, " | ", sizeof(zPlan) - strlen(zPlan) - 1);
+        strncat(zPlan, (const char*)sqlite3_column_text(stmt, 3), sizeof(zPlan) - strlen(zPlan) - 1);
+    }
+    sqlite3_finalize(stmt);
+    return zPlan;
+}
+
+void test_vtab_best_index(void) {
+    char db_file[256];
+    snprintf(db_file, sizeof(db_file), "test_best_index_%ld.db", (long)time(NULL));
+    
+    db = create_test_db(db_file);
+    
+    int rc = sqlite3_exec(db, 
+        "CREATE VIRTUAL TABLE bg USING graph();"
+        "INSERT INTO bg_nodes (id, labels, properties) VALUES "
+        "(1, '[\"Person\"]', '{}'), (2, '[\"Person\"]', '{}'), (3, '[\"City\"]', '{}');"
+        "INSERT INTO bg_edges (id, from_id, to_id, rel_type) VALUES "
+        "(1, 1, 2, 'KNOWS'), (2, 1, 3, 'LIVES_IN'), (3, 2, 3, 'LIVES_IN');",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    // idxNum is the scanned tables plus the columns used, constrained ones
+    // included, shifted by 8; idxStr has one code per xFilter argument,
+    // upper case for IN lists
+    TEST_ASSERT_EQUAL_STRING("SCAN bg VIRTUAL TABLE INDEX 515:i",
+                             query_plan("SELECT id FROM bg WHERE id = 3"));
+    TEST_ASSERT_EQUAL_STRING("SCAN bg VIRTUAL TABLE INDEX 515:I",
+                             query_plan("SELECT id FROM bg WHERE id IN (1, 2, 3)"));
+    TEST_ASSERT_EQUAL_STRING("SCAN bg VIRTUAL TABLE INDEX 11266:fy",
+                             query_plan("SELECT to_id FROM bg WHERE from_id = 1 AND rel_type = 'KNOWS'"));
+    TEST_ASSERT_EQUAL_STRING("SCAN bg VIRTUAL TABLE INDEX 11266:fY",
+                             query_plan("SELECT to_id FROM bg WHERE from_id = 1 AND rel_type IN ('KNOWS', 'LIVES_IN')"));
+    
+    // A node-only constraint drops the edge table, and a single table
+    // delivers ORDER BY itself
+    TEST_ASSERT_EQUAL_STRING("SCAN bg VIRTUAL TABLE INDEX 4609:l",
+                             query_plan("SELECT id FROM bg WHERE labels = '[\"City\"]'"));
+    TEST_ASSERT_EQUAL_STRING("SCAN bg VIRTUAL TABLE INDEX 1798:t;from_id",
+                             query_plan("SELECT id, from_id FROM bg WHERE type = 'edge' ORDER BY from_id"));
+    
+    // The IN list is handed to xFilter as a whole
+    sqlite3_stmt *stmt;
+    rc = sqlite3_prepare_v2(db, 
+        "SELECT group_concat(id) FROM (SELECT id FROM bg WHERE type = 'edge' "
+        "AND rel_type IN ('LIVES_IN', 'NOPE') ORDER BY id)",
+        -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    TEST_ASSERT_EQUAL_STRING("2,3", (const char*)sqlite3_column_text(stmt, 0));
+    sqlite3_finalize(stmt);
+    
+    rc = sqlite3_prepare_v2(db, 
+        "SELECT count(*) FROM bg WHERE id IN (1, 3) AND type = 'node'", -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    TEST_ASSERT_EQUAL(2, sqlite3_column_int(stmt, 0));
+    sqlite3_finalize(stmt);
+    
+    sqlite3_close(db);
+    db = NULL;
+    unlink(db_file);
+}
+
+void test_vtab_stat1_estimates(void) {
+    char db_file[256];
+    snprintf(db_file, sizeof(db_file), "test_stat1_%ld.db", (long)time(NULL));
+    
+    db = create_test_db(db_file);
+    
+    int rc = sqlite3_exec(db, 
+        "CREATE VIRTUAL TABLE sg USING graph();"
+        "WITH RECURSIVE c(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM c WHERE i < 200) "
+        "INSERT INTO sg_edges (from_id, to_id, rel_type) SELECT i % 20, i % 10, 'T' FROM c;"
+        "ANALYZE;",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    // The side whose key matches fewer edges per sqlite_stat1 goes outside
+    const char *zJoin = 
+        "SELECT a.id, b.id FROM sg a, sg b "
+        "WHERE a.from_id = 1 AND b.to_id = 7 AND a.to_id = b.from_id";
+    rc = sqlite3_exec(db, 
+        "UPDATE sqlite_stat1 SET stat = '200 100 100' WHERE idx = 'sg_edges_from_type';"
+        "UPDATE sqlite_stat1 SET stat = '200 2 2' WHERE idx = 'sg_edges_to_type';",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    TEST_ASSERT_EQUAL_STRING("SCAN b VIRTUAL TABLE INDEX 3586:o | SCAN a VIRTUAL TABLE INDEX 3586:fo",
+                             query_plan(zJoin));
+    
+    rc = sqlite3_exec(db, 
+        "UPDATE sqlite_stat1 SET stat = '200 2 2' WHERE idx = 'sg_edges_from_type';"
+        "UPDATE sqlite_stat1 SET stat = '200 100 100' WHERE idx = 'sg_edges_to_type';",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    TEST_ASSERT_EQUAL_STRING("SCAN a VIRTUAL TABLE INDEX 3586:f | SCAN b VIRTUAL TABLE INDEX 3586:of",
+                             query_plan(zJoin));
+    
+    sqlite3_close(db);
+    db = NULL;
+    unlink(db_file);
+}
+
+void test_rel_type_without_type_table(void) {
+    char db_file[256];
+    snprintf(db_file, sizeof(db_file), "test_no_type_table_%ld.db", (long)time(NULL));
+    
+    db = create_test_db(db_file);
+    int rc = sqlite3_exec(db, 
+        "CREATE VIRTUAL TABLE tg USING graph();"
+        "INSERT INTO tg_edges (from_id, to_id, rel_type) VALUES (1, 2, 'KNOWS'), (2, 3, 'LIKES');"
+        "DROP TRIGGER tg_rel_types_ai;"
+        "DROP TRIGGER tg_rel_types_au;"
+        "DROP TABLE tg_rel_types;",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    sqlite3_close(db);
+    
+    // A read-only connection cannot recreate the type table, so rel_type
+    // constraints compare the column itself
+    rc = sqlite3_open_v2(db_file, &db, SQLITE_OPEN_READONLY, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    sqlite3_enable_load_extension(db, 1);
+    rc = sqlite3_load_extension(db, "../build/libgraph.so", "sqlite3_graph_init", NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    sqlite3_stmt *stmt;
+    rc = sqlite3_prepare_v2(db, "SELECT to_id FROM tg WHERE rel_type = 'LIKES'", -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL_MESSAGE(SQLITE_OK, rc, sqlite3_errmsg(db));
+    TEST_ASSERT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    TEST_ASSERT_EQUAL(3, sqlite3_column_int(stmt, 0));
+    TEST_ASSERT_EQUAL(SQLITE_DONE, sqlite3_step(stmt));
+    sqlite3_finalize(stmt);
+    
+    sqlite3_close(db);
+    db = NULL;
+    unlink(db_file);
+}
+
+// Records the SQL of the backing table scans the vtab runs, which the
+// trace reports as nested statements prefixed with "-- "
+static char scan_sql[1024];
+
+static int trace_scans(unsigned int type, void *ctx, void *p, void *x) {
+    const char *zSql = (const char*)x;
+    (void)type; (void)ctx; (void)p;
+    if (strstr(zSql, " WHERE 1")) {
+        if (scan_sql[0]) strncat(scan_sql, " | ", sizeof(scan_sql) - strlen(scan_sql) - 1);
+        strncat(scan_sql, zSql, sizeof(scan_sql) - strlen(scan_sql) - 1);
+    }
+    return 0;
+}
+
+void test_vtab_projection(void) {
+    char db_file[256];
+    snprintf(db_file, sizeof(db_file), "test_projection_%ld.db", (long)time(NULL));
+    
+    db = create_test_db(db_file);
+    
+    int rc = sqlite3_exec(db, 
+        "CREATE VIRTUAL TABLE pg USING graph();"
+        "INSERT INTO pg_nodes (id, labels, properties) VALUES (1, '[\"Person\"]', '{\"name\":\"Alice\"}');"
+        "INSERT INTO pg_edges (id, from_id, to_id, rel_type, weight) VALUES (1, 1, 1, 'SELF', 0.5);",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    sqlite3_trace_v2(db, SQLITE_TRACE_STMT, trace_scans, NULL);
+    
+    // Only the columns the statement reads are selected from each table
+    sqlite3_stmt *stmt;
+    scan_sql[0] = 0;
+    rc = sqlite3_prepare_v2(db, "SELECT id, labels, weight FROM pg", -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    TEST_ASSERT_EQUAL_STRING("[\"Person\"]", (const char*)sqlite3_column_text(stmt, 1));
+    TEST_ASSERT_EQUAL(SQLITE_NULL, sqlite3_column_type(stmt, 2));
+    TEST_ASSERT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    TEST_ASSERT_EQUAL(SQLITE_NULL, sqlite3_column_type(stmt, 1));
+    TEST_ASSERT_TRUE(sqlite3_column_double(stmt, 2) == 0.5);
+    TEST_ASSERT_EQUAL(SQLITE_DONE, sqlite3_step(stmt));
+    sqlite3_finalize(stmt);
+    TEST_ASSERT_EQUAL_STRING(
+        "-- SELECT id, labels FROM pg_nodes WHERE 1 | -- SELECT id, weight FROM pg_edges WHERE 1",
+        scan_sql);
+    
+    scan_sql[0] = 0;
+    rc = sqlite3_exec(db, "SELECT to_id FROM pg WHERE type = 'edge'", NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    TEST_ASSERT_EQUAL_STRING("-- SELECT id, to_id FROM pg_edges WHERE 1", scan_sql);
+    
+    sqlite3_trace_v2(db, 0, NULL, NULL);
+    sqlite3_close(db);
+    db = NULL;
+    unlink(db_file);
+}
+
+void test_vtab_lazy_properties(void) {
+    char db_file[256];
+    snprintf(db_file, sizeof(db_file), "test_lazy_props_%ld.db", (long)time(NULL));
+    
+    db = create_test_db(db_file);
+    
+    int rc = sqlite3_exec(db, 
+        "CREATE VIRTUAL TABLE lg USING graph();"
+        "WITH RECURSIVE c(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM c WHERE i < 10) "
+        "INSERT INTO lg_nodes (id, properties) SELECT i, json_object('n', i) FROM c;"
+        "INSERT INTO lg_edges (id, from_id, to_id, properties) VALUES "
+        "(1, 1, 2, '{\"w\":1}'), (2, 2, 3, '{\"w\":2}');",
+        NULL, NULL, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    
+    // A residual filter SQLite applies itself defers the properties column
+    const char *zSql = "SELECT type, id, properties FROM lg WHERE id > 8";
+    TEST_ASSERT_EQUAL_STRING("SCAN lg VIRTUAL TABLE INDEX 33547:", query_plan(zSql));
+    
+    sqlite3_stmt *stmt;
+    rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    TEST_ASSERT_EQUAL(9, sqlite3_column_int(stmt, 1));
+    TEST_ASSERT_EQUAL_STRING("{\"n\":9}", (const char*)sqlite3_column_text(stmt, 2));
+    TEST_ASSERT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    TEST_ASSERT_EQUAL(10, sqlite3_column_int(stmt, 1));
+    TEST_ASSERT_EQUAL_STRING("{\"n\":10}", (const char*)sqlite3_column_text(stmt, 2));
+    TEST_ASSERT_EQUAL(SQLITE_DONE, sqlite3_step(stmt));
+    sqlite3_finalize(stmt);
+    
+    // Node and edge rows each look up their own table
+    rc = sqlite3_prepare_v2(db, 
+        "SELECT type, properties FROM lg WHERE id <= 2 ORDER BY type, id", -1, &stmt, NULL);
+    TEST_ASSERT_EQUAL(SQLITE_OK, rc);
+    TEST_ASSERT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    TEST_ASSERT_EQUAL_STRING("{\"w\":1}", (const char*)sqlite3_column_text(stmt, 1));
+    TEST_ASSERT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    TEST_ASSERT_EQUAL_STRING("{\"w\":2}", (const char*)sqlite3_column_text(stmt, 1));
+    TEST_ASSERT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    TEST_ASSERT_EQUAL_STRING("{\"n\":1}", (const char*)sqlite3_column_text(stmt, 1));
+    TEST_ASSERT_EQUAL(SQLITE_ROW, sqlite3_step(stmt));
+    TEST_ASSERT_EQUAL_STRING("{\"n\":2}", (const char*)sqlite3_column_text(stmt, 1));
+    TEST_ASSERT_EQUAL(SQLITE_DONE, sqlite3_step(stmt));
+    sqlite3_finalize(stmt);
+    
+    sqlite3_close(db);
+    db = NULL;
+    unlink(db_file);
+}
+
 int main(void) {
     UNITY_BEGIN();
     
@@ -265,6 +983,18 @@ int main(void) {
     RUN_TEST(test_large_data_storage);
     RUN_TEST(test_data_integrity_after_crashes);
     RUN_TEST(test_storage_optimization);
+    RUN_TEST(test_label_index_maintenance);
+    RUN_TEST(test_rel_type_index_maintenance);
+    RUN_TEST(test_property_index);
+    RUN_TEST(test_bitmap_index);
+    RUN_TEST(test_range_index);
+    RUN_TEST(test_fulltext_index);
+    RUN_TEST(test_vector_index);
+    RUN_TEST(test_vtab_best_index);
+    RUN_TEST(test_vtab_stat1_estimates);
+    RUN_TEST(test_rel_type_without_type_table);
+    RUN_TEST(test_vtab_projection);
+    RUN_TEST(test_vtab_lazy_properties);
     
     return UNITY_END();
 }